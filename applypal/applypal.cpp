@@ -28,276 +28,683 @@ SOFTWARE.
 //=============================================================================
 
 #include <algorithm>
-#include <set>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 #include <vector>
 #include <iostream>
+#include <memory>
 #include <fstream>
+#include <functional>
 #include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <direct.h>
-#include <io.h>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h> // GetProcessMemoryInfo
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#include <emmintrin.h> // SSE2
+#endif
 
 #include "png.h" // libpng
+#include "zlib.h"
 
 #define STBI_WINDOWS_UTF8
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-//=============================================================================
-
-struct dither_t
-{
-	uint8_t index;
+#include "palcore.h" // palettising core, shared with imgsize
+#include "paltask.h"
+#include "palcpu.h"
+#include "paldeflate.h"
+#include "paltrace.h" // TRACE_ZONE, compiled out unless FRAGMENTS_TRACE or TRACY_ENABLE
+#include "palfind.h" // input wildcards, with ** for every folder below
+#include "palcache.h" // -lutcache, the artefacts kept between runs
+#include "palserve.h" // -serve, jobs from stdin or a pipe
+#include "palverify.h" // -verify, hashes of the outputs before they are encoded
+#include "palwatch.h" // -watch, the inputs remapped again as they are saved
 
-	float err_r;
-	float err_g;
-	float err_b;
-
-	bool is_opaque;
-};
+//=============================================================================
 
-struct dithermap_t
+//
+// colormap_t
+//
+// The source image as rows of RGB or RGBA, 8 bits per channel. It is either a view of
+// the whole buffer that stb_image decoded, read in place, or when streaming a ring of
+// rows filled by the PNG reader. Pixel< N > reads one pixel of an N channel row, so the
+// remap functions are templates on the channel count and never copy the image.
+//
+struct colormap_t
 {
 
 public:
 
-	dither_t* _data_ptr = nullptr;
+	uint8_t* _data_ptr = nullptr;
 	size_t _width = 0;
 	size_t _height = 0;
+	size_t _rows = 0; // all of them, or when streaming a ring with row y in slot y % _rows.
+	size_t _uStride = 0;
+	uint32_t _uChannels = 0; // 3 (RGB) or 4 (RGBA)
+	bool bHasAlpha = false;
+
+	// the pixels after Create, or when streaming the ring; what reads the next source row
+	// (false if it could not), how many have been read, and whether any failed.
+	image_buffer_t _ring;
+	std::function< bool( uint8_t* pRow ) > _fnReadRow;
+	mutable std::atomic< size_t > _uLoaded = 0;
+	mutable std::atomic< bool > _bReadFailed = false;
+	mutable std::mutex _mutexRead;
 
 public:
 
+	// View a decoded image in place. The buffer stays owned by the caller.
+	void CreateView( uint8_t* data, size_t w, size_t h, uint32_t channels )
+	{
+		bHasAlpha = false;
+		_data_ptr = data;
+		_width = w;
+		_height = h;
+		_rows = h;
+		_uChannels = channels;
+		_uStride = w * channels;
+		_uLoaded = h;
+	}
+
+	// Hold a whole RGBA image in a buffer of its own, for its rows to be read into.
 	void Create( size_t w, size_t h )
 	{
+		bHasAlpha = false;
 		_width = w;
 		_height = h;
-		_data_ptr = new dither_t[ w * h + 1 ]; // +1 !
+		_rows = h;
+		_uChannels = 4;
+		_uStride = w * 4;
+		_data_ptr = static_cast< uint8_t* >( _ring.Allocate( _uStride * h ) );
+		_uLoaded = h;
 	}
 
-	dither_t& Element( int x, int y )
+	// Hold only a ring of RGBA rows, read with fnReadRow as Fetch asks for them.
+	void CreateStreamed( size_t w, size_t h, size_t rows, std::function< bool( uint8_t* pRow ) > fnReadRow )
 	{
-		return _data_ptr[ x + y * _width ];
+		bHasAlpha = false;
+		_width = w;
+		_height = h;
+		_rows = std::clamp< size_t >( rows, 1, h );
+		_uChannels = 4;
+		_uStride = w * 4;
+		_data_ptr = static_cast< uint8_t* >( _ring.Allocate( _uStride * _rows ) );
+		_fnReadRow = std::move( fnReadRow );
+		_uLoaded = 0;
+		_bReadFailed = false;
 	}
 
-	const dither_t& Element( int x, int y ) const
+	// Apply the rgb-to-luminance pre-filter to a viewed image, in place.
+	void ApplyLuminance()
 	{
-		return _data_ptr[ x + y * _width ];
+		uint8_t* src = _data_ptr;
+		uint8_t* end = _data_ptr + _uStride * _height;
+		for ( ; src < end; src += _uChannels )
+		{
+			make_lum_rgb( src );
+		}
 	}
-};
 
+	// Set bHasAlpha if any pixel of a viewed RGBA image has alpha below threshold, and so
+	// is transparent.
+	void DetectAlpha( uint8_t threshold )
+	{
+		bHasAlpha = false;
 
-struct color_t
-{
-	union
+		if ( _uChannels == 4 )
+		{
+			const uint8_t* src = _data_ptr + 3;
+			const uint8_t* end = _data_ptr + _uStride * _height;
+			for ( ; src < end && bHasAlpha == false; src += 4 )
+			{
+				if ( *src < threshold ) bHasAlpha = true;
+			}
+		}
+	}
+
+	//
+	// AlphaMask
+	//
+	// Set bit x of aMask (64 pixels a word) where pixel x of RGBA row y has alpha below
+	// threshold. Sixteen pixels at a time, so the remap tests one bit per pixel and can
+	// fill a span of transparent pixels without looking at them.
+	//
+	void AlphaMask( size_t y, uint8_t threshold, std::vector< uint64_t >& aMask ) const
 	{
-		uint32_t value_abgr;
-		uint8_t chan[ 4 ]; // R, G, B, A
-	};
+		aMask.assign( ( _width + 63 ) / 64, 0 );
 
-public:
+		if ( threshold == 0 )
+		{
+			return;
+		}
+
+		const uint8_t* pSrc = Row( y );
+		const __m128i limit = _mm_set1_epi8( char( threshold - 1 ) );
+
+		size_t x = 0;
+		for ( ; x + 16 <= _width; x += 16 )
+		{
+			const __m128i* p = reinterpret_cast< const __m128i* >( pSrc + x * 4 );
+
+			// the alpha of each pixel in the low byte of its lane, then packed to 16 bytes.
+			const __m128i a0 = _mm_srli_epi32( _mm_loadu_si128( p + 0 ), 24 );
+			const __m128i a1 = _mm_srli_epi32( _mm_loadu_si128( p + 1 ), 24 );
+			const __m128i a2 = _mm_srli_epi32( _mm_loadu_si128( p + 2 ), 24 );
+			const __m128i a3 = _mm_srli_epi32( _mm_loadu_si128( p + 3 ), 24 );
+			const __m128i alpha = _mm_packus_epi16( _mm_packs_epi32( a0, a1 ), _mm_packs_epi32( a2, a3 ) );
+
+			// alpha < threshold, unsigned: min( alpha, threshold - 1 ) == alpha.
+			const uint32_t bits = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_min_epu8( alpha, limit ), alpha ) ) );
+			aMask[ x >> 6 ] |= uint64_t( bits ) << ( x & 63 );
+		}
+
+		for ( ; x < _width; ++x )
+		{
+			if ( pSrc[ x * 4 + 3 ] < threshold )
+			{
+				aMask[ x >> 6 ] |= 1ULL << ( x & 63 );
+			}
+		}
+	}
+
+	//
+	// Fetch
+	//
+	// Make sure the rows up to and including y have been read. Rows come from the source
+	// in order, so any rows before y are read too, and the ring has to be big enough
+	// that this does not overwrite a row that is still wanted. Safe to call from several
+	// threads.
+	//
+	void Fetch( size_t y ) const
+	{
+		if ( y < _uLoaded.load( std::memory_order_acquire ) )
+		{
+			return;
+		}
+
+		std::lock_guard< std::mutex > lock( _mutexRead );
+
+		for ( size_t loaded = _uLoaded.load( std::memory_order_relaxed ); loaded <= y && loaded < _height; ++loaded )
+		{
+			if ( _fnReadRow( _data_ptr + ( loaded % _rows ) * _uStride ) == false )
+			{
+				_bReadFailed = true;
+			}
+			_uLoaded.store( loaded + 1, std::memory_order_release );
+		}
+	}
 
-	inline void make_lum()
+	// A streamed row could not be read, so the image is not all there and should not be written.
+	bool ReadFailed() const
 	{
-		// https://en.wikipedia.org/wiki/Relative_luminance
-		const float lum = ( chan[ 0 ] * 0.299f ) + ( chan[ 1 ] * 0.587f ) + ( chan[ 2 ] * 0.114f );
-		const uint8_t g = uint8_t( std::clamp( int( round( lum ) ), 0, 255 ) );
-		chan[ 0 ] = chan[ 1 ] = chan[ 2 ] = g;
+		return _bReadFailed;
 	}
 
-	uint32_t BGR() const { return value_abgr & 0xFFFFFF; }
+	const uint8_t* Row( size_t y ) const
+	{
+		return _data_ptr + ( y % _rows ) * _uStride;
+	}
 
-	void FromDither( dither_t& dither )
+	template < uint32_t N >
+	static inline color_t Pixel( const uint8_t* pRow, size_t x )
 	{
-		chan[ 0 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_r * 255.0f ) ), 0, 255 ) );
-		chan[ 1 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_g * 255.0f ) ), 0, 255 ) );
-		chan[ 2 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_b * 255.0f ) ), 0, 255 ) );
-		chan[ 3 ] = dither.is_opaque ? 0xFF : 0x00;
+		const uint8_t* src = pRow + x * N;
+
+		color_t colour;
+		colour.chan[ 0 ] = src[ 0 ];
+		colour.chan[ 1 ] = src[ 1 ];
+		colour.chan[ 2 ] = src[ 2 ];
+		colour.chan[ 3 ] = ( N == 4 ) ? src[ 3 ] : 0xFF;
+		return colour;
 	}
 
+	//
+	// RunLength
+	//
+	// How many pixels from x (at least 1, at most x1 - x) are the same as pixel x, in all
+	// N channels. 32 bytes are compared at a time; for RGB, 48 bytes against the pixel
+	// repeated 16 times. Flat artwork is mostly runs, so the remap can search once and
+	// fill the run.
+	//
+	template < uint32_t N >
+	static inline size_t RunLength( const uint8_t* pRow, size_t x, size_t x1 )
+	{
+		const uint8_t* src = pRow + x * N;
+		size_t end = x + 1;
+
+		// most pixels of a photo are not repeated, so look at the next one first.
+		if ( end >= x1 || memcmp( pRow + end * N, src, N ) != 0 )
+		{
+			return 1;
+		}
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+		if constexpr ( N == 4 )
+		{
+			uint32_t value;
+			memcpy( &value, src, 4 );
+			const __m128i pattern = _mm_set1_epi32( int( value ) );
+
+			for ( ; end + 8 <= x1; end += 8 )
+			{
+				const __m128i* p = reinterpret_cast< const __m128i* >( pRow + end * 4 );
+				const uint32_t lo = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_loadu_si128( p + 0 ), pattern ) ) );
+				const uint32_t hi = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_loadu_si128( p + 1 ), pattern ) ) );
+				const uint32_t same = lo | ( hi << 16 );
+
+				if ( same != 0xFFFFFFFF )
+				{
+					return end + std::countr_zero( ~same ) / 4 - x;
+				}
+			}
+		}
+		else
+		{
+			alignas( 16 ) uint8_t aPattern[ 48 ];
+			for ( uint32_t i = 0; i < 48; ++i )
+			{
+				aPattern[ i ] = src[ i % 3 ];
+			}
+
+			const __m128i* pattern = reinterpret_cast< const __m128i* >( aPattern );
+
+			for ( ; end + 16 <= x1; end += 16 )
+			{
+				const __m128i* p = reinterpret_cast< const __m128i* >( pRow + end * 3 );
+				const uint64_t b0 = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( p + 0 ), pattern[ 0 ] ) ) );
+				const uint64_t b1 = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( p + 1 ), pattern[ 1 ] ) ) );
+				const uint64_t b2 = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( p + 2 ), pattern[ 2 ] ) ) );
+				const uint64_t same = b0 | ( b1 << 16 ) | ( b2 << 32 );
+
+				if ( same != 0xFFFFFFFFFFFFULL )
+				{
+					return end + std::countr_zero( ~same ) / 3 - x;
+				}
+			}
+		}
+#endif
+
+		for ( ; end < x1 && memcmp( pRow + end * N, src, N ) == 0; ++end )
+		{
+		}
+
+		return end - x;
+	}
 };
 
-struct colormap_t
+//=============================================================================
+
+//
+// async_file_t
+//
+// An output file written in large buffers. A full buffer goes to a thread that writes it
+// while the next one fills, so encoding carries on while the disk catches up. A file
+// smaller than one buffer is written by Close, with no thread at all.
+//
+// Opened with bIfChanged (-ifchanged) the whole file is kept in memory and hashed as it
+// is written. Close then leaves the file on disk alone, time stamp and all, if its
+// "<file>.hash" sidecar has the same hash and still matches the file's size and time;
+// without a sidecar, a file of the same size is compared byte for byte. Otherwise the
+// file is written and the sidecar updated.
+//
+struct async_file_t
 {
 
 public:
 
-	color_t* _data_ptr = nullptr;
-	size_t _width = 0;
-	size_t _height = 0;
-	bool bHasAlpha = false;
+	static constexpr size_t kBufferSize = 1 << 20;
+	static constexpr size_t kMaxQueued = 2; // full buffers waiting for the disk, at most.
+
+private:
+
+	FILE* _fp = nullptr;
+	std::string _strPath; // for Discard.
+	std::vector< uint8_t > _aFill;
+	uint64_t _uSize = 0;
+
+	// -ifchanged
+	std::string _strFile; // while the file is still only in memory.
+	uint64_t _uHash = 0;
+	bool _bUnchanged = false;
+
+	// shared with the thread, under _mutex.
+	std::vector< std::vector< uint8_t > > _aQueue;
+	std::vector< std::vector< uint8_t > > _aSpare;
+	bool _bStop = false;
+	bool _bFailed = false;
+
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _cv;
 
 public:
 
-	void Create( size_t w, size_t h )
+	~async_file_t()
 	{
-		bHasAlpha = false;
-		_width = w;
-		_height = h;
-		_data_ptr = new color_t[ w * h ];
+		Close();
 	}
 
-	void CopyFromLUM( uint8_t* src )
+	bool Open( const std::string& strFile, bool bIfChanged = false )
 	{
-		bHasAlpha = false;
-		color_t* pout = _data_ptr;
-		color_t* pend = _data_ptr + _width * _height;
-		while ( pout < pend )
+		if ( bIfChanged )
 		{
-			pout->chan[ 0 ] = *src++;
-			pout->chan[ 1 ] = *src++;
-			pout->chan[ 2 ] = *src++;
-
-			pout->make_lum();
+			_strFile = strFile;
+			_uHash = kHashBasis;
+			return true;
+		}
 
-			pout->chan[ 3 ] = 0xFF;
-			++pout;
+		if ( fopen_s( &_fp, strFile.c_str(), "wb" ) != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			return false;
 		}
+
+		// the buffers here are big enough already.
+		setvbuf( _fp, nullptr, _IONBF, 0 );
+
+		_strPath = strFile;
+		_aFill.reserve( kBufferSize );
+		return true;
 	}
 
-	void CopyFromLUMalpha( uint8_t* src )
+	void Write( const void* pData, size_t size )
 	{
-		bHasAlpha = false;
-		color_t* pout = _data_ptr;
-		color_t* pend = _data_ptr + _width * _height;
-		while ( pout < pend )
-		{
-			pout->chan[ 0 ] = *src++;
-			pout->chan[ 1 ] = *src++;
-			pout->chan[ 2 ] = *src++;
+		const uint8_t* pBytes = static_cast< const uint8_t* >( pData );
+		_uSize += size;
 
-			pout->make_lum();
+		if ( _strFile.empty() == false )
+		{
+			// FNV-1a
+			for ( size_t i = 0; i < size; ++i )
+			{
+				_uHash = ( _uHash ^ pBytes[ i ] ) * 0x100000001b3ULL;
+			}
 
-			uint8_t alpha = *src++;
+			_aFill.insert( _aFill.end(), pBytes, pBytes + size );
+			return;
+		}
 
-			if ( alpha < 255 ) bHasAlpha = true;
+		while ( size > 0 )
+		{
+			const size_t count = std::min( size, kBufferSize - _aFill.size() );
+			_aFill.insert( _aFill.end(), pBytes, pBytes + count );
+			pBytes += count;
+			size -= count;
 
-			pout->chan[ 3 ] = alpha;
-			++pout;
+			if ( _aFill.size() == kBufferSize )
+			{
+				Submit();
+			}
 		}
 	}
 
-	void CopyFromRGB( uint8_t* src )
+	// Write whatever is left and close the file. Returns false if any write failed.
+	bool Close()
 	{
-		bHasAlpha = false;
-		color_t* pout = _data_ptr;
-		color_t* pend = _data_ptr + _width * _height;
-		while ( pout < pend )
+		if ( _strFile.empty() == false )
+		{
+			return CloseIfChanged();
+		}
+
+		if ( _fp == nullptr )
+		{
+			return ( _bFailed == false );
+		}
+
+		if ( _thread.joinable() )
+		{
+			{
+				std::lock_guard< std::mutex > lock( _mutex );
+				_bStop = true;
+			}
+			_cv.notify_all();
+			_thread.join();
+		}
+
+		if ( _aFill.empty() == false && fwrite( _aFill.data(), 1, _aFill.size(), _fp ) != _aFill.size() )
+		{
+			_bFailed = true;
+		}
+		_aFill.clear();
+
+		if ( fclose( _fp ) != 0 )
 		{
-			pout->chan[ 0 ] = *src++;
-			pout->chan[ 1 ] = *src++;
-			pout->chan[ 2 ] = *src++;
-			pout->chan[ 3 ] = 0xFF;
-			++pout;
+			_bFailed = true;
 		}
+		_fp = nullptr;
+
+		return ( _bFailed == false );
 	}
 
-	void CopyFromRGBA( uint8_t* src )
+	// Give up on the file. What was written of it is removed; with -ifchanged nothing has
+	// been written yet, so the file on disk is left as it was.
+	void Discard()
 	{
-		bHasAlpha = false;
-		color_t* pout = _data_ptr;
-		color_t* pend = _data_ptr + _width * _height;
-		while ( pout < pend )
+		if ( _strFile.empty() == false )
 		{
-			pout->chan[ 0 ] = *src++;
-			pout->chan[ 1 ] = *src++;
-			pout->chan[ 2 ] = *src++;
-
-			uint8_t alpha = *src++;
+			_strFile.clear();
+			_aFill.clear();
+			_aFill.shrink_to_fit();
+			return;
+		}
 
-			if ( alpha < 255 ) bHasAlpha = true;
+		if ( _fp != nullptr )
+		{
+			Close();
 
-			pout->chan[ 3 ] = alpha;
-			++pout;
+			std::error_code ec;
+			std::filesystem::remove( _strPath, ec );
 		}
 	}
 
-	void Plot( int x, int y, color_t value )
+	// bytes written so far, including any still buffered.
+	uint64_t Size() const
 	{
-		_data_ptr[ x + y * _width ] = value;
+		return _uSize;
 	}
 
-	color_t Peek( int x, int y ) const
+	// -ifchanged: Close found the file already held these bytes, and left it.
+	bool Unchanged() const
 	{
-		return _data_ptr[ x + y * _width ];
+		return _bUnchanged;
 	}
-};
 
-struct indexmap_t
-{
+private:
 
-public:
+	static constexpr uint64_t kHashBasis = 0xcbf29ce484222325ULL;
 
-	uint8_t* _data_ptr = nullptr;
-	int _width = 0;
-	int _height = 0;
-	uint32_t _uStride = 0;
-	uint32_t _uBPP = 0;
-	uint32_t _uPixelsPerByte = 0;
+	// a file's size and time stamp, for the sidecar.
+	static bool FileStamp( const std::string& strFile, uint64_t& uSize, int64_t& iTime )
+	{
+		std::error_code ec;
 
-public:
+		const auto mtime = std::filesystem::last_write_time( strFile, ec );
+		if ( ec )
+			return false;
 
-	void Create( int w, int h, uint32_t bpp )
-	{
-		_width = w;
-		_height = h;
-		_uBPP = bpp;
+		const auto size = std::filesystem::file_size( strFile, ec );
+		if ( ec )
+			return false;
 
-		_uPixelsPerByte = 8 / _uBPP;
-		_uStride = ( ( w + ( _uPixelsPerByte - 1 ) ) / _uPixelsPerByte );
-		const uint32_t payload = _uStride * _height;
-		_data_ptr = new uint8_t[ payload ];
+		uSize = static_cast< uint64_t >( size );
+		iTime = static_cast< int64_t >( mtime.time_since_epoch().count() );
+		return true;
 	}
 
-	void Plot( int x, int y, uint8_t value )
+	// Does the file on disk already hold the bytes in _aFill?
+	bool SameOnDisk() const
 	{
-		const int byte_x = x / _uPixelsPerByte; // which byte are we editing?
-		const int frac_x = x - ( byte_x * _uPixelsPerByte ); // which pixel in the byte?
-		const int shift = ( _uPixelsPerByte - 1 - frac_x ) * _uBPP;
+		uint64_t uSize = 0;
+		int64_t iTime = 0;
+
+		if ( FileStamp( _strFile, uSize, iTime ) == false || uSize != _aFill.size() )
+		{
+			return false;
+		}
 
-		uint8_t* byte_ptr = _data_ptr + ( (size_t)y * _uStride ) + byte_x;
+		// the sidecar: hash, size and time stamp, as hex.
+		unsigned long long uSideHash = 0, uSideSize = 0, uSideTime = 0;
 
-		switch ( _uBPP )
+		FILE* fp = nullptr;
+		if ( fopen_s( &fp, ( _strFile + ".hash" ).c_str(), "r" ) == 0 && fp != nullptr )
 		{
+			const bool bRead = ( fscanf( fp, "%llx %llx %llx", &uSideHash, &uSideSize, &uSideTime ) == 3 );
+			fclose( fp );
 
-		case 1:
+			if ( bRead && uSideSize == uSize && uSideTime == static_cast< unsigned long long >( iTime ) )
 			{
-				const uint8_t mask = 0x01 << shift;
-				*byte_ptr = ( *byte_ptr & ~mask ) | ( ( value & 0x01 ) << shift );
+				return ( uSideHash == _uHash );
 			}
-			break;
+		}
+
+		// no sidecar, or the file was changed since: compare the bytes.
+		std::ifstream file( _strFile, std::ios::binary );
+		std::vector< uint8_t > aBuffer( std::min< size_t >( _aFill.size(), kBufferSize ) );
+
+		for ( size_t pos = 0; pos < _aFill.size(); )
+		{
+			const size_t count = std::min( aBuffer.size(), _aFill.size() - pos );
 
-		case 2:
+			if ( !file.read( reinterpret_cast< char* >( aBuffer.data() ), count ) || memcmp( aBuffer.data(), &_aFill[ pos ], count ) != 0 )
 			{
-				const uint8_t mask = 0x03 << shift;
-				*byte_ptr = ( *byte_ptr & ~mask ) | ( ( value & 0x03 ) << shift );
+				return false;
 			}
-			break;
 
-		case 4:
+			pos += count;
+		}
+
+		return true;
+	}
+
+	void WriteSidecar() const
+	{
+		uint64_t uSize = 0;
+		int64_t iTime = 0;
+
+		if ( FileStamp( _strFile, uSize, iTime ) == false )
+		{
+			return;
+		}
+
+		FILE* fp = nullptr;
+		if ( fopen_s( &fp, ( _strFile + ".hash" ).c_str(), "w" ) == 0 && fp != nullptr )
+		{
+			fprintf( fp, "%016llx %llx %llx\n", static_cast< unsigned long long >( _uHash ), static_cast< unsigned long long >( uSize ),
+					 static_cast< unsigned long long >( iTime ) );
+			fclose( fp );
+		}
+	}
+
+	bool CloseIfChanged()
+	{
+		const bool bSame = SameOnDisk();
+
+		if ( bSame == false )
+		{
+			if ( fopen_s( &_fp, _strFile.c_str(), "wb" ) != 0 || _fp == nullptr )
 			{
-				const uint8_t mask = 0x0F << shift;
-				*byte_ptr = ( *byte_ptr & ~mask ) | ( ( value & 0x0F ) << shift );
+				_fp = nullptr;
+				_bFailed = true;
 			}
-			break;
-
-		case 8:
+			else
 			{
-				*byte_ptr = value; // just set!
+				_bFailed = ( fwrite( _aFill.data(), 1, _aFill.size(), _fp ) != _aFill.size() );
+				_bFailed = ( fclose( _fp ) != 0 ) || _bFailed;
+				_fp = nullptr;
 			}
-			break;
+		}
+
+		// a sidecar is (re)written for an unchanged file too, as it may have had none.
+		if ( _bFailed == false )
+		{
+			WriteSidecar();
+		}
 
-		}; // switch ( uBPP )
+		_bUnchanged = bSame;
+		_strFile.clear();
+		_aFill.clear();
+		_aFill.shrink_to_fit();
+
+		return ( _bFailed == false );
 	}
 
-};
+	// Hand the full buffer to the thread, waiting if it is kMaxQueued behind.
+	void Submit()
+	{
+		std::unique_lock< std::mutex > lock( _mutex );
 
-//=============================================================================
+		if ( _thread.joinable() == false )
+		{
+			_thread = std::thread( &async_file_t::WriteQueued, this );
+		}
+
+		_cv.wait( lock, [&]() { return _aQueue.size() < kMaxQueued; } );
+
+		std::vector< uint8_t > aNext;
+		if ( _aSpare.empty() == false )
+		{
+			aNext = std::move( _aSpare.back() );
+			_aSpare.pop_back();
+		}
+
+		_aQueue.push_back( std::move( _aFill ) );
+		_aFill = std::move( aNext );
+		_aFill.clear();
+		_aFill.reserve( kBufferSize );
+
+		lock.unlock();
+		_cv.notify_all();
+	}
+
+	// The thread: write the queued buffers in order until Close.
+	void WriteQueued()
+	{
+		std::unique_lock< std::mutex > lock( _mutex );
+
+		for ( ;; )
+		{
+			_cv.wait( lock, [&]() { return _aQueue.empty() == false || _bStop; } );
+
+			if ( _aQueue.empty() )
+			{
+				return;
+			}
+
+			std::vector< uint8_t > aBuffer = std::move( _aQueue.front() );
+			_aQueue.erase( _aQueue.begin() );
+
+			lock.unlock();
+			const bool bOK = ( fwrite( aBuffer.data(), 1, aBuffer.size(), _fp ) == aBuffer.size() );
+			lock.lock();
+
+			_bFailed = _bFailed || ( bOK == false );
+			_aSpare.push_back( std::move( aBuffer ) );
+			_cv.notify_all();
+		}
+	}
+};
 
 static void png_write_data_fn( png_structp png_ptr, png_bytep p_data, png_size_t size )
 {
-	// Get our FILE pointer, and write data to it.
-	FILE* fp = reinterpret_cast<FILE*>( png_get_io_ptr( png_ptr ) );
-	fwrite( p_data, 1, size, fp );
+	// Get our file, and write data to it. Failures are reported by its Close.
+	async_file_t* pFile = reinterpret_cast< async_file_t* >( png_get_io_ptr( png_ptr ) );
+	pFile->Write( p_data, size );
 }
 
 static void png_flush_data_fn( png_structp png_ptr )
@@ -316,871 +723,6067 @@ static void png_warn_fn( png_structp png_ptr, png_const_charp error_message )
 	printf( "png warning: %s\n", error_message );
 }
 
-//=============================================================================
+static void png_read_warn_fn( png_structp png_ptr, png_const_charp error_message )
+{
+	// stub - stb_image ignores the same problems (e.g. known incorrect sRGB profiles).
+}
 
-static int rgb_color_distance_squared( color_t colour1, color_t colour2 )
+static void png_read_data_fn( png_structp png_ptr, png_bytep p_data, png_size_t size )
 {
-	int x;
-	int delta;
+	// Get our FILE pointer, and read data from it.
+	FILE* fp = reinterpret_cast<FILE*>( png_get_io_ptr( png_ptr ) );
+	if ( fread( p_data, 1, size, fp ) != size )
+	{
+		png_error( png_ptr, "unexpected end of file" );
+	}
+}
 
-	x = static_cast<int>( colour1.chan[ 0 ] ) - static_cast<int>( colour2.chan[ 0 ] );
-	delta = x * x;
+//
+// png_reader_t
+//
+// Reads a PNG a row at a time as 8-bit RGBA, for streaming an image through the remap
+// without decoding all of it first, and for loading PNGs whole (with libpng's SSE2
+// filters, and without stb_image's copy of the file). Only 8 and 16-bit RGB and palette
+// PNGs that are not interlaced are read this way; 16-bit channels keep their top byte, as
+// stb_image does. Anything else is left to stb_image.
+//
+struct png_reader_t
+{
 
-	x = static_cast<int>( colour1.chan[ 1 ] ) - static_cast<int>( colour2.chan[ 1 ] );
-	delta += x * x;
+public:
 
-	x = static_cast<int>( colour1.chan[ 2 ] ) - static_cast<int>( colour2.chan[ 2 ] );
-	delta += x * x;
+	FILE* _fp = nullptr;
+	png_structp _png_ptr = nullptr;
+	png_infop _info_ptr = nullptr;
+	uint32_t _width = 0;
+	uint32_t _height = 0;
+	bool _bHasAlpha = false; // an alpha channel, or a tRNS chunk
+	bool _bLuminance = false;
+	bool _bFailed = false;
 
-	return delta;
-}
+public:
 
-static uint8_t find_nearest_palette_index( const color_t& colour1, std::vector< color_t >& aPalette, size_t palStart )
-{
-	size_t best_index = palStart;
-	int best_score = rgb_color_distance_squared( colour1, aPalette[ palStart ] );
+	~png_reader_t()
+	{
+		Close();
+	}
 
-	for ( size_t i = palStart + 1; i < aPalette.size(); ++i )
+	bool Open( const std::string& strFile, bool bLuminance )
 	{
-		int score = rgb_color_distance_squared( colour1, aPalette[ i ] );
+		if ( fopen_s( &_fp, strFile.c_str(), "rb" ) != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			return false;
+		}
 
-		if ( score <= best_score )
+		png_byte header[ 8 ];
+		if ( fread( header, 1, 8, _fp ) != 8 || png_sig_cmp( header, 0, 8 ) != 0 )
 		{
-			best_score = score;
-			best_index = i;
+			return false;
 		}
-	}
 
-	return (uint8_t)best_index;
-}
+		_png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_read_warn_fn );
+		if ( _png_ptr == nullptr )
+		{
+			return false;
+		}
 
-struct options_t
-{
-	std::string strPaletteFile;
-	std::vector< color_t > aPalette;
+		// up to what PNG itself allows, past libpng's default of a million pixels a side.
+		png_set_user_limits( _png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
 
-	std::set< std::string > aInputFiles;
+		_info_ptr = png_create_info_struct( _png_ptr );
+		if ( _info_ptr == nullptr )
+		{
+			return false;
+		}
 
-	bool bLuminance = false;
-	bool bDither = false;
-	int indexOffset = 0;
-	bool bOpaque = true;
-	int transIndex = 0;
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
 
-	std::string strOutFile;
-	std::string strOutFolder;
-};
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			png_set_read_fn( _png_ptr, _fp, png_read_data_fn );
+			png_set_sig_bytes( _png_ptr, 8 );
 
-//=============================================================================
+			// like stb_image, do not spend time checking the CRCs and zlib checksum.
+			png_set_crc_action( _png_ptr, PNG_CRC_QUIET_USE, PNG_CRC_QUIET_USE );
+#ifdef PNG_IGNORE_ADLER32
+			png_set_option( _png_ptr, PNG_IGNORE_ADLER32, PNG_OPTION_ON );
+#endif
+			png_read_info( _png_ptr, _info_ptr );
 
-//
-// print_hello
-//
-// Print hello text
-//
-static void print_hello()
-{
-	printf( "\n-----------------------------------------------------------------------\n"
-			" Apply Palette to Image (c) David Walters. See LICENSE.txt for details\n"
-			"-----------------------------------------------------------------------\n\n" );
-}
+			const int colour_type = png_get_color_type( _png_ptr, _info_ptr );
 
-//
-// print_help
-//
-// Print help text
-//
-static void print_help()
-{
-	// Usage
-	printf( " USAGE: applypal.exe [-?] [-dither] [-opaque|-transp[=<remap>]]\n" );
-	printf( "             [-lum] -pal <palette> [-addidx <offset>] <image>[...]\n" );
-	printf( "             [-o <image>]|[-outdir <folder>]\n\n" );
-	putchar( '\n' );
+			// grey images are rejected (as 1 or 2 channel) by the stb_image path.
+			if ( ( colour_type & PNG_COLOR_MASK_COLOR ) == 0 || png_get_interlace_type( _png_ptr, _info_ptr ) != PNG_INTERLACE_NONE )
+			{
+				return false;
+			}
 
-	// Options
-	printf( "  -?                 This help.\n" );
-	printf( "  -dither            Apply error-diffusion dithering to output.\n" );
-	printf( "  -opaque            All palette indices are opaque [default]\n" );
-	printf( "  -transp[=<remap>]  Make palette index 0 transparent, remap to <remap>.\n" );
-	printf( "  -lum               Apply rgb-to-luminance pre-filter to all inputs.\n" );
+			_width = png_get_image_width( _png_ptr, _info_ptr );
+			_height = png_get_image_height( _png_ptr, _info_ptr );
+			_bHasAlpha = ( colour_type & PNG_COLOR_MASK_ALPHA ) || png_get_valid( _png_ptr, _info_ptr, PNG_INFO_tRNS );
+			_bLuminance = bLuminance;
 
-	putchar( '\n' );
-	printf( "  -pal <palette>     Palette file to use (in .HEX format)\n" );
-	printf( "  -addidx <offset>   Apply a fixed offset to palette indices.\n" );
-	putchar( '\n' );
-	printf( "  <image>[...]       Add image(s) to the processing list. Wildcards supported.\n" );
-	putchar( '\n' );
-	printf( "  -o <file>          Specify an output file. Not supported with multiple images.\n" );
-	printf( "  -outdir <folder>   Specify an output folder. Ignored if -o is used.\n" );
-	putchar( '\n' );
+			// to 8-bit RGBA.
+			png_set_expand( _png_ptr );
+			png_set_strip_16( _png_ptr );
+			png_set_filler( _png_ptr, 0xFF, PNG_FILLER_AFTER );
+			png_read_update_info( _png_ptr, _info_ptr );
 
-	putchar( '\n' );
-}
+			if ( png_get_rowbytes( _png_ptr, _info_ptr ) != size_t( _width ) * 4 )
+			{
+				return false;
+			}
+
+			return true;
+		}
 
-//
-// load_palette
-//
-// Parse a .hex file output by "aseprite". A simple list of \n separated 6 byte ASCII hex values.
-//
-static bool load_palette( const char* szFileName, std::vector<color_t>& aPalette )
-{
-	// Load input palette file - keep it open to prevent common user error of overwriting input!
-	std::ifstream fileInput( szFileName );
-	if ( fileInput.is_open() == false )
-	{
 		return false;
 	}
 
-	while ( !fileInput.eof() )
+	// Read the next row, as RGBA, straight into pRow. After an error the rest of the rows are
+	// left black, and false is returned.
+	bool ReadRow( uint8_t* pRow )
 	{
-		std::string line;
-		std::getline( fileInput, line );
+		if ( _bFailed == false )
+		{
+			jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+			if ( setjmp( *p_jmp_buf ) != -1 )
+			{
+				png_read_row( _png_ptr, pRow, nullptr );
+			}
+			else
+			{
+				_bFailed = true;
+			}
+		}
 
-		if ( line.length() != 6 )
+		if ( _bFailed )
 		{
-			break;
+			std::fill( pRow, pRow + size_t( _width ) * 4, uint8_t( 0 ) );
+		}
+		else if ( _bLuminance )
+		{
+			for ( uint32_t x = 0; x < _width; ++x )
+			{
+				make_lum_rgb( pRow + x * 4 );
+			}
 		}
 
-		char* pEnd = nullptr;
-		uint32_t colour = std::strtoul( line.c_str(), &pEnd, 16 );
+		return _bFailed == false;
+	}
+
+	// Read every row into image, made to fit. False if any of them could not be read.
+	bool ReadImage( colormap_t& image )
+	{
+		TRACE_ZONE( "decode_png" );
+
+		image.Create( _width, _height );
 
-		if ( pEnd == line.c_str() )
+		for ( size_t y = 0; y < _height; ++y )
 		{
-			break;
+			ReadRow( image._data_ptr + y * image._uStride );
 		}
 
-		color_t c;
-		c.chan[ 0 ] = ( colour >> 16 ) & 0xFF; // RED
-		c.chan[ 1 ] = ( colour >> 8 ) & 0xFF; // GREEN
-		c.chan[ 2 ] = ( colour ) & 0xFF; // BLUE
-		c.chan[ 3 ] = 0xFF; // ALPHA
+		return _bFailed == false;
+	}
+
+	void Close()
+	{
+		if ( _png_ptr != nullptr )
+		{
+			png_destroy_read_struct( &_png_ptr, ( _info_ptr != nullptr ) ? &_info_ptr : nullptr, nullptr );
+			_png_ptr = nullptr;
+			_info_ptr = nullptr;
+		}
 
-		aPalette.push_back( c );
+		if ( _fp != nullptr )
+		{
+			fclose( _fp );
+			_fp = nullptr;
+		}
 	}
+};
 
-	// Usable palette?
-	return ( aPalette.size() >= 2 );
-}
+//=============================================================================
 
 //
-// add_files_wildcard
+// palette_tree_t
 //
-// Add a file to an array. Supports wildcards like *.png, so multiple files may be added.
+// Nearest palette index, via a k-d tree over RGB. Each node splits its entries at the
+// median of the channel with the widest spread, and a query only visits the far side
+// of a split if the splitting plane is no further than the best match so far. Results
+// match a full scan of the palette, including ties going to the last index.
 //
-static void add_files_wildcard( const char* szWildCard, std::set< std::string >& aFiles )
+struct palette_tree_t
 {
-	// printf( "scan input %s\n", szWildCard );
 
-	// split argument into path and file.
-	std::string path = szWildCard;
-	size_t slash_find = path.find_last_of( "/\\", path.npos ); // either kind of path separators
-	if ( slash_find == path.npos )
-	{
-		path.clear();
-	}
-	else
+public:
+
+	struct node_t
 	{
-		path = path.substr( 0, slash_find + 1 );
-		// printf( "from path %s\n", path.c_str() );
-	}
+		uint8_t index;	// palette entry at this node.
+		uint8_t axis;	// R, G or B.
+		int16_t left;	// entries with chan[ axis ] <= this one, -1 if none.
+		int16_t right;	// entries with chan[ axis ] >= this one, -1 if none.
+	};
+
+	const std::vector< color_t >* _pPalette = nullptr;
+	std::vector< node_t > _aNodes;
+	int16_t _root = -1;
 
-	struct _finddata_t fileinfo;
+public:
 
-	// Start the search
-	intptr_t handle = _findfirst( szWildCard, &fileinfo );
-	if ( handle != -1L )
+	void Create( const std::vector< color_t >& aPalette, size_t palStart )
 	{
-		do
+		_pPalette = &aPalette;
+		_aNodes.clear();
+
+		std::vector< uint8_t > aIndices;
+		for ( size_t i = palStart; i < aPalette.size(); ++i )
 		{
-			// A file, not a sub-directory?
-			if ( !( fileinfo.attrib & _A_SUBDIR ) )
-			{
-				std::string filepath;
-				filepath = path + fileinfo.name;
+			aIndices.push_back( uint8_t( i ) );
+		}
 
-				// printf( "found %s\n", filepath.c_str() );
+		_aNodes.reserve( aIndices.size() );
+		_root = Build( aIndices.data(), aIndices.data() + aIndices.size() );
+	}
 
-				aFiles.insert( filepath );
-			}
-		}
-		while ( _findnext( handle, &fileinfo ) == 0 ); // Get the next one
+	inline uint8_t Find( const color_t& colour ) const
+	{
+		int best_score = INT_MAX;
+		int best_index = -1;
 
-		_findclose( handle );
+		Search( _root, colour, best_score, best_index );
+
+		return uint8_t( best_index );
 	}
-}
 
-//
-// process_args
-//
-// Process command line arguments
-//
-static bool process_args( int argc, char** argv, options_t& options )
-{
-	// Command Line State
-	bool bNextArgIsPalette = false;
-	bool bNextArgIsOutFile = false;
-	bool bNextArgIsOutFolder = false;
-	bool bNextArgIsAddIdx = false;
+private:
 
-	// Parse Command Line
-	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
+	int16_t Build( uint8_t* first, uint8_t* last )
 	{
-		const char* szArg = argv[ iarg ];
-
-		if ( bNextArgIsOutFile )
-		{
-			bNextArgIsOutFile = false;
-			options.strOutFile = szArg;
-		}
-		else if ( bNextArgIsOutFolder )
+		if ( first == last )
 		{
-			bNextArgIsOutFolder = false;
-			options.strOutFolder = szArg;
-		}
-		else if ( bNextArgIsAddIdx )
-		{
-			bNextArgIsAddIdx = false;
-			options.indexOffset = atoi( szArg );
+			return -1;
 		}
-		else if ( bNextArgIsPalette )
-		{
-			bNextArgIsPalette = false;
-
-			bool bFailed = false;
 
-			if ( load_palette( szArg, options.aPalette ) == false )
-			{
-				std::cout << "Error - failed to load palette from \"" << szArg << "\"";
-				bFailed = true;
-			}
+		const std::vector< color_t >& aPalette = *_pPalette;
 
-			if ( bFailed == false )
-			{
-				if ( options.aPalette.size() < 2 )
-				{
-					std::cout << "Error - the palette loaded from \"" << szArg << "\" is too small (" << options.aPalette.size() << " entries).\n";
-					bFailed = true;
-				}
-				else if ( options.aPalette.size() > 256 )
-				{
-					std::cout << "Error - the palette loaded from \"" << szArg << "\" has over 256 entries (" << options.aPalette.size() << ") and is too big.\n";
-					bFailed = true;
-				}
-			}
+		// split on the widest channel.
+		int lo[ 3 ] = { 255, 255, 255 };
+		int hi[ 3 ] = { 0, 0, 0 };
 
-			if ( bFailed )
-			{
-				return false;
-			}
-			else
+		for ( const uint8_t* p = first; p != last; ++p )
+		{
+			for ( int c = 0; c < 3; ++c )
 			{
-				options.strPaletteFile = szArg;
+				lo[ c ] = std::min< int >( lo[ c ], aPalette[ *p ].chan[ c ] );
+				hi[ c ] = std::max< int >( hi[ c ], aPalette[ *p ].chan[ c ] );
 			}
 		}
-		else if ( _stricmp( szArg, "-?" ) == 0 )
-		{
-			return false;
-		}
-		else if ( _stricmp( szArg, "-pal" ) == 0 )
-		{
-			bNextArgIsPalette = true;
-		}
-		else if ( _stricmp( szArg, "-addidx" ) == 0 )
-		{
-			bNextArgIsAddIdx = true;
-		}
-		else if ( _stricmp( szArg, "-o" ) == 0 )
+
+		int axis = 0;
+		for ( int c = 1; c < 3; ++c )
 		{
-			bNextArgIsOutFile = true;
+			if ( hi[ c ] - lo[ c ] > hi[ axis ] - lo[ axis ] )
+				axis = c;
 		}
-		else if ( _stricmp( szArg, "-outdir" ) == 0 )
+
+		uint8_t* mid = first + ( last - first ) / 2;
+		std::nth_element( first, mid, last, [ &aPalette, axis ]( uint8_t a, uint8_t b )
+						  {
+							  return aPalette[ a ].chan[ axis ] < aPalette[ b ].chan[ axis ];
+						  } );
+
+		const int16_t node = int16_t( _aNodes.size() );
+		_aNodes.push_back( { *mid, uint8_t( axis ), -1, -1 } );
+
+		const int16_t left = Build( first, mid );
+		const int16_t right = Build( mid + 1, last );
+
+		_aNodes[ node ].left = left;
+		_aNodes[ node ].right = right;
+
+		return node;
+	}
+
+	void Search( int16_t node, const color_t& colour, int& best_score, int& best_index ) const
+	{
+		if ( node < 0 )
 		{
-			bNextArgIsOutFolder = true;
+			return;
 		}
-		else if ( _stricmp( szArg, "-lum" ) == 0 )
+
+		const node_t& n = _aNodes[ node ];
+		const color_t& entry = ( *_pPalette )[ n.index ];
+
+		const int score = rgb_color_distance_squared( colour, entry );
+
+		if ( score < best_score || ( score == best_score && n.index > best_index ) )
 		{
-			options.bLuminance = true;
+			best_score = score;
+			best_index = n.index;
 		}
-		else if ( _stricmp( szArg, "-dither" ) == 0 )
+
+		const int delta = int( colour.chan[ n.axis ] ) - int( entry.chan[ n.axis ] );
+
+		Search( ( delta < 0 ) ? n.left : n.right, colour, best_score, best_index );
+
+		// the far side can still hold an equal score, which may win on index.
+		if ( delta * delta <= best_score )
 		{
-			options.bDither = true;
+			Search( ( delta < 0 ) ? n.right : n.left, colour, best_score, best_index );
 		}
-		else if ( _stricmp( szArg, "-opaque" ) == 0 )
+	}
+};
+
+//
+// palette_exact_t
+//
+// Palette entries by colour, in a small open addressing hash, so a pixel that is
+// exactly a palette colour needs no search. Where entries share a colour the last one
+// is kept, as a search would pick it.
+//
+struct palette_exact_t
+{
+
+public:
+
+	static constexpr uint32_t kEmpty = 0xFFFFFFFF; // keys are BGR, so never this.
+
+	uint32_t _uBits = 0;
+	std::vector< uint32_t > _aKeys;
+	std::vector< uint8_t > _aIndices;
+
+public:
+
+	void Create( const std::vector< color_t >& aPalette, size_t palStart )
+	{
+		// at most a quarter full, so probes are short.
+		_uBits = 4;
+		while ( ( size_t( 1 ) << _uBits ) < aPalette.size() * 4 )
 		{
-			options.bOpaque = true;
+			++_uBits;
 		}
-		else if ( strncmp( szArg, "-transp=", 8 ) == 0 )
+
+		_aKeys.assign( size_t( 1 ) << _uBits, kEmpty );
+		_aIndices.assign( size_t( 1 ) << _uBits, 0 );
+
+		for ( size_t i = palStart; i < aPalette.size(); ++i )
 		{
-			options.bOpaque = false;
-			options.transIndex = atoi( szArg + 8 );
+			const uint32_t key = aPalette[ i ].BGR();
 
-			if ( options.transIndex < 0 || options.transIndex > 255 )
+			size_t slot = Slot( key );
+			while ( _aKeys[ slot ] != kEmpty && _aKeys[ slot ] != key )
 			{
-				printf( "Error - invalid transparent index (%d).\n", options.transIndex );
-				return false;
+				slot = ( slot + 1 ) & ( _aKeys.size() - 1 );
 			}
+
+			_aKeys[ slot ] = key;
+			_aIndices[ slot ] = uint8_t( i );
 		}
-		else if ( _stricmp( szArg, "-transp" ) == 0 )
-		{
-			options.bOpaque = false;
-			options.transIndex = 0;
-		}
-		else
+	}
+
+	inline bool Find( const color_t& colour, uint8_t& index ) const
+	{
+		const uint32_t key = colour.BGR();
+
+		for ( size_t slot = Slot( key ); _aKeys[ slot ] != kEmpty; slot = ( slot + 1 ) & ( _aKeys.size() - 1 ) )
 		{
-			// assume it's input files.
-			add_files_wildcard( szArg, options.aInputFiles );
+			if ( _aKeys[ slot ] == key )
+			{
+				index = _aIndices[ slot ];
+				return true;
+			}
 		}
 
-	}; // for each command line argument
-
-	if ( options.aPalette.empty() )
-	{
-		std::cout << "Error - no palette was loaded.\n";
 		return false;
 	}
 
-	if ( options.aInputFiles.empty() )
+private:
+
+	inline size_t Slot( uint32_t key ) const
 	{
-		std::cout << "Error - no input file(s) specified.\n";
-		return false;
+		return size_t( ( key * 0x9E3779B1u ) >> ( 32 - _uBits ) );
 	}
-
-	return true;
-}
+};
 
 //
-// write_hexfile
+// palette_scan_t
 //
-// Dump the whole palette to disk in .hex format.
+// Full scan of the palette, four entries at a time with SSE2 (eight with AVX2). Entries
+// are stored as int16 (R,G) and (B,0) pairs, so two multiply-adds give four squared
+// distances. Each lane keeps the last index of its lowest score, and the lanes are then
+// combined the same way, so ties still go to the last index. The kernel for cpu_level()
+// is chosen in Create; without SIMD it is the scalar find_nearest_palette_index.
 //
-static void write_hexfile( std::vector< color_t >& aPalette, const std::string& strFileName )
+struct palette_scan_t
 {
-	char buf[ 64 ];
 
-	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+public:
 
-	std::ofstream file( strFileName );
-	if ( file.is_open() )
+	static constexpr int16_t kPadChannel = 1024; // further than any colour, so padding never wins.
+
+	const std::vector< color_t >* _pPalette = nullptr;
+	size_t _palStart = 0;
+	size_t _uGroups = 0;
+
+	std::vector< int16_t > _aRG; // R0, G0, R1, G1, ... per group of 4, padded to an even count of groups.
+	std::vector< int16_t > _aB0; // B0, 0, B1, 0, ... per group of 4.
+
+	uint8_t ( *_pfnFind )( const palette_scan_t& scan, const color_t& colour ) = FindScalar;
+
+public:
+
+	void Create( const palette_t& palette, size_t palStart )
 	{
-		for ( uint32_t i = 0; i < aPalette.size(); ++i )
+		_pPalette = &palette.aColours;
+		_palStart = palStart;
+
+		const size_t count = palette.size() - palStart;
+		_uGroups = ( count + 3 ) / 4;
+
+		const size_t uStored = ( _uGroups + 1 ) & ~size_t( 1 );
+		_aRG.assign( uStored * 8, kPadChannel );
+		_aB0.assign( uStored * 8, 0 );
+
+		for ( size_t i = 0; i < uStored * 4; ++i )
 		{
-			// read BGRA palette entry and convert to RGB
+			_aB0[ i * 2 ] = kPadChannel;
+		}
 
-			const color_t& pal = aPalette[ i ];
-			uint32_t cout;
-			cout = pal.chan[ 0 ] << 16;
-			cout |= pal.chan[ 1 ] << 8;
-			cout |= pal.chan[ 2 ];
+		for ( size_t i = 0; i < count; ++i )
+		{
+			_aRG[ i * 2 + 0 ] = palette.aChan[ 0 ][ palStart + i ];
+			_aRG[ i * 2 + 1 ] = palette.aChan[ 1 ][ palStart + i ];
+			_aB0[ i * 2 + 0 ] = palette.aChan[ 2 ][ palStart + i ];
+		}
 
-			// .hex palette file format
-			sprintf_s( buf, sizeof( buf ), "%06x\n", cout );
+		_pfnFind = FindScalar;
+#if defined( _M_X64 ) || defined( __SSE2__ )
+		if ( cpu_level() >= CPU_SSE2 && cpu_level() != CPU_NEON )
+		{
+			_pfnFind = FindSSE2;
+		}
+#endif
+#if CPU_X86
+		if ( cpu_level() >= CPU_AVX2 && cpu_level() != CPU_NEON )
+		{
+			_pfnFind = FindAVX2;
+		}
+#endif
+	}
 
-			file << buf;
+	inline uint8_t Find( const color_t& colour ) const
+	{
+		return _pfnFind( *this, colour );
+	}
+
+private:
+
+	// the lane of the lowest score, the highest index among equals.
+	static uint8_t BestLane( const palette_scan_t& scan, const int32_t* aScore, const int32_t* aIndex, int lanes )
+	{
+		int lane = 0;
+		for ( int i = 1; i < lanes; ++i )
+		{
+			if ( aScore[ i ] < aScore[ lane ] || ( aScore[ i ] == aScore[ lane ] && aIndex[ i ] > aIndex[ lane ] ) )
+				lane = i;
 		}
 
-		file.close();
-		printf( "OK\n\n" );
+		return uint8_t( scan._palStart + aIndex[ lane ] );
 	}
-	else
+
+	static uint8_t FindScalar( const palette_scan_t& scan, const color_t& colour )
 	{
-		printf( "FAILED\n\n" );
+		return find_nearest_palette_index( colour, *scan._pPalette, scan._palStart );
 	}
-}
 
-//==============================================================================
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	static uint8_t FindSSE2( const palette_scan_t& scan, const color_t& colour )
+	{
+		const __m128i rg = _mm_set1_epi32( int( colour.chan[ 0 ] ) | ( int( colour.chan[ 1 ] ) << 16 ) );
+		const __m128i b0 = _mm_set1_epi32( int( colour.chan[ 2 ] ) );
+		const __m128i four = _mm_set1_epi32( 4 );
 
-static bool make_path( std::string& path )
+		__m128i best_score = _mm_set1_epi32( INT_MAX );
+		__m128i best_index = _mm_setzero_si128();
+		__m128i index = _mm_setr_epi32( 0, 1, 2, 3 );
+
+		for ( size_t g = 0; g < scan._uGroups; ++g )
+		{
+			const __m128i drg = _mm_sub_epi16( _mm_loadu_si128( reinterpret_cast< const __m128i* >( &scan._aRG[ g * 8 ] ) ), rg );
+			const __m128i db = _mm_sub_epi16( _mm_loadu_si128( reinterpret_cast< const __m128i* >( &scan._aB0[ g * 8 ] ) ), b0 );
+			const __m128i score = _mm_add_epi32( _mm_madd_epi16( drg, drg ), _mm_madd_epi16( db, db ) );
+
+			// keep the old best only where it is strictly lower, like the scalar '<='.
+			const __m128i keep = _mm_cmpgt_epi32( score, best_score );
+
+			best_score = _mm_or_si128( _mm_and_si128( keep, best_score ), _mm_andnot_si128( keep, score ) );
+			best_index = _mm_or_si128( _mm_and_si128( keep, best_index ), _mm_andnot_si128( keep, index ) );
+
+			index = _mm_add_epi32( index, four );
+		}
+
+		alignas( 16 ) int32_t aScore[ 4 ];
+		alignas( 16 ) int32_t aIndex[ 4 ];
+		_mm_store_si128( reinterpret_cast< __m128i* >( aScore ), best_score );
+		_mm_store_si128( reinterpret_cast< __m128i* >( aIndex ), best_index );
+
+		return BestLane( scan, aScore, aIndex, 4 );
+	}
+#endif
+
+#if CPU_X86
+	// two groups at a time, over the padding group if there is an odd one.
+	CPU_TARGET_AVX2 static uint8_t FindAVX2( const palette_scan_t& scan, const color_t& colour )
+	{
+		const __m256i rg = _mm256_set1_epi32( int( colour.chan[ 0 ] ) | ( int( colour.chan[ 1 ] ) << 16 ) );
+		const __m256i b0 = _mm256_set1_epi32( int( colour.chan[ 2 ] ) );
+		const __m256i eight = _mm256_set1_epi32( 8 );
+
+		__m256i best_score = _mm256_set1_epi32( INT_MAX );
+		__m256i best_index = _mm256_setzero_si256();
+		__m256i index = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+
+		for ( size_t g = 0; g < scan._uGroups; g += 2 )
+		{
+			const __m256i drg = _mm256_sub_epi16( _mm256_loadu_si256( reinterpret_cast< const __m256i* >( &scan._aRG[ g * 8 ] ) ), rg );
+			const __m256i db = _mm256_sub_epi16( _mm256_loadu_si256( reinterpret_cast< const __m256i* >( &scan._aB0[ g * 8 ] ) ), b0 );
+			const __m256i score = _mm256_add_epi32( _mm256_madd_epi16( drg, drg ), _mm256_madd_epi16( db, db ) );
+
+			const __m256i keep = _mm256_cmpgt_epi32( score, best_score );
+
+			best_score = _mm256_blendv_epi8( score, best_score, keep );
+			best_index = _mm256_blendv_epi8( index, best_index, keep );
+
+			index = _mm256_add_epi32( index, eight );
+		}
+
+		alignas( 32 ) int32_t aScore[ 8 ];
+		alignas( 32 ) int32_t aIndex[ 8 ];
+		_mm256_store_si256( reinterpret_cast< __m256i* >( aScore ), best_score );
+		_mm256_store_si256( reinterpret_cast< __m256i* >( aIndex ), best_index );
+
+		return BestLane( scan, aScore, aIndex, 8 );
+	}
+#endif
+};
+
+//
+// palette_small_t
+//
+// Nearest palette index for a palette of at most K entries from palStart, as a scan of
+// fixed length that the compiler unrolls. Unused entries sit further away than any
+// colour, so they never win. Two entries are one plane between them: entry 1 is nearest
+// where 2 c.(p1 - p0) >= |p1|^2 - |p0|^2. Results match a full scan of the palette,
+// including ties going to the last index.
+//
+template < size_t K >
+struct palette_small_t
 {
-	int e, er;
-	int start = 0;
 
-	// Skip drive?
-	if ( ( path.size() >= 2 ) && ( path[ 1 ] == ':' ) )
+public:
+
+	static constexpr int kPadChannel = 1024; // further than any colour, so padding never wins.
+
+	size_t _palStart = 0;
+	int _aChan[ 3 ][ K ]; // R, G and B of each entry.
+
+	int _aPlane[ 3 ]; // K == 2: p1 - p0,
+	int _iPlaneLimit = 0; // and |p1|^2 - |p0|^2.
+
+public:
+
+	void Create( const palette_t& palette, size_t palStart )
 	{
-		start = 3;
+		_palStart = palStart;
+
+		for ( size_t i = 0; i < K; ++i )
+		{
+			for ( int c = 0; c < 3; ++c )
+			{
+				_aChan[ c ][ i ] = ( palStart + i < palette.size() ) ? palette.aChan[ c ][ palStart + i ] : kPadChannel;
+			}
+		}
+
+		_iPlaneLimit = 0;
+		for ( int c = 0; c < 3; ++c )
+		{
+			_aPlane[ c ] = _aChan[ c ][ K - 1 ] - _aChan[ c ][ 0 ];
+			_iPlaneLimit += _aChan[ c ][ K - 1 ] * _aChan[ c ][ K - 1 ] - _aChan[ c ][ 0 ] * _aChan[ c ][ 0 ];
+		}
 	}
 
-	// Create tree
-	for ( size_t i = start; i < path.size(); ++i )
+	inline uint8_t Find( const color_t& colour ) const
 	{
-		if ( path[ i ] == '\\' || path[ i ] == '/' )
+		if constexpr ( K == 2 )
 		{
-			// Briefly turn into a nul terminated c-string
-			path[ i ] = '\0';
-			e = _mkdir( path.c_str() );
-			er = errno;
-			path[ i ] = '\\';
+			const int dot = colour.chan[ 0 ] * _aPlane[ 0 ] + colour.chan[ 1 ] * _aPlane[ 1 ] + colour.chan[ 2 ] * _aPlane[ 2 ];
+			return uint8_t( _palStart + ( ( 2 * dot >= _iPlaneLimit ) ? 1 : 0 ) );
+		}
+		else
+		{
+			size_t best_index = 0;
+			int best_score = INT_MAX;
 
-			if ( e != 0 && er != EEXIST )
+			for ( size_t i = 0; i < K; ++i )
 			{
-				return false;
+				const int dr = int( colour.chan[ 0 ] ) - _aChan[ 0 ][ i ];
+				const int dg = int( colour.chan[ 1 ] ) - _aChan[ 1 ][ i ];
+				const int db = int( colour.chan[ 2 ] ) - _aChan[ 2 ][ i ];
+				const int score = dr * dr + dg * dg + db * db;
+
+				if ( score <= best_score )
+				{
+					best_score = score;
+					best_index = i;
+				}
 			}
+
+			return uint8_t( _palStart + best_index );
 		}
 	}
+};
 
-	// Create full directory
-	e = _mkdir( path.c_str() );
-	er = errno;
-	return !( e != 0 && er != EEXIST );
-}
+typedef enum
+{
+	SEARCH_CUBE,	// palette_lookup_t
+	SEARCH_TREE,	// palette_tree_t
+	SEARCH_SCAN,	// palette_scan_t
+
+} search_t;
 
-void write_png( const indexmap_t& image, std::vector< color_t >& aPalette, int indexOffset, bool bOpaque, int transIndex, const std::string& strOutFile )
+typedef enum
 {
-	// Open
-	std::cout << "Writing \"" << strOutFile << "\" (" << image._uBPP << "-BPP) ... ";
+	DITHER_NONE,		// nearest colour
+	DITHER_FLOYD,		// FloydSteinberg error diffusion
+	DITHER_ATKINSON,	// Atkinson error diffusion
+	DITHER_SIERRALITE,	// Sierra-Lite error diffusion
+	DITHER_JJN,			// Jarvis, Judice and Ninke error diffusion
+	DITHER_BAYER4,		// ordered, 4x4 Bayer matrix
+	DITHER_BAYER8,		// ordered, 8x8 Bayer matrix
+	DITHER_BLUENOISE,	// ordered, 64x64 blue noise threshold map
+
+} dither_mode_t;
+
+typedef enum
+{
+	ENCODE_DEFAULT,	// libpng defaults
+	ENCODE_FAST,	// -fast: no filtering, quickest zlib settings
+	ENCODE_SMALL,	// -small: the smallest of every filter and zlib strategy
+	ENCODE_PARALLEL,// -parallel: deflate in blocks, on several threads
 
-	FILE* fp = nullptr;
-	int e = fopen_s( &fp, strOutFile.c_str(), "wb" );
-	if ( e != 0 || fp == nullptr )
+} encode_t;
+
+//
+// sequence_cache_t
+//
+// -sequence: the previous frame, a tile at a time. A tile is a kTile pixel span of a
+// row; for each one it keeps a hash of the source pixels and the indices they became,
+// so a tile that is unchanged since the last frame reuses its indices rather than being
+// remapped. Only for the modes where a pixel's index depends on nothing but the pixel
+// and its position: nearest and ordered dithering.
+//
+struct sequence_cache_t
+{
+
+public:
+
+	static constexpr uint32_t kTile = 32;
+
+	uint32_t _width = 0;
+	uint32_t _height = 0;
+	uint32_t _uChannels = 0;
+	bool _bHasAlpha = false;
+	bool _bValid = false; // a previous frame of the same form has been kept.
+
+	size_t _uTilesPerRow = 0;
+	std::vector< uint64_t > _aHash;
+	std::vector< uint8_t > _aIndices;
+
+public:
+
+	// Start a frame. With different dimensions, channels or alpha, nothing carries over.
+	void Begin( const colormap_t& image )
 	{
-		std::cout << "ERROR (attempted overwrite?)\n\n";
-		return;
+		if ( _bValid && image._width == _width && image._height == _height && image._uChannels == _uChannels && image.bHasAlpha == _bHasAlpha )
+		{
+			return;
+		}
+
+		_width = uint32_t( image._width );
+		_height = uint32_t( image._height );
+		_uChannels = uint32_t( image._uChannels );
+		_bHasAlpha = image.bHasAlpha;
+		_bValid = false;
+
+		_uTilesPerRow = ( size_t( _width ) + kTile - 1 ) / kTile;
+		_aHash.assign( _uTilesPerRow * _height, 0 );
+		_aIndices.assign( size_t( _width ) * _height, 0 );
 	}
 
-	// Initialise the PNG.
-	png_structp png_ptr;
-	png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
-	if ( png_ptr == nullptr )
+	// The frame is done; its tiles are the ones the next frame compares with.
+	void End()
 	{
-		std::cout << "ERROR: png_create_write_struct failed.\n";
-		return;
+		_bValid = true;
 	}
 
-	// Initialise the information structure.
-	png_infop info_ptr;
-	info_ptr = png_create_info_struct( png_ptr );
-	if ( info_ptr == nullptr )
+	static uint64_t Hash( const uint8_t* pData, size_t size )
 	{
-		std::cout << "ERROR: png_create_info_struct failed.\n";
-		return;
+		uint64_t hash = 0x9E3779B97F4A7C15ULL ^ size;
+
+		size_t i = 0;
+		for ( ; i + 8 <= size; i += 8 )
+		{
+			uint64_t word;
+			memcpy( &word, pData + i, 8 );
+			hash = ( hash ^ word ) * 0xFF51AFD7ED558CCDULL;
+			hash ^= hash >> 32;
+		}
+
+		for ( ; i < size; ++i )
+		{
+			hash = ( hash ^ pData[ i ] ) * 0x100000001B3ULL;
+		}
+
+		return hash ^ ( hash >> 29 );
+	}
+
+	// Copy the indices kept for tile t of row y, if its hash is unchanged.
+	bool Reuse( uint32_t y, size_t t, uint64_t hash, uint8_t* pIndices, size_t count ) const
+	{
+		if ( _bValid == false || _aHash[ y * _uTilesPerRow + t ] != hash )
+		{
+			return false;
+		}
+
+		memcpy( pIndices, &_aIndices[ size_t( y ) * _width + t * kTile ], count );
+		return true;
+	}
+
+	void Keep( uint32_t y, size_t t, uint64_t hash, const uint8_t* pIndices, size_t count )
+	{
+		_aHash[ y * _uTilesPerRow + t ] = hash;
+		memcpy( &_aIndices[ size_t( y ) * _width + t * kTile ], pIndices, count );
 	}
+};
+
+//
+// threshold_map_t
+//
+// Tiled offsets for ordered dithering, added to all three channels of a pixel before
+// its nearest palette index is found.
+//
+struct threshold_map_t
+{
 
-	// Palette!
-	png_color palette[ 256 ];
+public:
+
+	uint32_t _size = 0; // power of two
+	std::vector< int > _aOffset;
+
+public:
 
-	// base black palette.
-	for ( uint32_t i = 0; i < 256; ++i )
+	inline int At( uint32_t x, uint32_t y ) const
 	{
-		palette[ i ].red = palette[ i ].green = palette[ i ].blue = 0;
+		return _aOffset[ ( x & ( _size - 1 ) ) + ( y & ( _size - 1 ) ) * _size ];
 	}
+};
+
+typedef std::chrono::steady_clock tClock;
+
+static inline double elapsed_ms( tClock::time_point start, tClock::time_point end = tClock::now() )
+{
+	return std::chrono::duration< double, std::milli >( end - start ).count();
+}
+
+// for the times summed while rows are read and written, maybe by several threads.
+static inline void add_elapsed( std::atomic< int64_t >& ns, tClock::time_point start )
+{
+	ns += std::chrono::duration_cast< std::chrono::nanoseconds >( tClock::now() - start ).count();
+}
 
-	size_t palCopyStart;
+//
+// stats_t
+//
+// -stats timings and counters, for one file or summed over a batch. The decode and encode
+// are timed where the rows are read and written; the remap, with its dither in the same
+// pass, is the rest of the file's time. With -j the sums can exceed the batch wall time.
+//
+struct stats_t
+{
+	double fDecodeMs = 0;
+	double fRemapMs = 0;
+	double fEncodeMs = 0;
+	double fTotalMs = 0;
+	double fWallMs = 0; // batch only
+
+	uint64_t uFiles = 0;
+	uint64_t uFailed = 0;
+	uint64_t uPixels = 0;
+	uint64_t uBytesIn = 0;
+	uint64_t uBytesOut = 0;
+	uint64_t uPeakRSS = 0; // process peak working set, once the file was done.
+
+	// -quality: the opaque output pixels, their squared RGB error and Delta E (Oklab
+	// distance x 100) against the source, with the Delta E counted in bins of 1.
+	static constexpr size_t kDeltaEBins = 16; // the last bin holds 15 and over.
+	uint64_t uMeasured = 0;
+	uint64_t uSquaredError = 0;
+	double fDeltaE = 0;
+	uint64_t aDeltaE[ kDeltaEBins ] = {};
 
-	if ( bOpaque )
+public:
+
+	void AddQuality( const stats_t& other )
 	{
-		palCopyStart = 0;
+		uMeasured += other.uMeasured;
+		uSquaredError += other.uSquaredError;
+		fDeltaE += other.fDeltaE;
+		for ( size_t i = 0; i < kDeltaEBins; ++i )
+		{
+			aDeltaE[ i ] += other.aDeltaE[ i ];
+		}
 	}
-	else
+
+	double PSNR() const
 	{
-		palCopyStart = 1;
+		if ( uSquaredError == 0 )
+		{
+			return 100.0; // identical, rather than infinite.
+		}
 
-		const color_t src = aPalette[ 0 ];
-		uint8_t offset = (uint8_t)( transIndex );
-		png_color* p = palette + offset;
-		p->red = src.chan[ 0 ];
-		p->green = src.chan[ 1 ];
-		p->blue = src.chan[ 2 ];
+		const double fMSE = double( uSquaredError ) / ( 3.0 * double( uMeasured ) );
+		return std::min( 100.0, 10.0 * std::log10( 255.0 * 255.0 / fMSE ) );
 	}
 
-	for ( size_t i = palCopyStart; i < aPalette.size(); ++i )
+	double MeanDeltaE() const
 	{
-		const color_t src = aPalette[ i ];
-		uint8_t offset = (uint8_t)( i + indexOffset );
-		png_color* p = palette + offset;
-		p->red = src.chan[ 0 ];
-		p->green = src.chan[ 1 ];
-		p->blue = src.chan[ 2 ];
+		return uMeasured ? ( fDeltaE / double( uMeasured ) ) : 0.0;
 	}
 
-	jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
+	// the share of measured pixels with a Delta E below uBelow.
+	double DeltaEBelow( size_t uBelow ) const
+	{
+		uint64_t uCount = 0;
+		for ( size_t i = 0; i < uBelow && i < kDeltaEBins; ++i )
+		{
+			uCount += aDeltaE[ i ];
+		}
+		return uMeasured ? ( 100.0 * double( uCount ) / double( uMeasured ) ) : 0.0;
+	}
 
-	if ( setjmp( *p_jmp_buf ) != -1 )
+	void Add( const stats_t& other )
 	{
-		// Setup the writer
-		png_set_write_fn( png_ptr, fp, png_write_data_fn, png_flush_data_fn );
+		fDecodeMs += other.fDecodeMs;
+		fRemapMs += other.fRemapMs;
+		fEncodeMs += other.fEncodeMs;
+		fTotalMs += other.fTotalMs;
+		uFiles += other.uFiles;
+		uFailed += other.uFailed;
+		uPixels += other.uPixels;
+		uBytesIn += other.uBytesIn;
+		uBytesOut += other.uBytesOut;
+		uPeakRSS = std::max( uPeakRSS, other.uPeakRSS );
+		AddQuality( other );
+	}
+};
 
-		// Setup the header
-		png_set_IHDR( png_ptr, info_ptr, image._width, image._height,
-					  image._uBPP /*CHANNEL DEPTH*/, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-					  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+//
+// quality_t
+//
+// -quality: measures each row of output indices against its source as the remap
+// stores it, while both are still in cache, so there is no second decode to compare.
+// Rows come from several threads; each is summed on its own and then added under the
+// lock.
+//
+struct quality_t
+{
+	color_t aColour[ 256 ]; // the palette colour of each output index.
+	oklab_t aLab[ 256 ];
+	bool aMeasure[ 256 ] = {}; // false for the transparent index, and unused ones.
 
-		// palette
-		png_set_PLTE( png_ptr, info_ptr, palette, ( 1 << image._uBPP ) );
+	std::mutex mutex;
+	stats_t* pStats = nullptr;
+
+public:
+
+	void Begin( const std::vector< color_t >& aPalette, const uint8_t aOutIndex[ 256 ], bool bOpaque, stats_t& stats )
+	{
+		for ( size_t i = 0; i < aPalette.size() && i < 256; ++i )
+		{
+			const uint8_t out = aOutIndex[ i ];
+			aColour[ out ] = aPalette[ i ];
+			aLab[ out ] = rgb_to_oklab( aPalette[ i ] );
+			aMeasure[ out ] = true;
+		}
 
-		// Transparent index?
 		if ( bOpaque == false )
 		{
-			png_color_16 palette_trans[ 1 ];
-			png_byte palette_trans_alpha[ 256 ];
-			palette_trans[ 0 ].index = (png_byte)( transIndex ); // INDEX
-			for ( int i = 0; i < 256; ++i )
-				palette_trans_alpha[ i ] = 255; // Opaque
-			palette_trans_alpha[ palette_trans[ 0 ].index ] = 0; // Invisible
-			png_set_tRNS( png_ptr, info_ptr, palette_trans_alpha, (int)( (png_byte)indexOffset ) + 1, palette_trans );
+			aMeasure[ aOutIndex[ 0 ] ] = false;
+		}
+
+		pStats = &stats;
+	}
+
+	void AddRow( const colormap_t& image, size_t y, const uint8_t* pIndices )
+	{
+		if ( image._uChannels == 3 )
+		{
+			AddRow< 3 >( image.Row( y ), pIndices, image._width );
+		}
+		else
+		{
+			AddRow< 4 >( image.Row( y ), pIndices, image._width );
+		}
+	}
+
+private:
+
+	// a cube root to within 2e-6: a first guess from the exponent bits, then two Newton
+	// steps. About three times quicker than std::cbrt, and plenty for a metric.
+	static inline float QuickCbrt( float v )
+	{
+		if ( v <= 0.0f )
+		{
+			return 0.0f;
+		}
+
+		uint32_t bits;
+		memcpy( &bits, &v, 4 );
+		bits = bits / 3 + 709921077; // a third of the exponent, and a tuned mantissa.
+
+		float r;
+		memcpy( &r, &bits, 4 );
+
+		r = r - ( r * r * r - v ) / ( 3.0f * r * r );
+		r = r - ( r * r * r - v ) / ( 3.0f * r * r );
+		return r;
+	}
+
+	// rgb_to_oklab, with QuickCbrt.
+	static inline oklab_t SourceLab( const color_t& colour )
+	{
+		const float* aLinear = srgb_linear_table();
+		const float r = aLinear[ colour.chan[ 0 ] ];
+		const float g = aLinear[ colour.chan[ 1 ] ];
+		const float b = aLinear[ colour.chan[ 2 ] ];
+
+		float lms[ 3 ];
+		for ( int i = 0; i < 3; ++i )
+		{
+			lms[ i ] = QuickCbrt( float( kOklabM1[ i ][ 0 ] ) * r + float( kOklabM1[ i ][ 1 ] ) * g + float( kOklabM1[ i ][ 2 ] ) * b );
+		}
+
+		oklab_t lab;
+		lab.L = float( kOklabM2[ 0 ][ 0 ] ) * lms[ 0 ] + float( kOklabM2[ 0 ][ 1 ] ) * lms[ 1 ] + float( kOklabM2[ 0 ][ 2 ] ) * lms[ 2 ];
+		lab.a = float( kOklabM2[ 1 ][ 0 ] ) * lms[ 0 ] + float( kOklabM2[ 1 ][ 1 ] ) * lms[ 1 ] + float( kOklabM2[ 1 ][ 2 ] ) * lms[ 2 ];
+		lab.b = float( kOklabM2[ 2 ][ 0 ] ) * lms[ 0 ] + float( kOklabM2[ 2 ][ 1 ] ) * lms[ 1 ] + float( kOklabM2[ 2 ][ 2 ] ) * lms[ 2 ];
+		return lab;
+	}
+
+	// Consecutive pixels with the same source colour and index (runs in flat artwork,
+	// or in any image at the nearest colour) are counted, then measured once. The last
+	// few pairs measured are kept, for artwork with a handful of colours.
+	template < uint32_t N >
+	void AddRow( const uint8_t* pSrc, const uint8_t* pIndices, size_t width )
+	{
+		stats_t row;
+
+		struct measured_t
+		{
+			uint32_t key = 0xFFFFFFFF; // bgr, and the index in the top byte.
+			uint32_t uSquared = 0;
+			float fDeltaE = 0;
+		};
+
+		measured_t aMeasured[ 64 ];
+
+		uint32_t run_bgr = 0;
+		uint8_t run_index = 0;
+		uint64_t run_count = 0;
+
+		auto measure_run = [&]()
+		{
+			const uint32_t key = run_bgr | ( uint32_t( run_index ) << 24 );
+			measured_t& measured = aMeasured[ ( key * 0x9E3779B1u ) >> 26 ];
+
+			if ( measured.key != key )
+			{
+				color_t colour;
+				colour.value_abgr = run_bgr | 0xFF000000;
+				const color_t& output = aColour[ run_index ];
+
+				measured.key = key;
+				measured.uSquared = 0;
+				for ( int c = 0; c < 3; ++c )
+				{
+					const int d = int( colour.chan[ c ] ) - int( output.chan[ c ] );
+					measured.uSquared += uint32_t( d * d );
+				}
+
+				measured.fDeltaE = 100.0f * std::sqrt( oklab_distance_squared( SourceLab( colour ), aLab[ run_index ] ) );
+			}
+
+			const uint64_t uSquared = measured.uSquared;
+			const float fDeltaE = measured.fDeltaE;
+
+			row.uSquaredError += uSquared * run_count;
+			row.fDeltaE += double( fDeltaE ) * double( run_count );
+			row.aDeltaE[ std::min( size_t( fDeltaE ), stats_t::kDeltaEBins - 1 ) ] += run_count;
+			row.uMeasured += run_count;
+		};
+
+		for ( size_t x = 0; x < width; )
+		{
+			const uint8_t index = pIndices[ x ];
+
+			// the pixels that repeat this one, as far as they have its index too.
+			const size_t uSame = colormap_t::RunLength< N >( pSrc, x, width );
+			size_t count = 1;
+			while ( count < uSame && pIndices[ x + count ] == index )
+			{
+				++count;
+			}
+
+			const uint32_t bgr = colormap_t::Pixel< N >( pSrc, x ).BGR();
+			x += count;
+
+			if ( aMeasure[ index ] == false )
+			{
+				continue;
+			}
+
+			if ( run_count > 0 && bgr == run_bgr && index == run_index )
+			{
+				run_count += count;
+				continue;
+			}
+
+			if ( run_count > 0 )
+			{
+				measure_run();
+			}
+
+			run_bgr = bgr;
+			run_index = index;
+			run_count = count;
+		}
+
+		if ( run_count > 0 )
+		{
+			measure_run();
+		}
+
+		std::lock_guard< std::mutex > lock( mutex );
+		pStats->AddQuality( row );
+	}
+};
+
+struct options_t
+{
+	std::string strPaletteFile;
+	palette_t aPalette; // with its nearest colour cubes, searching from index 0 or 1.
+	uint8_t uBPP = 8; // of the output, from prepare_palette.
+
+	// several -pal: this options_t has the first palette (uPaletteIndex 0) and an owned
+	// variant for each of the others, all sharing the one decode of each image.
+	std::vector< std::string > aPaletteFiles;
+	std::vector< std::unique_ptr< options_t > > aVariants;
+	size_t uPaletteIndex = 0; // the -pal this options_t uses.
+	std::string strOutSuffix; // "_<palette name>", added to the output name.
+
+	search_t search = SEARCH_CUBE;
+	match_t match = MATCH_RGB;
+	palette_tree_t aTree[ 2 ];
+	palette_scan_t aScan[ 2 ];
+	palette_exact_t aExact[ 2 ]; // exact colours, tried before the search.
+
+	std::vector< std::string > aInputFiles;
+	std::vector< std::string > aInputWildCards; // as given, for -watch to match new files with.
+
+	uint32_t uThreadCount = 1; // -j
+	uint32_t uShareCount = 1; // images remapped side by side in each job (the palette variants).
+	bool bServe = false; // -serve
+	std::string strServe; // -serve=<name>: the pipe or socket, or stdin if empty.
+	bool bWatch = false; // -watch
+	bool bBenchmark = false; // -bench
+	bool bStats = false;
+	std::string strStatsFile; // -stats=<file>, JSON lines
+	std::string strVerifyFile; // -verify=<file>
+	verify_manifest_t* pVerify = nullptr; // -verify: opened by do_work, for every palette.
+	bool bSequence = false; // -sequence
+	sequence_cache_t sequence;
+	bool bLuminance = false;
+	dither_mode_t dither = DITHER_NONE;
+	threshold_map_t thresholds; // for the ordered dither modes.
+	bool bFixed = false; // integer error diffusion
+	bool bLinear = false; // -linear: integer error diffusion in linear light.
+	std::vector< uint16_t > aPaletteLinear; // R, G, B of each palette entry, 12-bit linear, for -linear.
+	bool bSerpentine = false; // error diffusion rows alternate direction
+	encode_t encode = ENCODE_DEFAULT;
+	bool bRaw = false; // -raw
+	bool bTiles = false; // -tiles: 8x8 4bpp tiles, a map and 16 colour sub-palettes.
+	bool bTrim = false; // -trim: write only the indices used, renumbered, at the fewest bits.
+	bool bIfChanged = false; // -ifchanged: don't rewrite an output that would be byte-identical.
+	bool bQuality = false; // -quality: PSNR and Delta E of each output, in the -stats.
+	int indexOffset = 0;
+	bool bOpaque = true;
+	int transIndex = 0;
+	uint8_t uAlphaCut = 255; // -alphacut: alpha below this is transparent.
+	uint8_t aOutIndex[ 256 ]; // index written to the PNG for each palette index.
+
+	std::string strOutFile;
+	std::string strOutFolder;
+	std::string strLutFolder; // -lutcache
+	std::string strAtlasFile; // -atlas
+};
+
+//
+// nearest_palette_index
+//
+// Nearest palette entry to a colour, searching from palStart (0 or 1) with the -search method.
+// A colour that is in the palette is found without a search.
+//
+static inline uint8_t nearest_palette_index( options_t& options, const color_t& colour, size_t palStart )
+{
+	uint8_t index;
+	if ( options.aExact[ palStart ].Find( colour, index ) )
+	{
+		return index;
+	}
+
+	switch ( options.search )
+	{
+	case SEARCH_TREE:	return options.aTree[ palStart ].Find( colour );
+	case SEARCH_SCAN:	return options.aScan[ palStart ].Find( colour );
+	default:			return options.aPalette.Lookup( palStart, options.match ).Find( colour );
+	}
+}
+
+//
+// palette_search_t
+//
+// nearest_palette_index as a search object, the same shape as palette_small_t, so the
+// remap functions can be templates on their search.
+//
+struct palette_search_t
+{
+	options_t* _pOptions;
+	size_t _palStart;
+
+	inline uint8_t Find( const color_t& colour ) const
+	{
+		return nearest_palette_index( *_pOptions, colour, _palStart );
+	}
+};
+
+//
+// palette_grey_t
+//
+// Nearest palette index for grey colours (R = G = B), from a table of the index for each
+// of the 256 levels that another search fills once.
+//
+struct palette_grey_t
+{
+
+public:
+
+	uint8_t _aIndex[ 256 ];
+
+public:
+
+	template < typename S >
+	void Create( const S& search )
+	{
+		for ( int level = 0; level < 256; ++level )
+		{
+			color_t grey;
+			grey.chan[ 0 ] = grey.chan[ 1 ] = grey.chan[ 2 ] = uint8_t( level );
+			grey.chan[ 3 ] = 0xFF;
+
+			_aIndex[ level ] = search.Find( grey );
+		}
+	}
+
+	inline uint8_t Find( const color_t& colour ) const
+	{
+		return _aIndex[ colour.chan[ 0 ] ];
+	}
+};
+
+//
+// grey_searches_only
+//
+// True if every colour the remap searches for is grey: with -lum the pixels are, an
+// ordered dither offsets each channel by the same amount, and error diffusion only
+// keeps them grey if every palette entry it can pick is too.
+//
+static bool grey_searches_only( const options_t& options, size_t palStart )
+{
+	if ( options.bLuminance == false )
+	{
+		return false;
+	}
+
+	switch ( options.dither )
+	{
+	case DITHER_NONE:
+	case DITHER_BAYER4:
+	case DITHER_BAYER8:
+	case DITHER_BLUENOISE:
+		return true;
+
+	default:
+		break;
+	}
+
+	for ( size_t i = palStart; i < options.aPalette.size(); ++i )
+	{
+		const color_t& colour = options.aPalette[ i ];
+
+		if ( colour.chan[ 0 ] != colour.chan[ 1 ] || colour.chan[ 0 ] != colour.chan[ 2 ] )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// with_palette_search
+//
+// Call fn with the search to use from palStart: palette_grey_t when grey_searches_only,
+// palette_small_t for an RGB match with the default search and at most 16 entries, else
+// the -search method. Chosen once per image, so the remap loops are compiled for each.
+//
+template < typename F >
+static void with_palette_search( options_t& options, size_t palStart, F fn )
+{
+	const size_t count = options.aPalette.size() - palStart;
+
+	if ( grey_searches_only( options, palStart ) )
+	{
+		palette_grey_t search;
+		search.Create( palette_search_t{ &options, palStart } );
+		fn( search );
+		return;
+	}
+
+	if ( options.search == SEARCH_CUBE && options.match == MATCH_RGB && count >= 1 )
+	{
+		if ( count <= 2 )
+		{
+			palette_small_t< 2 > search;
+			search.Create( options.aPalette, palStart );
+			fn( search );
+			return;
+		}
+		else if ( count <= 4 )
+		{
+			palette_small_t< 4 > search;
+			search.Create( options.aPalette, palStart );
+			fn( search );
+			return;
+		}
+		else if ( count <= 16 )
+		{
+			palette_small_t< 16 > search;
+			search.Create( options.aPalette, palStart );
+			fn( search );
+			return;
+		}
+	}
+
+	fn( palette_search_t{ &options, palStart } );
+}
+
+//=============================================================================
+
+//
+// print_hello
+//
+// Print hello text
+//
+static void print_hello()
+{
+	printf( "\n-----------------------------------------------------------------------\n"
+			" Apply Palette to Image (c) David Walters. See LICENSE.txt for details\n"
+			"-----------------------------------------------------------------------\n\n" );
+}
+
+//
+// print_help
+//
+// Print help text
+//
+static void print_help()
+{
+	// Usage
+	printf( " USAGE: applypal.exe [-?] [-dither[=#]] [-fixed] [-linear] [-serpentine] [-opaque|-transp[=<remap>]] [-alphacut=#]\n" );
+	printf( "             [-lum] [-match=#] [-search=#] [-cpu=#] [-deflate=#] [-lutcache <folder>] -pal <palette> [-addidx <offset>]\n" );
+	printf( "             <image>[...]\n" );
+	printf( "             [-o <image>]|[-outdir <folder>]|[-atlas <image>] [-fast|-small|-parallel|-raw|-tiles] [-trim] [-ifchanged]\n" );
+	printf( "             [-sequence] [-j <count>] [-stats[=<file>]] [-quality] [-verify=<file>] [-watch]\n" );
+	printf( "        applypal.exe -serve[=<name>] [-j <count>]\n" );
+	printf( "        applypal.exe -bench [-pal <palette>] [<image>...]\n\n" );
+	putchar( '\n' );
+
+	// Options
+	printf( "  -?                 This help.\n" );
+	printf( "  -dither[=#]        Dither: fs, atkinson, sierralite or jjn (error diffusion),\n" );
+	printf( "                     bayer4, bayer8 or bluenoise (ordered). [Default=fs]\n" );
+	printf( "  -fixed             Error diffusion in integers, for output that is identical on every platform.\n" );
+	printf( "  -linear            Error diffusion in linear light (in integers), so dithered areas keep their\n" );
+	printf( "                     brightness.\n" );
+	printf( "  -serpentine        Error diffusion runs alternate rows right to left.\n" );
+	printf( "  -opaque            All palette indices are opaque [default]\n" );
+	printf( "  -transp[=<remap>]  Make palette index 0 transparent, remap to <remap>.\n" );
+	printf( "  -alphacut=#        With -transp, pixels with alpha below # are transparent. [Default=255]\n" );
+	printf( "  -lum               Apply rgb-to-luminance pre-filter to all inputs.\n" );
+	printf( "  -match=#           Nearest colour by: rgb, or oklab (perceptual, -search=cube only). [Default=rgb]\n" );
+	printf( "  -search=#          Nearest colour search: cube, tree (k-d tree) or scan. [Default=cube]\n" );
+	printf( "  -cpu=#             -search=scan kernel: scalar, sse2, sse4.1, avx2, avx512, neon or native.\n" );
+	printf( "                     [Default=native]\n" );
+	printf( "  -deflate=#         PNG compression: zlib, or libdeflate (in builds with FRAGMENTS_LIBDEFLATE),\n" );
+	printf( "                     which compresses each image whole. [Default=libdeflate if built in]\n" );
+	printf( "  -lutcache <folder> Keep colour cubes in <folder>, for later runs with the same palette. The\n" );
+	printf( "                     folder may be shared, and is held to FRAGMENTS_CACHE_MB (4096 if unset).\n" );
+
+	putchar( '\n' );
+	printf( "  -pal <palette>     Palette file to use (in .HEX format). Repeat for several palettes: each\n" );
+	printf( "                     image is decoded once and written as <image>_<palette>.png for each.\n" );
+	printf( "  -addidx <offset>   Apply a fixed offset to palette indices.\n" );
+	putchar( '\n' );
+	printf( "  <image>[...]       Add image(s) to the processing list. Wildcards supported,\n" );
+	printf( "                     with ** for every folder below (art\\**\\*.png).\n" );
+	putchar( '\n' );
+	printf( "  -o <file>          Specify an output file. Not supported with multiple images.\n" );
+	printf( "  -outdir <folder>   Specify an output folder. Ignored if -o is used.\n" );
+	printf( "  -atlas <image>     Pack all of the images into one output, with the rects of each\n" );
+	printf( "                     listed in a .json file of the same name.\n" );
+	printf( "  -fast              Encode the PNG as quickly as possible, at some cost in size.\n" );
+	printf( "  -small             Try every PNG filter and zlib strategy, keep the smallest.\n" );
+	printf( "  -parallel          Compress the PNG in blocks on several threads. For large images.\n" );
+	printf( "  -raw               Write uncompressed .idx files instead, to be mapped into memory: a 32 byte\n" );
+	printf( "                     header, the RGBA palette, then the rows at 4 or 8 bits per pixel.\n" );
+	printf( "  -tiles             The palette is a set of 16 colour sub-palettes (palgen -tiles). Write 8x8\n" );
+	printf( "                     4 bpp tiles (.chr), a tile map (.map) and BGR555 palettes (.pal) for VRAM.\n" );
+	printf( "  -trim              Keep only the palette entries each image uses, renumbered in order, and\n" );
+	printf( "                     write it at the fewest bits per pixel that hold them.\n" );
+	printf( "  -ifchanged         Leave an output, and its time stamp, alone if its bytes would be the\n" );
+	printf( "                     same. A hash of each output is kept beside it in <output>.hash.\n" );
+	printf( "  -sequence          The images are frames of an animation, in name order. Unchanged areas\n" );
+	printf( "                     keep the last frame's indices. (No dither or ordered dither only.)\n" );
+	printf( "  -j <count>         Number of images to process in parallel, at most the CPU count or\n" );
+	printf( "                     FRAGMENTS_THREADS. [Default=1]\n" );
+	printf( "  -stats[=<file>]    Print decode, remap and encode times, sizes and peak memory for each\n" );
+	printf( "                     image and the batch, and write them to <file> as JSON lines.\n" );
+	printf( "  -quality           Add the PSNR and Delta E (Oklab x 100) of each output against its source\n" );
+	printf( "                     to the -stats, measured as the rows are remapped.\n" );
+	printf( "  -verify=<file>     Hash each output's indices and palette before it is encoded, and write\n" );
+	printf( "                     the hashes to <file>; or, if <file> is there, compare them with it and\n" );
+	printf( "                     fail if any differ. Not with -serve.\n" );
+	printf( "  -watch             After the run, keep the palette set up and remap each input again as it\n" );
+	printf( "                     is saved, and any new file the wildcards match, until Ctrl+C.\n" );
+	putchar( '\n' );
+	printf( "  -serve[=<name>]    Read jobs from stdin, or from clients of the named pipe (a Unix socket\n" );
+	printf( "                     off Windows) <name>, one line of the options above each. Each job's\n" );
+	printf( "                     log is followed by \"#<line> OK <ms>ms\" or \"#<line> FAILED <ms>ms\".\n" );
+	printf( "                     A line of -stop ends the server.\n" );
+	printf( "  -bench             Time each stage on synthetic images (and any <image>s), no output.\n" );
+	putchar( '\n' );
+
+	putchar( '\n' );
+}
+
+//
+// palette_suffix
+//
+// "_<name>" for the outputs of a palette file, its name without the path or extension.
+//
+static std::string palette_suffix( const std::string& strPaletteFile )
+{
+	std::string strName = strPaletteFile;
+
+	const size_t slash_find = strName.find_last_of( "/\\" );
+	if ( slash_find != strName.npos )
+	{
+		strName = strName.substr( slash_find + 1 );
+	}
+
+	const size_t dot_find = strName.find_last_of( '.' );
+	if ( dot_find != strName.npos )
+	{
+		strName = strName.substr( 0, dot_find );
+	}
+
+	return "_" + strName;
+}
+
+//
+// process_args
+//
+// Process command line arguments
+//
+static bool process_args( int argc, char** argv, options_t& options )
+{
+	// Command Line State
+	bool bNextArgIsPalette = false;
+	bool bNextArgIsOutFile = false;
+	bool bNextArgIsOutFolder = false;
+	bool bNextArgIsLutFolder = false;
+	bool bNextArgIsAtlasFile = false;
+	bool bNextArgIsAddIdx = false;
+	bool bNextArgIsJobs = false;
+
+	// Parse Command Line
+	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
+	{
+		const char* szArg = argv[ iarg ];
+
+		if ( bNextArgIsOutFile )
+		{
+			bNextArgIsOutFile = false;
+			options.strOutFile = szArg;
+		}
+		else if ( bNextArgIsOutFolder )
+		{
+			bNextArgIsOutFolder = false;
+			options.strOutFolder = szArg;
+		}
+		else if ( bNextArgIsLutFolder )
+		{
+			bNextArgIsLutFolder = false;
+			options.strLutFolder = szArg;
+		}
+		else if ( bNextArgIsAtlasFile )
+		{
+			bNextArgIsAtlasFile = false;
+			options.strAtlasFile = szArg;
+		}
+		else if ( bNextArgIsAddIdx )
+		{
+			bNextArgIsAddIdx = false;
+			options.indexOffset = atoi( szArg );
+		}
+		else if ( bNextArgIsJobs )
+		{
+			bNextArgIsJobs = false;
+
+			int iJobs = atoi( szArg );
+
+			if ( iJobs <= 0 )
+			{
+				printf( "Error - invalid job count (%d).\n", iJobs );
+				return false;
+			}
+
+			options.uThreadCount = std::min( unsigned( iJobs ), task_thread_cap() );
+		}
+		else if ( bNextArgIsPalette )
+		{
+			bNextArgIsPalette = false;
+
+			bool bFailed = false;
+			palette_t aPalette;
+
+			if ( aPalette.Load( szArg ) == false )
+			{
+				std::cout << "Error - failed to load palette from \"" << szArg << "\".\n";
+				bFailed = true;
+			}
+
+			if ( bFailed == false )
+			{
+				if ( aPalette.size() < 2 )
+				{
+					std::cout << "Error - the palette loaded from \"" << szArg << "\" is too small (" << aPalette.size() << " entries).\n";
+					bFailed = true;
+				}
+				else if ( aPalette.size() > 256 )
+				{
+					std::cout << "Error - the palette loaded from \"" << szArg << "\" has over 256 entries (" << aPalette.size() << ") and is too big.\n";
+					bFailed = true;
+				}
+			}
+
+			if ( bFailed )
+			{
+				return false;
+			}
+			else if ( options.aPaletteFiles.size() == options.uPaletteIndex )
+			{
+				options.strPaletteFile = szArg;
+				options.aPalette = std::move( aPalette );
+			}
+
+			options.aPaletteFiles.push_back( szArg );
+		}
+		else if ( _stricmp( szArg, "-?" ) == 0 )
+		{
+			return false;
+		}
+		else if ( _stricmp( szArg, "-pal" ) == 0 )
+		{
+			bNextArgIsPalette = true;
+		}
+		else if ( _stricmp( szArg, "-addidx" ) == 0 )
+		{
+			bNextArgIsAddIdx = true;
+		}
+		else if ( _stricmp( szArg, "-j" ) == 0 )
+		{
+			bNextArgIsJobs = true;
+		}
+		else if ( _stricmp( szArg, "-o" ) == 0 )
+		{
+			bNextArgIsOutFile = true;
+		}
+		else if ( _stricmp( szArg, "-outdir" ) == 0 )
+		{
+			bNextArgIsOutFolder = true;
+		}
+		else if ( _stricmp( szArg, "-lutcache" ) == 0 )
+		{
+			bNextArgIsLutFolder = true;
+		}
+		else if ( _stricmp( szArg, "-atlas" ) == 0 )
+		{
+			bNextArgIsAtlasFile = true;
+		}
+		else if ( _stricmp( szArg, "-raw" ) == 0 )
+		{
+			options.bRaw = true;
+		}
+		else if ( _stricmp( szArg, "-tiles" ) == 0 )
+		{
+			options.bTiles = true;
+		}
+		else if ( _stricmp( szArg, "-trim" ) == 0 )
+		{
+			options.bTrim = true;
+		}
+		else if ( _stricmp( szArg, "-ifchanged" ) == 0 )
+		{
+			options.bIfChanged = true;
+		}
+		else if ( _stricmp( szArg, "-serve" ) == 0 )
+		{
+			options.bServe = true;
+		}
+		else if ( _strnicmp( szArg, "-serve=", 7 ) == 0 && szArg[ 7 ] != '\0' )
+		{
+			options.bServe = true;
+			options.strServe = szArg + 7;
+		}
+		else if ( _stricmp( szArg, "-watch" ) == 0 )
+		{
+			options.bWatch = true;
+		}
+		else if ( _stricmp( szArg, "-bench" ) == 0 )
+		{
+			options.bBenchmark = true;
+		}
+		else if ( _stricmp( szArg, "-stats" ) == 0 )
+		{
+			options.bStats = true;
+		}
+		else if ( _stricmp( szArg, "-quality" ) == 0 )
+		{
+			options.bStats = true;
+			options.bQuality = true;
+		}
+		else if ( strncmp( szArg, "-stats=", 7 ) == 0 )
+		{
+			options.bStats = true;
+			options.strStatsFile = szArg + 7;
+		}
+		else if ( strncmp( szArg, "-verify=", 8 ) == 0 )
+		{
+			options.strVerifyFile = szArg + 8;
+		}
+		else if ( _stricmp( szArg, "-sequence" ) == 0 )
+		{
+			options.bSequence = true;
+		}
+		else if ( _stricmp( szArg, "-lum" ) == 0 )
+		{
+			options.bLuminance = true;
+		}
+		else if ( _stricmp( szArg, "-dither" ) == 0 )
+		{
+			options.dither = DITHER_FLOYD;
+		}
+		else if ( strncmp( szArg, "-dither=", 8 ) == 0 )
+		{
+			const char* szMode = szArg + 8;
+
+			if ( _stricmp( szMode, "fs" ) == 0 )
+				options.dither = DITHER_FLOYD;
+			else if ( _stricmp( szMode, "atkinson" ) == 0 )
+				options.dither = DITHER_ATKINSON;
+			else if ( _stricmp( szMode, "sierralite" ) == 0 )
+				options.dither = DITHER_SIERRALITE;
+			else if ( _stricmp( szMode, "jjn" ) == 0 )
+				options.dither = DITHER_JJN;
+			else if ( _stricmp( szMode, "bayer4" ) == 0 )
+				options.dither = DITHER_BAYER4;
+			else if ( _stricmp( szMode, "bayer8" ) == 0 )
+				options.dither = DITHER_BAYER8;
+			else if ( _stricmp( szMode, "bluenoise" ) == 0 )
+				options.dither = DITHER_BLUENOISE;
+			else
+			{
+				printf( "Error - invalid dither mode (%s).\n", szMode );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-fixed" ) == 0 )
+		{
+			options.bFixed = true;
+		}
+		else if ( _stricmp( szArg, "-linear" ) == 0 )
+		{
+			options.bLinear = true;
+		}
+		else if ( _stricmp( szArg, "-serpentine" ) == 0 )
+		{
+			options.bSerpentine = true;
+		}
+		else if ( _stricmp( szArg, "-fast" ) == 0 )
+		{
+			options.encode = ENCODE_FAST;
+		}
+		else if ( _stricmp( szArg, "-small" ) == 0 )
+		{
+			options.encode = ENCODE_SMALL;
+		}
+		else if ( _stricmp( szArg, "-parallel" ) == 0 )
+		{
+			options.encode = ENCODE_PARALLEL;
+		}
+		else if ( strncmp( szArg, "-match=", 7 ) == 0 )
+		{
+			const char* szMatch = szArg + 7;
+
+			if ( _stricmp( szMatch, "rgb" ) == 0 )
+				options.match = MATCH_RGB;
+			else if ( _stricmp( szMatch, "oklab" ) == 0 )
+				options.match = MATCH_OKLAB;
+			else
+			{
+				printf( "Error - invalid match (%s).\n", szMatch );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-search=", 8 ) == 0 )
+		{
+			const char* szSearch = szArg + 8;
+
+			if ( _stricmp( szSearch, "cube" ) == 0 )
+				options.search = SEARCH_CUBE;
+			else if ( _stricmp( szSearch, "tree" ) == 0 )
+				options.search = SEARCH_TREE;
+			else if ( _stricmp( szSearch, "scan" ) == 0 )
+				options.search = SEARCH_SCAN;
+			else
+			{
+				printf( "Error - invalid search method (%s).\n", szSearch );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-cpu=", 5 ) == 0 )
+		{
+			if ( cpu_select( szArg + 5 ) == false )
+			{
+				printf( "Error - unknown or unsupported SIMD level \"%s\" (this CPU has %s).\n", szArg + 5, cpu_level_name( cpu_detect() ) );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-deflate=", 9 ) == 0 )
+		{
+			if ( deflate_select( szArg + 9 ) == false )
+			{
+				printf( "Error - unknown deflate \"%s\" (zlib, or libdeflate in builds with FRAGMENTS_LIBDEFLATE).\n", szArg + 9 );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-opaque" ) == 0 )
+		{
+			options.bOpaque = true;
+		}
+		else if ( strncmp( szArg, "-transp=", 8 ) == 0 )
+		{
+			options.bOpaque = false;
+			options.transIndex = atoi( szArg + 8 );
+
+			if ( options.transIndex < 0 || options.transIndex > 255 )
+			{
+				printf( "Error - invalid transparent index (%d).\n", options.transIndex );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-transp" ) == 0 )
+		{
+			options.bOpaque = false;
+			options.transIndex = 0;
+		}
+		else if ( strncmp( szArg, "-alphacut=", 10 ) == 0 )
+		{
+			const int cut = atoi( szArg + 10 );
+
+			if ( cut < 0 || cut > 255 )
+			{
+				printf( "Error - invalid alpha cut (%d).\n", cut );
+				return false;
+			}
+
+			options.uAlphaCut = uint8_t( cut );
+		}
+		else
+		{
+			// assume it's input files.
+			find_files( szArg, options.aInputFiles );
+			options.aInputWildCards.push_back( szArg );
+		}
+
+	}; // for each command line argument
+
+	sort_files( options.aInputFiles );
+
+	if ( options.match == MATCH_OKLAB && options.search != SEARCH_CUBE )
+	{
+		std::cout << "Error - -match=oklab is only supported by -search=cube.\n";
+		return false;
+	}
+
+	if ( options.bWatch && ( options.bServe || options.bBenchmark || options.bSequence || options.strAtlasFile.empty() == false || options.strVerifyFile.empty() == false ) )
+	{
+		std::cout << "Error - -watch remaps each image on its own, not with -serve, -bench, -sequence, -atlas or -verify.\n";
+		return false;
+	}
+
+	if ( options.bWatch && options.strOutFile.empty() == false &&
+		 ( options.aInputWildCards.size() != 1 || options.aInputWildCards[ 0 ].find_first_of( "*?" ) != std::string::npos ) )
+	{
+		std::cout << "Error - -watch with -o takes one input file, without wildcards.\n";
+		return false;
+	}
+
+	// the jobs bring their own palettes and images.
+	if ( options.bServe )
+	{
+		return true;
+	}
+
+	if ( options.bBenchmark )
+	{
+		return true; // -pal and input files are optional, and nothing is written.
+	}
+
+	if ( options.aPalette.empty() )
+	{
+		std::cout << "Error - no palette was loaded.\n";
+		return false;
+	}
+
+	// -watch waits for the wildcards to match.
+	if ( options.aInputFiles.empty() && ( options.bWatch == false || options.aInputWildCards.empty() ) )
+	{
+		std::cout << "Error - no input file(s) specified.\n";
+		return false;
+	}
+
+	if ( options.strAtlasFile.empty() == false && ( options.bSequence || options.aPaletteFiles.size() > 1 ) )
+	{
+		std::cout << "Error - -atlas takes a single -pal, and not -sequence.\n";
+		return false;
+	}
+
+	if ( options.bTrim && ( options.strAtlasFile.empty() == false || options.indexOffset != 0 || options.transIndex != 0 ) )
+	{
+		std::cout << "Error - -trim picks the indices of each image, it does not work with -atlas, -addidx or -transp=<remap>.\n";
+		return false;
+	}
+
+	if ( options.bLinear && ( options.dither == DITHER_NONE || options.dither >= DITHER_BAYER4 ) )
+	{
+		std::cout << "Error - -linear is for the error diffusion dithers: -dither=fs, atkinson, sierralite or jjn.\n";
+		return false;
+	}
+
+	if ( options.bTiles && ( options.strAtlasFile.empty() == false || options.indexOffset != 0 || options.transIndex != 0 || options.bRaw ||
+							 options.bTrim || options.bSequence || options.bQuality || options.dither != DITHER_NONE || options.match != MATCH_RGB ) )
+	{
+		std::cout << "Error - -tiles picks a sub-palette for each tile by nearest RGB colour. It does not work with -atlas, -addidx,\n"
+					 "-transp=<remap>, -raw, -trim, -sequence, -quality, -dither or -match.\n";
+		return false;
+	}
+
+	// each further palette gets options_t of its own, parsed from the same arguments.
+	if ( options.uPaletteIndex == 0 && options.aPaletteFiles.size() > 1 )
+	{
+		options.strOutSuffix = palette_suffix( options.aPaletteFiles[ 0 ] );
+		options.uShareCount = uint32_t( options.aPaletteFiles.size() );
+
+		for ( size_t i = 1; i < options.aPaletteFiles.size(); ++i )
+		{
+			std::unique_ptr< options_t > variant = std::make_unique< options_t >();
+			variant->uPaletteIndex = i;
+
+			process_args( argc, argv, *variant );
+
+			variant->strOutSuffix = palette_suffix( options.aPaletteFiles[ i ] );
+			variant->uShareCount = options.uShareCount;
+
+			options.aVariants.push_back( std::move( variant ) );
+		}
+	}
+
+	return true;
+}
+
+//
+// write_hexfile
+//
+// Dump the whole palette to disk in .hex format.
+//
+static void write_hexfile( std::vector< color_t >& aPalette, const std::string& strFileName )
+{
+	char buf[ 64 ];
+
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+
+	std::ofstream file( strFileName );
+	if ( file.is_open() )
+	{
+		for ( uint32_t i = 0; i < aPalette.size(); ++i )
+		{
+			// read BGRA palette entry and convert to RGB
+
+			const color_t& pal = aPalette[ i ];
+			uint32_t cout;
+			cout = pal.chan[ 0 ] << 16;
+			cout |= pal.chan[ 1 ] << 8;
+			cout |= pal.chan[ 2 ];
+
+			// .hex palette file format
+			sprintf_s( buf, sizeof( buf ), "%06x\n", cout );
+
+			file << buf;
+		}
+
+		file.close();
+		printf( "OK\n\n" );
+	}
+	else
+	{
+		printf( "FAILED\n\n" );
+	}
+}
+
+//==============================================================================
+
+static bool make_path( std::string& path )
+{
+	int e, er;
+	int start = 0;
+
+	// Skip drive?
+	if ( ( path.size() >= 2 ) && ( path[ 1 ] == ':' ) )
+	{
+		start = 3;
+	}
+
+	// Create tree
+	for ( size_t i = start; i < path.size(); ++i )
+	{
+		if ( path[ i ] == '\\' || path[ i ] == '/' )
+		{
+			// Briefly turn into a nul terminated c-string
+			path[ i ] = '\0';
+			e = _mkdir( path.c_str() );
+			er = errno;
+			path[ i ] = '\\';
+
+			if ( e != 0 && er != EEXIST )
+			{
+				return false;
+			}
+		}
+	}
+
+	// Create full directory
+	e = _mkdir( path.c_str() );
+	er = errno;
+	return !( e != 0 && er != EEXIST );
+}
+
+//
+// deflate_block_t
+//
+// One block of a deflate_blocks stream, with the checksums needed to stitch it in.
+//
+struct deflate_block_t
+{
+	std::vector< uint8_t > aOut;
+	uint32_t uAdler = 0; // of the input
+	uint32_t uCRC = 0;	 // of aOut
+	bool bOK = false;
+};
+
+//
+// deflate_blocks
+//
+// Compresses size bytes as one raw deflate stream cut into kDeflateBlock sized blocks,
+// which are compressed on separate threads (the pigz approach). Each block is primed
+// with the 32K of input before it, so little is lost against a single stream, and ends
+// on a sync flush (the last on Z_FINISH) so the blocks can simply be concatenated.
+//
+static constexpr size_t kDeflateBlock = 128 * 1024;
+static constexpr size_t kDeflateWindow = 32 * 1024;
+
+static bool deflate_blocks( const uint8_t* pData, size_t size, int level, size_t threads, std::vector< deflate_block_t >& aBlocks )
+{
+	const size_t blocks = std::max< size_t >( ( size + kDeflateBlock - 1 ) / kDeflateBlock, 1 );
+	aBlocks.clear();
+	aBlocks.resize( blocks );
+
+	std::atomic< size_t > next = 0;
+
+	auto worker_fn = [&]()
+	{
+		for ( size_t i = next++; i < blocks; i = next++ )
+		{
+			deflate_block_t& block = aBlocks[ i ];
+			const size_t start = i * kDeflateBlock;
+			const size_t len = std::min( kDeflateBlock, size - start );
+			const bool bLast = ( i + 1 == blocks );
+
+			z_stream strm = {};
+			if ( deflateInit2( &strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+			{
+				continue;
+			}
+
+			if ( i > 0 )
+			{
+				deflateSetDictionary( &strm, pData + start - kDeflateWindow, uInt( kDeflateWindow ) );
+			}
+
+			// room for the worst case, and the sync flush marker.
+			block.aOut.resize( deflateBound( &strm, uLong( len ) ) + 16 );
+
+			strm.next_in = const_cast< Bytef* >( pData + start );
+			strm.avail_in = uInt( len );
+			strm.next_out = block.aOut.data();
+			strm.avail_out = uInt( block.aOut.size() );
+
+			const int result = deflate( &strm, bLast ? Z_FINISH : Z_SYNC_FLUSH );
+			block.bOK = bLast ? ( result == Z_STREAM_END ) : ( result == Z_OK && strm.avail_in == 0 && strm.avail_out != 0 );
+			block.aOut.resize( strm.total_out );
+			deflateEnd( &strm );
+
+			block.uAdler = uint32_t( adler32_z( adler32( 0, nullptr, 0 ), pData + start, len ) );
+			block.uCRC = uint32_t( crc32_z( 0, block.aOut.data(), block.aOut.size() ) );
+		}
+	};
+
+	std::vector< std::thread > aThreads;
+	for ( size_t t = 1; t < std::min( threads, blocks ); ++t )
+	{
+		aThreads.emplace_back( worker_fn );
+	}
+
+	worker_fn();
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	return std::all_of( aBlocks.begin(), aBlocks.end(), []( const deflate_block_t& block ) { return block.bOK; } );
+}
+
+//
+// png_writer_t
+//
+// Writes an indexed colour PNG a row at a time, as the remap finishes each one. With
+// ENCODE_SMALL the packed rows are kept instead, and Close encodes them with each
+// filter and zlib strategy in turn, writing whichever comes out smallest.
+// ENCODE_PARALLEL keeps them too, and Close deflates them with deflate_blocks: one
+// IDAT for each block, with the zlib header on the first and the Adler-32 on the last.
+// With libdeflate (see paldeflate.h) the default and ENCODE_FAST keep them as well, and
+// Close compresses them at once with png_write_compressed.
+//
+struct png_writer_t
+{
+
+public:
+
+	async_file_t _file;
+	png_structp _png_ptr = nullptr;
+	png_infop _info_ptr = nullptr;
+	bool _bFailed = false;
+
+	encode_t _encode = ENCODE_DEFAULT;
+	size_t _width = 0;
+	size_t _height = 0;
+	uint32_t _uBPP = 0;
+	png_color _aPalette[ 256 ];
+	uint32_t _uPaletteCount = 0; // PLTE entries
+	bool _bTrimPalette = false; // -trim: the PLTE is just the entries given, not 1 << uBPP.
+	bool _bIfChanged = false;	// -ifchanged: leave the file alone if its bytes are the same.
+	bool _bTransparent = false;
+	int _transIndex = 0;
+	int _transCount = 0;
+	size_t _uThreads = 1;
+	bool _bWhole = false; // libdeflate: the filtered rows are kept, as for ENCODE_PARALLEL.
+	std::vector< uint8_t > _aImage; // ENCODE_SMALL: the packed rows. ENCODE_PARALLEL: filtered too.
+
+public:
+
+	~png_writer_t()
+	{
+		if ( _png_ptr != nullptr )
+		{
+			png_destroy_write_struct( &_png_ptr, &_info_ptr );
+		}
+	}
+
+	static uint32_t OutputBPP( uint32_t uBPP )
+	{
+		return uBPP;
+	}
+
+	bool Open( size_t width, size_t height, uint32_t uBPP, std::vector< color_t >& aPalette, int indexOffset, bool bOpaque, int transIndex,
+			   encode_t encode, size_t threads, const std::string& strOutFile, std::string& strLog )
+	{
+		// Open
+		strLog += "Writing \"" + strOutFile + "\" (" + std::to_string( uBPP ) + "-BPP) ... ";
+
+		if ( width > PNG_UINT_31_MAX || height > PNG_UINT_31_MAX )
+		{
+			_bFailed = true;
+			strLog += "ERROR (too large for a PNG)\n\n";
+			return false;
+		}
+
+		if ( _file.Open( strOutFile, _bIfChanged ) == false )
+		{
+			_bFailed = true;
+			strLog += "ERROR (attempted overwrite?)\n\n";
+			return false;
+		}
+
+		_encode = encode;
+		_bWhole = ( deflate_backend() == DEFLATE_LIBDEFLATE ) && ( encode == ENCODE_DEFAULT || encode == ENCODE_FAST );
+		_uThreads = threads;
+		_width = width;
+		_height = height;
+		_uBPP = uBPP;
+		_uPaletteCount = _bTrimPalette ? uint32_t( std::clamp< size_t >( aPalette.size(), 1, size_t( 1 ) << uBPP ) ) : ( 1u << uBPP );
+
+		// Palette!
+
+		// base black palette.
+		for ( uint32_t i = 0; i < 256; ++i )
+		{
+			_aPalette[ i ].red = _aPalette[ i ].green = _aPalette[ i ].blue = 0;
+		}
+
+		size_t palCopyStart;
+
+		if ( bOpaque )
+		{
+			palCopyStart = 0;
+		}
+		else
+		{
+			palCopyStart = 1;
+
+			const color_t src = aPalette[ 0 ];
+			uint8_t offset = (uint8_t)( transIndex );
+			png_color* p = _aPalette + offset;
+			p->red = src.chan[ 0 ];
+			p->green = src.chan[ 1 ];
+			p->blue = src.chan[ 2 ];
+		}
+
+		for ( size_t i = palCopyStart; i < aPalette.size(); ++i )
+		{
+			const color_t src = aPalette[ i ];
+			uint8_t offset = (uint8_t)( i + indexOffset );
+			png_color* p = _aPalette + offset;
+			p->red = src.chan[ 0 ];
+			p->green = src.chan[ 1 ];
+			p->blue = src.chan[ 2 ];
+		}
+
+		_bTransparent = ( bOpaque == false );
+		_transIndex = (png_byte)( transIndex );
+		_transCount = (int)( (png_byte)indexOffset ) + 1;
+
+		if ( _encode == ENCODE_SMALL )
+		{
+			const size_t stride = ( size_t( width ) * uBPP + 7 ) / 8;
+			_aImage.reserve( stride * height );
+			return true;
+		}
+
+		if ( _encode == ENCODE_PARALLEL || _bWhole )
+		{
+			const size_t stride = ( size_t( width ) * uBPP + 7 ) / 8 + 1;
+			_aImage.reserve( stride * height );
+		}
+
+		// Initialise the PNG.
+		_png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
+		if ( _png_ptr == nullptr )
+		{
+			_bFailed = true;
+			strLog += "ERROR: png_create_write_struct failed.\n";
+			return false;
+		}
+
+		png_set_user_limits( _png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+		// Initialise the information structure.
+		_info_ptr = png_create_info_struct( _png_ptr );
+		if ( _info_ptr == nullptr )
+		{
+			_bFailed = true;
+			strLog += "ERROR: png_create_info_struct failed.\n";
+			return false;
+		}
+
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			// Setup the writer
+			png_set_write_fn( _png_ptr, &_file, png_write_data_fn, png_flush_data_fn );
+
+			WriteHeader( _png_ptr, _info_ptr );
+
+			if ( _encode == ENCODE_FAST )
+			{
+				// palette images are not filtered by default anyway; run length matching
+				// is the quickest zlib strategy and close to the default level in size.
+				png_set_filter( _png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE );
+				png_set_compression_level( _png_ptr, 1 );
+				png_set_compression_strategy( _png_ptr, Z_RLE );
+			}
+
+			// Write!
+			png_write_info( _png_ptr, _info_ptr );
+			return true;
+		}
+
+		_bFailed = true;
+		return false;
+	}
+
+	// Write the next row, already packed and holding the final indices (see options_t::aOutIndex).
+	void WriteRow( const uint8_t* pRow )
+	{
+		if ( _bFailed )
+		{
+			return;
+		}
+
+		if ( _encode == ENCODE_SMALL )
+		{
+			_aImage.insert( _aImage.end(), pRow, pRow + ( _width * _uBPP + 7 ) / 8 );
+			return;
+		}
+
+		if ( _encode == ENCODE_PARALLEL || _bWhole )
+		{
+			// each row is filter type byte, then the row; libpng leaves palette images unfiltered too.
+			_aImage.push_back( PNG_FILTER_VALUE_NONE );
+			_aImage.insert( _aImage.end(), pRow, pRow + ( _width * _uBPP + 7 ) / 8 );
+			return;
+		}
+
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			png_bytep row = const_cast<png_bytep>( pRow );
+			png_write_rows( _png_ptr, &row, 1 );
+		}
+		else
+		{
+			_bFailed = true;
+		}
+	}
+
+	void Close( std::string& strLog )
+	{
+		TRACE_ZONE( "png_write_finish" );
+
+		if ( _bFailed )
+		{
+			return;
+		}
+
+		if ( _encode == ENCODE_SMALL )
+		{
+			WriteSmallest( strLog );
+		}
+		else if ( _encode == ENCODE_PARALLEL )
+		{
+			WriteParallel( strLog );
+		}
+		else if ( _bWhole )
+		{
+			WriteWhole( strLog );
+		}
+		else
+		{
+			jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+			if ( setjmp( *p_jmp_buf ) != -1 )
+			{
+				png_write_end( _png_ptr, nullptr );
+			}
+			else
+			{
+				_bFailed = true;
+			}
+		}
+
+		// the last of the file may still be on its way to the disk.
+		if ( _bFailed == false )
+		{
+			if ( _file.Close() )
+			{
+				strLog += _file.Unchanged() ? "UNCHANGED\n" : "OK\n";
+			}
+			else
+			{
+				_bFailed = true;
+				strLog += "ERROR: write failed.\n";
+			}
+		}
+	}
+
+	// Drop the output instead of closing it, as the image could not be read in full.
+	void Discard( std::string& strLog )
+	{
+		_bFailed = true;
+		_file.Discard();
+		strLog += "ERROR (the image could not be read in full)\n\n";
+	}
+
+	// bytes written so far, including any still buffered.
+	uint64_t Size() const
+	{
+		return _file.Size();
+	}
+
+private:
+
+	void WriteHeader( png_structp png_ptr, png_infop info_ptr )
+	{
+		// Setup the header
+		png_set_IHDR( png_ptr, info_ptr, png_uint_32( _width ), png_uint_32( _height ),
+					  _uBPP /*CHANNEL DEPTH*/, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+					  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+
+		// palette
+		png_set_PLTE( png_ptr, info_ptr, _aPalette, int( _uPaletteCount ) );
+
+		// Transparent index?
+		if ( _bTransparent )
+		{
+			png_color_16 palette_trans[ 1 ];
+			png_byte palette_trans_alpha[ 256 ];
+			palette_trans[ 0 ].index = (png_byte)( _transIndex ); // INDEX
+			for ( int i = 0; i < 256; ++i )
+				palette_trans_alpha[ i ] = 255; // Opaque
+			palette_trans_alpha[ palette_trans[ 0 ].index ] = 0; // Invisible
+			png_set_tRNS( png_ptr, info_ptr, palette_trans_alpha, _transCount, palette_trans );
+		}
+	}
+
+	static void memory_write_fn( png_structp png_ptr, png_bytep p_data, png_size_t size )
+	{
+		std::vector< uint8_t >* pOut = reinterpret_cast< std::vector< uint8_t >* >( png_get_io_ptr( png_ptr ) );
+		pOut->insert( pOut->end(), p_data, p_data + size );
+	}
+
+	// Encode the kept rows into aOut with one filter and zlib strategy, or with strategy -1,
+	// unfiltered and compressed whole by libdeflate at its highest level.
+	bool EncodeMemory( int filters, int strategy, std::vector< uint8_t >& aOut )
+	{
+		png_structp png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
+		if ( png_ptr == nullptr )
+		{
+			return false;
+		}
+
+		png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+		png_infop info_ptr = png_create_info_struct( png_ptr );
+		std::vector< uint8_t > aFiltered;
+		std::vector< uint8_t > aStream;
+		bool bOK = false;
+
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
+
+		if ( info_ptr != nullptr && setjmp( *p_jmp_buf ) != -1 )
+		{
+			png_set_write_fn( png_ptr, &aOut, memory_write_fn, png_flush_data_fn );
+
+			WriteHeader( png_ptr, info_ptr );
+
+			const size_t stride = ( _width * _uBPP + 7 ) / 8;
+
+			if ( strategy < 0 )
+			{
+				png_write_info( png_ptr, info_ptr );
+
+				aFiltered.reserve( ( stride + 1 ) * _height );
+				for ( size_t y = 0; y < _height; ++y )
+				{
+					aFiltered.push_back( PNG_FILTER_VALUE_NONE );
+					aFiltered.insert( aFiltered.end(), _aImage.data() + stride * y, _aImage.data() + stride * ( y + 1 ) );
+				}
+
+				bOK = png_write_compressed( png_ptr, aFiltered.data(), aFiltered.size(), 12, aStream );
+			}
+			else
+			{
+				png_set_filter( png_ptr, PNG_FILTER_TYPE_BASE, filters );
+				png_set_compression_level( png_ptr, Z_BEST_COMPRESSION );
+				png_set_compression_mem_level( png_ptr, MAX_MEM_LEVEL );
+				png_set_compression_strategy( png_ptr, strategy );
+
+				png_write_info( png_ptr, info_ptr );
+
+				for ( size_t y = 0; y < _height; ++y )
+				{
+					png_bytep row = _aImage.data() + stride * y;
+					png_write_rows( png_ptr, &row, 1 );
+				}
+
+				png_write_end( png_ptr, nullptr );
+				bOK = true;
+			}
+		}
+
+		png_destroy_write_struct( &png_ptr, ( info_ptr != nullptr ) ? &info_ptr : nullptr );
+		return bOK;
+	}
+
+	// Try every filter (and the adaptive choice of all of them) with each zlib strategy, and
+	// libdeflate's best if it is in use.
+	void WriteSmallest( std::string& strLog )
+	{
+		static constexpr int kFilters[] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS };
+		static constexpr int kStrategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE };
+
+		std::vector< uint8_t > aBest;
+		std::vector< uint8_t > aTrial;
+
+		for ( int filters : kFilters )
+		{
+			for ( int strategy : kStrategies )
+			{
+				aTrial.clear();
+
+				if ( EncodeMemory( filters, strategy, aTrial ) && ( aBest.empty() || aTrial.size() < aBest.size() ) )
+				{
+					std::swap( aBest, aTrial );
+				}
+			}
+		}
+
+		if ( deflate_backend() == DEFLATE_LIBDEFLATE )
+		{
+			aTrial.clear();
+
+			if ( EncodeMemory( PNG_FILTER_NONE, -1, aTrial ) && ( aBest.empty() || aTrial.size() < aBest.size() ) )
+			{
+				std::swap( aBest, aTrial );
+			}
+		}
+
+		if ( aBest.empty() )
+		{
+			_bFailed = true;
+			strLog += "ERROR\n";
+			return;
+		}
+
+		_file.Write( aBest.data(), aBest.size() );
+	}
+
+	// Append a chunk to the file; its data is the concatenation of the parts, whose CRCs are already known.
+	struct chunk_part_t { const uint8_t* pData; size_t size; uint32_t uCRC; };
+
+	void WriteChunk( const char* szType, std::initializer_list< chunk_part_t > parts )
+	{
+		size_t size = 0;
+		uint32_t uCRC = uint32_t( crc32( 0, reinterpret_cast< const Bytef* >( szType ), 4 ) );
+		for ( const chunk_part_t& part : parts )
+		{
+			size += part.size;
+			uCRC = uint32_t( crc32_combine( uCRC, part.uCRC, z_off_t( part.size ) ) );
+		}
+
+		uint8_t length[ 4 ];
+		uint8_t crc[ 4 ];
+		png_save_uint_32( length, png_uint_32( size ) );
+		png_save_uint_32( crc, uCRC );
+
+		_file.Write( length, 4 );
+		_file.Write( szType, 4 );
+		for ( const chunk_part_t& part : parts )
+		{
+			_file.Write( part.pData, part.size );
+		}
+		_file.Write( crc, 4 );
+	}
+
+	// Compress the kept rows at once with libdeflate, after the header libpng wrote in Open.
+	void WriteWhole( std::string& strLog )
+	{
+		std::vector< uint8_t > aStream;
+
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			if ( png_write_compressed( _png_ptr, _aImage.data(), _aImage.size(), ( _encode == ENCODE_FAST ) ? 1 : Z_DEFAULT_COMPRESSION, aStream ) == false )
+			{
+				_bFailed = true;
+				strLog += "ERROR: deflate failed.\n";
+			}
+		}
+		else
+		{
+			_bFailed = true;
+		}
+	}
+
+	// Deflate the kept rows on several threads, after the header libpng wrote in Open.
+	void WriteParallel( std::string& strLog )
+	{
+		std::vector< deflate_block_t > aBlocks;
+		const int level = Z_DEFAULT_COMPRESSION;
+
+		if ( deflate_blocks( _aImage.data(), _aImage.size(), level, _uThreads, aBlocks ) == false )
+		{
+			_bFailed = true;
+			strLog += "ERROR: deflate failed.\n";
+			return;
+		}
+
+		// zlib header (32K window, default level).
+		const uint8_t header[ 2 ] = { 0x78, 0x9C };
+
+		uint32_t uAdler = aBlocks[ 0 ].uAdler;
+		for ( size_t i = 1; i < aBlocks.size(); ++i )
+		{
+			const size_t len = std::min( kDeflateBlock, _aImage.size() - i * kDeflateBlock );
+			uAdler = uint32_t( adler32_combine( uAdler, aBlocks[ i ].uAdler, z_off_t( len ) ) );
+		}
+
+		uint8_t trailer[ 4 ];
+		png_save_uint_32( trailer, uAdler );
+
+		const chunk_part_t header_part = { header, 2, uint32_t( crc32( 0, header, 2 ) ) };
+		const chunk_part_t trailer_part = { trailer, 4, uint32_t( crc32( 0, trailer, 4 ) ) };
+
+		for ( size_t i = 0; i < aBlocks.size(); ++i )
+		{
+			const deflate_block_t& block = aBlocks[ i ];
+			const chunk_part_t block_part = { block.aOut.data(), block.aOut.size(), block.uCRC };
+			const chunk_part_t none = { nullptr, 0, 0 };
+			WriteChunk( "IDAT", { ( i == 0 ) ? header_part : none, block_part, ( i + 1 == aBlocks.size() ) ? trailer_part : none } );
+		}
+
+		WriteChunk( "IEND", {} );
+	}
+};
+
+//
+// raw_writer_t
+//
+// -raw output, for loaders that map the file and use it in place: a raw_header_t, the
+// palette as ( 1 << uBPP ) RGBA entries, then the rows of indices with no padding
+// between them. 1 and 2 bit palettes are written at 4 bits, high nibble first as in
+// a PNG. The header and palette are multiples of 16 bytes, so the indices are aligned.
+//
+struct raw_header_t
+{
+	char magic[ 8 ]; // "APIDX001"
+	uint32_t uWidth;
+	uint32_t uHeight;
+	uint32_t uBPP; // 4 or 8
+	uint32_t uStride; // bytes per row
+	uint32_t uPaletteSize; // entries, always 1 << uBPP
+	uint32_t uDataOffset; // of the first row, from the start of the file
+};
+
+static_assert( sizeof( raw_header_t ) == 32, "raw_header_t is written as is" );
+
+struct raw_writer_t
+{
+
+public:
+
+	async_file_t _file;
+	bool _bFailed = false;
+	bool _bTrimPalette = false; // ignored, the palette is always 1 << uBPP entries.
+	bool _bIfChanged = false;	// -ifchanged: leave the file alone if its bytes are the same.
+	size_t _uStride = 0;
+
+public:
+
+	static uint32_t OutputBPP( uint32_t uBPP )
+	{
+		return std::max< uint32_t >( uBPP, 4 );
+	}
+
+	// as png_writer_t::Open; there is no encoding to choose.
+	bool Open( size_t width, size_t height, uint32_t uBPP, std::vector< color_t >& aPalette, int indexOffset, bool bOpaque, int transIndex,
+			   encode_t encode, size_t threads, const std::string& strOutFile, std::string& strLog )
+	{
+		strLog += "Writing \"" + strOutFile + "\" (" + std::to_string( uBPP ) + "-BPP raw) ... ";
+
+		_uStride = ( width * uBPP + 7 ) / 8;
+
+		// the header holds 32-bit sizes.
+		if ( _uStride > UINT32_MAX || height > UINT32_MAX )
+		{
+			_bFailed = true;
+			strLog += "ERROR (too large for the raw header)\n\n";
+			return false;
+		}
+
+		if ( _file.Open( strOutFile, _bIfChanged ) == false )
+		{
+			_bFailed = true;
+			strLog += "ERROR (attempted overwrite?)\n\n";
+			return false;
+		}
+
+		raw_header_t header;
+		memcpy( header.magic, "APIDX001", 8 );
+		header.uWidth = uint32_t( width );
+		header.uHeight = uint32_t( height );
+		header.uBPP = uBPP;
+		header.uStride = uint32_t( _uStride );
+		header.uPaletteSize = 1u << uBPP;
+		header.uDataOffset = uint32_t( sizeof( raw_header_t ) + header.uPaletteSize * 4 );
+
+		// the same entries as png_writer_t's PLTE and tRNS, unused ones opaque black.
+		std::vector< color_t > aEntries( 256, color_t( 0xFF000000 ) );
+
+		size_t palCopyStart = 0;
+
+		if ( bOpaque == false )
+		{
+			palCopyStart = 1;
+			aEntries[ uint8_t( transIndex ) ].value_abgr = aPalette[ 0 ].BGR() | 0xFF000000;
+		}
+
+		for ( size_t i = palCopyStart; i < aPalette.size(); ++i )
+		{
+			aEntries[ uint8_t( i + indexOffset ) ].value_abgr = aPalette[ i ].BGR() | 0xFF000000;
+		}
+
+		// the tRNS covers the entries up to the index offset.
+		if ( bOpaque == false && uint8_t( transIndex ) <= uint8_t( indexOffset ) )
+		{
+			aEntries[ uint8_t( transIndex ) ].chan[ 3 ] = 0;
+		}
+
+		aEntries.resize( header.uPaletteSize );
+
+		_file.Write( &header, sizeof( header ) );
+		_file.Write( aEntries.data(), aEntries.size() * 4 );
+
+		return true;
+	}
+
+	// Write the next row, already packed and holding the final indices.
+	void WriteRow( const uint8_t* pRow )
+	{
+		if ( _bFailed == false )
+		{
+			_file.Write( pRow, _uStride );
+		}
+	}
+
+	void Close( std::string& strLog )
+	{
+		if ( _bFailed )
+		{
+			return;
+		}
+
+		if ( _file.Close() == false )
+		{
+			_bFailed = true;
+			strLog += "ERROR: write failed.\n";
+			return;
+		}
+
+		strLog += _file.Unchanged() ? "UNCHANGED\n" : "OK\n";
+	}
+
+	// Drop the output instead of closing it, as the image could not be read in full.
+	void Discard( std::string& strLog )
+	{
+		_bFailed = true;
+		_file.Discard();
+		strLog += "ERROR (the image could not be read in full)\n\n";
+	}
+
+	// bytes written so far, including any still buffered.
+	uint64_t Size() const
+	{
+		return _file.Size();
+	}
+};
+
+//==============================================================================
+
+//
+// Error diffusion kernels
+//
+// Each kernel is a table of taps: a neighbour's offset from the pixel being remapped,
+// and its share of the error in 1/kDivisor. kRows is how many rows below the current
+// one it reaches. The dither functions are generated from these tables as templates,
+// so the taps are constants and there is no test of the kernel type per pixel.
+//
+struct kernel_tap_t
+{
+	int dx;
+	int dy;
+	int weight;
+};
+
+struct kernel_floyd_t // FloydSteinberg
+{
+	static constexpr int kDivisor = 16;
+	static constexpr int kRows = 1;
+	static constexpr kernel_tap_t kTaps[] = {
+								{ 1, 0, 7 },
+		{ -1, 1, 3 },	{ 0, 1, 5 },	{ 1, 1, 1 },
+	};
+};
+
+struct kernel_atkinson_t // Atkinson: only 6/8 of the error is passed on.
+{
+	static constexpr int kDivisor = 8;
+	static constexpr int kRows = 2;
+	static constexpr kernel_tap_t kTaps[] = {
+								{ 1, 0, 1 },	{ 2, 0, 1 },
+		{ -1, 1, 1 },	{ 0, 1, 1 },	{ 1, 1, 1 },
+						{ 0, 2, 1 },
+	};
+};
+
+struct kernel_sierra_lite_t // Sierra-Lite (Sierra "2-4A")
+{
+	static constexpr int kDivisor = 4;
+	static constexpr int kRows = 1;
+	static constexpr kernel_tap_t kTaps[] = {
+								{ 1, 0, 2 },
+		{ -1, 1, 1 },	{ 0, 1, 1 },
+	};
+};
+
+struct kernel_jjn_t // Jarvis, Judice and Ninke
+{
+	static constexpr int kDivisor = 48;
+	static constexpr int kRows = 2;
+	static constexpr kernel_tap_t kTaps[] = {
+												{ 1, 0, 7 },	{ 2, 0, 5 },
+		{ -2, 1, 3 },	{ -1, 1, 5 },	{ 0, 1, 7 },	{ 1, 1, 5 },	{ 2, 1, 3 },
+		{ -2, 2, 1 },	{ -1, 2, 3 },	{ 0, 2, 5 },	{ 1, 2, 3 },	{ 2, 2, 1 },
+	};
+};
+
+static void accumulate_error( ptrdiff_t x, ptrdiff_t y, dithermap_t< dither_t >& workspace, const dither_t& error, float fScale )
+{
+	// out of bounds?
+	if ( x < 0 || y < 0 || x >= ptrdiff_t( workspace._width ) || y >= ptrdiff_t( workspace._height ) )
+		return;
+
+	dither_t& p = workspace.Element( x, y );
+	p.err_r += error.err_r * fScale;
+	p.err_g += error.err_g * fScale;
+	p.err_b += error.err_b * fScale;
+}
+
+// error is in whole levels, weight in 1/kDivisor.
+static void accumulate_error( ptrdiff_t x, ptrdiff_t y, dithermap_t< dither_fixed_t >& workspace, const int error[ 3 ], int weight )
+{
+	// out of bounds?
+	if ( x < 0 || y < 0 || x >= ptrdiff_t( workspace._width ) || y >= ptrdiff_t( workspace._height ) )
+		return;
+
+	dither_fixed_t& p = workspace.Element( x, y );
+	p.value[ 0 ] = int16_t( p.value[ 0 ] + error[ 0 ] * weight );
+	p.value[ 1 ] = int16_t( p.value[ 1 ] + error[ 1 ] * weight );
+	p.value[ 2 ] = int16_t( p.value[ 2 ] + error[ 2 ] * weight );
+}
+
+static void accumulate_error( ptrdiff_t x, ptrdiff_t y, dithermap_t< dither_linear_t >& workspace, const int error[ 3 ], int weight )
+{
+	// out of bounds?
+	if ( x < 0 || y < 0 || x >= ptrdiff_t( workspace._width ) || y >= ptrdiff_t( workspace._height ) )
+		return;
+
+	dither_linear_t& p = workspace.Element( x, y );
+	p.value[ 0 ] += error[ 0 ] * weight;
+	p.value[ 1 ] += error[ 1 ] * weight;
+	p.value[ 2 ] += error[ 2 ] * weight;
+}
+
+//
+// image_thread_count
+//
+// How many threads to spread the remap of one image over. It is the cores left over
+// by -j, and 1 for images too small to be worth it.
+//
+static constexpr size_t kBandMinPixels = 1 << 20;
+
+static size_t image_thread_count( size_t width, size_t height, const options_t& options )
+{
+	const size_t pixels = width * height;
+	const size_t threads = task_thread_cap() / std::max< uint32_t >( options.uThreadCount * options.uShareCount, 1 );
+
+	if ( pixels < kBandMinPixels || height < 2 )
+	{
+		return 1;
+	}
+
+	return std::clamp< size_t >( threads, 1, height );
+}
+
+static size_t image_thread_count( const colormap_t& image, const options_t& options )
+{
+	return image_thread_count( image._width, image._height, options );
+}
+
+//
+// stream_row_count
+//
+// Rows of the source and output held at once while streaming an image: kStreamRows for
+// each thread working on it. That covers the row bands of run_row_bands, and the rows
+// in flight in dither_wavefront plus the kernel's reach below them.
+//
+static constexpr size_t kStreamRows = 32;
+
+static size_t stream_row_count( size_t width, size_t height, const options_t& options )
+{
+	return image_thread_count( width, height, options ) * kStreamRows;
+}
+
+//
+// dither_pixel
+//
+// Error diffusion step for one pixel: pick its nearest palette index with search, and spread the
+// error over the neighbours in kernel K. Dir is -1 on the right-to-left rows of a
+// serpentine scan, which mirrors the kernel.
+//
+template < typename K, int Dir, typename S >
+static void dither_pixel( dithermap_t< dither_t >& workspace, options_t& options, const S& search, ptrdiff_t x, ptrdiff_t y )
+{
+	dither_t& pixel = workspace.Element( x, y );
+
+	if ( pixel.is_opaque )
+	{
+		// decide which is our closest palette index
+		color_t old_colour_sat;
+		old_colour_sat.FromDither( pixel );
+		uint8_t remapped_idx = search.Find( old_colour_sat );
+		pixel.index = remapped_idx; // store this.
+
+		// not an exact match? (likely)
+		const color_t new_colour_sat = options.aPalette[ remapped_idx ];
+		if ( old_colour_sat.BGR() != new_colour_sat.BGR() )
+		{
+			// compute error between the pixel and the palette value we must use.
+			dither_t quant_error;
+			quant_error.err_r = ( static_cast<float>( old_colour_sat.chan[ 0 ] ) - static_cast<float>( new_colour_sat.chan[ 0 ] ) ) / 255.0f;
+			quant_error.err_g = ( static_cast<float>( old_colour_sat.chan[ 1 ] ) - static_cast<float>( new_colour_sat.chan[ 1 ] ) ) / 255.0f;
+			quant_error.err_b = ( static_cast<float>( old_colour_sat.chan[ 2 ] ) - static_cast<float>( new_colour_sat.chan[ 2 ] ) ) / 255.0f;
+
+			// diffuse the error among the neighbours
+			for ( const kernel_tap_t& tap : K::kTaps )
+			{
+				accumulate_error( x + tap.dx * Dir, y + tap.dy, workspace, quant_error, float( tap.weight ) / float( K::kDivisor ) );
+			}
+		}
+	}
+}
+
+//
+// dither_pixel (-fixed)
+//
+// As above, in integers. Each channel is held in 1/kDivisor of a level, so the kernel
+// weights are exact and the level is value / kDivisor. The result only depends on
+// integer arithmetic, so it is the same with any compiler or platform.
+//
+template < typename K, int Dir, typename S >
+static void dither_pixel( dithermap_t< dither_fixed_t >& workspace, options_t& options, const S& search, ptrdiff_t x, ptrdiff_t y )
+{
+	dither_fixed_t& pixel = workspace.Element( x, y );
+
+	if ( pixel.is_opaque )
+	{
+		// decide which is our closest palette index (negative values clamp to 0).
+		color_t old_colour_sat;
+		old_colour_sat.chan[ 0 ] = static_cast<uint8_t>( std::clamp( pixel.value[ 0 ] / K::kDivisor, 0, 255 ) );
+		old_colour_sat.chan[ 1 ] = static_cast<uint8_t>( std::clamp( pixel.value[ 1 ] / K::kDivisor, 0, 255 ) );
+		old_colour_sat.chan[ 2 ] = static_cast<uint8_t>( std::clamp( pixel.value[ 2 ] / K::kDivisor, 0, 255 ) );
+		old_colour_sat.chan[ 3 ] = 0xFF;
+
+		uint8_t remapped_idx = search.Find( old_colour_sat );
+		pixel.index = remapped_idx; // store this.
+
+		// not an exact match? (likely)
+		const color_t new_colour_sat = options.aPalette[ remapped_idx ];
+		if ( old_colour_sat.BGR() != new_colour_sat.BGR() )
+		{
+			const int quant_error[ 3 ] = {
+				int( old_colour_sat.chan[ 0 ] ) - int( new_colour_sat.chan[ 0 ] ),
+				int( old_colour_sat.chan[ 1 ] ) - int( new_colour_sat.chan[ 1 ] ),
+				int( old_colour_sat.chan[ 2 ] ) - int( new_colour_sat.chan[ 2 ] ),
+			};
+
+			// diffuse the error among the neighbours
+			for ( const kernel_tap_t& tap : K::kTaps )
+			{
+				accumulate_error( x + tap.dx * Dir, y + tap.dy, workspace, quant_error, tap.weight );
+			}
+		}
+	}
+}
+
+//
+// dither_pixel (-linear)
+//
+// As -fixed, with each channel in 12-bit linear light: the colour searched for is the
+// nearest sRGB to the level, and the error is against the palette entry in linear
+// light (options.aPaletteLinear), so what is diffused is light rather than sRGB code
+// values, and dithered areas keep their brightness.
+//
+template < typename K, int Dir, typename S >
+static void dither_pixel( dithermap_t< dither_linear_t >& workspace, options_t& options, const S& search, ptrdiff_t x, ptrdiff_t y )
+{
+	dither_linear_t& pixel = workspace.Element( x, y );
+
+	if ( pixel.is_opaque )
+	{
+		const uint8_t* aToSRGB = linear12_srgb_table();
+
+		// negative values clamp to 0.
+		int level[ 3 ];
+		color_t old_colour_sat;
+		for ( int c = 0; c < 3; ++c )
+		{
+			level[ c ] = std::clamp( pixel.value[ c ] / K::kDivisor, 0, kLinearLevels - 1 );
+			old_colour_sat.chan[ c ] = aToSRGB[ level[ c ] ];
+		}
+		old_colour_sat.chan[ 3 ] = 0xFF;
+
+		uint8_t remapped_idx = search.Find( old_colour_sat );
+		pixel.index = remapped_idx; // store this.
+
+		const uint16_t* pLinear = &options.aPaletteLinear[ size_t( remapped_idx ) * 3 ];
+		const int quant_error[ 3 ] = {
+			level[ 0 ] - int( pLinear[ 0 ] ),
+			level[ 1 ] - int( pLinear[ 1 ] ),
+			level[ 2 ] - int( pLinear[ 2 ] ),
+		};
+
+		// not an exact match? (likely)
+		if ( quant_error[ 0 ] != 0 || quant_error[ 1 ] != 0 || quant_error[ 2 ] != 0 )
+		{
+			// diffuse the error among the neighbours
+			for ( const kernel_tap_t& tap : K::kTaps )
+			{
+				accumulate_error( x + tap.dx * Dir, y + tap.dy, workspace, quant_error, tap.weight );
+			}
+		}
+	}
+}
+
+//
+// dither_row
+//
+// dither_pixel along row y, left to right for Dir = 1 and right to left for Dir = -1.
+//
+template < typename K, int Dir, typename T, typename S >
+static void dither_row( dithermap_t< T >& workspace, options_t& options, const S& search, ptrdiff_t y )
+{
+	const ptrdiff_t width = ptrdiff_t( workspace._width );
+
+	for ( ptrdiff_t i = 0; i < width; ++i )
+	{
+		const ptrdiff_t x = ( Dir > 0 ) ? i : ( width - 1 - i );
+		dither_pixel< K, Dir >( workspace, options, search, x, y );
+	}
+}
+
+template < typename K >
+static inline void load_dither_colour( dither_t& target, const color_t colour )
+{
+	target.err_r = static_cast<float>( colour.chan[ 0 ] ) / 255.0f;
+	target.err_g = static_cast<float>( colour.chan[ 1 ] ) / 255.0f;
+	target.err_b = static_cast<float>( colour.chan[ 2 ] ) / 255.0f;
+}
+
+template < typename K >
+static inline void load_dither_colour( dither_fixed_t& target, const color_t colour )
+{
+	target.value[ 0 ] = int16_t( colour.chan[ 0 ] * K::kDivisor );
+	target.value[ 1 ] = int16_t( colour.chan[ 1 ] * K::kDivisor );
+	target.value[ 2 ] = int16_t( colour.chan[ 2 ] * K::kDivisor );
+}
+
+template < typename K >
+static inline void load_dither_colour( dither_linear_t& target, const color_t colour )
+{
+	const uint16_t* aLinear = srgb_linear12_table();
+	target.value[ 0 ] = int32_t( aLinear[ colour.chan[ 0 ] ] ) * K::kDivisor;
+	target.value[ 1 ] = int32_t( aLinear[ colour.chan[ 1 ] ] ) * K::kDivisor;
+	target.value[ 2 ] = int32_t( aLinear[ colour.chan[ 2 ] ] ) * K::kDivisor;
+}
+
+//
+// load_dither_row
+//
+// Fill row y of the workspace from the source image, ready to receive error.
+//
+template < typename K, uint32_t N, typename T >
+static void load_dither_row( const colormap_t& image, dithermap_t< T >& workspace, const options_t& options, const color_t pal_idx0, size_t y )
+{
+	const bool bCheckTransp = ( options.bOpaque == false ) && image.bHasAlpha;
+
+	image.Fetch( y );
+	const uint8_t* pSrc = image.Row( y );
+
+	std::vector< uint64_t > aMask;
+	if ( bCheckTransp )
+	{
+		image.AlphaMask( y, options.uAlphaCut, aMask );
+	}
+
+	for ( size_t x = 0; x < image._width; ++x )
+	{
+		color_t colour = colormap_t::Pixel< N >( pSrc, x );
+
+		T& target = workspace.Element( x, y );
+		load_dither_colour< K >( target, colour );
+		target.index = 0;
+
+		if ( image.bHasAlpha == false && options.bOpaque == false && colour.BGR() == pal_idx0.BGR() )
+		{
+			target.is_opaque = false;
+		}
+		else
+		{
+			target.is_opaque = !( bCheckTransp && ( ( aMask[ x >> 6 ] >> ( x & 63 ) ) & 1 ) );
+		}
+	}
+}
+
+//
+// store_dither_row
+//
+// Copy the finished pixel indices of row y into the output image, through aRow, and into
+// pQuality if the image is being measured.
+//
+template < typename T >
+static void store_dither_row( const colormap_t& image, const dithermap_t< T >& workspace, indexmap_t& output, const options_t& options, quality_t* pQuality,
+							  std::vector< uint8_t >& aRow, size_t y )
+{
+	for ( size_t x = 0; x < workspace._width; ++x )
+	{
+		aRow[ x ] = options.aOutIndex[ workspace.Element( x, y ).index ];
+	}
+
+	if ( pQuality != nullptr )
+	{
+		pQuality->AddRow( image, y, aRow.data() );
+	}
+
+	output.StoreRow( y, aRow.data() );
+}
+
+//
+// kernel_lag
+//
+// How many pixels past x row y - 1 must have finished before row y can work on pixel x,
+// for the wavefront to give the same result as a serial pass. Row y - j is then at least
+// j times this far ahead. Every write into a pixel from a row above has to be made
+// before row y reads it (the pixel itself, { 0, 0 }) or adds to it (tap a), and the
+// row above is the one that is least far ahead, so each pair of taps a and b, with b
+// j rows further down, needs a lead of ( a.dx - b.dx ) / j. FloydSteinberg gives 2.
+//
+template < typename K >
+static constexpr int kernel_lag()
+{
+	int lag = 0;
+
+	for ( int i = -1; i < int( std::size( K::kTaps ) ); ++i )
+	{
+		const kernel_tap_t a = ( i < 0 ) ? kernel_tap_t{ 0, 0, 0 } : K::kTaps[ i ];
+
+		for ( const kernel_tap_t& b : K::kTaps )
+		{
+			const int j = b.dy - a.dy;
+			if ( j > 0 )
+			{
+				lag = std::max( lag, ( a.dx - b.dx + j - 1 ) / j );
+			}
+		}
+	}
+
+	return lag;
+}
+
+//
+// dither_wavefront
+//
+// Run dither_pixel over the whole image with rows spread across threads (row y on
+// thread y % threads). Row y may only work on pixel x once row y - 1 has finished
+// pixel x + kernel_lag(): each pixel then receives its error terms in the same order
+// as a serial pass and the result is bit-identical.
+//
+// The workspace needs threads + K::kRows rows. Before starting row y a thread loads
+// row y + K::kRows, whose slot last held row y - threads - the row this thread did
+// before. Rows finish in order, so each is written out as soon as it is stored.
+//
+static constexpr uint32_t kWavefrontStep = 16; // pixels between progress updates.
+
+template < typename K, uint32_t N, typename T, typename S >
+static void dither_wavefront( const colormap_t& image, indexmap_t& output, dithermap_t< T >& workspace, options_t& options,
+							  const S& search, const color_t pal_idx0, quality_t* pQuality, size_t threads )
+{
+	const size_t width = workspace._width;
+	const size_t height = workspace._height;
+	constexpr size_t lag = size_t( kernel_lag< K >() );
+
+	// pixels finished in each row.
+	std::unique_ptr< std::atomic< size_t >[] > aProgress( new std::atomic< size_t >[ height ] );
+	for ( size_t y = 0; y < height; ++y )
+	{
+		aProgress[ y ] = 0;
+	}
+
+	auto worker_fn = [&]( size_t first_row )
+	{
+		std::vector< uint8_t > aRow( width );
+
+		for ( size_t y = first_row; y < height; y += threads )
+		{
+			if ( y == 0 )
+			{
+				for ( size_t r = 0; r < K::kRows && r < height; ++r )
+					load_dither_row< K, N >( image, workspace, options, pal_idx0, r );
+			}
+			if ( y + K::kRows < height )
+				load_dither_row< K, N >( image, workspace, options, pal_idx0, y + K::kRows );
+
+			size_t ready = ( y == 0 ) ? width : 0; // pixels of row y - 1 known to be finished.
+
+			for ( size_t x = 0; x < width; ++x )
+			{
+				const size_t needed = std::min( x + lag + 1, width );
+
+				while ( ready < needed )
+				{
+					ready = aProgress[ y - 1 ].load( std::memory_order_acquire );
+					if ( ready < needed )
+						std::this_thread::yield();
+				}
+
+				dither_pixel< K, 1 >( workspace, options, search, x, y );
+
+				// the end of the row is only published once it has been written, below.
+				if ( ( ( x + 1 ) % kWavefrontStep ) == 0 && x + 1 < width )
+				{
+					aProgress[ y ].store( x + 1, std::memory_order_release );
+				}
+			}
+
+			store_dither_row( image, workspace, output, options, pQuality, aRow, y );
+
+			// row y - 1 was written before it marked itself finished, so rows go out in order.
+			output.Flush( y + 1 );
+
+			aProgress[ y ].store( width, std::memory_order_release );
+		}
+	};
+
+	std::vector< std::thread > aThreads;
+	for ( size_t t = 1; t < threads; ++t )
+	{
+		aThreads.emplace_back( worker_fn, t );
+	}
+
+	worker_fn( 0 );
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+}
+
+//
+// remap_image_dither
+//
+// Error diffusion with kernel K over an N channel image, in floats (T = dither_t) or
+// integers (dither_fixed_t).
+// A serpentine scan runs every other row right to left; it is always serial, as each
+// row then needs the whole of the row above to be finished.
+//
+template < typename K, uint32_t N, typename T, typename S >
+static void remap_image_dither( const colormap_t& image, indexmap_t& output, options_t& options, const S& search, const color_t pal_idx0, quality_t* pQuality )
+{
+	TRACE_ZONE( "remap_image_dither" );
+
+	const size_t palStart = ( options.bOpaque == false ) ? 1 : 0;
+
+	const size_t threads = options.bSerpentine ? 1 : image_thread_count( image, options );
+
+	// only the rows still receiving error are kept, not the whole frame.
+	dithermap_t< T > workspace;
+	workspace.Create( image._width, image._height, threads + K::kRows );
+
+	if ( threads <= 1 )
+	{
+		std::vector< uint8_t > aRow( image._width );
+
+		for ( size_t r = 0; r < K::kRows && r < image._height; ++r )
+		{
+			load_dither_row< K, N >( image, workspace, options, pal_idx0, r );
+		}
+
+		for ( size_t y = 0; y < image._height; ++y )
+		{
+			if ( y + K::kRows < image._height )
+			{
+				load_dither_row< K, N >( image, workspace, options, pal_idx0, y + K::kRows );
+			}
+
+			if ( options.bSerpentine && ( y & 1 ) )
+			{
+				dither_row< K, -1 >( workspace, options, search, y );
+			}
+			else
+			{
+				dither_row< K, 1 >( workspace, options, search, y );
+			}
+
+			store_dither_row( image, workspace, output, options, pQuality, aRow, y );
+			output.Flush( y + 1 );
+		}
+	}
+	else
+	{
+		// the rows share the searches, so the cube must be read only.
+		if ( options.search == SEARCH_CUBE )
+		{
+			options.aPalette.Lookup( palStart, options.match ).FillAll();
+		}
+
+		dither_wavefront< K, N >( image, output, workspace, options, search, pal_idx0, pQuality, threads );
+	}
+}
+
+//
+// remap_image_diffuse
+//
+// Error diffusion with kernel K, in integers for -fixed, and in integer linear light
+// for -linear.
+//
+template < typename K, uint32_t N, typename S >
+static void remap_image_diffuse( const colormap_t& image, indexmap_t& output, options_t& options, const S& search, const color_t pal_idx0, quality_t* pQuality )
+{
+	TRACE_ZONE( "remap_image_diffuse" );
+
+	if ( options.bLinear )
+	{
+		remap_image_dither< K, N, dither_linear_t >( image, output, options, search, pal_idx0, pQuality );
+	}
+	else if ( options.bFixed )
+	{
+		remap_image_dither< K, N, dither_fixed_t >( image, output, options, search, pal_idx0, pQuality );
+	}
+	else
+	{
+		remap_image_dither< K, N, dither_t >( image, output, options, search, pal_idx0, pQuality );
+	}
+}
+
+//==============================================================================
+
+//
+// bayer_matrix
+//
+// Ranks 0..size*size-1 of a size x size Bayer matrix, built up from 2x2 by doubling.
+//
+static void bayer_matrix( uint32_t size, std::vector< uint32_t >& aRank )
+{
+	aRank.assign( 1, 0 );
+
+	for ( uint32_t n = 1; n < size; n *= 2 )
+	{
+		std::vector< uint32_t > aNext( size_t( n ) * n * 4 );
+
+		for ( uint32_t y = 0; y < n; ++y )
+		{
+			for ( uint32_t x = 0; x < n; ++x )
+			{
+				const uint32_t r = aRank[ x + y * n ] * 4;
+
+				aNext[ x + y * n * 2 ] = r;
+				aNext[ ( x + n ) + y * n * 2 ] = r + 2;
+				aNext[ x + ( y + n ) * n * 2 ] = r + 3;
+				aNext[ ( x + n ) + ( y + n ) * n * 2 ] = r + 1;
+			}
+		}
+
+		aRank.swap( aNext );
+	}
+}
+
+//
+// blue_noise_matrix
+//
+// Ranks of a size x size (tiling) blue noise pattern, made with Ulichney's void and
+// cluster method. The energy of every cell - a Gaussian sum over the cells set so far -
+// is kept up to date as cells change, so each step is one pass over the map.
+//
+static void blue_noise_matrix( uint32_t size, std::vector< uint32_t >& aRank )
+{
+	const uint32_t cells = size * size;
+	const float sigma = 1.5f;
+
+	// Gaussian of the wrapped distance between two cells, by ( dx, dy ).
+	std::vector< float > aKernel( cells );
+	for ( uint32_t y = 0; y < size; ++y )
+	{
+		for ( uint32_t x = 0; x < size; ++x )
+		{
+			const float dx = float( std::min( x, size - x ) );
+			const float dy = float( std::min( y, size - y ) );
+			aKernel[ x + y * size ] = std::exp( -( dx * dx + dy * dy ) / ( 2.0f * sigma * sigma ) );
+		}
+	}
+
+	std::vector< uint8_t > aSet( cells, 0 );
+	std::vector< float > aEnergy( cells, 0.0f );
+
+	auto toggle = [&]( uint32_t cell, bool bSet )
+	{
+		aSet[ cell ] = bSet ? 1 : 0;
+
+		const float sign = bSet ? 1.0f : -1.0f;
+		const uint32_t cx = cell % size;
+		const uint32_t cy = cell / size;
+
+		for ( uint32_t y = 0; y < size; ++y )
+		{
+			const uint32_t ky = ( ( y - cy ) & ( size - 1 ) ) * size;
+
+			for ( uint32_t x = 0; x < size; ++x )
+			{
+				aEnergy[ x + y * size ] += sign * aKernel[ ( ( x - cx ) & ( size - 1 ) ) + ky ];
+			}
+		}
+	};
+
+	// tightest cluster (highest energy set cell) or largest void (lowest energy empty cell).
+	auto find = [&]( bool bCluster ) -> uint32_t
+	{
+		uint32_t best = 0;
+		bool bFound = false;
+
+		for ( uint32_t cell = 0; cell < cells; ++cell )
+		{
+			if ( ( aSet[ cell ] != 0 ) != bCluster )
+				continue;
+
+			if ( !bFound || ( bCluster ? aEnergy[ cell ] > aEnergy[ best ] : aEnergy[ cell ] < aEnergy[ best ] ) )
+			{
+				best = cell;
+				bFound = true;
+			}
+		}
+
+		return best;
+	};
+
+	// initial pattern: a tenth of the cells, picked by a fixed LCG so it's repeatable.
+	const uint32_t initial = cells / 10;
+	uint32_t seed = 12345;
+
+	for ( uint32_t count = 0; count < initial; )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const uint32_t cell = ( seed >> 8 ) % cells;
+
+		if ( aSet[ cell ] == 0 )
+		{
+			toggle( cell, true );
+			++count;
+		}
+	}
+
+	// spread it out: move the tightest cluster into the largest void until it settles.
+	for ( uint32_t pass = 0; pass < cells; ++pass )
+	{
+		const uint32_t cluster = find( true );
+		toggle( cluster, false );
+
+		const uint32_t hole = find( false );
+		toggle( hole, true );
+
+		if ( hole == cluster )
+			break;
+	}
+
+	aRank.assign( cells, 0 );
+
+	const std::vector< uint8_t > aInitialSet = aSet;
+	const std::vector< float > aInitialEnergy = aEnergy;
+
+	// rank the initial cells, removing the tightest cluster each time.
+	for ( uint32_t rank = initial; rank > 0; --rank )
+	{
+		const uint32_t cluster = find( true );
+		toggle( cluster, false );
+		aRank[ cluster ] = rank - 1;
+	}
+
+	// then the rest, filling the largest void each time.
+	aSet = aInitialSet;
+	aEnergy = aInitialEnergy;
+
+	for ( uint32_t rank = initial; rank < cells; ++rank )
+	{
+		const uint32_t hole = find( false );
+		toggle( hole, true );
+		aRank[ hole ] = rank;
+	}
+}
+
+//
+// build_threshold_map
+//
+// Set up options.thresholds for an ordered dither mode. The offsets span three quarters
+// of the mean distance from each palette entry to its nearest neighbour, which is about
+// the step between palette colours; the full step adds visible noise without helping.
+//
+static void build_threshold_map( options_t& options, size_t palStart )
+{
+	uint32_t size;
+	std::vector< uint32_t > aRank;
+
+	switch ( options.dither )
+	{
+	case DITHER_BAYER4:		size = 4; bayer_matrix( size, aRank ); break;
+	case DITHER_BAYER8:		size = 8; bayer_matrix( size, aRank ); break;
+	case DITHER_BLUENOISE:	size = 64; blue_noise_matrix( size, aRank ); break;
+	default:				options.thresholds = threshold_map_t(); return;
+	}
+
+	const std::vector< color_t >& aPalette = options.aPalette.aColours;
+
+	double spread = 0;
+	for ( size_t i = palStart; i < aPalette.size(); ++i )
+	{
+		int nearest = INT_MAX;
+		for ( size_t j = palStart; j < aPalette.size(); ++j )
+		{
+			if ( i != j )
+				nearest = std::min( nearest, rgb_color_distance_squared( aPalette[ i ], aPalette[ j ] ) );
+		}
+
+		spread += ( nearest == INT_MAX ) ? 0.0 : std::sqrt( double( nearest ) );
+	}
+	spread *= 0.75 / double( aPalette.size() - palStart );
+
+	const uint32_t cells = size * size;
+
+	options.thresholds._size = size;
+	options.thresholds._aOffset.resize( cells );
+
+	for ( uint32_t i = 0; i < cells; ++i )
+	{
+		// rank to a threshold in ( -0.5, 0.5 ).
+		const double t = ( double( aRank[ i ] ) + 0.5 ) / double( cells ) - 0.5;
+		options.thresholds._aOffset[ i ] = int( std::lround( t * spread ) );
+	}
+}
+
+//
+// run_row_bands
+//
+// Call rows_fn( y0, y1 ) over the rows of an image, a block of output._rows at a time
+// so a streamed image only needs that many rows held. Each block is read, split into
+// one band per thread when image_thread_count allows, and then written. Bands are
+// whole rows, and every indexmap_t row starts on a new byte, so bands never share
+// packed bytes at 1, 2 or 4 bpp.
+//
+template < typename F >
+static void run_row_bands( const colormap_t& image, indexmap_t& output, options_t& options, size_t palStart, F rows_fn )
+{
+	const size_t threads = image_thread_count( image, options );
+	const size_t block = output._rows;
+
+	// the bands share the searches, so the cube must be read only.
+	if ( threads > 1 && options.search == SEARCH_CUBE )
+	{
+		options.aPalette.Lookup( palStart, options.match ).FillAll();
+	}
+
+	for ( size_t b0 = 0; b0 < image._height; b0 += block )
+	{
+		const size_t b1 = std::min( b0 + block, image._height );
+
+		{
+			TRACE_ZONE( "fetch_rows" );
+			image.Fetch( b1 - 1 );
+		}
+
+		if ( threads <= 1 )
+		{
+			rows_fn( b0, b1 );
+		}
+		else
+		{
+			const size_t band = ( b1 - b0 + threads - 1 ) / threads;
+
+			std::vector< std::thread > aThreads;
+
+			for ( size_t y0 = b0 + band; y0 < b1; y0 += band )
+			{
+				const size_t y1 = std::min( y0 + band, b1 );
+				aThreads.emplace_back( [rows_fn, y0, y1]()
+				{
+					TRACE_ZONE( "row_band" );
+					rows_fn( y0, y1 );
+				} );
+			}
+
+			{
+				TRACE_ZONE( "row_band" );
+				rows_fn( b0, std::min( b0 + band, b1 ) );
+			}
+
+			for ( std::thread& thread : aThreads )
+			{
+				thread.join();
+			}
+		}
+
+		{
+			TRACE_ZONE( "flush_rows" );
+			output.Flush( b1 );
+		}
+	}
+}
+
+//
+// remap_rows_ordered
+//
+// Ordered dithering: offset each pixel by its threshold and take the nearest index.
+// Transparency is handled as in remap_image_dither.
+//
+template < uint32_t N, typename S >
+static void remap_rows_ordered( const colormap_t& image, indexmap_t& output, options_t& options, const S& search, const color_t pal_idx0, quality_t* pQuality,
+								size_t y0, size_t y1 )
+{
+	TRACE_ZONE( "remap_rows_ordered" );
+
+	const bool bCheckTransp = ( options.bOpaque == false ) && image.bHasAlpha;
+	const bool bColourKey = ( image.bHasAlpha == false ) && ( options.bOpaque == false );
+
+	const threshold_map_t& thresholds = options.thresholds;
+	sequence_cache_t* pSequence = options.bSequence ? &options.sequence : nullptr;
+
+	std::vector< uint8_t > aRow( image._width );
+	std::vector< uint64_t > aMask( ( image._width + 63 ) / 64, 0 );
+
+	for ( uint32_t y = uint32_t( y0 ); y < y1; ++y )
+	{
+		const uint8_t* pSrc = image.Row( y );
+
+		if ( bCheckTransp )
+		{
+			image.AlphaMask( y, options.uAlphaCut, aMask );
+		}
+
+		for ( uint32_t x0 = 0, t = 0; x0 < image._width; x0 += sequence_cache_t::kTile, ++t )
+		{
+			const uint32_t x1 = uint32_t( std::min< size_t >( x0 + sequence_cache_t::kTile, image._width ) );
+			uint64_t hash = 0;
+
+			if ( pSequence != nullptr )
+			{
+				hash = sequence_cache_t::Hash( pSrc + x0 * N, ( x1 - x0 ) * N );
+
+				if ( pSequence->Reuse( y, t, hash, &aRow[ x0 ], x1 - x0 ) )
+				{
+					continue;
+				}
+			}
+
+			// tiles are 32 pixels, so within one word of the mask.
+			const uint64_t tile_mask = ( 1ULL << ( x1 - x0 ) ) - 1;
+			const uint64_t tile_transp = ( aMask[ x0 >> 6 ] >> ( x0 & 63 ) ) & tile_mask;
+
+			if ( tile_transp == tile_mask )
+			{
+				std::fill( &aRow[ x0 ], &aRow[ x0 ] + ( x1 - x0 ), options.aOutIndex[ 0 ] ); // TRANSPARENT!
+			}
+			else
+			{
+				for ( uint32_t x = x0; x < x1; ++x )
+				{
+					const color_t colour = colormap_t::Pixel< N >( pSrc, x );
+
+					uint8_t remapped_idx;
+
+					if ( ( ( tile_transp >> ( x - x0 ) ) & 1 ) || ( bColourKey && colour.BGR() == pal_idx0.BGR() ) )
+					{
+						remapped_idx = 0; // TRANSPARENT!
+					}
+					else
+					{
+						const int offset = thresholds.At( x, y );
+
+						color_t dithered;
+						dithered.chan[ 0 ] = static_cast<uint8_t>( std::clamp( colour.chan[ 0 ] + offset, 0, 255 ) );
+						dithered.chan[ 1 ] = static_cast<uint8_t>( std::clamp( colour.chan[ 1 ] + offset, 0, 255 ) );
+						dithered.chan[ 2 ] = static_cast<uint8_t>( std::clamp( colour.chan[ 2 ] + offset, 0, 255 ) );
+						dithered.chan[ 3 ] = 0xFF;
+
+						remapped_idx = search.Find( dithered );
+					}
+
+					aRow[ x ] = options.aOutIndex[ remapped_idx ];
+				}
+			}
+
+			if ( pSequence != nullptr )
+			{
+				pSequence->Keep( y, t, hash, &aRow[ x0 ], x1 - x0 );
+			}
+		}
+
+		if ( pQuality != nullptr )
+		{
+			pQuality->AddRow( image, y, aRow.data() );
+		}
+
+		output.StoreRow( y, aRow.data() );
+	}
+}
+
+template < uint32_t N, typename S >
+static void remap_image_ordered( const colormap_t& image, indexmap_t& output, options_t& options, const S& search, const color_t pal_idx0, quality_t* pQuality )
+{
+	TRACE_ZONE( "remap_image_ordered" );
+
+	const size_t palStart = ( options.bOpaque == false ) ? 1 : 0;
+
+	if ( options.bSequence )
+	{
+		options.sequence.Begin( image );
+	}
+
+	run_row_bands( image, output, options, palStart, [&]( size_t y0, size_t y1 )
+				   {
+					   remap_rows_ordered< N >( image, output, options, search, pal_idx0, pQuality, y0, y1 );
+				   } );
+
+	if ( options.bSequence )
+	{
+		options.sequence.End();
+	}
+}
+
+template < uint32_t N, typename S >
+static void remap_rows_nearest( const colormap_t& image, indexmap_t& output, options_t& options, const S& search, quality_t* pQuality, size_t y0, size_t y1 )
+{
+	TRACE_ZONE( "remap_rows_nearest" );
+
+	const bool bCheckTransp = ( options.bOpaque == false ) && image.bHasAlpha;
+	sequence_cache_t* pSequence = options.bSequence ? &options.sequence : nullptr;
+
+	std::vector< uint8_t > aRow( image._width );
+	std::vector< uint64_t > aMask( ( image._width + 63 ) / 64, 0 );
+
+	for ( uint32_t y = uint32_t( y0 ); y < y1; ++y )
+	{
+		const uint8_t* pSrc = image.Row( y );
+
+		if ( bCheckTransp )
+		{
+			image.AlphaMask( y, options.uAlphaCut, aMask );
+		}
+
+		// the last colour searched for, so a run of one colour is only searched once.
+		uint32_t run_bgr = 0xFFFFFFFF;
+		uint8_t run_idx = 0;
+
+		for ( uint32_t x0 = 0, t = 0; x0 < image._width; x0 += sequence_cache_t::kTile, ++t )
+		{
+			const uint32_t x1 = uint32_t( std::min< size_t >( x0 + sequence_cache_t::kTile, image._width ) );
+			uint64_t hash = 0;
+
+			if ( pSequence != nullptr )
+			{
+				hash = sequence_cache_t::Hash( pSrc + x0 * N, ( x1 - x0 ) * N );
+
+				if ( pSequence->Reuse( y, t, hash, &aRow[ x0 ], x1 - x0 ) )
+				{
+					continue;
+				}
+			}
+
+			// tiles are 32 pixels, so within one word of the mask.
+			const uint64_t tile_mask = ( 1ULL << ( x1 - x0 ) ) - 1;
+			const uint64_t tile_transp = ( aMask[ x0 >> 6 ] >> ( x0 & 63 ) ) & tile_mask;
+
+			if ( tile_transp == tile_mask )
+			{
+				std::fill( &aRow[ x0 ], &aRow[ x0 ] + ( x1 - x0 ), options.aOutIndex[ 0 ] ); // TRANSPARENT!
+			}
+			else
+			{
+				for ( uint32_t x = x0; x < x1; )
+				{
+					uint8_t remapped_idx;
+					uint32_t count = 1;
+
+					if ( ( tile_transp >> ( x - x0 ) ) & 1 )
+					{
+						remapped_idx = 0; // TRANSPARENT!
+					}
+					else
+					{
+						const color_t colour = colormap_t::Pixel< N >( pSrc, x );
+
+						if ( colour.BGR() == run_bgr )
+						{
+							remapped_idx = run_idx;
+						}
+						else
+						{
+							remapped_idx = search.Find( colour );
+
+							run_bgr = colour.BGR();
+							run_idx = remapped_idx;
+						}
+
+						// the same pixels (alpha too, so none of them is transparent) take the same index.
+						count = uint32_t( colormap_t::RunLength< N >( pSrc, x, x1 ) );
+					}
+
+					std::fill( &aRow[ x ], &aRow[ x ] + count, options.aOutIndex[ remapped_idx ] );
+					x += count;
+				}
+			}
+
+			if ( pSequence != nullptr )
+			{
+				pSequence->Keep( y, t, hash, &aRow[ x0 ], x1 - x0 );
+			}
+		}
+
+		if ( pQuality != nullptr )
+		{
+			pQuality->AddRow( image, y, aRow.data() );
+		}
+
+		output.StoreRow( y, aRow.data() );
+	}
+}
+
+template < uint32_t N, typename S >
+static void remap_image_nearest( const colormap_t& image, indexmap_t& output, options_t& options, const S& search, const color_t pal_idx0, quality_t* pQuality )
+{
+	TRACE_ZONE( "remap_image_nearest" );
+
+	if ( options.bSequence )
+	{
+		options.sequence.Begin( image );
+	}
+
+	run_row_bands( image, output, options, 0, [&]( size_t y0, size_t y1 )
+				   {
+					   remap_rows_nearest< N >( image, output, options, search, pQuality, y0, y1 );
+				   } );
+
+	if ( options.bSequence )
+	{
+		options.sequence.End();
+	}
+}
+
+//
+// remap_pal_start
+//
+// The palStart remap_image searches from, so the cube a run's images read. With no
+// dither, transparent pixels are found by alpha alone and the search starts at 0.
+//
+static size_t remap_pal_start( const options_t& options )
+{
+	return ( options.dither != DITHER_NONE && options.bOpaque == false ) ? 1 : 0;
+}
+
+//
+// remap_image
+//
+// Remap an N channel image with the -dither method, and the search with_palette_search
+// picks for the palette. With pQuality (-quality) each row is measured as it is stored;
+// it is the image's own, as several images may share the options at once.
+//
+template < uint32_t N >
+static void remap_image( const colormap_t& image, indexmap_t& output, options_t& options, const color_t pal_idx0, quality_t* pQuality = nullptr )
+{
+	const size_t palStart = remap_pal_start( options );
+
+	with_palette_search( options, palStart, [&]( const auto& search )
+						 {
+							 switch ( options.dither )
+							 {
+							 case DITHER_NONE:		remap_image_nearest< N >( image, output, options, search, pal_idx0, pQuality ); break;
+							 case DITHER_FLOYD:		remap_image_diffuse< kernel_floyd_t, N >( image, output, options, search, pal_idx0, pQuality ); break;
+							 case DITHER_ATKINSON:	remap_image_diffuse< kernel_atkinson_t, N >( image, output, options, search, pal_idx0, pQuality ); break;
+							 case DITHER_SIERRALITE:	remap_image_diffuse< kernel_sierra_lite_t, N >( image, output, options, search, pal_idx0, pQuality ); break;
+							 case DITHER_JJN:		remap_image_diffuse< kernel_jjn_t, N >( image, output, options, search, pal_idx0, pQuality ); break;
+							 default:				remap_image_ordered< N >( image, output, options, search, pal_idx0, pQuality ); break;
+							 }
+						 } );
+}
+
+//
+// remap_measured
+//
+// remap_image for an image of either channel count. With -quality each stored row is
+// also measured against the source, into stats.
+//
+static void remap_measured( const colormap_t& image, indexmap_t& output, options_t& options, stats_t& stats )
+{
+	std::unique_ptr< quality_t > quality;
+
+	if ( options.bQuality )
+	{
+		quality = std::make_unique< quality_t >();
+		quality->Begin( options.aPalette.aColours, options.aOutIndex, options.bOpaque, stats );
+	}
+
+	const color_t pal_idx0 = options.aPalette[ 0 ];
+
+	if ( image._uChannels == 3 )
+	{
+		remap_image< 3 >( image, output, options, pal_idx0, quality.get() );
+	}
+	else
+	{
+		remap_image< 4 >( image, output, options, pal_idx0, quality.get() );
+	}
+}
+
+//==============================================================================
+
+//
+// determine_output_filename
+//
+// Figure out what we should call the output filename
+//
+static void determine_output_filename( const std::string& inputFile, options_t& options, std::string& outFile )
+{
+	// Use the single file output override?
+	if ( ( options.aInputFiles.size() == 1 ) && ( options.strOutFile.empty() == false ) )
+	{
+		outFile = options.strOutFile;
+
+		if ( options.strOutSuffix.empty() == false )
+		{
+			const size_t dot_find = outFile.find_last_of( '.' );
+			const size_t slash_find = outFile.find_last_of( "/\\" );
+			const size_t end = ( dot_find != outFile.npos && ( slash_find == outFile.npos || dot_find > slash_find ) ) ? dot_find : outFile.length();
+			outFile.insert( end, options.strOutSuffix );
+		}
+		return;
+	}
+
+	// split input file into path and file.
+	std::string outFolder;
+	size_t slash_find = inputFile.find_last_of( "/\\", inputFile.npos ); // either kind of path separators
+	if ( slash_find == inputFile.npos )
+	{
+		outFile = inputFile;
+	}
+	else
+	{
+		outFolder = inputFile.substr( 0, slash_find + 1 );
+		outFile = inputFile.substr( slash_find + 1 );
+	}
+
+	if ( options.strOutFolder.empty() == false )
+	{
+		outFolder = options.strOutFolder;
+	}
+
+	size_t dot_find = outFile.find_last_of( ".", outFile.npos ); // last dot
+	if ( dot_find != inputFile.npos )
+	{
+		outFile = outFile.substr( 0, dot_find );
+	}
+
+	if ( outFolder.empty() == false )
+	{
+		const char tail = outFolder[ outFolder.length() - 1 ];
+
+		if ( tail != '\\' && tail != '//' )
+			outFolder += "\\";
+	}
+
+	outFile = outFolder + outFile + options.strOutSuffix + ( options.bTiles ? ".chr" : options.bRaw ? ".idx" : ".png" );
+}
+
+//
+// file_size
+//
+// Size of a file in bytes, or 0 if it can't be opened.
+//
+static uint64_t file_size( const std::string& strFile )
+{
+	std::ifstream file( strFile, std::ios::binary | std::ios::ate );
+	return file.is_open() ? uint64_t( file.tellg() ) : 0;
+}
+
+//
+// peak_rss_bytes
+//
+// The most memory the process has had resident so far.
+//
+static uint64_t peak_rss_bytes()
+{
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+	{
+		return counters.PeakWorkingSetSize;
+	}
+
+	return 0;
+}
+
+//
+// palette_bpp
+//
+// Fewest PNG bits per pixel that index a palette of count entries.
+//
+static uint8_t palette_bpp( size_t count )
+{
+	if ( count <= 2 )
+		return 1;
+	else if ( count <= 4 )
+		return 2;
+	else if ( count <= 16 )
+		return 4;
+
+	return 8;
+}
+
+//
+// verify_indexed
+//
+// Start the -verify hash of an indexed output with its size, bits per pixel and palette as
+// written (the entries, the offset of its first index and the transparent one, if any), for
+// its rows to be added as they are written.
+//
+static void verify_indexed( verify_hash_t& hash, size_t width, size_t height, uint32_t uBPP, const std::vector< color_t >& aPalette, int indexOffset, bool bOpaque, int transIndex )
+{
+	hash.Add( uint32_t( width ) );
+	hash.Add( uint32_t( height ) );
+	hash.Add( uBPP );
+	hash.Add( uint32_t( indexOffset ) );
+	hash.Add( bOpaque ? 0xFFFFFFFFu : uint32_t( transIndex ) );
+
+	hash.Add( uint32_t( aPalette.size() ) );
+	for ( const color_t& colour : aPalette )
+	{
+		hash.Add( colour.value_abgr );
+	}
+}
+
+//
+// write_trimmed
+//
+// -trim: remap the whole image to 8-bit indices first, note which are used, then
+// write it with only those palette entries, renumbered in palette order, at the
+// fewest bits per pixel. A transparent index 0 is always kept, as index 0.
+//
+template < typename W >
+static bool write_trimmed( const colormap_t& image, options_t& options, const std::string& outFile, std::string& strLog, stats_t& stats )
+{
+	const tClock::time_point start = tClock::now();
+
+	std::vector< uint8_t > aIndices( image._width * image._height );
+
+	indexmap_t output;
+	output.Create( image._width, image._height, 8, stream_row_count( image._width, image._height, options ) );
+
+	size_t uRow = 0;
+	output._fnWriteRow = [&]( const uint8_t* pRow )
+	{
+		std::copy( pRow, pRow + image._width, &aIndices[ uRow * image._width ] );
+		++uRow;
+	};
+
+	remap_measured( image, output, options, stats );
+
+	// the used mask, then the new index of each used entry.
+	uint64_t aUsed[ 4 ] = { 0, 0, 0, 0 };
+	for ( uint8_t index : aIndices )
+	{
+		aUsed[ index >> 6 ] |= 1ULL << ( index & 63 );
+	}
+
+	if ( options.bOpaque == false )
+	{
+		aUsed[ 0 ] |= 1;
+	}
+
+	uint8_t aRemap[ 256 ] = {};
+	std::vector< color_t > aPalette;
+
+	for ( size_t i = 0; i < options.aPalette.size(); ++i )
+	{
+		if ( ( aUsed[ i >> 6 ] >> ( i & 63 ) ) & 1 )
+		{
+			aRemap[ i ] = uint8_t( aPalette.size() );
+			aPalette.push_back( options.aPalette[ i ] );
+		}
+	}
+
+	const uint32_t uBPP = W::OutputBPP( palette_bpp( aPalette.size() ) );
+
+	const double fRemapMs = elapsed_ms( start );
+	const tClock::time_point t0 = tClock::now();
+
+	if ( image.ReadFailed() )
+	{
+		strLog += "ERROR: the image could not be read in full, nothing written.\n";
+		stats.fRemapMs += fRemapMs;
+		return false;
+	}
+
+	strLog += "Using " + std::to_string( aPalette.size() ) + " of " + std::to_string( options.aPalette.size() ) + " colours.\n";
+
+	W writer;
+	writer._bTrimPalette = true;
+	writer._bIfChanged = options.bIfChanged;
+
+	if ( writer.Open( image._width, image._height, uBPP, aPalette, 0, options.bOpaque, 0, options.encode,
+					  image_thread_count( image, options ), outFile, strLog ) )
+	{
+		indexmap_t row;
+		row.Create( image._width, 1, uBPP, 1 );
+
+		std::vector< uint8_t > aRow( image._width );
+
+		verify_hash_t hash;
+		verify_indexed( hash, image._width, image._height, uBPP, aPalette, 0, options.bOpaque, 0 );
+		const size_t uRowBytes = ( image._width * uBPP + 7 ) / 8;
+
+		for ( size_t y = 0; y < image._height; ++y )
+		{
+			const uint8_t* pSrc = &aIndices[ y * image._width ];
+			for ( size_t x = 0; x < image._width; ++x )
+			{
+				aRow[ x ] = aRemap[ pSrc[ x ] ];
+			}
+
+			row.StoreRow( 0, aRow.data() );
+			if ( options.pVerify )
+			{
+				hash.AddData( row.Row( 0 ), uRowBytes );
+			}
+			writer.WriteRow( row.Row( 0 ) );
+		}
+
+		writer.Close( strLog );
+
+		if ( options.pVerify && writer._bFailed == false )
+		{
+			strLog += options.pVerify->Record( outFile, "indexed", hash );
+		}
+	}
+
+	const bool bOK = ( writer._bFailed == false );
+
+	stats.fEncodeMs += elapsed_ms( t0 );
+	stats.fRemapMs += fRemapMs;
+	stats.uBytesOut += bOK ? writer.Size() : 0;
+
+	return bOK;
+}
+
+//
+// write_remapped
+//
+// Remap an image with the palette of options and write it to outFile with W, a PNG or
+// -raw writer, each row as soon as it is done. The encode and remap times and bytes written go to stats; for a
+// streamed image the remap time still includes reading the rows.
+//
+template < typename W >
+static bool write_remapped( const colormap_t& image, options_t& options, const std::string& outFile, std::string& strLog, stats_t& stats )
+{
+	TRACE_ZONE( "write_remapped" );
+
+	const tClock::time_point start = tClock::now();
+
+	// rows may be written by the dither's workers.
+	std::atomic< int64_t > uEncodeNs = 0;
+
+	W writer;
+	writer._bIfChanged = options.bIfChanged;
+	const uint32_t uBPP = W::OutputBPP( options.uBPP );
+
+	const bool bOpen = writer.Open( image._width, image._height, uBPP, options.aPalette.aColours, options.indexOffset, options.bOpaque,
+									options.transIndex, options.encode, image_thread_count( image, options ), outFile, strLog );
+	add_elapsed( uEncodeNs, start );
+
+	if ( bOpen )
+	{
+		// -verify: the rows as they go to the writer, in order, and the palette they index.
+		verify_hash_t hash;
+		verify_indexed( hash, image._width, image._height, uBPP, options.aPalette.aColours, options.indexOffset, options.bOpaque, options.transIndex );
+		const size_t uRowBytes = ( image._width * uBPP + 7 ) / 8;
+
+		indexmap_t output;
+		output.Create( image._width, image._height, uBPP, stream_row_count( image._width, image._height, options ) );
+		output._fnWriteRow = [&]( const uint8_t* pRow )
+		{
+			const tClock::time_point t0 = tClock::now();
+			if ( options.pVerify )
+			{
+				hash.AddData( pRow, uRowBytes );
+			}
+			writer.WriteRow( pRow );
+			add_elapsed( uEncodeNs, t0 );
+		};
+
+		remap_measured( image, output, options, stats );
+
+		const tClock::time_point t0 = tClock::now();
+		if ( image.ReadFailed() )
+		{
+			writer.Discard( strLog );
+		}
+		else
+		{
+			writer.Close( strLog );
+		}
+		add_elapsed( uEncodeNs, t0 );
+
+		if ( options.pVerify && writer._bFailed == false )
+		{
+			strLog += options.pVerify->Record( outFile, "indexed", hash );
+		}
+	}
+
+	const bool bOK = ( writer._bFailed == false );
+
+	stats.fEncodeMs += double( uEncodeNs ) / 1e6;
+	stats.fRemapMs += std::max( 0.0, elapsed_ms( start ) - double( uEncodeNs ) / 1e6 );
+	stats.uBytesOut += bOK ? writer.Size() : 0;
+
+	return bOK;
+}
+
+//=============================================================================
+
+//
+// -tiles
+//
+// Console style tile data, from a palette that is a set of 16 colour sub-palettes one
+// after another (as palgen -tiles writes them). The image is cut into 8x8 tiles, and
+// each is drawn with the sub-palette that gives it the least squared error. Tiles are
+// measured in parallel, a block of whole tile rows at a time, so a streamed image only
+// needs that block held. Three files are written, in the layouts of the GBA's 4bpp
+// tiles, text background map and palette RAM, to be copied to VRAM as they are:
+//
+//   <output>.chr  the distinct tiles, 32 bytes each: rows top down, 4 bits a pixel
+//                 with the left one of each pair in the low nibble.
+//   <output>.map  a little-endian 16-bit entry for each tile, rows top down: the tile
+//                 number in bits 0-9, flipped horizontally in bit 10 and vertically in
+//                 bit 11, and the sub-palette in bits 12-15.
+//   <output>.pal  each sub-palette as 16 little-endian BGR555 colours.
+//
+// With -transp, index 0 of each sub-palette is transparent; palgen puts it there.
+// Pixels past the edge of an image that is not a multiple of 8 are index 0.
+//
+static constexpr uint32_t kTileSize = 8;
+static constexpr uint32_t kTilePixels = kTileSize * kTileSize;
+static constexpr uint32_t kTileColours = 16;
+static constexpr size_t kTileLimit = 1024; // tile numbers are 10 bits.
+
+//
+// draw_tile
+//
+// Pick the sub-palette for the tile at x0, y0 and fill aIndices with its nearest
+// entries. A sub-palette is dropped as soon as its error reaches the best so far, and
+// ties go to the first.
+//
+template < uint32_t N >
+static uint8_t draw_tile( const colormap_t& image, const options_t& options, size_t x0, size_t y0, uint8_t aIndices[ kTilePixels ] )
+{
+	const bool bCheckTransp = ( options.bOpaque == false ) && image.bHasAlpha;
+	const size_t palStart = options.bOpaque ? 0 : 1;
+	const size_t uSubPalettes = ( options.aPalette.size() + kTileColours - 1 ) / kTileColours;
+
+	// the opaque pixels of the tile that are within the image, and where they go.
+	color_t aPixels[ kTilePixels ];
+	uint8_t aSlots[ kTilePixels ];
+	uint32_t uCount = 0;
+
+	for ( uint32_t y = 0; y < kTileSize && y0 + y < image._height; ++y )
+	{
+		const uint8_t* pSrc = image.Row( y0 + y );
+
+		for ( uint32_t x = 0; x < kTileSize && x0 + x < image._width; ++x )
+		{
+			const color_t colour = colormap_t::Pixel< N >( pSrc, x0 + x );
+
+			if ( bCheckTransp && colour.chan[ 3 ] < options.uAlphaCut )
+			{
+				continue; // TRANSPARENT!
+			}
+
+			aPixels[ uCount ] = colour;
+			aSlots[ uCount ] = uint8_t( y * kTileSize + x );
+			++uCount;
+		}
+	}
+
+	// nearest entry of sub-palette p, and its squared error.
+	auto nearest = [&]( const color_t& colour, size_t p, uint32_t& uError )
+	{
+		const size_t uEnd = std::min< size_t >( ( p + 1 ) * kTileColours, options.aPalette.size() );
+
+		uint8_t best_index = 0;
+		uError = UINT32_MAX;
+
+		for ( size_t i = p * kTileColours + palStart; i < uEnd; ++i )
+		{
+			const color_t& entry = options.aPalette[ i ];
+			const int dr = int( colour.chan[ 0 ] ) - int( entry.chan[ 0 ] );
+			const int dg = int( colour.chan[ 1 ] ) - int( entry.chan[ 1 ] );
+			const int db = int( colour.chan[ 2 ] ) - int( entry.chan[ 2 ] );
+			const uint32_t uDist = uint32_t( dr * dr + dg * dg + db * db );
+
+			if ( uDist < uError )
+			{
+				uError = uDist;
+				best_index = uint8_t( i - p * kTileColours );
+			}
+		}
+
+		return best_index;
+	};
+
+	size_t best_palette = 0;
+	uint64_t best_error = UINT64_MAX;
+
+	for ( size_t p = 0; p < uSubPalettes; ++p )
+	{
+		if ( p * kTileColours + palStart >= options.aPalette.size() )
+		{
+			break; // no opaque entries.
+		}
+
+		// a run of one colour, as in flat artwork, is only searched once.
+		uint64_t error = 0;
+		uint32_t uError = 0;
+		for ( uint32_t i = 0; i < uCount && error < best_error; ++i )
+		{
+			if ( i == 0 || aPixels[ i ].BGR() != aPixels[ i - 1 ].BGR() )
+			{
+				nearest( aPixels[ i ], p, uError );
+			}
+			error += uError;
+		}
+
+		if ( error < best_error )
+		{
+			best_error = error;
+			best_palette = p;
+		}
+	}
+
+	std::fill( aIndices, aIndices + kTilePixels, uint8_t( 0 ) );
+
+	uint8_t index = 0;
+	for ( uint32_t i = 0; i < uCount; ++i )
+	{
+		if ( i == 0 || aPixels[ i ].BGR() != aPixels[ i - 1 ].BGR() )
+		{
+			uint32_t uError;
+			index = nearest( aPixels[ i ], best_palette, uError );
+		}
+		aIndices[ aSlots[ i ] ] = index;
+	}
+
+	return uint8_t( best_palette );
+}
+
+//
+// write_tile_file
+//
+// One of the -tiles outputs, through async_file_t for -ifchanged.
+//
+static bool write_tile_file( const std::string& strFile, const std::vector< uint8_t >& aData, const std::string& strWhat, const options_t& options,
+							 std::string& strLog, stats_t& stats )
+{
+	strLog += "Writing \"" + strFile + "\" (" + strWhat + ") ... ";
+
+	async_file_t file;
+	if ( file.Open( strFile, options.bIfChanged ) == false )
+	{
+		strLog += "ERROR (attempted overwrite?)\n\n";
+		return false;
+	}
+
+	file.Write( aData.data(), aData.size() );
+
+	if ( file.Close() == false )
+	{
+		strLog += "ERROR: write failed.\n";
+		return false;
+	}
+
+	strLog += file.Unchanged() ? "UNCHANGED\n" : "OK\n";
+	stats.uBytesOut += aData.size();
+
+	// the file is written as it is made, so its bytes are what is hashed.
+	if ( options.pVerify )
+	{
+		verify_hash_t hash;
+		hash.AddData( aData.data(), aData.size() );
+		strLog += options.pVerify->Record( strFile, "tiles", hash );
+	}
+
+	return true;
+}
+
+//
+// write_tiles
+//
+// -tiles: draw every tile, then number the distinct ones (a flipped copy of an earlier
+// tile uses it, flipped) in map order, so the output does not depend on the threads.
+//
+static bool write_tiles( const colormap_t& image, options_t& options, const std::string& outFile, std::string& strLog, stats_t& stats )
+{
+	const tClock::time_point start = tClock::now();
+
+	const size_t uTilesX = ( image._width + kTileSize - 1 ) / kTileSize;
+	const size_t uTilesY = ( image._height + kTileSize - 1 ) / kTileSize;
+	const size_t uSubPalettes = ( options.aPalette.size() + kTileColours - 1 ) / kTileColours;
+
+	std::vector< uint8_t > aChoices( uTilesX * uTilesY );
+	std::vector< uint8_t > aIndices( uTilesX * uTilesY * kTilePixels );
+
+	// whole tile rows at a time, as many as a streamed image holds.
+	const size_t uBlockRows = std::max< size_t >( 1, image._rows / kTileSize );
+	const size_t threads = image_thread_count( image, options );
+
+	for ( size_t b0 = 0; b0 < uTilesY; b0 += uBlockRows )
+	{
+		const size_t b1 = std::min( b0 + uBlockRows, uTilesY );
+		image.Fetch( std::min( b1 * kTileSize, image._height ) - 1 );
+
+		std::atomic< size_t > uNext = b0 * uTilesX;
+
+		auto worker_fn = [&]()
+		{
+			for ( size_t t = uNext++; t < b1 * uTilesX; t = uNext++ )
+			{
+				const size_t x0 = ( t % uTilesX ) * kTileSize;
+				const size_t y0 = ( t / uTilesX ) * kTileSize;
+				uint8_t* pIndices = &aIndices[ t * kTilePixels ];
+
+				aChoices[ t ] = ( image._uChannels == 3 ) ? draw_tile< 3 >( image, options, x0, y0, pIndices )
+														  : draw_tile< 4 >( image, options, x0, y0, pIndices );
+			}
+		};
+
+		std::vector< std::thread > aThreads;
+		for ( size_t i = 1; i < threads; ++i )
+		{
+			aThreads.emplace_back( worker_fn );
+		}
+
+		worker_fn();
+
+		for ( std::thread& thread : aThreads )
+		{
+			thread.join();
+		}
+	}
+
+	// each tile, packed, flipped each way.
+	auto pack_tile = []( const uint8_t* pIndices, bool bFlipX, bool bFlipY )
+	{
+		std::string strTile( kTilePixels / 2, '\0' );
+
+		for ( uint32_t y = 0; y < kTileSize; ++y )
+		{
+			const uint8_t* pRow = pIndices + ( bFlipY ? ( kTileSize - 1 - y ) : y ) * kTileSize;
+
+			for ( uint32_t x = 0; x < kTileSize; x += 2 )
+			{
+				const uint8_t left = pRow[ bFlipX ? ( kTileSize - 1 - x ) : x ];
+				const uint8_t right = pRow[ bFlipX ? ( kTileSize - 2 - x ) : ( x + 1 ) ];
+				strTile[ ( y * kTileSize + x ) / 2 ] = char( left | ( right << 4 ) );
+			}
+		}
+
+		return strTile;
+	};
+
+	std::unordered_map< std::string, uint16_t > mapTiles;
+	std::vector< uint8_t > aChr;
+	std::vector< uint8_t > aMap;
+	aMap.reserve( aChoices.size() * 2 );
+
+	for ( size_t t = 0; t < aChoices.size(); ++t )
+	{
+		const uint8_t* pIndices = &aIndices[ t * kTilePixels ];
+		uint16_t entry = 0xFFFF;
+
+		// as is, flipped horizontally, vertically, both: bits 10 and 11 of the entry.
+		for ( uint16_t flip = 0; flip < 4 && entry == 0xFFFF; ++flip )
+		{
+			auto it = mapTiles.find( pack_tile( pIndices, ( flip & 1 ) != 0, ( flip & 2 ) != 0 ) );
+			if ( it != mapTiles.end() )
+			{
+				entry = uint16_t( it->second | ( flip << 10 ) );
+			}
+		}
+
+		if ( entry == 0xFFFF )
+		{
+			if ( mapTiles.size() == kTileLimit )
+			{
+				strLog += "ERROR: more than " + std::to_string( kTileLimit ) + " distinct tiles, the most a map entry can number.\n";
+				stats.fRemapMs += elapsed_ms( start );
+				return false;
+			}
+
+			const std::string strTile = pack_tile( pIndices, false, false );
+			entry = uint16_t( mapTiles.size() );
+			mapTiles.emplace( strTile, entry );
+			aChr.insert( aChr.end(), strTile.begin(), strTile.end() );
+		}
+
+		entry = uint16_t( entry | ( aChoices[ t ] << 12 ) );
+		aMap.push_back( uint8_t( entry & 0xFF ) );
+		aMap.push_back( uint8_t( entry >> 8 ) );
+	}
+
+	// BGR555, with unused entries black.
+	std::vector< uint8_t > aPal( uSubPalettes * kTileColours * 2, 0 );
+	for ( size_t i = 0; i < options.aPalette.size(); ++i )
+	{
+		const color_t& colour = options.aPalette[ i ];
+		const uint16_t bgr555 = uint16_t( ( colour.chan[ 0 ] >> 3 ) | ( ( colour.chan[ 1 ] >> 3 ) << 5 ) | ( ( colour.chan[ 2 ] >> 3 ) << 10 ) );
+		aPal[ i * 2 + 0 ] = uint8_t( bgr555 & 0xFF );
+		aPal[ i * 2 + 1 ] = uint8_t( bgr555 >> 8 );
+	}
+
+	stats.fRemapMs += elapsed_ms( start );
+
+	if ( image.ReadFailed() )
+	{
+		strLog += "ERROR: the image could not be read in full, nothing written.\n";
+		return false;
+	}
+
+	strLog += std::to_string( aChoices.size() ) + " tiles (" + std::to_string( uTilesX ) + " x " + std::to_string( uTilesY ) + "), " +
+			  std::to_string( mapTiles.size() ) + " distinct, drawn with " + std::to_string( uSubPalettes ) + " sub-palettes.\n";
+
+	// the .chr keeps the output name; the others swap its extension.
+	const size_t dot_find = outFile.find_last_of( '.' );
+	const size_t slash_find = outFile.find_last_of( "/\\" );
+	const std::string strBase = ( dot_find != outFile.npos && ( slash_find == outFile.npos || dot_find > slash_find ) ) ? outFile.substr( 0, dot_find ) : outFile;
+
+	const tClock::time_point t0 = tClock::now();
+
+	bool bOK = write_tile_file( outFile, aChr, "4-BPP tiles", options, strLog, stats );
+	bOK = bOK && write_tile_file( strBase + ".map", aMap, "tile map", options, strLog, stats );
+	bOK = bOK && write_tile_file( strBase + ".pal", aPal, "BGR555 palettes", options, strLog, stats );
+
+	stats.fEncodeMs += elapsed_ms( t0 );
+
+	return bOK;
+}
+
+static bool write_remapped( const colormap_t& image, options_t& options, const std::string& outFile, std::string& strLog, stats_t& stats )
+{
+	if ( options.bTiles )
+	{
+		return write_tiles( image, options, outFile, strLog, stats );
+	}
+
+	if ( options.bTrim )
+	{
+		if ( options.bRaw )
+		{
+			return write_trimmed< raw_writer_t >( image, options, outFile, strLog, stats );
+		}
+
+		return write_trimmed< png_writer_t >( image, options, outFile, strLog, stats );
+	}
+
+	if ( options.bRaw )
+	{
+		return write_remapped< raw_writer_t >( image, options, outFile, strLog, stats );
+	}
+
+	return write_remapped< png_writer_t >( image, options, outFile, strLog, stats );
+}
+
+//
+// process_file
+//
+// Load, remap and write a single image to outFile. Progress and errors go to strLog,
+// which the caller prints, so that parallel jobs still report in input order. The
+// file's -stats are returned in stats. Returns false if the image was not written.
+// With several palettes the image is decoded once, and the variants are remapped to
+// their own outputs side by side.
+//
+static bool process_file( options_t& options, const std::string& inputFile, const std::string& outFile, std::string& strLog, stats_t& stats )
+{
+	TRACE_ZONE( "process_file" );
+
+	const tClock::time_point start = tClock::now();
+
+	// rows may be read by the dither's workers.
+	std::atomic< int64_t > uDecodeNs = 0;
+
+	stats = stats_t();
+	stats.uFiles = 1;
+	stats.uFailed = 1;
+	stats.uBytesIn = file_size( inputFile );
+
+	// load the image.
+
+	int w, h, chan_count;
+	unsigned char* img_data = nullptr;
+
+	strLog += "Loading \"" + inputFile + "\" ... ";
+
+	// PNGs are streamed a few rows at a time, unless -transp needs to know whether any
+	// pixel at all is translucent before choosing between alpha and the colour key, or
+	// there are palette variants to remap from the same rows. Those PNGs are loaded whole
+	// through libpng instead, and anything it can't read with stb_image.
+	png_reader_t reader;
+	const bool bPng = reader.Open( inputFile, options.bLuminance );
+	const bool bStream = bPng && options.aVariants.empty() && ( options.bOpaque || reader._bHasAlpha == false );
+
+	if ( bPng )
+	{
+		w = int( reader._width );
+		h = int( reader._height );
+	}
+	else
+	{
+		reader.Close();
+
+		img_data = stbi_load( inputFile.c_str(), &w, &h, &chan_count, 0 );
+		add_elapsed( uDecodeNs, start );
+
+		if ( img_data == nullptr )
+		{
+			strLog += "FAILED\n";
+			return false;
+		}
+		else if ( chan_count != 3 && chan_count != 4 )
+		{
+			strLog += "INVALID-CHANNELS (" + std::to_string( chan_count ) + ")\n";
+			stbi_image_free( img_data );
+			return false;
+		}
+	}
+
+	// Re-open input file - keep it open to prevent common user error of overwriting input!
+	std::ifstream fileInput( inputFile );
+	if ( fileInput.is_open() == false )
+	{
+		strLog += "FAILED\n";
+		stbi_image_free( img_data );
+		return false;
+	}
+
+	strLog += "OK (" + std::to_string( w ) + " x " + std::to_string( h ) + ")\n";
+
+	colormap_t image;
+
+	if ( bStream )
+	{
+		add_elapsed( uDecodeNs, start ); // the header
+
+		image.CreateStreamed( w, h, stream_row_count( w, h, options ), [&]( uint8_t* pRow )
+							  {
+								  const tClock::time_point t0 = tClock::now();
+								  const bool bRead = reader.ReadRow( pRow );
+								  add_elapsed( uDecodeNs, t0 );
+								  return bRead;
+							  } );
+	}
+	else
+	{
+		if ( bPng )
+		{
+			// the rows are made luminance as they are read.
+			const bool bRead = reader.ReadImage( image );
+			reader.Close();
+			add_elapsed( uDecodeNs, start );
+
+			if ( bRead == false )
+			{
+				strLog += "ERROR: \"" + inputFile + "\" is damaged, nothing written.\n";
+				return false;
+			}
+		}
+		else
+		{
+			// the remap reads the decoded pixels where they are.
+			image.CreateView( img_data, w, h, chan_count );
+
+			if ( options.bLuminance )
+			{
+				image.ApplyLuminance();
+			}
+		}
+
+		// only -transp cares whether the alpha is used.
+		if ( options.bOpaque == false )
+		{
+			image.DetectAlpha( options.uAlphaCut );
+		}
+	}
+
+	bool bOK;
+
+	if ( options.aVariants.empty() )
+	{
+		const int64_t uHeaderNs = uDecodeNs;
+
+		bOK = write_remapped( image, options, outFile, strLog, stats );
+
+		// the rows were read as they were remapped.
+		stats.fRemapMs = std::max( 0.0, stats.fRemapMs - double( uDecodeNs - uHeaderNs ) / 1e6 );
+	}
+	else
+	{
+		// one output for each palette, on as many threads as there are variants (within
+		// this job's share of the cores).
+		std::vector< options_t* > aOutputs = { &options };
+		for ( std::unique_ptr< options_t >& variant : options.aVariants )
+		{
+			aOutputs.push_back( variant.get() );
+		}
+
+		std::vector< std::string > aLogs( aOutputs.size() );
+		std::vector< stats_t > aStats( aOutputs.size() );
+		std::vector< uint8_t > aOK( aOutputs.size(), 0 );
+		std::atomic< size_t > uNext = 0;
+
+		auto worker_fn = [&]()
+		{
+			for ( size_t i = uNext++; i < aOutputs.size(); i = uNext++ )
+			{
+				std::string strOutFile = outFile;
+				if ( i > 0 )
+				{
+					determine_output_filename( inputFile, *aOutputs[ i ], strOutFile );
+				}
+
+				aOK[ i ] = write_remapped( image, *aOutputs[ i ], strOutFile, aLogs[ i ], aStats[ i ] );
+			}
+		};
+
+		const size_t uCores = std::max< size_t >( 1, task_thread_cap() / std::max< uint32_t >( options.uThreadCount, 1 ) );
+		const size_t uThreads = std::clamp< size_t >( uCores, 1, aOutputs.size() );
+
+		std::vector< std::thread > aThreads;
+		for ( size_t t = 1; t < uThreads; ++t )
+		{
+			aThreads.emplace_back( worker_fn );
+		}
+
+		worker_fn();
+
+		for ( std::thread& thread : aThreads )
+		{
+			thread.join();
+		}
+
+		bOK = true;
+
+		for ( size_t i = 0; i < aOutputs.size(); ++i )
+		{
+			strLog += aLogs[ i ];
+			stats.fEncodeMs += aStats[ i ].fEncodeMs;
+			stats.fRemapMs += aStats[ i ].fRemapMs;
+			stats.uBytesOut += aStats[ i ].uBytesOut;
+			stats.AddQuality( aStats[ i ] );
+			bOK = aOK[ i ] && bOK;
+		}
+	}
+
+	if ( image.ReadFailed() )
+	{
+		strLog += "ERROR: \"" + inputFile + "\" is damaged.\n";
+		bOK = false;
+	}
+
+	// tidy up (a streamed ring, or a PNG loaded whole, goes with the image)
+	stbi_image_free( img_data );
+	fileInput.close();
+
+	stats.fTotalMs = elapsed_ms( start );
+	stats.fDecodeMs = double( uDecodeNs ) / 1e6;
+	stats.uFailed = bOK ? 0 : 1;
+	stats.uPixels = uint64_t( w ) * uint64_t( h );
+	stats.uPeakRSS = peak_rss_bytes();
+
+	return bOK;
+}
+
+//
+// lut_cache_key
+//
+// The -lutcache key of a palette, palStart and -match.
+//
+static uint64_t lut_cache_key( const options_t& options, size_t palStart )
+{
+	cache_hash_t hash;
+
+	hash.Add( uint32_t( palStart ) );
+	hash.Add( uint32_t( options.match ) );
+	hash.Add( options.aPalette.uHash );
+
+	return hash.uHash;
+}
+
+static constexpr const char* kLutCacheName = "cube.lut";
+
+//
+// prepare_palette
+//
+// Everything the images of a run share: the nearest colour searches, the threshold
+// map and the PNG index of each palette entry. Returns the output bit depth.
+//
+static uint8_t prepare_palette( options_t& options, std::string& strLog )
+{
+	const uint8_t uBPP = palette_bpp( options.aPalette.size() );
+
+	// nearest colour searches. The cube cells are filled in as each image needs them.
+	options.aPalette.Lookup( 0, options.match );
+	options.aPalette.Lookup( 1, options.match );
+	options.aTree[ 0 ].Create( options.aPalette.aColours, 0 );
+	options.aTree[ 1 ].Create( options.aPalette.aColours, 1 );
+	options.aScan[ 0 ].Create( options.aPalette, 0 );
+	options.aScan[ 1 ].Create( options.aPalette, 1 );
+	options.aExact[ 0 ].Create( options.aPalette.aColours, 0 );
+	options.aExact[ 1 ].Create( options.aPalette.aColours, 1 );
+
+	// -linear dithers against the palette in linear light.
+	const uint16_t* aLinear = srgb_linear12_table();
+	options.aPaletteLinear.resize( options.aPalette.size() * 3 );
+	for ( size_t i = 0; i < options.aPalette.size(); ++i )
+	{
+		for ( int c = 0; c < 3; ++c )
+		{
+			options.aPaletteLinear[ i * 3 + c ] = aLinear[ options.aPalette[ i ].chan[ c ] ];
+		}
+	}
+
+	// -lutcache: map in the cube an earlier run saved for this palette, or fill it and save
+	// it. Only the cube remap_image will search is kept, which the key says.
+	artefact_cache_t cache;
+	if ( options.search == SEARCH_CUBE && options.strLutFolder.empty() == false && cache.Open( options.strLutFolder ) )
+	{
+		const size_t palStart = remap_pal_start( options );
+		const uint64_t key = lut_cache_key( options, palStart );
+		const std::string strFile = cache.Path( key, kLutCacheName );
+
+		palette_lookup_t& lookup = options.aPalette.Lookup( palStart, options.match );
+
+		if ( cache.Touch( key, kLutCacheName ) && lookup.Load( strFile ) )
+		{
+			strLog += "Using the colour cube in \"" + strFile + "\".\n\n";
+		}
+		else if ( cache.Store( key, kLutCacheName, [&]( const std::string& strTemp ) { return lookup.Save( strTemp ); } ) )
+		{
+			strLog += "Saved the colour cube to \"" + strFile + "\".\n\n";
+		}
+		else
+		{
+			strLog += "WARNING: could not save the colour cube to \"" + strFile + "\".\n\n";
+		}
+
+		cache.Trim();
+	}
+	else if ( options.search == SEARCH_CUBE && options.strLutFolder.empty() == false )
+	{
+		strLog += "WARNING: could not make the cube folder \"" + options.strLutFolder + "\".\n\n";
+	}
+
+	build_threshold_map( options, ( options.bOpaque == false ) ? 1 : 0 );
+
+	// PNG index for each palette index: a (wrapping) -addidx offset, and index 0 moved
+	// to the -transp index.
+	for ( int i = 0; i < 256; ++i )
+	{
+		options.aOutIndex[ i ] = (uint8_t)( i + options.indexOffset );
+	}
+	if ( options.bOpaque == false )
+	{
+		options.aOutIndex[ 0 ] = (uint8_t)( options.transIndex );
+	}
+
+	options.uBPP = uBPP;
+	return uBPP;
+}
+
+//
+// stats_line
+//
+// The -stats line that follows a file's log.
+//
+static std::string stats_line( const stats_t& stats )
+{
+	char szLine[ 256 ];
+	snprintf( szLine, sizeof( szLine ), "  decode %.3f ms, remap %.3f ms, encode %.3f ms, %llu -> %llu bytes, peak %.1f MB\n",
+			  stats.fDecodeMs, stats.fRemapMs, stats.fEncodeMs, static_cast<unsigned long long>( stats.uBytesIn ),
+			  static_cast<unsigned long long>( stats.uBytesOut ), double( stats.uPeakRSS ) / ( 1024.0 * 1024.0 ) );
+
+	std::string strLine = szLine;
+
+	if ( stats.uMeasured > 0 )
+	{
+		snprintf( szLine, sizeof( szLine ), "  PSNR %.2f dB, mean dE %.2f, dE < 1 %.1f%%, < 2 %.1f%%, < 5 %.1f%%\n", stats.PSNR(), stats.MeanDeltaE(),
+				  stats.DeltaEBelow( 1 ), stats.DeltaEBelow( 2 ), stats.DeltaEBelow( 5 ) );
+		strLine += szLine;
+	}
+
+	return strLine;
+}
+
+//
+// print_stats
+//
+// Print the -stats summary for the batch.
+//
+static void print_stats( const stats_t& stats )
+{
+	const double fMegaPixelsPerSec = ( stats.fWallMs > 0 ) ? ( double( stats.uPixels ) / ( stats.fWallMs * 1000.0 ) ) : 0;
+
+	printf( "\nStats:\n" );
+	printf( "  files           %10llu (%llu failed)\n", static_cast<unsigned long long>( stats.uFiles ), static_cast<unsigned long long>( stats.uFailed ) );
+	printf( "  decode          %10.3f ms (all files)\n", stats.fDecodeMs );
+	printf( "  remap           %10.3f ms (all files)\n", stats.fRemapMs );
+	printf( "  encode          %10.3f ms (all files)\n", stats.fEncodeMs );
+	printf( "  wall            %10.3f ms (%llu pixels, %.2f Mpixel/s)\n", stats.fWallMs, static_cast<unsigned long long>( stats.uPixels ), fMegaPixelsPerSec );
+	printf( "  bytes in        %10llu\n", static_cast<unsigned long long>( stats.uBytesIn ) );
+	printf( "  bytes out       %10llu\n", static_cast<unsigned long long>( stats.uBytesOut ) );
+	printf( "  peak memory     %10.1f MB\n", double( stats.uPeakRSS ) / ( 1024.0 * 1024.0 ) );
+
+	if ( stats.uMeasured > 0 )
+	{
+		printf( "  PSNR            %10.2f dB (%llu pixels)\n", stats.PSNR(), static_cast<unsigned long long>( stats.uMeasured ) );
+		printf( "  mean dE         %10.2f (dE < 1 %.1f%%, < 2 %.1f%%, < 5 %.1f%%)\n", stats.MeanDeltaE(), stats.DeltaEBelow( 1 ), stats.DeltaEBelow( 2 ),
+				stats.DeltaEBelow( 5 ) );
+	}
+
+	printf( "\n" );
+}
+
+//
+// quality_json
+//
+// The -quality figures as JSON members, to go at the end of an object. Empty without.
+//
+static std::string quality_json( const stats_t& stats )
+{
+	if ( stats.uMeasured == 0 )
+	{
+		return std::string();
+	}
+
+	char szValue[ 128 ];
+	snprintf( szValue, sizeof( szValue ), ", \"measured\": %llu, \"psnr_db\": %.3f, \"mean_delta_e\": %.3f, \"delta_e_bins\": [",
+			  static_cast<unsigned long long>( stats.uMeasured ), stats.PSNR(), stats.MeanDeltaE() );
+
+	std::string strJson = szValue;
+
+	for ( size_t i = 0; i < stats_t::kDeltaEBins; ++i )
+	{
+		snprintf( szValue, sizeof( szValue ), "%s%llu", i ? ", " : "", static_cast<unsigned long long>( stats.aDeltaE[ i ] ) );
+		strJson += szValue;
+	}
+
+	return strJson + "]";
+}
+
+//
+// json_string
+//
+// A string as a quoted JSON value.
+//
+static std::string json_string( const std::string& str )
+{
+	std::string strJson = "\"";
+
+	for ( const char c : str )
+	{
+		if ( c == '"' || c == '\\' )
+		{
+			strJson += '\\';
+			strJson += c;
+		}
+		else if ( uint8_t( c ) < 0x20 )
+		{
+			char szEscape[ 8 ];
+			snprintf( szEscape, sizeof( szEscape ), "\\u%04x", c );
+			strJson += szEscape;
+		}
+		else
+		{
+			strJson += c;
+		}
+	}
+
+	return strJson + "\"";
+}
+
+//
+// write_stats_json
+//
+// Dump the -stats report to disk as JSON lines: one object per file, in input order,
+// then the batch summary.
+//
+static void write_stats_json( const std::vector< std::string >& aFiles, const std::vector< stats_t >& aStats, const stats_t& total, const std::string& strFileName )
+{
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, strFileName.c_str(), "w" );
+
+	if ( e != 0 || fp == nullptr )
+	{
+		printf( "FAILED\n\n" );
+		return;
+	}
+
+	for ( size_t i = 0; i < aFiles.size(); ++i )
+	{
+		const stats_t& stats = aStats[ i ];
+
+		fprintf( fp, "{\"file\": %s, \"ok\": %s, \"pixels\": %llu, \"decode_ms\": %.3f, \"remap_ms\": %.3f, \"encode_ms\": %.3f, \"total_ms\": %.3f, "
+				 "\"bytes_in\": %llu, \"bytes_out\": %llu, \"peak_rss_bytes\": %llu%s}\n",
+				 json_string( aFiles[ i ] ).c_str(), stats.uFailed ? "false" : "true", static_cast<unsigned long long>( stats.uPixels ),
+				 stats.fDecodeMs, stats.fRemapMs, stats.fEncodeMs, stats.fTotalMs, static_cast<unsigned long long>( stats.uBytesIn ),
+				 static_cast<unsigned long long>( stats.uBytesOut ), static_cast<unsigned long long>( stats.uPeakRSS ), quality_json( stats ).c_str() );
+	}
+
+	fprintf( fp, "{\"summary\": true, \"files\": %llu, \"failed\": %llu, \"pixels\": %llu, \"decode_ms\": %.3f, \"remap_ms\": %.3f, \"encode_ms\": %.3f, "
+			 "\"wall_ms\": %.3f, \"pixels_per_sec\": %.0f, \"bytes_in\": %llu, \"bytes_out\": %llu, \"peak_rss_bytes\": %llu%s}\n",
+			 static_cast<unsigned long long>( total.uFiles ), static_cast<unsigned long long>( total.uFailed ), static_cast<unsigned long long>( total.uPixels ),
+			 total.fDecodeMs, total.fRemapMs, total.fEncodeMs, total.fWallMs,
+			 ( total.fWallMs > 0 ) ? ( double( total.uPixels ) * 1000.0 / total.fWallMs ) : 0.0,
+			 static_cast<unsigned long long>( total.uBytesIn ), static_cast<unsigned long long>( total.uBytesOut ), static_cast<unsigned long long>( total.uPeakRSS ),
+			 quality_json( total ).c_str() );
+
+	fclose( fp );
+
+	printf( "OK\n\n" );
+}
+
+//
+// atlas_sprite_t
+//
+// One -atlas input and where it goes in the atlas.
+//
+struct atlas_sprite_t
+{
+	std::string strFile;
+	int x = 0;
+	int y = 0;
+	int w = 0;
+	int h = 0;
+	bool bOK = false;
+	std::string strLog;
+};
+
+static constexpr int kAtlasPadding = 1; // pixels of index 0 between sprites.
+
+//
+// pack_atlas
+//
+// Shelf packing: the tallest sprites first, left to right in rows about as wide as the
+// square root of their total area. Returns the atlas size.
+//
+static void pack_atlas( std::vector< atlas_sprite_t >& aSprites, int& width, int& height )
+{
+	std::vector< size_t > aOrder;
+	uint64_t uArea = 0;
+	int max_width = 1;
+
+	for ( size_t i = 0; i < aSprites.size(); ++i )
+	{
+		if ( aSprites[ i ].w > 0 )
+		{
+			aOrder.push_back( i );
+			uArea += uint64_t( aSprites[ i ].w + kAtlasPadding ) * uint64_t( aSprites[ i ].h + kAtlasPadding );
+			max_width = std::max( max_width, aSprites[ i ].w );
+		}
+	}
+
+	std::stable_sort( aOrder.begin(), aOrder.end(), [&]( size_t a, size_t b )
+					  {
+						  return ( aSprites[ a ].h != aSprites[ b ].h ) ? ( aSprites[ a ].h > aSprites[ b ].h ) : ( aSprites[ a ].w > aSprites[ b ].w );
+					  } );
+
+	width = std::max( max_width, int( ceil( sqrt( double( uArea ) ) ) ) );
+	height = 0;
+
+	int x = 0;
+	int y = 0;
+	int shelf = 0;
+
+	for ( size_t i : aOrder )
+	{
+		atlas_sprite_t& sprite = aSprites[ i ];
+
+		if ( x > 0 && x + sprite.w > width )
+		{
+			x = 0;
+			y += shelf + kAtlasPadding;
+			shelf = 0;
+		}
+
+		sprite.x = x;
+		sprite.y = y;
+
+		x += sprite.w + kAtlasPadding;
+		shelf = std::max( shelf, sprite.h );
+		height = std::max( height, y + sprite.h );
+	}
+
+	height = std::max( height, 1 );
+}
+
+//
+// write_atlas_json
+//
+// The rect index of an atlas: its size, and where each input went.
+//
+static bool write_atlas_json( const std::vector< atlas_sprite_t >& aSprites, int width, int height, const std::string& strFileName )
+{
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, strFileName.c_str(), "w" );
+
+	if ( e != 0 || fp == nullptr )
+	{
+		printf( "FAILED\n" );
+		return false;
+	}
+
+	fprintf( fp, "{\n\t\"width\": %d,\n\t\"height\": %d,\n\t\"sprites\": [", width, height );
+
+	const char* szSeparator = "\n";
+	for ( const atlas_sprite_t& sprite : aSprites )
+	{
+		if ( sprite.bOK )
+		{
+			fprintf( fp, "%s\t\t{\"file\": %s, \"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d}", szSeparator, json_string( sprite.strFile ).c_str(),
+					 sprite.x, sprite.y, sprite.w, sprite.h );
+			szSeparator = ",\n";
+		}
+	}
+
+	fprintf( fp, "\n\t]\n}\n" );
+	fclose( fp );
+
+	printf( "OK\n" );
+	return true;
+}
+
+//
+// write_atlas_image
+//
+// Write the atlas indices with W, a PNG or -raw writer.
+//
+template < typename W >
+static bool write_atlas_image( const options_t& options, const std::vector< uint8_t >& aAtlas, int width, int height, std::string& strLog )
+{
+	TRACE_ZONE( "write_atlas_image" );
+
+	W writer;
+	writer._bIfChanged = options.bIfChanged;
+	std::vector< color_t > aPalette = options.aPalette.aColours;
+	const uint32_t uBPP = W::OutputBPP( options.uBPP );
+
+	if ( writer.Open( width, height, uBPP, aPalette, options.indexOffset, options.bOpaque, options.transIndex, options.encode,
+					  image_thread_count( width, height, options ), options.strAtlasFile, strLog ) )
+	{
+		indexmap_t row;
+		row.Create( width, 1, uBPP, 1 );
+
+		verify_hash_t hash;
+		verify_indexed( hash, size_t( width ), size_t( height ), uBPP, aPalette, options.indexOffset, options.bOpaque, options.transIndex );
+		const size_t uRowBytes = ( size_t( width ) * uBPP + 7 ) / 8;
+
+		for ( int y = 0; y < height; ++y )
+		{
+			row.StoreRow( y, &aAtlas[ size_t( y ) * width ] );
+			if ( options.pVerify )
+			{
+				hash.AddData( row.Row( y ), uRowBytes );
+			}
+			writer.WriteRow( row.Row( y ) );
+		}
+
+		writer.Close( strLog );
+
+		if ( options.pVerify && writer._bFailed == false )
+		{
+			strLog += options.pVerify->Record( options.strAtlasFile, "indexed", hash );
+		}
+	}
+
+	return ( writer._bFailed == false );
+}
+
+//
+// do_atlas
+//
+// -atlas: remap every input and pack them into one PNG, written in a single pass, with
+// a JSON index of the rects beside it. Each sprite is remapped on its own, so it comes
+// out just as it would have in a file of its own.
+//
+static void do_atlas( options_t& options, const std::vector< std::string >& aFiles )
+{
+	std::vector< atlas_sprite_t > aSprites( aFiles.size() );
+
+	// the sizes, from the headers.
+	for ( size_t i = 0; i < aFiles.size(); ++i )
+	{
+		atlas_sprite_t& sprite = aSprites[ i ];
+		sprite.strFile = aFiles[ i ];
+
+		int chan_count = 0;
+		if ( stbi_info( sprite.strFile.c_str(), &sprite.w, &sprite.h, &chan_count ) == 0 || sprite.w <= 0 || sprite.h <= 0 )
+		{
+			sprite.w = sprite.h = 0;
+			sprite.strLog = "Loading \"" + sprite.strFile + "\" ... FAILED\n";
+		}
+	}
+
+	int width, height;
+	pack_atlas( aSprites, width, height );
+
+	// the atlas starts as padding.
+	std::vector< uint8_t > aAtlas( size_t( width ) * height, options.aOutIndex[ 0 ] );
+
+	std::atomic< size_t > uNext = 0;
+
+	auto worker_fn = [&]()
+	{
+		for ( size_t index = uNext++; index < aSprites.size(); index = uNext++ )
+		{
+			atlas_sprite_t& sprite = aSprites[ index ];
+			if ( sprite.w == 0 )
+			{
+				continue;
+			}
+
+			sprite.strLog = "Loading \"" + sprite.strFile + "\" ... ";
+
+			colormap_t image;
+			int w = 0, h = 0, chan_count = 0;
+			unsigned char* img_data = nullptr;
+
+			// made luminance as it is read, if it is a PNG libpng can read.
+			png_reader_t reader;
+			if ( reader.Open( sprite.strFile, options.bLuminance ) )
+			{
+				w = int( reader._width );
+				h = int( reader._height );
+				chan_count = 4;
+
+				if ( w != sprite.w || h != sprite.h || reader.ReadImage( image ) == false )
+				{
+					sprite.strLog += "FAILED\n";
+					continue;
+				}
+
+				reader.Close();
+			}
+			else if ( ( img_data = stbi_load( sprite.strFile.c_str(), &w, &h, &chan_count, 0 ) ) == nullptr || w != sprite.w || h != sprite.h )
+			{
+				sprite.strLog += "FAILED\n";
+				stbi_image_free( img_data );
+				continue;
+			}
+			else if ( chan_count != 3 && chan_count != 4 )
+			{
+				sprite.strLog += "INVALID-CHANNELS (" + std::to_string( chan_count ) + ")\n";
+				stbi_image_free( img_data );
+				continue;
+			}
+
+			sprite.strLog += "OK (" + std::to_string( w ) + " x " + std::to_string( h ) + ") at " + std::to_string( sprite.x ) + ", " + std::to_string( sprite.y ) + "\n";
+
+			if ( img_data )
+			{
+				image.CreateView( img_data, w, h, chan_count );
+
+				if ( options.bLuminance )
+				{
+					image.ApplyLuminance();
+				}
+			}
+
+			if ( options.bOpaque == false )
+			{
+				image.DetectAlpha( options.uAlphaCut );
+			}
+
+			// unpacked indices, copied straight to the sprite's rect.
+			indexmap_t output;
+			output.Create( w, h, 8, stream_row_count( w, h, options ) );
+
+			size_t y = 0;
+			output._fnWriteRow = [&]( const uint8_t* pRow )
+			{
+				memcpy( &aAtlas[ size_t( sprite.y + y++ ) * width + sprite.x ], pRow, w );
+			};
+
+			if ( image._uChannels == 3 )
+			{
+				remap_image< 3 >( image, output, options, options.aPalette[ 0 ] );
+			}
+			else
+			{
+				remap_image< 4 >( image, output, options, options.aPalette[ 0 ] );
+			}
+
+			stbi_image_free( img_data );
+
+			sprite.bOK = true;
+		}
+	};
+
+	const size_t uThreadCount = std::max< size_t >( 1, std::min< size_t >( options.uThreadCount, aSprites.size() ) );
+
+	std::vector< std::thread > aThreads;
+	for ( size_t i = 1; i < uThreadCount; ++i )
+	{
+		aThreads.emplace_back( worker_fn );
+	}
+
+	worker_fn();
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	for ( const atlas_sprite_t& sprite : aSprites )
+	{
+		std::cout << sprite.strLog;
+	}
+
+	// one output, packed a row at a time.
+	std::string strLog;
+
+	const bool bOK = options.bRaw ? write_atlas_image< raw_writer_t >( options, aAtlas, width, height, strLog )
+								  : write_atlas_image< png_writer_t >( options, aAtlas, width, height, strLog );
+
+	std::cout << strLog;
+
+	if ( bOK )
+	{
+		std::string strIndexFile = options.strAtlasFile;
+
+		const size_t dot_find = strIndexFile.find_last_of( '.' );
+		const size_t slash_find = strIndexFile.find_last_of( "/\\" );
+		if ( dot_find != strIndexFile.npos && ( slash_find == strIndexFile.npos || dot_find > slash_find ) )
+		{
+			strIndexFile.erase( dot_find );
+		}
+
+		write_atlas_json( aSprites, width, height, strIndexFile + ".json" );
+	}
+}
+
+//
+// finish_verify
+//
+// -verify: write the manifest, or sum up the comparison with it. False if an output differed.
+//
+static bool finish_verify( options_t& options )
+{
+	if ( options.pVerify == nullptr )
+	{
+		return true;
+	}
+
+	std::string strLog;
+	const bool bOK = options.pVerify->Close( strLog );
+	std::cout << "\n" << strLog;
+
+	options.pVerify = nullptr;
+	for ( std::unique_ptr< options_t >& variant : options.aVariants )
+	{
+		variant->pVerify = nullptr;
+	}
+
+	return bOK;
+}
+
+//
+// do_work
+//
+// Palette generator. False if -verify found an output that differs.
+//
+static bool do_work( options_t& options )
+{
+	std::cout << "Applying palette \"" << options.strPaletteFile << "\". It has " << options.aPalette.size() << " entries.\n";
+
+	for ( const std::unique_ptr< options_t >& variant : options.aVariants )
+	{
+		std::cout << "Applying palette \"" << variant->strPaletteFile << "\". It has " << variant->aPalette.size() << " entries.\n";
+	}
+
+	if ( options.bOpaque == false )
+	{
+		std::cout << "Index " << int( (uint8_t)( options.transIndex ) ) << " will be transparent.\n";
+	}
+
+	std::cout << "\n";
+
+	if ( options.aInputFiles.size() > 1 )
+	{
+		std::cout << "Palettizing " << options.aInputFiles.size() << " files...\n";
+	}
+
+	// ... auto-create the output folder, if specified.
+	if ( options.strOutFolder.empty() == false )
+	{
+		make_path( options.strOutFolder );
+	}
+
+	const tClock::time_point start = tClock::now();
+
+	std::string strSetupLog;
+	const uint8_t uBPP = prepare_palette( options, strSetupLog );
+
+	for ( std::unique_ptr< options_t >& variant : options.aVariants )
+	{
+		prepare_palette( *variant, strSetupLog );
+	}
+
+	std::cout << strSetupLog;
+
+	std::vector< color_t > png_palette;
+	for ( uint32_t i = 0; i < options.aPalette.size(); ++i )
+	{
+		png_palette.push_back( options.aPalette[ i ] );
+	}
+	while ( png_palette.size() < ( 1ULL << uBPP ) )
+	{
+		png_palette.push_back( color_t( 0xFF00FF ) );
+	}
+
+	//
+	// -- Process Each File
+
+	// -sequence frames go in order, each one compared with the one before.
+	if ( options.bSequence )
+	{
+		options.uThreadCount = 1;
+	}
+
+	// with several jobs, the cube is filled up front so the searches are read only.
+	const size_t uThreadCount = std::max< size_t >( 1, std::min< size_t >( options.uThreadCount, options.aInputFiles.size() ) );
+
+	if ( uThreadCount > 1 && options.search == SEARCH_CUBE )
+	{
+		options.aPalette.Lookup( 0, options.match ).FillAll();
+		options.aPalette.Lookup( 1, options.match ).FillAll();
+
+		for ( std::unique_ptr< options_t >& variant : options.aVariants )
+		{
+			variant->aPalette.Lookup( 0, variant->match ).FillAll();
+			variant->aPalette.Lookup( 1, variant->match ).FillAll();
+		}
+	}
+
+	const std::vector< std::string > aFiles( options.aInputFiles.begin(), options.aInputFiles.end() );
+
+	// -verify: one manifest, for the outputs of every palette.
+	verify_manifest_t verify;
+	if ( options.strVerifyFile.empty() == false )
+	{
+		if ( verify.Open( options.strVerifyFile ) == false )
+		{
+			std::cout << "Error - could not read the verify manifest \"" << options.strVerifyFile << "\".\n";
+			return false;
+		}
+
+		options.pVerify = &verify;
+		for ( std::unique_ptr< options_t >& variant : options.aVariants )
+		{
+			variant->pVerify = &verify;
+		}
+	}
+
+	if ( options.strAtlasFile.empty() == false )
+	{
+		do_atlas( options, aFiles );
+		return finish_verify( options );
+	}
+
+	std::vector< std::string > aLogs( aFiles.size() );
+	std::vector< stats_t > aStats( aFiles.size() );
+	std::vector< uint8_t > aDone( aFiles.size(), 0 );
+	std::atomic< size_t > uNextFile = 0;
+	size_t uNextPrint = 0;
+	std::mutex mutexLog;
+
+	stat_files( aFiles.size() );
+
+	auto worker_fn = [&]()
+	{
+		stat_worker_t worker;
+
+		for ( size_t index = uNextFile++; index < aFiles.size(); index = uNextFile++ )
+		{
+			std::string outFile;
+			determine_output_filename( aFiles[ index ], options, outFile );
+
+			std::string strLog;
+			{
+				stat_busy_t busy;
+				process_file( options, aFiles[ index ], outFile, strLog, aStats[ index ] );
+			}
+
+			const stats_t& done = aStats[ index ];
+			stat_file_done( done.uFailed == 0, done.uBytesIn, done.uBytesOut, done.uPixels );
+
+			if ( options.bStats )
+			{
+				strLog += stats_line( aStats[ index ] );
+			}
+
+			// print every finished file up to the first one still in progress.
+			std::lock_guard< std::mutex > lock( mutexLog );
+
+			aLogs[ index ] = std::move( strLog );
+			aDone[ index ] = 1;
+
+			while ( uNextPrint < aFiles.size() && aDone[ uNextPrint ] )
+			{
+				std::cout << aLogs[ uNextPrint ];
+				aLogs[ uNextPrint ].clear();
+				++uNextPrint;
+			}
+		}
+	};
+
+	std::vector< std::thread > aThreads;
+	for ( size_t i = 1; i < uThreadCount; ++i )
+	{
+		aThreads.emplace_back( [ &worker_fn, i ]()
+		{
+			mem_numa_pin( i );
+			worker_fn();
+		} );
+	}
+
+	worker_fn();
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	if ( options.bStats )
+	{
+		stats_t total;
+		for ( const stats_t& stats : aStats )
+		{
+			total.Add( stats );
+		}
+		total.fWallMs = elapsed_ms( start );
+
+		print_stats( total );
+
+		if ( options.strStatsFile.empty() == false )
+		{
+			write_stats_json( aFiles, aStats, total, options.strStatsFile );
+		}
+	}
+
+	return finish_verify( options );
+}
+
+//
+// setup_key
+//
+// Identifies the palette and options that prepare_palette, the remap and the writing of
+// the output depend on, so -serve jobs that share them share one setup. Each job's output
+// is made with the setup's options, not its own, so any option that process_file reads
+// must be here.
+//
+static std::string setup_key( const options_t& options )
+{
+	std::string strKey = std::to_string( options.aPalette.size() ) + "," + std::to_string( options.aPalette.uHash );
+
+	strKey += "|" + std::to_string( options.search )
+			+ "|" + std::to_string( options.match )
+			+ "|" + std::to_string( options.dither )
+			+ "|" + std::to_string( options.bFixed )
+			+ "|" + std::to_string( options.bLinear )
+			+ "|" + std::to_string( options.bSerpentine )
+			+ "|" + std::to_string( options.encode )
+			+ "|" + std::to_string( options.indexOffset )
+			+ "|" + std::to_string( options.bOpaque )
+			+ "|" + std::to_string( options.transIndex )
+			+ "|" + std::to_string( options.uAlphaCut )
+			+ "|" + std::to_string( options.bLuminance )
+			+ "|" + std::to_string( options.bRaw )
+			+ "|" + std::to_string( options.bTrim )
+			+ "|" + std::to_string( options.bIfChanged )
+			+ "|" + std::to_string( options.bTiles )
+			+ "|" + std::to_string( options.bQuality )
+			+ "|" + options.strLutFolder;
+
+	return strKey;
+}
+
+//
+// run_server
+//
+// -serve: each job (see palserve.h) has the arguments of a normal run. A setup (the
+// prepare_palette state, with the cube filled) is kept for each palette and set of options,
+// so only the first job to use one pays for it. -j jobs run at once, from every client.
+//
+struct server_setup_t
+{
+	options_t options;
+	std::once_flag prepared;
+};
+
+static void run_server( const options_t& server )
+{
+	std::unordered_map< std::string, std::unique_ptr< server_setup_t > > mapSetups;
+	std::mutex mutexSetups;
+
+	serve_jobs( server.strServe, server.uThreadCount, [&]( std::vector< std::string >& aArgs, std::string& strLog )
+	{
+		std::vector< char* > argv = serve_argv( "applypal", aArgs );
+
+		// jobs run side by side, so there is no previous frame for -sequence. The setups
+		// are keyed by one palette, so a job has just the one. A job remaps its inputs, so
+		// -atlas and -bench, which the job would not run, are refused rather than dropped.
+		options_t job;
+		if ( process_args( int( argv.size() ), argv.data(), job ) == false || job.bServe || job.bSequence || job.aVariants.empty() == false ||
+			 job.strVerifyFile.empty() == false || job.strAtlasFile.empty() == false || job.bBenchmark )
+		{
+			return false;
 		}
 
-		// Write!
-		png_write_info( png_ptr, info_ptr );
-
-		for ( int i = 0; i < image._height; ++i )
+		server_setup_t* pSetup;
 		{
-			png_bytep row = const_cast<png_bytep>( image._data_ptr + ( i * image._uStride ) );
+			std::lock_guard< std::mutex > lock( mutexSetups );
 
-			for ( int x = 0; x < image._width; ++x )
+			std::unique_ptr< server_setup_t >& setup = mapSetups[ setup_key( job ) ];
+			if ( setup == nullptr )
 			{
-				png_byte p = row[ x ];
+				setup = std::make_unique< server_setup_t >();
+				process_args( int( argv.size() ), argv.data(), setup->options );
+				setup->options.uThreadCount = server.uThreadCount;
+			}
 
-				if ( ( bOpaque == false ) && ( p == 0 ) )
-				{
-					p = transIndex; // potentially remaps the transparent pixel to another index.
-				}
-				else
-				{
-					p = (png_byte)( p + indexOffset ); // apply a (wrapping) offset to the index.
-				}
+			pSetup = setup.get();
+		}
 
-				row[ x ] = p;
-			}
+		// the first job prepares the setup; any others that need it meanwhile wait here.
+		std::call_once( pSetup->prepared, [&]()
+		{
+			prepare_palette( pSetup->options, strLog );
 
-			png_write_rows( png_ptr, &row, 1 );
+			// shared between the workers, so the searches must be read only.
+			pSetup->options.aPalette.Lookup( 0, pSetup->options.match ).FillAll();
+			pSetup->options.aPalette.Lookup( 1, pSetup->options.match ).FillAll();
+		} );
+
+		if ( job.strOutFolder.empty() == false )
+		{
+			make_path( job.strOutFolder );
 		}
 
-		png_write_end( png_ptr, nullptr );
+		bool bOK = true;
 
-		std::cout << "OK\n";
-	}
+		for ( const std::string& inputFile : job.aInputFiles )
+		{
+			std::string outFile;
+			determine_output_filename( inputFile, job, outFile );
 
-	// Destroy the main writer and info structures
-	png_destroy_write_struct( &png_ptr, &info_ptr );
+			stats_t stats;
+			bOK = process_file( pSetup->options, inputFile, outFile, strLog, stats ) && bOK;
 
-	fclose( fp );
-}
+			if ( job.bStats )
+			{
+				strLog += stats_line( stats );
+			}
+		}
 
-//==============================================================================
+		return bOK;
+	} );
+}
 
-static void accumulate_error( int x, int y, dithermap_t& workspace, const dither_t& error, float fScale )
+//
+// watch_outputs
+//
+// Note the outputs of an input, of every palette, so that -watch doesn't take them for
+// inputs when the wildcards match them too.
+//
+static void watch_outputs( options_t& options, const std::string& inputFile, std::unordered_set< std::string >& setOutputs )
 {
-	// out of bounds?
-	if ( x < 0 || y < 0 || x >= workspace._width || y >= workspace._height )
-		return;
+	std::string outFile;
+	determine_output_filename( inputFile, options, outFile );
+	setOutputs.insert( outFile );
 
-	dither_t& p = workspace.Element( x, y );
-	p.err_r += error.err_r * fScale;
-	p.err_g += error.err_g * fScale;
-	p.err_b += error.err_b * fScale;
+	for ( std::unique_ptr< options_t >& variant : options.aVariants )
+	{
+		determine_output_filename( inputFile, *variant, outFile );
+		setOutputs.insert( outFile );
+	}
 }
 
-static void remap_image_dither( const colormap_t& image, indexmap_t& output, options_t& options, const color_t pal_idx0 )
+//
+// run_watch
+//
+// -watch: a normal run, then the folders of the input wildcards are watched (see
+// palwatch.h) and each input is remapped again when it is saved, as is a new file that
+// the wildcards match, -j at once. The palettes are prepared once, by the first run, and
+// their cubes kept full. An input's time and size say whether it has changed, so that an
+// output written over its input doesn't set it off again.
+//
+static constexpr unsigned kWatchSettleMs = 50; // the changes of a save, or a copy of many files, are remapped once.
+
+static bool run_watch( options_t& options )
 {
-	const bool bCheckTransp = ( options.bOpaque == false ) && image.bHasAlpha;
-	const size_t palStart = ( options.bOpaque == false ) ? 1 : 0;
+	// the folder each wildcard's files are under, watched before the first run so no save is missed.
+	std::vector< std::pair< std::string, bool > > aFolders;
+	for ( const std::string& strWildCard : options.aInputWildCards )
+	{
+		std::string strBase;
+		std::vector< std::string > aParts;
+		find_split( strWildCard.c_str(), strBase, aParts );
 
-	dithermap_t workspace;
-	workspace.Create( image._width, image._height );
+		const bool bSubtree = ( aParts.size() > 1 );
+		auto it = std::find_if( aFolders.begin(), aFolders.end(), [&]( const std::pair< std::string, bool >& folder ) { return folder.first == strBase; } );
+		if ( it == aFolders.end() )
+		{
+			aFolders.emplace_back( strBase, bSubtree );
+		}
+		else
+		{
+			it->second = it->second || bSubtree;
+		}
+	}
 
-	// load the workspace with the source image.
-	for ( uint32_t y = 0; y < image._height; ++y )
+	watch_folders_t watch;
+	for ( const std::pair< std::string, bool >& folder : aFolders )
 	{
-		for ( uint32_t x = 0; x < image._width; ++x )
+		if ( watch.Add( folder.first, folder.second ) == false )
 		{
-			color_t colour = image.Peek( x, y );
-
-			if ( image.bHasAlpha == false && options.bOpaque == false && colour.BGR() == pal_idx0.BGR() )
-			{
-				dither_t& target = workspace.Element( x, y );
-				target.err_r = static_cast<float>( colour.chan[ 0 ] ) / 255.0f;
-				target.err_g = static_cast<float>( colour.chan[ 1 ] ) / 255.0f;
-				target.err_b = static_cast<float>( colour.chan[ 2 ] ) / 255.0f;
-				target.is_opaque = false;
-				target.index = 0;
-			}
-			else
-			{
-				dither_t& target = workspace.Element( x, y );
-				target.err_r = static_cast<float>( colour.chan[ 0 ] ) / 255.0f;
-				target.err_g = static_cast<float>( colour.chan[ 1 ] ) / 255.0f;
-				target.err_b = static_cast<float>( colour.chan[ 2 ] ) / 255.0f;
-				target.is_opaque = !( bCheckTransp && colour.chan[ 3 ] != 0xFF );
-				target.index = 0;
-			}
+			std::cout << "Error - could not watch the folder \"" << ( folder.first.empty() ? std::string( "." ) : folder.first ) << "\".\n";
+			return false;
 		}
 	}
 
-	// FloydSteinberg dithering
-	for ( uint32_t y = 0; y < image._height; ++y )
+	std::unordered_map< std::string, watch_stamp_t > mapStamps;
+	std::unordered_set< std::string > setOutputs;
+	for ( const std::string& inputFile : options.aInputFiles )
 	{
-		for ( uint32_t x = 0; x < image._width; ++x )
-		{
-			dither_t& pixel = workspace.Element( x, y );
+		mapStamps[ inputFile ] = watch_stamp( inputFile );
+		watch_outputs( options, inputFile, setOutputs );
+	}
 
-			if ( pixel.is_opaque )
-			{
-				// decide which is our closest palette index
-				color_t old_colour_sat;
-				old_colour_sat.FromDither( pixel );
-				uint8_t remapped_idx = find_nearest_palette_index( old_colour_sat, options.aPalette, palStart );
-				pixel.index = remapped_idx; // store this.
+	if ( do_work( options ) == false )
+	{
+		return false;
+	}
 
-				// not an exact match? (likely)
-				const color_t new_colour_sat = options.aPalette[ remapped_idx ];
-				if ( old_colour_sat.BGR() != new_colour_sat.BGR() )
-				{
-					// compute error between the pixel and the palette value we must use.
-					dither_t quant_error;
-					quant_error.err_r = ( static_cast<float>( old_colour_sat.chan[ 0 ] ) - static_cast<float>( new_colour_sat.chan[ 0 ] ) ) / 255.0f;
-					quant_error.err_g = ( static_cast<float>( old_colour_sat.chan[ 1 ] ) - static_cast<float>( new_colour_sat.chan[ 1 ] ) ) / 255.0f;
-					quant_error.err_b = ( static_cast<float>( old_colour_sat.chan[ 2 ] ) - static_cast<float>( new_colour_sat.chan[ 2 ] ) ) / 255.0f;
-
-					// diffuse the error among the neighbours
-					accumulate_error( x + 1, y, workspace, quant_error, 7.0f / 16.0f );
-					accumulate_error( x - 1, y + 1, workspace, quant_error, 3.0f / 16.0f );
-					accumulate_error( x, y + 1, workspace, quant_error, 5.0f / 16.0f );
-					accumulate_error( x + 1, y + 1, workspace, quant_error, 1.0f / 16.0f );
-				}
-			}
+	// an output written over its input is not a change to remap again.
+	auto restamp_fn = [&]( const std::string& inputFile )
+	{
+		if ( setOutputs.count( inputFile ) )
+		{
+			mapStamps[ inputFile ] = watch_stamp( inputFile );
 		}
+	};
+
+	for ( const std::string& inputFile : options.aInputFiles )
+	{
+		restamp_fn( inputFile );
 	}
 
-	// copy the pixel indices into the output image
-	for ( uint32_t y = 0; y < image._height; ++y )
+	// shared between the workers, so the searches must be read only.
+	if ( options.uThreadCount > 1 && options.search == SEARCH_CUBE )
 	{
-		for ( uint32_t x = 0; x < image._width; ++x )
+		options.aPalette.Lookup( 0, options.match ).FillAll();
+		options.aPalette.Lookup( 1, options.match ).FillAll();
+
+		for ( std::unique_ptr< options_t >& variant : options.aVariants )
 		{
-			const dither_t& pixel = workspace.Element( x, y );
-			output.Plot( x, y, pixel.index );
+			variant->aPalette.Lookup( 0, variant->match ).FillAll();
+			variant->aPalette.Lookup( 1, variant->match ).FillAll();
 		}
 	}
 
-	delete[] workspace._data_ptr;
-}
+	std::cout << "\nWatching " << aFolders.size() << ( aFolders.size() == 1 ? " folder" : " folders" ) << " for changes to the inputs, Ctrl+C to stop.\n";
+	std::cout.flush();
 
-//==============================================================================
+	std::vector< std::string > aChanged;
+	bool bLost = false;
 
-static void remap_image_nearest( const colormap_t& image, indexmap_t& output, options_t& options, const color_t pal_idx0 )
-{
-	std::vector< color_t >& aPalette = options.aPalette;
+	while ( watch.Wait( kWatchSettleMs, aChanged, bLost ) )
+	{
+		const tClock::time_point start = tClock::now();
 
-	const bool bCheckTransp = ( options.bOpaque == false ) && image.bHasAlpha;
+		// the changes the OS let go of could be to any input.
+		if ( bLost )
+		{
+			for ( const std::string& strWildCard : options.aInputWildCards )
+			{
+				find_files( strWildCard.c_str(), aChanged );
+			}
+		}
 
-	for ( uint32_t y = 0; y < image._height; ++y )
-	{
-		for ( uint32_t x = 0; x < image._width; ++x )
+		sort_files( aChanged );
+
+		std::vector< std::string > aFiles;
+		for ( const std::string& strFile : aChanged )
 		{
-			const color_t colour = image.Peek( x, y );
+			const auto it = mapStamps.find( strFile );
+			if ( it == mapStamps.end() )
+			{
+				const bool bInput = std::any_of( options.aInputWildCards.begin(), options.aInputWildCards.end(), [&]( const std::string& strWildCard )
+				{
+					return find_match_path( strWildCard.c_str(), strFile );
+				} );
 
-			uint8_t remapped_idx;
+				if ( bInput == false || setOutputs.count( strFile ) )
+				{
+					continue;
+				}
+			}
 
-			if ( bCheckTransp && colour.chan[ 3 ] != 0xFF )
+			// gone again, or as it was when last remapped.
+			const watch_stamp_t stamp = watch_stamp( strFile );
+			if ( stamp.uSize == ~0ULL || ( it != mapStamps.end() && it->second == stamp ) )
 			{
-				remapped_idx = 0; // TRANSPARENT!
+				continue;
 			}
-			else
+
+			if ( it == mapStamps.end() )
+			{
+				watch_outputs( options, strFile, setOutputs );
+			}
+
+			mapStamps[ strFile ] = stamp;
+			aFiles.push_back( strFile );
+		}
+
+		aChanged.clear();
+
+		if ( aFiles.empty() )
+		{
+			continue;
+		}
+
+		std::vector< std::string > aLogs( aFiles.size() );
+		std::vector< stats_t > aStats( aFiles.size() );
+		std::vector< uint8_t > aFailed( aFiles.size(), 0 );
+
+		parallel_for( 0, aFiles.size(), int( options.uThreadCount ), [&]( size_t i )
+		{
+			std::string outFile;
+			determine_output_filename( aFiles[ i ], options, outFile );
+
+			aFailed[ i ] = process_file( options, aFiles[ i ], outFile, aLogs[ i ], aStats[ i ] ) ? 0 : 1;
+
+			if ( options.bStats )
 			{
-				remapped_idx = find_nearest_palette_index( colour, aPalette, 0 );
+				aLogs[ i ] += stats_line( aStats[ i ] );
 			}
+		} );
 
-			output.Plot( x, y, remapped_idx );
+		for ( size_t i = 0; i < aFiles.size(); ++i )
+		{
+			restamp_fn( aFiles[ i ] );
+			std::cout << aLogs[ i ];
 		}
+
+		const size_t uFailed = size_t( std::count( aFailed.begin(), aFailed.end(), 1 ) );
+
+		std::cout << "Remapped " << aFiles.size() << ( aFiles.size() == 1 ? " changed file" : " changed files" ) << " in " << int64_t( elapsed_ms( start ) ) << "ms";
+		std::cout << ( uFailed ? ", " + std::to_string( uFailed ) + " failed.\n" : std::string( ".\n" ) );
+		std::cout.flush();
 	}
-}
 
-//==============================================================================
+	std::cout << "Error - the input folders can no longer be watched.\n";
+	return false;
+}
 
 //
-// determine_output_filename
+// bench_hash
 //
-// Figure out what we should call the output filename
+// FNV-1a of a stage's output, printed with its timing so that a change can be checked
+// against the results of an earlier build.
 //
-static void determine_output_filename( const std::string& inputFile, options_t& options, std::string& outFile )
+static uint64_t bench_hash( uint64_t hash, const uint8_t* pData, size_t size )
 {
-	// Use the single file output override?
-	if ( ( options.aInputFiles.size() == 1 ) && ( options.strOutFile.empty() == false ) )
+	for ( size_t i = 0; i < size; ++i )
 	{
-		outFile = options.strOutFile;
-		return;
+		hash = ( hash ^ pData[ i ] ) * 0x100000001b3ULL;
 	}
 
-	// split input file into path and file.
-	std::string outFolder;
-	size_t slash_find = inputFile.find_last_of( "/\\", inputFile.npos ); // either kind of path separators
-	if ( slash_find == inputFile.npos )
-	{
-		outFile = inputFile;
-	}
-	else
-	{
-		outFolder = inputFile.substr( 0, slash_find + 1 );
-		outFile = inputFile.substr( slash_find + 1 );
-	}
+	return hash;
+}
 
-	if ( options.strOutFolder.empty() == false )
-	{
-		outFolder = options.strOutFolder;
-	}
+static constexpr uint64_t kBenchHashSeed = 0xcbf29ce484222325ULL;
 
-	size_t dot_find = outFile.find_last_of( ".", outFile.npos ); // last dot
-	if ( dot_find != inputFile.npos )
-	{
-		outFile = outFile.substr( 0, dot_find );
-	}
+//
+// bench_stage
+//
+// Time one stage of the benchmark, which returns the hash of its output, and print a
+// result line.
+//
+template< typename FN >
+static void bench_stage( const char* szName, size_t uPixels, FN fn )
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-	if ( outFolder.empty() == false )
-	{
-		const char tail = outFolder[ outFolder.length() - 1 ];
+	const uint64_t hash = fn();
 
-		if ( tail != '\\' && tail != '//' )
-			outFolder += "\\";
-	}
+	const double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+	const double fMegaPixelsPerSec = ( ms > 0 ) ? ( double( uPixels ) / ( ms * 1000.0 ) ) : 0;
 
-	outFile = outFolder + outFile + ".png";
+	printf( "  %-16s %10.3f ms %9.2f Mpixel/s  %016llx\n", szName, ms, fMegaPixelsPerSec, static_cast<unsigned long long>( hash ) );
 }
 
 //
-// do_work
+// bench_image
 //
-// Palette generator.
+// Run every stage on one N channel image with a palette: each nearest colour search on
+// its own, the remap with no dither, error diffusion and ordered dither, packing rows,
+// and encoding the PNG (to a temporary file).
 //
-static void do_work( options_t& options )
+template < uint32_t N >
+static void bench_image( const options_t& options, const char* szName, const uint8_t* pPixels, uint32_t width, uint32_t height, const std::vector< color_t >& aPalette )
 {
-	std::cout << "Applying palette \"" << options.strPaletteFile << "\". It has " << options.aPalette.size() << " entries.\n";
+	const size_t uPixels = size_t( width ) * height;
 
-	if ( options.bOpaque == false )
-	{
-		std::cout << "Index " << int( (uint8_t)( options.transIndex ) ) << " will be transparent.\n";
-	}
+	options_t bench;
+	bench.aPalette.Set( aPalette );
+	bench.uThreadCount = options.uThreadCount;
 
-	std::cout << "\n";
+	std::string strLog;
+	const uint8_t uBPP = prepare_palette( bench, strLog );
 
-	if ( options.aInputFiles.size() > 1 )
-	{
-		std::cout << "Palettizing " << options.aInputFiles.size() << " files...\n";
-	}
+	// filled up front, so the searches only time the search.
+	bench.aPalette.Lookup( 0, bench.match ).FillAll();
 
-	// ... auto-create the output folder, if specified.
-	if ( options.strOutFolder.empty() == false )
+	printf( "%s, %u x %u, %u channels, palette %zu:\n", szName, width, height, N, aPalette.size() );
+
+	colormap_t image;
+	image.CreateView( const_cast< uint8_t* >( pPixels ), width, height, N );
+
+	std::vector< uint8_t > aIndices( uPixels );
+
+	bench_stage( "find", uPixels, [&]()
+				 {
+					 for ( size_t i = 0; i < uPixels; ++i )
+					 {
+						 aIndices[ i ] = find_nearest_palette_index( colormap_t::Pixel< N >( pPixels, i ), bench.aPalette.aColours, 0 );
+					 }
+					 return bench_hash( kBenchHashSeed, aIndices.data(), uPixels );
+				 } );
+
+	const search_t aSearches[] = { SEARCH_CUBE, SEARCH_TREE, SEARCH_SCAN };
+	const char* aSearchNames[] = { "search=cube", "search=tree", "search=scan" };
+
+	for ( int s = 0; s < 3; ++s )
 	{
-		make_path( options.strOutFolder );
+		bench.search = aSearches[ s ];
+
+		bench_stage( aSearchNames[ s ], uPixels, [&]()
+					 {
+						 for ( size_t i = 0; i < uPixels; ++i )
+						 {
+							 aIndices[ i ] = nearest_palette_index( bench, colormap_t::Pixel< N >( pPixels, i ), 0 );
+						 }
+						 return bench_hash( kBenchHashSeed, aIndices.data(), uPixels );
+					 } );
 	}
 
-	uint8_t uBPP;
+	bench.search = SEARCH_CUBE;
 
-	if ( options.aPalette.size() == 2 )
+	// the search the remap stages use for a palette this small.
+	if ( aPalette.size() <= 16 )
 	{
-		uBPP = 1;
+		with_palette_search( bench, 0, [&]( const auto& search )
+							 {
+								 bench_stage( "search=small", uPixels, [&]()
+											  {
+												  for ( size_t i = 0; i < uPixels; ++i )
+												  {
+													  aIndices[ i ] = search.Find( colormap_t::Pixel< N >( pPixels, i ) );
+												  }
+												  return bench_hash( kBenchHashSeed, aIndices.data(), uPixels );
+											  } );
+							 } );
 	}
-	else if ( options.aPalette.size() <= 4 )
+
+	// the remap, with its packed rows kept for the encode stages.
+	const size_t uStride = ( size_t( width ) * uBPP + 7 ) / 8;
+	std::vector< uint8_t > aPacked( uStride * height );
+
+	struct remap_stage_t
 	{
-		uBPP = 2;
-	}
-	else if ( options.aPalette.size() <= 16 )
+		const char* szName;
+		dither_mode_t dither;
+		bool bFixed;
+		bool bLinear;
+	};
+
+	const remap_stage_t aRemaps[] =
 	{
-		uBPP = 4;
-	}
-	else
+		{ "nearest", DITHER_NONE, false, false },
+		{ "fs", DITHER_FLOYD, false, false },
+		{ "fs-fixed", DITHER_FLOYD, true, false },
+		{ "fs-linear", DITHER_FLOYD, true, true },
+		{ "atkinson", DITHER_ATKINSON, false, false },
+		{ "bayer8", DITHER_BAYER8, false, false },
+	};
+
+	for ( const remap_stage_t& remap : aRemaps )
 	{
-		uBPP = 8;
+		bench.dither = remap.dither;
+		bench.bFixed = remap.bFixed;
+		bench.bLinear = remap.bLinear;
+		build_threshold_map( bench, 0 );
+
+		bench_stage( remap.szName, uPixels, [&]()
+					 {
+						 indexmap_t output;
+						 output.Create( width, height, uBPP, stream_row_count( width, height, bench ) );
+
+						 size_t y = 0;
+						 output._fnWriteRow = [&]( const uint8_t* pRow ) { memcpy( &aPacked[ uStride * y++ ], pRow, uStride ); };
+
+						 remap_image< N >( image, output, bench, bench.aPalette[ 0 ] );
+
+						 return bench_hash( kBenchHashSeed, aPacked.data(), aPacked.size() );
+					 } );
 	}
 
-	std::vector< color_t > png_palette;
-	for ( uint32_t i = 0; i < options.aPalette.size(); ++i )
+	// aIndices holds the last search's nearest indices.
+	bench_stage( "pack", uPixels, [&]()
+				 {
+					 indexmap_t output;
+					 output.Create( width, height, uBPP, height );
+
+					 for ( uint32_t y = 0; y < height; ++y )
+					 {
+						 output.StoreRow( y, &aIndices[ size_t( y ) * width ] );
+					 }
+
+					 const uint64_t hash = bench_hash( kBenchHashSeed, output._data_ptr, size_t( output._uStride ) * height );
+					 return hash;
+				 } );
+
+	// aPacked holds the bayer8 remap, a fair mix for deflate.
+	char szTempPath[ MAX_PATH ];
+	GetTempPathA( MAX_PATH, szTempPath );
+	const std::string strTempFile = std::string( szTempPath ) + "applypal_bench.png";
+
+	const encode_t aEncodes[] = { ENCODE_DEFAULT, ENCODE_FAST, ENCODE_PARALLEL };
+	const char* aEncodeNames[] = { "encode", "encode-fast", "encode-parallel" };
+
+	for ( int e = 0; e < 3; ++e )
 	{
-		png_palette.push_back( options.aPalette[ i ] );
+		bench_stage( aEncodeNames[ e ], uPixels, [&]()
+					 {
+						 std::string strWriteLog;
+						 {
+							 png_writer_t writer;
+							 if ( writer.Open( width, height, uBPP, bench.aPalette.aColours, 0, true, 0, aEncodes[ e ], image_thread_count( width, height, bench ), strTempFile, strWriteLog ) )
+							 {
+								 for ( uint32_t y = 0; y < height; ++y )
+								 {
+									 writer.WriteRow( &aPacked[ uStride * y ] );
+								 }
+								 writer.Close( strWriteLog );
+							 }
+						 }
+
+						 // the size of the file stands in for a hash; the bytes depend on the zlib build.
+						 return file_size( strTempFile );
+					 } );
 	}
-	while ( png_palette.size() < ( 1ULL << uBPP ) )
+
+	remove( strTempFile.c_str() );
+	putchar( '\n' );
+}
+
+//
+// bench_palette
+//
+// A palette of count pseudo random colours, the same on every run.
+//
+static std::vector< color_t > bench_palette( uint32_t count )
+{
+	std::vector< color_t > aPalette( count );
+
+	uint32_t seed = 0x12345678u ^ count;
+	for ( color_t& colour : aPalette )
 	{
-		png_palette.push_back( color_t( 0xFF00FF ) );
+		seed = seed * 1664525u + 1013904223u;
+		colour.value_abgr = ( seed >> 8 ) | 0xFF000000;
 	}
 
-	//
-	// -- Process Each File
+	return aPalette;
+}
 
-	for ( const std::string& inputFile : options.aInputFiles )
-	{
-		// load the image.
+//
+// do_benchmark
+//
+// Time each stage over synthetic images of a range of sizes, channel counts and palette
+// sizes, then over the input files (if any). Nothing is written.
+//
+static void do_benchmark( const options_t& options )
+{
+	print_hello();
 
-		int w, h, chan_count;
-		unsigned char* img_data;
+	printf( "Scan kernels: %s\n", cpu_level_name( cpu_level() ) );
+	printf( "Deflate: %s\n\n", deflate_backend_name( deflate_backend() ) );
 
-		std::cout << "Loading \"" << inputFile << "\" ... ";
+	const uint32_t aSizes[] = { 256, 1024 };
+	const uint32_t aPaletteSizes[] = { 2, 4, 16, 256 };
 
-		img_data = stbi_load( inputFile.c_str(), &w, &h, &chan_count, 0 );
+	for ( uint32_t size : aSizes )
+	{
+		// smooth gradients with a little noise, in RGB and RGBA.
+		std::vector< uint8_t > aRGB( size_t( size ) * size * 3 );
+		std::vector< uint8_t > aRGBA( size_t( size ) * size * 4 );
 
-		if ( img_data == nullptr )
+		uint32_t seed = 1;
+		for ( uint32_t y = 0; y < size; ++y )
 		{
-			std::cout << "FAILED\n";
-			continue;
+			for ( uint32_t x = 0; x < size; ++x )
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const int noise = int( seed >> 28 ) - 8;
+
+				const uint8_t r = uint8_t( std::clamp( int( x * 255 / size ) + noise, 0, 255 ) );
+				const uint8_t g = uint8_t( std::clamp( int( y * 255 / size ) + noise, 0, 255 ) );
+				const uint8_t b = uint8_t( std::clamp( int( ( x + y ) * 255 / ( size * 2 ) ) - noise, 0, 255 ) );
+
+				const size_t i = size_t( y ) * size + x;
+				aRGB[ i * 3 + 0 ] = r;
+				aRGB[ i * 3 + 1 ] = g;
+				aRGB[ i * 3 + 2 ] = b;
+				aRGBA[ i * 4 + 0 ] = r;
+				aRGBA[ i * 4 + 1 ] = g;
+				aRGBA[ i * 4 + 2 ] = b;
+				aRGBA[ i * 4 + 3 ] = 0xFF;
+			}
 		}
-		else if ( chan_count != 3 && chan_count != 4 )
+
+		for ( uint32_t palette_size : aPaletteSizes )
 		{
-			std::cout << "INVALID-CHANNELS (" << chan_count << ")\n";
-			stbi_image_free( img_data );
-			continue;
+			const std::vector< color_t > aPalette = bench_palette( palette_size );
+
+			bench_image< 3 >( options, "synthetic", aRGB.data(), size, size, aPalette );
+			bench_image< 4 >( options, "synthetic", aRGBA.data(), size, size, aPalette );
 		}
+	}
 
-		// Re-open input file - keep it open to prevent common user error of overwriting input!
-		std::ifstream fileInput( inputFile );
-		if ( fileInput.is_open() == false )
+	// real images, with -pal if there is one.
+	for ( const std::string& file_name : options.aInputFiles )
+	{
+		int w, h, chan_count;
+		unsigned char* data = stbi_load( file_name.c_str(), &w, &h, &chan_count, 0 );
+		if ( data == nullptr || ( chan_count != 3 && chan_count != 4 ) )
 		{
-			std::cout << "FAILED\n";
-			stbi_image_free( img_data );
+			printf( "Error - failed to load \"%s\".\n", file_name.c_str() );
+			stbi_image_free( data );
 			continue;
 		}
 
-		std::cout << "OK (" << w << " x " << h << ")\n";
-
-		// where do we write the output?
-		std::string outFile;
-		determine_output_filename( inputFile, options, outFile );
-
-		colormap_t image;
-		image.Create( w, h );
-
-		if ( options.bLuminance )
+		for ( uint32_t palette_size : aPaletteSizes )
 		{
+			const std::vector< color_t > aPalette = options.aPalette.empty() ? bench_palette( palette_size ) : options.aPalette.aColours;
+
 			if ( chan_count == 3 )
 			{
-				image.CopyFromLUM( img_data );
-			}
-			else if ( chan_count == 4 )
-			{
-				image.CopyFromLUMalpha( img_data );
+				bench_image< 3 >( options, file_name.c_str(), data, w, h, aPalette );
 			}
-		}
-		else
-		{
-			if ( chan_count == 3 )
+			else
 			{
-				image.CopyFromRGB( img_data );
+				bench_image< 4 >( options, file_name.c_str(), data, w, h, aPalette );
 			}
-			else if ( chan_count == 4 )
+
+			if ( options.aPalette.empty() == false )
 			{
-				image.CopyFromRGBA( img_data );
+				break;
 			}
 		}
 
-		indexmap_t output;
-		output.Create( w, h, uBPP );
-
-		const color_t pal_idx0 = options.aPalette[ 0 ];
-
-		if ( options.bDither )
-		{
-			remap_image_dither( image, output, options, pal_idx0 );
-		}
-		else
-		{
-			remap_image_nearest( image, output, options, pal_idx0 );
-		}
-
-		// write image!
-		write_png( output, options.aPalette, options.indexOffset, options.bOpaque, options.transIndex, outFile );
-
-		// tidy up
-		delete[] image._data_ptr;
-		delete[] output._data_ptr;
-		stbi_image_free( img_data );
-		fileInput.close();
+		stbi_image_free( data );
 	}
 }
 
@@ -1196,9 +6799,29 @@ int main( int argc, char** argv )
 
 	if ( process_args( argc, argv, options ) )
 	{
+		if ( options.bServe )
+		{
+			run_server( options );
+			return 0;
+		}
+
+		if ( options.bBenchmark )
+		{
+			do_benchmark( options );
+			return 0;
+		}
+
 		print_hello();
 
-		do_work( options );
+		if ( options.bWatch )
+		{
+			return run_watch( options ) ? 0 : 1;
+		}
+
+		if ( do_work( options ) == false )
+		{
+			return 1;
+		}
 	}
 	else
 	{
@@ -0,0 +1,846 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2024-2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+
+#include "fogcore.h"
+#include "paltask.h"
+#include "palcpu.h"
+#include "paltrace.h" // TRACE_ZONE, compiled out unless FRAGMENTS_TRACE or TRACY_ENABLE
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#include <emmintrin.h> // SSE2
+#endif
+
+//=============================================================================
+
+struct color_t
+{
+	union
+	{
+		uint32_t value_abgr;
+		uint8_t chan[ 4 ]; // R, G, B, A
+	};
+};
+
+static double F( double input ) // function f(...), which is used for defining L, a and b changes within [4/29,1]
+{
+	if ( input > 0.008856 )
+	{
+		return ( pow( input, 0.333333333 ) ); // maximum 1
+	}
+	else
+	{
+		return ( ( 841 / 108 ) * input + 4 / 29 );  //841/108 = 29*29/36*16
+	}
+}
+
+static void XYZtoLab( double X, double Y, double Z, double* L, double* a, double* b )
+{
+	const double Xo = 244.66128; // reference white
+	const double Yo = 255.0;
+	const double Zo = 277.63227;
+	*L = 116 * F( Y / Yo ) - 16; // maximum L = 100
+	*a = 500 * ( F( X / Xo ) - F( Y / Yo ) ); // maximum
+	*b = 200 * ( F( Y / Yo ) - F( Z / Zo ) );
+}
+
+//
+// srgb_to_linear
+//
+// The sRGB gamma curve for each 8-bit channel value, worked out once.
+//
+struct srgb_table_t
+{
+	double aLinear[ 256 ];
+
+	srgb_table_t()
+	{
+		for ( int i = 0; i < 256; ++i )
+		{
+			const double v = i / 255.0;
+			aLinear[ i ] = ( v > 0.04045 ) ? pow( ( v + 0.055 ) / 1.055, 2.4 ) : v / 12.92;
+		}
+	}
+};
+
+static double srgb_to_linear( int value )
+{
+	static const srgb_table_t table;
+	return table.aLinear[ value ];
+}
+
+static void RGBtoXYZ( int R, int G, int B, double* X, double* Y, double* Z )
+{
+	double var_R = srgb_to_linear( R );
+	double var_G = srgb_to_linear( G );
+	double var_B = srgb_to_linear( B );
+
+	var_R *= 100;
+	var_G *= 100;
+	var_B *= 100;
+
+	*X = var_R * 0.4124 + var_G * 0.3576 + var_B * 0.1805;
+	*Y = var_R * 0.2126 + var_G * 0.7152 + var_B * 0.0722;
+	*Z = var_R * 0.0193 + var_G * 0.1192 + var_B * 0.9505;
+}
+
+static void rgb2lab( int R, int G, int B, double* Lab )
+{
+	double X, Y, Z;
+	RGBtoXYZ( R, G, B, &X, &Y, &Z );
+	XYZtoLab( X, Y, Z, &Lab[ 0 ], &Lab[ 1 ], &Lab[ 2 ] );
+}
+
+//
+// rgb2oklab
+//
+// Oklab (Bjorn Ottosson) from sRGB, via linear light and the cube roots of the cone
+// responses. Euclidean distance here follows perceived difference far better than in rgb.
+//
+static void rgb2oklab( int R, int G, int B, double* Lab )
+{
+	const double r = srgb_to_linear( R );
+	const double g = srgb_to_linear( G );
+	const double b = srgb_to_linear( B );
+
+	const double l = cbrt( 0.4122214708 * r + 0.5363325363 * g + 0.0514459929 * b );
+	const double m = cbrt( 0.2119034982 * r + 0.6806995451 * g + 0.1073969566 * b );
+	const double s = cbrt( 0.0883024619 * r + 0.2817188376 * g + 0.6299787005 * b );
+
+	Lab[ 0 ] = 0.2104542553 * l + 0.7936177850 * m - 0.0040720468 * s;
+	Lab[ 1 ] = 1.9779984951 * l - 2.4285922050 * m + 0.4505937099 * s;
+	Lab[ 2 ] = 0.0259040371 * l + 0.7827717662 * m - 0.8086757660 * s;
+}
+
+//
+// nearest_tree_t::Create
+//
+// Order the palette entries into the tree, in the colour space of eMetric.
+//
+void nearest_tree_t::Create( const uint32_t* pPalette, const size_t baseSize, remap_metric_t eMetric )
+{
+	metric = eMetric;
+
+	aPoints.resize( baseSize );
+	aOrder.resize( baseSize );
+
+	for ( size_t i = 0; i < baseSize; ++i )
+	{
+		Point( pPalette[ i ], aPoints[ i ].v );
+		aOrder[ i ] = uint32_t( i );
+	}
+
+	aNodes.clear();
+	Build( 0, uint32_t( baseSize ) );
+}
+
+//
+// nearest_tree_t::Find
+//
+// The index of the closest entry to colour.
+//
+size_t nearest_tree_t::Find( const uint32_t colour ) const
+{
+	double q[ 3 ];
+	Point( colour, q );
+
+	double best_score = std::numeric_limits< double >::infinity();
+	size_t best_index = 0;
+	Search( 0, q, best_score, best_index );
+
+	return best_index;
+}
+
+//
+// nearest_tree_t::Point
+//
+// A colour as a point in the tree's colour space.
+//
+void nearest_tree_t::Point( const uint32_t colour, double* v ) const
+{
+	if ( metric == REMAP_OKLAB )
+	{
+		rgb2oklab( ( colour >> 16 ) & 0xFF, ( colour >> 8 ) & 0xFF, colour & 0xFF, v );
+		return;
+	}
+
+	const color_t* c = (const color_t*)&colour;
+
+	rgb2lab( c->chan[ 0 ], c->chan[ 1 ], c->chan[ 2 ], v );
+}
+
+//
+// nearest_tree_t::Build
+//
+// The node for aOrder[ lo, hi ), and below it. Returns its index.
+//
+uint32_t nearest_tree_t::Build( uint32_t lo, uint32_t hi )
+{
+	const uint32_t index = uint32_t( aNodes.size() );
+	aNodes.push_back( { lo, hi, -1, 0.0, 0, 0 } );
+
+	if ( hi - lo <= kLeafSize )
+	{
+		return index;
+	}
+
+	// the axis of the widest spread.
+	double lo_v[ 3 ], hi_v[ 3 ];
+	for ( int a = 0; a < 3; ++a )
+	{
+		lo_v[ a ] = hi_v[ a ] = aPoints[ aOrder[ lo ] ].v[ a ];
+	}
+	for ( uint32_t k = lo + 1; k < hi; ++k )
+	{
+		for ( int a = 0; a < 3; ++a )
+		{
+			lo_v[ a ] = std::min( lo_v[ a ], aPoints[ aOrder[ k ] ].v[ a ] );
+			hi_v[ a ] = std::max( hi_v[ a ], aPoints[ aOrder[ k ] ].v[ a ] );
+		}
+	}
+
+	int axis = 0;
+	for ( int a = 1; a < 3; ++a )
+	{
+		if ( hi_v[ a ] - lo_v[ a ] > hi_v[ axis ] - lo_v[ axis ] )
+		{
+			axis = a;
+		}
+	}
+
+	// left of mid are at or below the split, mid and right at or above it.
+	const uint32_t mid = ( lo + hi ) / 2;
+	std::nth_element( aOrder.begin() + lo, aOrder.begin() + mid, aOrder.begin() + hi,
+					  [&]( uint32_t a, uint32_t b ) { return aPoints[ a ].v[ axis ] < aPoints[ b ].v[ axis ]; } );
+
+	const double split = aPoints[ aOrder[ mid ] ].v[ axis ];
+	const uint32_t left = Build( lo, mid );
+	const uint32_t right = Build( mid, hi );
+
+	node_t& node = aNodes[ index ];
+	node.axis = axis;
+	node.split = split;
+	node.left = left;
+	node.right = right;
+
+	return index;
+}
+
+//
+// nearest_tree_t::Search
+//
+// Improve on best_index with any entry of node n that is as close to q.
+//
+void nearest_tree_t::Search( uint32_t n, const double* q, double& best_score, size_t& best_index ) const
+{
+	const node_t& node = aNodes[ n ];
+
+	if ( node.axis < 0 )
+	{
+		for ( uint32_t k = node.lo; k < node.hi; ++k )
+		{
+			const uint32_t i = aOrder[ k ];
+			const double* p = aPoints[ i ].v;
+
+			// the same sum, in the same order, as a scan.
+			double x;
+			double score;
+
+			x = q[ 0 ] - p[ 0 ];
+			score = x * x;
+
+			x = q[ 1 ] - p[ 1 ];
+			score += x * x;
+
+			x = q[ 2 ] - p[ 2 ];
+			score += x * x;
+
+			if ( score < best_score || ( score == best_score && i > best_index ) )
+			{
+				best_score = score;
+				best_index = i;
+			}
+		}
+		return;
+	}
+
+	const double diff = q[ node.axis ] - node.split;
+	Search( ( diff < 0 ) ? node.left : node.right, q, best_score, best_index );
+
+	// the far side, unless all of it is further than the best (ties must be seen).
+	if ( diff * diff <= best_score )
+	{
+		Search( ( diff < 0 ) ? node.right : node.left, q, best_score, best_index );
+	}
+}
+
+//
+// cube_channels
+//
+// A colour's channels, as the cube's axes.
+//
+static void cube_channels( const uint32_t colour, int* v )
+{
+	v[ 0 ] = int( ( colour >> 16 ) & 0xFF );
+	v[ 1 ] = int( ( colour >> 8 ) & 0xFF );
+	v[ 2 ] = int( colour & 0xFF );
+}
+
+//
+// cube_distance
+//
+// Squared rgb distance, as integers.
+//
+static int cube_distance( const int* q, const uint32_t colour )
+{
+	int v[ 3 ];
+	cube_channels( colour, v );
+
+	const int x = q[ 0 ] - v[ 0 ];
+	const int y = q[ 1 ] - v[ 1 ];
+	const int z = q[ 2 ] - v[ 2 ];
+
+	return x * x + y * y + z * z;
+}
+
+//
+// nearest_cube_t::Create
+//
+// List the candidates of every cell.
+//
+void nearest_cube_t::Create( const uint32_t* pPalette, const size_t baseSize )
+{
+	aColours.assign( pPalette, pPalette + baseSize );
+
+	aOffsets.resize( kCells + 1 );
+	aCandidates.clear();
+
+	std::vector< int > aMinDist( baseSize, 0 );
+
+	for ( uint32_t cell = 0; cell < kCells; ++cell )
+	{
+		aOffsets[ cell ] = uint32_t( aCandidates.size() );
+
+		int lo[ 3 ];
+		lo[ 0 ] = int( ( cell >> ( kCellBits * 2 ) ) & ( ( 1 << kCellBits ) - 1 ) ) * kCellSize;
+		lo[ 1 ] = int( ( cell >> kCellBits ) & ( ( 1 << kCellBits ) - 1 ) ) * kCellSize;
+		lo[ 2 ] = int( cell & ( ( 1 << kCellBits ) - 1 ) ) * kCellSize;
+
+		int best_max_dist = std::numeric_limits< int >::max();
+
+		for ( size_t i = 0; i < baseSize; ++i )
+		{
+			int v[ 3 ];
+			cube_channels( aColours[ i ], v );
+
+			int min_dist = 0;
+			int max_dist = 0;
+
+			for ( int c = 0; c < 3; ++c )
+			{
+				const int hi = lo[ c ] + kCellSize - 1;
+
+				// distance to the nearest and furthest edge of the cell on this axis.
+				const int near_d = ( v[ c ] < lo[ c ] ) ? ( lo[ c ] - v[ c ] ) : ( v[ c ] > hi ) ? ( v[ c ] - hi ) : 0;
+				const int far_d = std::max( std::abs( v[ c ] - lo[ c ] ), std::abs( v[ c ] - hi ) );
+
+				min_dist += near_d * near_d;
+				max_dist += far_d * far_d;
+			}
+
+			aMinDist[ i ] = min_dist;
+			best_max_dist = std::min( best_max_dist, max_dist );
+		}
+
+		for ( size_t i = 0; i < baseSize; ++i )
+		{
+			if ( aMinDist[ i ] <= best_max_dist )
+			{
+				aCandidates.push_back( uint32_t( i ) );
+			}
+		}
+	}
+
+	aOffsets[ kCells ] = uint32_t( aCandidates.size() );
+}
+
+//
+// nearest_cube_t::Find
+//
+// The index of the closest entry to colour.
+//
+size_t nearest_cube_t::Find( const uint32_t colour ) const
+{
+	int q[ 3 ];
+	cube_channels( colour, q );
+
+	const uint32_t cell = ( uint32_t( q[ 0 ] >> ( 8 - kCellBits ) ) << ( kCellBits * 2 ) )
+						| ( uint32_t( q[ 1 ] >> ( 8 - kCellBits ) ) << kCellBits )
+						| ( uint32_t( q[ 2 ] >> ( 8 - kCellBits ) ) );
+
+	const uint32_t* pFirst = aCandidates.data() + aOffsets[ cell ];
+	const uint32_t* pLast = aCandidates.data() + aOffsets[ cell + 1 ];
+
+	uint32_t best_index = pFirst[ 0 ];
+	int best_score = cube_distance( q, aColours[ best_index ] );
+
+	for ( const uint32_t* p = pFirst + 1; p < pLast; ++p )
+	{
+		const int score = cube_distance( q, aColours[ *p ] );
+
+		if ( score <= best_score )
+		{
+			best_score = score;
+			best_index = *p;
+		}
+	}
+
+	return best_index;
+}
+
+//
+// nearest_search_t::Create
+//
+// The cube for rgb, or the tree for the other metrics.
+//
+void nearest_search_t::Create( const uint32_t* pPalette, const size_t baseSize, remap_metric_t eMetric )
+{
+	metric = eMetric;
+
+	if ( metric == REMAP_RGB )
+	{
+		cube.Create( pPalette, baseSize );
+	}
+	else
+	{
+		tree.Create( pPalette, baseSize, metric );
+	}
+}
+
+//
+// fog_palette_t::Create
+//
+void fog_palette_t::Create( const uint32_t* pPalette, size_t count )
+{
+	pColours = pPalette;
+	uCount = count;
+
+	for ( nearest_search_t& search : aSearch )
+	{
+		search = nearest_search_t();
+	}
+}
+
+//
+// fog_palette_t::AddRemap
+//
+void fog_palette_t::AddRemap( remap_metric_t metric )
+{
+	if ( aSearch[ metric ].Empty() )
+	{
+		aSearch[ metric ].Create( pColours, uCount, metric );
+	}
+}
+
+//
+// fog_levels
+//
+size_t fog_levels( const fog_settings_t& settings )
+{
+	return 1 + settings.aRamps.size() * size_t( settings.iSteps - 1 );
+}
+
+//
+// ramp_amount
+//
+// How far toward its colour a ramp is at a step from 1 to steps - 1.
+//
+static float ramp_amount( const ramp_t& ramp, int iStep, const fog_settings_t& settings )
+{
+	float fScale;
+	if ( settings.bLastStepEqualsFog )
+	{
+		fScale = 1.0f / static_cast<float>( settings.iSteps - 1 );
+	}
+	else
+	{
+		fScale = 1.0f / static_cast<float>( settings.iSteps );
+	}
+
+	const float fLinear = static_cast<float>( iStep ) * fScale;
+
+	switch ( ramp.curve )
+	{
+	case CURVE_EXP:
+		{
+			const double k = 3.0;
+			return static_cast<float>( ( 1.0 - exp( -k * fLinear ) ) / ( 1.0 - exp( -k ) ) );
+		}
+
+	case CURVE_LUT:
+		return ramp.aAmounts[ iStep - 1 ];
+
+	default:
+		return fLinear;
+	}
+}
+
+//
+// ramp_weight
+//
+// ramp_amount in 8.8 fixed point, 0 to 256. The linear curve is worked out in integers so
+// that, with the integer blend, a fog table is the same on every compiler and platform.
+//
+static int ramp_weight( const ramp_t& ramp, int iStep, const fog_settings_t& settings )
+{
+	if ( ramp.curve == CURVE_LINEAR )
+	{
+		const int iDivisor = settings.bLastStepEqualsFog ? ( settings.iSteps - 1 ) : settings.iSteps;
+		return ( iStep * 512 + iDivisor ) / ( iDivisor * 2 );
+	}
+
+	const int iWeight = static_cast<int>( ramp_amount( ramp, iStep, settings ) * 256.0f + 0.5f );
+	return std::min( std::max( iWeight, 0 ), 256 );
+}
+
+//
+// fog_weights_t
+//
+// A level's blend as a multiply and add per channel, in the byte order of a 0x00RRGGBB
+// entry in memory (b, g, r, then the unused top byte): each channel becomes
+// ( source * aMul + aAdd ) >> 8, which is at most 255 * 256, so it fits 16 bits.
+//
+struct fog_weights_t
+{
+	uint16_t aMul[ 4 ];
+	uint16_t aAdd[ 4 ];
+};
+
+//
+// level_ramp, level_weights
+//
+// The ramp a level from 1 on belongs to, and the blend toward its colour: fog is
+// source * ( 256 - w ) + colour * w, light scales the source by ( 256 - w ) + w * colour / 255
+// (rounded, so a light of ffffff is no change).
+//
+static const ramp_t& level_ramp( size_t level, const fog_settings_t& settings )
+{
+	return settings.aRamps[ ( level - 1 ) / ( settings.iSteps - 1 ) ];
+}
+
+static fog_weights_t level_weights( size_t level, const fog_settings_t& settings )
+{
+	const ramp_t& ramp = level_ramp( level, settings );
+	const int iStep = int( ( level - 1 ) % ( settings.iSteps - 1 ) ) + 1;
+	const int w = ramp_weight( ramp, iStep, settings );
+
+	fog_weights_t weights = {};
+	for ( int c = 0; c < 3; ++c )
+	{
+		const int target = int( ( ramp.colour >> ( c * 8 ) ) & 0xFF );
+
+		if ( ramp.mode == RAMP_LIGHT )
+		{
+			weights.aMul[ c ] = uint16_t( ( ( 256 - w ) * 255 + w * target + 127 ) / 255 );
+		}
+		else
+		{
+			weights.aMul[ c ] = uint16_t( 256 - w );
+			weights.aAdd[ c ] = uint16_t( target * w );
+		}
+	}
+
+	return weights;
+}
+
+//
+// fog_colour
+//
+// A colour fogged by a level's weights.
+//
+static uint32_t fog_colour( const fog_weights_t& weights, const uint32_t rawColour )
+{
+	uint32_t rampOutput = 0;
+	for ( int c = 0; c < 3; ++c )
+	{
+		const uint32_t source = ( rawColour >> ( c * 8 ) ) & 0xFF;
+		rampOutput |= ( ( source * weights.aMul[ c ] + weights.aAdd[ c ] ) >> 8 ) << ( c * 8 );
+	}
+
+	return rampOutput;
+}
+
+//
+// fog_blend
+//
+// fog_colour for count colours (pOutput may be pInput). The SIMD kernels widen each
+// colour's bytes to 16 bits for one multiply and add of all its channels, four colours
+// at a time with SSE2 and eight with AVX2; fog_blend runs the one for cpu_level().
+//
+static void fog_blend_scalar( const fog_weights_t& weights, const uint32_t* pInput, size_t count, uint32_t* pOutput )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		pOutput[ i ] = fog_colour( weights, pInput[ i ] );
+	}
+}
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+static void fog_blend_sse2( const fog_weights_t& weights, const uint32_t* pInput, size_t count, uint32_t* pOutput )
+{
+	size_t i = 0;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mul = _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)weights.aMul ), _mm_loadl_epi64( (const __m128i*)weights.aMul ) );
+	const __m128i add = _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)weights.aAdd ), _mm_loadl_epi64( (const __m128i*)weights.aAdd ) );
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const __m128i colours = _mm_loadu_si128( (const __m128i*)( pInput + i ) );
+
+		__m128i lo = _mm_unpacklo_epi8( colours, zero );
+		__m128i hi = _mm_unpackhi_epi8( colours, zero );
+
+		lo = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( lo, mul ), add ), 8 );
+		hi = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( hi, mul ), add ), 8 );
+
+		_mm_storeu_si128( (__m128i*)( pOutput + i ), _mm_packus_epi16( lo, hi ) );
+	}
+
+	fog_blend_scalar( weights, pInput + i, count - i, pOutput + i );
+}
+#endif
+
+#if CPU_X86
+// the unpacks and pack work within each 128-bit half, so the colours stay in order.
+CPU_TARGET_AVX2 static void fog_blend_avx2( const fog_weights_t& weights, const uint32_t* pInput, size_t count, uint32_t* pOutput )
+{
+	size_t i = 0;
+
+	long long mul4, add4;
+	memcpy( &mul4, weights.aMul, sizeof( mul4 ) );
+	memcpy( &add4, weights.aAdd, sizeof( add4 ) );
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i mul = _mm256_set1_epi64x( mul4 );
+	const __m256i add = _mm256_set1_epi64x( add4 );
+
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		const __m256i colours = _mm256_loadu_si256( (const __m256i*)( pInput + i ) );
+
+		__m256i lo = _mm256_unpacklo_epi8( colours, zero );
+		__m256i hi = _mm256_unpackhi_epi8( colours, zero );
+
+		lo = _mm256_srli_epi16( _mm256_add_epi16( _mm256_mullo_epi16( lo, mul ), add ), 8 );
+		hi = _mm256_srli_epi16( _mm256_add_epi16( _mm256_mullo_epi16( hi, mul ), add ), 8 );
+
+		_mm256_storeu_si256( (__m256i*)( pOutput + i ), _mm256_packus_epi16( lo, hi ) );
+	}
+
+	fog_blend_sse2( weights, pInput + i, count - i, pOutput + i );
+}
+#endif
+
+typedef void ( *fog_blend_fn )( const fog_weights_t& weights, const uint32_t* pInput, size_t count, uint32_t* pOutput );
+
+static fog_blend_fn bind_fog_blend( cpu_level_t level )
+{
+#if CPU_X86
+	if ( level >= CPU_AVX2 && level != CPU_NEON )
+	{
+		return fog_blend_avx2;
+	}
+#endif
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	if ( level >= CPU_SSE2 && level != CPU_NEON )
+	{
+		return fog_blend_sse2;
+	}
+#endif
+
+	( void )level;
+	return fog_blend_scalar;
+}
+
+static void fog_blend( const fog_weights_t& weights, const uint32_t* pInput, size_t count, uint32_t* pOutput )
+{
+	static const fog_blend_fn pfnBlend = bind_fog_blend( cpu_level() );
+	pfnBlend( weights, pInput, count, pOutput );
+}
+
+//
+// fog_generate
+//
+// Generate additional palette entries for each ramp, in equally spaced steps. Each level
+// is a slice of its own in the output, so each thread takes the next level not yet
+// started.
+//
+bool fog_generate( const fog_palette_t& palette, const fog_settings_t& settings, uint32_t* pOutput, size_t* pIndices, int threads )
+{
+	TRACE_ZONE( "fog_generate" );
+
+	const nearest_search_t* pSearch = nullptr;
+	if ( settings.bRemap )
+	{
+		pSearch = &palette.aSearch[ settings.remapMetric ];
+		if ( pSearch->Empty() )
+		{
+			return false;
+		}
+	}
+
+	// cache the base size of the raw palette (fog step 0)
+	const size_t baseSize = palette.uCount;
+	const size_t levels = fog_levels( settings );
+	const uint32_t* pBase = palette.pColours;
+
+	// level 0 is the base palette itself.
+	for ( size_t i = 0; i < baseSize; ++i )
+	{
+		pOutput[ i ] = pBase[ i ];
+	}
+
+	if ( pSearch && pIndices )
+	{
+		for ( size_t i = 0; i < baseSize; ++i )
+		{
+			pIndices[ i ] = i;
+		}
+	}
+
+	auto level_fn = [&]( size_t level, nearest_memo_t& memo )
+	{
+		uint32_t* pLevel = pOutput + level * baseSize;
+		size_t* pLevelIndices = pIndices ? pIndices + level * baseSize : nullptr;
+
+		// the whole level blended into its slice ...
+		fog_blend( level_weights( level, settings ), pBase, baseSize, pLevel );
+
+		// ... then remapped?
+		if ( pSearch )
+		{
+			for ( size_t i = 0; i < baseSize; ++i )
+			{
+				const size_t index = memo.Find( *pSearch, pLevel[ i ] );
+
+				if ( pLevelIndices )
+				{
+					pLevelIndices[ i ] = index;
+				}
+				pLevel[ i ] = pBase[ index ];
+			}
+		}
+	};
+
+	parallel_for_state< nearest_memo_t >( 1, levels, threads, level_fn );
+	return true;
+}
+
+//
+// fog_lut
+//
+// Each level as an rgb lattice: the lattice colours are fogged as the palette entries are
+// in fog_generate, then remapped. A level's slices of equal blue are the units of work, so
+// even a table of few levels keeps every thread busy.
+//
+bool fog_lut( const fog_palette_t& palette, const fog_settings_t& settings, uint32_t uSize, uint32_t* pOutput, int threads )
+{
+	TRACE_ZONE( "fog_lut" );
+
+	const nearest_search_t* pSearch = nullptr;
+	if ( settings.bRemap )
+	{
+		pSearch = &palette.aSearch[ settings.remapMetric ];
+		if ( pSearch->Empty() )
+		{
+			return false;
+		}
+	}
+
+	if ( uSize < 2 || uSize > 256 )
+	{
+		return false;
+	}
+
+	const uint32_t* pBase = palette.pColours;
+	const size_t levels = fog_levels( settings );
+	const size_t slice = size_t( uSize ) * uSize;
+
+	// the channel value at each lattice point, 0 to 255 evenly.
+	uint32_t aValue[ 256 ];
+	for ( uint32_t k = 0; k < uSize; ++k )
+	{
+		aValue[ k ] = ( k * 255 + ( uSize - 1 ) / 2 ) / ( uSize - 1 );
+	}
+
+	auto slice_fn = [&]( size_t unit, nearest_memo_t& memo )
+	{
+		const size_t level = unit / uSize;
+		const uint32_t b = aValue[ unit % uSize ];
+
+		const fog_weights_t weights = ( level > 0 ) ? level_weights( level, settings ) : fog_weights_t();
+
+		for ( uint32_t g = 0; g < uSize; ++g )
+		{
+			uint32_t* pRow = pOutput + unit * slice + g * uSize;
+
+			for ( uint32_t r = 0; r < uSize; ++r )
+			{
+				pRow[ r ] = ( aValue[ r ] << 16 ) | ( aValue[ g ] << 8 ) | b;
+			}
+
+			// level 0 is no fog, only the remap.
+			if ( level > 0 )
+			{
+				fog_blend( weights, pRow, uSize, pRow );
+			}
+
+			if ( pSearch )
+			{
+				for ( uint32_t r = 0; r < uSize; ++r )
+				{
+					pRow[ r ] = pBase[ memo.Find( *pSearch, pRow[ r ] ) ];
+				}
+			}
+		}
+	};
+
+	parallel_for_state< nearest_memo_t >( 0, levels * uSize, threads, slice_fn );
+	return true;
+}
+
+//=============================================================================
@@ -0,0 +1,302 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2024-2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// fogcore.h
+//
+// The fog table generator behind fogpal, for programs that want the tables in memory:
+// prepare a base palette once with fog_palette_t, then fog_generate fills caller owned
+// buffers with every level, as often as the settings change.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+
+typedef enum
+{
+	RAMP_FOG, // blend toward the colour
+	RAMP_LIGHT, // multiply by the colour
+}
+ramp_mode_t;
+
+typedef enum
+{
+	CURVE_LINEAR,
+	CURVE_EXP, // most of the change in the first steps
+	CURVE_LUT, // amounts from a file
+}
+curve_t;
+
+typedef enum
+{
+	REMAP_RGB, // -remap
+	REMAP_LAB, // -remap-lab
+	REMAP_OKLAB, // -remap-oklab
+	REMAP_COUNT,
+}
+remap_metric_t;
+
+//
+// ramp_t
+//
+// One ramp of steps from the base palette toward a colour. Step 0 is always the base
+// palette, so a ramp adds steps - 1 levels.
+//
+struct ramp_t
+{
+	ramp_mode_t mode = RAMP_FOG;
+	uint32_t colour = 0; // 0xRRGGBB
+	curve_t curve = CURVE_LINEAR;
+	std::vector< float > aAmounts; // CURVE_LUT: for steps 1 on.
+};
+
+//
+// fog_settings_t
+//
+// What to generate: the ramps, each of iSteps, and whether to remap every generated
+// colour back to the nearest base palette entry.
+//
+struct fog_settings_t
+{
+	int iSteps = 8;
+	std::vector< ramp_t > aRamps;
+
+	bool bLastStepEqualsFog = false; // the last step of each ramp is its full amount.
+	bool bRemap = false;
+	remap_metric_t remapMetric = REMAP_RGB;
+};
+
+//
+// nearest_tree_t
+//
+// A k-d tree of the base palette in Lab or Oklab, for -remap-lab and -remap-oklab, built
+// once and shared (read only) by every ramp, step and thread. Find returns what a scan of
+// every entry would: the closest, and of any that tie the last. Each node splits its
+// entries at the median of the axis they spread most along; leaves of up to kLeafSize
+// entries are scanned.
+//
+struct nearest_tree_t
+{
+	static const uint32_t kLeafSize = 8;
+
+	struct point_t
+	{
+		double v[ 3 ];
+	};
+
+	struct node_t
+	{
+		uint32_t lo, hi; // aOrder[ lo, hi ) are in this node.
+		int axis; // -1 for a leaf.
+		double split;
+		uint32_t left, right;
+	};
+
+	remap_metric_t metric = REMAP_LAB;
+	std::vector< point_t > aPoints; // by palette index.
+	std::vector< uint32_t > aOrder;
+	std::vector< node_t > aNodes;
+
+	void Create( const uint32_t* pPalette, const size_t baseSize, remap_metric_t eMetric );
+
+	bool Empty() const
+	{
+		return aNodes.empty();
+	}
+
+	// the index of the closest entry to colour.
+	size_t Find( const uint32_t colour ) const;
+
+private:
+
+	void Point( const uint32_t colour, double* v ) const;
+
+	uint32_t Build( uint32_t lo, uint32_t hi );
+
+	void Search( uint32_t n, const double* q, double& best_score, size_t& best_index ) const;
+};
+
+//
+// nearest_cube_t
+//
+// Nearest base palette index in rgb, for -remap, via a 32x32x32 cube (as applypal's palette
+// lookup). Each cell lists the entries that can be nearest to some colour inside it (any
+// entry whose closest point is no further than the best entry's furthest point), so Find
+// only scans those, with integer distances. Every cell is filled by Create, so the cube
+// is read only after and shared by every ramp, step and thread. Results match a scan of
+// every entry, including ties going to the last index.
+//
+struct nearest_cube_t
+{
+	static const int kCellBits = 5;
+	static const int kCellSize = 1 << ( 8 - kCellBits );
+	static const uint32_t kCells = 1u << ( kCellBits * 3 );
+
+	std::vector< uint32_t > aColours; // the base palette.
+	std::vector< uint32_t > aOffsets; // cell's candidates are [ aOffsets[ cell ], aOffsets[ cell + 1 ] )
+	std::vector< uint32_t > aCandidates;
+
+	void Create( const uint32_t* pPalette, const size_t baseSize );
+
+	bool Empty() const
+	{
+		return aOffsets.empty();
+	}
+
+	// the index of the closest entry to colour.
+	size_t Find( const uint32_t colour ) const;
+};
+
+//
+// nearest_search_t
+//
+// The -remap search of a base palette: the cube in rgb, or the tree in Lab or Oklab.
+// Memoise is true when a lookup costs more than a look in a small cache of the colours
+// already found (the tree converts every colour it is asked for).
+//
+struct nearest_search_t
+{
+	remap_metric_t metric = REMAP_RGB;
+	nearest_cube_t cube;
+	nearest_tree_t tree;
+
+	void Create( const uint32_t* pPalette, const size_t baseSize, remap_metric_t eMetric );
+
+	bool Empty() const
+	{
+		return ( metric == REMAP_RGB ) ? cube.Empty() : tree.Empty();
+	}
+
+	bool Memoise() const
+	{
+		return metric != REMAP_RGB;
+	}
+
+	size_t Find( const uint32_t colour ) const
+	{
+		return ( metric == REMAP_RGB ) ? cube.Find( colour ) : tree.Find( colour );
+	}
+};
+
+//
+// nearest_memo_t
+//
+// The nearest index of colours already searched for, in a small direct mapped cache, for
+// the searches that Memoise (fogged and photographed colours repeat a lot). Others are
+// looked up as they are. One per thread, on its stack.
+//
+struct nearest_memo_t
+{
+	static const int kBits = 12;
+
+	uint32_t aColour[ 1 << kBits ];
+	uint32_t aIndex[ 1 << kBits ];
+
+	nearest_memo_t()
+	{
+		// no colour is ever 0xFFFFFFFF, so every slot starts empty.
+		memset( aColour, 0xFF, sizeof( aColour ) );
+	}
+
+	size_t Find( const nearest_search_t& search, const uint32_t colour )
+	{
+		if ( search.Memoise() == false )
+		{
+			return search.Find( colour );
+		}
+
+		const uint32_t slot = ( colour * 2654435761u ) >> ( 32 - kBits );
+
+		if ( aColour[ slot ] != colour )
+		{
+			aColour[ slot ] = colour;
+			aIndex[ slot ] = uint32_t( search.Find( colour ) );
+		}
+
+		return aIndex[ slot ];
+	}
+};
+
+//
+// fog_palette_t
+//
+// A base palette ready for fog_generate. The colours are not copied, so they must
+// outlive it. AddRemap builds the nearest colour search for a metric, once; after that
+// the fog_palette_t is read only, and may be shared by any number of fog_generate calls
+// at once.
+//
+struct fog_palette_t
+{
+	const uint32_t* pColours = nullptr; // 0xRRGGBB
+	size_t uCount = 0;
+	nearest_search_t aSearch[ REMAP_COUNT ]; // by remap_metric_t, empty until AddRemap.
+
+	void Create( const uint32_t* pPalette, size_t count );
+
+	void AddRemap( remap_metric_t metric );
+};
+
+//
+// fog_levels
+//
+// The base palette, then steps - 1 levels for each ramp. fog_generate writes
+// uCount * fog_levels( settings ) entries.
+//
+size_t fog_levels( const fog_settings_t& settings );
+
+//
+// fog_generate
+//
+// Every level of the fog table for palette: pOutput[ level * uCount + i ] is entry i at
+// that level, level 0 being the palette itself. With settings.bRemap, pIndices (if not
+// null) gets the base palette index of each entry, and the search must have been added
+// with AddRemap or nothing is written and false is returned. The levels are shared out
+// between up to threads threads; with 1, all of the work is on the calling thread and
+// nothing is allocated.
+//
+bool fog_generate( const fog_palette_t& palette, const fog_settings_t& settings, uint32_t* pOutput, size_t* pIndices, int threads );
+
+//
+// fog_lut
+//
+// Every level as a uSize^3 rgb lookup (2 to 256 a side), for fogging true colour rather
+// than palette indices: pOutput[ ( ( level * uSize + b ) * uSize + g ) * uSize + r ] is the
+// lattice colour ( r, g, b ) (each 0 to uSize - 1, spread evenly over 0 to 255) fogged
+// to that level, and with settings.bRemap mapped to the nearest base palette entry. Level
+// 0 is unfogged, so without a remap it is the identity. Writes uSize^3 * fog_levels entries;
+// false if the size is out of range or the remap search was not added.
+//
+bool fog_lut( const fog_palette_t& palette, const fog_settings_t& settings, uint32_t uSize, uint32_t* pOutput, int threads );
+
+//=============================================================================
@@ -28,35 +28,64 @@ SOFTWARE.
 //=============================================================================
 
 
+#include "fogcore.h"
+#include "paltask.h"
+#include "palcpu.h"
+#include "palpalette.h" // .hex palettes, as every tool reads them
+#include "palserve.h" // -serve, jobs from stdin or a pipe
+#include "palverify.h" // -verify, hashes of the tables made
+#include "paltrace.h" // TRACE_ZONE, compiled out unless FRAGMENTS_TRACE or TRACY_ENABLE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <fstream>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 //=============================================================================
 
-struct options_t
+typedef enum
+{
+	PALFILE_HEX, // text, a 6 digit hex value per line
+	PALFILE_PAL32, // binary, a little endian uint32 0x00RRGGBB per entry
+}
+palfile_t;
+
+static const char* const kPalfileExtension[] = { ".hex", ".pal32" };
+
+static const char* const kRampModeName[] = { "fog", "light" };
+static const char* const kCurveName[] = { "linear", "exp", "lut" };
+
+// the fog_settings_t aRamps are the -col fog then each -ramp, see process_args.
+struct options_t : fog_settings_t
 {
 	std::string strInPaletteFile;
 	std::string strOutPaletteFile;
-	
-	int iSteps = 8;
+	palfile_t outFormat = PALFILE_HEX; // from the extension of the output
+	std::string strColormapFile; // -colormap
+	std::string strCompactFile; // -compact
+	std::string strLutFile; // -lut
+	uint32_t uLutSize = 32; // -lut-size
+	std::string strBatchFile; // -batch
+	std::string strGoldenFolder; // -golden
+	std::string strVerifyFile; // -verify
+	verify_manifest_t* pVerify = nullptr; // open while the run's tables are written.
+	bool bBenchmark = false; // -bench
+	bool bServe = false; // -serve
+	std::string strServe; // -serve=<name>: the pipe or socket, or stdin if empty.
 
 	uint32_t fogColour = 0;
-	
-	bool bLastStepEqualsFog = false;
-	bool bSplitMode = false;
-	bool bRemap = false;
-	bool bRemapLab = false;
-};
+	bool bFogColour = false; // -col given
 
-struct color_t
-{
-	union
-	{
-		uint32_t value_abgr;
-		uint8_t chan[ 4 ]; // R, G, B, A
-	};
+	bool bSplitMode = false;
 };
 
 //=============================================================================
@@ -81,26 +110,159 @@ static void print_hello()
 static void print_help()
 {
 	// Usage
-	printf( " USAGE: fogpal.exe [-?] -col=RRGGBB [-final] -steps=# [-split]\n" );
-	printf( "                 [-remap|-remap-lab] -i <palette> <output>\n\n" );
+	printf( " USAGE: fogpal.exe [-?] -col=RRGGBB [-ramp=<mode>,RRGGBB[,<curve>]...] [-final] -steps=# [-split]\n" );
+	printf( "                 [-remap|-remap-lab|-remap-oklab] -i <palette> <output> [-colormap <file>]\n" );
+	printf( "                 [-compact <file>] [-lut <file> [-lut-size=#]] [-verify <file>]\n" );
+	printf( "        fogpal.exe -batch <file> [-verify <file>]\n" );
+	printf( "        fogpal.exe -serve[=<name>]\n" );
+	printf( "        fogpal.exe -bench [-golden <folder>]\n" );
+	printf( "        (any of them with [-cpu=<level>])\n\n" );
 
 	// Options
 	printf( "  -?                This help.\n" );
 	printf( "  -col=RRGGBB       The fog colour.\n" );
+	printf( "  -ramp=<mode>,RRGGBB[,<curve>]\n" );
+	printf( "                    Another ramp of steps, after the fog: mode fog (blend toward the\n" );
+	printf( "                    colour) or light (multiply by it), curve linear [default], exp, or\n" );
+	printf( "                    a file of amounts from 0 to 1, one per step after the first.\n" );
 	printf( "  -final            Make the last line equal to the fog colour.\n" );
 	printf( "  -steps=#          Set the number of fog levels to generate.\n" );
 	printf( "  -split            Write each fog level to a separate file.\n" );
 	printf( "  -remap            Map fog outputs back to original palette.\n" );
 	printf( "  -remap-lab        Use Lab color space for remapping.\n" );
+	printf( "  -remap-oklab      Use Oklab color space for remapping (closer to what the eye sees).\n" );
 	putchar( '\n' );
 	printf( "  -i <file>         Filename of input palette.\n" );
 	putchar( '\n' );
-	printf( "  <output>          Filename of output palette.\n" );
+	printf( "  <output>          Filename of output palette. A .pal32 input or output is binary.\n" );
+	putchar( '\n' );
+	printf( "  -colormap <file>  With -remap, also write the base index for each index and fog\n" );
+	printf( "                    level, as a binary table of bytes (256 per level).\n" );
+	printf( "  -compact <file>   Also write each distinct colour once, and for each entry of each level\n" );
+	printf( "                    the number of its colour (a byte each, 2 past 256 colours).\n" );
+	printf( "  -lut <file>       Also write each fog level as an rgb to rgb lookup (remapped with\n" );
+	printf( "                    -remap), for fogging true colour in one texture fetch: a .cube\n" );
+	printf( "                    file per level, or any other extension as one RGBA strip.\n" );
+	printf( "  -lut-size=#       The points along each side of the lookup, 2 to 256. [Default=32]\n" );
+	printf( "  -verify <file>    Write a hash of each fog table (and -colormap) to <file>, or compare\n" );
+	printf( "                    them with it if it is there and fail if any differ.\n" );
+	putchar( '\n' );
+	printf( "  -batch <file>     Run every line of <file> as the options above, in parallel. Each\n" );
+	printf( "                    palette is loaded, and its remap search built, once.\n" );
+	printf( "  -serve[=<name>]   Read jobs from stdin, or from clients of the named pipe (a Unix socket\n" );
+	printf( "                    off Windows) <name>, a line of the options above each, run in turn with\n" );
+	printf( "                    the remap searches of each palette kept while it is unchanged. Each job\n" );
+	printf( "                    is answered \"#<line> OK <ms>ms\" or \"#<line> FAILED <ms>ms\". A line of\n" );
+	printf( "                    -stop ends the server.\n" );
+	putchar( '\n' );
+	printf( "  -bench            Time generating fog tables of synthetic palettes, with each remap.\n" );
+	printf( "  -golden <folder>  With -bench, check each table against <folder>\\<case>.hex, writing\n" );
+	printf( "                    any that are missing.\n" );
+	putchar( '\n' );
+	printf( "  -cpu=<level>      Blend kernels: scalar, sse2, sse4.1, avx2, avx512, neon or native.\n" );
+	printf( "                    [Default=native]\n" );
 	putchar( '\n' );
 
 	putchar( '\n' );
 }
 
+//
+// palette_file_format
+//
+// .pal32 files are binary, anything else is .hex.
+//
+static palfile_t palette_file_format( const std::string& strFileName )
+{
+	const size_t len = strlen( kPalfileExtension[ PALFILE_PAL32 ] );
+
+	if ( strFileName.length() >= len && _stricmp( strFileName.c_str() + strFileName.length() - len, kPalfileExtension[ PALFILE_PAL32 ] ) == 0 )
+	{
+		return PALFILE_PAL32;
+	}
+
+	return PALFILE_HEX;
+}
+
+//
+// parse_ramp
+//
+// -ramp=<mode>,RRGGBB[,<curve>], where a curve that is not linear or exp is a file of the
+// amount for each step after the first, one per line.
+//
+static bool parse_ramp( const char* szArg, ramp_t& ramp )
+{
+	std::vector< std::string > aParts;
+	std::string strArg = szArg;
+
+	size_t start = 0;
+	for ( ;; )
+	{
+		const size_t comma = strArg.find( ',', start );
+		aParts.push_back( strArg.substr( start, comma - start ) );
+		if ( comma == std::string::npos )
+		{
+			break;
+		}
+		start = comma + 1;
+	}
+
+	if ( aParts.size() < 2 || aParts.size() > 3 )
+	{
+		return false;
+	}
+
+	if ( _stricmp( aParts[ 0 ].c_str(), "fog" ) == 0 )
+	{
+		ramp.mode = RAMP_FOG;
+	}
+	else if ( _stricmp( aParts[ 0 ].c_str(), "light" ) == 0 )
+	{
+		ramp.mode = RAMP_LIGHT;
+	}
+	else
+	{
+		return false;
+	}
+
+	char* pEnd = nullptr;
+	ramp.colour = strtoul( aParts[ 1 ].c_str(), &pEnd, 16 );
+	if ( aParts[ 1 ].length() != 6 || *pEnd != 0 )
+	{
+		return false;
+	}
+
+	if ( aParts.size() == 2 || _stricmp( aParts[ 2 ].c_str(), "linear" ) == 0 )
+	{
+		ramp.curve = CURVE_LINEAR;
+	}
+	else if ( _stricmp( aParts[ 2 ].c_str(), "exp" ) == 0 )
+	{
+		ramp.curve = CURVE_EXP;
+	}
+	else
+	{
+		ramp.curve = CURVE_LUT;
+
+		std::ifstream fileCurve( aParts[ 2 ] );
+		if ( fileCurve.is_open() == false )
+		{
+			printf( "Error - failed to load the curve \"%s\".\n", aParts[ 2 ].c_str() );
+			return false;
+		}
+
+		std::string line;
+		while ( std::getline( fileCurve, line ) )
+		{
+			if ( line.empty() == false )
+			{
+				ramp.aAmounts.push_back( float( atof( line.c_str() ) ) );
+			}
+		}
+	}
+
+	return true;
+}
+
 //
 // process_args
 //
@@ -110,6 +272,12 @@ static bool process_args( int argc, char** argv, options_t& options )
 {
 	// Command Line State
 	bool bNextArgIsPalette = false;
+	bool bNextArgIsColormap = false;
+	bool bNextArgIsCompact = false;
+	bool bNextArgIsLut = false;
+	bool bNextArgIsBatch = false;
+	bool bNextArgIsGolden = false;
+	bool bNextArgIsVerify = false;
 
 	// Parse Command Line
 	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
@@ -121,6 +289,36 @@ static bool process_args( int argc, char** argv, options_t& options )
 			bNextArgIsPalette = false;
 			options.strInPaletteFile = szArg;
 		}
+		else if ( bNextArgIsColormap )
+		{
+			bNextArgIsColormap = false;
+			options.strColormapFile = szArg;
+		}
+		else if ( bNextArgIsCompact )
+		{
+			bNextArgIsCompact = false;
+			options.strCompactFile = szArg;
+		}
+		else if ( bNextArgIsLut )
+		{
+			bNextArgIsLut = false;
+			options.strLutFile = szArg;
+		}
+		else if ( bNextArgIsBatch )
+		{
+			bNextArgIsBatch = false;
+			options.strBatchFile = szArg;
+		}
+		else if ( bNextArgIsGolden )
+		{
+			bNextArgIsGolden = false;
+			options.strGoldenFolder = szArg;
+		}
+		else if ( bNextArgIsVerify )
+		{
+			bNextArgIsVerify = false;
+			options.strVerifyFile = szArg;
+		}
 		else if ( strncmp( szArg, "-steps=", 7 ) == 0 )
 		{
 			options.iSteps = atoi( szArg + 7 );
@@ -131,6 +329,26 @@ static bool process_args( int argc, char** argv, options_t& options )
 				return false;
 			}
 		}
+		else if ( strncmp( szArg, "-cpu=", 5 ) == 0 )
+		{
+			if ( cpu_select( szArg + 5 ) == false )
+			{
+				printf( "Error - unknown or unsupported SIMD level \"%s\" (this CPU has %s).\n", szArg + 5, cpu_level_name( cpu_detect() ) );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-lut-size=", 10 ) == 0 )
+		{
+			const int iSize = atoi( szArg + 10 );
+
+			if ( iSize < 2 || iSize > 256 )
+			{
+				printf( "Error - invalid lut size (%d), it must be 2 to 256.\n", iSize );
+				return false;
+			}
+
+			options.uLutSize = uint32_t( iSize );
+		}
 		else if ( strncmp( szArg, "-col=", 5 ) == 0 )
 		{
 			uint32_t colour;
@@ -140,6 +358,7 @@ static bool process_args( int argc, char** argv, options_t& options )
 			if ( colour >= 0 && colour <= 0xFFFFFF )
 			{
 				options.fogColour = colour;
+				options.bFogColour = true;
 			}
 			else
 			{
@@ -147,6 +366,17 @@ static bool process_args( int argc, char** argv, options_t& options )
 				return false;
 			}
 		}
+		else if ( strncmp( szArg, "-ramp=", 6 ) == 0 )
+		{
+			ramp_t ramp;
+			if ( parse_ramp( szArg + 6, ramp ) == false )
+			{
+				printf( "Error - invalid ramp \"%s\".\n", szArg + 6 );
+				return false;
+			}
+
+			options.aRamps.push_back( ramp );
+		}
 		else if ( _stricmp( szArg, "-?" ) == 0 )
 		{
 			return false;
@@ -155,6 +385,43 @@ static bool process_args( int argc, char** argv, options_t& options )
 		{
 			bNextArgIsPalette = true;
 		}
+		else if ( _stricmp( szArg, "-colormap" ) == 0 )
+		{
+			bNextArgIsColormap = true;
+		}
+		else if ( _stricmp( szArg, "-compact" ) == 0 )
+		{
+			bNextArgIsCompact = true;
+		}
+		else if ( _stricmp( szArg, "-lut" ) == 0 )
+		{
+			bNextArgIsLut = true;
+		}
+		else if ( _stricmp( szArg, "-batch" ) == 0 )
+		{
+			bNextArgIsBatch = true;
+		}
+		else if ( _stricmp( szArg, "-verify" ) == 0 )
+		{
+			bNextArgIsVerify = true;
+		}
+		else if ( _stricmp( szArg, "-serve" ) == 0 )
+		{
+			options.bServe = true;
+		}
+		else if ( strncmp( szArg, "-serve=", 7 ) == 0 && szArg[ 7 ] != '\0' )
+		{
+			options.bServe = true;
+			options.strServe = szArg + 7;
+		}
+		else if ( _stricmp( szArg, "-bench" ) == 0 )
+		{
+			options.bBenchmark = true;
+		}
+		else if ( _stricmp( szArg, "-golden" ) == 0 )
+		{
+			bNextArgIsGolden = true;
+		}
 		else if ( _stricmp( szArg, "-remap" ) == 0 )
 		{
 			options.bRemap = true;
@@ -162,7 +429,12 @@ static bool process_args( int argc, char** argv, options_t& options )
 		else if ( _stricmp( szArg, "-remap-lab" ) == 0 )
 		{
 			options.bRemap = true;
-			options.bRemapLab = true;
+			options.remapMetric = REMAP_LAB;
+		}
+		else if ( _stricmp( szArg, "-remap-oklab" ) == 0 )
+		{
+			options.bRemap = true;
+			options.remapMetric = REMAP_OKLAB;
 		}
 		else if ( _stricmp( szArg, "-final" ) == 0 )
 		{
@@ -184,6 +456,12 @@ static bool process_args( int argc, char** argv, options_t& options )
 
 	}; // for each command line argument
 
+	// the jobs in a batch or served have options of their own, and the benchmark its own cases.
+	if ( options.strBatchFile.empty() == false || options.bServe || options.bBenchmark )
+	{
+		return true;
+	}
+
 	if ( options.strInPaletteFile.empty() )
 	{
 		printf( "Error - no input file specified.\n" );
@@ -196,6 +474,31 @@ static bool process_args( int argc, char** argv, options_t& options )
 		return false;
 	}
 
+	if ( options.strColormapFile.empty() == false && options.bRemap == false )
+	{
+		printf( "Error - -colormap needs -remap, -remap-lab or -remap-oklab.\n" );
+		return false;
+	}
+
+	// the -col fog comes first, and is the only ramp without any -ramp.
+	if ( options.bFogColour || options.aRamps.empty() )
+	{
+		ramp_t fog;
+		fog.colour = options.fogColour;
+		options.aRamps.insert( options.aRamps.begin(), fog );
+	}
+
+	for ( const ramp_t& ramp : options.aRamps )
+	{
+		if ( ramp.curve == CURVE_LUT && ramp.aAmounts.size() != size_t( options.iSteps - 1 ) )
+		{
+			printf( "Error - a curve has %llu amounts, -steps=%d needs %d.\n", (unsigned long long)ramp.aAmounts.size(), options.iSteps, options.iSteps - 1 );
+			return false;
+		}
+	}
+
+	options.outFormat = palette_file_format( options.strOutPaletteFile );
+
 	if ( options.bSplitMode )
 	{
 		// Strip file extension
@@ -213,332 +516,495 @@ static bool process_args( int argc, char** argv, options_t& options )
 	return true;
 }
 
-double F( double input ) // function f(...), which is used for defining L, a and b changes within [4/29,1]
+//
+// parse_pal32file
+//
+// A .pal32 file is the entries as they are in memory: little endian uint32 0x00RRGGBB,
+// with no header, ready to map. Any other size is not a palette.
+//
+static void parse_pal32file( const std::string& data, std::vector<uint32_t>& aPalette )
 {
-	if ( input > 0.008856 )
+	if ( data.length() % sizeof( uint32_t ) != 0 )
 	{
-		return ( pow( input, 0.333333333 ) ); // maximum 1
+		return;
 	}
-	else
+
+	aPalette.resize( data.length() / sizeof( uint32_t ) );
+	if ( aPalette.empty() == false )
 	{
-		return ( ( 841 / 108 ) * input + 4 / 29 );  //841/108 = 29*29/36*16
+		memcpy( aPalette.data(), data.data(), data.length() );
 	}
-}
-
-void XYZtoLab( double X, double Y, double Z, double* L, double* a, double* b )
-{
-	const double Xo = 244.66128; // reference white
-	const double Yo = 255.0;
-	const double Zo = 277.63227;
-	*L = 116 * F( Y / Yo ) - 16; // maximum L = 100
-	*a = 500 * ( F( X / Xo ) - F( Y / Yo ) ); // maximum
-	*b = 200 * ( F( Y / Yo ) - F( Z / Zo ) );
-}
-
-void RGBtoXYZ( double R, double G, double B, double* X, double* Y, double* Z )
-{
-	double var_R = R / 255.0;
-	double var_G = G / 255.0;
-	double var_B = B / 255.0;
-
-	var_R = ( var_R > 0.04045 ) ? pow( ( var_R + 0.055 ) / 1.055, 2.4 )
-		: var_R / 12.92;
-	var_G = ( var_G > 0.04045 ) ? pow( ( var_G + 0.055 ) / 1.055, 2.4 )
-		: var_G / 12.92;
-	var_B = ( var_B > 0.04045 ) ? pow( ( var_B + 0.055 ) / 1.055, 2.4 )
-		: var_B / 12.92;
 
-	var_R *= 100;
-	var_G *= 100;
-	var_B *= 100;
-
-	*X = var_R * 0.4124 + var_G * 0.3576 + var_B * 0.1805;
-	*Y = var_R * 0.2126 + var_G * 0.7152 + var_B * 0.0722;
-	*Z = var_R * 0.0193 + var_G * 0.1192 + var_B * 0.9505;
+	for ( uint32_t& colour : aPalette )
+	{
+		colour &= 0xFFFFFF;
+	}
 }
 
-void rgb2lab( int R, int G, int B, double* Lab )
+//
+// write_hexfile
+//
+// Dump the palette to disk in .hex format, formatted into one buffer and written at once.
+//
+static bool write_hexfile( const std::vector< uint32_t >& aPalette, size_t iBase, size_t iCount, const std::string& strFileName )
 {
-	double X, Y, Z;
-	RGBtoXYZ( R, G, B, &X, &Y, &Z );
-	XYZtoLab( X, Y, Z, &Lab[ 0 ], &Lab[ 1 ], &Lab[ 2 ] );
-}
+	static const char kNibble[] = "0123456789abcdef";
 
-static double color_distance_Lab( color_t* colour1, color_t* colour2 )
-{
-	double Lab1[ 3 ];
-	rgb2lab( colour1->chan[ 0 ], colour1->chan[ 1 ], colour1->chan[ 2 ], Lab1 );
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
 
-	double Lab2[ 3 ];
-	rgb2lab( colour2->chan[ 0 ], colour2->chan[ 1 ], colour2->chan[ 2 ], Lab2 );
+	std::ofstream file( strFileName );
+	if ( file.is_open() )
+	{
+		// .hex palette file format
+		std::vector< char > aText( iCount * 7 );
 
-	double x;
-	double delta = 0;
+		char* pText = aText.data();
+		for ( size_t i = 0; i < iCount; ++i )
+		{
+			const uint32_t c = aPalette[ i + iBase ];
 
-	x = Lab1[ 0 ] - Lab2[ 0 ];
-	delta += x * x;
+			pText[ 0 ] = kNibble[ ( c >> 20 ) & 0xF ];
+			pText[ 1 ] = kNibble[ ( c >> 16 ) & 0xF ];
+			pText[ 2 ] = kNibble[ ( c >> 12 ) & 0xF ];
+			pText[ 3 ] = kNibble[ ( c >> 8 ) & 0xF ];
+			pText[ 4 ] = kNibble[ ( c >> 4 ) & 0xF ];
+			pText[ 5 ] = kNibble[ c & 0xF ];
+			pText[ 6 ] = '\n';
+			pText += 7;
+		}
 
-	x = Lab1[ 1 ] - Lab2[ 1 ];
-	delta += x * x;
+		file.write( aText.data(), aText.size() );
+		file.close();
 
-	x = Lab1[ 2 ] - Lab2[ 2 ];
-	delta += x * x;
+		if ( file.fail() == false )
+		{
+			printf( "OK\n" );
+			return true;
+		}
+	}
 
-	return delta;
+	printf( "FAILED\n" );
+	return false;
 }
 
 //
-// remap_Lab
+// write_pal32file
 //
-// Return the closest color in the base palette. Use Lab color space comparison.
+// Dump the palette to disk in .pal32 format, see parse_pal32file.
 //
-static uint32_t remap_Lab( std::vector< uint32_t >& aPalette, const size_t baseSize, const uint32_t input )
+static bool write_pal32file( const std::vector< uint32_t >& aPalette, size_t iBase, size_t iCount, const std::string& strFileName )
 {
-	size_t best_index = 0;
-	double score, best_score;
-
-	best_score = color_distance_Lab( (color_t*)&input, (color_t*)&( aPalette[ 0 ] ) );
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
 
-	for ( size_t i = 1; i < baseSize; ++i )
+	std::ofstream file( strFileName, std::ios::binary );
+	if ( file.is_open() )
 	{
-		score = color_distance_Lab( (color_t*)&input, (color_t*)&( aPalette[ i ] ) );
+		file.write( reinterpret_cast< const char* >( aPalette.data() + iBase ), iCount * sizeof( uint32_t ) );
+		file.close();
 
-		if ( score <= best_score )
+		if ( file.fail() == false )
 		{
-			best_score = score;
-			best_index = i;
+			printf( "OK\n" );
+			return true;
 		}
 	}
 
-	return aPalette[ best_index ];
-}
-
-static double color_distance_rgb( color_t* colour1, color_t* colour2 )
-{
-	double x;
-	double delta;
-
-	x = double( colour1->chan[ 0 ] ) - double( colour2->chan[ 0 ] );
-	delta = x * x;
-
-	x = double( colour1->chan[ 1 ] ) - double( colour2->chan[ 1 ] );
-	delta += x * x;
-
-	x = double( colour1->chan[ 2 ] ) - double( colour2->chan[ 2 ] );
-	delta += x * x;
-
-	return delta;
+	printf( "FAILED\n" );
+	return false;
 }
 
 //
-// remap_rgb
+// write_palette
 //
-// Return the closest color in the base palette. Use rgb color space comparison.
+// Dump iCount entries from iBase to disk, in the given format.
 //
-static uint32_t remap_rgb( std::vector< uint32_t >& aPalette, const size_t baseSize, const uint32_t input )
+static bool write_palette( const std::vector< uint32_t >& aPalette, size_t iBase, size_t iCount, palfile_t format, const std::string& strFileName )
 {
-	size_t best_index = 0;
-	double score, best_score;
+	TRACE_ZONE( "write_palette" );
 
-	best_score = color_distance_rgb( (color_t*)&input, (color_t*)&( aPalette[ 0 ] ) );
-
-	for ( size_t i = 1; i < baseSize; ++i )
+	if ( format == PALFILE_PAL32 )
 	{
-		score = color_distance_rgb( (color_t*)&input, (color_t*)&( aPalette[ i ] ) );
-
-		if ( score <= best_score )
-		{
-			best_score = score;
-			best_index = i;
-		}
+		return write_pal32file( aPalette, iBase, iCount, strFileName );
 	}
 
-	return aPalette[ best_index ];
+	return write_hexfile( aPalette, iBase, iCount, strFileName );
 }
 
 //
-// generate_fog
+// colormap_header_t
 //
-// Generate additional palette entries corresponding to equally spaced steps.
+// -colormap output, for engines that map the file or upload it as a texture as it is:
+// this header, then a row of kColormapStride bytes for each level (of every ramp in
+// turn), each byte the base palette index for that index at that level. Fogging index i
+// at level l is then data[ l * 256 + i ], as in a Doom COLORMAP. Bytes past the palette's entries are 0.
 //
-static void generate_fog( std::vector< uint32_t >& aPalette, const options_t& options )
+struct colormap_header_t
 {
-	// cache the base size of the raw palette (fog step 0)
-	const size_t baseSize = aPalette.size();
+	char magic[ 8 ]; // "FOGMAP01"
+	uint32_t uEntries; // base palette entries
+	uint32_t uLevels; // the rows: 1 + ramps * ( steps - 1 )
+	uint32_t uStride; // bytes per row, always kColormapStride
+	uint32_t uDataOffset; // of the first row, from the start of the file
+	uint32_t uFogColour; // 0xRRGGBB, of the first ramp
+	uint32_t uReserved;
+};
 
-	float fScale;
-	if ( options.bLastStepEqualsFog )
-	{
-		fScale = 1.0f / static_cast<float>( options.iSteps - 1 );
-	}
-	else
-	{
-		fScale = 1.0f / static_cast<float>( options.iSteps );
-	}
+static_assert( sizeof( colormap_header_t ) == 32, "colormap_header_t is written as is" );
 
-	const float target_r = static_cast<float>( ( options.fogColour >> 16 ) & 0xFF );
-	const float target_g = static_cast<float>( ( options.fogColour >> 8 ) & 0xFF );
-	const float target_b = static_cast<float>( ( options.fogColour ) & 0xFF );
+static const uint32_t kColormapStride = 256;
 
-	for ( int iStep = 1; iStep < options.iSteps; ++iStep )
-	{
-		// how much fog at this step?
-		const float fFog = static_cast<float>( iStep ) * fScale;
+static bool write_colormap( const std::vector< size_t >& aIndices, size_t iEntries, const options_t& options, const std::string& strFileName )
+{
+	TRACE_ZONE( "write_colormap" );
 
-		for ( size_t i = 0; i < baseSize; ++i )
-		{
- 			// get the raw colour
- 			const uint32_t rawColour = aPalette[ i ];
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
 
-			// ... convert to float
-			float source_r = static_cast<float>( ( rawColour >> 16 ) & 0xFF );
-			float source_g = static_cast<float>( ( rawColour >> 8 ) & 0xFF );
-			float source_b = static_cast<float>( ( rawColour ) & 0xFF );
+	if ( iEntries > kColormapStride )
+	{
+		printf( "FAILED (%llu entries, a colormap holds 256 at most)\n", (unsigned long long)iEntries );
+		return false;
+	}
 
-			// ... blend
-			float r, g, b;
-			r = source_r * ( 1 - fFog ) + target_r * ( fFog );
-			g = source_g * ( 1 - fFog ) + target_g * ( fFog );
-			b = source_b * ( 1 - fFog ) + target_b * ( fFog );
+	colormap_header_t header = {};
+	memcpy( header.magic, "FOGMAP01", 8 );
+	header.uEntries = uint32_t( iEntries );
+	header.uLevels = uint32_t( fog_levels( options ) );
+	header.uStride = kColormapStride;
+	header.uDataOffset = sizeof( colormap_header_t );
+	header.uFogColour = options.aRamps[ 0 ].colour;
 
-			// generate the fogged value.
-			uint32_t fogOutput = 0;
-			fogOutput |= std::min( std::max( static_cast<int>( r ), 0 ), 255 ) << 16;
-			fogOutput |= std::min( std::max( static_cast<int>( g ), 0 ), 255 ) << 8;
-			fogOutput |= std::min( std::max( static_cast<int>( b ), 0 ), 255 );
+	std::vector< uint8_t > aTable( size_t( kColormapStride ) * header.uLevels, 0 );
+	for ( size_t i = 0; i < aIndices.size(); ++i )
+	{
+		aTable[ ( i / iEntries ) * kColormapStride + ( i % iEntries ) ] = uint8_t( aIndices[ i ] );
+	}
 
-			// remap?
-			if ( options.bRemapLab )
-			{
-				fogOutput = remap_Lab( aPalette, baseSize, fogOutput );
-			}
-			else if ( options.bRemap )
-			{
-				fogOutput = remap_rgb( aPalette, baseSize, fogOutput );
-			}
+	std::ofstream file( strFileName, std::ios::binary );
+	if ( file.is_open() )
+	{
+		file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+		file.write( reinterpret_cast< const char* >( aTable.data() ), aTable.size() );
+		file.close();
 
-			// add to the array
-			aPalette.push_back( fogOutput );
+		if ( file.good() )
+		{
+			printf( "OK\n" );
+			return true;
 		}
 	}
+
+	printf( "FAILED\n" );
+	return false;
 }
 
 //
-// parse_hexfile
+// compact_header_t
 //
-// Parse a .hex file output by "aseprite". A simple list of \n separated 6 byte ASCII hex values.
+// -compact output: this header, the distinct colours of the whole table as little endian
+// 32-bit 0x00RRGGBB values (in the order they first appear, so the base palette comes
+// first), then for each level and entry the number of its colour, as uint8 or uint16 by
+// uIndexSize. Entry i at level l is colours[ index[ l * uEntries + i ] ].
 //
-static void parse_hexfile( std::ifstream& fileInput, std::vector<uint32_t>& aPalette )
+struct compact_header_t
 {
-	while ( !fileInput.eof() )
-	{
-		std::string line;
-		std::getline( fileInput, line );
+	char magic[ 8 ]; // "FOGIDX01"
+	uint32_t uColours; // distinct colours
+	uint32_t uEntries; // base palette entries
+	uint32_t uLevels; // 1 + ramps * ( steps - 1 )
+	uint32_t uIndexSize; // bytes per index, 1 or 2
+	uint32_t uColourOffset; // of the colours, from the start of the file
+	uint32_t uIndexOffset; // of the indices, from the start of the file
+};
+
+static_assert( sizeof( compact_header_t ) == 32, "compact_header_t is written as is" );
+
+static bool write_compact( const std::vector< uint32_t >& aPalette, size_t iEntries, const std::string& strFileName )
+{
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
 
-		if ( line.length() != 6 )
+	// number each colour as it is first seen.
+	std::unordered_map< uint32_t, uint32_t > mapColours;
+	mapColours.reserve( iEntries * 2 );
+
+	std::vector< uint32_t > aColours;
+	std::vector< uint32_t > aIndices( aPalette.size() );
+	for ( size_t i = 0; i < aPalette.size(); ++i )
+	{
+		const auto found = mapColours.emplace( aPalette[ i ], uint32_t( aColours.size() ) );
+		if ( found.second )
 		{
-			break;
+			aColours.push_back( aPalette[ i ] );
 		}
+		aIndices[ i ] = found.first->second;
+	}
 
-		char* pEnd = nullptr;
-		uint32_t colour = std::strtoul( line.c_str(), &pEnd, 16 );
+	if ( aColours.size() > 65536 )
+	{
+		printf( "FAILED (%llu colours, a compact table holds 65536 at most)\n", (unsigned long long)aColours.size() );
+		return false;
+	}
 
-		if ( pEnd == line.c_str() )
+	compact_header_t header = {};
+	memcpy( header.magic, "FOGIDX01", 8 );
+	header.uColours = uint32_t( aColours.size() );
+	header.uEntries = uint32_t( iEntries );
+	header.uLevels = uint32_t( aPalette.size() / iEntries );
+	header.uIndexSize = ( aColours.size() > 256 ) ? 2 : 1;
+	header.uColourOffset = sizeof( compact_header_t );
+	header.uIndexOffset = header.uColourOffset + header.uColours * 4;
+
+	std::vector< uint8_t > aTable( aIndices.size() * header.uIndexSize );
+	for ( size_t i = 0; i < aIndices.size(); ++i )
+	{
+		if ( header.uIndexSize == 2 )
 		{
-			break;
+			aTable[ i * 2 ] = uint8_t( aIndices[ i ] );
+			aTable[ i * 2 + 1 ] = uint8_t( aIndices[ i ] >> 8 );
+		}
+		else
+		{
+			aTable[ i ] = uint8_t( aIndices[ i ] );
 		}
+	}
 
-		aPalette.push_back( colour );
+	std::ofstream file( strFileName, std::ios::binary );
+	if ( file.is_open() )
+	{
+		file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+		file.write( reinterpret_cast< const char* >( aColours.data() ), aColours.size() * 4 );
+		file.write( reinterpret_cast< const char* >( aTable.data() ), aTable.size() );
+		file.close();
 
-		// printf( "debug: %s -> %06x\n", line.c_str(), colour );
+		if ( file.good() )
+		{
+			printf( "OK (%llu colours, %llu bytes)\n", (unsigned long long)aColours.size(), (unsigned long long)( header.uIndexOffset + aTable.size() ) );
+			return true;
+		}
 	}
+
+	printf( "FAILED\n" );
+	return false;
 }
 
 //
-// write_hexfile
+// lut_header_t
 //
-// Dump the whole palette to disk in .hex format.
+// -lut output that is not .cube: this header, then every level's lookup as RGBA bytes in
+// one 2D strip for a texture upload, uSize * uSize wide and uSize * uLevels high. Each
+// level is uSize rows; the lookup of lattice point ( r, g, b ) at level l is the texel
+// ( b * uSize + r, l * uSize + g ), so blue picks a tile along the strip.
 //
-static bool write_hexfile( std::vector< uint32_t >& aPalette, size_t iBase, size_t iCount, const std::string& strFileName )
+struct lut_header_t
 {
-	char buf[ 64 ];
+	char magic[ 8 ]; // "FOGLUT01"
+	uint32_t uSize; // lattice points along each side
+	uint32_t uLevels; // 1 + ramps * ( steps - 1 )
+	uint32_t uWidth; // texels, uSize * uSize
+	uint32_t uHeight; // texels, uSize * uLevels
+	uint32_t uDataOffset; // of the first row, from the start of the file
+	uint32_t uFogColour; // 0xRRGGBB, of the first ramp
+};
+
+static_assert( sizeof( lut_header_t ) == 32, "lut_header_t is written as is" );
 
+//
+// write_cube
+//
+// One level of a lookup as an Adobe / Resolve .cube file, red changing fastest.
+//
+static bool write_cube( const uint32_t* pLevel, uint32_t uSize, size_t level, const std::string& strFileName )
+{
 	printf( "Writing \"%s\" ... ", strFileName.c_str() );
 
-	std::ofstream file( strFileName );
+	std::string data = "TITLE \"fogpal level " + std::to_string( level ) + "\"\nLUT_3D_SIZE " + std::to_string( uSize ) + "\n";
+
+	const size_t count = size_t( uSize ) * uSize * uSize;
+	for ( size_t i = 0; i < count; ++i )
+	{
+		char line[ 32 ];
+		snprintf( line, sizeof( line ), "%.6f %.6f %.6f\n", ( ( pLevel[ i ] >> 16 ) & 0xFF ) / 255.0, ( ( pLevel[ i ] >> 8 ) & 0xFF ) / 255.0, ( pLevel[ i ] & 0xFF ) / 255.0 );
+		data += line;
+	}
+
+	std::ofstream file( strFileName, std::ios::binary );
 	if ( file.is_open() )
 	{
-		for ( size_t i = 0; i < iCount; ++i )
+		file.write( data.data(), data.size() );
+		file.close();
+
+		if ( file.good() )
 		{
-			const uint32_t c = aPalette[ i + iBase ];
+			printf( "OK\n" );
+			return true;
+		}
+	}
+
+	printf( "FAILED\n" );
+	return false;
+}
+
+//
+// write_lut
+//
+// Generate the -lut lookups on threads threads and write them, as .cube files named
+// <file>_<level>.cube, or as one strip.
+//
+static bool write_lut( const fog_palette_t& palette, const options_t& options, int threads )
+{
+	const uint32_t uSize = options.uLutSize;
+	const size_t levels = fog_levels( options );
+	const size_t count = size_t( uSize ) * uSize * uSize;
+
+	std::vector< uint32_t > aLut( count * levels );
+	if ( fog_lut( palette, options, uSize, aLut.data(), threads ) == false )
+	{
+		printf( "Writing \"%s\" ... FAILED\n", options.strLutFile.c_str() );
+		return false;
+	}
+
+	const std::string& strFileName = options.strLutFile;
+	const size_t len = strlen( ".cube" );
 
-			// .hex palette file format
-			sprintf_s( buf, sizeof( buf ), "%06x\n", c );
+	if ( strFileName.length() >= len && _stricmp( strFileName.c_str() + strFileName.length() - len, ".cube" ) == 0 )
+	{
+		const std::string strBase = strFileName.substr( 0, strFileName.length() - len );
 
-			file << buf;
+		for ( size_t level = 0; level < levels; ++level )
+		{
+			if ( write_cube( aLut.data() + level * count, uSize, level, strBase + "_" + std::to_string( level ) + ".cube" ) == false )
+			{
+				return false;
+			}
 		}
 
-		file.close();
-		printf( "OK\n" );
 		return true;
 	}
-	else
+
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+
+	lut_header_t header = {};
+	memcpy( header.magic, "FOGLUT01", 8 );
+	header.uSize = uSize;
+	header.uLevels = uint32_t( levels );
+	header.uWidth = uSize * uSize;
+	header.uHeight = uint32_t( uSize * levels );
+	header.uDataOffset = sizeof( lut_header_t );
+	header.uFogColour = options.aRamps[ 0 ].colour;
+
+	// from fog_lut's ( level, b, g, r ) order to rows of ( level, g ), each of b tiles of r.
+	std::vector< uint8_t > aStrip( count * levels * 4 );
+	uint8_t* pTexel = aStrip.data();
+	for ( size_t level = 0; level < levels; ++level )
 	{
-		printf( "FAILED\n" );
-		return false;
+		for ( uint32_t g = 0; g < uSize; ++g )
+		{
+			for ( uint32_t b = 0; b < uSize; ++b )
+			{
+				const uint32_t* pRow = aLut.data() + ( ( level * uSize + b ) * uSize + g ) * uSize;
+
+				for ( uint32_t r = 0; r < uSize; ++r )
+				{
+					*pTexel++ = uint8_t( pRow[ r ] >> 16 );
+					*pTexel++ = uint8_t( pRow[ r ] >> 8 );
+					*pTexel++ = uint8_t( pRow[ r ] );
+					*pTexel++ = 0xFF;
+				}
+			}
+		}
 	}
+
+	std::ofstream file( strFileName, std::ios::binary );
+	if ( file.is_open() )
+	{
+		file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+		file.write( reinterpret_cast< const char* >( aStrip.data() ), aStrip.size() );
+		file.close();
+
+		if ( file.good() )
+		{
+			printf( "OK\n" );
+			return true;
+		}
+	}
+
+	printf( "FAILED\n" );
+	return false;
 }
 
 //
-// do_work
+// load_palette
 //
-// Palette fogger tool.
+// Load a .hex or .pal32 palette (read in one go), keeping fileInput open to prevent the
+// common user error of overwriting the input!
 //
-static void do_work( const options_t& options )
+static bool load_palette( const std::string& strFileName, std::ifstream& fileInput, std::vector< uint32_t >& aPalette )
 {
-	print_hello();
+	printf( "Loading palette \"%s\" ... ", strFileName.c_str() );
 
-	printf( "Loading palette \"%s\" ... ", options.strInPaletteFile.c_str() );
+	const palfile_t format = palette_file_format( strFileName );
 
-	// Load input palette file - keep it open to prevent common user error of overwriting input!
-	std::ifstream fileInput( options.strInPaletteFile );
-	if ( fileInput.is_open() )
+	fileInput.open( strFileName, std::ios::binary );
+	if ( fileInput.is_open() == false )
 	{
-		//
+		printf( "FAILED\n\n" );
+		return false;
+	}
+
+	std::string data;
+	fileInput.seekg( 0, std::ios::end );
+	data.resize( size_t( fileInput.tellg() ) );
+	fileInput.seekg( 0, std::ios::beg );
+	fileInput.read( &data[ 0 ], data.size() );
+
+	if ( format == PALFILE_PAL32 )
+	{
+		parse_pal32file( data, aPalette );
 	}
 	else
 	{
-		printf( "FAILED\n\n" );
-		return;
+		palette_parse_hex( data.data(), data.size(), aPalette );
 	}
 
-	std::vector< uint32_t > aPalette;
-	parse_hexfile( fileInput, aPalette );
-
 	// Usable palette?
 	if ( aPalette.empty() )
 	{
 		printf( "INVALID\n\n" );
-		return;
-	}
-	else
-	{
-		printf( "OK\n\n" );
+		return false;
 	}
 
-	const size_t initialSize = aPalette.size();
+	printf( "OK\n\n" );
+	return true;
+}
+
+//
+// write_fog
+//
+// Explain what was generated, then write the output(s).
+//
+static void write_fog( const std::vector< uint32_t >& aPalette, const std::vector< size_t >& aIndices, size_t initialSize, const options_t& options )
+{
+	const size_t levels = fog_levels( options );
 
 	// Explain what we're doing.
-	printf( "Generating %d steps of fog (#%06x) for this palette.\n", options.iSteps, options.fogColour );
+	for ( const ramp_t& ramp : options.aRamps )
+	{
+		printf( "Generating %d steps of %s (#%06x", options.iSteps, kRampModeName[ ramp.mode ], ramp.colour );
+		printf( ( ramp.curve == CURVE_LINEAR ) ? ") for this palette.\n" : ", %s) for this palette.\n", kCurveName[ ramp.curve ] );
+	}
 
 	if ( options.bLastStepEqualsFog )
 	{
-		printf( "The last %llu entries will equal the fog colour (#%06x).\n", initialSize, options.fogColour );
+		if ( options.aRamps.size() == 1 && options.aRamps[ 0 ].mode == RAMP_FOG )
+		{
+			printf( "The last %llu entries will equal the fog colour (#%06x).\n", initialSize, options.aRamps[ 0 ].colour );
+		}
+		else
+		{
+			printf( "The last %llu entries of each ramp will be at its full amount.\n", initialSize );
+		}
 	}
 
-	printf( "\nThe palette is now %llu x %u = %llu entries.\n\n", initialSize, options.iSteps, initialSize * options.iSteps );
-
-	generate_fog( aPalette, options );
+	printf( "\nThe palette is now %llu x %llu = %llu entries.\n\n", initialSize, (unsigned long long)levels, initialSize * levels );
 
 	// Try and write the output.
 
@@ -546,15 +1012,15 @@ static void do_work( const options_t& options )
 	{
 		printf( "Writing split palette files ...\n\n" );
 
-		for ( int step = 1; step < options.iSteps; ++step )
+		for ( size_t step = 1; step < levels; ++step )
 		{
 			std::string file;
 			file = options.strOutPaletteFile;
 			file += "_";
 			file += std::to_string( step );
-			file += ".hex";
+			file += kPalfileExtension[ options.outFormat ];
 
-			if ( write_hexfile( aPalette, step * initialSize, initialSize, file ) == false )
+			if ( write_palette( aPalette, step * initialSize, initialSize, options.outFormat, file ) == false )
 			{
 				break;
 			}
@@ -562,13 +1028,486 @@ static void do_work( const options_t& options )
 	}
 	else
 	{
-		write_hexfile( aPalette, 0, aPalette.size(), options.strOutPaletteFile );
+		write_palette( aPalette, 0, aPalette.size(), options.outFormat, options.strOutPaletteFile );
+	}
+
+	if ( options.strColormapFile.empty() == false )
+	{
+		write_colormap( aIndices, initialSize, options, options.strColormapFile );
+	}
+
+	if ( options.strCompactFile.empty() == false )
+	{
+		write_compact( aPalette, initialSize, options.strCompactFile );
+	}
+
+	// -verify: the table as generated, however it is split into files.
+	if ( options.pVerify )
+	{
+		verify_hash_t hash;
+		hash.Add( uint32_t( initialSize ) );
+		hash.Add( uint32_t( levels ) );
+		hash.AddData( aPalette.data(), aPalette.size() * sizeof( uint32_t ) );
+		fputs( options.pVerify->Record( options.strOutPaletteFile, "fog", hash ).c_str(), stdout );
+
+		if ( options.strColormapFile.empty() == false )
+		{
+			verify_hash_t indices;
+			for ( size_t index : aIndices )
+			{
+				indices.Add( uint32_t( index ) );
+			}
+			fputs( options.pVerify->Record( options.strColormapFile, "colormap", indices ).c_str(), stdout );
+		}
+
+		putchar( '\n' );
+	}
+}
+
+//
+// run_verified
+//
+// Run fn() under -verify when it is given: the manifest is open while it runs, and closed
+// (written, or compared) after. False if it cannot be read, or if a table differs.
+//
+template < typename FN >
+static bool run_verified( options_t& options, FN fn )
+{
+	if ( options.strVerifyFile.empty() )
+	{
+		fn();
+		return true;
+	}
+
+	verify_manifest_t verify;
+	if ( verify.Open( options.strVerifyFile ) == false )
+	{
+		printf( "Error - could not read the verify manifest \"%s\".\n", options.strVerifyFile.c_str() );
+		return false;
+	}
+
+	options.pVerify = &verify;
+	fn();
+	options.pVerify = nullptr;
+
+	std::string strLog;
+	const bool bOK = verify.Close( strLog );
+	fputs( strLog.c_str(), stdout );
+	return bOK;
+}
+
+//
+// do_work
+//
+// Palette fogger tool.
+//
+static void do_work( const options_t& options )
+{
+	print_hello();
+
+	std::ifstream fileInput;
+	std::vector< uint32_t > aPalette;
+	if ( load_palette( options.strInPaletteFile, fileInput, aPalette ) == false )
+	{
+		return;
+	}
+
+	const size_t initialSize = aPalette.size();
+
+	// one nearest colour search, for every ramp.
+	fog_palette_t palette;
+	palette.Create( aPalette.data(), initialSize );
+	if ( options.bRemap )
+	{
+		palette.AddRemap( options.remapMetric );
+	}
+
+	std::vector< uint32_t > aOutput( initialSize * fog_levels( options ) );
+	std::vector< size_t > aIndices( options.bRemap ? aOutput.size() : 0 );
+	fog_generate( palette, options, aOutput.data(), aIndices.empty() ? nullptr : aIndices.data(), int( task_thread_cap() ) );
+
+	write_fog( aOutput, aIndices, initialSize, options );
+
+	if ( options.strLutFile.empty() == false )
+	{
+		write_lut( palette, options, int( task_thread_cap() ) );
 	}
 
 	// Done. We can close the input now.
 	fileInput.close();
 }
 
+//
+// do_batch
+//
+// -batch: every line of the file is a job with the options of a normal run (blank lines
+// and lines starting with # are skipped). Each palette is loaded once, and its nearest
+// colour search (for each metric) built once for every job that uses it. The jobs are then
+// generated in parallel, and written in the order of the file.
+//
+struct batch_palette_t
+{
+	std::ifstream fileInput; // kept open, as in do_work.
+	std::vector< uint32_t > aPalette;
+	fog_palette_t fog; // with the searches of the jobs' metrics.
+	bool bLoaded = false;
+};
+
+struct batch_job_t
+{
+	size_t uLine = 0;
+	options_t options;
+	const batch_palette_t* pPalette = nullptr;
+	std::vector< uint32_t > aOutput;
+	std::vector< size_t > aIndices;
+};
+
+static void do_batch( const options_t& batch )
+{
+	print_hello();
+
+	std::ifstream fileBatch( batch.strBatchFile );
+	if ( fileBatch.is_open() == false )
+	{
+		printf( "Error - failed to open batch file \"%s\".\n", batch.strBatchFile.c_str() );
+		return;
+	}
+
+	std::map< std::string, std::unique_ptr< batch_palette_t > > mapPalettes;
+	std::vector< batch_job_t > aJobs;
+
+	size_t uLine = 0;
+	std::string strLine;
+	while ( std::getline( fileBatch, strLine ) )
+	{
+		++uLine;
+
+		std::vector< std::string > aArgs = serve_split_args( strLine );
+		if ( aArgs.empty() || aArgs[ 0 ][ 0 ] == '#' )
+		{
+			continue;
+		}
+
+		std::vector< char* > argv = serve_argv( "fogpal", aArgs );
+
+		batch_job_t job;
+		job.uLine = uLine;
+
+		if ( process_args( int( argv.size() ), argv.data(), job.options ) == false || job.options.strBatchFile.empty() == false || job.options.bServe || job.options.bBenchmark
+			 || job.options.strVerifyFile.empty() == false )
+		{
+			printf( "Line %llu: FAILED\n\n", (unsigned long long)uLine );
+			continue;
+		}
+
+		job.options.pVerify = batch.pVerify; // the batch's -verify covers every job.
+
+		// the first job to use a palette loads it.
+		std::unique_ptr< batch_palette_t >& palette = mapPalettes[ job.options.strInPaletteFile ];
+		if ( palette == nullptr )
+		{
+			palette.reset( new batch_palette_t );
+			palette->bLoaded = load_palette( job.options.strInPaletteFile, palette->fileInput, palette->aPalette );
+			palette->fog.Create( palette->aPalette.data(), palette->aPalette.size() );
+		}
+
+		if ( palette->bLoaded == false )
+		{
+			printf( "Line %llu: FAILED\n\n", (unsigned long long)uLine );
+			continue;
+		}
+
+		if ( job.options.bRemap )
+		{
+			palette->fog.AddRemap( job.options.remapMetric );
+		}
+
+		job.pPalette = palette.get();
+		aJobs.push_back( std::move( job ) );
+	}
+
+	// the jobs side by side, sharing what is left of the cores between steps.
+	const int cores = int( task_thread_cap() );
+	const int job_threads = std::min( cores, int( aJobs.size() ) );
+	const int step_threads = std::max( 1, cores / std::max( job_threads, 1 ) );
+
+	std::atomic< size_t > next_job( 0 );
+
+	auto thread_fn = [&]()
+	{
+		for ( size_t i = next_job++; i < aJobs.size(); i = next_job++ )
+		{
+			batch_job_t& job = aJobs[ i ];
+			job.aOutput.resize( job.pPalette->aPalette.size() * fog_levels( job.options ) );
+			job.aIndices.resize( job.options.bRemap ? job.aOutput.size() : 0 );
+			fog_generate( job.pPalette->fog, job.options, job.aOutput.data(), job.aIndices.empty() ? nullptr : job.aIndices.data(), step_threads );
+		}
+	};
+
+	std::vector< std::thread > aThreads;
+	for ( int t = 1; t < job_threads; ++t )
+	{
+		aThreads.emplace_back( thread_fn );
+	}
+
+	thread_fn();
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	for ( const batch_job_t& job : aJobs )
+	{
+		printf( "Line %llu: \"%s\"\n\n", (unsigned long long)job.uLine, job.options.strInPaletteFile.c_str() );
+		write_fog( job.aOutput, job.aIndices, job.pPalette->aPalette.size(), job.options );
+
+		if ( job.options.strLutFile.empty() == false )
+		{
+			write_lut( job.pPalette->fog, job.options, cores );
+		}
+
+		putchar( '\n' );
+	}
+
+	size_t uPalettes = 0;
+	for ( const auto& palette : mapPalettes )
+	{
+		uPalettes += palette.second->bLoaded ? 1 : 0;
+	}
+
+	printf( "%llu jobs from %llu palettes.\n", (unsigned long long)aJobs.size(), (unsigned long long)uPalettes );
+}
+
+//
+// run_server
+//
+// -serve: each job (see palserve.h) has the options of a normal run, and is run in turn on
+// every core. The palette is read again for each job, and a changed one built again, but
+// the remap searches of one that has not changed are kept: a job after the first with a
+// palette and metric pays only for its own levels.
+//
+struct serve_palette_t
+{
+	std::vector< uint32_t > aPalette;
+	fog_palette_t fog; // with the searches of the jobs' metrics so far.
+};
+
+static void run_server( const options_t& server )
+{
+	std::map< std::string, std::unique_ptr< serve_palette_t > > mapPalettes;
+
+	serve_jobs( server.strServe, 1, [&]( std::vector< std::string >& aArgs, std::string& )
+	{
+		std::vector< char* > argv = serve_argv( "fogpal", aArgs );
+
+		options_t job;
+		if ( process_args( int( argv.size() ), argv.data(), job ) == false || job.strBatchFile.empty() == false || job.bServe || job.bBenchmark )
+		{
+			return false;
+		}
+
+		std::ifstream fileInput; // kept open, as in do_work.
+		std::vector< uint32_t > aPalette;
+		if ( load_palette( job.strInPaletteFile, fileInput, aPalette ) == false )
+		{
+			return false;
+		}
+
+		std::unique_ptr< serve_palette_t >& palette = mapPalettes[ job.strInPaletteFile ];
+		if ( palette == nullptr || palette->aPalette != aPalette )
+		{
+			palette.reset( new serve_palette_t );
+			palette->aPalette = std::move( aPalette );
+			palette->fog.Create( palette->aPalette.data(), palette->aPalette.size() );
+		}
+
+		if ( job.bRemap )
+		{
+			palette->fog.AddRemap( job.remapMetric );
+		}
+
+		const int threads = int( task_thread_cap() );
+		std::vector< uint32_t > aOutput( palette->aPalette.size() * fog_levels( job ) );
+		std::vector< size_t > aIndices( job.bRemap ? aOutput.size() : 0 );
+		fog_generate( palette->fog, job, aOutput.data(), aIndices.empty() ? nullptr : aIndices.data(), threads );
+
+		bool bOK = run_verified( job, [&]() { write_fog( aOutput, aIndices, palette->aPalette.size(), job ); } );
+		if ( job.strLutFile.empty() == false )
+		{
+			bOK = write_lut( palette->fog, job, threads ) && bOK;
+		}
+
+		fflush( stdout );
+		return bOK;
+	} );
+}
+
+//
+// bench_hash
+//
+// FNV-1a of a table, printed with its timing so that a change can be checked against the
+// results of an earlier build.
+//
+static uint64_t bench_hash( uint64_t hash, const uint8_t* pData, size_t size )
+{
+	for ( size_t i = 0; i < size; ++i )
+	{
+		hash = ( hash ^ pData[ i ] ) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static const uint64_t kBenchHashSeed = 0xcbf29ce484222325ULL;
+
+//
+// bench_palette
+//
+// A palette of count pseudo random colours, the same on every run.
+//
+static std::vector< uint32_t > bench_palette( uint32_t count )
+{
+	std::vector< uint32_t > aPalette( count );
+
+	uint32_t seed = 0x12345678u ^ count;
+	for ( uint32_t& colour : aPalette )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		colour = seed >> 8;
+	}
+
+	return aPalette;
+}
+
+//
+// bench_golden
+//
+// Compare a table with <folder>\<case>.hex, or write the file if there isn't one yet.
+// Returns false if they differ.
+//
+static bool bench_golden( const std::vector< uint32_t >& aOutput, const std::string& strFolder, const std::string& strCase, const char*& szResult )
+{
+	const std::string strFile = strFolder + "\\" + strCase + kPalfileExtension[ PALFILE_HEX ];
+
+	std::ifstream fileGolden( strFile, std::ios::binary );
+	if ( fileGolden.is_open() == false )
+	{
+		szResult = write_hexfile( aOutput, 0, aOutput.size(), strFile ) ? "written" : "FAILED";
+		return true;
+	}
+
+	std::string data;
+	fileGolden.seekg( 0, std::ios::end );
+	data.resize( size_t( fileGolden.tellg() ) );
+	fileGolden.seekg( 0, std::ios::beg );
+	fileGolden.read( &data[ 0 ], data.size() );
+
+	std::vector< uint32_t > aGolden;
+	palette_parse_hex( data.data(), data.size(), aGolden );
+
+	const bool bMatch = ( aGolden == aOutput );
+	szResult = bMatch ? "matches" : "DIFFERS";
+	return bMatch;
+}
+
+//
+// do_benchmark
+//
+// Time fog_generate for palettes of 16, 256 and 4096 colours and a range of step counts,
+// with no remap and with each remap metric. Each case runs once to warm up, then as many
+// times as fit in 100ms; the best time is printed, with a hash of the table (and, with
+// -golden, how it compares to the stored one).
+//
+static void do_benchmark( const options_t& options )
+{
+	print_hello();
+
+	const uint32_t aPaletteSizes[] = { 16, 256, 4096 };
+	const int aSteps[] = { 8, 32, 256 };
+	const char* const aRemapNames[] = { "none", "rgb", "lab", "oklab" };
+
+	const int threads = int( task_thread_cap() );
+
+	printf( "Blend kernels: %s\n\n", cpu_level_name( cpu_level() ) );
+	printf( "  %-22s %8s %12s %10s %9s  %-16s\n", "case", "entries", "ms (build)", "ms", "Mentry/s", "hash" );
+
+	size_t uCases = 0;
+	size_t uDiffer = 0;
+
+	for ( uint32_t palette_size : aPaletteSizes )
+	{
+		const std::vector< uint32_t > aPalette = bench_palette( palette_size );
+
+		for ( int steps : aSteps )
+		{
+			for ( int remap = -1; remap < REMAP_COUNT; ++remap )
+			{
+				fog_settings_t settings;
+				settings.iSteps = steps;
+				settings.bRemap = ( remap >= 0 );
+				settings.remapMetric = settings.bRemap ? remap_metric_t( remap ) : REMAP_RGB;
+
+				ramp_t fog;
+				fog.colour = 0x406080;
+				settings.aRamps.push_back( fog );
+
+				// building the search is part of a run, so timed too.
+				const std::chrono::steady_clock::time_point build_start = std::chrono::steady_clock::now();
+
+				fog_palette_t palette;
+				palette.Create( aPalette.data(), aPalette.size() );
+				if ( settings.bRemap )
+				{
+					palette.AddRemap( settings.remapMetric );
+				}
+
+				const double build_ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - build_start ).count();
+
+				std::vector< uint32_t > aOutput( aPalette.size() * fog_levels( settings ) );
+				std::vector< size_t > aIndices( aOutput.size() );
+
+				fog_generate( palette, settings, aOutput.data(), aIndices.data(), threads );
+
+				double best_ms = 0;
+				double total_ms = 0;
+				for ( int run = 0; run == 0 || total_ms < 100.0; ++run )
+				{
+					const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+					fog_generate( palette, settings, aOutput.data(), aIndices.data(), threads );
+
+					const double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+					best_ms = ( run == 0 ) ? ms : std::min( best_ms, ms );
+					total_ms += ms;
+				}
+
+				const double fMegaEntriesPerSec = ( best_ms > 0 ) ? ( double( aOutput.size() ) / ( best_ms * 1000.0 ) ) : 0;
+				const uint64_t hash = bench_hash( kBenchHashSeed, reinterpret_cast< const uint8_t* >( aOutput.data() ), aOutput.size() * sizeof( uint32_t ) );
+
+				const std::string strCase = "p" + std::to_string( palette_size ) + "_s" + std::to_string( steps ) + "_" + aRemapNames[ remap + 1 ];
+
+				const char* szGolden = "";
+				if ( options.strGoldenFolder.empty() == false )
+				{
+					if ( bench_golden( aOutput, options.strGoldenFolder, strCase, szGolden ) == false )
+					{
+						++uDiffer;
+					}
+				}
+
+				printf( "  %-22s %8llu %12.3f %10.3f %9.2f  %016llx %s\n", strCase.c_str(), (unsigned long long)aOutput.size(), build_ms, best_ms, fMegaEntriesPerSec, (unsigned long long)hash, szGolden );
+				++uCases;
+			}
+		}
+	}
+
+	if ( options.strGoldenFolder.empty() == false )
+	{
+		printf( "\n%llu of %llu tables differ from the golden files.\n", (unsigned long long)uDiffer, (unsigned long long)uCases );
+	}
+}
+
 //
 // main
 //
@@ -581,7 +1520,25 @@ int main( int argc, char** argv )
 
 	if ( process_args( argc, argv, options ) )
 	{
-		do_work( options );
+		if ( options.bServe )
+		{
+			run_server( options );
+		}
+		else if ( options.bBenchmark )
+		{
+			do_benchmark( options );
+		}
+		else if ( options.strBatchFile.empty() )
+		{
+			if ( run_verified( options, [&]() { do_work( options ); } ) == false )
+			{
+				return 1;
+			}
+		}
+		else if ( run_verified( options, [&]() { do_batch( options ); } ) == false )
+		{
+			return 1;
+		}
 	}
 	else
 	{
@@ -28,81 +28,59 @@ SOFTWARE.
 //=============================================================================
 
 #include <algorithm>
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <direct.h>
-#include <io.h>
+#include <malloc.h>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#include <emmintrin.h> // SSE2
+#endif
 
 #include "png.h" // libpng
 
 #define STBI_WINDOWS_UTF8
-#define STB_IMAGE_IMPLEMENTATION
+#if !defined( IMGSIZE_LIBRARY )
+#define STB_IMAGE_IMPLEMENTATION // a library build takes it from palgen.cpp.
+#endif
 #include "stb_image.h"
 
-//=============================================================================
-
-struct dither_t
-{
-	uint8_t index;
-
-	float err_r;
-	float err_g;
-	float err_b;
-};
-
-struct dithermap_t
-{
-
-public:
-
-	dither_t* _data_ptr = nullptr;
-	size_t _width = 0;
-	size_t _height = 0;
-
-public:
-
-	void Create( size_t w, size_t h )
-	{
-		_width = w;
-		_height = h;
-		_data_ptr = new dither_t[ w * h + 1 ]; // +1 !
-	}
-
-	dither_t& Element( int x, int y )
-	{
-		return _data_ptr[ x + y * _width ];
-	}
-
-	const dither_t& Element( int x, int y ) const
-	{
-		return _data_ptr[ x + y * _width ];
-	}
-};
-
-struct color_t
-{
-	union
-	{
-		uint32_t value_abgr;
-		uint8_t chan[ 4 ]; // R, G, B, A
-	};
-
-public:
-
-	uint32_t BGR() const { return value_abgr & 0xFFFFFF; }
+#include "imgsize.h" // the library interface, and filter_t
+#include "palcore.h" // palettising core, shared with applypal
+#include "paltask.h"
+#include "palcpu.h"
+#include "paldeflate.h"
+#include "paltrace.h" // TRACE_ZONE, compiled out unless FRAGMENTS_TRACE or TRACY_ENABLE
+#include "palfind.h" // input wildcards, with ** for every folder below
+#include "palcache.h" // -cache, the artefacts kept between runs
+#include "palserve.h" // -serve, jobs from stdin or a pipe
+#include "palverify.h" // -verify, hashes of the outputs before they are encoded
+
+#ifdef FRAGMENTS_LIBWEBP
+#include <webp/encode.h> // -format webp, lossless
+#endif
 
-	void FromDither( dither_t& dither )
-	{
-		chan[ 0 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_r * 255.0f ) ), 0, 255 ) );
-		chan[ 1 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_g * 255.0f ) ), 0, 255 ) );
-		chan[ 2 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_b * 255.0f ) ), 0, 255 ) );
-		chan[ 3 ] = 0xFF;
-	}
-};
+//=============================================================================
 
 struct fcolor_t
 {
@@ -139,6 +117,10 @@ public:
 	color_t* _data_ptr = nullptr;
 	size_t _width = 0;
 	size_t _height = 0;
+	size_t _stride = 0; // pixels from one row to the next, wider than _width in a View.
+	image_buffer_t _buffer; // the pixels after Create, empty in a View.
+	bool _bHasAlpha = false; // a pixel that is not opaque, written as RGB/32.
+	int _orientation = 1; // EXIF: how the stored pixels are turned to be seen, 1 as they are.
 
 public:
 
@@ -146,126 +128,125 @@ public:
 	{
 		_width = w;
 		_height = h;
-		_data_ptr = new color_t[ w * h ];
+		_stride = w;
+		_data_ptr = static_cast< color_t* >( _buffer.Allocate( w * h * sizeof( color_t ) ) );
 	}
 
-	void CopyFromRGB( uint8_t* src )
+	// back to the pool before the image goes, after Create.
+	void Release()
 	{
-		color_t* pout = _data_ptr;
-		color_t* pend = _data_ptr + _width * _height;
-		while ( pout < pend )
-		{
-			pout->chan[ 0 ] = *src++;
-			pout->chan[ 1 ] = *src++;
-			pout->chan[ 2 ] = *src++;
-			pout->chan[ 3 ] = 0xFF;
-			++pout;
-		}
+		_buffer.Reset();
+		_data_ptr = nullptr;
 	}
 
-	void CopyFromRGBA( uint8_t* src )
+	color_t* Row( size_t y ) const
 	{
-		color_t* pout = _data_ptr;
-		color_t* pend = _data_ptr + _width * _height;
-		while ( pout < pend )
-		{
-			pout->chan[ 0 ] = *src++;
-			pout->chan[ 1 ] = *src++;
-			pout->chan[ 2 ] = *src++;
-			pout->chan[ 3 ] = *src++;
-			++pout;
-		}
+		return _data_ptr + y * _stride;
 	}
 
-	void Plot( int x, int y, color_t value )
+	// The w x h rectangle at (x, y), in place. Not to be released.
+	colormap_t View( size_t x, size_t y, size_t w, size_t h ) const
 	{
-		_data_ptr[ x + y * _width ] = value;
+		colormap_t view;
+		view._data_ptr = Row( y ) + x;
+		view._width = w;
+		view._height = h;
+		view._stride = _stride;
+		return view;
 	}
 
-	color_t Peek( int x, int y ) const
+	// The size of the image as it is seen, after _orientation: 5 to 8 turn it on its side.
+	size_t OrientedWidth() const
 	{
-		return _data_ptr[ x + y * _width ];
+		return ( _orientation >= 5 ) ? _height : _width;
 	}
 
-	color_t PeekClamp( int x, int y ) const
+	size_t OrientedHeight() const
 	{
-		if ( x < 0 ) x = 0;
-		else if ( x >= _width ) x = (int)_width - 1;
-
-		if ( y < 0 ) y = 0;
-		else if ( y >= _height ) y = (int)_height - 1;
-
-		return _data_ptr[ x + y * _width ];
+		return ( _orientation >= 5 ) ? _width : _height;
 	}
-};
 
-struct indexmap_t
-{
+	// Where row y of the image as it is seen starts, in pixels from _data_ptr, and in step
+	// the pixels from each of its pixels to the next.
+	ptrdiff_t OrientedStart( size_t y, ptrdiff_t& step ) const
+	{
+		const ptrdiff_t stride = ptrdiff_t( _stride );
+		const ptrdiff_t last_x = ptrdiff_t( _width ) - 1;
+		const ptrdiff_t last_y = ptrdiff_t( _height ) - 1;
+		const ptrdiff_t row = ptrdiff_t( y );
 
-public:
+		switch ( _orientation )
+		{
+		default:	step = 1;			return row * stride;
+		case 2:		step = -1;			return row * stride + last_x;				// mirrored
+		case 3:		step = -1;			return ( last_y - row ) * stride + last_x;	// 180
+		case 4:		step = 1;			return ( last_y - row ) * stride;			// flipped
+		case 5:		step = stride;		return row;									// transposed
+		case 6:		step = -stride;		return last_y * stride + row;				// 90 clockwise
+		case 7:		step = -stride;		return last_y * stride + last_x - row;		// transversed
+		case 8:		step = stride;		return last_x - row;						// 90 anticlockwise
+		}
+	}
 
-	uint8_t* _data_ptr = nullptr;
-	int _width = 0;
-	int _height = 0;
-	uint32_t _uStride = 0;
-	uint32_t _uBPP = 0;
-	uint32_t _uPixelsPerByte = 0;
+	// Row y of the image as it is seen. One that runs along a stored row left to right is
+	// returned in place, others are gathered into pBuffer (OrientedWidth() pixels).
+	const color_t* OrientedRow( size_t y, color_t* pBuffer ) const
+	{
+		ptrdiff_t step;
+		const color_t* pStart = _data_ptr + OrientedStart( y, step );
 
-public:
+		if ( step == 1 )
+		{
+			return pStart;
+		}
 
-	void Create( int w, int h, uint32_t bpp )
-	{
-		_width = w;
-		_height = h;
-		_uBPP = bpp;
+		const size_t width = OrientedWidth();
+		for ( size_t x = 0; x < width; ++x, pStart += step )
+		{
+			pBuffer[ x ] = *pStart;
+		}
 
-		_uPixelsPerByte = 8 / _uBPP;
-		_uStride = ( ( w + ( _uPixelsPerByte - 1 ) ) / _uPixelsPerByte );
-		const uint32_t payload = _uStride * _height;
-		_data_ptr = new uint8_t[ payload ];
+		return pBuffer;
 	}
 
-	void Plot( int x, int y, uint8_t value )
+	// The w x h rectangle at (x, y) of the image as it is seen, in place, still turned.
+	colormap_t OrientedView( size_t x, size_t y, size_t w, size_t h ) const
 	{
-		const int byte_x = x / _uPixelsPerByte; // which byte are we editing?
-		const int frac_x = x - ( byte_x * _uPixelsPerByte ); // which pixel in the byte?
-		const int shift = ( _uPixelsPerByte - 1 - frac_x ) * _uBPP;
+		colormap_t view;
 
-		uint8_t* byte_ptr = _data_ptr + ( (size_t)y * _uStride ) + byte_x;
-
-		switch ( _uBPP )
+		switch ( _orientation )
 		{
+		default:	view = View( x, y, w, h ); break;
+		case 2:		view = View( _width - x - w, y, w, h ); break;
+		case 3:		view = View( _width - x - w, _height - y - h, w, h ); break;
+		case 4:		view = View( x, _height - y - h, w, h ); break;
+		case 5:		view = View( y, x, h, w ); break;
+		case 6:		view = View( y, _height - x - w, h, w ); break;
+		case 7:		view = View( _width - y - h, _height - x - w, h, w ); break;
+		case 8:		view = View( _width - y - h, x, h, w ); break;
+		}
 
-		case 1:
-			{
-				const uint8_t mask = 0x01 << shift;
-				*byte_ptr = ( *byte_ptr & ~mask ) | ( ( value & 0x01 ) << shift );
-			}
-			break;
+		view._orientation = _orientation;
+		return view;
+	}
 
-		case 2:
-			{
-				const uint8_t mask = 0x03 << shift;
-				*byte_ptr = ( *byte_ptr & ~mask ) | ( ( value & 0x03 ) << shift );
-			}
-			break;
+	void Plot( size_t x, size_t y, color_t value )
+	{
+		_data_ptr[ x + y * _stride ] = value;
+	}
 
-		case 4:
-			{
-				const uint8_t mask = 0x0F << shift;
-				*byte_ptr = ( *byte_ptr & ~mask ) | ( ( value & 0x0F ) << shift );
-			}
-			break;
+	color_t Peek( size_t x, size_t y ) const
+	{
+		return _data_ptr[ x + y * _stride ];
+	}
 
-		case 8:
-			{
-				*byte_ptr = value; // just set!
-			}
-			break;
+	color_t PeekClamp( ptrdiff_t x, ptrdiff_t y ) const
+	{
+		const size_t cx = size_t( std::clamp< ptrdiff_t >( x, 0, ptrdiff_t( _width ) - 1 ) );
+		const size_t cy = size_t( std::clamp< ptrdiff_t >( y, 0, ptrdiff_t( _height ) - 1 ) );
 
-		}; // switch ( uBPP )
+		return _data_ptr[ cx + cy * _stride ];
 	}
-
 };
 
 //=============================================================================
@@ -293,70 +274,243 @@ static void png_warn_fn( png_structp png_ptr, png_const_charp error_message )
 	printf( "png warning: %s\n", error_message );
 }
 
-//=============================================================================
+static void png_read_warn_fn( png_structp png_ptr, png_const_charp error_message )
+{
+	// stub - stb_image ignores the same problems (e.g. known incorrect sRGB profiles).
+}
 
-static int rgb_color_distance_squared( color_t colour1, color_t colour2 )
+static void png_read_data_fn( png_structp png_ptr, png_bytep p_data, png_size_t size )
 {
-	int x;
-	int delta;
+	// Get our FILE pointer, and read data from it.
+	FILE* fp = reinterpret_cast<FILE*>( png_get_io_ptr( png_ptr ) );
+	if ( fread( p_data, 1, size, fp ) != size )
+	{
+		png_error( png_ptr, "unexpected end of file" );
+	}
+}
 
-	x = static_cast<int>( colour1.chan[ 0 ] ) - static_cast<int>( colour2.chan[ 0 ] );
-	delta = x * x;
+//
+// png_reader_t
+//
+// Reads a PNG a row at a time as 8-bit RGBA, for -stream and for loading PNGs whole (with
+// libpng's SSE2 filters, and without stb_image's copy of the file). Only 8 and 16-bit RGB
+// and palette PNGs that are not interlaced are read this way; 16-bit channels keep their
+// top byte, as stb_image does. Anything else is left to stb_image.
+//
+struct png_reader_t
+{
 
-	x = static_cast<int>( colour1.chan[ 1 ] ) - static_cast<int>( colour2.chan[ 1 ] );
-	delta += x * x;
+public:
 
-	x = static_cast<int>( colour1.chan[ 2 ] ) - static_cast<int>( colour2.chan[ 2 ] );
-	delta += x * x;
+	FILE* _fp = nullptr;
+	png_structp _png_ptr = nullptr;
+	png_infop _info_ptr = nullptr;
+	uint32_t _width = 0;
+	uint32_t _height = 0;
+	bool _bHasAlpha = false; // an alpha channel, or a tRNS chunk
+	bool _bFailed = false;
 
-	return delta;
-}
+public:
 
-static uint8_t find_nearest_palette_index( const color_t& colour1, std::vector< color_t >& aPalette )
-{
-	size_t best_index = 0;
-	int best_score = rgb_color_distance_squared( colour1, aPalette[ 0 ] );
+	~png_reader_t()
+	{
+		Close();
+	}
+
+	bool Open( const std::string& strFile )
+	{
+		if ( fopen_s( &_fp, strFile.c_str(), "rb" ) != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			return false;
+		}
+
+		png_byte header[ 8 ];
+		if ( fread( header, 1, 8, _fp ) != 8 || png_sig_cmp( header, 0, 8 ) != 0 )
+		{
+			return false;
+		}
+
+		_png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_read_warn_fn );
+		if ( _png_ptr == nullptr )
+		{
+			return false;
+		}
+
+		// up to what PNG itself allows, past libpng's default of a million pixels a side.
+		png_set_user_limits( _png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+		_info_ptr = png_create_info_struct( _png_ptr );
+		if ( _info_ptr == nullptr )
+		{
+			return false;
+		}
+
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			png_set_read_fn( _png_ptr, _fp, png_read_data_fn );
+			png_set_sig_bytes( _png_ptr, 8 );
+			png_read_info( _png_ptr, _info_ptr );
+
+			const int colour_type = png_get_color_type( _png_ptr, _info_ptr );
+
+			// grey images are rejected (as 1 or 2 channel) by the stb_image path.
+			if ( ( colour_type & PNG_COLOR_MASK_COLOR ) == 0 || png_get_interlace_type( _png_ptr, _info_ptr ) != PNG_INTERLACE_NONE )
+			{
+				return false;
+			}
+
+			_width = png_get_image_width( _png_ptr, _info_ptr );
+			_height = png_get_image_height( _png_ptr, _info_ptr );
+			_bHasAlpha = ( colour_type & PNG_COLOR_MASK_ALPHA ) || png_get_valid( _png_ptr, _info_ptr, PNG_INFO_tRNS );
+
+			// to 8-bit RGBA.
+			png_set_expand( _png_ptr );
+			png_set_strip_16( _png_ptr );
+			png_set_filler( _png_ptr, 0xFF, PNG_FILLER_AFTER );
+			png_read_update_info( _png_ptr, _info_ptr );
 
-	for ( size_t i = 1; i < aPalette.size(); ++i )
+			if ( png_get_rowbytes( _png_ptr, _info_ptr ) != size_t( _width ) * 4 )
+			{
+				return false;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Read the next row, as RGBA, straight into pRow. After an error the rest of the rows are
+	// left black.
+	void ReadRow( color_t* pRow )
+	{
+		if ( _bFailed == false )
+		{
+			jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+			if ( setjmp( *p_jmp_buf ) != -1 )
+			{
+				png_read_row( _png_ptr, reinterpret_cast< png_bytep >( pRow ), nullptr );
+			}
+			else
+			{
+				_bFailed = true;
+			}
+		}
+
+		if ( _bFailed )
+		{
+			std::fill( pRow, pRow + _width, color_t( 0 ) );
+		}
+	}
+
+	// Read every row into image, made to fit. False if any of them could not be read.
+	bool ReadImage( colormap_t& image )
+	{
+		image.Create( _width, _height );
+
+		for ( size_t y = 0; y < _height; ++y )
+		{
+			ReadRow( image.Row( y ) );
+		}
+
+		return _bFailed == false;
+	}
+
+	void Close()
 	{
-		int score = rgb_color_distance_squared( colour1, aPalette[ i ] );
+		if ( _png_ptr != nullptr )
+		{
+			png_destroy_read_struct( &_png_ptr, ( _info_ptr != nullptr ) ? &_info_ptr : nullptr, nullptr );
+			_png_ptr = nullptr;
+			_info_ptr = nullptr;
+		}
 
-		if ( score <= best_score )
+		if ( _fp != nullptr )
 		{
-			best_score = score;
-			best_index = i;
+			fclose( _fp );
+			_fp = nullptr;
 		}
 	}
+};
+
+//=============================================================================
 
-	return (uint8_t)best_index;
+typedef enum
+{
+	GEOMETRY_STRETCH, // to -w x -h, or to the aspect with -aspect.
+	GEOMETRY_FIT, // -fit
+	GEOMETRY_FILL, // -fill
+	GEOMETRY_CROP, // -crop
 }
+geometry_t;
 
 typedef enum
 {
-	FILTER_NEAREST,
-	FILTER_BILINEAR,
+	FORMAT_PNG, // .png
+	FORMAT_QOI, // .qoi
+	FORMAT_RAW, // .rgba
+	FORMAT_DDS, // .dds
+	FORMAT_WEBP, // .webp, lossless, in builds with FRAGMENTS_LIBWEBP
+	FORMAT_PAL, // _pal.png, the -pal palette applied to the resized image, in a -format list.
 }
-filter_t;
+format_t;
+
+static const char* const kFormatExtension[] = { ".png", ".qoi", ".rgba", ".dds", ".webp", "_pal.png" };
+
+struct gpu_resizer_t;
+
+// -sharpen 1 takes this much of each neighbouring output away, on each axis: about as
+// crisp as an unsharp mask of amount 1 over a radius of one output pixel.
+static constexpr double kSharpenScale = 0.25;
+
+// in a namespace of this file's own, as a library build shares a binary with palgen.cpp.
+namespace
+{
 
 struct options_t
 {
-	size_t width = 0;
-	size_t height = 0;
+	std::vector< size_t > aWidths; // -w, one or more.
+	std::vector< size_t > aHeights; // -h
 	bool aspect_preserve = false;
+	bool mips = false; // -mips
+	uint32_t uThreadCount = 1; // -j
+	bool stream = false; // -stream
+	bool linear = false; // -linear
+	bool deep = false; // -deep
+	double fSharpen = 0.0; // -sharpen, as the s of resample_weights_t.
+	bool bGpu = false; // -gpu
+	bool bBenchmark = false; // -bench
+	bool bServe = false; // -serve
+	std::string strServe; // -serve=<name>: the pipe or socket, or stdin if empty.
+	gpu_resizer_t* pGpu = nullptr; // the -gpu device, if one could be made.
 
 	filter_t filter = FILTER_NEAREST;
+	geometry_t geometry = GEOMETRY_STRETCH;
+	format_t format = FORMAT_PNG; // -format, or the extension of -o.
+	std::vector< format_t > aFormats; // -format <a>,<b>,...: every output in each, from the one resize. Empty for one format.
 
 	std::string strPaletteFile;
-	std::vector< color_t > aPalette;
+	palette_t aPalette; // with the cube of its nearest colours, from index 0 by RGB.
 
-	std::set< std::string > aInputFiles;
+	std::vector< std::string > aInputFiles;
 
 	bool bDither = false;
 
 	std::string strOutFile;
 	std::string strOutFolder;
+	std::string strCacheFolder; // -cache
+	artefact_cache_t cache; // the -cache folder, open from do_work.
+	std::string strVerifyFile; // -verify
+	verify_manifest_t* pVerify = nullptr; // -verify: open from do_work.
+	size_t uResizeThreads = 0; // imgsize_resize's threads, or 0 for the cores left over by -j.
 };
 
+} // namespace
+
 //=============================================================================
 
 //
@@ -379,18 +533,30 @@ static void print_hello()
 static void print_help()
 {
 	// Usage
-	printf( " USAGE: imgsize.exe [-?] -w <width> -h <height> -aspect [-pal <palette> [-dither]]\n" );
-	printf( "                    [-nearest|-bilinear]\n" );
-	printf( "                    <image>[...] [-o <image>]|[-outdir <folder>]\n" );
+	printf( " USAGE: imgsize.exe [-?] -w <width>[,...] -h <height>[,...] [-aspect|-fit|-fill|-crop] [-mips]\n" );
+	printf( "                    [-pal <palette> [-dither]]\n" );
+	printf( "                    [-nearest|-bilinear|-area|-mitchell|-lanczos] [-linear] [-deep] [-sharpen <amount>]\n" );
+	printf( "                    [-gpu] [-cpu <level>] [-deflate <backend>]\n" );
+	printf( "                    <image>[...] [-o <image>]|[-outdir <folder>] [-j <count>] [-stream]\n" );
+	printf( "                    [-format <png|qoi|rgba|dds|webp|pal>[,...]] [-cache <folder>] [-verify <file>]\n" );
+	printf( "        imgsize.exe -serve[=<name>]\n" );
+	printf( "        imgsize.exe -bench [-linear] [-cpu <level>] [<image>...]\n" );
 	putchar( '\n' );
 
 	// Options
 	printf( "  -?                 This help.\n" );
 
 	putchar( '\n' );
-	printf( "  -w <width>         Output width in pixels.\n" );
-	printf( "  -h <height>        Output height in pixels.\n" );
+	printf( "  -w <width>[,...]   Output width in pixels. A list makes one output of each size,\n" );
+	printf( "                     named <image>_<width>x<height>.png, from one load.\n" );
+	printf( "  -h <height>[,...]  Output height in pixels.\n" );
 	printf( "  -aspect            Preserve aspect ratio if either width or height is omitted.\n" );
+	printf( "  -fit               Scale to fit within width x height, keeping the aspect ratio.\n" );
+	printf( "  -fill              Scale to cover width x height, keeping the aspect ratio, and\n" );
+	printf( "                     crop the centre of it.\n" );
+	printf( "  -crop              Crop the centre width x height of the image, without scaling.\n" );
+	printf( "  -mips              Also make each half size below the output, down to 1 x 1.\n" );
+	printf( "                     Without -w or -h the chain starts at the image's own size.\n" );
 
 	putchar( '\n' );
 	printf( "  -pal <palette>     Palette file to apply (in .HEX format)\n" );
@@ -399,108 +565,170 @@ static void print_help()
 	putchar( '\n' );
 	printf( "  -nearest           Filter mode: Nearest [default]\n" );
 	printf( "  -bilinear          Filter mode: Bilinear\n" );
+	printf( "  -area              Filter mode: Area average (box)\n" );
+	printf( "  -mitchell          Filter mode: Mitchell-Netravali bicubic\n" );
+	printf( "  -lanczos           Filter mode: Lanczos3\n" );
+	printf( "  -linear            Filter in linear light, so fine detail keeps its brightness.\n" );
+	printf( "  -deep              Resample in 15-bit channels (all 16 of a 16-bit source are read),\n" );
+	printf( "                     rounding to bytes once per output, not once per size of a chain.\n" );
+	printf( "  -sharpen <amount>  Sharpen (0 to 1) as it is resampled, in the filter's own taps.\n" );
+	printf( "  -gpu               Resize with a Direct3D 11 compute shader, or the CPU if unavailable.\n" );
+	printf( "  -cpu <level>       Resample kernels: scalar, sse2, sse4.1, avx2, avx512, neon or native.\n" );
+	printf( "                     [Default=native]\n" );
+	printf( "  -deflate <backend> -pal PNG compression: zlib, or libdeflate (in builds with\n" );
+	printf( "                     FRAGMENTS_LIBDEFLATE), which compresses each image whole.\n" );
+	printf( "                     [Default=libdeflate if built in]\n" );
 
 	putchar( '\n' );
-	printf( "  <image>[...]       Add image(s) to the processing list. Wildcards supported.\n" );
+	printf( "  <image>[...]       Add image(s) to the processing list. Wildcards supported,\n" );
+	printf( "                     with ** for every folder below (art\\**\\*.png).\n" );
 
 	putchar( '\n' );
 	printf( "  -o <file>          Specify an output file. Not supported with multiple images.\n" );
 	printf( "  -outdir <folder>   Specify an output folder. Ignored if -o is used.\n" );
+	printf( "  -format <format>   png [default], qoi (fast to write and read), rgba (raw, a 32 byte\n" );
+	printf( "                     header then RGBA rows) or dds (BC1, or BC3 with alpha, and one file\n" );
+	printf( "                     for all of -mips). -o picks one by its extension. webp is lossless,\n" );
+	printf( "                     in builds with FRAGMENTS_LIBWEBP. A list (png,webp,pal) writes each\n" );
+	printf( "                     output in every format from the one resize, the writers side by side;\n" );
+	printf( "                     pal is the -pal palette applied to it, as <image>_pal.png.\n" );
+	printf( "  -j <count>         Number of images to process in parallel, at most the CPU count or\n" );
+	printf( "                     FRAGMENTS_THREADS. [Default=1]\n" );
+	printf( "  -stream            Resize PNGs a row at a time as they are read and written, in memory\n" );
+	printf( "                     that does not grow with their height. One size, no -pal. Wide outputs\n" );
+	printf( "                     are resized in column tiles, on the cores left over by -j.\n" );
+	printf( "  -cache <folder>    Keep the outputs in <folder>, by the source and options. A later run\n" );
+	printf( "                     links the kept outputs in, without loading images that are unchanged.\n" );
+	printf( "                     The folder may be shared by any number of runs, and is held to\n" );
+	printf( "                     FRAGMENTS_CACHE_MB (4096 if unset), the outputs used longest ago going.\n" );
+	printf( "  -verify <file>     Hash each output's pixels (or indices and palette) before it is encoded\n" );
+	printf( "                     and write the hashes to <file>; or, if <file> is there, compare them\n" );
+	printf( "                     with it and fail if any differ. Every output is made, none cached or\n" );
+	printf( "                     copied.\n" );
+
+	putchar( '\n' );
+	printf( "  -serve[=<name>]    Read jobs from stdin, or from clients of the named pipe (a Unix socket\n" );
+	printf( "                     off Windows) <name>, one line of the options above each, run in turn\n" );
+	printf( "                     with the palette cubes kept. Each job's log is followed by\n" );
+	printf( "                     \"#<line> OK <ms>ms\" or \"#<line> FAILED <ms>ms\". A line of -stop ends it.\n" );
+	printf( "  -bench             Time each filter at several ratios and thread counts on synthetic\n" );
+	printf( "                     images (and any <image>s), with PSNR and SSIM against a double\n" );
+	printf( "                     precision Lanczos3. No output is written.\n" );
 
 	putchar( '\n' );
 	putchar( '\n' );
 }
 
 //
-// load_palette
+// parse_size_list
 //
-// Parse a .hex file output by "aseprite". A simple list of \n separated 6 byte ASCII hex values.
+// Comma separated sizes in pixels, added to aSizes. False if any is not above zero.
 //
-static bool load_palette( const char* szFileName, std::vector<color_t>& aPalette )
+static bool parse_size_list( const char* szArg, std::vector< size_t >& aSizes )
 {
-	// Load input palette file - keep it open to prevent common user error of overwriting input!
-	std::ifstream fileInput( szFileName );
-	if ( fileInput.is_open() == false )
-	{
-		return false;
-	}
+	const char* p = szArg;
 
-	while ( !fileInput.eof() )
+	for ( ; ; )
 	{
-		std::string line;
-		std::getline( fileInput, line );
-
-		if ( line.length() != 6 )
+		const int v = atol( p );
+		if ( v <= 0 )
 		{
-			break;
+			return false;
 		}
 
-		char* pEnd = nullptr;
-		uint32_t colour = std::strtoul( line.c_str(), &pEnd, 16 );
+		aSizes.push_back( size_t( v ) );
 
-		if ( pEnd == line.c_str() )
+		p = strchr( p, ',' );
+		if ( p == nullptr )
 		{
-			break;
+			return true;
 		}
 
-		color_t c;
-		c.chan[ 0 ] = ( colour >> 16 ) & 0xFF; // RED
-		c.chan[ 1 ] = ( colour >> 8 ) & 0xFF; // GREEN
-		c.chan[ 2 ] = ( colour ) & 0xFF; // BLUE
-		c.chan[ 3 ] = 0xFF; // ALPHA
-
-		aPalette.push_back( c );
+		++p;
 	}
-
-	// Usable palette?
-	return ( aPalette.size() >= 2 );
 }
 
 //
-// add_files_wildcard
+// parse_format
 //
-// Add a file to an array. Supports wildcards like *.png, so multiple files may be added.
+// An output format by name or extension (without the dot). False if it is not one.
 //
-static void add_files_wildcard( const char* szWildCard, std::set< std::string >& aFiles )
+static bool parse_format( const char* szArg, format_t& format )
 {
-	// printf( "scan input %s\n", szWildCard );
-
-	// split argument into path and file.
-	std::string path = szWildCard;
-	size_t slash_find = path.find_last_of( "/\\", path.npos ); // either kind of path separators
-	if ( slash_find == path.npos )
+	if ( _stricmp( szArg, "png" ) == 0 )
+	{
+		format = FORMAT_PNG;
+	}
+	else if ( _stricmp( szArg, "qoi" ) == 0 )
+	{
+		format = FORMAT_QOI;
+	}
+	else if ( _stricmp( szArg, "rgba" ) == 0 || _stricmp( szArg, "raw" ) == 0 )
+	{
+		format = FORMAT_RAW;
+	}
+	else if ( _stricmp( szArg, "dds" ) == 0 )
+	{
+		format = FORMAT_DDS;
+	}
+	else if ( _stricmp( szArg, "webp" ) == 0 )
+	{
+		format = FORMAT_WEBP;
+	}
+	else if ( _stricmp( szArg, "pal" ) == 0 )
 	{
-		path.clear();
+		format = FORMAT_PAL;
 	}
 	else
 	{
-		path = path.substr( 0, slash_find + 1 );
-		// printf( "from path %s\n", path.c_str() );
+		return false;
 	}
 
-	struct _finddata_t fileinfo;
+	return true;
+}
+
+//
+// parse_formats
+//
+// -format: one format, or a comma separated list of them. False if one is not a format.
+//
+static bool parse_formats( const char* szArg, options_t& options )
+{
+	options.aFormats.clear();
 
-	// Start the search
-	intptr_t handle = _findfirst( szWildCard, &fileinfo );
-	if ( handle != -1L )
+	std::istringstream list( szArg );
+	std::string strFormat;
+	while ( std::getline( list, strFormat, ',' ) )
 	{
-		do
+		format_t format;
+		if ( parse_format( strFormat.c_str(), format ) == false )
 		{
-			// A file, not a sub-directory?
-			if ( !( fileinfo.attrib & _A_SUBDIR ) )
-			{
-				std::string filepath;
-				filepath = path + fileinfo.name;
-
-				// printf( "found %s\n", filepath.c_str() );
+			return false;
+		}
 
-				aFiles.insert( filepath );
-			}
+		if ( std::find( options.aFormats.begin(), options.aFormats.end(), format ) == options.aFormats.end() )
+		{
+			options.aFormats.push_back( format );
 		}
-		while ( _findnext( handle, &fileinfo ) == 0 ); // Get the next one
+	}
+
+	if ( options.aFormats.empty() )
+	{
+		return false;
+	}
 
-		_findclose( handle );
+	// just the one is written as ever. A list's outputs are named after its first RGB format.
+	if ( options.aFormats.size() == 1 )
+	{
+		options.format = options.aFormats[ 0 ];
+		options.aFormats.clear();
+	}
+	else
+	{
+		options.format = ( options.aFormats[ 0 ] == FORMAT_PAL ) ? options.aFormats[ 1 ] : options.aFormats[ 0 ];
 	}
+
+	return true;
 }
 
 //
@@ -516,6 +744,13 @@ static bool process_args( int argc, char** argv, options_t& options )
 	bool bNextArgIsPalette = false;
 	bool bNextArgIsOutFile = false;
 	bool bNextArgIsOutFolder = false;
+	bool bNextArgIsJobs = false;
+	bool bNextArgIsCacheFolder = false;
+	bool bNextArgIsVerifyFile = false;
+	bool bNextArgIsFormat = false;
+	bool bNextArgIsSharpen = false;
+	bool bNextArgIsCpu = false;
+	bool bNextArgIsDeflate = false;
 
 	// Parse Command Line
 	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
@@ -525,30 +760,20 @@ static bool process_args( int argc, char** argv, options_t& options )
 		if ( bNextArgIsWidth )
 		{
 			bNextArgIsWidth = false;
-			int w = atol( szArg );
-			if ( w <= 0 )
+			if ( parse_size_list( szArg, options.aWidths ) == false )
 			{
-				std::cout << "Error - invalid width \"" << w << "\"";
+				std::cout << "Error - invalid width \"" << szArg << "\"";
 				return false;
 			}
-			else
-			{
-				options.width = uint32_t( w );
-			}
 		}
 		else if ( bNextArgIsHeight )
 		{
 			bNextArgIsHeight = false;
-			int h = atol( szArg );
-			if ( h <= 0 )
+			if ( parse_size_list( szArg, options.aHeights ) == false )
 			{
-				std::cout << "Error - invalid height \"" << h << "\"";
+				std::cout << "Error - invalid height \"" << szArg << "\"";
 				return false;
 			}
-			else
-			{
-				options.height = uint32_t( h );
-			}
 		}
 		else if ( bNextArgIsOutFile )
 		{
@@ -560,33 +785,95 @@ static bool process_args( int argc, char** argv, options_t& options )
 			bNextArgIsOutFolder = false;
 			options.strOutFolder = szArg;
 		}
-		else if ( bNextArgIsPalette )
+		else if ( bNextArgIsCacheFolder )
 		{
-			bNextArgIsPalette = false;
-
-			bool bFailed = false;
-
-			if ( load_palette( szArg, options.aPalette ) == false )
-			{
-				std::cout << "Error - failed to load palette from \"" << szArg << "\"";
-				bFailed = true;
-			}
-
-			if ( bFailed == false )
+			bNextArgIsCacheFolder = false;
+			options.strCacheFolder = szArg;
+		}
+		else if ( bNextArgIsVerifyFile )
+		{
+			bNextArgIsVerifyFile = false;
+			options.strVerifyFile = szArg;
+		}
+		else if ( bNextArgIsFormat )
+		{
+			bNextArgIsFormat = false;
+			if ( parse_formats( szArg, options ) == false )
 			{
-				if ( options.aPalette.size() < 2 )
-				{
-					std::cout << "Error - the palette loaded from \"" << szArg << "\" is too small (" << options.aPalette.size() << " entries).\n";
-					bFailed = true;
-				}
-				else if ( options.aPalette.size() > 256 )
-				{
-					std::cout << "Error - the palette loaded from \"" << szArg << "\" has over 256 entries (" << options.aPalette.size() << ") and is too big.\n";
-					bFailed = true;
-				}
+				std::cout << "Error - unknown output format \"" << szArg << "\"";
+				return false;
 			}
-
-			if ( bFailed )
+		}
+		else if ( bNextArgIsSharpen )
+		{
+			bNextArgIsSharpen = false;
+			const double fAmount = atof( szArg );
+			if ( fAmount <= 0.0 || fAmount > 1.0 )
+			{
+				std::cout << "Error - -sharpen takes an amount above 0, up to 1.\n";
+				return false;
+			}
+			options.fSharpen = fAmount * kSharpenScale;
+		}
+		else if ( bNextArgIsCpu )
+		{
+			bNextArgIsCpu = false;
+			if ( cpu_select( szArg ) == false )
+			{
+				std::cout << "Error - unknown or unsupported SIMD level \"" << szArg << "\" (this CPU has " << cpu_level_name( cpu_detect() ) << ").\n";
+				return false;
+			}
+		}
+		else if ( bNextArgIsDeflate )
+		{
+			bNextArgIsDeflate = false;
+			if ( deflate_select( szArg ) == false )
+			{
+				std::cout << "Error - unknown deflate \"" << szArg << "\" (zlib, or libdeflate in builds with FRAGMENTS_LIBDEFLATE).\n";
+				return false;
+			}
+		}
+		else if ( bNextArgIsJobs )
+		{
+			bNextArgIsJobs = false;
+			int iJobs = atol( szArg );
+			if ( iJobs <= 0 )
+			{
+				std::cout << "Error - invalid job count \"" << szArg << "\"";
+				return false;
+			}
+			else
+			{
+				options.uThreadCount = std::min( unsigned( iJobs ), task_thread_cap() );
+			}
+		}
+		else if ( bNextArgIsPalette )
+		{
+			bNextArgIsPalette = false;
+
+			bool bFailed = false;
+
+			if ( options.aPalette.Load( szArg ) == false )
+			{
+				std::cout << "Error - failed to load palette from \"" << szArg << "\"";
+				bFailed = true;
+			}
+
+			if ( bFailed == false )
+			{
+				if ( options.aPalette.size() < 2 )
+				{
+					std::cout << "Error - the palette loaded from \"" << szArg << "\" is too small (" << options.aPalette.size() << " entries).\n";
+					bFailed = true;
+				}
+				else if ( options.aPalette.size() > 256 )
+				{
+					std::cout << "Error - the palette loaded from \"" << szArg << "\" has over 256 entries (" << options.aPalette.size() << ") and is too big.\n";
+					bFailed = true;
+				}
+			}
+
+			if ( bFailed )
 			{
 				return false;
 			}
@@ -603,6 +890,22 @@ static bool process_args( int argc, char** argv, options_t& options )
 		{
 			options.aspect_preserve = true;
 		}
+		else if ( _stricmp( szArg, "-fit" ) == 0 )
+		{
+			options.geometry = GEOMETRY_FIT;
+		}
+		else if ( _stricmp( szArg, "-fill" ) == 0 )
+		{
+			options.geometry = GEOMETRY_FILL;
+		}
+		else if ( _stricmp( szArg, "-crop" ) == 0 )
+		{
+			options.geometry = GEOMETRY_CROP;
+		}
+		else if ( _stricmp( szArg, "-mips" ) == 0 )
+		{
+			options.mips = true;
+		}
 		else if ( _stricmp( szArg, "-nearest" ) == 0 )
 		{
 			options.filter = FILTER_NEAREST;
@@ -611,6 +914,42 @@ static bool process_args( int argc, char** argv, options_t& options )
 		{
 			options.filter = FILTER_BILINEAR;
 		}
+		else if ( _stricmp( szArg, "-area" ) == 0 )
+		{
+			options.filter = FILTER_AREA;
+		}
+		else if ( _stricmp( szArg, "-mitchell" ) == 0 )
+		{
+			options.filter = FILTER_MITCHELL;
+		}
+		else if ( _stricmp( szArg, "-lanczos" ) == 0 )
+		{
+			options.filter = FILTER_LANCZOS3;
+		}
+		else if ( _stricmp( szArg, "-linear" ) == 0 )
+		{
+			options.linear = true;
+		}
+		else if ( _stricmp( szArg, "-deep" ) == 0 )
+		{
+			options.deep = true;
+		}
+		else if ( _stricmp( szArg, "-sharpen" ) == 0 )
+		{
+			bNextArgIsSharpen = true;
+		}
+		else if ( _stricmp( szArg, "-gpu" ) == 0 )
+		{
+			options.bGpu = true;
+		}
+		else if ( _stricmp( szArg, "-cpu" ) == 0 )
+		{
+			bNextArgIsCpu = true;
+		}
+		else if ( _stricmp( szArg, "-deflate" ) == 0 )
+		{
+			bNextArgIsDeflate = true;
+		}
 		else if ( _stricmp( szArg, "-w" ) == 0 )
 		{
 			bNextArgIsWidth = true;
@@ -631,36 +970,177 @@ static bool process_args( int argc, char** argv, options_t& options )
 		{
 			bNextArgIsOutFolder = true;
 		}
+		else if ( _stricmp( szArg, "-cache" ) == 0 )
+		{
+			bNextArgIsCacheFolder = true;
+		}
+		else if ( _stricmp( szArg, "-verify" ) == 0 )
+		{
+			bNextArgIsVerifyFile = true;
+		}
+		else if ( _stricmp( szArg, "-format" ) == 0 )
+		{
+			bNextArgIsFormat = true;
+		}
+		else if ( _stricmp( szArg, "-j" ) == 0 )
+		{
+			bNextArgIsJobs = true;
+		}
+		else if ( _stricmp( szArg, "-stream" ) == 0 )
+		{
+			options.stream = true;
+		}
 		else if ( _stricmp( szArg, "-dither" ) == 0 )
 		{
 			options.bDither = true;
 		}
+		else if ( _stricmp( szArg, "-serve" ) == 0 )
+		{
+			options.bServe = true;
+		}
+		else if ( _strnicmp( szArg, "-serve=", 7 ) == 0 && szArg[ 7 ] != '\0' )
+		{
+			options.bServe = true;
+			options.strServe = szArg + 7;
+		}
+		else if ( _stricmp( szArg, "-bench" ) == 0 )
+		{
+			options.bBenchmark = true;
+		}
 		else
 		{
 			// assume it's input files.
-			add_files_wildcard( szArg, options.aInputFiles );
+			find_files( szArg, options.aInputFiles );
 		}
 
 	}; // for each command line argument
 
+	sort_files( options.aInputFiles );
+
+	// the jobs bring their own sizes and images.
+	if ( options.bServe )
+	{
+		return true;
+	}
+
+	// the benchmark makes its own sizes, and images are optional.
+	if ( options.bBenchmark )
+	{
+		return true;
+	}
+
 	if ( options.aInputFiles.empty() )
 	{
 		std::cout << "Error - no input file(s) specified.\n";
 		return false;
 	}
 
-	if ( options.width == 0 && !( options.height && options.aspect_preserve ) )
+	// an output file's own extension picks its format, others are written as -format. A
+	// list names each output after it.
+	const size_t dot_find = options.strOutFile.find_last_of( '.' );
+	if ( options.aInputFiles.size() == 1 && dot_find != options.strOutFile.npos && options.aFormats.empty() )
+	{
+		parse_format( options.strOutFile.c_str() + dot_find + 1, options.format );
+	}
+
+#ifndef FRAGMENTS_LIBWEBP
+	if ( options.format == FORMAT_WEBP || std::count( options.aFormats.begin(), options.aFormats.end(), FORMAT_WEBP ) )
+	{
+		std::cout << "Error - webp needs a build with FRAGMENTS_LIBWEBP.\n";
+		return false;
+	}
+#endif
+
+	// -format pal alone is -pal as ever.
+	if ( options.format == FORMAT_PAL && options.aFormats.empty() )
+	{
+		options.format = FORMAT_PNG;
+
+		if ( options.aPalette.empty() )
+		{
+			std::cout << "Error - -format pal needs a -pal.\n";
+			return false;
+		}
+	}
+
+	if ( options.aFormats.empty() == false )
+	{
+		const bool bPal = std::count( options.aFormats.begin(), options.aFormats.end(), FORMAT_PAL ) > 0;
+
+		if ( bPal != ( options.aPalette.empty() == false ) )
+		{
+			std::cout << "Error - a -format list with pal needs a -pal, and a -pal is only written as its pal.\n";
+			return false;
+		}
+
+		if ( options.stream || ( options.mips && std::count( options.aFormats.begin(), options.aFormats.end(), FORMAT_DDS ) ) )
+		{
+			std::cout << "Error - a -format list is not for -stream, or -mips with dds.\n";
+			return false;
+		}
+	}
+	else if ( options.format != FORMAT_PNG && options.aPalette.size() )
+	{
+		std::cout << "Error - -pal writes indexed .png only.\n";
+		return false;
+	}
+
+	const bool bFromSource = options.mips && options.aWidths.empty() && options.aHeights.empty();
+
+	if ( options.aWidths.empty() && !( options.aHeights.size() && options.aspect_preserve ) && !bFromSource )
 	{
 		std::cout << "Error - no output width was specified.\n";
 		return false;
 	}
 
-	if ( options.height == 0 && !( options.width && options.aspect_preserve ) )
+	if ( options.aHeights.empty() && !( options.aWidths.size() && options.aspect_preserve ) && !bFromSource )
 	{
 		std::cout << "Error - no output height was specified.\n";
 		return false;
 	}
 
+	if ( options.geometry != GEOMETRY_STRETCH && ( options.aWidths.empty() || options.aHeights.empty() ) )
+	{
+		std::cout << "Error - -fit, -fill and -crop need both a width and a height.\n";
+		return false;
+	}
+
+	if ( options.aWidths.size() > 1 && options.aHeights.size() > 1 && options.aWidths.size() != options.aHeights.size() )
+	{
+		std::cout << "Error - " << options.aWidths.size() << " widths and " << options.aHeights.size() << " heights were specified.\n";
+		return false;
+	}
+
+	if ( options.mips && ( options.aWidths.size() > 1 || options.aHeights.size() > 1 ) )
+	{
+		std::cout << "Error - -mips takes a single output size.\n";
+		return false;
+	}
+
+	if ( options.stream && ( options.mips || options.aWidths.size() > 1 || options.aHeights.size() > 1 || options.aPalette.size() ) )
+	{
+		std::cout << "Error - -stream makes a single output size, without a palette.\n";
+		return false;
+	}
+
+	if ( options.fSharpen > 0.0 && options.filter == FILTER_NEAREST )
+	{
+		std::cout << "Error - -sharpen needs a filter: -bilinear, -area, -mitchell or -lanczos.\n";
+		return false;
+	}
+
+	if ( options.stream && ( options.format == FORMAT_DDS || options.format == FORMAT_WEBP ) )
+	{
+		std::cout << "Error - -stream writes png, qoi or rgba.\n";
+		return false;
+	}
+
+	if ( options.deep && ( options.filter == FILTER_NEAREST || options.stream ) )
+	{
+		std::cout << "Error - -deep needs a filter (-bilinear, -area, -mitchell or -lanczos), and is not for -stream.\n";
+		return false;
+	}
+
 	return true;
 }
 
@@ -701,157 +1181,646 @@ static bool make_path( std::string& path )
 	return !( e != 0 && er != EEXIST );
 }
 
-void write_png_rgb24( const colormap_t& image, const std::string& strOutFile )
+//
+// png_rgb_writer_t
+//
+// Writes an RGB/24 or RGB/32 PNG a row at a time, straight from rows of color_t: for
+// RGB/24 libpng drops the alpha bytes itself.
+//
+struct png_rgb_writer_t
 {
-	// Open
-	std::cout << "Writing \"" << strOutFile << "\" (RGB/24) ... ";
 
-	FILE* fp = nullptr;
-	int e = fopen_s( &fp, strOutFile.c_str(), "wb" );
-	if ( e != 0 || fp == nullptr )
-	{
-		std::cout << "ERROR (attempted overwrite?)\n\n";
-		return;
-	}
+public:
 
-	// Initialise the PNG.
-	png_structp png_ptr;
-	png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
-	if ( png_ptr == nullptr )
-	{
-		std::cout << "ERROR: png_create_write_struct failed.\n";
-		return;
-	}
+	FILE* _fp = nullptr;
+	png_structp _png_ptr = nullptr;
+	png_infop _info_ptr = nullptr;
+	bool _bFailed = false;
 
-	// Initialise the information structure.
-	png_infop info_ptr;
-	info_ptr = png_create_info_struct( png_ptr );
-	if ( info_ptr == nullptr )
+public:
+
+	~png_rgb_writer_t()
 	{
-		std::cout << "ERROR: png_create_info_struct failed.\n";
-		return;
+		Close();
 	}
 
-	jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
-
-	if ( setjmp( *p_jmp_buf ) != -1 )
+	bool Open( const std::string& strOutFile, size_t width, size_t height, bool bAlpha, std::ostream& log )
 	{
-		// Setup the writer
-		png_set_write_fn( png_ptr, fp, png_write_data_fn, png_flush_data_fn );
+		// Open
+		log << "Writing \"" << strOutFile << "\" (" << ( bAlpha ? "RGB/32" : "RGB/24" ) << ") ... ";
 
-		// Setup the header
-		png_set_IHDR( png_ptr, info_ptr, uint32_t( image._width ), uint32_t( image._height ),
-					  8 /*CHANNEL DEPTH*/, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-					  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+		int e = fopen_s( &_fp, strOutFile.c_str(), "wb" );
+		if ( e != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			log << "ERROR (attempted overwrite?)\n\n";
+			return false;
+		}
 
-		// Write!
-		png_write_info( png_ptr, info_ptr );
+		// Initialise the PNG.
+		_png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
+		if ( _png_ptr == nullptr )
+		{
+			log << "ERROR: png_create_write_struct failed.\n";
+			return false;
+		}
 
-		png_bytep row = (png_bytep)malloc( image._width * 3 );
+		png_set_user_limits( _png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
 
-		for ( int i = 0; i < image._height; ++i )
+		// Initialise the information structure.
+		_info_ptr = png_create_info_struct( _png_ptr );
+		if ( _info_ptr == nullptr )
 		{
-			png_bytep src = (png_bytep)( image._data_ptr + ( i * image._width ) );
-			png_bytep dst = row;
-			for ( size_t x = 0; x < image._width; ++x )
-			{
-				*dst++ = *src++;
-				*dst++ = *src++;
-				*dst++ = *src++;
-				*src++; // skip alpha
-			}
-
-			png_write_rows( png_ptr, &row, 1 );
+			log << "ERROR: png_create_info_struct failed.\n";
+			return false;
 		}
 
-		free( row );
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
 
-		png_write_end( png_ptr, nullptr );
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			// Setup the writer
+			png_set_write_fn( _png_ptr, _fp, png_write_data_fn, png_flush_data_fn );
 
-		std::cout << "OK\n";
-	}
+			// Setup the header
+			png_set_IHDR( _png_ptr, _info_ptr, uint32_t( width ), uint32_t( height ),
+						  8 /*CHANNEL DEPTH*/, bAlpha ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+						  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
 
-	// Destroy the main writer and info structures
-	png_destroy_write_struct( &png_ptr, &info_ptr );
+			// Write!
+			png_write_info( _png_ptr, _info_ptr );
 
-	fclose( fp );
-}
+			if ( bAlpha == false )
+			{
+				// the rows are RGBA, skip alpha.
+				png_set_filler( _png_ptr, 0, PNG_FILLER_AFTER );
+			}
 
-void write_png_rgb32( const colormap_t& image, const std::string& strOutFile )
-{
-	// Open
-	std::cout << "Writing \"" << strOutFile << "\" (RGB/32) ... ";
+			return true;
+		}
 
-	FILE* fp = nullptr;
-	int e = fopen_s( &fp, strOutFile.c_str(), "wb" );
-	if ( e != 0 || fp == nullptr )
-	{
-		std::cout << "ERROR (attempted overwrite?)\n\n";
-		return;
+		_bFailed = true;
+		return false;
 	}
 
-	// Initialise the PNG.
-	png_structp png_ptr;
-	png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
-	if ( png_ptr == nullptr )
+	void WriteRow( const color_t* pRow )
 	{
-		std::cout << "ERROR: png_create_write_struct failed.\n";
-		return;
-	}
+		if ( _bFailed )
+		{
+			return;
+		}
 
-	// Initialise the information structure.
-	png_infop info_ptr;
-	info_ptr = png_create_info_struct( png_ptr );
-	if ( info_ptr == nullptr )
-	{
-		std::cout << "ERROR: png_create_info_struct failed.\n";
-		return;
-	}
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
 
-	jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			png_write_row( _png_ptr, reinterpret_cast< png_const_bytep >( pRow ) );
+		}
+		else
+		{
+			_bFailed = true;
+		}
+	}
 
-	if ( setjmp( *p_jmp_buf ) != -1 )
+	// Finish the file, true if every row was written.
+	bool Close()
 	{
-		// Setup the writer
-		png_set_write_fn( png_ptr, fp, png_write_data_fn, png_flush_data_fn );
+		bool bOK = false;
 
-		// Setup the header
-		png_set_IHDR( png_ptr, info_ptr, uint32_t( image._width ), uint32_t( image._height ),
-					  8 /*CHANNEL DEPTH*/, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
-					  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
-
-		// Write!
-		png_write_info( png_ptr, info_ptr );
-
-		for ( int i = 0; i < image._height; ++i )
+		if ( _png_ptr != nullptr )
 		{
-			png_bytep row = (png_bytep)( image._data_ptr + ( i * image._width ) );
+			if ( _bFailed == false && _info_ptr != nullptr )
+			{
+				jmp_buf* p_jmp_buf = png_set_longjmp_fn( _png_ptr, longjmp, sizeof( jmp_buf ) );
+
+				if ( setjmp( *p_jmp_buf ) != -1 )
+				{
+					png_write_end( _png_ptr, nullptr );
+					bOK = true;
+				}
+			}
 
-			png_write_rows( png_ptr, &row, 1 );
+			// Destroy the main writer and info structures
+			png_destroy_write_struct( &_png_ptr, ( _info_ptr != nullptr ) ? &_info_ptr : nullptr );
+			_png_ptr = nullptr;
+			_info_ptr = nullptr;
 		}
 
-		png_write_end( png_ptr, nullptr );
+		if ( _fp != nullptr )
+		{
+			fclose( _fp );
+			_fp = nullptr;
+		}
 
-		std::cout << "OK\n";
+		return bOK;
 	}
+};
 
-	// Destroy the main writer and info structures
-	png_destroy_write_struct( &png_ptr, &info_ptr );
+//
+// qoi_writer_t
+//
+// The same rows as png_rgb_writer_t, as a QOI ("Quite OK Image", qoiformat.org): a short
+// header then one pass of runs, deltas and a 64 entry table of recent colours. Much
+// faster to write and read than a PNG, in a larger file.
+//
+struct qoi_writer_t
+{
 
-	fclose( fp );
+public:
+
+	FILE* _fp = nullptr;
+	bool _bFailed = false;
+	bool _bAlpha = false;
+
+	color_t _previous = color_t( 0xFF000000 );
+	color_t _aIndex[ 64 ] = {};
+	uint32_t _uRun = 0;
+	std::vector< uint8_t > _aBuffer; // a row's worth of encoded bytes.
+
+public:
+
+	~qoi_writer_t()
+	{
+		Close();
+	}
+
+	bool Open( const std::string& strOutFile, size_t width, size_t height, bool bAlpha, std::ostream& log )
+	{
+		log << "Writing \"" << strOutFile << "\" (" << ( bAlpha ? "QOI RGBA" : "QOI RGB" ) << ") ... ";
+
+		int e = fopen_s( &_fp, strOutFile.c_str(), "wb" );
+		if ( e != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			log << "ERROR (attempted overwrite?)\n\n";
+			return false;
+		}
+
+		_bAlpha = bAlpha;
+
+		// "qoif", big endian width and height, channels, then sRGB colour with linear alpha.
+		const uint8_t aHeader[ 14 ] = { 'q', 'o', 'i', 'f',
+										uint8_t( width >> 24 ), uint8_t( width >> 16 ), uint8_t( width >> 8 ), uint8_t( width ),
+										uint8_t( height >> 24 ), uint8_t( height >> 16 ), uint8_t( height >> 8 ), uint8_t( height ),
+										uint8_t( bAlpha ? 4 : 3 ), 0 };
+
+		_aBuffer.reserve( width * 5 + 8 );
+		_aBuffer.assign( aHeader, aHeader + sizeof( aHeader ) );
+		return true;
+	}
+
+	void WriteRow( const color_t* pRow, size_t width )
+	{
+		if ( _bFailed )
+		{
+			return;
+		}
+
+		for ( size_t x = 0; x < width; ++x )
+		{
+			color_t px = pRow[ x ];
+			if ( _bAlpha == false )
+			{
+				px.chan[ 3 ] = 0xFF;
+			}
+
+			if ( px.value_abgr == _previous.value_abgr )
+			{
+				if ( ++_uRun == 62 )
+				{
+					_aBuffer.push_back( uint8_t( 0xC0 | ( _uRun - 1 ) ) ); // QOI_OP_RUN
+					_uRun = 0;
+				}
+				continue;
+			}
+
+			if ( _uRun )
+			{
+				_aBuffer.push_back( uint8_t( 0xC0 | ( _uRun - 1 ) ) );
+				_uRun = 0;
+			}
+
+			const uint32_t hash = ( px.chan[ 0 ] * 3 + px.chan[ 1 ] * 5 + px.chan[ 2 ] * 7 + px.chan[ 3 ] * 11 ) % 64;
+
+			if ( _aIndex[ hash ].value_abgr == px.value_abgr )
+			{
+				_aBuffer.push_back( uint8_t( hash ) ); // QOI_OP_INDEX
+			}
+			else if ( px.chan[ 3 ] != _previous.chan[ 3 ] )
+			{
+				_aBuffer.insert( _aBuffer.end(), { 0xFF, px.chan[ 0 ], px.chan[ 1 ], px.chan[ 2 ], px.chan[ 3 ] } ); // QOI_OP_RGBA
+			}
+			else
+			{
+				const int dr = int8_t( px.chan[ 0 ] - _previous.chan[ 0 ] );
+				const int dg = int8_t( px.chan[ 1 ] - _previous.chan[ 1 ] );
+				const int db = int8_t( px.chan[ 2 ] - _previous.chan[ 2 ] );
+				const int dr_dg = dr - dg;
+				const int db_dg = db - dg;
+
+				if ( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 )
+				{
+					_aBuffer.push_back( uint8_t( 0x40 | ( ( dr + 2 ) << 4 ) | ( ( dg + 2 ) << 2 ) | ( db + 2 ) ) ); // QOI_OP_DIFF
+				}
+				else if ( dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7 )
+				{
+					_aBuffer.push_back( uint8_t( 0x80 | ( dg + 32 ) ) ); // QOI_OP_LUMA
+					_aBuffer.push_back( uint8_t( ( ( dr_dg + 8 ) << 4 ) | ( db_dg + 8 ) ) );
+				}
+				else
+				{
+					_aBuffer.insert( _aBuffer.end(), { 0xFE, px.chan[ 0 ], px.chan[ 1 ], px.chan[ 2 ] } ); // QOI_OP_RGB
+				}
+			}
+
+			_aIndex[ hash ] = px;
+			_previous = px;
+		}
+
+		Flush();
+	}
+
+	// Finish the file, true if every row was written.
+	bool Close()
+	{
+		if ( _fp == nullptr )
+		{
+			return false;
+		}
+
+		if ( _uRun )
+		{
+			_aBuffer.push_back( uint8_t( 0xC0 | ( _uRun - 1 ) ) );
+			_uRun = 0;
+		}
+
+		// the end marker.
+		_aBuffer.insert( _aBuffer.end(), { 0, 0, 0, 0, 0, 0, 0, 1 } );
+		Flush();
+
+		const bool bOK = ( fclose( _fp ) == 0 ) && _bFailed == false;
+		_fp = nullptr;
+
+		return bOK;
+	}
+
+private:
+
+	void Flush()
+	{
+		if ( _aBuffer.size() && fwrite( _aBuffer.data(), 1, _aBuffer.size(), _fp ) != _aBuffer.size() )
+		{
+			_bFailed = true;
+		}
+
+		_aBuffer.clear();
+	}
+};
+
+//
+// raw_rgba_writer_t
+//
+// The same rows as png_rgb_writer_t, uncompressed for loaders that map the file and use
+// it in place: a raw_rgba_header_t, then every row as RGBA (alpha or not) with no
+// padding between them. The header is 32 bytes, so the pixels are aligned.
+//
+struct raw_rgba_header_t
+{
+	char magic[ 8 ]; // "ISRGBA01"
+	uint32_t uWidth;
+	uint32_t uHeight;
+	uint32_t uStride; // bytes per row, uWidth * 4
+	uint32_t uDataOffset; // of the first row, from the start of the file
+	uint32_t uFlags; // 1: a pixel is not opaque
+	uint32_t uReserved;
+};
+
+static_assert( sizeof( raw_rgba_header_t ) == 32, "raw_rgba_header_t is written as is" );
+
+struct raw_rgba_writer_t
+{
+
+public:
+
+	FILE* _fp = nullptr;
+	bool _bFailed = false;
+
+public:
+
+	~raw_rgba_writer_t()
+	{
+		Close();
+	}
+
+	bool Open( const std::string& strOutFile, size_t width, size_t height, bool bAlpha, std::ostream& log )
+	{
+		log << "Writing \"" << strOutFile << "\" (RGBA raw) ... ";
+
+		int e = fopen_s( &_fp, strOutFile.c_str(), "wb" );
+		if ( e != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			log << "ERROR (attempted overwrite?)\n\n";
+			return false;
+		}
+
+		raw_rgba_header_t header = {};
+		memcpy( header.magic, "ISRGBA01", 8 );
+		header.uWidth = uint32_t( width );
+		header.uHeight = uint32_t( height );
+		header.uStride = uint32_t( width * sizeof( color_t ) );
+		header.uDataOffset = uint32_t( sizeof( raw_rgba_header_t ) );
+		header.uFlags = bAlpha ? 1 : 0;
+
+		if ( fwrite( &header, sizeof( header ), 1, _fp ) != 1 )
+		{
+			_bFailed = true;
+		}
+		return true;
+	}
+
+	void WriteRow( const color_t* pRow, size_t width )
+	{
+		if ( _bFailed == false && fwrite( pRow, sizeof( color_t ), width, _fp ) != width )
+		{
+			_bFailed = true;
+		}
+	}
+
+	// Finish the file, true if every row was written.
+	bool Close()
+	{
+		if ( _fp == nullptr )
+		{
+			return false;
+		}
+
+		const bool bOK = ( fclose( _fp ) == 0 ) && _bFailed == false;
+		_fp = nullptr;
+
+		return bOK;
+	}
+};
+
+#ifdef FRAGMENTS_LIBWEBP
+//
+// webp_writer_t
+//
+// The same rows as png_rgb_writer_t, as a lossless WebP. libwebp encodes the image whole,
+// so the rows are kept until Close; an opaque one is written without its alpha.
+//
+struct webp_writer_t
+{
+
+public:
+
+	FILE* _fp = nullptr;
+	size_t _width = 0;
+	size_t _height = 0;
+	bool _bAlpha = false;
+	std::vector< color_t > _aPixels;
+
+public:
+
+	~webp_writer_t()
+	{
+		if ( _fp )
+		{
+			fclose( _fp );
+		}
+	}
+
+	bool Open( const std::string& strOutFile, size_t width, size_t height, bool bAlpha, std::ostream& log )
+	{
+		log << "Writing \"" << strOutFile << "\" (" << ( bAlpha ? "WebP RGBA" : "WebP RGB" ) << ") ... ";
+
+		int e = fopen_s( &_fp, strOutFile.c_str(), "wb" );
+		if ( e != 0 || _fp == nullptr )
+		{
+			_fp = nullptr;
+			log << "ERROR (attempted overwrite?)\n\n";
+			return false;
+		}
+
+		_width = width;
+		_height = height;
+		_bAlpha = bAlpha;
+		_aPixels.clear();
+		_aPixels.reserve( width * height );
+		return true;
+	}
+
+	void WriteRow( const color_t* pRow, size_t width )
+	{
+		const size_t start = _aPixels.size();
+		_aPixels.insert( _aPixels.end(), pRow, pRow + width );
+
+		if ( _bAlpha == false )
+		{
+			for ( size_t x = start; x < _aPixels.size(); ++x )
+			{
+				_aPixels[ x ].chan[ 3 ] = 0xFF;
+			}
+		}
+	}
+
+	// Encode and write the file, true if it was all written.
+	bool Close()
+	{
+		if ( _fp == nullptr )
+		{
+			return false;
+		}
+
+		uint8_t* pEncoded = nullptr;
+		const size_t size = ( _aPixels.size() == _width * _height ) ?
+			WebPEncodeLosslessRGBA( reinterpret_cast< const uint8_t* >( _aPixels.data() ), int( _width ), int( _height ), int( _width * sizeof( color_t ) ), &pEncoded ) : 0;
+
+		bool bOK = ( size > 0 ) && fwrite( pEncoded, 1, size, _fp ) == size;
+		WebPFree( pEncoded );
+
+		bOK = ( fclose( _fp ) == 0 ) && bOK;
+		_fp = nullptr;
+
+		return bOK;
+	}
+};
+#endif
+
+//
+// rgb_writer_t
+//
+// The writer for an output format: Open, WriteRow and Close go to the one that format uses.
+//
+struct rgb_writer_t
+{
+
+public:
+
+	format_t _format = FORMAT_PNG;
+	size_t _width = 0;
+
+	png_rgb_writer_t _png;
+	qoi_writer_t _qoi;
+	raw_rgba_writer_t _raw;
+#ifdef FRAGMENTS_LIBWEBP
+	webp_writer_t _webp;
+#endif
+
+public:
+
+	bool Open( format_t format, const std::string& strOutFile, size_t width, size_t height, bool bAlpha, std::ostream& log )
+	{
+		_format = format;
+		_width = width;
+
+		switch ( _format )
+		{
+		case FORMAT_QOI:	return _qoi.Open( strOutFile, width, height, bAlpha, log );
+		case FORMAT_RAW:	return _raw.Open( strOutFile, width, height, bAlpha, log );
+#ifdef FRAGMENTS_LIBWEBP
+		case FORMAT_WEBP:	return _webp.Open( strOutFile, width, height, bAlpha, log );
+#endif
+		default:			return _png.Open( strOutFile, width, height, bAlpha, log );
+		}
+	}
+
+	void WriteRow( const color_t* pRow )
+	{
+		switch ( _format )
+		{
+		case FORMAT_QOI:	_qoi.WriteRow( pRow, _width ); break;
+		case FORMAT_RAW:	_raw.WriteRow( pRow, _width ); break;
+#ifdef FRAGMENTS_LIBWEBP
+		case FORMAT_WEBP:	_webp.WriteRow( pRow, _width ); break;
+#endif
+		default:			_png.WriteRow( pRow ); break;
+		}
+	}
+
+	bool Close()
+	{
+		switch ( _format )
+		{
+		case FORMAT_QOI:	return _qoi.Close();
+		case FORMAT_RAW:	return _raw.Close();
+#ifdef FRAGMENTS_LIBWEBP
+		case FORMAT_WEBP:	return _webp.Close();
+#endif
+		default:			return _png.Close();
+		}
+	}
+};
+
+static bool write_rgb( const colormap_t& image, format_t format, const std::string& strOutFile, bool bAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "write_rgb" );
+
+	rgb_writer_t writer;
+
+	if ( writer.Open( format, strOutFile, image._width, image._height, bAlpha, log ) == false )
+	{
+		return false;
+	}
+
+	for ( size_t i = 0; i < image._height; ++i )
+	{
+		writer.WriteRow( image._data_ptr + i * image._width );
+	}
+
+	if ( writer.Close() == false )
+	{
+		return false;
+	}
+
+	log << "OK\n";
+	return true;
+}
+
+//
+// rgb_verify_t
+//
+// The -verify hash of an RGB or RGBA output: its size and channels, then its rows as they
+// are written (an RGB one's without the alpha it does not keep).
+//
+struct rgb_verify_t
+{
+	verify_hash_t hash;
+	bool bAlpha = false;
+	std::vector< color_t > aRow;
+
+	rgb_verify_t( size_t width, size_t height, bool alpha ) : bAlpha( alpha )
+	{
+		hash.Add( uint32_t( width ) );
+		hash.Add( uint32_t( height ) );
+		hash.Add( bAlpha ? 4u : 3u );
+	}
+
+	void Row( const color_t* pRow, size_t width )
+	{
+		if ( bAlpha == false )
+		{
+			aRow.assign( pRow, pRow + width );
+			for ( color_t& colour : aRow )
+			{
+				colour.chan[ 3 ] = 0xFF;
+			}
+			pRow = aRow.data();
+		}
+
+		hash.AddData( pRow, width * sizeof( color_t ) );
+	}
+
+	void Image( const colormap_t& image )
+	{
+		for ( size_t y = 0; y < image._height; ++y )
+		{
+			Row( image.Row( y ), image._width );
+		}
+	}
+};
+
+//
+// verify_indexed
+//
+// The -verify hash of an indexed output: its size, bits per pixel and palette, then its
+// packed rows.
+//
+static verify_hash_t verify_indexed( const indexmap_t& image, const std::vector< color_t >& aPalette )
+{
+	verify_hash_t hash;
+	hash.Add( uint32_t( image._width ) );
+	hash.Add( uint32_t( image._height ) );
+	hash.Add( image._uBPP );
+
+	hash.Add( uint32_t( aPalette.size() ) );
+	for ( const color_t& colour : aPalette )
+	{
+		hash.Add( colour.value_abgr );
+	}
+
+	const size_t uRowBytes = ( size_t( image._width ) * image._uBPP + 7 ) / 8;
+	for ( size_t y = 0; y < image._height; ++y )
+	{
+		hash.AddData( const_cast< indexmap_t& >( image ).Row( y ), uRowBytes );
+	}
+
+	return hash;
 }
 
-void write_png_idx( const indexmap_t& image, std::vector< color_t >& aPalette, const std::string& strOutFile )
+bool write_png_idx( const indexmap_t& image, std::vector< color_t >& aPalette, const std::string& strOutFile, std::ostream& log = std::cout )
 {
+	TRACE_ZONE( "write_png_idx" );
+
 	// Open
-	std::cout << "Writing \"" << strOutFile << "\" (" << image._uBPP << "-BPP) ... ";
+	log << "Writing \"" << strOutFile << "\" (" << image._uBPP << "-BPP) ... ";
 
 	FILE* fp = nullptr;
 	int e = fopen_s( &fp, strOutFile.c_str(), "wb" );
 	if ( e != 0 || fp == nullptr )
 	{
-		std::cout << "ERROR (attempted overwrite?)\n\n";
-		return;
+		log << "ERROR (attempted overwrite?)\n\n";
+		return false;
 	}
 
 	// Initialise the PNG.
@@ -859,17 +1828,19 @@ void write_png_idx( const indexmap_t& image, std::vector< color_t >& aPalette, c
 	png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
 	if ( png_ptr == nullptr )
 	{
-		std::cout << "ERROR: png_create_write_struct failed.\n";
-		return;
+		log << "ERROR: png_create_write_struct failed.\n";
+		return false;
 	}
 
+	png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
 	// Initialise the information structure.
 	png_infop info_ptr;
 	info_ptr = png_create_info_struct( png_ptr );
 	if ( info_ptr == nullptr )
 	{
-		std::cout << "ERROR: png_create_info_struct failed.\n";
-		return;
+		log << "ERROR: png_create_info_struct failed.\n";
+		return false;
 	}
 
 	// Palette!
@@ -890,6 +1861,10 @@ void write_png_idx( const indexmap_t& image, std::vector< color_t >& aPalette, c
 		p->blue = src.chan[ 2 ];
 	}
 
+	bool bOK = false;
+	std::vector< uint8_t > aFiltered;
+	std::vector< uint8_t > aStream;
+
 	jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
 
 	if ( setjmp( *p_jmp_buf ) != -1 )
@@ -898,7 +1873,7 @@ void write_png_idx( const indexmap_t& image, std::vector< color_t >& aPalette, c
 		png_set_write_fn( png_ptr, fp, png_write_data_fn, png_flush_data_fn );
 
 		// Setup the header
-		png_set_IHDR( png_ptr, info_ptr, image._width, image._height,
+		png_set_IHDR( png_ptr, info_ptr, png_uint_32( image._width ), png_uint_32( image._height ),
 					  image._uBPP /*CHANNEL DEPTH*/, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
 					  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
 
@@ -908,30 +1883,50 @@ void write_png_idx( const indexmap_t& image, std::vector< color_t >& aPalette, c
 		// Write!
 		png_write_info( png_ptr, info_ptr );
 
-		for ( int i = 0; i < image._height; ++i )
+		if ( deflate_backend() == DEFLATE_LIBDEFLATE )
 		{
-			png_bytep row = const_cast<png_bytep>( image._data_ptr + ( i * image._uStride ) );
+			// the whole image is here, so it is compressed at once; unfiltered, as libpng leaves palette images.
+			const size_t stride = ( image._width * image._uBPP + 7 ) / 8;
+			aFiltered.reserve( ( stride + 1 ) * image._height );
+			for ( size_t i = 0; i < image._height; ++i )
+			{
+				const uint8_t* pRow = image._data_ptr + ( i * image._uStride );
+				aFiltered.push_back( PNG_FILTER_VALUE_NONE );
+				aFiltered.insert( aFiltered.end(), pRow, pRow + stride );
+			}
 
-			png_write_rows( png_ptr, &row, 1 );
+			bOK = png_write_compressed( png_ptr, aFiltered.data(), aFiltered.size(), Z_DEFAULT_COMPRESSION, aStream );
 		}
+		else
+		{
+			for ( size_t i = 0; i < image._height; ++i )
+			{
+				png_bytep row = const_cast<png_bytep>( image._data_ptr + ( i * image._uStride ) );
+
+				png_write_rows( png_ptr, &row, 1 );
+			}
 
-		png_write_end( png_ptr, nullptr );
+			png_write_end( png_ptr, nullptr );
+			bOK = true;
+		}
 
-		std::cout << "OK\n";
+		log << ( bOK ? "OK\n" : "ERROR: deflate failed.\n" );
 	}
 
 	// Destroy the main writer and info structures
 	png_destroy_write_struct( &png_ptr, &info_ptr );
 
 	fclose( fp );
+
+	return bOK;
 }
 
 //==============================================================================
 
-static void accumulate_error( int x, int y, dithermap_t& workspace, const dither_t& error, float fScale )
+static void accumulate_error( ptrdiff_t x, ptrdiff_t y, dithermap_t< dither_t >& workspace, const dither_t& error, float fScale )
 {
 	// out of bounds?
-	if ( x < 0 || y < 0 || x >= workspace._width || y >= workspace._height )
+	if ( x < 0 || y < 0 || x >= ptrdiff_t( workspace._width ) || y >= ptrdiff_t( workspace._height ) )
 		return;
 
 	dither_t& p = workspace.Element( x, y );
@@ -940,427 +1935,4900 @@ static void accumulate_error( int x, int y, dithermap_t& workspace, const dither
 	p.err_b += error.err_b * fScale;
 }
 
-static void remap_image_dither( const colormap_t& image, indexmap_t& output, options_t& options, const color_t pal_idx0 )
+//
+// palette_rows_t
+//
+// Palettises an image a row at a time, as each row is resized, into an indexmap_t of its
+// full height. Without -dither a row is mapped on its own, from any thread. With it, rows
+// must come in order: the Floyd-Steinberg error is kept in a ring of two rows, and each
+// row is dithered once the next is loaded, the same sums in the same order as over the
+// whole image at once.
+//
+struct palette_rows_t
+{
+	options_t* _pOptions = nullptr;
+	indexmap_t* _pOutput = nullptr;
+	dithermap_t< dither_t > _workspace;
+	std::vector< uint8_t > _aRow;
+
+	void Create( options_t& options, indexmap_t& output )
+	{
+		_pOptions = &options;
+		_pOutput = &output;
+
+		if ( options.bDither )
+		{
+			_workspace.Create( output._width, output._height, 2 );
+			_aRow.resize( output._width );
+		}
+	}
+
+	// row y of the image; pIndices is a row of scratch for the caller's thread, unused
+	// with -dither.
+	void Row( size_t y, const color_t* pRow, uint8_t* pIndices )
+	{
+		if ( _pOptions->bDither == false )
+		{
+			palette_lookup_t& lookup = _pOptions->aPalette.Lookup( 0, MATCH_RGB );
+
+			for ( size_t x = 0; x < _pOutput->_width; ++x )
+			{
+				pIndices[ x ] = lookup.Find( pRow[ x ] );
+			}
+
+			_pOutput->StoreRow( y, pIndices );
+			return;
+		}
+
+		// load the workspace with the source row.
+		for ( size_t x = 0; x < _pOutput->_width; ++x )
+		{
+			dither_t& target = _workspace.Element( x, y );
+			target.err_r = static_cast<float>( pRow[ x ].chan[ 0 ] ) / 255.0f;
+			target.err_g = static_cast<float>( pRow[ x ].chan[ 1 ] ) / 255.0f;
+			target.err_b = static_cast<float>( pRow[ x ].chan[ 2 ] ) / 255.0f;
+			target.index = 0;
+			target.is_opaque = true;
+		}
+
+		if ( y > 0 )
+		{
+			DitherRow( y - 1 );
+		}
+
+		if ( y + 1 == _pOutput->_height )
+		{
+			DitherRow( y );
+		}
+	}
+
+	// Floyd–Steinberg dithering, of a row whose error is complete.
+	void DitherRow( size_t y )
+	{
+		palette_lookup_t& lookup = _pOptions->aPalette.Lookup( 0, MATCH_RGB );
+		const ptrdiff_t width = ptrdiff_t( _pOutput->_width );
+		const ptrdiff_t yd = ptrdiff_t( y );
+
+		for ( ptrdiff_t x = 0; x < width; ++x )
+		{
+			dither_t& pixel = _workspace.Element( x, y );
+
+			// decide which is our closest palette index
+			color_t old_colour_sat;
+			old_colour_sat.FromDither( pixel );
+			uint8_t remapped_idx = lookup.Find( old_colour_sat );
+			_aRow[ x ] = remapped_idx; // store this.
+
+			// not an exact match? (likely)
+			const color_t new_colour_sat = _pOptions->aPalette[ remapped_idx ];
+			if ( old_colour_sat.BGR() != new_colour_sat.BGR() )
+			{
+				// compute error between the pixel and the palette value we must use.
+				dither_t quant_error;
+				quant_error.err_r = ( static_cast<float>( old_colour_sat.chan[ 0 ] ) - static_cast<float>( new_colour_sat.chan[ 0 ] ) ) / 255.0f;
+				quant_error.err_g = ( static_cast<float>( old_colour_sat.chan[ 1 ] ) - static_cast<float>( new_colour_sat.chan[ 1 ] ) ) / 255.0f;
+				quant_error.err_b = ( static_cast<float>( old_colour_sat.chan[ 2 ] ) - static_cast<float>( new_colour_sat.chan[ 2 ] ) ) / 255.0f;
+
+				// diffuse the error among the neighbours
+				accumulate_error( x + 1, yd, _workspace, quant_error, 7.0f / 16.0f );
+				accumulate_error( x - 1, yd + 1, _workspace, quant_error, 3.0f / 16.0f );
+				accumulate_error( x, yd + 1, _workspace, quant_error, 5.0f / 16.0f );
+				accumulate_error( x + 1, yd + 1, _workspace, quant_error, 1.0f / 16.0f );
+			}
+		}
+
+		_pOutput->StoreRow( y, _aRow.data() );
+	}
+};
+
+//==============================================================================
+
+//
+// mark_alpha_row
+//
+// Set bHasAlpha if a pixel of the row is not opaque. Called on each output row as it is
+// made, while it is still in cache, so there is no pass over the image to choose between
+// RGB/24 and RGB/32; once one row has alpha the rest are not looked at.
+//
+static void mark_alpha_row( const color_t* pRow, size_t width, std::atomic< bool >* pHasAlpha )
+{
+	if ( pHasAlpha == nullptr || pHasAlpha->load( std::memory_order_relaxed ) )
+	{
+		return;
+	}
+
+	size_t x = 0;
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	const __m128i opaque = _mm_set1_epi32( int( 0xFF000000 ) );
+	for ( ; x + 4 <= width; x += 4 )
+	{
+		const __m128i alpha = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >( pRow + x ) ), opaque );
+		if ( _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, opaque ) ) != 0xFFFF )
+		{
+			pHasAlpha->store( true, std::memory_order_relaxed );
+			return;
+		}
+	}
+#endif
+
+	for ( ; x < width; ++x )
+	{
+		if ( pRow[ x ].chan[ 3 ] != 0xFF )
+		{
+			pHasAlpha->store( true, std::memory_order_relaxed );
+			return;
+		}
+	}
+}
+
+//
+// run_row_bands
+//
+// Call rows_fn( y0, y1 ) over output rows [0, height) split into up to threads bands, each
+// on its own thread. Outputs too small to be worth it are one band on this thread.
+//
+static constexpr size_t kBandMinPixels = 1 << 18;
+
+template < typename F >
+static void run_row_bands( size_t width, size_t height, size_t threads, F rows_fn )
+{
+	if ( width * height < kBandMinPixels )
+	{
+		threads = 1;
+	}
+	threads = std::clamp< size_t >( threads, 1, std::max< size_t >( height, 1 ) );
+
+	const size_t band = ( height + threads - 1 ) / threads;
+
+	std::vector< std::thread > aThreads;
+
+	for ( size_t y0 = band; y0 < height; y0 += band )
+	{
+		const size_t y1 = std::min( y0 + band, height );
+		aThreads.emplace_back( [rows_fn, y0, y1]()
+		{
+			TRACE_ZONE( "row_band" );
+			rows_fn( y0, y1 );
+		} );
+	}
+
+	{
+		TRACE_ZONE( "row_band" );
+		rows_fn( 0, std::min( band, height ) );
+	}
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+}
+
+//
+// run_row_chunks
+//
+// Rows [0, height) made a chunk at a time on up to threads threads, then handed back in
+// order on this thread: make_fn( y0, y1, pRows ) fills the rows of a chunk into pRows,
+// and take_fn( y, pRow ) is called on each row once every row above it has been taken.
+// Chunks are claimed in order, into a ring of two per thread; a thread waits while its
+// chunk's slot is still held, so at most that many chunks are in RGBA at once.
+//
+static constexpr size_t kChunkRows = 32;
+
+template < typename F, typename G >
+static void run_row_chunks( size_t width, size_t height, size_t threads, F make_fn, G take_fn )
+{
+	const size_t chunks = ( height + kChunkRows - 1 ) / kChunkRows;
+	const size_t slots = threads * 2;
+	const size_t slot_pixels = kChunkRows * width;
+
+	std::vector< color_t > aSlots( slots * slot_pixels );
+	std::vector< size_t > aHeld( slots, SIZE_MAX ); // the chunk made into each slot.
+	std::mutex lock;
+	std::condition_variable made;
+	std::condition_variable taken;
+	std::atomic< size_t > next_chunk = 0;
+	size_t taken_chunks = 0;
+
+	std::vector< std::thread > aThreads;
+
+	for ( size_t t = 0; t < threads; ++t )
+	{
+		aThreads.emplace_back( [&]()
+		{
+			TRACE_ZONE( "row_chunks" );
+
+			for ( size_t c = next_chunk++; c < chunks; c = next_chunk++ )
+			{
+				const size_t slot = c % slots;
+
+				{
+					std::unique_lock< std::mutex > guard( lock );
+					taken.wait( guard, [&]() { return c < taken_chunks + slots; } );
+				}
+
+				const size_t y0 = c * kChunkRows;
+				make_fn( y0, std::min( y0 + kChunkRows, height ), &aSlots[ slot * slot_pixels ] );
+
+				{
+					std::lock_guard< std::mutex > guard( lock );
+					aHeld[ slot ] = c;
+				}
+				made.notify_one();
+			}
+		} );
+	}
+
+	for ( size_t c = 0; c < chunks; ++c )
+	{
+		const size_t slot = c % slots;
+
+		{
+			std::unique_lock< std::mutex > guard( lock );
+			made.wait( guard, [&]() { return aHeld[ slot ] == c; } );
+		}
+
+		const size_t y0 = c * kChunkRows;
+		const size_t y1 = std::min( y0 + kChunkRows, height );
+		for ( size_t y = y0; y < y1; ++y )
+		{
+			take_fn( y, &aSlots[ slot * slot_pixels + ( y - y0 ) * width ] );
+		}
+
+		{
+			std::lock_guard< std::mutex > guard( lock );
+			taken_chunks = c + 1;
+		}
+		taken.notify_all();
+	}
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+}
+
+//
+// resize_image_nearest
+//
+// Each output pixel is the source pixel its left-top corner falls in. The source column of
+// each output column is looked up in a table made once, and an output row with the same
+// source row as the one above is a copy of it. Whole number widenings (2x, 3x pixel art)
+// repeat each source pixel instead of looking it up.
+//
+static void resize_image_nearest( colormap_t& output, const colormap_t& input, size_t threads, std::atomic< bool >* pHasAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image_nearest" );
+
+	log << "Resizing to (" << output._width << " x " << output._height << ") - 'nearest neighbor'\n";
+
+	const size_t width = output._width;
+	const size_t src_width = input.OrientedWidth();
+	const size_t src_height = input.OrientedHeight();
+	const size_t repeat = ( width % src_width == 0 ) ? width / src_width : 0;
+
+	std::vector< uint32_t > aSrcX( width );
+	for ( size_t rx = 0; rx < width; ++rx )
+	{
+		aSrcX[ rx ] = uint32_t( uint64_t( rx ) * src_width / width );
+	}
+
+	run_row_bands( width, output._height, threads, [&]( size_t y0, size_t y1 )
+	{
+		std::vector< color_t > aSource( input._orientation == 1 ? 0 : src_width );
+		size_t last_y = SIZE_MAX;
+
+		for ( size_t ry = y0; ry < y1; ++ry )
+		{
+			const size_t sy = size_t( uint64_t( ry ) * src_height / output._height );
+			color_t* pOut = output._data_ptr + ry * width;
+
+			if ( sy == last_y )
+			{
+				std::copy_n( pOut - width, width, pOut );
+				continue;
+			}
+
+			last_y = sy;
+			const color_t* pSrc = input.OrientedRow( sy, aSource.data() );
+
+			if ( repeat )
+			{
+				for ( size_t sx = 0; sx < src_width; ++sx )
+				{
+					std::fill_n( pOut + sx * repeat, repeat, pSrc[ sx ] );
+				}
+			}
+			else
+			{
+				for ( size_t rx = 0; rx < width; ++rx )
+				{
+					pOut[ rx ] = pSrc[ aSrcX[ rx ] ];
+				}
+			}
+
+			// a row copied from the one above has nothing new.
+			mark_alpha_row( pOut, width, pHasAlpha );
+		}
+	} );
+}
+
+static const char* const kFilterName[] = { "nearest", "bilinear", "area", "mitchell", "lanczos3" };
+
+//
+// resample_support
+//
+// How far from an output's centre the filter reaches, in source samples. Reductions
+// widen every filter by the ratio (stretch), so that each source sample is weighed.
+//
+static double resample_support( filter_t filter, double stretch )
+{
+	switch ( filter )
+	{
+	case FILTER_AREA:		return 0.5 * stretch + 0.5;
+	case FILTER_MITCHELL:	return 2.0 * stretch;
+	case FILTER_LANCZOS3:	return 3.0 * stretch;
+	default:				return 1.0 * stretch;
+	}
+}
+
+//
+// resample_weight
+//
+// The weight of a source sample t away from an output's centre, zero from
+// resample_support out.
+//
+static double resample_weight( filter_t filter, double t, double stretch )
+{
+	// area: how much of the source sample lies under the output's footprint.
+	if ( filter == FILTER_AREA )
+		return std::clamp( 0.5 * stretch + 0.5 - std::abs( t ), 0.0, 1.0 );
+
+	const double x = std::abs( t / stretch );
+
+	switch ( filter )
+	{
+	case FILTER_MITCHELL:
+		{
+			// B = C = 1/3.
+			if ( x < 1.0 )
+				return ( 7.0 * x * x * x - 12.0 * x * x + 16.0 / 3.0 ) / 6.0;
+			if ( x < 2.0 )
+				return ( -7.0 / 3.0 * x * x * x + 12.0 * x * x - 20.0 * x + 32.0 / 3.0 ) / 6.0;
+			return 0.0;
+		}
+
+	case FILTER_LANCZOS3:
+		{
+			constexpr double kPi = 3.14159265358979323846;
+			if ( x < 1e-8 )
+				return 1.0;
+			if ( x < 3.0 )
+				return 3.0 * std::sin( kPi * x ) * std::sin( kPi * x / 3.0 ) / ( kPi * kPi * x * x );
+			return 0.0;
+		}
+
+	default:
+		// bilinear: a triangle.
+		return std::max( 0.0, 1.0 - x );
+	}
+}
+
+//
+// resample_weights_t
+//
+// The taps of a resample along one axis, from uIn samples to uOut: output i is the sum
+// of the _uTaps source samples from _aFirst[ i ], each times its weight. Weights are in
+// fixed point and add up to exactly 1 << kWeightBits. With fSharpen each output also
+// has fSharpen of each output beside it taken away (an unsharp mask along the axis)
+// in its taps, so that sharpening costs no pass of its own. Taps that fall off either edge
+// are folded onto the edge sample, as PeekClamp did.
+//
+struct resample_weights_t
+{
+	static constexpr int kWeightBits = 14;
+
+	size_t _uTaps = 0;
+	std::vector< int > _aFirst;
+	std::vector< int16_t > _aWeights; // _uTaps for each output.
+
+	void Create( size_t uOut, size_t uIn, filter_t filter, double fSharpen = 0.0 )
+	{
+		if ( filter == FILTER_NEAREST )
+		{
+			// one whole tap: the source sample each output's left-top corner falls in.
+			_uTaps = 1;
+			_aFirst.resize( uOut );
+			_aWeights.assign( uOut, int16_t( 1 << kWeightBits ) );
+
+			for ( size_t i = 0; i < uOut; ++i )
+			{
+				_aFirst[ i ] = int( uint64_t( i ) * uIn / uOut );
+			}
+			return;
+		}
+
+		const double scale = double( uIn ) / double( uOut );
+		const double stretch = std::max( 1.0, scale );
+		const double fSupport = resample_support( filter, stretch );
+
+		// the source samples each output covers, strictly inside the support.
+		auto centre_fn = [&]( size_t i ) { return ( double( i ) + 0.5 ) * scale - 0.5; };
+		auto first_fn = [&]( size_t i ) { return int( std::floor( centre_fn( i ) - fSupport ) ) + 1; };
+		auto last_fn = [&]( size_t i ) { return int( std::ceil( centre_fn( i ) + fSupport ) ) - 1; };
+
+		// -sharpen: [ -s, 1 + 2s, -s ] over each output and those beside it (the edge
+		// outputs stand in for the ones past them), each with its taps summing to 1.
+		const double s = fSharpen;
+		auto beside_fn = [&]( size_t i, int d ) { return size_t( std::clamp< ptrdiff_t >( ptrdiff_t( i ) + d, 0, ptrdiff_t( uOut ) - 1 ) ); };
+
+		std::vector< double > aTotal( s > 0.0 ? uOut : 0, 0.0 );
+		for ( size_t i = 0; i < aTotal.size(); ++i )
+		{
+			for ( int j = first_fn( i ); j <= last_fn( i ); ++j )
+			{
+				aTotal[ i ] += resample_weight( filter, double( j ) - centre_fn( i ), stretch );
+			}
+		}
+
+		auto lo_fn = [&]( size_t i ) { return first_fn( s > 0.0 ? beside_fn( i, -1 ) : i ); };
+		auto hi_fn = [&]( size_t i ) { return last_fn( s > 0.0 ? beside_fn( i, 1 ) : i ); };
+		auto tap_fn = [&]( size_t i, int j )
+		{
+			if ( s == 0.0 )
+				return resample_weight( filter, double( j ) - centre_fn( i ), stretch );
+
+			double w = 0.0;
+			for ( int d = -1; d <= 1; ++d )
+			{
+				const size_t k = beside_fn( i, d );
+				w += ( d == 0 ? 1.0 + 2.0 * s : -s ) * resample_weight( filter, double( j ) - centre_fn( k ), stretch ) / aTotal[ k ];
+			}
+			return w;
+		};
+
+		_uTaps = 1;
+		for ( size_t i = 0; i < uOut; ++i )
+		{
+			_uTaps = std::max< size_t >( _uTaps, size_t( hi_fn( i ) - lo_fn( i ) + 1 ) );
+		}
+		_uTaps = std::min( _uTaps, uIn );
+
+		_aFirst.resize( uOut );
+		_aWeights.assign( uOut * _uTaps, 0 );
+
+		std::vector< double > aWeight( _uTaps );
+
+		for ( size_t i = 0; i < uOut; ++i )
+		{
+			const int lo = lo_fn( i );
+			const int hi = hi_fn( i );
+			const int first = std::clamp( lo, 0, int( uIn - _uTaps ) );
+
+			std::fill( aWeight.begin(), aWeight.end(), 0.0 );
+			double total = 0.0;
+
+			for ( int j = lo; j <= hi; ++j )
+			{
+				const double w = tap_fn( i, j );
+				aWeight[ std::clamp( j, 0, int( uIn ) - 1 ) - first ] += w;
+				total += w;
+			}
+
+			// to fixed point, with the rounding left over given to the largest tap.
+			int16_t* pWeights = &_aWeights[ i * _uTaps ];
+			int sum = 0;
+			size_t largest = 0;
+
+			for ( size_t t = 0; t < _uTaps; ++t )
+			{
+				pWeights[ t ] = int16_t( std::lround( aWeight[ t ] / total * ( 1 << kWeightBits ) ) );
+				sum += pWeights[ t ];
+
+				if ( std::abs( pWeights[ t ] ) > std::abs( pWeights[ largest ] ) )
+					largest = t;
+			}
+
+			pWeights[ largest ] = int16_t( pWeights[ largest ] + ( 1 << kWeightBits ) - sum );
+			_aFirst[ i ] = first;
+		}
+	}
+
+	// The taps of outputs [i0, i1) of all, counted from the first source sample they use,
+	// which is returned.
+	size_t Slice( const resample_weights_t& all, size_t i0, size_t i1 )
+	{
+		const int base = all._aFirst[ i0 ];
+
+		_uTaps = all._uTaps;
+		_aFirst.assign( all._aFirst.begin() + i0, all._aFirst.begin() + i1 );
+		_aWeights.assign( all._aWeights.begin() + i0 * _uTaps, all._aWeights.begin() + i1 * _uTaps );
+
+		for ( int& first : _aFirst )
+		{
+			first -= base;
+		}
+
+		return size_t( base );
+	}
+};
+
+// one 8-bit channel from a sum of fixed point weights.
+static inline uint8_t resample_round( int32_t acc )
+{
+	return uint8_t( std::clamp( ( acc + ( 1 << ( resample_weights_t::kWeightBits - 1 ) ) ) >> resample_weights_t::kWeightBits, 0, 255 ) );
+}
+
+//
+// lcolor_t
+//
+// A pixel widened to kLinearBits, for -linear and for sources with alpha: R, G, B and A,
+// small enough for the same 16-bit multiplies as color_t. In linear light the colour goes
+// through the sRGB curve on the way in and out, otherwise it is only rescaled, as alpha
+// always is.
+//
+static constexpr int kLinearBits = 12;
+static constexpr int kLinearMax = ( 1 << kLinearBits ) - 1;
+
+struct lcolor_t
+{
+	uint16_t chan[ 4 ];
+};
+
+struct lcolor_tables_t
+{
+	uint16_t _aToColour[ 256 ];
+	uint16_t _aToAlpha[ 256 ];
+	uint8_t _aFromColour[ kLinearMax + 1 ];
+	uint8_t _aFromAlpha[ kLinearMax + 1 ];
+	uint32_t _aReciprocal[ kLinearMax + 1 ]; // ( kLinearMax << 16 ) / alpha, to unpremultiply.
+};
+
+// to kLinearBits and back, built on first use. Every byte comes back unchanged.
+static const lcolor_tables_t& lcolor_tables( bool bLinear )
+{
+	auto build_fn = []( bool bLinear )
+	{
+		lcolor_tables_t t;
+		const float* aLinear = srgb_linear_table();
+
+		for ( int i = 0; i < 256; ++i )
+		{
+			t._aToAlpha[ i ] = uint16_t( ( i * kLinearMax + 127 ) / 255 );
+			t._aToColour[ i ] = bLinear ? uint16_t( std::lround( aLinear[ i ] * kLinearMax ) ) : t._aToAlpha[ i ];
+		}
+
+		for ( int i = 0; i <= kLinearMax; ++i )
+		{
+			const double l = double( i ) / kLinearMax;
+			const double v = ( l <= 0.0031308 ) ? ( l * 12.92 ) : ( 1.055 * std::pow( l, 1.0 / 2.4 ) - 0.055 );
+			t._aFromAlpha[ i ] = uint8_t( ( i * 255 + kLinearMax / 2 ) / kLinearMax );
+			t._aFromColour[ i ] = bLinear ? uint8_t( std::clamp( std::lround( v * 255.0 ), 0L, 255L ) ) : t._aFromAlpha[ i ];
+			t._aReciprocal[ i ] = i ? uint32_t( ( ( uint64_t( kLinearMax ) << 16 ) + i / 2 ) / i ) : 0;
+		}
+
+		return t;
+	};
+
+	static const lcolor_tables_t linear = build_fn( true );
+	static const lcolor_tables_t plain = build_fn( false );
+
+	return bLinear ? linear : plain;
+}
+
+// a source row widened, and with bPremultiply its colour scaled by its alpha.
+static void to_lcolor_row( lcolor_t* pDest, const color_t* pSrc, size_t width, const lcolor_tables_t& tables, bool bPremultiply )
+{
+	for ( size_t x = 0; x < width; ++x )
+	{
+		const uint32_t a = tables._aToAlpha[ pSrc[ x ].chan[ 3 ] ];
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			const uint32_t v = tables._aToColour[ pSrc[ x ].chan[ c ] ];
+			pDest[ x ].chan[ c ] = uint16_t( bPremultiply ? ( v * a + kLinearMax / 2 ) / kLinearMax : v );
+		}
+
+		pDest[ x ].chan[ 3 ] = uint16_t( a );
+	}
+}
+
+// an output row narrowed, and with bPremultiply its colour divided by its alpha again.
+static void from_lcolor_row( color_t* pDest, const lcolor_t* pSrc, size_t width, const lcolor_tables_t& tables, bool bPremultiply )
+{
+	for ( size_t x = 0; x < width; ++x )
+	{
+		const uint32_t a = pSrc[ x ].chan[ 3 ];
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			uint32_t v = pSrc[ x ].chan[ c ];
+			if ( bPremultiply )
+			{
+				// a filter's overshoot can leave colour above alpha, which no pixel has.
+				v = ( std::min( v, a ) * tables._aReciprocal[ a ] + 0x8000 ) >> 16;
+			}
+			pDest[ x ].chan[ c ] = tables._aFromColour[ std::min< uint32_t >( v, kLinearMax ) ];
+		}
+
+		pDest[ x ].chan[ 3 ] = tables._aFromAlpha[ a ];
+	}
+}
+
+//
+// dcolor_t
+//
+// A pixel widened to kDeepBits, for -deep: held from the load to the last output, with
+// every level resampled from the last in these, and narrowed to bytes only as each output
+// is made. 15 bits rather than 16, so that the same signed 16-bit multiplies as lcolor_t
+// take the negative lobes of -mitchell and -lanczos. Always premultiplied when the source
+// has alpha, and in linear light with -linear.
+//
+static constexpr int kDeepBits = 15;
+static constexpr int kDeepMax = ( 1 << kDeepBits ) - 1;
+
+struct dcolor_t
+{
+	uint16_t chan[ 4 ];
+};
+
+// one wide channel, at most MAX, from a sum of fixed point weights.
+template < int MAX >
+static inline uint16_t resample_round_linear( int32_t acc )
+{
+	return uint16_t( std::clamp( ( acc + ( 1 << ( resample_weights_t::kWeightBits - 1 ) ) ) >> resample_weights_t::kWeightBits, 0, MAX ) );
+}
+
+//
+// resample_across
+//
+// One source row resampled to width outputs, with the column taps.
+//
+static void resample_across_scalar( color_t* pDest, const color_t* pSrc, size_t width, const resample_weights_t& cols )
+{
+	const size_t taps = cols._uTaps;
+
+	for ( size_t rx = 0; rx < width; ++rx )
+	{
+		const color_t* pTaps = pSrc + cols._aFirst[ rx ];
+		const int16_t* pWeights = &cols._aWeights[ rx * taps ];
+
+		int32_t acc[ 4 ] = { 0, 0, 0, 0 };
+		for ( size_t t = 0; t < taps; ++t )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				acc[ c ] += int32_t( pTaps[ t ].chan[ c ] ) * pWeights[ t ];
+			}
+		}
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			pDest[ rx ].chan[ c ] = resample_round( acc[ c ] );
+		}
+	}
+}
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+static void resample_across_sse2( color_t* pDest, const color_t* pSrc, size_t width, const resample_weights_t& cols )
+{
+	const size_t taps = cols._uTaps;
+
+	for ( size_t rx = 0; rx < width; ++rx )
+	{
+		const color_t* pTaps = pSrc + cols._aFirst[ rx ];
+		const int16_t* pWeights = &cols._aWeights[ rx * taps ];
+
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc = _mm_setzero_si128();
+
+		// two taps at a time: R0 R1 G0 G1 B0 B1 A0 A1 against w0 w1, four sums in one madd.
+		size_t t = 0;
+		for ( ; t + 2 <= taps; t += 2 )
+		{
+			const __m128i pair = _mm_unpacklo_epi8( _mm_loadl_epi64( reinterpret_cast< const __m128i* >( pTaps + t ) ), zero );
+			const __m128i chan = _mm_unpacklo_epi16( pair, _mm_srli_si128( pair, 8 ) );
+			const __m128i w = _mm_set1_epi32( int( uint16_t( pWeights[ t ] ) ) | ( int( pWeights[ t + 1 ] ) << 16 ) );
+			acc = _mm_add_epi32( acc, _mm_madd_epi16( chan, w ) );
+		}
+
+		if ( t < taps )
+		{
+			const __m128i one = _mm_unpacklo_epi8( _mm_cvtsi32_si128( int( pTaps[ t ].value_abgr ) ), zero );
+			const __m128i w = _mm_set1_epi32( int( uint16_t( pWeights[ t ] ) ) );
+			acc = _mm_add_epi32( acc, _mm_madd_epi16( _mm_unpacklo_epi16( one, zero ), w ) );
+		}
+
+		acc = _mm_srai_epi32( _mm_add_epi32( acc, _mm_set1_epi32( 1 << ( resample_weights_t::kWeightBits - 1 ) ) ), resample_weights_t::kWeightBits );
+		acc = _mm_packs_epi32( acc, acc );
+		pDest[ rx ].value_abgr = uint32_t( _mm_cvtsi128_si32( _mm_packus_epi16( acc, acc ) ) );
+	}
+}
+#endif
+
+//
+// resample_down
+//
+// Outputs [rx, width) of one output row, the weighted sum of the taps source rows in
+// apRows. The wider kernels do what they can and leave the rest to the narrower ones.
+//
+static void resample_down_scalar( color_t* pOut, const color_t* const* apRows, const int16_t* pWeights, size_t taps, size_t rx, size_t width )
+{
+	for ( ; rx < width; ++rx )
+	{
+		int32_t acc[ 4 ] = { 0, 0, 0, 0 };
+		for ( size_t t = 0; t < taps; ++t )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				acc[ c ] += int32_t( apRows[ t ][ rx ].chan[ c ] ) * pWeights[ t ];
+			}
+		}
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			pOut[ rx ].chan[ c ] = resample_round( acc[ c ] );
+		}
+	}
+}
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+static void resample_down_sse2( color_t* pOut, const color_t* const* apRows, const int16_t* pWeights, size_t taps, size_t rx, size_t width )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi32( 1 << ( resample_weights_t::kWeightBits - 1 ) );
+
+	// four pixels at a time, two rows at a time: their bytes interleaved against w0 w1.
+	for ( ; rx + 4 <= width; rx += 4 )
+	{
+		__m128i acc0 = _mm_setzero_si128();
+		__m128i acc1 = _mm_setzero_si128();
+		__m128i acc2 = _mm_setzero_si128();
+		__m128i acc3 = _mm_setzero_si128();
+
+		for ( size_t t = 0; t < taps; t += 2 )
+		{
+			const __m128i a = _mm_loadu_si128( reinterpret_cast< const __m128i* >( apRows[ t ] + rx ) );
+			const __m128i b = ( t + 1 < taps ) ? _mm_loadu_si128( reinterpret_cast< const __m128i* >( apRows[ t + 1 ] + rx ) ) : zero;
+			const int16_t w1 = ( t + 1 < taps ) ? pWeights[ t + 1 ] : int16_t( 0 );
+			const __m128i w = _mm_set1_epi32( int( uint16_t( pWeights[ t ] ) ) | ( int( w1 ) << 16 ) );
+
+			const __m128i lo = _mm_unpacklo_epi8( a, b );
+			const __m128i hi = _mm_unpackhi_epi8( a, b );
+
+			acc0 = _mm_add_epi32( acc0, _mm_madd_epi16( _mm_unpacklo_epi8( lo, zero ), w ) );
+			acc1 = _mm_add_epi32( acc1, _mm_madd_epi16( _mm_unpackhi_epi8( lo, zero ), w ) );
+			acc2 = _mm_add_epi32( acc2, _mm_madd_epi16( _mm_unpacklo_epi8( hi, zero ), w ) );
+			acc3 = _mm_add_epi32( acc3, _mm_madd_epi16( _mm_unpackhi_epi8( hi, zero ), w ) );
+		}
+
+		acc0 = _mm_srai_epi32( _mm_add_epi32( acc0, half ), resample_weights_t::kWeightBits );
+		acc1 = _mm_srai_epi32( _mm_add_epi32( acc1, half ), resample_weights_t::kWeightBits );
+		acc2 = _mm_srai_epi32( _mm_add_epi32( acc2, half ), resample_weights_t::kWeightBits );
+		acc3 = _mm_srai_epi32( _mm_add_epi32( acc3, half ), resample_weights_t::kWeightBits );
+
+		const __m128i packed = _mm_packus_epi16( _mm_packs_epi32( acc0, acc1 ), _mm_packs_epi32( acc2, acc3 ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i* >( pOut + rx ), packed );
+	}
+
+	resample_down_scalar( pOut, apRows, pWeights, taps, rx, width );
+}
+#endif
+
+#if CPU_X86
+// the SSE2 kernel on eight pixels: AVX2's unpacks and packs work within each 128-bit
+// half, so each half is the SSE2 sum of its four pixels and they come out in order.
+CPU_TARGET_AVX2 static void resample_down_avx2( color_t* pOut, const color_t* const* apRows, const int16_t* pWeights, size_t taps, size_t rx, size_t width )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i half = _mm256_set1_epi32( 1 << ( resample_weights_t::kWeightBits - 1 ) );
+
+	for ( ; rx + 8 <= width; rx += 8 )
+	{
+		__m256i acc0 = _mm256_setzero_si256();
+		__m256i acc1 = _mm256_setzero_si256();
+		__m256i acc2 = _mm256_setzero_si256();
+		__m256i acc3 = _mm256_setzero_si256();
+
+		for ( size_t t = 0; t < taps; t += 2 )
+		{
+			const __m256i a = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( apRows[ t ] + rx ) );
+			const __m256i b = ( t + 1 < taps ) ? _mm256_loadu_si256( reinterpret_cast< const __m256i* >( apRows[ t + 1 ] + rx ) ) : zero;
+			const int16_t w1 = ( t + 1 < taps ) ? pWeights[ t + 1 ] : int16_t( 0 );
+			const __m256i w = _mm256_set1_epi32( int( uint16_t( pWeights[ t ] ) ) | ( int( w1 ) << 16 ) );
+
+			const __m256i lo = _mm256_unpacklo_epi8( a, b );
+			const __m256i hi = _mm256_unpackhi_epi8( a, b );
+
+			acc0 = _mm256_add_epi32( acc0, _mm256_madd_epi16( _mm256_unpacklo_epi8( lo, zero ), w ) );
+			acc1 = _mm256_add_epi32( acc1, _mm256_madd_epi16( _mm256_unpackhi_epi8( lo, zero ), w ) );
+			acc2 = _mm256_add_epi32( acc2, _mm256_madd_epi16( _mm256_unpacklo_epi8( hi, zero ), w ) );
+			acc3 = _mm256_add_epi32( acc3, _mm256_madd_epi16( _mm256_unpackhi_epi8( hi, zero ), w ) );
+		}
+
+		acc0 = _mm256_srai_epi32( _mm256_add_epi32( acc0, half ), resample_weights_t::kWeightBits );
+		acc1 = _mm256_srai_epi32( _mm256_add_epi32( acc1, half ), resample_weights_t::kWeightBits );
+		acc2 = _mm256_srai_epi32( _mm256_add_epi32( acc2, half ), resample_weights_t::kWeightBits );
+		acc3 = _mm256_srai_epi32( _mm256_add_epi32( acc3, half ), resample_weights_t::kWeightBits );
+
+		const __m256i packed = _mm256_packus_epi16( _mm256_packs_epi32( acc0, acc1 ), _mm256_packs_epi32( acc2, acc3 ) );
+		_mm256_storeu_si256( reinterpret_cast< __m256i* >( pOut + rx ), packed );
+	}
+
+	resample_down_sse2( pOut, apRows, pWeights, taps, rx, width );
+}
+#endif
+
+//
+// resample_across (linear)
+//
+// As above, with 16-bit channels that need no widening: P is lcolor_t or dcolor_t, with
+// channels of at most MAX.
+//
+template < typename P, int MAX >
+static void resample_across_linear_scalar( P* pDest, const P* pSrc, size_t width, const resample_weights_t& cols )
+{
+	const size_t taps = cols._uTaps;
+
+	for ( size_t rx = 0; rx < width; ++rx )
+	{
+		const P* pTaps = pSrc + cols._aFirst[ rx ];
+		const int16_t* pWeights = &cols._aWeights[ rx * taps ];
+
+		int32_t acc[ 4 ] = { 0, 0, 0, 0 };
+		for ( size_t t = 0; t < taps; ++t )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				acc[ c ] += int32_t( pTaps[ t ].chan[ c ] ) * pWeights[ t ];
+			}
+		}
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			pDest[ rx ].chan[ c ] = resample_round_linear< MAX >( acc[ c ] );
+		}
+	}
+}
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+template < typename P, int MAX >
+static void resample_across_linear_sse2( P* pDest, const P* pSrc, size_t width, const resample_weights_t& cols )
+{
+	const size_t taps = cols._uTaps;
+
+	for ( size_t rx = 0; rx < width; ++rx )
+	{
+		const P* pTaps = pSrc + cols._aFirst[ rx ];
+		const int16_t* pWeights = &cols._aWeights[ rx * taps ];
+
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc = _mm_setzero_si128();
+
+		size_t t = 0;
+		for ( ; t + 2 <= taps; t += 2 )
+		{
+			const __m128i pair = _mm_loadu_si128( reinterpret_cast< const __m128i* >( pTaps + t ) );
+			const __m128i chan = _mm_unpacklo_epi16( pair, _mm_srli_si128( pair, 8 ) );
+			const __m128i w = _mm_set1_epi32( int( uint16_t( pWeights[ t ] ) ) | ( int( pWeights[ t + 1 ] ) << 16 ) );
+			acc = _mm_add_epi32( acc, _mm_madd_epi16( chan, w ) );
+		}
+
+		if ( t < taps )
+		{
+			const __m128i one = _mm_loadl_epi64( reinterpret_cast< const __m128i* >( pTaps + t ) );
+			const __m128i w = _mm_set1_epi32( int( uint16_t( pWeights[ t ] ) ) );
+			acc = _mm_add_epi32( acc, _mm_madd_epi16( _mm_unpacklo_epi16( one, zero ), w ) );
+		}
+
+		acc = _mm_srai_epi32( _mm_add_epi32( acc, _mm_set1_epi32( 1 << ( resample_weights_t::kWeightBits - 1 ) ) ), resample_weights_t::kWeightBits );
+		acc = _mm_min_epi16( _mm_max_epi16( _mm_packs_epi32( acc, acc ), zero ), _mm_set1_epi16( MAX ) );
+		_mm_storel_epi64( reinterpret_cast< __m128i* >( pDest + rx ), acc );
+	}
+}
+#endif
+
+//
+// resample_down (linear)
+//
+template < typename P, int MAX >
+static void resample_down_linear_scalar( P* pOut, const P* const* apRows, const int16_t* pWeights, size_t taps, size_t rx, size_t width )
+{
+	for ( ; rx < width; ++rx )
+	{
+		int32_t acc[ 4 ] = { 0, 0, 0, 0 };
+		for ( size_t t = 0; t < taps; ++t )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				acc[ c ] += int32_t( apRows[ t ][ rx ].chan[ c ] ) * pWeights[ t ];
+			}
+		}
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			pOut[ rx ].chan[ c ] = resample_round_linear< MAX >( acc[ c ] );
+		}
+	}
+}
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+template < typename P, int MAX >
+static void resample_down_linear_sse2( P* pOut, const P* const* apRows, const int16_t* pWeights, size_t taps, size_t rx, size_t width )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi32( 1 << ( resample_weights_t::kWeightBits - 1 ) );
+
+	// two pixels at a time, two rows at a time: their channels interleaved against w0 w1.
+	for ( ; rx + 2 <= width; rx += 2 )
+	{
+		__m128i acc0 = _mm_setzero_si128();
+		__m128i acc1 = _mm_setzero_si128();
+
+		for ( size_t t = 0; t < taps; t += 2 )
+		{
+			const __m128i a = _mm_loadu_si128( reinterpret_cast< const __m128i* >( apRows[ t ] + rx ) );
+			const __m128i b = ( t + 1 < taps ) ? _mm_loadu_si128( reinterpret_cast< const __m128i* >( apRows[ t + 1 ] + rx ) ) : zero;
+			const int16_t w1 = ( t + 1 < taps ) ? pWeights[ t + 1 ] : int16_t( 0 );
+			const __m128i w = _mm_set1_epi32( int( uint16_t( pWeights[ t ] ) ) | ( int( w1 ) << 16 ) );
+
+			acc0 = _mm_add_epi32( acc0, _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), w ) );
+			acc1 = _mm_add_epi32( acc1, _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), w ) );
+		}
+
+		acc0 = _mm_srai_epi32( _mm_add_epi32( acc0, half ), resample_weights_t::kWeightBits );
+		acc1 = _mm_srai_epi32( _mm_add_epi32( acc1, half ), resample_weights_t::kWeightBits );
+
+		const __m128i packed = _mm_min_epi16( _mm_max_epi16( _mm_packs_epi32( acc0, acc1 ), zero ), _mm_set1_epi16( MAX ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i* >( pOut + rx ), packed );
+	}
+
+	resample_down_linear_scalar< P, MAX >( pOut, apRows, pWeights, taps, rx, width );
+}
+#endif
+
+#if CPU_X86
+// four pixels at a time, each 128-bit half two of them as in the SSE2 kernel.
+template < typename P, int MAX >
+CPU_TARGET_AVX2 static void resample_down_linear_avx2( P* pOut, const P* const* apRows, const int16_t* pWeights, size_t taps, size_t rx, size_t width )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i half = _mm256_set1_epi32( 1 << ( resample_weights_t::kWeightBits - 1 ) );
+
+	for ( ; rx + 4 <= width; rx += 4 )
+	{
+		__m256i acc0 = _mm256_setzero_si256();
+		__m256i acc1 = _mm256_setzero_si256();
+
+		for ( size_t t = 0; t < taps; t += 2 )
+		{
+			const __m256i a = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( apRows[ t ] + rx ) );
+			const __m256i b = ( t + 1 < taps ) ? _mm256_loadu_si256( reinterpret_cast< const __m256i* >( apRows[ t + 1 ] + rx ) ) : zero;
+			const int16_t w1 = ( t + 1 < taps ) ? pWeights[ t + 1 ] : int16_t( 0 );
+			const __m256i w = _mm256_set1_epi32( int( uint16_t( pWeights[ t ] ) ) | ( int( w1 ) << 16 ) );
+
+			acc0 = _mm256_add_epi32( acc0, _mm256_madd_epi16( _mm256_unpacklo_epi16( a, b ), w ) );
+			acc1 = _mm256_add_epi32( acc1, _mm256_madd_epi16( _mm256_unpackhi_epi16( a, b ), w ) );
+		}
+
+		acc0 = _mm256_srai_epi32( _mm256_add_epi32( acc0, half ), resample_weights_t::kWeightBits );
+		acc1 = _mm256_srai_epi32( _mm256_add_epi32( acc1, half ), resample_weights_t::kWeightBits );
+
+		const __m256i packed = _mm256_min_epi16( _mm256_max_epi16( _mm256_packs_epi32( acc0, acc1 ), zero ), _mm256_set1_epi16( MAX ) );
+		_mm256_storeu_si256( reinterpret_cast< __m256i* >( pOut + rx ), packed );
+	}
+
+	resample_down_linear_sse2< P, MAX >( pOut, apRows, pWeights, taps, rx, width );
+}
+#endif
+
+//
+// resample_kernels_t
+//
+// The resample kernels for cpu_level(), chosen the first time they are used. AVX-512
+// runs the AVX2 kernels.
+//
+struct resample_kernels_t
+{
+	void ( *pfnAcross )( color_t*, const color_t*, size_t, const resample_weights_t& ) = resample_across_scalar;
+	void ( *pfnDown )( color_t*, const color_t* const*, const int16_t*, size_t, size_t, size_t ) = resample_down_scalar;
+	void ( *pfnAcrossLinear )( lcolor_t*, const lcolor_t*, size_t, const resample_weights_t& ) = resample_across_linear_scalar< lcolor_t, kLinearMax >;
+	void ( *pfnDownLinear )( lcolor_t*, const lcolor_t* const*, const int16_t*, size_t, size_t, size_t ) = resample_down_linear_scalar< lcolor_t, kLinearMax >;
+	void ( *pfnAcrossDeep )( dcolor_t*, const dcolor_t*, size_t, const resample_weights_t& ) = resample_across_linear_scalar< dcolor_t, kDeepMax >;
+	void ( *pfnDownDeep )( dcolor_t*, const dcolor_t* const*, const int16_t*, size_t, size_t, size_t ) = resample_down_linear_scalar< dcolor_t, kDeepMax >;
+
+	static const resample_kernels_t& Get()
+	{
+		static const resample_kernels_t kernels = Bind( cpu_level() );
+		return kernels;
+	}
+
+private:
+
+	static resample_kernels_t Bind( cpu_level_t level )
+	{
+		resample_kernels_t kernels;
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+		if ( level >= CPU_SSE2 && level != CPU_NEON )
+		{
+			kernels.pfnAcross = resample_across_sse2;
+			kernels.pfnDown = resample_down_sse2;
+			kernels.pfnAcrossLinear = resample_across_linear_sse2< lcolor_t, kLinearMax >;
+			kernels.pfnDownLinear = resample_down_linear_sse2< lcolor_t, kLinearMax >;
+			kernels.pfnAcrossDeep = resample_across_linear_sse2< dcolor_t, kDeepMax >;
+			kernels.pfnDownDeep = resample_down_linear_sse2< dcolor_t, kDeepMax >;
+		}
+#endif
+#if CPU_X86
+		if ( level >= CPU_AVX2 && level != CPU_NEON )
+		{
+			kernels.pfnDown = resample_down_avx2;
+			kernels.pfnDownLinear = resample_down_linear_avx2< lcolor_t, kLinearMax >;
+			kernels.pfnDownDeep = resample_down_linear_avx2< dcolor_t, kDeepMax >;
+		}
+#endif
+
+		( void )level;
+		return kernels;
+	}
+};
+
+static void resample_across( color_t* pDest, const color_t* pSrc, size_t width, const resample_weights_t& cols )
+{
+	resample_kernels_t::Get().pfnAcross( pDest, pSrc, width, cols );
+}
+
+static void resample_down( color_t* pOut, const color_t* const* apRows, const int16_t* pWeights, size_t taps, size_t width )
+{
+	resample_kernels_t::Get().pfnDown( pOut, apRows, pWeights, taps, 0, width );
+}
+
+static void resample_across( lcolor_t* pDest, const lcolor_t* pSrc, size_t width, const resample_weights_t& cols )
+{
+	resample_kernels_t::Get().pfnAcrossLinear( pDest, pSrc, width, cols );
+}
+
+static void resample_down( lcolor_t* pOut, const lcolor_t* const* apRows, const int16_t* pWeights, size_t taps, size_t width )
+{
+	resample_kernels_t::Get().pfnDownLinear( pOut, apRows, pWeights, taps, 0, width );
+}
+
+static void resample_across( dcolor_t* pDest, const dcolor_t* pSrc, size_t width, const resample_weights_t& cols )
+{
+	resample_kernels_t::Get().pfnAcrossDeep( pDest, pSrc, width, cols );
+}
+
+static void resample_down( dcolor_t* pOut, const dcolor_t* const* apRows, const int16_t* pWeights, size_t taps, size_t width )
+{
+	resample_kernels_t::Get().pfnDownDeep( pOut, apRows, pWeights, taps, 0, width );
+}
+
+//
+// resample_rows
+//
+// Output rows [y0, y1) of a resample with the taps in cols and rows, one row at a time:
+// each source row a column needs is resampled across into a ring of rows as tall as the
+// vertical filter, and each output row is then the weighted sum of the ring rows. Source
+// rows come from source_fn( y ), asked for in order from the band's first tap and each
+// only once; each output row is made in dest_fn( ry ), then handed to done_fn( ry ). T is
+// the pixel filtered: color_t, or lcolor_t with each source row widened through tables
+// first and each output row narrowed again, or dcolor_t with the rows from source_fn and
+// into dest_fn already dcolor_t (-deep, see deepmap_t).
+//
+template < typename T, typename S, typename D, typename E >
+static void resample_rows( const resample_weights_t& cols, const resample_weights_t& rows, size_t src_width, size_t y0, size_t y1,
+						   S source_fn, D dest_fn, E done_fn, const lcolor_tables_t* pTables, bool bPremultiply )
+{
+	constexpr bool bWide = std::is_same_v< T, lcolor_t >;
+
+	const size_t width = cols._aFirst.size();
+	const size_t ring = rows._uTaps;
+
+	std::vector< T > aRing( width * ring );
+	std::vector< const T* > apRows( ring );
+	std::vector< lcolor_t > aSource( bWide ? src_width : 0 );
+	std::vector< lcolor_t > aOut( bWide ? width : 0 );
+	size_t next_row = size_t( rows._aFirst[ y0 ] ); // the next source row to resample across.
+
+	for ( size_t ry = y0; ry < y1; ++ry )
+	{
+		const size_t first_row = size_t( rows._aFirst[ ry ] );
+		auto* pOut = dest_fn( ry );
+
+		// across: the source rows this output row needs, that are not in the ring yet.
+		for ( ; next_row < first_row + ring; ++next_row )
+		{
+			const auto* pSrc = source_fn( next_row );
+			T* pDest = &aRing[ ( next_row % ring ) * width ];
+
+			if constexpr ( bWide )
+			{
+				to_lcolor_row( aSource.data(), pSrc, src_width, *pTables, bPremultiply );
+				resample_across( pDest, aSource.data(), width, cols );
+			}
+			else
+			{
+				resample_across( pDest, pSrc, width, cols );
+			}
+		}
+
+		// down: the ring rows, weighted.
+		for ( size_t t = 0; t < ring; ++t )
+		{
+			apRows[ t ] = &aRing[ ( ( first_row + t ) % ring ) * width ];
+		}
+
+		if constexpr ( bWide )
+		{
+			resample_down( aOut.data(), apRows.data(), &rows._aWeights[ ry * ring ], ring, width );
+			from_lcolor_row( pOut, aOut.data(), width, *pTables, bPremultiply );
+		}
+		else
+		{
+			resample_down( pOut, apRows.data(), &rows._aWeights[ ry * ring ], ring, width );
+		}
+
+		done_fn( ry );
+	}
+}
+
+//
+// resample_image
+//
+// input resampled into output, in bands of rows on up to threads threads. Each band has
+// a ring of its own, so the few source rows at a band's top are resampled across by both
+// bands that need them.
+//
+template < typename T >
+static void resample_image( colormap_t& output, const colormap_t& input, const resample_weights_t& cols, const resample_weights_t& rows,
+							size_t threads, std::atomic< bool >* pHasAlpha, const lcolor_tables_t* pTables = nullptr, bool bPremultiply = false )
+{
+	run_row_bands( output._width, output._height, threads, [&]( size_t y0, size_t y1 )
+	{
+		std::vector< color_t > aSource( input._orientation == 1 ? 0 : input.OrientedWidth() );
+
+		resample_rows< T >( cols, rows, input.OrientedWidth(), y0, y1,
+			[&]( size_t y ) { return input.OrientedRow( y, aSource.data() ); },
+			[&]( size_t ry ) { return output._data_ptr + ry * output._width; },
+			[&]( size_t ry ) { mark_alpha_row( output._data_ptr + ry * output._width, output._width, pHasAlpha ); },
+			pTables, bPremultiply );
+	} );
+}
+
+//
+// first_visible / last_visible
+//
+// The first pixel of pRow in [x0, x1) that is not clear (x1 if none), and one past the
+// last (x0 if none).
+//
+static size_t first_visible( const color_t* pRow, size_t x0, size_t x1 )
+{
+	size_t x = x0;
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	const __m128i alpha = _mm_set1_epi32( int( 0xFF000000 ) );
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; x + 4 <= x1; x += 4 )
+	{
+		const __m128i a = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >( pRow + x ) ), alpha );
+		if ( _mm_movemask_epi8( _mm_cmpeq_epi32( a, zero ) ) != 0xFFFF )
+		{
+			break;
+		}
+	}
+#endif
+
+	for ( ; x < x1; ++x )
+	{
+		if ( pRow[ x ].chan[ 3 ] != 0 )
+		{
+			return x;
+		}
+	}
+
+	return x1;
+}
+
+static size_t last_visible( const color_t* pRow, size_t x0, size_t x1 )
+{
+	size_t x = x1;
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	const __m128i alpha = _mm_set1_epi32( int( 0xFF000000 ) );
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; x >= x0 + 4; x -= 4 )
+	{
+		const __m128i a = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >( pRow + x - 4 ) ), alpha );
+		if ( _mm_movemask_epi8( _mm_cmpeq_epi32( a, zero ) ) != 0xFFFF )
+		{
+			break;
+		}
+	}
+#endif
+
+	for ( ; x > x0; --x )
+	{
+		if ( pRow[ x - 1 ].chan[ 3 ] != 0 )
+		{
+			return x;
+		}
+	}
+
+	return x0;
+}
+
+//
+// visible_bounds
+//
+// The smallest rectangle [x0, x1) x [y0, y1) of image holding every pixel that is not
+// clear. False if there are none. Only the margins are scanned: the rows above and below
+// in full, and those between from each side in as far as the rectangle reaches so far.
+//
+static bool visible_bounds( const colormap_t& image, size_t& x0, size_t& y0, size_t& x1, size_t& y1 )
+{
+	const size_t width = image._width;
+
+	y0 = 0;
+	while ( y0 < image._height && first_visible( image.Row( y0 ), 0, width ) == width )
+	{
+		++y0;
+	}
+
+	if ( y0 == image._height )
+	{
+		return false;
+	}
+
+	y1 = image._height;
+	while ( last_visible( image.Row( y1 - 1 ), 0, width ) == 0 )
+	{
+		--y1;
+	}
+
+	x0 = width;
+	x1 = 0;
+	for ( size_t y = y0; y < y1; ++y )
+	{
+		const color_t* pRow = image.Row( y );
+		x0 = first_visible( pRow, 0, x0 );
+		x1 = last_visible( pRow, std::max( x0, x1 ), width );
+	}
+
+	return true;
+}
+
+//
+// resample_span
+//
+// The outputs [i0, i1) of weights whose taps reach into source samples [s0, s1). Those
+// outside it only sum clear pixels, which premultiplied come to clear.
+//
+static void resample_span( const resample_weights_t& weights, size_t s0, size_t s1, size_t& i0, size_t& i1 )
+{
+	const size_t count = weights._aFirst.size();
+
+	i0 = 0;
+	while ( i0 < count && size_t( weights._aFirst[ i0 ] ) + weights._uTaps <= s0 )
+	{
+		++i0;
+	}
+
+	i1 = count;
+	while ( i1 > i0 && size_t( weights._aFirst[ i1 - 1 ] ) >= s1 )
+	{
+		--i1;
+	}
+}
+
+//
+// resample_image_visible
+//
+// resample_image of a source with alpha, premultiplied, in the part of the output that
+// the source's visible rectangle reaches. The rest of the output is clear, as the filter
+// would make it, so sprites with wide clear margins are only filtered where they show.
+//
+static void resample_image_visible( colormap_t& output, const colormap_t& input, const resample_weights_t& cols, const resample_weights_t& rows,
+									size_t threads, std::atomic< bool >* pHasAlpha, bool bLinear )
+{
+	size_t sx0 = 0, sy0 = 0, sx1 = 0, sy1 = 0;
+	size_t ox0 = 0, oy0 = 0, ox1 = 0, oy1 = 0;
+
+	if ( visible_bounds( input, sx0, sy0, sx1, sy1 ) )
+	{
+		resample_span( cols, sx0, sx1, ox0, ox1 );
+		resample_span( rows, sy0, sy1, oy0, oy1 );
+	}
+
+	if ( ox0 == 0 && oy0 == 0 && ox1 == output._width && oy1 == output._height )
+	{
+		resample_image< lcolor_t >( output, input, cols, rows, threads, pHasAlpha, &lcolor_tables( bLinear ), true );
+		return;
+	}
+
+	// the margins, clear.
+	for ( size_t y = 0; y < output._height; ++y )
+	{
+		color_t* pRow = output._data_ptr + y * output._width;
+
+		if ( y < oy0 || y >= oy1 || ox0 == ox1 )
+		{
+			memset( pRow, 0, output._width * sizeof( color_t ) );
+		}
+		else
+		{
+			memset( pRow, 0, ox0 * sizeof( color_t ) );
+			memset( pRow + ox1, 0, ( output._width - ox1 ) * sizeof( color_t ) );
+		}
+	}
+
+	if ( pHasAlpha )
+	{
+		pHasAlpha->store( true, std::memory_order_relaxed );
+	}
+
+	if ( ox0 == ox1 || oy0 == oy1 )
+	{
+		return;
+	}
+
+	// the columns that reach the rectangle, from the first source column they use.
+	resample_weights_t span;
+	const size_t src_x = span.Slice( cols, ox0, ox1 );
+	const size_t src_width = size_t( span._aFirst.back() ) + span._uTaps;
+	const size_t width = ox1 - ox0;
+
+	run_row_bands( width, oy1 - oy0, threads, [&]( size_t y0, size_t y1 )
+	{
+		resample_rows< lcolor_t >( span, rows, src_width, oy0 + y0, oy0 + y1,
+			[&]( size_t y ) { return input.Row( y ) + src_x; },
+			[&]( size_t ry ) { return output._data_ptr + ry * output._width + ox0; },
+			[&]( size_t ry ) {},
+			&lcolor_tables( bLinear ), true );
+	} );
+}
+
+//
+// resize_image_separable
+//
+// Resample input into output with filter, in one pass at any ratio. With bPremultiply
+// (a source with alpha) colour is filtered scaled by alpha, so that the colour of clear
+// pixels does not bleed into the edges of those beside them.
+//
+static void resize_image_separable( colormap_t& output, const colormap_t& input, filter_t filter, double fSharpen, bool bLinear, bool bPremultiply,
+									size_t threads, std::atomic< bool >* pHasAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image_separable" );
+
+	log << "Resizing to (" << output._width << " x " << output._height << ") - '" << kFilterName[ filter ] << "'" << ( bLinear ? " in linear light" : "" ) << "\n";
+
+	resample_weights_t cols;
+	resample_weights_t rows;
+	cols.Create( output._width, input.OrientedWidth(), filter, fSharpen );
+	rows.Create( output._height, input.OrientedHeight(), filter, fSharpen );
+
+	if ( bPremultiply && input._orientation == 1 )
+	{
+		resample_image_visible( output, input, cols, rows, threads, pHasAlpha, bLinear );
+	}
+	else if ( bLinear || bPremultiply )
+	{
+		resample_image< lcolor_t >( output, input, cols, rows, threads, pHasAlpha, &lcolor_tables( bLinear ), bPremultiply );
+	}
+	else
+	{
+		resample_image< color_t >( output, input, cols, rows, threads, pHasAlpha );
+	}
+}
+
+//
+// halve_row
+//
+// One output row of an exact 2:1 area reduction, from source rows pRow0 and pRow1: each
+// pair of pixels averaged across, rounding up, and then the two rows averaged down the
+// same way. These are the sums and rounding of resample_across and resample_down for
+// the two equal taps of a 2:1 area filter, so the output is the same.
+//
+static void halve_row( color_t* pOut, const color_t* pRow0, const color_t* pRow1, size_t width )
+{
+	size_t x = 0;
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	// four outputs at a time: the even and odd pixels of each row split apart and averaged.
+	auto across_fn = []( const color_t* pSrc )
+	{
+		const __m128 a = _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast< const __m128i* >( pSrc ) ) );
+		const __m128 b = _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast< const __m128i* >( pSrc + 4 ) ) );
+		const __m128i even = _mm_castps_si128( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+		const __m128i odd = _mm_castps_si128( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+		return _mm_avg_epu8( even, odd );
+	};
+
+	for ( ; x + 4 <= width; x += 4 )
+	{
+		const __m128i top = across_fn( pRow0 + x * 2 );
+		const __m128i bottom = across_fn( pRow1 + x * 2 );
+		_mm_storeu_si128( reinterpret_cast< __m128i* >( pOut + x ), _mm_avg_epu8( top, bottom ) );
+	}
+#endif
+
+	for ( ; x < width; ++x )
+	{
+		for ( int c = 0; c < 4; ++c )
+		{
+			const int top = ( pRow0[ x * 2 ].chan[ c ] + pRow0[ x * 2 + 1 ].chan[ c ] + 1 ) >> 1;
+			const int bottom = ( pRow1[ x * 2 ].chan[ c ] + pRow1[ x * 2 + 1 ].chan[ c ] + 1 ) >> 1;
+			pOut[ x ].chan[ c ] = uint8_t( ( top + bottom + 1 ) >> 1 );
+		}
+	}
+}
+
+//
+// resize_image_halve
+//
+// input reduced to exactly half its width and height with the area filter, two rows in
+// for each row out, in bands of rows on up to threads threads. -mips makes each size from
+// the one above it, so every size below the first is one of these.
+//
+static void resize_image_halve( colormap_t& output, const colormap_t& input, size_t threads, std::atomic< bool >* pHasAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image_halve" );
+
+	log << "Resizing to (" << output._width << " x " << output._height << ") - '" << kFilterName[ FILTER_AREA ] << "'\n";
+
+	run_row_bands( output._width, output._height, threads, [&]( size_t y0, size_t y1 )
+	{
+		for ( size_t y = y0; y < y1; ++y )
+		{
+			color_t* pOut = output._data_ptr + y * output._width;
+			halve_row( pOut, input.Row( y * 2 ), input.Row( y * 2 + 1 ), output._width );
+			mark_alpha_row( pOut, output._width, pHasAlpha );
+		}
+	} );
+}
+
+//==============================================================================
+
+// The two passes of resample_rows, one thread per pixel. resample_across resamples each
+// source row the output needs to out_width, into the across buffer; resample_down sums
+// its rows into the output. The sums, rounding and tables are those of the CPU kernels,
+// so the output is the same. flags: 1 = lcolor_t (12-bit channels, through the tables),
+// 2 = premultiplied alpha.
+static const char g_szResampleShader[] =
+	"ByteAddressBuffer source : register( t0 );\n"
+	"ByteAddressBuffer weights : register( t1 );\n"
+	"ByteAddressBuffer tables : register( t2 );\n"
+	"RWByteAddressBuffer across : register( u0 );\n"
+	"RWByteAddressBuffer output : register( u1 );\n"
+	"cbuffer params : register( b0 )\n"
+	"{\n"
+	"	uint src_width;\n"
+	"	uint out_width;\n"
+	"	uint height;\n"
+	"	uint flags;\n"
+	"	uint first;\n"
+	"	uint taps;\n"
+	"	uint weight;\n"
+	"	uint table_base;\n"
+	"};\n"
+	"uint table( uint i ) { return tables.Load( ( table_base + i ) * 4 ); }\n"
+	"int4 unpack8( uint v ) { return int4( v & 0xFF, ( v >> 8 ) & 0xFF, ( v >> 16 ) & 0xFF, v >> 24 ); }\n"
+	"uint pack8( uint4 c ) { return c.r | ( c.g << 8 ) | ( c.b << 16 ) | ( c.a << 24 ); }\n"
+	"int4 widen( uint v )\n"
+	"{\n"
+	"	uint4 c = unpack8( v );\n"
+	"	uint a = table( 256 + c.a );\n"
+	"	uint3 rgb = uint3( table( c.r ), table( c.g ), table( c.b ) );\n"
+	"	if ( flags & 2 ) rgb = ( rgb * a + 2047 ) / 4095;\n"
+	"	return int4( rgb, a );\n"
+	"}\n"
+	"int4 round_sum( int4 acc ) { return clamp( ( acc + 8192 ) >> 14, 0, ( flags & 1 ) ? 4095 : 255 ); }\n"
+	"[numthreads( 64, 1, 1 )]\n"
+	"void resample_across( uint3 id : SV_DispatchThreadID )\n"
+	"{\n"
+	"	if ( id.x >= out_width || id.y >= height ) return;\n"
+	"	uint src = id.y * src_width + weights.Load( ( first + id.x ) * 4 );\n"
+	"	int4 acc = 0;\n"
+	"	for ( uint t = 0; t < taps; ++t )\n"
+	"	{\n"
+	"		uint v = source.Load( ( src + t ) * 4 );\n"
+	"		int w = asint( weights.Load( ( weight + id.x * taps + t ) * 4 ) );\n"
+	"		acc += ( ( flags & 1 ) ? widen( v ) : unpack8( v ) ) * w;\n"
+	"	}\n"
+	"	uint4 c = round_sum( acc );\n"
+	"	uint i = id.y * out_width + id.x;\n"
+	"	if ( flags & 1 ) across.Store2( i * 8, uint2( c.r | ( c.g << 16 ), c.b | ( c.a << 16 ) ) );\n"
+	"	else across.Store( i * 4, pack8( c ) );\n"
+	"}\n"
+	"[numthreads( 64, 1, 1 )]\n"
+	"void resample_down( uint3 id : SV_DispatchThreadID )\n"
+	"{\n"
+	"	if ( id.x >= out_width || id.y >= height ) return;\n"
+	"	uint row = weights.Load( ( first + id.y ) * 4 );\n"
+	"	int4 acc = 0;\n"
+	"	for ( uint t = 0; t < taps; ++t )\n"
+	"	{\n"
+	"		uint i = ( row + t ) * out_width + id.x;\n"
+	"		int4 v;\n"
+	"		if ( flags & 1 ) { uint2 p = across.Load2( i * 8 ); v = int4( p.x & 0xFFFF, p.x >> 16, p.y & 0xFFFF, p.y >> 16 ); }\n"
+	"		else v = unpack8( across.Load( i * 4 ) );\n"
+	"		acc += v * asint( weights.Load( ( weight + id.y * taps + t ) * 4 ) );\n"
+	"	}\n"
+	"	uint4 c = round_sum( acc );\n"
+	"	if ( flags & 1 )\n"
+	"	{\n"
+	"		if ( flags & 2 ) c.rgb = ( min( c.rgb, c.a ) * table( 8704 + c.a ) + 0x8000 ) >> 16;\n"
+	"		c.rgb = min( c.rgb, 4095 );\n"
+	"		c = uint4( table( 512 + c.r ), table( 512 + c.g ), table( 512 + c.b ), table( 4608 + c.a ) );\n"
+	"	}\n"
+	"	output.Store( ( id.y * out_width + id.x ) * 4, pack8( c ) );\n"
+	"}\n";
+
+//
+// gpu_resizer_t
+//
+// Runs resample_rows on the GPU, with a Direct3D 11 compute shader. d3d11.dll and
+// d3dcompiler_47.dll are loaded at run time, so a machine without them (or without a
+// feature level 11 GPU) just resizes on the CPU. The buffers grow to the largest image
+// seen, and the last source uploaded is kept, so that the sizes made from one image (a
+// list of sizes, or -mips) upload it once.
+//
+// Safe to call from several resize workers, the GPU is used by one at a time.
+//
+struct gpu_resizer_t
+{
+	static constexpr uint32_t kGroupSize = 64;
+	static constexpr uint32_t kMaxGroups = 65535;
+	static constexpr uint32_t kTableSize = 256 * 2 + ( kLinearMax + 1 ) * 3; // as laid out in g_szResampleShader.
+
+	// matches the cbuffer in g_szResampleShader.
+	struct params_t
+	{
+		uint32_t uSrcWidth;
+		uint32_t uOutWidth;
+		uint32_t uHeight;
+		uint32_t uFlags;
+		uint32_t uFirst;
+		uint32_t uTaps;
+		uint32_t uWeight;
+		uint32_t uTableBase;
+	};
+
+	// a raw buffer, with its views.
+	struct buffer_t
+	{
+		ID3D11Buffer* pBuffer = nullptr;
+		ID3D11ShaderResourceView* pSRV = nullptr;
+		ID3D11UnorderedAccessView* pUAV = nullptr;
+		uint32_t uBytes = 0;
+	};
+
+	std::mutex _mutex;
+
+	HMODULE _hD3D = nullptr;
+	HMODULE _hCompiler = nullptr;
+
+	ID3D11Device* _pDevice = nullptr;
+	ID3D11DeviceContext* _pContext = nullptr;
+	ID3D11ComputeShader* _pAcross = nullptr;
+	ID3D11ComputeShader* _pDown = nullptr;
+	ID3D11Buffer* _pParams = nullptr;
+
+	buffer_t _source;	// the source rows, color_t.
+	buffer_t _weights;	// int32: the columns' first taps and weights, then the rows'.
+	buffer_t _tables;	// lcolor_tables for plain, then linear light.
+	buffer_t _across;	// the source rows resampled across, color_t or lcolor_t.
+	buffer_t _output;	// color_t.
+	buffer_t _readback;	// staging copy of _output.
+
+	const color_t* _pLastSource = nullptr; // what _source holds, see Forget.
+	size_t _uLastRows[ 2 ] = {};
+	bool _bFailed = false;
+
+	~gpu_resizer_t()
+	{
+		for ( buffer_t* pBuffer : { &_readback, &_output, &_across, &_tables, &_weights, &_source } )
+		{
+			release_buffer( *pBuffer );
+		}
+
+		release( _pParams );
+		release( _pDown );
+		release( _pAcross );
+		release( _pContext );
+		release( _pDevice );
+
+		if ( _hCompiler )
+			FreeLibrary( _hCompiler );
+		if ( _hD3D )
+			FreeLibrary( _hD3D );
+	}
+
+	template < typename T >
+	static void release( T*& pObject )
+	{
+		if ( pObject )
+		{
+			pObject->Release();
+			pObject = nullptr;
+		}
+	}
+
+	static void release_buffer( buffer_t& buffer )
+	{
+		release( buffer.pUAV );
+		release( buffer.pSRV );
+		release( buffer.pBuffer );
+		buffer.uBytes = 0;
+	}
+
+	//
+	// Init
+	//
+	// Create the device, shaders and tables. On failure strReason says why, and the CPU
+	// should be used instead.
+	//
+	bool Init( std::string& strReason )
+	{
+		_hD3D = LoadLibraryA( "d3d11.dll" );
+		_hCompiler = LoadLibraryA( "d3dcompiler_47.dll" );
+
+		if ( _hD3D == nullptr || _hCompiler == nullptr )
+		{
+			strReason = "Direct3D 11 is not installed";
+			return false;
+		}
+
+		auto pfnCreateDevice = reinterpret_cast< PFN_D3D11_CREATE_DEVICE >( GetProcAddress( _hD3D, "D3D11CreateDevice" ) );
+		auto pfnCompile = reinterpret_cast< pD3DCompile >( GetProcAddress( _hCompiler, "D3DCompile" ) );
+
+		if ( pfnCreateDevice == nullptr || pfnCompile == nullptr )
+		{
+			strReason = "Direct3D 11 is not installed";
+			return false;
+		}
+
+		const D3D_FEATURE_LEVEL level = D3D_FEATURE_LEVEL_11_0;
+
+		if ( FAILED( pfnCreateDevice( nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, &level, 1, D3D11_SDK_VERSION, &_pDevice, nullptr, &_pContext ) ) )
+		{
+			strReason = "no feature level 11 GPU";
+			return false;
+		}
+
+		auto compile_fn = [&]( const char* szEntry, ID3D11ComputeShader** ppShader )
+		{
+			ID3DBlob* pCode = nullptr;
+			ID3DBlob* pErrors = nullptr;
+
+			HRESULT hr = pfnCompile( g_szResampleShader, sizeof( g_szResampleShader ) - 1, "imgsize_resample", nullptr, nullptr,
+									 szEntry, "cs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &pCode, &pErrors );
+			release( pErrors );
+
+			if ( SUCCEEDED( hr ) )
+			{
+				hr = _pDevice->CreateComputeShader( pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, ppShader );
+			}
+
+			release( pCode );
+			return SUCCEEDED( hr );
+		};
+
+		if ( !compile_fn( "resample_across", &_pAcross ) || !compile_fn( "resample_down", &_pDown ) )
+		{
+			strReason = "the compute shader failed to build";
+			return false;
+		}
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof( params_t );
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+		if ( FAILED( _pDevice->CreateBuffer( &desc, nullptr, &_pParams ) ) || !reserve( _tables, kTableSize * 2 * 4, D3D11_BIND_SHADER_RESOURCE ) )
+		{
+			strReason = "out of GPU memory";
+			return false;
+		}
+
+		std::vector< uint32_t > aTables;
+		for ( const lcolor_tables_t* pTables : { &lcolor_tables( false ), &lcolor_tables( true ) } )
+		{
+			aTables.insert( aTables.end(), pTables->_aToColour, pTables->_aToColour + 256 );
+			aTables.insert( aTables.end(), pTables->_aToAlpha, pTables->_aToAlpha + 256 );
+			aTables.insert( aTables.end(), pTables->_aFromColour, pTables->_aFromColour + kLinearMax + 1 );
+			aTables.insert( aTables.end(), pTables->_aFromAlpha, pTables->_aFromAlpha + kLinearMax + 1 );
+			aTables.insert( aTables.end(), pTables->_aReciprocal, pTables->_aReciprocal + kLinearMax + 1 );
+		}
+
+		upload( _tables, aTables.data(), 0, uint32_t( aTables.size() * 4 ) );
+
+		_pContext->CSSetConstantBuffers( 0, 1, &_pParams );
+		return true;
+	}
+
+	//
+	// reserve
+	//
+	// Make buffer at least uBytes, with views for uBind (or a staging buffer for 0).
+	//
+	bool reserve( buffer_t& buffer, uint64_t uBytes, UINT uBind )
+	{
+		if ( uBytes <= buffer.uBytes )
+		{
+			return true;
+		}
+
+		release_buffer( buffer );
+
+		if ( uBytes > ( UINT32_MAX >> 1 ) )
+		{
+			return false;
+		}
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = uint32_t( uBytes );
+
+		if ( uBind == 0 )
+		{
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		}
+		else
+		{
+			desc.Usage = D3D11_USAGE_DEFAULT;
+			desc.BindFlags = uBind;
+			desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+		}
+
+		HRESULT hr = _pDevice->CreateBuffer( &desc, nullptr, &buffer.pBuffer );
+
+		if ( SUCCEEDED( hr ) && ( uBind & D3D11_BIND_SHADER_RESOURCE ) )
+		{
+			D3D11_SHADER_RESOURCE_VIEW_DESC srv = {};
+			srv.Format = DXGI_FORMAT_R32_TYPELESS;
+			srv.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+			srv.BufferEx.NumElements = desc.ByteWidth / 4;
+			srv.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+
+			hr = _pDevice->CreateShaderResourceView( buffer.pBuffer, &srv, &buffer.pSRV );
+		}
+
+		if ( SUCCEEDED( hr ) && ( uBind & D3D11_BIND_UNORDERED_ACCESS ) )
+		{
+			D3D11_UNORDERED_ACCESS_VIEW_DESC uav = {};
+			uav.Format = DXGI_FORMAT_R32_TYPELESS;
+			uav.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+			uav.Buffer.NumElements = desc.ByteWidth / 4;
+			uav.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+			hr = _pDevice->CreateUnorderedAccessView( buffer.pBuffer, &uav, &buffer.pUAV );
+		}
+
+		if ( FAILED( hr ) )
+		{
+			release_buffer( buffer );
+			return false;
+		}
+
+		buffer.uBytes = desc.ByteWidth;
+		return true;
+	}
+
+	void upload( buffer_t& buffer, const void* pData, uint32_t uOffset, uint32_t uBytes )
+	{
+		D3D11_BOX box = {};
+		box.left = uOffset;
+		box.right = uOffset + uBytes;
+		box.bottom = 1;
+		box.back = 1;
+
+		_pContext->UpdateSubresource( buffer.pBuffer, 0, &box, pData, 0, 0 );
+	}
+
+	//
+	// Resize
+	//
+	// output as resample_rows would make it from input, with the taps in cols and rows,
+	// in lcolor_t with bWide. Returns false if the GPU cannot, and the CPU should.
+	//
+	bool Resize( colormap_t& output, const colormap_t& input, const resample_weights_t& cols, const resample_weights_t& rows,
+				 bool bWide, bool bLinear, bool bPremultiply )
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+
+		// the source rows the output needs.
+		const size_t row0 = size_t( rows._aFirst.front() );
+		const size_t row1 = size_t( rows._aFirst.back() ) + rows._uTaps;
+		const uint64_t uPixel = bWide ? 8 : 4;
+
+		if ( _bFailed || row1 - row0 > kMaxGroups || output._height > kMaxGroups || ( output._width + kGroupSize - 1 ) / kGroupSize > kMaxGroups )
+		{
+			return false;
+		}
+
+		std::vector< int32_t > aWeights;
+		aWeights.insert( aWeights.end(), cols._aFirst.begin(), cols._aFirst.end() );
+		aWeights.insert( aWeights.end(), cols._aWeights.begin(), cols._aWeights.end() );
+		for ( int first : rows._aFirst )
+		{
+			aWeights.push_back( int32_t( first - int( row0 ) ) );
+		}
+		aWeights.insert( aWeights.end(), rows._aWeights.begin(), rows._aWeights.end() );
+
+		ID3D11Buffer* pSourceBuffer = _source.pBuffer;
+
+		if ( !reserve( _source, uint64_t( input._width ) * ( row1 - row0 ) * 4, D3D11_BIND_SHADER_RESOURCE )
+			 || !reserve( _weights, aWeights.size() * 4, D3D11_BIND_SHADER_RESOURCE )
+			 || !reserve( _across, uint64_t( output._width ) * ( row1 - row0 ) * uPixel, D3D11_BIND_UNORDERED_ACCESS )
+			 || !reserve( _output, uint64_t( output._width ) * output._height * 4, D3D11_BIND_UNORDERED_ACCESS )
+			 || !reserve( _readback, uint64_t( output._width ) * output._height * 4, 0 ) )
+		{
+			_pLastSource = nullptr;
+			return false;
+		}
+
+		// unless it is the source uploaded last, into a buffer that has not been replaced since.
+		if ( pSourceBuffer != _source.pBuffer || _pLastSource != input.Row( row0 ) || _uLastRows[ 0 ] != input._width || _uLastRows[ 1 ] != row1 - row0 )
+		{
+			const uint32_t uRowBytes = uint32_t( input._width * 4 );
+
+			if ( input._stride == input._width )
+			{
+				upload( _source, input.Row( row0 ), 0, uint32_t( uRowBytes * ( row1 - row0 ) ) );
+			}
+			else
+			{
+				for ( size_t y = row0; y < row1; ++y )
+				{
+					upload( _source, input.Row( y ), uint32_t( ( y - row0 ) * uRowBytes ), uRowBytes );
+				}
+			}
+
+			_pLastSource = input.Row( row0 );
+			_uLastRows[ 0 ] = input._width;
+			_uLastRows[ 1 ] = row1 - row0;
+		}
+
+		upload( _weights, aWeights.data(), 0, uint32_t( aWeights.size() * 4 ) );
+
+		params_t params = {};
+		params.uSrcWidth = uint32_t( input._width );
+		params.uOutWidth = uint32_t( output._width );
+		params.uFlags = ( bWide ? 1 : 0 ) | ( bPremultiply ? 2 : 0 );
+		params.uTableBase = bLinear ? kTableSize : 0;
+
+		ID3D11ShaderResourceView* aViews[ 3 ] = { _source.pSRV, _weights.pSRV, _tables.pSRV };
+		ID3D11UnorderedAccessView* aTargets[ 2 ] = { _across.pUAV, _output.pUAV };
+
+		_pContext->CSSetShaderResources( 0, 3, aViews );
+		_pContext->CSSetUnorderedAccessViews( 0, 2, aTargets, nullptr );
+
+		// across: the columns' taps.
+		params.uHeight = uint32_t( row1 - row0 );
+		params.uFirst = 0;
+		params.uTaps = uint32_t( cols._uTaps );
+		params.uWeight = uint32_t( cols._aFirst.size() );
+
+		_pContext->UpdateSubresource( _pParams, 0, nullptr, &params, 0, 0 );
+		_pContext->CSSetShader( _pAcross, nullptr, 0 );
+		_pContext->Dispatch( uint32_t( ( output._width + kGroupSize - 1 ) / kGroupSize ), params.uHeight, 1 );
+
+		// down: the rows' taps.
+		params.uHeight = uint32_t( output._height );
+		params.uFirst = uint32_t( cols._aFirst.size() + cols._aWeights.size() );
+		params.uTaps = uint32_t( rows._uTaps );
+		params.uWeight = params.uFirst + uint32_t( rows._aFirst.size() );
+
+		_pContext->UpdateSubresource( _pParams, 0, nullptr, &params, 0, 0 );
+		_pContext->CSSetShader( _pDown, nullptr, 0 );
+		_pContext->Dispatch( uint32_t( ( output._width + kGroupSize - 1 ) / kGroupSize ), params.uHeight, 1 );
+
+		// read back.
+		D3D11_BOX box = {};
+		box.right = uint32_t( output._width * output._height * 4 );
+		box.bottom = 1;
+		box.back = 1;
+
+		_pContext->CopySubresourceRegion( _readback.pBuffer, 0, 0, 0, 0, _output.pBuffer, 0, &box );
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if ( FAILED( _pContext->Map( _readback.pBuffer, 0, D3D11_MAP_READ, 0, &mapped ) ) )
+		{
+			_bFailed = true;
+			return false;
+		}
+
+		const color_t* pResult = static_cast< const color_t* >( mapped.pData );
+		for ( size_t y = 0; y < output._height; ++y )
+		{
+			std::copy_n( pResult + y * output._width, output._width, output.Row( y ) );
+		}
+
+		_pContext->Unmap( _readback.pBuffer, 0 );
+		return true;
+	}
+
+	//
+	// Forget
+	//
+	// The image at pData is about to be freed, so it can't be the source kept any more.
+	//
+	void Forget( const color_t* pData, size_t uBytes )
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+
+		if ( _pLastSource >= pData && _pLastSource < reinterpret_cast< const color_t* >( reinterpret_cast< const uint8_t* >( pData ) + uBytes ) )
+		{
+			_pLastSource = nullptr;
+		}
+	}
+};
+
+//
+// resize_image_gpu
+//
+// resize_image on the -gpu device, with the same weights and sums as the CPU. False if
+// the GPU can't take it, and it should be resized on the CPU.
+//
+static bool resize_image_gpu( colormap_t& output, const colormap_t& input, const options_t& options, bool bPremultiply, std::atomic< bool >* pHasAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image_gpu" );
+
+	// nearest neighbor only copies, in the weights of one whole tap.
+	const bool bNearest = options.filter == FILTER_NEAREST;
+	const bool bLinear = options.linear && bNearest == false;
+	bPremultiply = bPremultiply && bNearest == false;
+
+	resample_weights_t cols;
+	resample_weights_t rows;
+	cols.Create( output._width, input._width, options.filter, options.fSharpen );
+	rows.Create( output._height, input._height, options.filter, options.fSharpen );
+
+	if ( options.pGpu->Resize( output, input, cols, rows, bLinear || bPremultiply, bLinear, bPremultiply ) == false )
+	{
+		return false;
+	}
+
+	if ( bNearest )
+	{
+		log << "Resizing to (" << output._width << " x " << output._height << ") - 'nearest neighbor' on the GPU\n";
+	}
+	else
+	{
+		log << "Resizing to (" << output._width << " x " << output._height << ") - '" << kFilterName[ options.filter ] << "'" << ( bLinear ? " in linear light" : "" ) << " on the GPU\n";
+	}
+
+	for ( size_t y = 0; y < output._height; ++y )
+	{
+		mark_alpha_row( output.Row( y ), output._width, pHasAlpha );
+	}
+
+	return true;
+}
+
+//==============================================================================
+
+//
+// determine_output_filename
+//
+// Figure out what we should call the output filename
+//
+static void determine_output_filename( const std::string& inputFile, options_t& options, std::string& outFile )
+{
+	// Use the single file output override?
+	if ( ( options.aInputFiles.size() == 1 ) && ( options.strOutFile.empty() == false ) )
+	{
+		outFile = options.strOutFile;
+		return;
+	}
+
+	// split input file into path and file.
+	std::string outFolder;
+	size_t slash_find = inputFile.find_last_of( "/\\", inputFile.npos ); // either kind of path separators
+	if ( slash_find == inputFile.npos )
+	{
+		outFile = inputFile;
+	}
+	else
+	{
+		outFolder = inputFile.substr( 0, slash_find + 1 );
+		outFile = inputFile.substr( slash_find + 1 );
+	}
+
+	if ( options.strOutFolder.empty() == false )
+	{
+		outFolder = options.strOutFolder;
+	}
+
+	size_t dot_find = outFile.find_last_of( ".", outFile.npos ); // last dot
+	if ( dot_find != inputFile.npos )
+	{
+		outFile = outFile.substr( 0, dot_find );
+	}
+
+	if ( outFolder.empty() == false )
+	{
+		const char tail = outFolder[ outFolder.length() - 1 ];
+
+		if ( tail != '\\' && tail != '//' )
+			outFolder += "\\";
+	}
+
+	outFile = outFolder + outFile + kFormatExtension[ options.format ];
+}
+
+//
+// output_size_t
+//
+// One output of an image: its size, and the rectangle of the source that it is made
+// from, which is all of it unless -fill or -crop cut it down.
+//
+struct output_size_t
+{
+	size_t width = 0;
+	size_t height = 0;
+
+	size_t src_x = 0;
+	size_t src_y = 0;
+	size_t src_width = 0;
+	size_t src_height = 0;
+
+	// from the same source rectangle as other, so one can be resized from the other.
+	bool SameSource( const output_size_t& other ) const
+	{
+		return src_x == other.src_x && src_y == other.src_y && src_width == other.src_width && src_height == other.src_height;
+	}
+};
+
+//
+// output_sizes
+//
+// The outputs for a w x h image, the largest first: each -w / -h pair, a single value
+// standing for all of them, with an omitted side kept to the image's aspect, fitted
+// (-fit) or cropped (-fill, -crop). -mips adds the half sizes below, from the same
+// source rectangle.
+//
+static void output_sizes( const options_t& options, size_t w, size_t h, std::vector< output_size_t >& aSizes )
+{
+	const size_t count = std::max< size_t >( 1, std::max( options.aWidths.size(), options.aHeights.size() ) );
+
+	auto pick_fn = []( const std::vector< size_t >& aList, size_t i ) -> size_t
+	{
+		return aList.empty() ? 0 : aList[ std::min( i, aList.size() - 1 ) ];
+	};
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		output_size_t size;
+		size.width = pick_fn( options.aWidths, i );
+		size.height = pick_fn( options.aHeights, i );
+		size.src_width = w;
+		size.src_height = h;
+
+		// is the image wider than the output, for its height?
+		const bool bWider = w * size.height > size.width * h;
+
+		if ( size.width == 0 && size.height == 0 )
+		{
+			// -mips on its own.
+			size.width = w;
+			size.height = h;
+		}
+		else if ( size.width == 0 )
+		{
+			size.width = w * size.height / h;
+		}
+		else if ( size.height == 0 )
+		{
+			size.height = h * size.width / w;
+		}
+		else if ( options.geometry == GEOMETRY_FIT )
+		{
+			if ( bWider )
+			{
+				size.height = h * size.width / w;
+			}
+			else
+			{
+				size.width = w * size.height / h;
+			}
+		}
+		else if ( options.geometry == GEOMETRY_FILL )
+		{
+			if ( bWider )
+			{
+				size.src_width = ( h * size.width + size.height / 2 ) / size.height;
+			}
+			else
+			{
+				size.src_height = ( w * size.height + size.width / 2 ) / size.width;
+			}
+		}
+		else if ( options.geometry == GEOMETRY_CROP )
+		{
+			size.width = std::min( size.width, w );
+			size.height = std::min( size.height, h );
+			size.src_width = size.width;
+			size.src_height = size.height;
+		}
+
+		size.width = std::max< size_t >( size.width, 1 );
+		size.height = std::max< size_t >( size.height, 1 );
+		size.src_width = std::clamp< size_t >( size.src_width, 1, w );
+		size.src_height = std::clamp< size_t >( size.src_height, 1, h );
+		size.src_x = ( w - size.src_width ) / 2;
+		size.src_y = ( h - size.src_height ) / 2;
+
+		aSizes.push_back( size );
+	}
+
+	if ( options.mips )
+	{
+		while ( aSizes.back().width > 1 || aSizes.back().height > 1 )
+		{
+			output_size_t size = aSizes.back();
+			size.width = std::max< size_t >( size.width / 2, 1 );
+			size.height = std::max< size_t >( size.height / 2, 1 );
+			aSizes.push_back( size );
+		}
+	}
+
+	std::stable_sort( aSizes.begin(), aSizes.end(), []( const auto& a, const auto& b ) { return a.width * a.height > b.width * b.height; } );
+}
+
+//
+// source_view
+//
+// The part of image that size is made from, logged when it is not all of it.
+//
+static colormap_t source_view( const colormap_t& image, const output_size_t& size, std::ostream& log )
+{
+	if ( size.src_width != image.OrientedWidth() || size.src_height != image.OrientedHeight() )
+	{
+		log << "Cropping to (" << size.src_width << " x " << size.src_height << ") at (" << size.src_x << ", " << size.src_y << ")\n";
+	}
+
+	return image.OrientedView( size.src_x, size.src_y, size.src_width, size.src_height );
+}
+
+//
+// sized_output_filename
+//
+// outFile with the size (width x height) added to the name, for several outputs from one image.
+//
+static std::string sized_output_filename( const std::string& outFile, size_t width, size_t height )
+{
+	const std::string strSize = "_" + std::to_string( width ) + "x" + std::to_string( height );
+
+	const size_t slash_find = outFile.find_last_of( "/\\" );
+	const size_t dot_find = outFile.find_last_of( '.' );
+
+	if ( dot_find == outFile.npos || ( slash_find != outFile.npos && dot_find < slash_find ) )
+	{
+		return outFile + strSize;
+	}
+
+	return outFile.substr( 0, dot_find ) + strSize + outFile.substr( dot_find );
+}
+
+//
+// output_formats
+//
+// The formats each output is written in: the -format list, or the one format.
+//
+static std::vector< format_t > output_formats( const options_t& options )
+{
+	return options.aFormats.empty() ? std::vector< format_t >{ options.format } : options.aFormats;
+}
+
+//
+// format_output_filename
+//
+// The name of an output in one format of a -format list: outFile with the format's
+// extension in place of its own.
+//
+static std::string format_output_filename( const std::string& outFile, format_t format, size_t count, size_t width, size_t height )
+{
+	const size_t slash_find = outFile.find_last_of( "/\\" );
+	const size_t dot_find = outFile.find_last_of( '.' );
+
+	std::string strFile = outFile;
+	if ( dot_find != outFile.npos && ( slash_find == outFile.npos || dot_find > slash_find ) )
+	{
+		strFile.resize( dot_find );
+	}
+	strFile += kFormatExtension[ format ];
+
+	return ( count == 1 ) ? strFile : sized_output_filename( strFile, width, height );
+}
+
+//==============================================================================
+
+//
+// dds_header_t
+//
+// The "DDS " magic and DDS_HEADER with its DDS_PIXELFORMAT, for a block compressed texture
+// with its mip levels after it, largest first.
+//
+struct dds_header_t
+{
+	uint32_t uMagic; // "DDS "
+	uint32_t uSize; // 124, the header without the magic
+	uint32_t uFlags;
+	uint32_t uHeight;
+	uint32_t uWidth;
+	uint32_t uLinearSize; // bytes in the first level
+	uint32_t uDepth;
+	uint32_t uMipCount;
+	uint32_t aReserved1[ 11 ];
+	uint32_t uFormatSize; // 32
+	uint32_t uFormatFlags;
+	uint32_t uFourCC;
+	uint32_t aMasks[ 5 ]; // bit count and R, G, B, A masks, unused with a FourCC
+	uint32_t uCaps;
+	uint32_t aCaps[ 3 ];
+	uint32_t uReserved2;
+};
+
+static_assert( sizeof( dds_header_t ) == 128, "dds_header_t is written as is" );
+
+static constexpr uint32_t make_fourcc( char a, char b, char c, char d )
+{
+	return uint32_t( uint8_t( a ) ) | ( uint32_t( uint8_t( b ) ) << 8 ) | ( uint32_t( uint8_t( c ) ) << 16 ) | ( uint32_t( uint8_t( d ) ) << 24 );
+}
+
+// a 0..255 colour to 5:6:5, and back as a decoder widens it.
+static uint16_t pack_565( const float* pColour )
+{
+	const int r = std::clamp( int( pColour[ 0 ] * ( 31.0f / 255.0f ) + 0.5f ), 0, 31 );
+	const int g = std::clamp( int( pColour[ 1 ] * ( 63.0f / 255.0f ) + 0.5f ), 0, 63 );
+	const int b = std::clamp( int( pColour[ 2 ] * ( 31.0f / 255.0f ) + 0.5f ), 0, 31 );
+	return uint16_t( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+static void unpack_565( uint16_t v, int* pColour )
+{
+	const int r = ( v >> 11 ) & 31;
+	const int g = ( v >> 5 ) & 63;
+	const int b = v & 31;
+	pColour[ 0 ] = ( r << 3 ) | ( r >> 2 );
+	pColour[ 1 ] = ( g << 2 ) | ( g >> 4 );
+	pColour[ 2 ] = ( b << 3 ) | ( b >> 2 );
+}
+
+//
+// bc_colour_fit
+//
+// The endpoints hi and lo as a four colour block (c0 > c1) for the 16 pixels of aBlock,
+// with each pixel's nearest of its colours. Returns the squared error of the block.
+//
+static uint32_t bc_colour_fit( const color_t* aBlock, const float* pHi, const float* pLo, uint16_t& c0, uint16_t& c1, uint32_t& indices )
+{
+	c0 = pack_565( pHi );
+	c1 = pack_565( pLo );
+	if ( c0 < c1 )
+	{
+		std::swap( c0, c1 );
+	}
+
+	int aColour[ 4 ][ 3 ];
+	unpack_565( c0, aColour[ 0 ] );
+	unpack_565( c1, aColour[ 1 ] );
+	for ( int c = 0; c < 3; ++c )
+	{
+		aColour[ 2 ][ c ] = ( 2 * aColour[ 0 ][ c ] + aColour[ 1 ][ c ] ) / 3;
+		aColour[ 3 ][ c ] = ( aColour[ 0 ][ c ] + 2 * aColour[ 1 ][ c ] ) / 3;
+	}
+
+	// equal endpoints would be the three colour mode, where index 3 is clear: use only 0.
+	const int choices = ( c0 == c1 ) ? 1 : 4;
+
+	indices = 0;
+	uint32_t error = 0;
+	for ( int i = 0; i < 16; ++i )
+	{
+		uint32_t best_error = UINT32_MAX;
+		uint32_t best = 0;
+
+		for ( int k = 0; k < choices; ++k )
+		{
+			uint32_t e = 0;
+			for ( int c = 0; c < 3; ++c )
+			{
+				const int d = int( aBlock[ i ].chan[ c ] ) - aColour[ k ][ c ];
+				e += uint32_t( d * d );
+			}
+
+			if ( e < best_error )
+			{
+				best_error = e;
+				best = uint32_t( k );
+			}
+		}
+
+		indices |= best << ( i * 2 );
+		error += best_error;
+	}
+
+	return error;
+}
+
+//
+// bc_colour_block
+//
+// The 8 byte colour half of a BC1 or BC3 block for the 16 pixels of aBlock: endpoints
+// at the ends of the pixels' principal axis, then refitted once by least squares to the
+// indices they gave, whichever is closer.
+//
+static void bc_colour_block( uint8_t* pOut, const color_t* aBlock )
+{
+	float mean[ 3 ] = { 0, 0, 0 };
+	float lo[ 3 ] = { 255, 255, 255 };
+	float hi[ 3 ] = { 0, 0, 0 };
+	for ( int i = 0; i < 16; ++i )
+	{
+		for ( int c = 0; c < 3; ++c )
+		{
+			const float v = aBlock[ i ].chan[ c ];
+			mean[ c ] += v;
+			lo[ c ] = std::min( lo[ c ], v );
+			hi[ c ] = std::max( hi[ c ], v );
+		}
+	}
+
+	for ( float& m : mean )
+	{
+		m /= 16.0f;
+	}
+
+	// the covariance, and its principal axis by power iteration from the bounding box.
+	float cov[ 6 ] = { 0, 0, 0, 0, 0, 0 };
+	for ( int i = 0; i < 16; ++i )
+	{
+		const float r = aBlock[ i ].chan[ 0 ] - mean[ 0 ];
+		const float g = aBlock[ i ].chan[ 1 ] - mean[ 1 ];
+		const float b = aBlock[ i ].chan[ 2 ] - mean[ 2 ];
+		cov[ 0 ] += r * r; cov[ 1 ] += r * g; cov[ 2 ] += r * b;
+		cov[ 3 ] += g * g; cov[ 4 ] += g * b; cov[ 5 ] += b * b;
+	}
+
+	float axis[ 3 ] = { hi[ 0 ] - lo[ 0 ], hi[ 1 ] - lo[ 1 ], hi[ 2 ] - lo[ 2 ] };
+	for ( int iter = 0; iter < 4; ++iter )
+	{
+		const float x = cov[ 0 ] * axis[ 0 ] + cov[ 1 ] * axis[ 1 ] + cov[ 2 ] * axis[ 2 ];
+		const float y = cov[ 1 ] * axis[ 0 ] + cov[ 3 ] * axis[ 1 ] + cov[ 4 ] * axis[ 2 ];
+		const float z = cov[ 2 ] * axis[ 0 ] + cov[ 4 ] * axis[ 1 ] + cov[ 5 ] * axis[ 2 ];
+		const float scale = std::max( { std::abs( x ), std::abs( y ), std::abs( z ) } );
+		if ( scale == 0.0f )
+		{
+			break;
+		}
+
+		axis[ 0 ] = x / scale;
+		axis[ 1 ] = y / scale;
+		axis[ 2 ] = z / scale;
+	}
+
+	// the pixels furthest along it either way.
+	auto project_fn = [&]( int i ) { return aBlock[ i ].chan[ 0 ] * axis[ 0 ] + aBlock[ i ].chan[ 1 ] * axis[ 1 ] + aBlock[ i ].chan[ 2 ] * axis[ 2 ]; };
+
+	int imin = 0, imax = 0;
+	float dmin = project_fn( 0 ), dmax = dmin;
+	for ( int i = 1; i < 16; ++i )
+	{
+		const float d = project_fn( i );
+		if ( d < dmin ) { dmin = d; imin = i; }
+		if ( d > dmax ) { dmax = d; imax = i; }
+	}
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		hi[ c ] = aBlock[ imax ].chan[ c ];
+		lo[ c ] = aBlock[ imin ].chan[ c ];
+	}
+
+	uint16_t c0, c1;
+	uint32_t indices;
+	uint32_t error = bc_colour_fit( aBlock, hi, lo, c0, c1, indices );
+
+	// refit: the endpoints that best give the pixels for the indices chosen.
+	if ( c0 != c1 && error > 0 )
+	{
+		static const float kWeight[ 4 ] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		float aa = 0, ab = 0, bb = 0;
+		float ax[ 3 ] = { 0, 0, 0 };
+		float bx[ 3 ] = { 0, 0, 0 };
+		for ( int i = 0; i < 16; ++i )
+		{
+			const float a = kWeight[ ( indices >> ( i * 2 ) ) & 3 ];
+			const float b = 1.0f - a;
+			aa += a * a; ab += a * b; bb += b * b;
+			for ( int c = 0; c < 3; ++c )
+			{
+				ax[ c ] += a * aBlock[ i ].chan[ c ];
+				bx[ c ] += b * aBlock[ i ].chan[ c ];
+			}
+		}
+
+		const float det = aa * bb - ab * ab;
+		if ( std::abs( det ) > 1e-4f )
+		{
+			float fit_hi[ 3 ], fit_lo[ 3 ];
+			for ( int c = 0; c < 3; ++c )
+			{
+				fit_hi[ c ] = std::clamp( ( bb * ax[ c ] - ab * bx[ c ] ) / det, 0.0f, 255.0f );
+				fit_lo[ c ] = std::clamp( ( aa * bx[ c ] - ab * ax[ c ] ) / det, 0.0f, 255.0f );
+			}
+
+			uint16_t fit_c0, fit_c1;
+			uint32_t fit_indices;
+			const uint32_t fit_error = bc_colour_fit( aBlock, fit_hi, fit_lo, fit_c0, fit_c1, fit_indices );
+			if ( fit_error < error )
+			{
+				c0 = fit_c0;
+				c1 = fit_c1;
+				indices = fit_indices;
+			}
+		}
+	}
+
+	memcpy( pOut, &c0, 2 );
+	memcpy( pOut + 2, &c1, 2 );
+	memcpy( pOut + 4, &indices, 4 );
+}
+
+//
+// bc_alpha_block
+//
+// The 8 byte alpha half of a BC3 block: the block's highest and lowest alpha, with the
+// six between them, and each pixel's nearest of the eight.
+//
+static void bc_alpha_block( uint8_t* pOut, const color_t* aBlock )
+{
+	int a0 = 0, a1 = 255;
+	for ( int i = 0; i < 16; ++i )
+	{
+		a0 = std::max< int >( a0, aBlock[ i ].chan[ 3 ] );
+		a1 = std::min< int >( a1, aBlock[ i ].chan[ 3 ] );
+	}
+
+	pOut[ 0 ] = uint8_t( a0 );
+	pOut[ 1 ] = uint8_t( a1 );
+
+	uint64_t bits = 0;
+	if ( a0 > a1 )
+	{
+		int aValue[ 8 ] = { a0, a1 };
+		for ( int k = 2; k < 8; ++k )
+		{
+			aValue[ k ] = ( ( 8 - k ) * a0 + ( k - 1 ) * a1 ) / 7;
+		}
+
+		for ( int i = 0; i < 16; ++i )
+		{
+			int best = 0;
+			for ( int k = 1; k < 8; ++k )
+			{
+				if ( std::abs( aBlock[ i ].chan[ 3 ] - aValue[ k ] ) < std::abs( aBlock[ i ].chan[ 3 ] - aValue[ best ] ) )
+				{
+					best = k;
+				}
+			}
+
+			bits |= uint64_t( best ) << ( i * 3 );
+		}
+	}
+
+	for ( int b = 0; b < 6; ++b )
+	{
+		pOut[ 2 + b ] = uint8_t( bits >> ( b * 8 ) );
+	}
+}
+
+//
+// bc_encode
+//
+// image as BC1 blocks (8 bytes each), or BC3 (16) with bAlpha, into pOut in rows of
+// blocks. Blocks past the right or bottom edge repeat the edge pixels. The rows of
+// blocks are encoded in bands on up to threads threads.
+//
+static size_t bc_size( size_t width, size_t height, bool bAlpha )
+{
+	return ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * ( bAlpha ? 16 : 8 );
+}
+
+static void bc_encode( uint8_t* pOut, const colormap_t& image, bool bAlpha, size_t threads )
+{
+	TRACE_ZONE( "bc_encode" );
+
+	const size_t blocks_x = ( image._width + 3 ) / 4;
+	const size_t blocks_y = ( image._height + 3 ) / 4;
+	const size_t block_size = bAlpha ? 16 : 8;
+
+	run_row_bands( blocks_x * 16, blocks_y, threads, [&]( size_t by0, size_t by1 )
+	{
+		color_t aBlock[ 16 ];
+
+		for ( size_t by = by0; by < by1; ++by )
+		{
+			const color_t* apRows[ 4 ];
+			for ( size_t y = 0; y < 4; ++y )
+			{
+				apRows[ y ] = image.Row( std::min( by * 4 + y, image._height - 1 ) );
+			}
+
+			uint8_t* pBlock = pOut + by * blocks_x * block_size;
+			for ( size_t bx = 0; bx < blocks_x; ++bx, pBlock += block_size )
+			{
+				for ( size_t i = 0; i < 16; ++i )
+				{
+					aBlock[ i ] = apRows[ i / 4 ][ std::min( bx * 4 + i % 4, image._width - 1 ) ];
+				}
+
+				if ( bAlpha )
+				{
+					bc_alpha_block( pBlock, aBlock );
+					bc_colour_block( pBlock + 8, aBlock );
+				}
+				else
+				{
+					bc_colour_block( pBlock, aBlock );
+				}
+			}
+		}
+	} );
+}
+
+//
+// write_dds
+//
+// count images in one .dds file, as its mip levels from the largest: BC1, or BC3 when
+// any of them is not opaque. Each level is block compressed straight from its pixels on
+// up to threads threads.
+//
+static bool write_dds( const colormap_t* pLevels, size_t count, const std::string& strOutFile, size_t threads, std::ostream& log )
+{
+	TRACE_ZONE( "write_dds" );
+
+	bool bAlpha = false;
+	for ( size_t i = 0; i < count; ++i )
+	{
+		bAlpha = bAlpha || pLevels[ i ]._bHasAlpha;
+	}
+
+	log << "Writing \"" << strOutFile << "\" (" << ( bAlpha ? "BC3" : "BC1" );
+	if ( count > 1 )
+	{
+		log << ", " << count << " mips";
+	}
+	log << ") ... ";
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, strOutFile.c_str(), "wb" );
+	if ( e != 0 || fp == nullptr )
+	{
+		log << "ERROR (attempted overwrite?)\n\n";
+		return false;
+	}
+
+	dds_header_t header = {};
+	header.uMagic = make_fourcc( 'D', 'D', 'S', ' ' );
+	header.uSize = 124;
+	header.uFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000 | ( count > 1 ? 0x20000 : 0 ); // CAPS, HEIGHT, WIDTH, PIXELFORMAT, LINEARSIZE, MIPMAPCOUNT
+	header.uHeight = uint32_t( pLevels[ 0 ]._height );
+	header.uWidth = uint32_t( pLevels[ 0 ]._width );
+	header.uLinearSize = uint32_t( bc_size( pLevels[ 0 ]._width, pLevels[ 0 ]._height, bAlpha ) );
+	header.uMipCount = uint32_t( count );
+	header.uFormatSize = 32;
+	header.uFormatFlags = 0x4; // FOURCC
+	header.uFourCC = bAlpha ? make_fourcc( 'D', 'X', 'T', '5' ) : make_fourcc( 'D', 'X', 'T', '1' );
+	header.uCaps = 0x1000 | ( count > 1 ? ( 0x8 | 0x400000 ) : 0 ); // TEXTURE, COMPLEX, MIPMAP
+
+	bool bFailed = fwrite( &header, sizeof( header ), 1, fp ) != 1;
+
+	std::vector< uint8_t > aBlocks;
+	for ( size_t i = 0; i < count && bFailed == false; ++i )
+	{
+		aBlocks.resize( bc_size( pLevels[ i ]._width, pLevels[ i ]._height, bAlpha ) );
+		bc_encode( aBlocks.data(), pLevels[ i ], bAlpha, threads );
+		bFailed = fwrite( aBlocks.data(), 1, aBlocks.size(), fp ) != aBlocks.size();
+	}
+
+	if ( fclose( fp ) != 0 || bFailed )
+	{
+		return false;
+	}
+
+	log << "OK\n";
+	return true;
+}
+
+//
+// resize_threads
+//
+// The cores left over by -j, for the row bands of one resize.
+//
+static size_t resize_threads( const options_t& options )
+{
+	if ( options.uResizeThreads > 0 )
+	{
+		return options.uResizeThreads;
+	}
+
+	return std::max< size_t >( 1, task_thread_cap() / std::max< uint32_t >( options.uThreadCount, 1 ) );
+}
+
+//
+// resize_image
+//
+// input resized to fill output with the -filter, on the cores left over by -j. With
+// bAlpha (a source with alpha) the output notes whether any of it is not opaque.
+//
+static void resize_image( colormap_t& output, const colormap_t& input, const options_t& options, bool bAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image" );
+
+	const size_t threads = resize_threads( options );
+	const bool bPremultiply = bAlpha;
+
+	std::atomic< bool > has_alpha = false;
+	std::atomic< bool >* pHasAlpha = bAlpha ? &has_alpha : nullptr;
+
+	if ( options.pGpu && input._orientation == 1 && resize_image_gpu( output, input, options, bPremultiply, pHasAlpha, log ) )
+	{
+		output._bHasAlpha = has_alpha;
+		return;
+	}
+
+	// an exact half by area, without alpha to weigh the colour by, is a 2x2 mean.
+	if ( options.filter == FILTER_AREA && options.fSharpen == 0.0 && options.linear == false && bPremultiply == false && input._orientation == 1 &&
+		 output._width * 2 == input._width && output._height * 2 == input._height )
+	{
+		resize_image_halve( output, input, threads, pHasAlpha, log );
+		output._bHasAlpha = has_alpha;
+		return;
+	}
+
+	switch ( options.filter )
+	{
+
+	default:
+	case FILTER_NEAREST:
+		resize_image_nearest( output, input, threads, pHasAlpha, log );
+		break;
+
+	case FILTER_BILINEAR:
+	case FILTER_AREA:
+	case FILTER_MITCHELL:
+	case FILTER_LANCZOS3:
+		// one pass, the filter widens with the reduction.
+		resize_image_separable( output, input, options.filter, options.fSharpen, options.linear, bPremultiply, threads, pHasAlpha, log );
+		break;
+
+	}
+
+	output._bHasAlpha = has_alpha;
+}
+
+//
+// resize_image_palette
+//
+// input resized with the -filter straight to palette indices in output: each row is
+// palettised as soon as it is resampled, so the resized image is never held in RGBA.
+// Dithering needs the rows in order, so with it the rows are resampled in chunks on the
+// resize threads and dithered here as each chunk comes in, the same as one band would.
+//
+static void resize_image_palette( indexmap_t& output, const colormap_t& input, options_t& options, bool bAlpha, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image_palette" );
+
+	const size_t width = size_t( output._width );
+	const size_t height = size_t( output._height );
+	const bool bNearest = options.filter == FILTER_NEAREST;
+	const bool bLinear = options.linear && bNearest == false;
+	const bool bPremultiply = bAlpha && bNearest == false;
+	const size_t threads = ( width * height < kBandMinPixels ) ? 1 : resize_threads( options );
+
+	if ( bNearest )
+	{
+		log << "Resizing to (" << width << " x " << height << ") - 'nearest neighbor'\n";
+	}
+	else
+	{
+		log << "Resizing to (" << width << " x " << height << ") - '" << kFilterName[ options.filter ] << "'" << ( bLinear ? " in linear light" : "" ) << "\n";
+	}
+
+	resample_weights_t cols;
+	resample_weights_t rows;
+	cols.Create( width, input.OrientedWidth(), options.filter, options.fSharpen );
+	rows.Create( height, input.OrientedHeight(), options.filter, options.fSharpen );
+
+	palette_rows_t palette;
+	palette.Create( options, output );
+
+	// rows [y0, y1) resampled, each into dest_fn( y ) and then handed to done_fn( y ).
+	auto resample_fn = [&]( size_t y0, size_t y1, auto dest_fn, auto done_fn )
+	{
+		std::vector< color_t > aSource( input._orientation == 1 ? 0 : input.OrientedWidth() );
+		auto source_fn = [&]( size_t y ) { return input.OrientedRow( y, aSource.data() ); };
+
+		if ( bLinear || bPremultiply )
+		{
+			resample_rows< lcolor_t >( cols, rows, input.OrientedWidth(), y0, y1, source_fn, dest_fn, done_fn, &lcolor_tables( bLinear ), bPremultiply );
+		}
+		else
+		{
+			resample_rows< color_t >( cols, rows, input.OrientedWidth(), y0, y1, source_fn, dest_fn, done_fn, nullptr, false );
+		}
+	};
+
+	if ( options.bDither && threads > 1 )
+	{
+		run_row_chunks( width, height, threads, [&]( size_t y0, size_t y1, color_t* pRows )
+		{
+			resample_fn( y0, y1, [&]( size_t y ) { return pRows + ( y - y0 ) * width; }, []( size_t ) {} );
+		},
+		[&]( size_t y, const color_t* pRow )
+		{
+			palette.Row( y, pRow, nullptr );
+		} );
+		return;
+	}
+
+	run_row_bands( width, height, options.bDither ? 1 : threads, [&]( size_t y0, size_t y1 )
+	{
+		std::vector< color_t > aRow( width );
+		std::vector< uint8_t > aIndices( width );
+
+		resample_fn( y0, y1, [&]( size_t ) { return aRow.data(); }, [&]( size_t y ) { palette.Row( y, aRow.data(), aIndices.data() ); } );
+	} );
+}
+
+//
+// index_bpp
+//
+// The bits per pixel of an indexed output of a palette of uColours, or 24 without one.
+//
+static uint8_t index_bpp( size_t uColours )
+{
+	if ( uColours == 0 )
+	{
+		return 24;
+	}
+	else if ( uColours == 2 )
+	{
+		return 1;
+	}
+	else if ( uColours <= 4 )
+	{
+		return 2;
+	}
+	else if ( uColours <= 16 )
+	{
+		return 4;
+	}
+
+	return 8;
+}
+
+//
+// palettise_image
+//
+// An image already resized, remapped to the -pal palette for the pal output of a -format
+// list, by the palette_rows_t that resize_image_palette hands its rows to: without -dither
+// in bands across the threads, and with it a row at a time in order.
+//
+static void palettise_image( indexmap_t& output, const colormap_t& input, options_t& options, size_t threads )
+{
+	TRACE_ZONE( "palettise_image" );
+
+	const size_t width = input._width;
+	const size_t height = input._height;
+
+	output.Create( width, height, index_bpp( options.aPalette.size() ), height );
+
+	palette_rows_t palette;
+	palette.Create( options, output );
+
+	run_row_bands( width, height, ( options.bDither || width * height < kBandMinPixels ) ? 1 : threads, [&]( size_t y0, size_t y1 )
+	{
+		std::vector< uint8_t > aIndices( width );
+
+		for ( size_t y = y0; y < y1; ++y )
+		{
+			palette.Row( y, input._data_ptr + y * width, aIndices.data() );
+		}
+	} );
+}
+
+//
+// deep_tables_t
+//
+// -deep's conversions, as lcolor_tables_t's: bytes and 16-bit words to kDeepBits, in
+// linear light or only rescaled, and back to bytes. Every byte comes back unchanged.
+//
+struct deep_tables_t
+{
+	uint16_t _aToColour[ 256 ];
+	std::vector< uint16_t > _aWordToColour; // 65536 entries, for a 16-bit source.
+	std::vector< uint8_t > _aFromColour; // kDeepMax + 1 entries, as the two below.
+	std::vector< uint8_t > _aFromAlpha;
+	std::vector< uint32_t > _aReciprocal; // ( kDeepMax << 16 ) / alpha, to unpremultiply.
+};
+
+// alpha, which is only ever rescaled, to kDeepBits from a byte and from a word.
+static inline uint32_t deep_alpha( uint8_t a )
+{
+	return ( uint32_t( a ) * kDeepMax + 127 ) / 255;
+}
+
+static inline uint32_t deep_alpha( uint16_t a )
+{
+	return ( uint32_t( a ) * kDeepMax + 32767 ) / 65535;
+}
+
+// built on first use.
+static const deep_tables_t& deep_tables( bool bLinear )
+{
+	auto to_linear_fn = []( double v ) { return ( v <= 0.04045 ) ? ( v / 12.92 ) : std::pow( ( v + 0.055 ) / 1.055, 2.4 ); };
+	auto to_srgb_fn = []( double l ) { return ( l <= 0.0031308 ) ? ( l * 12.92 ) : ( 1.055 * std::pow( l, 1.0 / 2.4 ) - 0.055 ); };
+
+	auto build_fn = [&]( bool bLinear )
+	{
+		deep_tables_t t;
+		const float* aLinear = srgb_linear_table();
+
+		for ( int i = 0; i < 256; ++i )
+		{
+			t._aToColour[ i ] = bLinear ? uint16_t( std::lround( aLinear[ i ] * kDeepMax ) ) : uint16_t( deep_alpha( uint8_t( i ) ) );
+		}
+
+		t._aWordToColour.resize( 65536 );
+		for ( int i = 0; i < 65536; ++i )
+		{
+			t._aWordToColour[ i ] = bLinear ? uint16_t( std::lround( to_linear_fn( i / 65535.0 ) * kDeepMax ) ) : uint16_t( deep_alpha( uint16_t( i ) ) );
+		}
+
+		t._aFromColour.resize( kDeepMax + 1 );
+		t._aFromAlpha.resize( kDeepMax + 1 );
+		t._aReciprocal.resize( kDeepMax + 1 );
+		for ( int i = 0; i <= kDeepMax; ++i )
+		{
+			t._aFromAlpha[ i ] = uint8_t( ( i * 255 + kDeepMax / 2 ) / kDeepMax );
+			t._aFromColour[ i ] = bLinear ? uint8_t( std::clamp( std::lround( to_srgb_fn( double( i ) / kDeepMax ) * 255.0 ), 0L, 255L ) ) : t._aFromAlpha[ i ];
+			t._aReciprocal[ i ] = i ? uint32_t( ( ( uint64_t( kDeepMax ) << 16 ) + i / 2 ) / i ) : 0;
+		}
+
+		return t;
+	};
+
+	static const deep_tables_t linear = build_fn( true );
+	static const deep_tables_t plain = build_fn( false );
+
+	return bLinear ? linear : plain;
+}
+
+//
+// deepmap_t
+//
+// An image of dcolor_t, for -deep: the source widened once, and each output as it is
+// resampled, kept for the smaller ones made from it.
+//
+struct deepmap_t
+{
+
+public:
+
+	dcolor_t* _data_ptr = nullptr;
+	size_t _width = 0;
+	size_t _height = 0;
+	image_buffer_t _buffer;
+
+public:
+
+	void Create( size_t w, size_t h )
+	{
+		_width = w;
+		_height = h;
+		_data_ptr = _buffer.Allocate< dcolor_t >( w * h );
+	}
+
+	dcolor_t* Row( size_t y ) const
+	{
+		return _data_ptr + y * _width;
+	}
+};
+
+//
+// widen_deep_image
+//
+// view (a source_view of image) as it is seen, widened into output. pWords is image's
+// RGBA as 16-bit words when it was loaded as such, in image's layout, or nullptr for its
+// bytes. With bPremultiply colour is scaled by alpha, as to_lcolor_row does.
+//
+static void widen_deep_image( deepmap_t& output, const colormap_t& view, const colormap_t& image, const uint16_t* pWords, bool bLinear, bool bPremultiply,
+							  size_t threads )
+{
+	TRACE_ZONE( "widen_deep_image" );
+
+	const deep_tables_t& tables = deep_tables( bLinear );
+	const ptrdiff_t base = view._data_ptr - image._data_ptr;
+
+	output.Create( view.OrientedWidth(), view.OrientedHeight() );
+
+	auto store_fn = [&]( dcolor_t& out, const uint32_t ( &colour )[ 3 ], uint32_t a )
+	{
+		for ( int c = 0; c < 3; ++c )
+		{
+			out.chan[ c ] = uint16_t( bPremultiply ? ( colour[ c ] * a + kDeepMax / 2 ) / kDeepMax : colour[ c ] );
+		}
+		out.chan[ 3 ] = uint16_t( a );
+	};
+
+	run_row_bands( output._width, output._height, threads, [&]( size_t y0, size_t y1 )
+	{
+		for ( size_t y = y0; y < y1; ++y )
+		{
+			dcolor_t* pOut = output.Row( y );
+
+			ptrdiff_t step;
+			ptrdiff_t at = view.OrientedStart( y, step );
+
+			for ( size_t x = 0; x < output._width; ++x, at += step )
+			{
+				if ( pWords )
+				{
+					const uint16_t* pWord = pWords + ( base + at ) * 4;
+					const uint32_t colour[ 3 ] = { tables._aWordToColour[ pWord[ 0 ] ], tables._aWordToColour[ pWord[ 1 ] ], tables._aWordToColour[ pWord[ 2 ] ] };
+					store_fn( pOut[ x ], colour, deep_alpha( pWord[ 3 ] ) );
+				}
+				else
+				{
+					const color_t& pixel = view._data_ptr[ at ];
+					const uint32_t colour[ 3 ] = { tables._aToColour[ pixel.chan[ 0 ] ], tables._aToColour[ pixel.chan[ 1 ] ], tables._aToColour[ pixel.chan[ 2 ] ] };
+					store_fn( pOut[ x ], colour, deep_alpha( pixel.chan[ 3 ] ) );
+				}
+			}
+		}
+	} );
+}
+
+//
+// narrow_deep_image
+//
+// input narrowed to bytes in output (of the same size), each pixel rounded once, with
+// bPremultiply its colour divided by its alpha again, as from_lcolor_row does.
+//
+static void narrow_deep_image( colormap_t& output, const deepmap_t& input, bool bLinear, bool bPremultiply, size_t threads )
+{
+	TRACE_ZONE( "narrow_deep_image" );
+
+	const deep_tables_t& tables = deep_tables( bLinear );
+
+	std::atomic< bool > has_alpha = false;
+	std::atomic< bool >* pHasAlpha = bPremultiply ? &has_alpha : nullptr;
+
+	run_row_bands( output._width, output._height, threads, [&]( size_t y0, size_t y1 )
+	{
+		for ( size_t y = y0; y < y1; ++y )
+		{
+			const dcolor_t* pSrc = input.Row( y );
+			color_t* pDest = output.Row( y );
+
+			for ( size_t x = 0; x < output._width; ++x )
+			{
+				const uint32_t a = pSrc[ x ].chan[ 3 ];
+
+				for ( int c = 0; c < 3; ++c )
+				{
+					uint32_t v = pSrc[ x ].chan[ c ];
+					if ( bPremultiply )
+					{
+						// a filter's overshoot can leave colour above alpha, which no pixel has.
+						v = ( std::min( v, a ) * tables._aReciprocal[ a ] + 0x8000 ) >> 16;
+					}
+					pDest[ x ].chan[ c ] = tables._aFromColour[ std::min< uint32_t >( v, kDeepMax ) ];
+				}
+
+				pDest[ x ].chan[ 3 ] = tables._aFromAlpha[ a ];
+			}
+
+			mark_alpha_row( pDest, output._width, pHasAlpha );
+		}
+	} );
+
+	output._bHasAlpha = has_alpha;
+}
+
+//
+// resize_image_deep
+//
+// input resized to fill output with the -filter, in dcolor_t throughout, on the cores left
+// over by -j.
+//
+static void resize_image_deep( deepmap_t& output, const deepmap_t& input, const options_t& options, std::ostream& log )
+{
+	TRACE_ZONE( "resize_image_deep" );
+
+	log << "Resizing to (" << output._width << " x " << output._height << ") - '" << kFilterName[ options.filter ] << "'"
+		<< ( options.linear ? " in linear light" : "" ) << ", " << kDeepBits << "-bit\n";
+
+	resample_weights_t cols;
+	resample_weights_t rows;
+	cols.Create( output._width, input._width, options.filter, options.fSharpen );
+	rows.Create( output._height, input._height, options.filter, options.fSharpen );
+
+	run_row_bands( output._width, output._height, resize_threads( options ), [&]( size_t y0, size_t y1 )
+	{
+		resample_rows< dcolor_t >( cols, rows, input._width, y0, y1,
+			[&]( size_t y ) { return input.Row( y ); },
+			[&]( size_t ry ) { return output.Row( ry ); },
+			[]( size_t ) {},
+			nullptr, false );
+	} );
+}
+
+//
+// image_job_t
+//
+// One input file on its way through the pipeline, and its log.
+//
+struct image_job_t
+{
+	size_t uIndex = 0;
+	std::string strInputFile;
+	std::string strOutFile;
+
+	unsigned char* img_data = nullptr;
+	uint16_t* img_data16 = nullptr; // -deep: a 16-bit source as loaded, with original its bytes.
+	int chan_count = 0;
+	colormap_t original; // as loaded: in its own buffer from png_reader_t, or img_data.
+	std::vector< colormap_t > aResized;
+	std::vector< indexmap_t > aIndexed; // with -pal, instead of aResized.
+
+	std::ifstream fileInput; // kept open to prevent common user error of overwriting input!
+	std::ostringstream log;
+	bool bFailed = false; // not loaded, or an output not written.
+
+	uint64_t uCacheKey = 0; // -cache: the source and options, see cache_key.
+	std::vector< std::pair< std::string, std::string > > aCacheFiles; // outputs written, and their names in the cache.
+
+	uint64_t uPixels = 0; // of the source, and the bytes of the outputs, for palstat.h.
+	uint64_t uBytesOut = 0;
+
+	~image_job_t()
+	{
+		if ( img_data )
+		{
+			stbi_image_free( img_data );
+		}
+		if ( img_data16 )
+		{
+			stbi_image_free( img_data16 );
+		}
+	}
+};
+
+//
+// kCacheVersion
+//
+// Part of every -cache key. Bump it whenever a change to imgsize changes the output for
+// the same source and options, so that outputs kept by older builds are not used.
+//
+static constexpr uint32_t kCacheVersion = 2;
+
+//
+// cache_key
+//
+// The -cache key of a source file's contents and the options that shape its outputs.
+//
+static uint64_t cache_key( const uint8_t* pData, size_t size, const options_t& options )
+{
+	cache_hash_t hash;
+
+	hash.AddData( pData, size );
+	hash.Add( kCacheVersion );
+
+	hash.Add( uint32_t( options.aWidths.size() ) );
+	for ( size_t width : options.aWidths )
+	{
+		hash.Add( uint32_t( width ) );
+	}
+	hash.Add( uint32_t( options.aHeights.size() ) );
+	for ( size_t height : options.aHeights )
+	{
+		hash.Add( uint32_t( height ) );
+	}
+
+	hash.Add( uint32_t( ( options.aspect_preserve ? 1 : 0 ) | ( options.mips ? 2 : 0 ) | ( options.linear ? 4 : 0 ) | ( options.bDither ? 8 : 0 ) | ( options.stream ? 16 : 0 ) |
+					   ( options.deep ? 32 : 0 ) ) );
+	hash.Add( uint32_t( options.filter ) );
+	hash.Add( uint32_t( options.geometry ) );
+	hash.Add( uint32_t( options.format ) );
+	hash.Add( uint32_t( std::lround( options.fSharpen * 1e6 ) ) );
+
+	hash.Add( uint32_t( options.aPalette.size() ) );
+	hash.Add( options.aPalette.uHash );
+
+	// a -format list; one format is as it always was.
+	for ( format_t format : options.aFormats )
+	{
+		hash.Add( uint32_t( format ) );
+	}
+
+	return hash.uHash;
+}
+
+//
+// cache_name
+//
+// The name of the output of one size and format in the cache, after its key.
+//
+static std::string cache_name( format_t format, size_t width, size_t height )
+{
+	char szName[ 48 ];
+	sprintf_s( szName, sizeof( szName ), "%zux%zu%s", width, height, kFormatExtension[ format ] );
+
+	return szName;
+}
+
+//
+// unlink_cached_output
+//
+// An output fetched by an earlier -cache run may be a hard link to a kept file: remove it
+// before it is written, with or without -cache this run, rather than write through the
+// link into the cache.
+//
+static void unlink_cached_output( const std::string& strOutFile )
+{
+	std::error_code ec;
+	std::filesystem::remove( strOutFile, ec );
+}
+
+//
+// file_bytes
+//
+// The size of a file for palstat.h, or 0 when it is not reporting.
+//
+static uint64_t file_bytes( const std::string& strFile )
+{
+	if ( stat_enabled() == false )
+	{
+		return 0;
+	}
+
+	std::error_code ec;
+	const uintmax_t size = std::filesystem::file_size( strFile, ec );
+	return ec ? 0 : uint64_t( size );
+}
+
+//
+// note_output
+//
+// An output that was written: counted for palstat.h, and with -cache for cache_store to keep.
+//
+static void note_output( image_job_t& job, const options_t& options, const std::string& strOutFile, format_t format, size_t width, size_t height )
+{
+	job.uBytesOut += file_bytes( strOutFile );
+
+	if ( options.cache.IsOpen() )
+	{
+		job.aCacheFiles.emplace_back( strOutFile, cache_name( format, width, height ) );
+	}
+}
+
+//
+// exif_orientation
+//
+// The orientation tag (1 to 8) in the EXIF block of a JPEG's header, 1 if there is none:
+// how its stored pixels are to be mirrored or turned to be seen the right way up.
+//
+static int exif_orientation( const uint8_t* pData, size_t size )
+{
+	if ( size < 4 || pData[ 0 ] != 0xFF || pData[ 1 ] != 0xD8 )
+	{
+		return 1;
+	}
+
+	// the markers before the image data, each FF xx then a big endian length.
+	size_t pos = 2;
+	while ( pos + 4 <= size && pData[ pos ] == 0xFF )
+	{
+		const uint8_t marker = pData[ pos + 1 ];
+		const size_t length = ( size_t( pData[ pos + 2 ] ) << 8 ) | pData[ pos + 3 ];
+		if ( marker == 0xDA || length < 2 )
+		{
+			break;
+		}
+
+		const uint8_t* pTiff = pData + pos + 10;
+		const size_t tiff_size = std::min( length - 2, size - pos - 4 );
+
+		// APP1 "Exif\0\0", then a TIFF header and its first directory.
+		if ( marker == 0xE1 && tiff_size >= 6 + 8 && memcmp( pData + pos + 4, "Exif\0\0", 6 ) == 0 )
+		{
+			const size_t tiff_end = tiff_size - 6;
+			const bool bBigEndian = pTiff[ 0 ] == 'M';
+
+			auto u16_fn = [&]( size_t at ) { return bBigEndian ? uint32_t( ( pTiff[ at ] << 8 ) | pTiff[ at + 1 ] ) : uint32_t( pTiff[ at ] | ( pTiff[ at + 1 ] << 8 ) ); };
+			auto u32_fn = [&]( size_t at ) { return bBigEndian ? ( ( u16_fn( at ) << 16 ) | u16_fn( at + 2 ) ) : ( u16_fn( at ) | ( u16_fn( at + 2 ) << 16 ) ); };
+
+			const size_t ifd = u32_fn( 4 );
+			if ( ifd + 2 > tiff_end )
+			{
+				return 1;
+			}
+
+			const size_t count = u16_fn( ifd );
+			for ( size_t i = 0; i < count && ifd + 2 + ( i + 1 ) * 12 <= tiff_end; ++i )
+			{
+				const size_t entry = ifd + 2 + i * 12;
+
+				// tag 0x0112, a SHORT.
+				if ( u16_fn( entry ) == 0x0112 && u16_fn( entry + 2 ) == 3 )
+				{
+					const uint32_t value = u16_fn( entry + 8 );
+					return ( value >= 1 && value <= 8 ) ? int( value ) : 1;
+				}
+			}
+
+			return 1;
+		}
+
+		pos += 2 + length;
+	}
+
+	return 1;
+}
+
+//
+// cache_fetch
+//
+// -cache: key the job's source, and if every output it would make is kept, link them in
+// (or copy them, where links can't be made). True if the job is done; if an output went
+// from the cache before it could be fetched, the job is run as if none were kept.
+//
+static bool cache_fetch( image_job_t& job, options_t& options )
+{
+	mapped_file_t source;
+	if ( source.Open( job.strInputFile ) == false )
+	{
+		return false;
+	}
+
+	int w, h, chan_count;
+	if ( stbi_info_from_memory( source._pData, int( source._uSize ), &w, &h, &chan_count ) == 0 || w <= 0 || h <= 0 )
+	{
+		return false;
+	}
+
+	// the outputs are the size of the image as it is seen.
+	if ( exif_orientation( source._pData, source._uSize ) >= 5 )
+	{
+		std::swap( w, h );
+	}
+
+	job.uCacheKey = cache_key( source._pData, source._uSize, options );
+	source.Close();
+
+	std::vector< output_size_t > aSizes;
+	output_sizes( options, size_t( w ), size_t( h ), aSizes );
+
+	// a .dds keeps the whole -mips chain in the file of the largest.
+	if ( options.format == FORMAT_DDS && options.mips )
+	{
+		aSizes.resize( 1 );
+	}
+
+	const std::vector< format_t > aFormats = output_formats( options );
+
+	for ( const output_size_t& size : aSizes )
+	{
+		for ( format_t format : aFormats )
+		{
+			if ( options.cache.Touch( job.uCacheKey, cache_name( format, size.width, size.height ).c_str() ) == false )
+			{
+				return false;
+			}
+		}
+	}
+
+	// where do we write the output?
+	determine_output_filename( job.strInputFile, options, job.strOutFile );
+
+	std::ostringstream log;
+	for ( const output_size_t& size : aSizes )
+	{
+		for ( format_t format : aFormats )
+		{
+			const std::string strOutFile = options.aFormats.empty() ?
+				( ( aSizes.size() == 1 ) ? job.strOutFile : sized_output_filename( job.strOutFile, size.width, size.height ) ) :
+				format_output_filename( job.strOutFile, format, aSizes.size(), size.width, size.height );
+
+			if ( options.cache.Fetch( job.uCacheKey, cache_name( format, size.width, size.height ).c_str(), strOutFile ) == false )
+			{
+				return false;
+			}
+
+			log << "Cached \"" << strOutFile << "\" ... OK\n";
+			job.uBytesOut += file_bytes( strOutFile );
+		}
+	}
+
+	job.log << log.str();
+	return true;
+}
+
+//
+// cache_store
+//
+// -cache: keep a copy of each output the job wrote.
+//
+static void cache_store( image_job_t& job, options_t& options )
+{
+	for ( const auto& files : job.aCacheFiles )
+	{
+		if ( options.cache.StoreFile( job.uCacheKey, files.second.c_str(), files.first ) == false )
+		{
+			job.log << "WARNING: could not keep \"" << files.first << "\" in the cache.\n";
+		}
+	}
+}
+
+//
+// copy_job
+//
+// Probe the job's source from its header alone, and if the output would be the same
+// pixels (one output at the source's own size, as a PNG, through a filter that leaves
+// them as they are) copy the file through rather than decode and encode it again. True
+// if the job is done.
+//
+static bool copy_job( image_job_t& job, options_t& options )
+{
+	TRACE_ZONE( "copy_job" );
+
+	if ( options.aPalette.empty() == false || options.format != FORMAT_PNG || options.aFormats.empty() == false || options.filter == FILTER_MITCHELL || options.fSharpen > 0.0 )
+	{
+		return false;
+	}
+
+	FILE* fp = nullptr;
+	if ( fopen_s( &fp, job.strInputFile.c_str(), "rb" ) != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	// only a PNG of 8-bit channels holds what decoding it gives; anything else is converted.
+	png_byte header[ 8 ];
+	int w = 0, h = 0, chan_count = 0;
+	const bool bPng = fread( header, 1, 8, fp ) == 8 && png_sig_cmp( header, 0, 8 ) == 0 && fseek( fp, 0, SEEK_SET ) == 0 &&
+					  stbi_info_from_file( fp, &w, &h, &chan_count ) != 0 && stbi_is_16_bit_from_file( fp ) == 0;
+	fclose( fp );
+
+	if ( bPng == false || w <= 0 || h <= 0 || ( chan_count != 3 && chan_count != 4 ) )
+	{
+		return false;
+	}
+
+	// the filters resample at 1:1 to the same pixels, but weigh colour by alpha, or go
+	// through linear light, in steps that do not all come back to the same values.
+	if ( options.filter != FILTER_NEAREST && ( chan_count == 4 || options.linear ) )
+	{
+		return false;
+	}
+
+	std::vector< output_size_t > aSizes;
+	output_sizes( options, size_t( w ), size_t( h ), aSizes );
+
+	if ( aSizes.size() != 1 || aSizes[ 0 ].width != size_t( w ) || aSizes[ 0 ].height != size_t( h ) ||
+		 aSizes[ 0 ].src_width != size_t( w ) || aSizes[ 0 ].src_height != size_t( h ) )
+	{
+		return false;
+	}
+
+	// where do we write the output?
+	determine_output_filename( job.strInputFile, options, job.strOutFile );
+
+	// ... never over the input, which load_job would refuse.
+	std::error_code ec;
+	if ( std::filesystem::equivalent( job.strInputFile, job.strOutFile, ec ) )
+	{
+		return false;
+	}
+
+	job.log << "Copying \"" << job.strInputFile << "\" to \"" << job.strOutFile << "\" (" << w << " x " << h << ") ... ";
+
+	unlink_cached_output( job.strOutFile );
+
+	ec.clear();
+	std::filesystem::copy_file( job.strInputFile, job.strOutFile, std::filesystem::copy_options::overwrite_existing, ec );
+
+	if ( ec )
+	{
+		job.log << "ERROR (" << ec.message() << ")\n";
+	}
+	else
+	{
+		job.log << "OK\n";
+		job.uBytesOut += file_bytes( job.strOutFile );
+	}
+
+	job.uPixels = uint64_t( w ) * uint64_t( h );
+	return true;
+}
+
+//
+// load_png
+//
+// Load a PNG whole through png_reader_t, into image. False if png_reader_t cannot read it,
+// to be loaded with stb_image instead.
+//
+static bool load_png( const std::string& strFile, colormap_t& image, int& chan_count )
+{
+	TRACE_ZONE( "decode_png" );
+
+	png_reader_t reader;
+	if ( reader.Open( strFile ) == false || reader.ReadImage( image ) == false )
+	{
+		image.Release();
+		return false;
+	}
+
+	chan_count = reader._bHasAlpha ? 4 : 3;
+	return true;
+}
+
+//
+// load_job
+//
+// The decode stage: load the job's image. False if it cannot be used.
+//
+static bool load_job( image_job_t& job, options_t& options )
+{
+	TRACE_ZONE( "load_job" );
+
+	int w, h;
+
+	job.log << "Loading \"" << job.strInputFile << "\" ... ";
+
+	// always as RGBA, the layout of color_t, so the decoded pixels are the source as they are.
+	// -deep keeps all 16 bits of a source that has them, and rounds them to bytes for original.
+	if ( options.deep && stbi_is_16_bit( job.strInputFile.c_str() ) )
+	{
+		if ( ( job.img_data16 = stbi_load_16( job.strInputFile.c_str(), &w, &h, &job.chan_count, 4 ) ) == nullptr )
+		{
+			job.log << "FAILED\n";
+			return false;
+		}
+		if ( job.chan_count != 3 && job.chan_count != 4 )
+		{
+			job.log << "INVALID-CHANNELS (" << job.chan_count << ")\n";
+			return false;
+		}
+
+		job.original.Create( size_t( w ), size_t( h ) );
+
+		const uint16_t* pWord = job.img_data16;
+		for ( size_t i = 0; i < size_t( w ) * size_t( h ); ++i, pWord += 4 )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				job.original._data_ptr[ i ].chan[ c ] = uint8_t( ( uint32_t( pWord[ c ] ) * 255 + 32767 ) / 65535 );
+			}
+		}
+	}
+	else if ( load_png( job.strInputFile, job.original, job.chan_count ) )
+	{
+		w = int( job.original._width );
+		h = int( job.original._height );
+	}
+	else if ( ( job.img_data = stbi_load( job.strInputFile.c_str(), &w, &h, &job.chan_count, 4 ) ) == nullptr )
+	{
+		job.log << "FAILED\n";
+		return false;
+	}
+	else if ( job.chan_count != 3 && job.chan_count != 4 )
+	{
+		job.log << "INVALID-CHANNELS (" << job.chan_count << ")\n";
+		return false;
+	}
+
+	// Re-open input file - keep it open to prevent common user error of overwriting input!
+	job.fileInput.open( job.strInputFile );
+	if ( job.fileInput.is_open() == false )
+	{
+		job.log << "FAILED\n";
+		return false;
+	}
+
+	// the EXIF orientation is followed as the image is resampled, without turning it first.
+	mapped_file_t source;
+	if ( source.Open( job.strInputFile ) )
+	{
+		job.original._orientation = exif_orientation( source._pData, source._uSize );
+	}
+
+	if ( job.original._orientation != 1 )
+	{
+		job.log << "OK (" << w << " x " << h << ", EXIF orientation " << job.original._orientation << ")\n";
+	}
+	else
+	{
+		job.log << "OK (" << w << " x " << h << ")\n";
+	}
+
+	// where do we write the output?
+	determine_output_filename( job.strInputFile, options, job.strOutFile );
+
+	job.uPixels = uint64_t( w ) * uint64_t( h );
+
+	if ( job.img_data )
+	{
+		job.original._data_ptr = reinterpret_cast< color_t* >( job.img_data );
+		job.original._width = size_t( w );
+		job.original._height = size_t( h );
+		job.original._stride = size_t( w );
+	}
+
+	return true;
+}
+
+// -stream: the narrowest column tile worth a thread, and the source and output rows
+// kept in flight between the reader, the tiles and the writer.
+static constexpr size_t kStreamTileMinWidth = 256;
+static constexpr size_t kStreamSourceRing = 32;
+static constexpr size_t kStreamOutputRing = 16;
+
+//
+// stream_job
+//
+// -stream: resize a PNG while it is read and written, a row at a time, so that memory
+// depends on the widths alone. False if it is not a PNG that can be read that way, to be
+// loaded whole instead.
+//
+static bool stream_job( image_job_t& job, options_t& options )
+{
+	TRACE_ZONE( "stream_job" );
+
+	png_reader_t reader;
+	if ( reader.Open( job.strInputFile ) == false )
+	{
+		return false;
+	}
+
+	job.log << "Streaming \"" << job.strInputFile << "\" ... OK (" << reader._width << " x " << reader._height << ")\n";
+	job.uPixels = uint64_t( reader._width ) * uint64_t( reader._height );
+
+	// where do we write the output?
+	determine_output_filename( job.strInputFile, options, job.strOutFile );
+
+	std::vector< output_size_t > aSizes;
+	output_sizes( options, reader._width, reader._height, aSizes );
+
+	const output_size_t& size = aSizes[ 0 ];
+	const size_t width = size.width;
+	const size_t height = size.height;
+	const bool bPremultiply = reader._bHasAlpha && options.filter != FILTER_NEAREST;
+
+	if ( size.src_width != reader._width || size.src_height != reader._height )
+	{
+		job.log << "Cropping to (" << size.src_width << " x " << size.src_height << ") at (" << size.src_x << ", " << size.src_y << ")\n";
+	}
+
+	job.log << "Resizing to (" << width << " x " << height << ") - '" << kFilterName[ options.filter ] << "'" << ( options.linear ? " in linear light" : "" ) << "\n";
+
+	resample_weights_t cols;
+	resample_weights_t rows;
+	cols.Create( width, size.src_width, options.filter, options.fSharpen );
+	rows.Create( height, size.src_height, options.filter, options.fSharpen );
+
+	// the rows are written as they are made, so any alpha in the source is kept.
+	unlink_cached_output( job.strOutFile );
+
+	rgb_writer_t writer;
+	if ( writer.Open( options.format, job.strOutFile, width, height, reader._bHasAlpha, job.log ) == false )
+	{
+		return true;
+	}
+
+	// -verify: the rows are hashed as they go by, as they are not kept.
+	std::unique_ptr< rgb_verify_t > pVerify;
+	if ( options.pVerify )
+	{
+		pVerify = std::make_unique< rgb_verify_t >( width, height, reader._bHasAlpha );
+	}
+
+	// Column tiles of the output, each resampled across and down by a thread of
+	// its own. The halo of a tile is the source columns its taps reach past its edges, so
+	// each tile needs only its own slice of every source row.
+	struct stream_tile_t
+	{
+		resample_weights_t cols; // the tile's columns, from source column src_x0.
+		size_t x0 = 0;
+		size_t src_x0 = 0;
+		size_t src_width = 0;
+		size_t y_in_use = 0; // the source row it last asked for, SIZE_MAX when done.
+	};
+
+	const size_t threads = resize_threads( options );
+	const size_t tile_count = ( width * height < kBandMinPixels ) ? 1 : std::clamp< size_t >( width / kStreamTileMinWidth, 1, threads );
+
+	std::vector< stream_tile_t > aTiles( tile_count );
+	for ( size_t t = 0; t < tile_count; ++t )
+	{
+		stream_tile_t& tile = aTiles[ t ];
+		tile.x0 = width * t / tile_count;
+		tile.src_x0 = tile.cols.Slice( cols, tile.x0, width * ( t + 1 ) / tile_count );
+		tile.src_width = size_t( tile.cols._aFirst.back() ) + tile.cols._uTaps;
+	}
+
+	if ( tile_count > 1 )
+	{
+		job.log << "Streaming in " << tile_count << " tiles\n";
+	}
+
+	// the source rows the output needs, and rings of them and of the output rows: source
+	// rows are decoded and output rows written on this thread, while the tiles resample.
+	const size_t src_rows = size_t( rows._aFirst[ height - 1 ] ) + rows._uTaps;
+
+	std::vector< color_t > aSource( reader._width * kStreamSourceRing );
+	std::vector< color_t > aOut( width * kStreamOutputRing );
+	std::vector< size_t > aTilesDone( kStreamOutputRing, 0 ); // tiles finished with each output row.
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t decoded = 0;
+	size_t written = 0;
+
+	auto tile_fn = [&]( stream_tile_t& tile )
+	{
+		auto source_fn = [&]( size_t y )
+		{
+			std::unique_lock< std::mutex > lock( mutex );
+			tile.y_in_use = y; // the rows above it may be decoded over.
+			cv.notify_all();
+			cv.wait( lock, [&]() { return decoded > y; } );
+			return aSource.data() + ( y % kStreamSourceRing ) * reader._width + size.src_x + tile.src_x0;
+		};
+		auto dest_fn = [&]( size_t ry )
+		{
+			std::unique_lock< std::mutex > lock( mutex );
+			cv.wait( lock, [&]() { return written + kStreamOutputRing > ry; } );
+			return aOut.data() + ( ry % kStreamOutputRing ) * width + tile.x0;
+		};
+		auto done_fn = [&]( size_t ry )
+		{
+			std::lock_guard< std::mutex > lock( mutex );
+			++aTilesDone[ ry % kStreamOutputRing ];
+			cv.notify_all();
+		};
+
+		if ( options.linear || bPremultiply )
+		{
+			resample_rows< lcolor_t >( tile.cols, rows, tile.src_width, 0, height, source_fn, dest_fn, done_fn, &lcolor_tables( options.linear ), bPremultiply );
+		}
+		else
+		{
+			resample_rows< color_t >( tile.cols, rows, tile.src_width, 0, height, source_fn, dest_fn, done_fn, nullptr, false );
+		}
+
+		std::lock_guard< std::mutex > lock( mutex );
+		tile.y_in_use = SIZE_MAX;
+		cv.notify_all();
+	};
+
+	// rows above a crop are decoded and dropped, those below it are never read.
+	for ( size_t y = 0; y < size.src_y; ++y )
+	{
+		reader.ReadRow( aSource.data() );
+	}
+
+	std::vector< std::thread > aThreads;
+	for ( stream_tile_t& tile : aTiles )
+	{
+		aThreads.emplace_back( [ &tile_fn, &tile ]() { tile_fn( tile ); } );
+	}
+
+	std::unique_lock< std::mutex > lock( mutex );
+	while ( written < height )
+	{
+		auto can_write_fn = [&]() { return aTilesDone[ written % kStreamOutputRing ] == tile_count; };
+		auto can_decode_fn = [&]()
+		{
+			if ( decoded == src_rows )
+			{
+				return false;
+			}
+
+			// the row decoded over is the one kStreamSourceRing above, which no tile may be using.
+			for ( const stream_tile_t& tile : aTiles )
+			{
+				if ( tile.y_in_use != SIZE_MAX && tile.y_in_use + kStreamSourceRing <= decoded )
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		cv.wait( lock, [&]() { return can_write_fn() || can_decode_fn(); } );
+
+		if ( can_write_fn() )
+		{
+			lock.unlock();
+			if ( pVerify )
+			{
+				pVerify->Row( aOut.data() + ( written % kStreamOutputRing ) * width, width );
+			}
+			writer.WriteRow( aOut.data() + ( written % kStreamOutputRing ) * width );
+			lock.lock();
+
+			aTilesDone[ written % kStreamOutputRing ] = 0;
+			++written;
+		}
+		else
+		{
+			lock.unlock();
+			reader.ReadRow( aSource.data() + ( decoded % kStreamSourceRing ) * reader._width );
+			lock.lock();
+
+			++decoded;
+		}
+
+		cv.notify_all();
+	}
+	lock.unlock();
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	if ( writer.Close() )
+	{
+		job.log << "OK\n";
+		note_output( job, options, job.strOutFile, options.format, width, height );
+
+		if ( pVerify )
+		{
+			job.log << options.pVerify->Record( job.strOutFile, "rgba", pVerify->hash );
+		}
+	}
+
+	return true;
+}
+
+//
+// resize_job_deep
+//
+// resize_job with -deep: the source widened to dcolor_t once (from all 16 bits of a 16-bit
+// source), and each size resized in dcolor_t from the smallest larger one before it, so
+// a chain of sizes is rounded to bytes once per output rather than once per step. With
+// -pal each size is then palettised, and kept only as indices.
+//
+static void resize_job_deep( image_job_t& job, options_t& options, const std::vector< output_size_t >& aSizes )
+{
+	TRACE_ZONE( "resize_job_deep" );
+
+	const bool bPremultiply = job.chan_count == 4;
+	const size_t threads = resize_threads( options );
+
+	std::vector< deepmap_t > aDeep( aSizes.size() );
+	deepmap_t source; // the source rectangle of pWidened, widened.
+	const output_size_t* pWidened = nullptr;
+
+	job.aResized.resize( aSizes.size() );
+
+	for ( size_t i = 0; i < aSizes.size(); ++i )
+	{
+		const deepmap_t* pSource = nullptr;
+		size_t source_pixels = aSizes[ i ].src_width * aSizes[ i ].src_height;
+
+		for ( size_t j = 0; j < i; ++j )
+		{
+			if ( aSizes[ i ].SameSource( aSizes[ j ] ) &&
+				 aDeep[ j ]._width >= aSizes[ i ].width && aDeep[ j ]._height >= aSizes[ i ].height && aDeep[ j ]._width * aDeep[ j ]._height < source_pixels )
+			{
+				pSource = &aDeep[ j ];
+				source_pixels = aDeep[ j ]._width * aDeep[ j ]._height;
+			}
+		}
+
+		if ( pSource == nullptr )
+		{
+			if ( pWidened == nullptr || pWidened->SameSource( aSizes[ i ] ) == false )
+			{
+				const colormap_t view = source_view( job.original, aSizes[ i ], job.log );
+				widen_deep_image( source, view, job.original, job.img_data16, options.linear, bPremultiply, threads );
+				pWidened = &aSizes[ i ];
+			}
+			pSource = &source;
+		}
+
+		aDeep[ i ].Create( aSizes[ i ].width, aSizes[ i ].height );
+		resize_image_deep( aDeep[ i ], *pSource, options, job.log );
+
+		job.aResized[ i ].Create( aSizes[ i ].width, aSizes[ i ].height );
+		narrow_deep_image( job.aResized[ i ], aDeep[ i ], options.linear, bPremultiply, threads );
+	}
+
+	// a -format list's pal is remapped from the resized image as it is written.
+	if ( options.aPalette.empty() == false && options.aFormats.empty() )
+	{
+		job.aIndexed.resize( aSizes.size() );
+
+		for ( size_t i = 0; i < aSizes.size(); ++i )
+		{
+			palettise_image( job.aIndexed[ i ], job.aResized[ i ], options, threads );
+		}
+
+		job.aResized.clear();
+	}
+}
+
+//
+// resize_job
+//
+// The process stage: make each output size, the largest first, each resized from the
+// smallest made before it from the same source rectangle that is still larger. With -pal
+// each size is resized from the original straight to indices, as there are no RGBA sizes
+// to start from. Only the source rectangle is read, for -fill and -crop.
+//
+static void resize_job( image_job_t& job, options_t& options, uint8_t uBPP )
+{
+	TRACE_ZONE( "resize_job" );
+
+	std::vector< output_size_t > aSizes;
+	output_sizes( options, job.original.OrientedWidth(), job.original.OrientedHeight(), aSizes );
+
+	if ( options.deep )
+	{
+		resize_job_deep( job, options, aSizes );
+		return;
+	}
+
+	// a -format list's pal is remapped from the resized image as it is written.
+	if ( options.aPalette.empty() == false && options.aFormats.empty() )
+	{
+		job.aIndexed.resize( aSizes.size() );
+
+		for ( size_t i = 0; i < aSizes.size(); ++i )
+		{
+			const colormap_t source = source_view( job.original, aSizes[ i ], job.log );
+
+			job.aIndexed[ i ].Create( aSizes[ i ].width, aSizes[ i ].height, uBPP, aSizes[ i ].height );
+			resize_image_palette( job.aIndexed[ i ], source, options, job.chan_count == 4, job.log );
+		}
+		return;
+	}
+
+	job.aResized.resize( aSizes.size() );
+
+	for ( size_t i = 0; i < aSizes.size(); ++i )
+	{
+		const colormap_t source = source_view( job.original, aSizes[ i ], job.log );
+
+		const colormap_t* pSource = &source;
+		for ( size_t j = 0; j < i; ++j )
+		{
+			if ( aSizes[ i ].SameSource( aSizes[ j ] ) &&
+				 job.aResized[ j ]._width >= aSizes[ i ].width && job.aResized[ j ]._height >= aSizes[ i ].height &&
+				 job.aResized[ j ]._width * job.aResized[ j ]._height < pSource->_width * pSource->_height )
+			{
+				pSource = &job.aResized[ j ];
+			}
+		}
+
+		job.aResized[ i ].Create( aSizes[ i ].width, aSizes[ i ].height );
+		resize_image( job.aResized[ i ], *pSource, options, job.chan_count == 4, job.log );
+	}
+
+	// the GPU may be keeping one of these, which the job will free.
+	if ( options.pGpu )
+	{
+		options.pGpu->Forget( job.original._data_ptr, job.original._stride * job.original._height * sizeof( color_t ) );
+
+		for ( const colormap_t& resize : job.aResized )
+		{
+			options.pGpu->Forget( resize._data_ptr, resize._width * resize._height * sizeof( color_t ) );
+		}
+	}
+}
+
+//
+// write_job_formats
+//
+// The encode stage of a -format list: each output size in every format, each on a thread
+// of its own, all reading the one resized image. pal remaps it to the -pal palette on its
+// thread before it is written.
+//
+static void write_job_formats( image_job_t& job, options_t& options )
+{
+	TRACE_ZONE( "write_job_formats" );
+
+	struct output_t
+	{
+		size_t size = 0;
+		format_t format = FORMAT_PNG;
+		std::string strOutFile;
+		std::ostringstream log;
+		bool bWritten = false;
+	};
+
+	std::vector< output_t > aOutputs( job.aResized.size() * options.aFormats.size() );
+	for ( size_t i = 0; i < aOutputs.size(); ++i )
+	{
+		output_t& output = aOutputs[ i ];
+		output.size = i / options.aFormats.size();
+		output.format = options.aFormats[ i % options.aFormats.size() ];
+
+		const colormap_t& image = job.aResized[ output.size ];
+		output.strOutFile = format_output_filename( job.strOutFile, output.format, job.aResized.size(), image._width, image._height );
+	}
+
+	auto output_fn = [&]( output_t& output )
+	{
+		const colormap_t& image = job.aResized[ output.size ];
+
+		unlink_cached_output( output.strOutFile );
+
+		if ( output.format == FORMAT_PAL )
+		{
+			indexmap_t indexed;
+			palettise_image( indexed, image, options, resize_threads( options ) );
+
+			output.bWritten = write_png_idx( indexed, options.aPalette.aColours, output.strOutFile, output.log );
+
+			if ( output.bWritten && options.pVerify )
+			{
+				output.log << options.pVerify->Record( output.strOutFile, "indexed", verify_indexed( indexed, options.aPalette.aColours ) );
+			}
+			return;
+		}
+
+		if ( output.format == FORMAT_DDS )
+		{
+			output.bWritten = write_dds( &image, 1, output.strOutFile, resize_threads( options ), output.log );
+		}
+		else
+		{
+			output.bWritten = write_rgb( image, output.format, output.strOutFile, image._bHasAlpha, output.log );
+		}
+
+		if ( output.bWritten && options.pVerify )
+		{
+			rgb_verify_t verify( image._width, image._height, image._bHasAlpha || output.format == FORMAT_DDS );
+			verify.Image( image );
+			output.log << options.pVerify->Record( output.strOutFile, "rgba", verify.hash );
+		}
+	};
+
+	std::vector< std::thread > aThreads;
+	for ( size_t i = 1; i < aOutputs.size(); ++i )
+	{
+		aThreads.emplace_back( [ &, i ]() { output_fn( aOutputs[ i ] ); } );
+	}
+
+	output_fn( aOutputs[ 0 ] );
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	// -cache: keep what was written.
+	for ( output_t& output : aOutputs )
+	{
+		job.log << output.log.str();
+		job.bFailed |= ( output.bWritten == false );
+
+		if ( output.bWritten )
+		{
+			const colormap_t& image = job.aResized[ output.size ];
+			note_output( job, options, output.strOutFile, output.format, image._width, image._height );
+		}
+	}
+	cache_store( job, options );
+}
+
+//
+// write_job
+//
+// The encode stage: write each output size, on a thread of its own when there are several.
+//
+static void write_job( image_job_t& job, options_t& options )
+{
+	TRACE_ZONE( "write_job" );
+
+	if ( options.aFormats.empty() == false )
+	{
+		write_job_formats( job, options );
+		return;
+	}
+
+	// a -mips chain in a .dds is one file, with every size as a mip level.
+	if ( options.format == FORMAT_DDS && options.mips )
+	{
+		unlink_cached_output( job.strOutFile );
+
+		if ( write_dds( job.aResized.data(), job.aResized.size(), job.strOutFile, resize_threads( options ), job.log ) )
+		{
+			note_output( job, options, job.strOutFile, options.format, job.aResized[ 0 ]._width, job.aResized[ 0 ]._height );
+
+			if ( options.pVerify )
+			{
+				// the whole chain, as it is the one file.
+				verify_hash_t hash;
+				for ( const colormap_t& level : job.aResized )
+				{
+					rgb_verify_t verify( level._width, level._height, true );
+					verify.Image( level );
+					hash.Add( uint32_t( verify.hash.uHash ) );
+					hash.Add( uint32_t( verify.hash.uHash >> 32 ) );
+				}
+				job.log << options.pVerify->Record( job.strOutFile, "rgba", hash );
+			}
+		}
+
+		cache_store( job, options );
+		return;
+	}
+
+	const size_t count = options.aPalette.empty() ? job.aResized.size() : job.aIndexed.size();
+	std::vector< char > aWritten( count, false );
+
+	auto output_fn = [&]( size_t i, std::ostream& log )
+	{
+		const size_t width = options.aPalette.empty() ? job.aResized[ i ]._width : size_t( job.aIndexed[ i ]._width );
+		const size_t height = options.aPalette.empty() ? job.aResized[ i ]._height : size_t( job.aIndexed[ i ]._height );
+		const std::string strOutFile = ( count == 1 ) ? job.strOutFile : sized_output_filename( job.strOutFile, width, height );
+
+		unlink_cached_output( strOutFile );
+
+		if ( options.format == FORMAT_DDS )
+		{
+			aWritten[ i ] = write_dds( &job.aResized[ i ], 1, strOutFile, resize_threads( options ), log );
+		}
+		else if ( options.aPalette.empty() )
+		{
+			aWritten[ i ] = write_rgb( job.aResized[ i ], options.format, strOutFile, job.aResized[ i ]._bHasAlpha, log );
+		}
+		else
+		{
+			aWritten[ i ] = write_png_idx( job.aIndexed[ i ], options.aPalette.aColours, strOutFile, log );
+		}
+
+		if ( aWritten[ i ] && options.pVerify )
+		{
+			if ( options.aPalette.empty() )
+			{
+				// a .dds keeps its alpha whether or not it has any.
+				rgb_verify_t verify( width, height, job.aResized[ i ]._bHasAlpha || options.format == FORMAT_DDS );
+				verify.Image( job.aResized[ i ] );
+				log << options.pVerify->Record( strOutFile, "rgba", verify.hash );
+			}
+			else
+			{
+				log << options.pVerify->Record( strOutFile, "indexed", verify_indexed( job.aIndexed[ i ], options.aPalette.aColours ) );
+			}
+		}
+	};
+
+	if ( count == 1 )
+	{
+		output_fn( 0, job.log );
+	}
+	else
+	{
+		std::vector< std::ostringstream > aLogs( count );
+		std::vector< std::thread > aThreads;
+
+		for ( size_t i = 0; i < count; ++i )
+		{
+			aThreads.emplace_back( [ &, i ]() { output_fn( i, aLogs[ i ] ); } );
+		}
+
+		for ( size_t i = 0; i < aThreads.size(); ++i )
+		{
+			aThreads[ i ].join();
+			job.log << aLogs[ i ].str();
+		}
+	}
+
+	// -cache: keep what was written.
+	for ( size_t i = 0; i < count; ++i )
+	{
+		job.bFailed |= ( aWritten[ i ] == false );
+
+		if ( aWritten[ i ] )
+		{
+			const size_t width = options.aPalette.empty() ? job.aResized[ i ]._width : size_t( job.aIndexed[ i ]._width );
+			const size_t height = options.aPalette.empty() ? job.aResized[ i ]._height : size_t( job.aIndexed[ i ]._height );
+			note_output( job, options, ( count == 1 ) ? job.strOutFile : sized_output_filename( job.strOutFile, width, height ), options.format, width, height );
+		}
+	}
+	cache_store( job, options );
+}
+
+//
+// do_work
+//
+// Palette generator. The run's log goes to out (stdout, or a -serve job's answer); false if
+// an image could not be loaded or written.
+//
+static bool do_work( options_t& options, std::ostream& out = std::cout )
+{
+	if ( options.aPalette.empty() == false )
+	{
+		out << "Applying palette \"" << options.strPaletteFile << "\". It has " << options.aPalette.size() << " entries.\n";
+	}
+
+	if ( options.aInputFiles.size() > 1 )
+	{
+		out << "Processing " << options.aInputFiles.size() << " files...\n";
+	}
+
+	// ... auto-create the output folder, if specified.
+	if ( options.strOutFolder.empty() == false )
+	{
+		make_path( options.strOutFolder );
+	}
+
+	// ... and the -cache folder.
+	if ( options.strCacheFolder.empty() == false && options.cache.Open( options.strCacheFolder ) == false )
+	{
+		out << "WARNING: could not make the cache folder \"" << options.strCacheFolder << "\", nothing is cached.\n";
+	}
+
+	// ... and the -verify manifest, to compare with if it is there.
+	verify_manifest_t verify;
+	if ( options.strVerifyFile.empty() == false )
+	{
+		if ( verify.Open( options.strVerifyFile ) == false )
+		{
+			out << "ERROR: could not read the verify manifest \"" << options.strVerifyFile << "\".\n";
+			return false;
+		}
+		options.pVerify = &verify;
+	}
+
+	const uint8_t uBPP = index_bpp( options.aPalette.size() );
+
+	if ( uBPP <= 8 )
+	{
+		// the row bands and the -j workers all look up colours in it.
+		options.aPalette.Lookup( 0, MATCH_RGB ).FillAll();
+	}
+
+	// Resize on the GPU where it can give the same output as the CPU.
+	std::unique_ptr< gpu_resizer_t > pGpu;
+
+	if ( options.bGpu )
+	{
+		std::string strReason;
+
+		if ( options.aPalette.empty() == false && options.aFormats.empty() )
+			strReason = "-pal resizes straight to indices";
+		else if ( options.stream )
+			strReason = "-stream is not supported";
+		else if ( options.deep )
+			strReason = "-deep resamples in 15 bits";
+		else
+		{
+			pGpu = std::make_unique< gpu_resizer_t >();
+			if ( !pGpu->Init( strReason ) )
+			{
+				pGpu.reset();
+			}
+		}
+
+		if ( pGpu )
+			out << "Resizing on the GPU.\n";
+		else
+			out << "Resizing on the CPU, " << strReason << ".\n";
+
+		options.pGpu = pGpu.get();
+	}
+
+	//
+	// -- Process Each File
+	//
+	// Files go through three stages: load (on this thread), resize and write, with -j
+	// threads for each of the last two. The queues between them hold -j jobs each, so no
+	// more than a few images per thread are ever in memory. Each file's log is printed
+	// once it is written, in the order of the files.
+
+	const size_t uWorkers = std::max< uint32_t >( options.uThreadCount, 1 );
+
+	bounded_queue_t< std::unique_ptr< image_job_t > > resize_queue( uWorkers, "resize" );
+	bounded_queue_t< std::unique_ptr< image_job_t > > write_queue( uWorkers, "write" );
+
+	std::mutex print_mutex;
+	std::atomic< bool > bFailed( false );
+	std::vector< std::string > aLogs( options.aInputFiles.size() );
+	std::vector< bool > aDone( options.aInputFiles.size(), false );
+	size_t next_print = 0;
+
+	auto finish_fn = [&]( std::unique_ptr< image_job_t > pJob )
+	{
+		const size_t index = pJob->uIndex;
+		std::string strLog = pJob->log.str();
+		if ( pJob->bFailed )
+		{
+			bFailed = true;
+		}
+		stat_file_done( pJob->bFailed == false, file_bytes( pJob->strInputFile ), pJob->uBytesOut, pJob->uPixels );
+		pJob.reset();
+
+		std::lock_guard< std::mutex > lock( print_mutex );
+		aLogs[ index ] = std::move( strLog );
+		aDone[ index ] = true;
+
+		for ( ; next_print < aDone.size() && aDone[ next_print ]; ++next_print )
+		{
+			out << aLogs[ next_print ];
+			aLogs[ next_print ].clear();
+		}
+	};
+
+	std::atomic< size_t > resizing = uWorkers;
+
+	auto resize_fn = [&]()
+	{
+		stat_worker_t worker;
+
+		std::unique_ptr< image_job_t > pJob;
+		while ( resize_queue.Pop( pJob ) )
+		{
+			{
+				stat_busy_t busy;
+				resize_job( *pJob, options, uBPP );
+			}
+			write_queue.Push( std::move( pJob ) );
+		}
+
+		// the last one out lets the writers finish.
+		if ( --resizing == 0 )
+		{
+			write_queue.Close();
+		}
+	};
+
+	auto write_fn = [&]()
+	{
+		stat_worker_t worker;
+
+		std::unique_ptr< image_job_t > pJob;
+		while ( write_queue.Pop( pJob ) )
+		{
+			{
+				stat_busy_t busy;
+				write_job( *pJob, options );
+			}
+			finish_fn( std::move( pJob ) );
+		}
+	};
+
+	std::vector< std::thread > aThreads;
+	for ( size_t t = 0; t < uWorkers; ++t )
+	{
+		// each worker's resize and write on one node, under FRAGMENTS_NUMA.
+		aThreads.emplace_back( [ &resize_fn, t ]()
+		{
+			mem_numa_pin( t );
+			resize_fn();
+		} );
+		aThreads.emplace_back( [ &write_fn, t ]()
+		{
+			mem_numa_pin( t );
+			write_fn();
+		} );
+	}
+
+	// this thread is the load stage.
+	stat_files( options.aInputFiles.size() );
+	stat_worker_t loader;
+
+	size_t index = 0;
+	for ( const std::string& inputFile : options.aInputFiles )
+	{
+		std::unique_ptr< image_job_t > pJob = std::make_unique< image_job_t >();
+		pJob->uIndex = index++;
+		pJob->strInputFile = inputFile;
+
+		bool bLoaded = false;
+		{
+			stat_busy_t busy;
+
+			if ( options.pVerify == nullptr && options.cache.IsOpen() && cache_fetch( *pJob, options ) )
+			{
+				finish_fn( std::move( pJob ) );
+			}
+			else if ( options.pVerify == nullptr && copy_job( *pJob, options ) )
+			{
+				finish_fn( std::move( pJob ) );
+			}
+			else if ( options.stream && stream_job( *pJob, options ) )
+			{
+				cache_store( *pJob, options );
+				finish_fn( std::move( pJob ) );
+			}
+			else if ( load_job( *pJob, options ) )
+			{
+				bLoaded = true;
+			}
+			else
+			{
+				pJob->bFailed = true;
+				finish_fn( std::move( pJob ) );
+			}
+		}
+
+		// waiting for room in the queue is not counted as busy.
+		if ( bLoaded )
+		{
+			resize_queue.Push( std::move( pJob ) );
+		}
+	}
+
+	resize_queue.Close();
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+
+	// -cache: back under its size, if this run added to it.
+	options.cache.Trim();
+
+	if ( options.pVerify )
+	{
+		std::string strLog;
+		if ( verify.Close( strLog ) == false )
+		{
+			bFailed = true;
+		}
+		out << strLog;
+		options.pVerify = nullptr;
+	}
+
+	return bFailed == false;
+}
+
+//
+// run_server
+//
+// -serve: each job (see palserve.h) has the arguments of a normal run, and is run in turn
+// with its own -j. The palettes are kept between jobs with their cubes, so a job with a
+// palette that has been used before does not fill one again.
+//
+static void run_server( const options_t& server )
 {
-	dithermap_t workspace;
-	workspace.Create( image._width, image._height );
+	std::unordered_map< uint64_t, palette_t > mapPalettes;
 
-	// load the workspace with the source image.
-	for ( uint32_t y = 0; y < image._height; ++y )
+	serve_jobs( server.strServe, 1, [&]( std::vector< std::string >& aArgs, std::string& strLog )
 	{
-		for ( uint32_t x = 0; x < image._width; ++x )
-		{
-			color_t colour = image.Peek( x, y );
+		std::vector< char* > argv = serve_argv( "imgsize", aArgs );
+		std::ostringstream log;
 
-			dither_t& target = workspace.Element( x, y );
-			target.err_r = static_cast<float>( colour.chan[ 0 ] ) / 255.0f;
-			target.err_g = static_cast<float>( colour.chan[ 1 ] ) / 255.0f;
-			target.err_b = static_cast<float>( colour.chan[ 2 ] ) / 255.0f;
-			target.index = 0;
-		}
-	}
+		// process_args reports its errors on stdout, where the server's answers go too.
+		options_t job;
+		std::streambuf* pStdout = std::cout.rdbuf( log.rdbuf() );
+		const bool bParsed = process_args( int( argv.size() ), argv.data(), job );
+		std::cout.rdbuf( pStdout );
 
-	// FloydSteinberg dithering
-	for ( uint32_t y = 0; y < image._height; ++y )
-	{
-		for ( uint32_t x = 0; x < image._width; ++x )
+		if ( bParsed == false || job.bServe || job.bBenchmark )
 		{
-			dither_t& pixel = workspace.Element( x, y );
-
-			// decide which is our closest palette index
-			color_t old_colour_sat;
-			old_colour_sat.FromDither( pixel );
-			uint8_t remapped_idx = find_nearest_palette_index( old_colour_sat, options.aPalette );
-			pixel.index = remapped_idx; // store this.
+			strLog = log.str();
+			return false;
+		}
 
-			// not an exact match? (likely)
-			const color_t new_colour_sat = options.aPalette[ remapped_idx ];
-			if ( old_colour_sat.BGR() != new_colour_sat.BGR() )
+		palette_t* pWarm = nullptr;
+		if ( job.aPalette.empty() == false )
+		{
+			pWarm = &mapPalettes[ job.aPalette.uHash ];
+			if ( pWarm->size() == job.aPalette.size() )
 			{
-				// compute error between the pixel and the palette value we must use.
-				dither_t quant_error;
-				quant_error.err_r = ( static_cast<float>( old_colour_sat.chan[ 0 ] ) - static_cast<float>( new_colour_sat.chan[ 0 ] ) ) / 255.0f;
-				quant_error.err_g = ( static_cast<float>( old_colour_sat.chan[ 1 ] ) - static_cast<float>( new_colour_sat.chan[ 1 ] ) ) / 255.0f;
-				quant_error.err_b = ( static_cast<float>( old_colour_sat.chan[ 2 ] ) - static_cast<float>( new_colour_sat.chan[ 2 ] ) ) / 255.0f;
-
-				// diffuse the error among the neighbours
-				accumulate_error( x + 1, y, workspace, quant_error, 7.0f / 16.0f );
-				accumulate_error( x - 1, y + 1, workspace, quant_error, 3.0f / 16.0f );
-				accumulate_error( x, y + 1, workspace, quant_error, 5.0f / 16.0f );
-				accumulate_error( x + 1, y + 1, workspace, quant_error, 1.0f / 16.0f );
+				job.aPalette = std::move( *pWarm );
 			}
 		}
-	}
 
-	// copy the pixel indices into the output image
-	for ( uint32_t y = 0; y < image._height; ++y )
-	{
-		for ( uint32_t x = 0; x < image._width; ++x )
+		const bool bOK = do_work( job, log );
+
+		if ( pWarm )
 		{
-			const dither_t& pixel = workspace.Element( x, y );
-			output.Plot( x, y, pixel.index );
+			*pWarm = std::move( job.aPalette );
 		}
-	}
 
-	delete[] workspace._data_ptr;
+		strLog = log.str();
+		return bOK;
+	} );
 }
 
 //==============================================================================
 
-static void remap_image_nearest( const colormap_t& image, indexmap_t& output, options_t& options, const color_t pal_idx0 )
+//
+// bench_hash
+//
+// FNV-1a of a result, so that a change to a kernel's output shows in the benchmark.
+//
+static uint64_t bench_hash( uint64_t hash, const uint8_t* pData, size_t size )
 {
-	std::vector< color_t >& aPalette = options.aPalette;
-
-	for ( uint32_t y = 0; y < image._height; ++y )
+	for ( size_t i = 0; i < size; ++i )
 	{
-		for ( uint32_t x = 0; x < image._width; ++x )
-		{
-			const color_t colour = image.Peek( x, y );
-
-			uint8_t remapped_idx;
-
-			remapped_idx = find_nearest_palette_index( colour, aPalette );
-
-			output.Plot( x, y, remapped_idx );
-		}
+		hash = ( hash ^ pData[ i ] ) * 0x100000001b3ULL;
 	}
+
+	return hash;
 }
 
-//==============================================================================
+static constexpr uint64_t kBenchHashSeed = 0xcbf29ce484222325ULL;
 
-static void resize_image_nearest( colormap_t& output, const colormap_t& input )
+//
+// bench_reference
+//
+// input resampled to width x height with Lanczos3 in double precision, with no fixed
+// point, tables or rounding: the image the kernels are measured against. Colour is
+// premultiplied by alpha (and in linear light) as the kernels would have it. aOut is
+// RGBA from 0 to 255, premultiplied, so colour under clear pixels does not count.
+//
+static void bench_reference( std::vector< float >& aOut, const colormap_t& input, size_t width, size_t height, bool bLinear )
 {
-	std::cout << "Resizing to (" << output._width << " x " << output._height << ") - 'nearest neighbor'\n";
+	struct tap_t
+	{
+		size_t index;
+		double weight;
+	};
 
-	for ( int ry = 0; ry < output._height; ++ry )
+	// the normalised taps of each output along one axis, folded at the edges.
+	auto axis_fn = []( size_t uOut, size_t uIn )
 	{
-		for ( int rx = 0; rx < output._width; ++rx )
+		const double scale = double( uIn ) / double( uOut );
+		const double stretch = std::max( 1.0, scale );
+		const double fSupport = resample_support( FILTER_LANCZOS3, stretch );
+
+		std::vector< std::vector< tap_t > > aTaps( uOut );
+		for ( size_t i = 0; i < uOut; ++i )
 		{
-			float x, y;
-			x = float( rx * input._width ) / float( output._width );
-			y = float( ry * input._height ) / float( output._height );
+			const double centre = ( double( i ) + 0.5 ) * scale - 0.5;
+			const int lo = int( std::floor( centre - fSupport ) ) + 1;
+			const int hi = int( std::ceil( centre + fSupport ) ) - 1;
 
-			const color_t colour = input.Peek( int( floorf( x ) ), int( floorf( y ) ) );
+			double total = 0.0;
+			for ( int j = lo; j <= hi; ++j )
+			{
+				const double w = resample_weight( FILTER_LANCZOS3, double( j ) - centre, stretch );
+				aTaps[ i ].push_back( { size_t( std::clamp( j, 0, int( uIn ) - 1 ) ), w } );
+				total += w;
+			}
 
-			output.Plot( rx, ry, colour );
+			for ( tap_t& tap : aTaps[ i ] )
+			{
+				tap.weight /= total;
+			}
 		}
-	}
-}
 
-static void resize_image_bilinear( colormap_t& output, const colormap_t& input )
-{
-	std::cout << "Resizing to (" << output._width << " x " << output._height << ") - 'bilinear'\n";
+		return aTaps;
+	};
 
-	float x, y, fx, fy;
-	int ix, iy;
+	const std::vector< std::vector< tap_t > > aCols = axis_fn( width, input._width );
+	const std::vector< std::vector< tap_t > > aRows = axis_fn( height, input._height );
 
-	for ( int ry = 0; ry < output._height; ++ry )
+	const float* aLinear = srgb_linear_table();
+
+	// the source, premultiplied.
+	std::vector< double > aSource( input._width * input._height * 4 );
+	for ( size_t y = 0; y < input._height; ++y )
 	{
-		y = ( float( ( ry + 0.5f ) * input._height ) / float( output._height ) ) - 0.5f;
-		iy = int( floorf( y ) );
-		fy = y - iy;
+		const color_t* pRow = input.Row( y );
+		double* pOut = &aSource[ y * input._width * 4 ];
 
-		for ( int rx = 0; rx < output._width; ++rx )
+		for ( size_t x = 0; x < input._width; ++x, pOut += 4 )
 		{
-			x = ( float( ( rx + 0.5f ) * input._width ) / float( output._width ) ) - 0.5f;
-			ix = int( floorf( x ) );
-			fx = x - ix;
-
-			// ... 4 taps
-			const color_t colour00 = input.PeekClamp( ix, iy );
-			const color_t colour10 = input.PeekClamp( ix + 1, iy );
-			const color_t colour01 = input.PeekClamp( ix, iy + 1 );
-			const color_t colour11 = input.PeekClamp( ix + 1, iy + 1 );
+			const double a = pRow[ x ].chan[ 3 ] / 255.0;
+			for ( int c = 0; c < 3; ++c )
+			{
+				pOut[ c ] = ( bLinear ? aLinear[ pRow[ x ].chan[ c ] ] : pRow[ x ].chan[ c ] / 255.0 ) * a;
+			}
+			pOut[ 3 ] = a;
+		}
+	}
 
-			// ... bilinear interpolation (float)
-			fcolor_t colour_a = fcolor_t::Blend( colour00, colour10, fx );
-			fcolor_t colour_b = fcolor_t::Blend( colour01, colour11, fx );
-			fcolor_t colour = fcolor_t::Blend( colour_a, colour_b, fy );
+	// across, then down.
+	std::vector< double > aAcross( width * input._height * 4, 0.0 );
+	for ( size_t y = 0; y < input._height; ++y )
+	{
+		for ( size_t x = 0; x < width; ++x )
+		{
+			double* pOut = &aAcross[ ( y * width + x ) * 4 ];
+			for ( const tap_t& tap : aCols[ x ] )
+			{
+				const double* pIn = &aSource[ ( y * input._width + tap.index ) * 4 ];
+				for ( int c = 0; c < 4; ++c )
+				{
+					pOut[ c ] += pIn[ c ] * tap.weight;
+				}
+			}
+		}
+	}
 
-			// ... quantise to 8-bit channels
-			color_t out;
-			for ( int i = 0; i < 4; ++i )
+	aOut.assign( width * height * 4, 0.0f );
+	for ( size_t y = 0; y < height; ++y )
+	{
+		for ( size_t x = 0; x < width; ++x )
+		{
+			double acc[ 4 ] = { 0, 0, 0, 0 };
+			for ( const tap_t& tap : aRows[ y ] )
 			{
-				out.chan[ i ] = uint8_t( std::clamp( int( floorf( colour.chan[ i ] + 0.5f ) ), 0, 255 ) );
+				const double* pIn = &aAcross[ ( tap.index * width + x ) * 4 ];
+				for ( int c = 0; c < 4; ++c )
+				{
+					acc[ c ] += pIn[ c ] * tap.weight;
+				}
 			}
 
- 			output.Plot( rx, ry, out );
+			// back to sRGB to compare with the output, still premultiplied.
+			const double a = std::clamp( acc[ 3 ], 0.0, 1.0 );
+			float* pOut = &aOut[ ( y * width + x ) * 4 ];
+			for ( int c = 0; c < 3; ++c )
+			{
+				double v = ( a > 0.0 ) ? std::clamp( acc[ c ] / a, 0.0, 1.0 ) : 0.0;
+				if ( bLinear )
+				{
+					v = ( v <= 0.0031308 ) ? ( v * 12.92 ) : ( 1.055 * std::pow( v, 1.0 / 2.4 ) - 0.055 );
+				}
+				pOut[ c ] = float( v * a * 255.0 );
+			}
+			pOut[ 3 ] = float( a * 255.0 );
 		}
 	}
 }
 
-//==============================================================================
-
 //
-// determine_output_filename
+// bench_quality
 //
-// Figure out what we should call the output filename
+// PSNR (over R, G, B and A, premultiplied) and SSIM (of the luma, in 8 x 8 windows four
+// pixels apart) of an output against its reference.
 //
-static void determine_output_filename( const std::string& inputFile, options_t& options, std::string& outFile )
+static void bench_quality( double& fPSNR, double& fSSIM, const colormap_t& output, const std::vector< float >& aReference )
 {
-	// Use the single file output override?
-	if ( ( options.aInputFiles.size() == 1 ) && ( options.strOutFile.empty() == false ) )
-	{
-		outFile = options.strOutFile;
-		return;
-	}
+	const size_t width = output._width;
+	const size_t height = output._height;
 
-	// split input file into path and file.
-	std::string outFolder;
-	size_t slash_find = inputFile.find_last_of( "/\\", inputFile.npos ); // either kind of path separators
-	if ( slash_find == inputFile.npos )
-	{
-		outFile = inputFile;
-	}
-	else
-	{
-		outFolder = inputFile.substr( 0, slash_find + 1 );
-		outFile = inputFile.substr( slash_find + 1 );
-	}
+	std::vector< double > aLumaOut( width * height );
+	std::vector< double > aLumaRef( width * height );
 
-	if ( options.strOutFolder.empty() == false )
+	double fSquares = 0.0;
+	for ( size_t i = 0; i < width * height; ++i )
 	{
-		outFolder = options.strOutFolder;
-	}
+		const color_t& pixel = output._data_ptr[ i ];
+		const float* pRef = &aReference[ i * 4 ];
+		const double a = pixel.chan[ 3 ] / 255.0;
 
-	size_t dot_find = outFile.find_last_of( ".", outFile.npos ); // last dot
-	if ( dot_find != inputFile.npos )
-	{
-		outFile = outFile.substr( 0, dot_find );
+		double v[ 4 ];
+		for ( int c = 0; c < 3; ++c )
+		{
+			v[ c ] = pixel.chan[ c ] * a;
+		}
+		v[ 3 ] = pixel.chan[ 3 ];
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			fSquares += ( v[ c ] - pRef[ c ] ) * ( v[ c ] - pRef[ c ] );
+		}
+
+		aLumaOut[ i ] = 0.299 * v[ 0 ] + 0.587 * v[ 1 ] + 0.114 * v[ 2 ];
+		aLumaRef[ i ] = 0.299 * pRef[ 0 ] + 0.587 * pRef[ 1 ] + 0.114 * pRef[ 2 ];
 	}
 
-	if ( outFolder.empty() == false )
+	const double fMSE = fSquares / double( width * height * 4 );
+	fPSNR = ( fMSE > 0.0 ) ? 10.0 * std::log10( 255.0 * 255.0 / fMSE ) : 99.99;
+
+	constexpr double kC1 = ( 0.01 * 255 ) * ( 0.01 * 255 );
+	constexpr double kC2 = ( 0.03 * 255 ) * ( 0.03 * 255 );
+
+	const size_t win_w = std::min< size_t >( 8, width );
+	const size_t win_h = std::min< size_t >( 8, height );
+
+	double fTotal = 0.0;
+	size_t uWindows = 0;
+
+	for ( size_t y0 = 0; y0 + win_h <= height; y0 += 4 )
 	{
-		const char tail = outFolder[ outFolder.length() - 1 ];
+		for ( size_t x0 = 0; x0 + win_w <= width; x0 += 4 )
+		{
+			double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+			for ( size_t y = y0; y < y0 + win_h; ++y )
+			{
+				for ( size_t x = x0; x < x0 + win_w; ++x )
+				{
+					const double a = aLumaOut[ y * width + x ];
+					const double b = aLumaRef[ y * width + x ];
+					sx += a;
+					sy += b;
+					sxx += a * a;
+					syy += b * b;
+					sxy += a * b;
+				}
+			}
 
-		if ( tail != '\\' && tail != '//' )
-			outFolder += "\\";
+			const double n = double( win_w * win_h );
+			const double mx = sx / n;
+			const double my = sy / n;
+			const double vx = sxx / n - mx * mx;
+			const double vy = syy / n - my * my;
+			const double cxy = sxy / n - mx * my;
+
+			fTotal += ( ( 2 * mx * my + kC1 ) * ( 2 * cxy + kC2 ) ) / ( ( mx * mx + my * my + kC1 ) * ( vx + vy + kC2 ) );
+			++uWindows;
+		}
 	}
 
-	outFile = outFolder + outFile + ".png";
+	fSSIM = uWindows ? fTotal / double( uWindows ) : 1.0;
 }
 
 //
-// do_work
+// bench_image
 //
-// Palette generator.
+// Resize one image by each ratio with each filter on each thread count, and print the
+// time, the output's Mpixel/s, its PSNR and SSIM against bench_reference, and its hash.
+// Each resize runs once untimed, then for at least 100ms, and the time is that of one.
 //
-static void do_work( options_t& options )
+static void bench_image( const options_t& options, const char* szName, const colormap_t& input, bool bAlpha )
 {
-	if ( options.aPalette.empty() == false )
-	{
-		std::cout << "Applying palette \"" << options.strPaletteFile << "\". It has " << options.aPalette.size() << " entries.\n";
-	}
+	const double aRatios[] = { 0.25, 0.5, 0.7, 1.5, 2.0 };
+	const filter_t aFilters[] = { FILTER_NEAREST, FILTER_BILINEAR, FILTER_AREA, FILTER_MITCHELL, FILTER_LANCZOS3 };
 
-	if ( options.aInputFiles.size() > 1 )
+	std::vector< size_t > aThreadCounts = { 1 };
+	if ( task_thread_cap() > 1 )
 	{
-		std::cout << "Processing " << options.aInputFiles.size() << " files...\n";
+		aThreadCounts.push_back( task_thread_cap() );
 	}
 
-	// ... auto-create the output folder, if specified.
-	if ( options.strOutFolder.empty() == false )
+	for ( double ratio : aRatios )
 	{
-		make_path( options.strOutFolder );
-	}
+		const size_t width = std::max< size_t >( 1, size_t( std::lround( input._width * ratio ) ) );
+		const size_t height = std::max< size_t >( 1, size_t( std::lround( input._height * ratio ) ) );
+		const size_t uPixels = width * height;
 
-	uint8_t uBPP;
+		printf( "%s, %zu x %zu to %zu x %zu%s%s:\n", szName, input._width, input._height, width, height,
+				bAlpha ? ", alpha" : "", options.linear ? ", in linear light" : "" );
 
-	if ( options.aPalette.empty() )
-	{
-		uBPP = 24;
-	}
-	else if ( options.aPalette.size() == 2 )
-	{
-		uBPP = 1;
-	}
-	else if ( options.aPalette.size() <= 4 )
-	{
-		uBPP = 2;
-	}
-	else if ( options.aPalette.size() <= 16 )
-	{
-		uBPP = 4;
-	}
-	else
-	{
-		uBPP = 8;
-	}
+		std::vector< float > aReference;
+		bench_reference( aReference, input, width, height, options.linear );
 
-	std::vector< color_t > png_palette;
+		colormap_t output;
+		output.Create( width, height );
 
-	if ( uBPP <= 8 )
-	{
-		for ( uint32_t i = 0; i < options.aPalette.size(); ++i )
-		{
-			png_palette.push_back( options.aPalette[ i ] );
-		}
-		while ( png_palette.size() < ( 1ULL << uBPP ) )
+		for ( filter_t filter : aFilters )
 		{
-			png_palette.push_back( color_t( 0xFF00FF ) );
-		}
-	}
+			for ( size_t threads : aThreadCounts )
+			{
+				std::ostringstream log; // not shown.
 
-	//
-	// -- Process Each File
+				auto resize_fn = [&]()
+				{
+					if ( filter == FILTER_NEAREST )
+					{
+						resize_image_nearest( output, input, threads, nullptr, log );
+					}
+					else if ( filter == FILTER_AREA && options.linear == false && bAlpha == false &&
+							  width * 2 == input._width && height * 2 == input._height )
+					{
+						resize_image_halve( output, input, threads, nullptr, log );
+					}
+					else
+					{
+						resize_image_separable( output, input, filter, 0.0, options.linear, bAlpha, threads, nullptr, log );
+					}
+				};
 
-	for ( const std::string& inputFile : options.aInputFiles )
-	{
-		// load the image.
+				// once untimed, to build the tables and warm the caches.
+				resize_fn();
 
-		int w, h, chan_count;
-		unsigned char* img_data;
+				const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-		std::cout << "Loading \"" << inputFile << "\" ... ";
+				size_t uRuns = 0;
+				double ms = 0;
+				do
+				{
+					resize_fn();
+					++uRuns;
+					ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+				}
+				while ( ms < 100.0 );
 
-		img_data = stbi_load( inputFile.c_str(), &w, &h, &chan_count, 0 );
+				ms /= double( uRuns );
+				const double fMegaPixelsPerSec = ( ms > 0 ) ? ( double( uPixels ) / ( ms * 1000.0 ) ) : 0;
 
-		if ( img_data == nullptr )
-		{
-			std::cout << "FAILED\n";
-			continue;
-		}
-		else if ( chan_count != 3 && chan_count != 4 )
-		{
-			std::cout << "INVALID-CHANNELS (" << chan_count << ")\n";
-			stbi_image_free( img_data );
-			continue;
-		}
+				double fPSNR, fSSIM;
+				bench_quality( fPSNR, fSSIM, output, aReference );
 
-		// Re-open input file - keep it open to prevent common user error of overwriting input!
-		std::ifstream fileInput( inputFile );
-		if ( fileInput.is_open() == false )
-		{
-			std::cout << "FAILED\n";
-			stbi_image_free( img_data );
-			continue;
+				const uint64_t hash = bench_hash( kBenchHashSeed, reinterpret_cast< const uint8_t* >( output._data_ptr ), uPixels * sizeof( color_t ) );
+
+				char szStage[ 32 ];
+				snprintf( szStage, sizeof( szStage ), "%s j%zu", kFilterName[ filter ], threads );
+
+				printf( "  %-16s %10.3f ms %9.2f Mpixel/s %7.2f dB  SSIM %.4f  %016llx\n", szStage, ms, fMegaPixelsPerSec, fPSNR, fSSIM,
+						static_cast< unsigned long long >( hash ) );
+			}
 		}
 
-		std::cout << "OK (" << w << " x " << h << ")\n";
+		output.Release();
+		putchar( '\n' );
+	}
+}
 
-		// where do we write the output?
-		std::string outFile;
-		determine_output_filename( inputFile, options, outFile );
+//
+// do_benchmark
+//
+// -bench: time every filter over synthetic images of two sizes, opaque and with alpha,
+// then over the input files (if any). Nothing is written.
+//
+static void do_benchmark( const options_t& options )
+{
+	printf( "Resample kernels: %s\n\n", cpu_level_name( cpu_level() ) );
 
-		colormap_t original;
-		original.Create( w, h );
-		if ( chan_count == 3 )
-		{
-			original.CopyFromRGB( img_data );
-		}
-		else if ( chan_count == 4 )
+	const size_t aSizes[] = { 256, 1024 };
+
+	for ( size_t size : aSizes )
+	{
+		// gradients under a zone plate, which rises to the finest detail a pixel grid holds
+		// at the far corner, so that aliasing and ringing show. The alpha version fades out
+		// to a clear edge.
+		colormap_t image;
+		image.Create( size, size );
+
+		constexpr double kPi = 3.14159265358979323846;
+		for ( size_t y = 0; y < size; ++y )
 		{
-			original.CopyFromRGBA( img_data );
+			for ( size_t x = 0; x < size; ++x )
+			{
+				const double zone = 0.5 + 0.5 * std::cos( kPi * double( x * x + y * y ) / double( 2 * size ) );
+				const double gx = double( x ) / double( size );
+				const double gy = double( y ) / double( size );
+
+				color_t& pixel = image._data_ptr[ y * size + x ];
+				pixel.chan[ 0 ] = uint8_t( std::lround( 255.0 * ( 0.5 * gx + 0.5 * zone ) ) );
+				pixel.chan[ 1 ] = uint8_t( std::lround( 255.0 * zone ) );
+				pixel.chan[ 2 ] = uint8_t( std::lround( 255.0 * ( 0.5 * gy + 0.5 * zone ) ) );
+				pixel.chan[ 3 ] = 0xFF;
+			}
 		}
 
-		size_t out_width, out_height;
+		bench_image( options, "synthetic", image, false );
 
-		if ( options.width == 0 )
+		for ( size_t y = 0; y < size; ++y )
 		{
-			out_width = w * options.height / h;
-		}
-		else
-		{
-			out_width = options.width;
+			for ( size_t x = 0; x < size; ++x )
+			{
+				const double r = std::hypot( double( x ) - size * 0.5, double( y ) - size * 0.5 ) / ( size * 0.5 );
+				image._data_ptr[ y * size + x ].chan[ 3 ] = uint8_t( std::lround( 255.0 * std::clamp( ( 1.0 - r ) * 4.0, 0.0, 1.0 ) ) );
+			}
 		}
 
-		if ( options.height == 0 )
-		{
-			out_height = h * options.width / w;
-		}
-		else
-		{
-			out_height = options.height;
-		}
+		bench_image( options, "synthetic", image, true );
+
+		image.Release();
+	}
 
-		colormap_t resize;
-		resize.Create( out_width, out_height );
+	// real images.
+	for ( const std::string& file_name : options.aInputFiles )
+	{
+		colormap_t image;
+		int chan_count = 0;
+		unsigned char* data = nullptr;
 
-		switch ( options.filter )
+		if ( load_png( file_name, image, chan_count ) == false )
 		{
+			int w, h;
+			data = stbi_load( file_name.c_str(), &w, &h, &chan_count, 4 );
+			if ( data == nullptr || ( chan_count != 3 && chan_count != 4 ) )
+			{
+				printf( "Error - failed to load \"%s\".\n", file_name.c_str() );
+				stbi_image_free( data );
+				continue;
+			}
 
-		default:
-		case FILTER_NEAREST:
-			resize_image_nearest( resize, original );
-			break;
+			image._data_ptr = reinterpret_cast< color_t* >( data );
+			image._width = size_t( w );
+			image._height = size_t( h );
+			image._stride = size_t( w );
+		}
 
-		case FILTER_BILINEAR:
-			{
-				// ... handle large reductions using a pyramid of step-downs
-				for ( ; ; )
-				{
-					size_t x = original._width;
-					size_t y = original._height;
+		bench_image( options, file_name.c_str(), image, chan_count == 4 );
 
-					bool inter_step = false;
+		stbi_image_free( data );
+	}
+}
 
-					if ( ( out_width * 2 < x ) )
-					{
-						x /= 2;
-						inter_step = true;
-					}
+//
+// imgsize_resize
+//
+// The library entry point: see imgsize.h.
+//
+bool imgsize_resize( const imgsize_settings_t& settings, const imgsize_image_t& input, uint8_t* pOutput, size_t uWidth, size_t uHeight )
+{
+	TRACE_ZONE( "imgsize_resize" );
 
-					if ( ( out_height * 2 < y ) )
-					{
-						y /= 2;
-						inter_step = true;
-					}
+	const size_t uStride = input.uStride ? input.uStride : input.uWidth * size_t( input.iChannels );
 
-					if ( inter_step )
-					{
-						colormap_t pyramid;
-						pyramid.Create( x, y );
-						resize_image_bilinear( pyramid, original );
-						delete[] original._data_ptr;
-						original = pyramid;
-					}
-					else
-					{
-						break;
-					}
-				}
+	if ( input.pPixels == nullptr || input.uWidth == 0 || input.uHeight == 0 || ( input.iChannels != 3 && input.iChannels != 4 ) ||
+		 uStride < input.uWidth * size_t( input.iChannels ) || pOutput == nullptr || uWidth == 0 || uHeight == 0 ||
+		 settings.filter < FILTER_NEAREST || settings.filter > FILTER_LANCZOS3 || settings.fSharpen < 0.0 || settings.fSharpen > 1.0 ||
+		 ( settings.fSharpen > 0.0 && settings.filter == FILTER_NEAREST ) )
+	{
+		return false;
+	}
 
-				resize.Create( out_width, out_height );
-				resize_image_bilinear( resize, original );
-			}
-			break;
+	options_t options;
+	options.filter = settings.filter;
+	options.linear = settings.bLinear;
+	options.fSharpen = settings.fSharpen * kSharpenScale;
+	options.uResizeThreads = std::max< uint32_t >( settings.uThreadCount, 1 );
 
-		}
+	colormap_t source;
+	if ( input.iChannels == 4 && uStride % sizeof( color_t ) == 0 && reinterpret_cast< uintptr_t >( input.pPixels ) % alignof( color_t ) == 0 )
+	{
+		source._data_ptr = reinterpret_cast< color_t* >( const_cast< uint8_t* >( input.pPixels ) );
+		source._width = input.uWidth;
+		source._height = input.uHeight;
+		source._stride = uStride / sizeof( color_t );
+	}
+	else
+	{
+		source.Create( input.uWidth, input.uHeight );
 
-		if ( png_palette.empty() )
-		{
-			// write image!
-			write_png_rgb24( resize, outFile );
-		}
-		else
+		for ( size_t y = 0; y < input.uHeight; ++y )
 		{
-			indexmap_t output;
-			output.Create( int( out_width ), int( out_height ), uBPP );
-
-			const color_t pal_idx0 = options.aPalette[ 0 ];
+			const uint8_t* pSrc = input.pPixels + y * uStride;
+			color_t* pDest = source.Row( y );
 
-			if ( options.bDither )
-			{
-				remap_image_dither( resize, output, options, pal_idx0 );
-			}
-			else
+			for ( size_t x = 0; x < input.uWidth; ++x, pSrc += input.iChannels )
 			{
-				remap_image_nearest( resize, output, options, pal_idx0 );
+				pDest[ x ].chan[ 0 ] = pSrc[ 0 ];
+				pDest[ x ].chan[ 1 ] = pSrc[ 1 ];
+				pDest[ x ].chan[ 2 ] = pSrc[ 2 ];
+				pDest[ x ].chan[ 3 ] = ( input.iChannels == 4 ) ? pSrc[ 3 ] : 0xFF;
 			}
-
-			// write image!
-			write_png_idx( output, options.aPalette, outFile );
-
-			delete[] output._data_ptr;
 		}
-
-		// tidy up
-		delete[] original._data_ptr;
-		delete[] resize._data_ptr;
-		stbi_image_free( img_data );
-		fileInput.close();
 	}
+
+	colormap_t output;
+	output._data_ptr = reinterpret_cast< color_t* >( pOutput );
+	output._width = uWidth;
+	output._height = uHeight;
+	output._stride = uWidth;
+
+	std::ostream log( nullptr ); // nothing is printed.
+	resize_image( output, source, options, input.iChannels == 4, log );
+	return true;
 }
 
+#if !defined( IMGSIZE_LIBRARY )
+
 //
 // main
 //
@@ -1373,9 +6841,22 @@ int main( int argc, char** argv )
 
 	if ( process_args( argc, argv, options ) )
 	{
+		if ( options.bServe )
+		{
+			run_server( options );
+			return 0;
+		}
+
 		print_hello();
 
-		do_work( options );
+		if ( options.bBenchmark )
+		{
+			do_benchmark( options );
+		}
+		else if ( do_work( options ) == false )
+		{
+			return 1;
+		}
 	}
 	else
 	{
@@ -1386,3 +6867,5 @@ int main( int argc, char** argv )
 
 	return 0;
 }
+
+#endif // !defined( IMGSIZE_LIBRARY )
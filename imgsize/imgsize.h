@@ -0,0 +1,94 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//=============================================================================
+//
+// imgsize.h
+//
+// Library interface. Build imgsize.cpp with IMGSIZE_LIBRARY defined to leave out the
+// command line entry point (and stb_image's implementation, which palgen.cpp holds), and
+// call imgsize_resize with images already in memory.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "paltask.h" // the shared thread cap, from palcore
+
+//=============================================================================
+
+typedef enum
+{
+	FILTER_NEAREST,
+	FILTER_BILINEAR,
+	FILTER_AREA,
+	FILTER_MITCHELL,
+	FILTER_LANCZOS3,
+}
+filter_t;
+
+//
+// imgsize_settings_t
+//
+// How imgsize_resize resamples, as imgsize's -nearest to -lanczos, -linear and -sharpen.
+//
+struct imgsize_settings_t
+{
+	filter_t filter = FILTER_LANCZOS3;
+	bool bLinear = false;
+	double fSharpen = 0.0; // 0 to 1, not with FILTER_NEAREST.
+
+	uint32_t uThreadCount = task_thread_cap();
+};
+
+//
+// imgsize_image_t
+//
+// An image in memory. 3 (RGB) or 4 (RGBA) channels of 8 bits, uStride bytes from one row to
+// the next (0 for rows tightly packed).
+//
+struct imgsize_image_t
+{
+	const uint8_t* pPixels = nullptr;
+	size_t uWidth = 0;
+	size_t uHeight = 0;
+	size_t uStride = 0;
+	int iChannels = 0;
+};
+
+//
+// imgsize_resize
+//
+// Resample an image to uWidth x uHeight RGBA pixels in pOutput (rows tightly packed, on a
+// 4 byte boundary), as imgsize would. RGBA sources with rows on 4 byte boundaries are read
+// in place; RGB is widened to opaque RGBA first. Nothing is printed or written to disk.
+// Returns false if an image or a setting is invalid.
+//
+bool imgsize_resize( const imgsize_settings_t& settings, const imgsize_image_t& input, uint8_t* pOutput, size_t uWidth, size_t uHeight );
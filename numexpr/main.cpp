@@ -2,15 +2,502 @@
 // this file specifically is licensed under CC0. see: https://creativecommons.org/public-domain/cc0/
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <vector>
 #include <locale>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <atomic>
 
 #include "numexpr.h"
 
-int main()
+//==============================================================================
+// -bench
+
+// every allocation is counted, for the allocs/op of each stage (EvalBulk's threads too)
+static std::atomic<size_t> gAllocations = 0;
+
+void* operator new( size_t size )
+{
+	++gAllocations;
+
+	if ( void* p = malloc( size ? size : 1 ) )
+	{
+		return p;
+	}
+
+	throw std::bad_alloc();
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+// The unsized, sized and array deletes all come here, as every new comes from the one
+// above. It isn't inlined: GCC would then see free given a pointer from a call to
+// operator new, and warn of a mismatch (-Wmismatched-new-delete).
+#if defined( __GNUC__ )
+__attribute__(( noinline ))
+#endif
+void operator delete( void* p ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+	operator delete( p );
+}
+
+void operator delete[]( void* p ) noexcept
+{
+	operator delete( p );
+}
+
+void operator delete[]( void* p, size_t ) noexcept
+{
+	operator delete( p );
+}
+
+// What an edit box sees: mixed units, fractions, hex and binary, and some nesting.
+static const char* const kBenchCorpus[] =
+{
+	"12.5mm",
+	"3m + 250mm",
+	"1ft + 6in",
+	"2' + 7\"",
+	"1/2in",
+	"3ft + 5/8in",
+	"(1ft + 6in) * 4",
+	"2.5in * 3 - 1/16in",
+	"6ft - 3in + 1/4in",
+	"1mi - 10yd",
+	"500 th",
+	"25.4mm * 12",
+	"1km - 3m",
+	"2,5 * 4 m",
+	"10in / 4",
+	"100",
+	"-42.5",
+	"0x1F + 0b101",
+	"(0b1101 + 0x0A) * 1.5ft",
+	"1 + 2 + 3 + 4 + 5 + 6 + 7 + 8",
+	"((((1 + 2) * 3) - 4) / 5)",
+	"7 * (3mm + (2cm - (1mm * 4)))",
+};
+
+// FNV-1a of each stage's output, printed with its timing so that a change can be checked
+// against the results of an earlier build.
+static uint64_t BenchHash( uint64_t hash, const void* pData, size_t size )
+{
+	const uint8_t* pBytes = static_cast<const uint8_t*>( pData );
+
+	for ( size_t i = 0; i < size; ++i )
+	{
+		hash = ( hash ^ pBytes[ i ] ) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t BenchHash( uint64_t hash, const Numeric::Solution& solution )
+{
+	hash = BenchHash( hash, &solution.value, sizeof( solution.value ) );
+	hash = BenchHash( hash, &solution.units.scale, sizeof( solution.units.scale ) );
+	return BenchHash( hash, &solution.units.type, sizeof( solution.units.type ) );
+}
+
+static constexpr uint64_t kBenchHashSeed = 0xcbf29ce484222325ULL;
+
+// Time fn, which does uOps operations and returns the hash of their output, and print a
+// result line.
+template <typename FN>
+static void BenchStage( const char* szName, size_t uOps, FN fn )
+{
+	const size_t uAllocations = gAllocations;
+	const auto start = std::chrono::steady_clock::now();
+
+	const uint64_t hash = fn();
+
+	const double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+	const double allocs = double( gAllocations - uAllocations ) / double( uOps );
+
+	printf( "  %-16s %10.1f ns/op %8.2f allocs/op  %016llx\n", szName, ns / double( uOps ), allocs, static_cast<unsigned long long>( hash ) );
+}
+
+static void BenchSystem( const char* szName, Numeric::UnitType type, const std::vector<std::string>& vCorpus )
+{
+	Numeric::Compiler compiler;
+	compiler.SetUnitOut( type );
+
+	// only what this system can evaluate
+	std::vector<std::string> vInputs;
+	for ( const auto& sInput : vCorpus )
+	{
+		if ( compiler.TryEval( sInput, nullptr ).ok() )
+		{
+			vInputs.push_back( sInput );
+		}
+	}
+
+	if ( vInputs.empty() )
+	{
+		printf( "%s: nothing to evaluate\n", szName );
+		return;
+	}
+
+	const size_t uRepeat = ( 200000 + vInputs.size() - 1 ) / vInputs.size();
+	const size_t uOps = uRepeat * vInputs.size();
+
+	printf( "%s: %zu expressions (%zu skipped), %zu ops per stage\n", szName, vInputs.size(), vCorpus.size() - vInputs.size(), uOps );
+
+	std::vector<Numeric::TokenList> vTokens;
+	std::vector<Numeric::CompiledExpression> vCompiled;
+	std::vector<Numeric::Solution> vSolutions;
+	for ( const auto& sInput : vInputs )
+	{
+		vTokens.push_back( compiler.Parse( sInput ) );
+		vCompiled.push_back( compiler.Compile( sInput ) );
+		vSolutions.push_back( compiler.Eval( sInput, nullptr ) );
+	}
+
+	BenchStage( "Parse", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& sInput : vInputs )
+			{
+				const auto tokens = compiler.Parse( sInput );
+				for ( const auto& token : tokens )
+				{
+					hash = BenchHash( hash, &token.value, sizeof( token.value ) );
+				}
+			}
+		}
+		return hash;
+	} );
+
+	BenchStage( "Solve", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& tokens : vTokens )
+			{
+				hash = BenchHash( hash, compiler.Solve( tokens, nullptr ) );
+			}
+		}
+		return hash;
+	} );
+
+	BenchStage( "Eval", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& sInput : vInputs )
+			{
+				hash = BenchHash( hash, compiler.Eval( sInput, nullptr ) );
+			}
+		}
+		return hash;
+	} );
+
+	compiler.SetCacheSize( vInputs.size() );
+	BenchStage( "Eval (cached)", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& sInput : vInputs )
+			{
+				hash = BenchHash( hash, compiler.Eval( sInput, nullptr ) );
+			}
+		}
+		return hash;
+	} );
+	compiler.SetCacheSize( 0 );
+
+	BenchStage( "Eval (compiled)", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& expr : vCompiled )
+			{
+				hash = BenchHash( hash, expr.Eval( nullptr ) );
+			}
+		}
+		return hash;
+	} );
+
+	std::vector<Numeric::JitExpression> vNative;
+	for ( const auto& expr : vCompiled )
+	{
+		vNative.emplace_back( expr );
+	}
+
+	BenchStage( "Eval (native)", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& jit : vNative )
+			{
+				hash = BenchHash( hash, jit.Eval( nullptr ) );
+			}
+		}
+		return hash;
+	} );
+
+	// the whole corpus, uRepeat times, in one call
+	std::vector<std::string_view> vBulk;
+	for ( size_t r = 0; r < uRepeat; ++r )
+	{
+		vBulk.insert( vBulk.end(), vInputs.begin(), vInputs.end() );
+	}
+
+	BenchStage( "EvalBulk", uOps, [ & ]()
+	{
+		const auto bulk = compiler.EvalBulk( vBulk, nullptr );
+
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t i = 0; i < vBulk.size(); ++i )
+		{
+			hash = BenchHash( hash, { bulk.values[ i ], bulk.units[ i ] } );
+		}
+		return hash;
+	} );
+
+	std::string sText;
+	BenchStage( "Format", uOps, [ & ]()
+	{
+		uint64_t hash = kBenchHashSeed;
+		for ( size_t r = 0; r < uRepeat; ++r )
+		{
+			for ( const auto& solution : vSolutions )
+			{
+				compiler.Format( solution, sText );
+				hash = BenchHash( hash, sText.data(), sText.size() );
+			}
+		}
+		return hash;
+	} );
+}
+
+static bool SameSolution( const Numeric::Solution& a, const Numeric::Solution& b )
+{
+	return memcmp( &a.value, &b.value, sizeof( a.value ) ) == 0 && a.units.scale == b.units.scale && a.units.type == b.units.type;
+}
+
+// Random inputs, the same on every run, through each of the faster paths: they must all
+// agree with Eval, error for error.
+static size_t BenchCrossCheck( Numeric::UnitType type, size_t uInputs )
+{
+	static const char* const kFragments[] =
+	{
+		"1", "2.5", "0,75", "12", "0x1F", "0b101", "(", ")", "+", "-", "*", "/", " ",
+		"mm", "cm", "m", "ft", "in", "'", "\"", "yd", "mi", "th", "zz", "1e3", "00", "1..2",
+		"^", "%", ";", "min(", "max(", "round(", "sqrt(",
+	};
+
+	Numeric::Compiler compiler, cached, preview;
+	compiler.SetUnitOut( type );
+	cached.SetUnitOut( type );
+	preview.SetUnitOut( type );
+	cached.SetCacheSize( 64 );
+
+	// every other input has a previous solution, for %
+	const Numeric::Solution prevSolution = compiler.Eval( "250", nullptr );
+
+	// compiled inputs are chained too, 16 at a time, each link after the first taking the
+	// solution Eval gave the link before
+	Numeric::CompiledChain chain;
+	std::vector<Numeric::Solution> vChainExpected, vChainOutput;
+
+	std::mt19937 random( 1234 );
+	size_t uDiffer = 0;
+	char szText[ 64 ];
+	std::string sText;
+
+	auto differ = [ & ]( const char* szPath, const std::string& sInput )
+	{
+		if ( uDiffer++ < 10 )
+		{
+			printf( "  %s differs from Eval: \"%s\"\n", szPath, sInput.c_str() );
+		}
+	};
+
+	// EvalBulk of them all at the end, with and without the previous solution
+	std::vector<std::string> vBulkInputs[ 2 ];
+	std::vector<Numeric::Result<Numeric::Solution>> vBulkExpected[ 2 ];
+
+	for ( size_t i = 0; i < uInputs; ++i )
+	{
+		std::string sInput;
+		for ( size_t n = 1 + random() % 8; n > 0; --n )
+		{
+			sInput += kFragments[ random() % std::size( kFragments ) ];
+		}
+
+		const Numeric::Solution* pPrev = ( i & 1 ) ? &prevSolution : nullptr;
+		const auto expected = compiler.TryEval( sInput, pPrev );
+
+		vBulkInputs[ i & 1 ].push_back( sInput );
+		vBulkExpected[ i & 1 ].push_back( expected );
+
+		if ( const auto result = cached.TryEval( sInput, pPrev ); result.ok() != expected.ok() || ( result.ok() && !SameSolution( result.value, expected.value ) ) )
+		{
+			differ( "cached Eval", sInput );
+		}
+
+		if ( const auto compiled = compiler.TryCompile( sInput ); compiled.ok() )
+		{
+			const auto result = compiled.value.TryEval( pPrev );
+
+			if ( result.ok() != expected.ok() || ( result.ok() && !SameSolution( result.value, expected.value ) ) )
+			{
+				differ( "Compile", sInput );
+			}
+
+			const Numeric::JitExpression jit( compiled.value, pPrev );
+
+			if ( const auto native = jit.TryEval( pPrev ); native.ok() != expected.ok() || ( native.ok() && !SameSolution( native.value, expected.value ) ) )
+			{
+				differ( "JitExpression", sInput );
+			}
+
+			if ( const auto linked = compiled.value.TryEval( vChainExpected.empty() ? nullptr : &vChainExpected.back() ); linked.ok() )
+			{
+				chain.Append( compiled.value );
+				vChainExpected.push_back( linked.value );
+			}
+
+			if ( chain.Links() == 16 )
+			{
+				vChainOutput.resize( chain.Links() );
+
+				if ( chain.TryEval( nullptr, nullptr, vChainOutput.data() ) || !std::equal( vChainOutput.begin(), vChainOutput.end(), vChainExpected.begin(), SameSolution ) )
+				{
+					differ( "CompiledChain", sInput );
+				}
+
+				chain.Clear();
+				vChainExpected.clear();
+			}
+		}
+		else if ( expected.ok() )
+		{
+			differ( "Compile", sInput );
+		}
+
+		Numeric::Solution solution = {};
+		if ( const bool bOk = preview.Preview( sInput, pPrev, solution ); bOk != expected.ok() || ( bOk && !SameSolution( solution, expected.value ) ) )
+		{
+			differ( "Preview", sInput );
+		}
+
+		// Literal refuses some inputs Eval takes, but must agree on the rest (it has no previous solution)
+		if ( const auto literal = Numeric::TryEvalLiteral( sInput, type ); pPrev == nullptr && literal.ok() && !( expected.ok() && SameSolution( literal.value, expected.value ) ) )
+		{
+			differ( "Literal", sInput );
+		}
+
+		if ( expected.ok() )
+		{
+			compiler.Format( expected.value, sText );
+
+			if ( compiler.FormatTo( expected.value, szText, sizeof( szText ) ) != sText.size() || sText.compare( 0, sizeof( szText ) - 1, szText ) != 0 )
+			{
+				differ( "FormatTo", sInput );
+			}
+		}
+	}
+
+	for ( size_t p = 0; p < 2; ++p )
+	{
+		const std::vector<std::string_view> vViews( vBulkInputs[ p ].begin(), vBulkInputs[ p ].end() );
+		const auto bulk = compiler.EvalBulk( vViews, p ? &prevSolution : nullptr, 4 );
+
+		for ( size_t i = 0; i < vViews.size(); ++i )
+		{
+			const auto& expected = vBulkExpected[ p ][ i ];
+
+			if ( bulk.errors[ i ] != expected.error.code || ( expected.ok() && !SameSolution( { bulk.values[ i ], bulk.units[ i ] }, expected.value ) ) )
+			{
+				differ( "EvalBulk", vBulkInputs[ p ][ i ] );
+			}
+		}
+	}
+
+	return uDiffer;
+}
+
+static int Bench( const char* szCorpusFile )
+{
+	std::vector<std::string> vCorpus( std::begin( kBenchCorpus ), std::end( kBenchCorpus ) );
+
+	// deep nesting, past the solver's local stack
+	vCorpus.push_back( std::string( 40, '(' ) + "1mm" + std::string( 40, ')' ) );
+	std::string sDeep = "1";
+	for ( int i = 0; i < 40; ++i )
+	{
+		sDeep = "1mm + (" + sDeep + ")";
+	}
+	vCorpus.push_back( sDeep );
+
+	if ( szCorpusFile )
+	{
+		std::ifstream file( szCorpusFile );
+		if ( !file.is_open() )
+		{
+			printf( "Can't open %s\n", szCorpusFile );
+			return 1;
+		}
+
+		vCorpus.clear();
+		for ( std::string sLine; std::getline( file, sLine ); )
+		{
+			if ( !sLine.empty() )
+			{
+				vCorpus.push_back( sLine );
+			}
+		}
+	}
+
+	BenchSystem( "Metric", Numeric::UnitType::Metric, vCorpus );
+	BenchSystem( "Imperial", Numeric::UnitType::Imperial, vCorpus );
+
+	size_t uDiffer = 0;
+	for ( const auto type : { Numeric::UnitType::Generic, Numeric::UnitType::Metric, Numeric::UnitType::Imperial } )
+	{
+		uDiffer += BenchCrossCheck( type, 100000 );
+	}
+
+	printf( "Cross-check: 300000 random inputs, %zu differ from Eval\n", uDiffer );
+
+	return ( uDiffer == 0 ) ? 0 : 1;
+}
+
+//==============================================================================
+
+int main( int argc, char** argv )
 {
 	std::locale::global( std::locale( "" ) ); // apply the locale from the environment
 
+	if ( argc > 1 && strcmp( argv[ 1 ], "-bench" ) == 0 )
+	{
+		return Bench( ( argc > 2 ) ? argv[ 2 ] : nullptr );
+	}
+
 	std::cout << "\n==========================================\n";
 	std::cout << "=== Smart Numeric 'Edit Box' Simulator ===\n";
 	std::cout << "==========================================\n";
@@ -24,11 +511,16 @@ int main()
 	std::cout << "Enter \"metric\" to use the Metric system (default).\n";
 	std::cout << "Enter \"imperial\" to use the Imperial system.\n";
 	std::cout << "Enter \"generic\" to use generic units.\n";
+	std::cout << "Enter \"exact\" to carry imperial values as exact fractions, or not.\n";
+	std::cout << "Enter \"dimensions\" to reject units that don't go together, as 3m + 2, or not.\n";
 	std::cout << "Enter a blank line to return to more tedious activities.\n";
 
 	Numeric::Compiler compiler;
 	compiler.SetUnitOut( Numeric::UnitType::Metric );
 
+	bool bExactImperial = false;
+	bool bDimensionChecking = false;
+
 	Numeric::Solution prevSolution = { 0 };
 	prevSolution.units = compiler.DefaultUnit();
 
@@ -65,6 +557,18 @@ int main()
 			prevSolution.value = 0;
 			prevSolution.units = compiler.DefaultUnit();
 		}
+		else if ( sExpression == "exact" )
+		{
+			bExactImperial = !bExactImperial;
+			compiler.SetExactImperial( bExactImperial );
+			std::cout << "Exact imperial values were turned " << ( bExactImperial ? "on" : "off" ) << "\n";
+		}
+		else if ( sExpression == "dimensions" )
+		{
+			bDimensionChecking = !bDimensionChecking;
+			compiler.SetDimensionChecking( bDimensionChecking );
+			std::cout << "Dimension checking was turned " << ( bDimensionChecking ? "on" : "off" ) << "\n";
+		}
 		else
 		{
 			try
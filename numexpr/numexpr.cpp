@@ -58,33 +58,344 @@
 #include <string>
 #include <iostream>
 #include <locale>
-#include <deque>
+#include <charconv>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+#include <utility>
 
 #include "numexpr.h"
 
 //==============================================================================
 
-#define OUTPUT_TO_CM						0
-#define OUTPUT_TO_YARDS						0
-
 #define DEBUG_OUTPUT_TOKENS					0
 #define DEBUG_OUTPUT_RPN					0
 #define DEBUG_OUTPUT_RPN_EXTRA				0
 #define DEBUG_OUTPUT_ERROR					0
 
-static constexpr auto gWhitespaceDigits = Numeric::lut::MakeLUT( " \t\n\r\v\f" );
-static constexpr auto gFirstNumericDigits = Numeric::lut::MakeLUT( "0123456789" );
-static constexpr auto gAdditionalNumericDigits = Numeric::lut::MakeLUT( ".,0123456789" );
-static constexpr auto gOperatorDigits = Numeric::lut::MakeLUT( "*+-/" );
-static constexpr auto gUnitDigits = Numeric::lut::MakeLUT( "mMkKcfootfeetinchesyardsmiles'\"" );
-static constexpr auto gAllowedHexDigits = Numeric::lut::MakeLUT( "0123456789abcdefABCDEF" );
-static constexpr auto gAllowedBinaryDigits = Numeric::lut::MakeLUT( "01" );
+// JitExpression emits native code on x86-64 only
+#if defined( _M_X64 ) || defined( __x86_64__ )
+#define JIT_X64								1
+#else
+#define JIT_X64								0
+#endif
+
+#if JIT_X64
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif // JIT_X64
+
+using namespace Numeric::lut;
 
 static constexpr int gDenominatorTable[] = { 2, 3, 4, 5, 6, 7, 8, 10, 12, 16, 32, 64, 128, 1000, -1 };
 
 //==============================================================================
 
-std::string Numeric::Token::str() const
+// Precedence and arguments, by OperatorType
+static constexpr Numeric::Operator gOperatorTable[] =
+{
+	{ 0, 0 },		// None
+	{ 3, 2 },		// Multiply
+	{ 3, 2 },		// Divide
+	{ 1, 2 },		// Add
+	{ 1, 2 },		// Subtract
+	{ 100, 1 },		// UnaryPlus (the solver upgrades + to it)
+	{ 100, 1 },		// UnaryMinus (the solver upgrades - to it)
+	{ 4, 2 },		// Power (below the signs, as in a spreadsheet: -2^2 is 4)
+	{ 0, 1 },		// Percent (postfix, so it never waits on the holding stack)
+	{ 0, 2 },		// Min (functions wait under their parenthesis, not behind operators)
+	{ 0, 2 },		// Max
+	{ 0, 1 },		// Round
+	{ 0, 1 },		// Sqrt
+};
+
+static_assert( std::size( gOperatorTable ) == size_t( Numeric::OperatorType::Count ) );
+
+struct OperatorName
+{
+	std::string_view text;
+	Numeric::OperatorType type;
+};
+
+static constexpr OperatorName gOperatorNames[] =
+{
+	{ "*", Numeric::OperatorType::Multiply },
+	{ "/", Numeric::OperatorType::Divide },
+	{ "+", Numeric::OperatorType::Add },
+	{ "-", Numeric::OperatorType::Subtract },
+	{ "^", Numeric::OperatorType::Power },
+	{ "%", Numeric::OperatorType::Percent },
+
+	// functions, which the tokeniser finds among the names
+	{ "min", Numeric::OperatorType::Min },
+	{ "max", Numeric::OperatorType::Max },
+	{ "round", Numeric::OperatorType::Round },
+	{ "sqrt", Numeric::OperatorType::Sqrt },
+};
+
+static const Numeric::Operator& GetOperator( Numeric::OperatorType type )
+{
+	return gOperatorTable[ size_t( type ) ];
+}
+
+static Numeric::OperatorType FindOperator( std::string_view sText )
+{
+	for ( const auto& name : gOperatorNames )
+	{
+		if ( name.text == sText )
+		{
+			return name.type;
+		}
+	}
+
+	return Numeric::OperatorType::None;
+}
+
+// Perfect hash over the unit spellings: a seed is searched for at compile time so that
+// every alias lands in its own slot of gUnitHashTable.
+static constexpr size_t gUnitHashSize = 64;
+
+static constexpr uint32_t UnitHash( std::string_view sText, uint32_t seed )
+{
+	uint32_t h = 2166136261u ^ seed;
+	for ( const auto c : sText )
+	{
+		h = ( h ^ uint8_t( c ) ) * 16777619u;
+	}
+
+	return ( h ^ ( h >> 15 ) ) % gUnitHashSize;
+}
+
+static constexpr uint32_t FindUnitHashSeed()
+{
+	for ( uint32_t seed = 0; ; ++seed )
+	{
+		bool aUsed[ gUnitHashSize ] = {};
+		bool bCollision = false;
+
+		for ( const auto& alias : Numeric::gUnitAliases )
+		{
+			const uint32_t slot = UnitHash( alias.text, seed );
+			bCollision = bCollision || aUsed[ slot ];
+			aUsed[ slot ] = true;
+		}
+
+		if ( !bCollision )
+		{
+			return seed;
+		}
+	}
+}
+
+static constexpr uint32_t gUnitHashSeed = FindUnitHashSeed();
+
+static constexpr auto gUnitHashTable = []()
+{
+	std::array<int8_t, gUnitHashSize> table{};
+	table.fill( -1 );
+
+	for ( size_t i = 0; i < std::size( Numeric::gUnitAliases ); ++i )
+	{
+		table[ UnitHash( Numeric::gUnitAliases[ i ].text, gUnitHashSeed ) ] = int8_t( i );
+	}
+
+	return table;
+}();
+
+static Numeric::UnitId FindUnit( std::string_view sText )
+{
+	const int index = gUnitHashTable[ UnitHash( sText, gUnitHashSeed ) ];
+
+	if ( index >= 0 && Numeric::gUnitAliases[ index ].text == sText )
+	{
+		return Numeric::gUnitAliases[ index ].id;
+	}
+
+	return Numeric::UnitId::None;
+}
+
+// Read position in the input being tokenised, kept on the stack of ParseInto so that the
+// shared state of a Compiler is never written while parsing.
+struct InputCursor
+{
+	InputCursor( const std::string& sInput, size_t uStart )
+		: stream( sInput.begin() + uStart ), streamEnd( sInput.end() ), pos( uStart )
+	{
+	}
+
+	char Peek() const
+	{
+		return ( stream == streamEnd ) ? 0 : *stream;
+	}
+
+	void Next()
+	{
+		++stream;
+		++pos;
+	}
+
+	std::string::const_iterator stream;
+	std::string::const_iterator streamEnd;
+	size_t pos;
+};
+
+// Read a base 10 literal. One with no delimiter, or a '.', is read where it is; any other
+// delimiter is swapped for a '.' in a copy first.
+static bool ParseDecimalLiteral( std::string_view sLiteral, char charDelimiter, double& value )
+{
+	value = 0.0;
+
+	if ( charDelimiter == 0 || charDelimiter == '.' )
+	{
+		std::from_chars( sLiteral.data(), sLiteral.data() + sLiteral.size(), value );
+		return true;
+	}
+
+	char buffer[ 64 ];
+
+	if ( sLiteral.size() >= sizeof( buffer ) )
+	{
+		return false;
+	}
+
+	for ( size_t i = 0; i < sLiteral.size(); ++i )
+	{
+		buffer[ i ] = ( sLiteral[ i ] == charDelimiter ) ? '.' : sLiteral[ i ];
+	}
+
+	std::from_chars( buffer, buffer + sLiteral.size(), value );
+
+	return true;
+}
+
+// The exact value of a numeric literal, for SetExactImperial: a decimal of at most 18
+// digits, or (hex and binary) a whole number that the double holds exactly.
+static Numeric::math::Rational ExactLiteral( std::string_view sLiteral, double value )
+{
+	if ( sLiteral.size() > 1 && sLiteral[ 0 ] == '0' && ( sLiteral[ 1 ] == 'x' || sLiteral[ 1 ] == 'X' || sLiteral[ 1 ] == 'b' || sLiteral[ 1 ] == 'B' ) )
+	{
+		if ( value > 9007199254740992.0 ) // 2^53
+		{
+			return {};
+		}
+
+		return { int64_t( value ), 1 };
+	}
+
+	int64_t num = 0;
+	int64_t den = 1;
+	size_t uDigits = 0;
+	bool bPoint = false;
+
+	for ( const char c : sLiteral )
+	{
+		if ( c >= '0' && c <= '9' )
+		{
+			if ( ++uDigits > 18 )
+			{
+				return {};
+			}
+
+			num = num * 10 + ( c - '0' );
+			den *= bPoint ? 10 : 1;
+		}
+		else
+		{
+			bPoint = true; // the tokeniser allows one point, '.' or the locale's
+		}
+	}
+
+	return Numeric::math::MakeRational( num, den );
+}
+
+// The powers of length a Dimension stands for, and back, for SetDimensionChecking
+static constexpr int DimensionPower( Numeric::Dimension dimension )
+{
+	return int( dimension ) - int( Numeric::Dimension::Unitless );
+}
+
+static constexpr bool DimensionOfPower( int power, Numeric::Dimension& dimension )
+{
+	if ( power < 0 || power > DimensionPower( Numeric::Dimension::Area ) )
+	{
+		return false;
+	}
+
+	dimension = Numeric::Dimension( power + int( Numeric::Dimension::Unitless ) );
+	return true;
+}
+
+// The Dimension of an operation on values of lhs (the only argument of one that takes one)
+// and rhs, or false if they don't go together. pExponent is the exponent of a Power when it
+// is a literal, which a length can only be raised to as a whole number.
+static bool CombineDimensions( Numeric::OperatorType op, Numeric::Dimension lhs, Numeric::Dimension rhs, const double* pExponent, Numeric::Dimension& result )
+{
+	using Numeric::Dimension;
+	using Numeric::OperatorType;
+
+	switch ( op )
+	{
+	case OperatorType::Add:
+	case OperatorType::Subtract:
+	case OperatorType::Min:
+	case OperatorType::Max:
+		result = ( lhs == Dimension::Unknown ) ? rhs : lhs;
+		return lhs == rhs || lhs == Dimension::Unknown || rhs == Dimension::Unknown;
+
+	case OperatorType::Multiply:
+	case OperatorType::Divide:
+		if ( lhs == Dimension::Unknown || rhs == Dimension::Unknown )
+		{
+			result = Dimension::Unknown;
+			return true;
+		}
+		return DimensionOfPower( DimensionPower( lhs ) + ( ( op == OperatorType::Multiply ) ? 1 : -1 ) * DimensionPower( rhs ), result );
+
+	case OperatorType::Power:
+		if ( rhs != Dimension::Unitless && rhs != Dimension::Unknown )
+		{
+			return false;
+		}
+		if ( lhs == Dimension::Unitless || lhs == Dimension::Unknown )
+		{
+			result = lhs;
+			return true;
+		}
+		return pExponent && *pExponent >= 0 && *pExponent <= 2 && double( int( *pExponent ) ) == *pExponent
+			&& DimensionOfPower( DimensionPower( lhs ) * int( *pExponent ), result );
+
+	case OperatorType::Sqrt:
+		if ( lhs == Dimension::Unitless || lhs == Dimension::Unknown )
+		{
+			result = lhs;
+			return true;
+		}
+		result = Dimension::Length;
+		return lhs == Dimension::Area;
+
+	case OperatorType::Percent:
+		result = Dimension::Unknown;
+		return lhs == Dimension::Unitless || lhs == Dimension::Unknown;
+
+	default: // UnaryPlus, UnaryMinus and Round
+		result = lhs;
+		return true;
+	}
+}
+
+//==============================================================================
+
+std::string Numeric::Token::str( std::string_view svInput ) const
 {
 	std::string o;
 
@@ -97,9 +408,11 @@ std::string Numeric::Token::str() const
 	case Token::Type::Parenthesis_Close:		o += "[Parenthesis, Close]"; break;
 	case Token::Type::Symbol:					o += "[Symbol            ]"; break;
 	case Token::Type::Unit:						o += "[Unit              ]"; break;
+	case Token::Type::Function:					o += "[Function          ]"; break;
+	case Token::Type::Separator:				o += "[Separator         ]"; break;
 	}
 
-	o += " @ (" + std::to_string( pos ) + ") : " + text;
+	o += " @ (" + std::to_string( pos ) + ") : " + std::string( Text( svInput ) );
 
 	if ( type == Type::Literal_Numeric )
 	{
@@ -113,6 +426,44 @@ std::string Numeric::Token::str() const
 	return o;
 }
 
+std::string Numeric::ErrorMessage( const Error& error )
+{
+	const std::string sText( error.text );
+
+	switch ( error.code )
+	{
+	case ErrorCode::None:							return "";
+
+	case ErrorCode::NoInput:						return "[PARSE] No input.";
+	case ErrorCode::UnknownCharacter:				return "[PARSE] Unknown character '" + sText + "'";
+	case ErrorCode::BadNumericConstruction:			return "[PARSE] Bad numeric construction";
+	case ErrorCode::InvalidPrefixedLiteral:			return "[PARSE] Invalid prefixed numeric literal";
+	case ErrorCode::UnknownOperator:				return "[PARSE] Unknown operator: " + sText;
+	case ErrorCode::UnbalancedParenthesis:			return "[PARSE] Parenthesis '(' & ')' not balanced";
+
+	case ErrorCode::UnexpectedCloseParenthesis:		return "[SOLVE] Unexpected close parenthesis";
+	case ErrorCode::NoOpenParenthesis:				return "[SOLVE] No open parenthesis found";
+	case ErrorCode::UnknownSymbol:					return "[SOLVE] Unknown symbol: " + sText;
+	case ErrorCode::UnsupportedToken:				return "[SOLVE] Unsupported Token";
+	case ErrorCode::MalformedExpression:			return "[SOLVE] Expression is malformed";
+	case ErrorCode::UnexpectedToken:				return "[SOLVE] Unexpected Token";
+	case ErrorCode::IndeterminateExpression:		return "[SOLVE] Indeterminate Expression";
+	case ErrorCode::NoSymbolValues:					return "[SOLVE] No values for symbols";
+	case ErrorCode::BadArguments:					return "[SOLVE] Wrong arguments to function: " + sText;
+	case ErrorCode::NoPreviousValue:				return "[SOLVE] No previous value for %";
+	case ErrorCode::DimensionMismatch:				return "[SOLVE] Units don't go together: " + sText;
+	}
+
+	return "";
+}
+
+Numeric::CompilerError::CompilerError( const Error& error )
+	: _message( ErrorMessage( error ) )
+	, _code( error.code )
+	, _pos( error.pos )
+{
+}
+
 Numeric::CompilerError::CompilerError( Stage stage, const std::string& sMsg )
 {
 	switch ( stage )
@@ -129,246 +480,539 @@ Numeric::CompilerError::CompilerError( Stage stage, const std::string& sMsg )
 	}
 }
 
-Numeric::Compiler::Compiler()
+Numeric::Compiler::Config::Config( const UnitType unitOut )
 {
-	// Standard Binary Operators
-	_mapOperators[ "*" ] = { 3, 2 };
-	_mapOperators[ "/" ] = { 3, 2 };
-	_mapOperators[ "+" ] = { 1, 2 };
-	_mapOperators[ "-" ] = { 1, 2 };
+	// Cache the current decimal point used by the locale.
+	_localeDecimalPoint = std::use_facet<std::numpunct<char>>( std::locale( "" ) ).decimal_point();
+
+	SetUnitOut( unitOut );
+}
 
-	// Unary Operators
-	_mapOperators[ "u+" ] = { 100, 1 };
-	_mapOperators[ "u-" ] = { 100, 1 };
+void Numeric::Compiler::Config::SetUnitOut( const UnitType type )
+{
+	_desiredUnitType = type;
 
-	// Default
-	SetUnitOut( UnitType::Generic );
+	// Generic values use the metric system's units
+	_pUnitSystem = ( type == UnitType::Imperial ) ? &_imperialSystem : &_metricSystem;
 }
 
-void Numeric::Compiler::SetUnitOut( const UnitType type )
+Numeric::Compiler::Compiler()
+	: _pOwnConfig( std::make_shared<Config>() )
 {
-	_mapUnits.clear();
-	_mapUnitLookup.clear();
+	_pConfig = _pOwnConfig;
+}
 
-	_desiredUnitType = type;
+Numeric::Compiler::Compiler( std::shared_ptr<const Config> pConfig )
+	: _pConfig( std::move( pConfig ) )
+{
+}
 
-	if ( type == UnitType::Imperial )
-	{
-		//
-		// -- IMPERIAL SYSTEM
-
-		// Metric Units
-		_mapUnits[ "mm" ] = { 1.0 / _metricScaleInch, UnitType::Metric };
-		_mapUnits[ "cm" ] = { 10.0 / _metricScaleInch, UnitType::Metric };
-		_mapUnits[ "m" ] = { 1000.0 / _metricScaleInch, UnitType::Metric };
-		_mapUnits[ "Km" ] = _mapUnits[ "km" ] = { 1000000.0 / _metricScaleInch, UnitType::Metric };
-		_mapUnits[ "Mm" ] = { 1000000000.0 / _metricScaleInch, UnitType::Metric };
-
-		// Metric Units (lookup)
-		_mapUnitLookup[ 0.001 / _metricScaleFoot ] = "mm";
-		_mapUnitLookup[ 0.01 / _metricScaleFoot ] = "cm";
-		_mapUnitLookup[ 1 / _metricScaleFoot ] = "m";
-		_mapUnitLookup[ 1000 / _metricScaleFoot ] = "Km";
-		_mapUnitLookup[ 1000000 / _metricScaleFoot ] = "Mm";
-
-		// Imperial Units
-		_mapUnits[ "th" ] = _mapUnits[ "thou" ] = _mapUnits[ "mil" ] = { _impScaleThou, UnitType::Imperial };
-		_mapUnits[ "in" ] = _mapUnits[ "inch" ] = _mapUnits[ "inches" ] = _mapUnits[ "\"" ] = { _impScaleInch, UnitType::Imperial };
-		_mapUnits[ "ft" ] = _mapUnits[ "foot" ] = _mapUnits[ "feet" ] = _mapUnits[ "'" ] = { _impScaleFoot, UnitType::Imperial };
-		_mapUnits[ "yd" ] = _mapUnits[ "yard" ] = _mapUnits[ "yds" ] = _mapUnits[ "yards" ] = { _impScaleYard, UnitType::Imperial };
-		_mapUnits[ "mi" ] = _mapUnits[ "mile" ] = _mapUnits[ "miles" ] = { _impScaleMile, UnitType::Imperial };
-
-		// Imperial Units (lookup)
-		_mapUnitLookup[ _impScaleThou ] = "th";
-		_mapUnitLookup[ _impScaleInch ] = "in";
-		_mapUnitLookup[ _impScaleFoot ] = "ft";
-		_mapUnitLookup[ _impScaleYard ] = "yd";
-		_mapUnitLookup[ _impScaleMile ] = "mi";
-	}
-	else
+Numeric::Compiler::Config& Numeric::Compiler::EditConfig()
+{
+	// others may be reading a shared Config: change a copy of our own instead
+	if ( !_pOwnConfig )
 	{
-		//
-		// -- METRIC SYSTEM
-
-		// Metric Units
-		_mapUnits[ "mm" ] = { 0.001, UnitType::Metric };
-		_mapUnits[ "cm" ] = { 0.01, UnitType::Metric };
-		_mapUnits[ "m" ] = { 1, UnitType::Metric };
-		_mapUnits[ "Km" ] = _mapUnits[ "km" ] = { 1000, UnitType::Metric };
-		_mapUnits[ "Mm" ] = { 1000000, UnitType::Metric };
-
-		// Metric Units (lookup)
-		_mapUnitLookup[ 0.001 ] = "mm";
-		_mapUnitLookup[ 0.01 ] = "cm";
-		_mapUnitLookup[ 1 ] = "m";
-		_mapUnitLookup[ 1000 ] = "Km";
-		_mapUnitLookup[ 1000000 ] = "Mm";
-
-		// Imperial Units
-		_mapUnits[ "in" ] = _mapUnits[ "inch" ] = _mapUnits[ "inches" ] = _mapUnits[ "\"" ] = { _metricScaleInch, UnitType::Imperial };
-		_mapUnits[ "ft" ] = _mapUnits[ "foot" ] = _mapUnits[ "feet" ] = _mapUnits[ "'" ] = { _metricScaleFoot, UnitType::Imperial };
-		_mapUnits[ "yd" ] = _mapUnits[ "yard" ] = _mapUnits[ "yds" ] = _mapUnits[ "yards" ] = { _metricScaleYard, UnitType::Imperial };
-		_mapUnits[ "mi" ] = _mapUnits[ "mile" ] = _mapUnits[ "miles" ] = { _metricScaleMile, UnitType::Imperial };
-
-		// Imperial Units (lookup)
-		_mapUnitLookup[ _metricScaleInch ] = "in";
-		_mapUnitLookup[ _metricScaleFoot ] = "ft";
-		_mapUnitLookup[ _metricScaleYard ] = "yd";
-		_mapUnitLookup[ _metricScaleMile ] = "mi";
+		_pOwnConfig = std::make_shared<Config>( *_pConfig );
+		_pConfig = _pOwnConfig;
 	}
+
+	return *_pOwnConfig;
+}
+
+void Numeric::Compiler::SetUnitOut( const UnitType type )
+{
+	EditConfig().SetUnitOut( type );
+
+	// units may now tokenise differently
+	_previewInput.clear();
+	_previewTokens.clear();
 }
 
 const Numeric::Unit Numeric::Compiler::DefaultUnit() const
 {
-	if ( _desiredUnitType == UnitType::Generic || _desiredUnitType == UnitType::Metric )
-	{
-		return { 1.0, _desiredUnitType };
-	}
-	else
+	return DefaultUnit( _pConfig->_desiredUnitType );
+}
+
+Numeric::Solution Numeric::Compiler::Eval( const std::string& sInput, const Solution* pPrevSolution )
+{
+	auto result = TryEval( sInput, pPrevSolution );
+
+	if ( result.error )
 	{
-		return { _impScaleFoot, _desiredUnitType };
+		throw CompilerError( result.error );
 	}
+
+	return result.value;
 }
 
-Numeric::Solution Numeric::Compiler::Eval( const std::string& sInput, const Solution* pPrevSolution )
+Numeric::Result<Numeric::Solution> Numeric::Compiler::TryEval( const std::string& sInput, const Solution* pPrevSolution )
 {
+	if ( _cacheSize > 0 )
+	{
+		return TryEvalCached( sInput, pPrevSolution );
+	}
+
 	// Parse the expression into tokens
-	auto vTokens = Parse( sInput );
+	if ( const Error error = ParseInto( sInput, _scratchTokens ) )
+	{
+		return { {}, error };
+	}
 
 	// Solve the expression
-	Solution result = Solve( vTokens, pPrevSolution );
+	return TrySolve( _scratchTokens, pPrevSolution );
+}
 
-	return result;
+void Numeric::Compiler::SetCacheSize( size_t uEntries )
+{
+	ClearCache();
+
+	_cacheSize = uEntries;
+	_cacheEntries.reserve( uEntries );
+	_mapCache.reserve( uEntries );
 }
 
-const std::string Numeric::Compiler::Format( const Solution& result ) const
+void Numeric::Compiler::ClearCache()
 {
-	std::string out;
+	_cacheEntries.clear();
+	_mapCache.clear();
+	_cacheHand = 0;
+}
 
-	double normalValue = result.value / result.units.scale;
-	int64_t normalValueAbsInt = static_cast<int64_t>( floor( fabs( normalValue ) ) );
-	double frac = fabs( normalValue ) - normalValueAbsInt;
+Numeric::Result<Numeric::Solution> Numeric::Compiler::TryEvalCached( const std::string& sInput, const Solution* pPrevSolution )
+{
+	// Imperial fractions only change Format, so the compiled form depends on the output units alone
+	const UnitType unitType = _pConfig->_desiredUnitType;
+	const size_t uHash = StringHash{}( sInput ) ^ ( ( size_t( unitType ) + 1 ) * 0x9E3779B97F4A7C15ull );
 
-	if ( IsEpsilonInteger( normalValue ) )
-	{
-		out = std::to_string( static_cast<int64_t>( round( normalValue ) ) );
-	}
-	else // frac > 0
+	if ( const auto it = _mapCache.find( uHash ); it != _mapCache.end() )
 	{
-		bool success = false;
+		CacheEntry& entry = _cacheEntries[ it->second ];
 
-		if ( result.units.type == Numeric::UnitType::Imperial && _imperialFractions )
+		if ( entry.unitType == unitType && entry.text == sInput )
 		{
-			for ( const int* pDenominator = gDenominatorTable; *pDenominator != -1; ++pDenominator )
-			{
-				int denom = *pDenominator;
+			++_cacheHits;
+			entry.referenced = true;
 
-				if ( IsEpsilonInteger( frac * denom ) )
-				{
-					if ( normalValueAbsInt != 0 )
-					{
-						out += std::to_string( (int64_t)normalValue );
+			return entry.expr.TryEval( pPrevSolution );
+		}
+	}
 
-						if ( denom == 12 && result.units.scale == _impScaleFoot )
-						{
-							out += UnitName( result.units );
-						}
+	++_cacheMisses;
 
-						if ( normalValue < 0 )
-						{
-							out += "-";
-						}
-						else
-						{
-							out += "+";
-						}
-					}
+	// inputs with errors aren't kept
+	if ( const Error error = ParseInto( sInput, _scratchTokens ) )
+	{
+		return { {}, error };
+	}
 
-					if ( denom == 12 && result.units.scale == _impScaleFoot )
-					{
-						out += std::to_string( int( frac * denom ) ) + UnitName( { _impScaleInch, UnitType::Imperial } );
+	if ( const Error error = CompileInto( _scratchTokens, _scratchExpression ) )
+	{
+		return { {}, error };
+	}
 
-						return out; // <== EARLY OUT
-					}
-					else
-					{
-						out += std::to_string( int( frac * denom ) ) + "/" + std::to_string( denom );
-					}
+	uint32_t uEntry;
 
-					success = true;
-					break;
-				}
-			}
+	if ( _cacheEntries.size() < _cacheSize )
+	{
+		uEntry = uint32_t( _cacheEntries.size() );
+		_cacheEntries.emplace_back();
+	}
+	else
+	{
+		while ( _cacheEntries[ _cacheHand ].referenced )
+		{
+			_cacheEntries[ _cacheHand ].referenced = false;
+			_cacheHand = ( _cacheHand + 1 ) % _cacheSize;
 		}
 
-		if ( success == false )
+		uEntry = uint32_t( _cacheHand );
+		_cacheHand = ( _cacheHand + 1 ) % _cacheSize;
+
+		// on a hash collision the map may already point at a newer entry
+		if ( const auto it = _mapCache.find( _cacheEntries[ uEntry ].hash ); it != _mapCache.end() && it->second == uEntry )
 		{
-			out = std::to_string( normalValue );
+			_mapCache.erase( it );
 		}
 	}
 
-	out += UnitName( result.units );
+	CacheEntry& entry = _cacheEntries[ uEntry ];
+	entry.text = sInput;
+	entry.hash = uHash;
+	entry.unitType = unitType;
+	entry.referenced = false;
+	std::swap( entry.expr, _scratchExpression ); // the scratch takes over the old buffers
+	_mapCache[ uHash ] = uEntry;
 
-	return out;
+	return entry.expr.TryEval( pPrevSolution );
 }
 
-std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput )
+bool Numeric::Compiler::Preview( const std::string& sInput, const Solution* pPrevSolution, Solution& result )
 {
-	if ( sInput.empty() )
+	// A token is ended by the character after it, so it still stands if that character
+	// comes before the first one that changed.
+	const size_t uSame = std::mismatch( sInput.begin(), sInput.end(), _previewInput.begin(), _previewInput.end() ).first - sInput.begin();
+
+	size_t uKeepTokens = 0;
+	while ( uKeepTokens < _previewTokens.size() && _previewTokens[ uKeepTokens ].pos + _previewTokens[ uKeepTokens ].length < uSame )
 	{
-		throw CompilerError( CompilerError::Stage::Parser, "No input." );
+		++uKeepTokens;
 	}
 
-	// Cache the current decimal point used by the locale.
-	_localeDecimalPoint = std::use_facet<std::numpunct<char>>( std::locale( "" ) ).decimal_point();
+	_previewInput = sInput;
 
-	std::vector< Token > vecOutputTokens;
-
-	// Prepare input
-	SetupInput( sInput );
+	// on error, _previewTokens still holds the tokens read up to it.
+	Error error = ParseInto( _previewInput, _previewTokens, uKeepTokens );
 
-	// Finite State Machine
-	enum class TokeniserState
+	if ( !error )
 	{
-		NewToken,
-		NumericLiteral,
-		PrefixedNumericLiteral,
-		HexNumericLiteral,
-		BinNumericLiteral,
-		Unit_or_Symbol,
-		Parenthesis_Open,
-		Parenthesis_Close,
-		Operator,
-		CompleteToken,
-	};
+		const auto solved = TrySolve( _previewTokens, pPrevSolution );
 
-	// State
-	TokeniserState stateNow = TokeniserState::NewToken;
-	TokeniserState stateNext = TokeniserState::NewToken;
-	std::string sCurrentToken = "";
-	Token tokCurrent;
-	Token tokPrevious = { _inputPos, Token::Type::Unknown, "" };
-	size_t uTokenStart = 0;
-	size_t uParenthesisBalance = 0;
-	bool bDecimalPointFound = false;
-	bool bFootFound = false;
-	std::string sPrefixedNumericLiteralToken = "";
+		error = solved.error;
+		result = solved.value;
+	}
 
-	for ( ; ; )
-	{
-		char charNow = PeekInput();
+	_previewError = ErrorMessage( error );
 
-		switch ( stateNow )
-		{
+	return !error;
+}
 
-		case TokeniserState::NewToken:
-			{
-				uTokenStart = _inputPos;
-				sCurrentToken.clear();
-				bDecimalPointFound = false;
-				tokCurrent = { _inputPos, Token::Type::Unknown, "" };
+Numeric::CompiledExpression Numeric::Compiler::Compile( const std::string& sInput )
+{
+	auto result = TryCompile( sInput );
 
-				//
+	if ( result.error )
+	{
+		throw CompilerError( result.error );
+	}
+
+	return std::move( result.value );
+}
+
+Numeric::Result<Numeric::CompiledExpression> Numeric::Compiler::TryCompile( const std::string& sInput )
+{
+	Result<CompiledExpression> result;
+
+	// Parse the expression into tokens, once
+	result.error = ParseInto( sInput, _scratchTokens );
+
+	if ( !result.error )
+	{
+		result.error = CompileInto( _scratchTokens, result.value );
+	}
+
+	return result;
+}
+
+Numeric::BulkResult Numeric::Compiler::EvalBulk( std::span<const std::string_view> vInputs, const Solution* pPrevSolution, unsigned uThreads ) const
+{
+	BulkResult result;
+	result.values.resize( vInputs.size() );
+	result.units.resize( vInputs.size() );
+	result.errors.resize( vInputs.size() );
+
+	const size_t uChunks = ( vInputs.size() + _bulkChunkSize - 1 ) / _bulkChunkSize;
+
+	if ( uThreads == 0 )
+	{
+		uThreads = std::max( 1u, std::thread::hardware_concurrency() );
+	}
+
+	uThreads = unsigned( std::min<size_t>( uThreads, std::max<size_t>( uChunks, 1 ) ) );
+
+	// The Config isn't changed while the workers read it, as only EditConfig does that.
+	std::atomic<size_t> nextChunk( 0 );
+	std::atomic<size_t> failed( 0 );
+
+	auto worker = [ & ]()
+	{
+		Compiler compiler( _pConfig );
+		compiler.SetCacheSize( _cacheSize );
+
+		std::string sInput;
+		size_t uFailed = 0;
+
+		for ( size_t uChunk = nextChunk++; uChunk < uChunks; uChunk = nextChunk++ )
+		{
+			const size_t uEnd = std::min( vInputs.size(), ( uChunk + 1 ) * _bulkChunkSize );
+
+			for ( size_t i = uChunk * _bulkChunkSize; i < uEnd; ++i )
+			{
+				sInput.assign( vInputs[ i ] );
+
+				const Result<Solution> solution = compiler.TryEval( sInput, pPrevSolution );
+
+				result.values[ i ] = solution.value.value;
+				result.units[ i ] = solution.value.units;
+				result.errors[ i ] = solution.error.code;
+
+				uFailed += solution.error ? 1 : 0;
+			}
+		}
+
+		failed += uFailed;
+	};
+
+	std::vector<std::thread> vThreads;
+	for ( unsigned t = 1; t < uThreads; ++t )
+	{
+		vThreads.emplace_back( worker );
+	}
+
+	worker();
+
+	for ( auto& thread : vThreads )
+	{
+		thread.join();
+	}
+
+	result.failed = failed;
+
+	return result;
+}
+
+const std::string Numeric::Compiler::Format( const Solution& result ) const
+{
+	std::string out;
+	Format( result, out );
+	return out;
+}
+
+void Numeric::Compiler::Format( const Solution& result, std::string& sOut ) const
+{
+	char aText[ _formatTextSize ];
+	sOut.assign( aText, FormatChars( result, aText ) );
+}
+
+size_t Numeric::Compiler::FormatTo( const Solution& result, char* pBuffer, size_t uSize ) const
+{
+	char aText[ _formatTextSize ];
+	const size_t uLength = FormatChars( result, aText );
+
+	if ( uSize > 0 )
+	{
+		const size_t uCopy = std::min( uLength, uSize - 1 );
+		std::copy_n( aText, uCopy, pBuffer );
+		pBuffer[ uCopy ] = '\0';
+	}
+
+	return uLength;
+}
+
+// Writes the formatted text to pText, which must hold _formatTextSize chars, and returns its
+// length. Numbers go through std::to_chars; doubles use the same fixed 6 decimals as
+// std::to_string, with the locale's decimal point.
+size_t Numeric::Compiler::FormatChars( const Solution& result, char* pText ) const
+{
+	char* pOut = pText;
+	char* const pOutEnd = pText + _formatTextSize;
+
+	auto putText = [ & ]( std::string_view sText )
+	{
+		pOut = std::copy( sText.begin(), sText.end(), pOut );
+	};
+
+	auto putInteger = [ & ]( int64_t iValue )
+	{
+		pOut = std::to_chars( pOut, pOutEnd, iValue ).ptr;
+	};
+
+	double normalValue = result.value / result.units.scale;
+	int64_t normalValueAbsInt = static_cast<int64_t>( floor( fabs( normalValue ) ) );
+	double frac = fabs( normalValue ) - normalValueAbsInt;
+
+	// An exact result (see SetExactImperial) is taken in its units in lowest terms, so its
+	// whole part and fraction are read straight off it.
+	const bool bFractions = ( result.units.type == Numeric::UnitType::Imperial && _pConfig->_imperialFractions );
+	const math::Rational exact = ( bFractions && result.exact.Exact() ) ? math::Divide( result.exact, ExactScale( result.units.scale ) ) : math::Rational{};
+
+	if ( exact.Exact() ? ( exact.den == 1 ) : math::IsEpsilonInteger( normalValue ) )
+	{
+		putInteger( exact.Exact() ? exact.num : static_cast<int64_t>( round( normalValue ) ) );
+	}
+	else // frac > 0
+	{
+		// The fraction is shown with a denominator of the table: the exact one, if it is
+		// there, or the first that gives a whole numerator.
+		int denom = 0;
+
+		if ( bFractions )
+		{
+			for ( const int* pDenominator = gDenominatorTable; *pDenominator != -1; ++pDenominator )
+			{
+				if ( exact.Exact() ? ( *pDenominator == exact.den ) : math::IsEpsilonInteger( frac * *pDenominator ) )
+				{
+					denom = *pDenominator;
+					break;
+				}
+			}
+		}
+
+		if ( denom != 0 )
+		{
+			const bool bNegative = exact.Exact() ? ( exact.num < 0 ) : ( normalValue < 0 );
+			const int64_t numerator = exact.Exact() ? ( ( exact.num < 0 ) ? -exact.num : exact.num ) % exact.den : int( frac * denom );
+
+			if ( exact.Exact() )
+			{
+				normalValueAbsInt = ( ( exact.num < 0 ) ? -exact.num : exact.num ) / exact.den;
+			}
+
+			if ( normalValueAbsInt != 0 )
+			{
+				putInteger( exact.Exact() ? ( exact.num / exact.den ) : (int64_t)normalValue );
+
+				if ( denom == 12 && result.units.scale == _impScaleFoot )
+				{
+					putText( UnitName( result.units ) );
+				}
+
+				if ( bNegative )
+				{
+					putText( "-" );
+				}
+				else
+				{
+					putText( "+" );
+				}
+			}
+
+			if ( denom == 12 && result.units.scale == _impScaleFoot )
+			{
+				putInteger( numerator );
+				putText( UnitName( { _impScaleInch, UnitType::Imperial } ) );
+
+				return pOut - pText; // <== EARLY OUT
+			}
+			else
+			{
+				putInteger( numerator );
+				putText( "/" );
+				putInteger( denom );
+			}
+		}
+		else
+		{
+			char* const pNumber = pOut;
+			pOut = std::to_chars( pOut, pOutEnd, normalValue, std::chars_format::fixed, 6 ).ptr;
+			std::replace( pNumber, pOut, '.', _pConfig->_localeDecimalPoint );
+		}
+	}
+
+	putText( UnitName( result.units ) );
+
+	return pOut - pText;
+}
+
+Numeric::TokenList Numeric::Compiler::Parse( const std::string& sInput )
+{
+	TokenList vecOutputTokens;
+
+	if ( const Error error = ParseInto( sInput, vecOutputTokens ) )
+	{
+		throw CompilerError( error );
+	}
+
+	return vecOutputTokens;
+}
+
+Numeric::Error Numeric::Compiler::ParseInto( const std::string& sInput, TokenList& vecOutputTokens, size_t uKeepTokens )
+{
+	if ( sInput.empty() )
+	{
+		return { ErrorCode::NoInput };
+	}
+
+	// tokens hold 32-bit offsets
+	if ( sInput.size() > UINT32_MAX )
+	{
+		return { ErrorCode::UnsupportedToken, 0 };
+	}
+
+	// The first uKeepTokens tokens are already known to be those of sInput (see Preview);
+	// the list is pointed at sInput and tokenising carries on after them.
+	const std::string_view svInput( sInput );
+	size_t uParenthesisBalance = 0;
+	size_t uResume = 0;
+
+	vecOutputTokens.resize( uKeepTokens );
+	vecOutputTokens.input = svInput;
+
+	for ( const auto& token : vecOutputTokens )
+	{
+		uResume = token.pos + token.length;
+
+		if ( token.type == Token::Type::Parenthesis_Open )
+		{
+			++uParenthesisBalance;
+		}
+		else if ( token.type == Token::Type::Parenthesis_Close )
+		{
+			--uParenthesisBalance;
+		}
+	}
+
+	// Prepare input
+	InputCursor input( sInput, uResume );
+	const Config& config = *_pConfig;
+
+	// Finite State Machine
+	enum class TokeniserState
+	{
+		NewToken,
+		NumericLiteral,
+		PrefixedNumericLiteral,
+		HexNumericLiteral,
+		BinNumericLiteral,
+		Unit_or_Symbol,
+		Parenthesis_Open,
+		Parenthesis_Close,
+		Separator,
+		Operator,
+		CompleteToken,
+	};
+
+	// State
+	TokeniserState stateNow = TokeniserState::NewToken;
+	TokeniserState stateNext = TokeniserState::NewToken;
+	Token tokCurrent;
+	Token tokPrevious = { .pos = uint32_t( input.pos ) };
+	size_t uTokenStart = 0;
+	size_t uTokenLength = 0;
+	bool bDecimalPointFound = false;
+	char charDelimiter = 0;
+	uint64_t uPrefixedValue = 0;
+	bool bFootFound = false;
+
+	// The token so far is the input from its start up to here (plus uExtra characters).
+	auto currentToken = [ & ]( size_t uExtra = 0 )
+	{
+		return svInput.substr( uTokenStart, input.pos - uTokenStart + uExtra );
+	};
+
+	// A token of the text so far.
+	auto makeToken = [ & ]( Token::Type type, double value = 0.0 )
+	{
+		uTokenLength = input.pos - uTokenStart;
+		return Token{ value, uint32_t( uTokenStart ), uint16_t( std::min<size_t>( uTokenLength, UINT16_MAX ) ), type };
+	};
+
+	for ( ; ; )
+	{
+		char charNow = input.Peek();
+
+		switch ( stateNow )
+		{
+
+		case TokeniserState::NewToken:
+			{
+				uTokenStart = input.pos;
+				bDecimalPointFound = false;
+				charDelimiter = 0;
+				uPrefixedValue = 0;
+				tokCurrent = { .pos = uint32_t( input.pos ) };
+				uTokenLength = 0;
+
+				//
 				// -- First Character Analysis
 
 				// End of input?
@@ -376,7 +1020,7 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 				{
 					if ( uParenthesisBalance != 0 )
 					{
-						throw CompilerError( CompilerError::Stage::Parser, "Parenthesis '(' & ')' not balanced" );
+						return { ErrorCode::UnbalancedParenthesis, input.pos };
 					}
 
 #if DEBUG_OUTPUT_TOKENS
@@ -384,19 +1028,19 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 					std::cout << "\n-------- Tokens ------------\n";
 					for ( const auto& token : vecOutputTokens )
 					{
-						std::cout << token.str() << "\n";
+						std::cout << token.str( svInput ) << "\n";
 					}
 					std::cout << "----------------------------\n\n";
 #endif // DEBUG_OUTPUT_TOKENS
 
-					return vecOutputTokens;
+					return {};
 				}
 
 				// White space?
 				else if ( gWhitespaceDigits.at( charNow ) )
 				{
 					// Just consume, do nothing
-					NextInput();
+					input.Next();
 					stateNext = TokeniserState::NewToken;
 				}
 
@@ -404,8 +1048,6 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 				else if ( gFirstNumericDigits.at( charNow ) )
 				{
 					// A numeric literal has been found
-					sCurrentToken = charNow;
-
 					if ( charNow == '0' )
 					{
 						// Hex (0x) or Binary (0b) maybe?
@@ -417,7 +1059,7 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 						stateNext = TokeniserState::NumericLiteral;
 					}
 
-					NextInput();
+					input.Next();
 
 					bDecimalPointFound = false;
 				}
@@ -440,17 +1082,22 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 					stateNext = TokeniserState::Parenthesis_Close;
 				}
 
-				// Unknown - presumably a symbol
-				else if ( gUnitDigits.at( charNow ) )
+				// Separator of function arguments (not ',', which is a decimal point)
+				else if ( charNow == ';' )
 				{
-					sCurrentToken = charNow;
-					NextInput();
+					stateNext = TokeniserState::Separator;
+				}
+
+				// Unknown - presumably a unit or a symbol
+				else if ( gUnitDigits.at( charNow ) || gFirstSymbolDigits.at( charNow ) )
+				{
+					input.Next();
 					stateNext = TokeniserState::Unit_or_Symbol;
 				}
 
 				else
 				{
-					throw CompilerError( CompilerError::Stage::Parser, "Unknown character '" + std::string( 1, charNow ) + "'" );
+					return { ErrorCode::UnknownCharacter, input.pos, svInput.substr( input.pos, 1 ) };
 				}
 
 
@@ -459,33 +1106,36 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 
 		case TokeniserState::NumericLiteral:
 			{
-				if ( gAdditionalNumericDigits.at( charNow ) || ( charNow == _localeDecimalPoint ) )
+				if ( gAdditionalNumericDigits.at( charNow ) || ( charNow == config._localeDecimalPoint ) )
 				{
 					if ( gFirstNumericDigits.at( charNow ) == false ) // If it's in Additional and not in First, it's a delimiter.
 					{
-						charNow = _localeDecimalPoint; // but ensure it's the kind that our locale / std::stod wants
-
 						if ( bDecimalPointFound )
 						{
 							// Error ! we can only have one
-							throw CompilerError( CompilerError::Stage::Parser, "Bad numeric construction" );
+							return { ErrorCode::BadNumericConstruction, uTokenStart, currentToken( 1 ) };
 						}
 						else
 						{
-							// We allow one
+							// We allow one, and ParseDecimalLiteral reads it as the decimal point
 							bDecimalPointFound = true;
+							charDelimiter = charNow;
 						}
 					}
 
-					sCurrentToken += charNow;
-					NextInput();
+					input.Next();
 					stateNext = TokeniserState::NumericLiteral;
 				}
 				else
 				{
 					// Anything else found indicates the end of this numeric literal.
 
-					tokCurrent = { uTokenStart, Token::Type::Literal_Numeric, sCurrentToken, std::stod( sCurrentToken ) };
+					tokCurrent = makeToken( Token::Type::Literal_Numeric );
+
+					if ( !ParseDecimalLiteral( currentToken(), charDelimiter, tokCurrent.value ) )
+					{
+						return { ErrorCode::BadNumericConstruction, uTokenStart, currentToken() };
+					}
 
 					stateNext = TokeniserState::CompleteToken; // check for implied addition.
 				}
@@ -497,18 +1147,14 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 				if ( charNow == 'x' || charNow == 'X' )
 				{
 					// Hexadecimal
-					sCurrentToken += charNow;
-					sPrefixedNumericLiteralToken.clear();
-					NextInput();
+					input.Next();
 					stateNext = TokeniserState::HexNumericLiteral;
 				}
 
 				else if ( charNow == 'b' || charNow == 'B' )
 				{
 					// Binary
-					sCurrentToken += charNow;
-					sPrefixedNumericLiteralToken.clear();
-					NextInput();
+					input.Next();
 					stateNext = TokeniserState::BinNumericLiteral;
 				}
 
@@ -524,21 +1170,25 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 			{
 				if ( gAllowedHexDigits.at( charNow ) )
 				{
-					sCurrentToken += charNow;
-					sPrefixedNumericLiteralToken += charNow;
-					NextInput();
+					// the digits go straight into an integer, as long as it can hold them
+					if ( uPrefixedValue >> ( 64 - 4 ) )
+					{
+						return { ErrorCode::InvalidPrefixedLiteral, uTokenStart, currentToken( 1 ) };
+					}
+
+					uPrefixedValue = ( uPrefixedValue << 4 ) | gDigitValues[ uint8_t( charNow ) ];
+					input.Next();
 					stateNext = TokeniserState::HexNumericLiteral;
 				}
-				else if ( sPrefixedNumericLiteralToken.empty() )
+				else if ( currentToken().size() == 2 ) // only the prefix
 				{
-					throw CompilerError( CompilerError::Stage::Parser, "Invalid prefixed numeric literal" );
+					return { ErrorCode::InvalidPrefixedLiteral, uTokenStart, currentToken() };
 				}
 				else
 				{
 					// Don't consume, something else might use this
 					stateNext = TokeniserState::CompleteToken;
-					tokCurrent = { uTokenStart, Token::Type::Literal_Numeric, sCurrentToken };
-					tokCurrent.value = double( std::stoll( sPrefixedNumericLiteralToken, nullptr, 16 ) );
+					tokCurrent = makeToken( Token::Type::Literal_Numeric, double( uPrefixedValue ) );
 				}
 			}
 			break;
@@ -547,21 +1197,25 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 			{
 				if ( gAllowedBinaryDigits.at( charNow ) )
 				{
-					sCurrentToken += charNow;
-					sPrefixedNumericLiteralToken += charNow;
-					NextInput();
+					// the digits go straight into an integer, as long as it can hold them
+					if ( uPrefixedValue >> ( 64 - 1 ) )
+					{
+						return { ErrorCode::InvalidPrefixedLiteral, uTokenStart, currentToken( 1 ) };
+					}
+
+					uPrefixedValue = ( uPrefixedValue << 1 ) | gDigitValues[ uint8_t( charNow ) ];
+					input.Next();
 					stateNext = TokeniserState::BinNumericLiteral;
 				}
-				else if ( sPrefixedNumericLiteralToken.empty() )
+				else if ( currentToken().size() == 2 ) // only the prefix
 				{
-					throw CompilerError( CompilerError::Stage::Parser, "Invalid prefixed numeric literal" );
+					return { ErrorCode::InvalidPrefixedLiteral, uTokenStart, currentToken() };
 				}
 				else
 				{
 					// Don't consume, something else might use this
 					stateNext = TokeniserState::CompleteToken;
-					tokCurrent = { uTokenStart, Token::Type::Literal_Numeric, sCurrentToken };
-					tokCurrent.value = double( std::stoll( sPrefixedNumericLiteralToken, nullptr, 2 ) );
+					tokCurrent = makeToken( Token::Type::Literal_Numeric, double( uPrefixedValue ) );
 				}
 			}
 			break;
@@ -572,26 +1226,25 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 				if ( gOperatorDigits.at( charNow ) )
 				{
 					// If we hypothetically continue to grow the operator, is it still valid?
-					if ( _mapOperators.contains( sCurrentToken + charNow ) )
+					if ( FindOperator( currentToken( 1 ) ) != OperatorType::None )
 					{
 						// YES - keep going, nom nom nom
-						sCurrentToken += charNow;
-						NextInput();
+						input.Next();
 					}
 					else
 					{
 						// NO - uhm, is what we have already a valid operator?!
-						if ( _mapOperators.contains( sCurrentToken ) )
+						if ( const auto op = FindOperator( currentToken() ); op != OperatorType::None )
 						{
 							// YES - bank it, we're done.
-							tokCurrent = { uTokenStart, Token::Type::Operator, sCurrentToken };
+							tokCurrent = makeToken( Token::Type::Operator );
+							tokCurrent.SetOp( op );
 							stateNext = TokeniserState::CompleteToken;
 						}
 						else
 						{
 							// NO - current operator is invalid, BUT it might be later.
-							sCurrentToken += charNow;
-							NextInput();
+							input.Next();
 						}
 					}
 				}
@@ -599,14 +1252,15 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 				{
 					// We've left the valid operator alphabet now.
 					// Let's check what we have accumulated.
-					if ( _mapOperators.contains( sCurrentToken ) )
+					if ( const auto op = FindOperator( currentToken() ); op != OperatorType::None )
 					{
-						tokCurrent = { uTokenStart, Token::Type::Operator, sCurrentToken };
+						tokCurrent = makeToken( Token::Type::Operator );
+						tokCurrent.SetOp( op );
 						stateNext = TokeniserState::CompleteToken;
 					}
 					else
 					{
-						throw CompilerError( CompilerError::Stage::Parser, "Unknown operator: " + sCurrentToken );
+						return { ErrorCode::UnknownOperator, uTokenStart, currentToken() };
 					}
 				}
 			}
@@ -614,21 +1268,29 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 
 		case TokeniserState::Unit_or_Symbol:
 			{
-				if ( gUnitDigits.at( charNow ) )
+				// symbol names may continue with digits, units (like ' and ") may not.
+				if ( gUnitDigits.at( charNow )
+					 || ( gAdditionalSymbolDigits.at( charNow ) && gFirstSymbolDigits.at( uint8_t( svInput[ uTokenStart ] ) ) ) )
 				{
-					sCurrentToken += charNow;
-					NextInput();
+					input.Next();
 				}
 				else
 				{
-					if ( _mapUnits.contains( sCurrentToken ) )
+					// a unit, if the current system has it
+					if ( const auto id = FindUnit( currentToken() ); config._pUnitSystem->units[ size_t( id ) ].scale != 0.0 )
+					{
+						tokCurrent = makeToken( Token::Type::Unit );
+						tokCurrent.value = config._pUnitSystem->units[ size_t( id ) ].scale;
+						tokCurrent.SetUnitID( id );
+					}
+					else if ( const auto op = FindOperator( currentToken() ); op != OperatorType::None )
 					{
-						tokCurrent = { uTokenStart, Token::Type::Unit, sCurrentToken };
-						tokCurrent.value = _mapUnits[ sCurrentToken ].scale;
+						tokCurrent = makeToken( Token::Type::Function );
+						tokCurrent.SetOp( op );
 					}
 					else
 					{
-						tokCurrent = { uTokenStart, Token::Type::Symbol, sCurrentToken };
+						tokCurrent = makeToken( Token::Type::Symbol );
 					}
 
 					stateNext = TokeniserState::CompleteToken;
@@ -638,10 +1300,9 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 
 		case TokeniserState::Parenthesis_Open:
 			{
-				sCurrentToken += charNow;
-				NextInput();
+				input.Next();
 				++uParenthesisBalance;
-				tokCurrent = { uTokenStart, Token::Type::Parenthesis_Open, sCurrentToken };
+				tokCurrent = makeToken( Token::Type::Parenthesis_Open );
 				stateNext = TokeniserState::CompleteToken;
 			}
 			break;
@@ -650,19 +1311,32 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 			{
 				if ( uParenthesisBalance == 0 )
 				{
-					throw CompilerError( CompilerError::Stage::Parser, "Parenthesis '(' & ')' not balanced" );
+					return { ErrorCode::UnbalancedParenthesis, input.pos, svInput.substr( input.pos, 1 ) };
 				}
 
-				sCurrentToken += charNow;
+				input.Next();
 				--uParenthesisBalance;
-				tokCurrent = { uTokenStart, Token::Type::Parenthesis_Close, sCurrentToken };
-				NextInput();
+				tokCurrent = makeToken( Token::Type::Parenthesis_Close );
+				stateNext = TokeniserState::CompleteToken;
+			}
+			break;
+
+		case TokeniserState::Separator:
+			{
+				input.Next();
+				tokCurrent = makeToken( Token::Type::Separator );
 				stateNext = TokeniserState::CompleteToken;
 			}
 			break;
 
 		case TokeniserState::CompleteToken:
 			{
+				// a token's length is held in 16 bits
+				if ( uTokenLength > UINT16_MAX )
+				{
+					return { ErrorCode::UnsupportedToken, tokCurrent.pos, svInput.substr( tokCurrent.pos, uTokenLength ) };
+				}
+
 				// Emit token
 				vecOutputTokens.push_back( tokCurrent );
 				tokPrevious = tokCurrent;
@@ -677,534 +1351,1674 @@ std::vector<Numeric::Token> Numeric::Compiler::Parse( const std::string& sInput
 	}; // for ( ; ; )
 }
 
-Numeric::Solution Numeric::Compiler::Solve( const std::vector<Token>& vTokens, const Solution* pPrevSolution )
+Numeric::Solution Numeric::Compiler::Solve( const TokenList& vTokens, const Solution* pPrevSolution )
 {
-	// Solve like a calculator the stream of parsed tokens, using the Shunting Yard Algorithm
-	std::deque<Token> stkHolding;
-	std::deque<Token> stkOutput;
+	auto result = TrySolve( vTokens, pPrevSolution );
 
-	Token tokPrevious = { 0, Token::Type::Literal_Numeric };
-	int pass = 0;
-	bool bExplicitUnits = false;
+	if ( result.error )
+	{
+		throw CompilerError( result.error );
+	}
 
-	for ( const auto& token : vTokens )
+	return result.value;
+}
+
+Numeric::Result<Numeric::Solution> Numeric::Compiler::TrySolve( const TokenList& vTokens, const Solution* pPrevSolution )
+{
+	// Compile, then run once
+	if ( const Error error = CompileInto( vTokens, _scratchExpression ) )
 	{
-#if DEBUG_OUTPUT_RPN_EXTRA
-		// verbose debug of reverse-polish notation
-		std::cout << "-------- next token --------\n";
-		std::cout << token.str() << "\n";
-		std::cout << "-------- RPN (holding) -----\n";
-		for ( const auto& s : stkHolding )
-		{
-			std::cout << s.str() << "\n";
-		}
-		std::cout << "-------- RPN (output) ------\n";
-		for ( const auto& s : stkOutput )
+		return { {}, error };
+	}
+
+	return _scratchExpression.TryEval( pPrevSolution );
+}
+
+Numeric::CompiledExpression Numeric::Compiler::Compile( const TokenList& vTokens )
+{
+	CompiledExpression expr;
+
+	if ( const Error error = CompileInto( vTokens, expr ) )
+	{
+		throw CompilerError( error );
+	}
+
+	return expr;
+}
+
+Numeric::Error Numeric::Compiler::CompileInto( const TokenList& vTokens, CompiledExpression& expr )
+{
+	// Order the stream of parsed tokens like a calculator, using the Shunting Yard Algorithm,
+	// emitting the bytecode for each token as it leaves for the output. The holding stack's
+	// top is its back.
+	auto& stkHolding = _stkHolding;
+	auto& stkCalls = _stkCalls;
+	auto& stkDimensions = _stkDimensions;
+
+	stkHolding.clear();
+	stkCalls.clear();
+	stkDimensions.clear();
+
+	expr._code.clear();
+	expr._literals.clear();
+	expr._units.clear();
+	expr._maxDepth = 0;
+	expr._symbolSlots = 0;
+	expr._desiredUnitType = _pConfig->_desiredUnitType;
+	expr._dimension = Dimension::Unknown;
+
+	// Track the stack as the solver would use it. Errors found here are held back until the
+	// whole input has been ordered, so that those in the ordering are reported first.
+	size_t depth = 0;
+	Error emitError;
+
+	// exact values for the literals and units too (see SetExactImperial)
+	const bool bExact = _pConfig->_exactImperial && _pConfig->_desiredUnitType == UnitType::Imperial;
+
+	// and the Dimension of each value on it (see SetDimensionChecking)
+	const bool bDimensions = _pConfig->_dimensionChecking;
+
+	auto emit = [ & ]( const Token& inst )
+	{
+#if DEBUG_OUTPUT_RPN
+		// debug reverse-polish notation
+		std::cout << "RPN: " << inst.str( vTokens.input ) << "\n";
+#endif // DEBUG_OUTPUT_RPN
+
+		if ( emitError )
 		{
-			std::cout << s.str() << "\n";
+			return;
 		}
-		std::cout << "----------------------------\n\n";
-#endif // DEBUG_OUTPUT_RPN_EXTRA
 
-		if ( token.type == Token::Type::Literal_Numeric )
+		switch ( inst.type )
 		{
-			// Push literals straight to output, they are already in order
-			stkOutput.push_back( token );
-			tokPrevious = stkOutput.back();
-		}
-		else if ( token.type == Token::Type::Parenthesis_Open )
+		case Token::Type::Literal_Numeric:
+			{
+				expr._code.push_back( { CompiledExpression::OpCode::Literal, uint32_t( expr._literals.size() ) } );
+				expr._literals.push_back( { inst.value, { 1.0, UnitType::Generic }, bExact ? ExactLiteral( vTokens.Text( inst ), inst.value ) : math::Rational{} } );
+
+				if ( bDimensions )
+				{
+					stkDimensions.push_back( Dimension::Unitless );
+				}
+
+				++depth;
+			}
+			break;
+
+		case Token::Type::Symbol:
+			{
+				const Config::Symbol& symbol = _pConfig->_mapSymbols.find( vTokens.Text( inst ) )->second;
+
+				expr._code.push_back( { CompiledExpression::OpCode::Symbol, symbol.slot } );
+				expr._symbolSlots = std::max( expr._symbolSlots, size_t( symbol.slot ) + 1 );
+
+				if ( bDimensions )
+				{
+					stkDimensions.push_back( symbol.dimension );
+				}
+
+				++depth;
+			}
+			break;
+
+		case Token::Type::Unit:
+			{
+				if ( depth == 0 )
+				{
+					emitError = { ErrorCode::MalformedExpression, inst.pos, vTokens.Text( inst ) };
+					return;
+				}
+
+				// units go on a plain number
+				if ( bDimensions )
+				{
+					if ( stkDimensions.back() != Dimension::Unitless && stkDimensions.back() != Dimension::Unknown )
+					{
+						emitError = { ErrorCode::DimensionMismatch, inst.pos, vTokens.Text( inst ) };
+						return;
+					}
+
+					stkDimensions.back() = Dimension::Length;
+				}
+
+				expr._code.push_back( { CompiledExpression::OpCode::Unit, uint32_t( expr._units.size() ) } );
+				expr._units.push_back( { inst.value, _pConfig->_pUnitSystem->units[ size_t( inst.UnitID() ) ], bExact ? _imperialExactScales[ size_t( inst.UnitID() ) ] : math::Rational{} } );
+			}
+			break;
+
+		case Token::Type::Operator:
+		case Token::Type::Function:
+			{
+				const auto& op = GetOperator( inst.Op() );
+
+				if ( depth < size_t( op.arguments ) )
+				{
+					emitError = { ErrorCode::MalformedExpression, inst.pos, vTokens.Text( inst ) };
+					return;
+				}
+
+				CompiledExpression::OpCode code;
+
+				switch ( inst.Op() )
+				{
+				case OperatorType::Divide:		code = CompiledExpression::OpCode::Divide; break;
+				case OperatorType::Multiply:	code = CompiledExpression::OpCode::Multiply; break;
+				case OperatorType::Add:			code = CompiledExpression::OpCode::Add; break;
+				case OperatorType::Subtract:	code = CompiledExpression::OpCode::Subtract; break;
+				case OperatorType::UnaryPlus:	code = CompiledExpression::OpCode::UnaryPlus; break;
+				case OperatorType::UnaryMinus:	code = CompiledExpression::OpCode::UnaryMinus; break;
+				case OperatorType::Power:		code = CompiledExpression::OpCode::Power; break;
+				case OperatorType::Percent:		code = CompiledExpression::OpCode::Percent; break;
+				case OperatorType::Min:			code = CompiledExpression::OpCode::Min; break;
+				case OperatorType::Max:			code = CompiledExpression::OpCode::Max; break;
+				case OperatorType::Round:		code = CompiledExpression::OpCode::Round; break;
+				case OperatorType::Sqrt:		code = CompiledExpression::OpCode::Sqrt; break;
+				default:
+					emitError = { ErrorCode::UnexpectedToken, inst.pos, vTokens.Text( inst ) };
+					return;
+				}
+
+				if ( bDimensions )
+				{
+					const Dimension rhs = ( op.arguments == 2 ) ? stkDimensions.back() : Dimension::Unknown;
+					if ( op.arguments == 2 )
+					{
+						stkDimensions.pop_back();
+					}
+
+					// an exponent that is the code just emitted, a literal, is known now
+					const CompiledExpression::Instruction& last = expr._code.back();
+					const double* pExponent = ( last.op == CompiledExpression::OpCode::Literal ) ? &expr._literals[ last.operand ].value : nullptr;
+
+					if ( !CombineDimensions( inst.Op(), stkDimensions.back(), rhs, pExponent, stkDimensions.back() ) )
+					{
+						emitError = { ErrorCode::DimensionMismatch, inst.pos, vTokens.Text( inst ) };
+						return;
+					}
+				}
+
+				expr._code.push_back( { code } );
+
+				depth = depth - op.arguments + 1;
+			}
+			break;
+
+		default:
+			emitError = { ErrorCode::UnexpectedToken, inst.pos, vTokens.Text( inst ) };
+			return;
+		}
+
+		expr._maxDepth = std::max( expr._maxDepth, depth );
+	};
+
+	Token tokPrevious = { .type = Token::Type::Literal_Numeric };
+	int pass = 0;
+	bool bExplicitUnits = false;
+	bool bReadsPrevious = false;
+
+	for ( const auto& token : vTokens )
+	{
+#if DEBUG_OUTPUT_RPN_EXTRA
+		// verbose debug of reverse-polish notation
+		std::cout << "-------- next token --------\n";
+		std::cout << token.str( vTokens.input ) << "\n";
+		std::cout << "-------- RPN (holding) -----\n";
+		for ( auto it = stkHolding.rbegin(); it != stkHolding.rend(); ++it )
+		{
+			std::cout << it->str( vTokens.input ) << "\n";
+		}
+		std::cout << "-------- RPN (output) ------\n";
+		std::cout << expr._code.size() << " instructions, depth " << depth << "\n";
+		std::cout << "----------------------------\n\n";
+#endif // DEBUG_OUTPUT_RPN_EXTRA
+
+		// A function's arguments must follow it
+		if ( tokPrevious.type == Token::Type::Function && token.type != Token::Type::Parenthesis_Open )
+		{
+			return { ErrorCode::BadArguments, tokPrevious.pos, vTokens.Text( tokPrevious ) };
+		}
+
+		if ( token.type == Token::Type::Literal_Numeric )
+		{
+			// Literals go straight to output, they are already in order
+			emit( token );
+			tokPrevious = token;
+		}
+		else if ( token.type == Token::Type::Parenthesis_Open )
+		{
+			// Push to holding stack, it acts as a stopper when we back track. One opening a
+			// function's arguments carries the function, and its call is tracked.
+			stkHolding.push_back( token );
+
+			if ( tokPrevious.type == Token::Type::Function )
+			{
+				stkHolding.back().SetOp( tokPrevious.Op() );
+				stkCalls.push_back( { depth, 0 } );
+			}
+
+			tokPrevious = stkHolding.back();
+		}
+		else if ( token.type == Token::Type::Separator )
+		{
+			// Back-flush holding stack into output until the call's open parenthesis
+			while ( !stkHolding.empty() && stkHolding.back().type != Token::Type::Parenthesis_Open )
+			{
+				emit( stkHolding.back() );
+				stkHolding.pop_back();
+			}
+
+			if ( stkHolding.empty() || stkHolding.back().Op() == OperatorType::None )
+			{
+				return { ErrorCode::UnexpectedToken, token.pos, vTokens.Text( token ) };
+			}
+
+			// each argument leaves one value
+			auto& call = stkCalls.back();
+			++call.arguments;
+
+			if ( !emitError && depth != call.depth + call.arguments )
+			{
+				const Token& tokFunction = stkHolding[ stkHolding.size() - 2 ];
+				return { ErrorCode::BadArguments, tokFunction.pos, vTokens.Text( tokFunction ) };
+			}
+
+			tokPrevious = token;
+		}
+		else if ( token.type == Token::Type::Parenthesis_Close )
+		{
+			// Check something is actually wrapped by parenthesis
+			if ( stkHolding.empty() )
+			{
+				return { ErrorCode::UnexpectedCloseParenthesis, token.pos, vTokens.Text( token ) };
+			}
+
+			// Back-flush holding stack into output until open parenthesis
+			while ( !stkHolding.empty() && stkHolding.back().type != Token::Type::Parenthesis_Open )
+			{
+				emit( stkHolding.back() );
+				stkHolding.pop_back();
+			}
+
+			// Check if open parenthesis was actually found
+			if ( stkHolding.empty() )
+			{
+				return { ErrorCode::NoOpenParenthesis, token.pos, vTokens.Text( token ) };
+			}
+
+			// Remove corresponding open parenthesis from holding stack
+			const OperatorType function = stkHolding.back().Op();
+			stkHolding.pop_back();
+
+			// then a function call is complete: it follows its arguments to output
+			if ( function != OperatorType::None )
+			{
+				const CallFrame call = stkCalls.back();
+				stkCalls.pop_back();
+
+				const uint32_t uArguments = call.arguments + 1;
+
+				if ( !emitError && ( depth != call.depth + uArguments || uArguments != uint32_t( GetOperator( function ).arguments ) ) )
+				{
+					return { ErrorCode::BadArguments, stkHolding.back().pos, vTokens.Text( stkHolding.back() ) };
+				}
+
+				emit( stkHolding.back() );
+				stkHolding.pop_back();
+			}
+
+			tokPrevious = { .type = Token::Type::Parenthesis_Close };
+		}
+
+		else if ( token.type == Token::Type::Symbol )
+		{
+			// Symbols stand in for values, so they go straight to output like literals
+			if ( !_pConfig->_mapSymbols.contains( vTokens.Text( token ) ) )
+			{
+				return { ErrorCode::UnknownSymbol, token.pos, vTokens.Text( token ) };
+			}
+
+			emit( token );
+			tokPrevious = token;
+		}
+
+		else if ( token.type == Token::Type::Unit )
+		{
+			bExplicitUnits = true; // units were specified
+
+			// Units go straight to output, they are already in order
+			emit( token );
+			tokPrevious = token;
+		}
+
+		else if ( token.type == Token::Type::Function )
+		{
+			// Waits under its open parenthesis until the arguments are done
+			stkHolding.push_back( token );
+			tokPrevious = token;
+		}
+
+		else if ( token.type == Token::Type::Operator && token.Op() == OperatorType::Percent )
+		{
+			// Postfix, on the value before it, so it goes straight to output like a unit. The
+			// result has the previous solution's units.
+			bExplicitUnits = true;
+			bReadsPrevious = true;
+
+			emit( token );
+			tokPrevious = token;
+		}
+
+		else if ( token.type == Token::Type::Operator )
+		{
+			// Unit_or_Symbol is operator
+			Token tokOperator = token;
+
+			// Unary Operator check
+			if ( token.Op() == OperatorType::Subtract || token.Op() == OperatorType::Add )
+			{
+				if ( ( tokPrevious.type != Token::Type::Literal_Numeric
+					   && tokPrevious.type != Token::Type::Symbol
+					   && tokPrevious.type != Token::Type::Unit
+					   && tokPrevious.type != Token::Type::Parenthesis_Close
+					   && tokPrevious.Op() != OperatorType::Percent ) || pass == 0 )
+				{
+					// "Upgrade" operator
+					tokOperator.SetOp( ( token.Op() == OperatorType::Add ) ? OperatorType::UnaryPlus : OperatorType::UnaryMinus );
+				}
+			}
+
+			while ( !stkHolding.empty() && stkHolding.back().type != Token::Type::Parenthesis_Open )
+			{
+				// Ensure holding stack front is an operator (it might not be later...)
+				if ( stkHolding.back().type == Token::Type::Operator )
+				{
+					const auto& holding_stack_op = GetOperator( stkHolding.back().Op() );
+
+					if ( holding_stack_op.precedence >= GetOperator( tokOperator.Op() ).precedence )
+					{
+						emit( stkHolding.back() );
+						stkHolding.pop_back();
+					}
+					else
+					{
+						break;
+					}
+				}
+			}
+
+			// Push the new operator onto the holding stack
+			stkHolding.push_back( tokOperator );
+			tokPrevious = stkHolding.back();
+		}
+
+		else
+		{
+			return { ErrorCode::UnsupportedToken, token.pos, vTokens.Text( token ) };
+		}
+
+		pass++;
+	}
+
+	if ( tokPrevious.type == Token::Type::Function )
+	{
+		return { ErrorCode::BadArguments, tokPrevious.pos, vTokens.Text( tokPrevious ) };
+	}
+
+	// Drain the holding stack
+	while ( !stkHolding.empty() )
+	{
+		emit( stkHolding.back() );
+		stkHolding.pop_back();
+	}
+
+	if ( emitError )
+	{
+		return emitError;
+	}
+
+	expr._explicitUnits = bExplicitUnits;
+	expr._readsPrevious = bReadsPrevious;
+
+	if ( depth != 1 )
+	{
+
+#if DEBUG_OUTPUT_ERROR
+		std::cout << "Solution  := " << depth << " values\n\n";
+#endif // DEBUG_OUTPUT_ERROR
+
+		return { ErrorCode::IndeterminateExpression };
+	}
+
+	if ( bDimensions )
+	{
+		expr._dimension = stkDimensions.back();
+	}
+
+	expr.Fold();
+
+	return {};
+}
+
+void Numeric::CompiledExpression::Fold()
+{
+	// Constant folding: run the code with a stack that only knows which entries are
+	// constant. An operation on constants is done now, with the solver's own arithmetic,
+	// and its result replaces the literals it used. A constant entry's literal is always
+	// the last code emitted so far (or, for the entry below a constant, the one before).
+	// Folding never grows the code, so it is rewritten in place.
+	bool aLocalConstant[ _localStackSize ];
+	std::vector<char> vLargeConstant;
+
+	bool* stkConstant = aLocalConstant;
+	if ( _maxDepth > _localStackSize )
+	{
+		vLargeConstant.resize( _maxDepth );
+		stkConstant = reinterpret_cast<bool*>( vLargeConstant.data() );
+	}
+
+	size_t depth = 0;
+	size_t uCode = 0;
+	size_t uLiterals = 0;
+
+	_maxDepth = 0;
+
+	for ( size_t i = 0; i < _code.size(); ++i )
+	{
+		const Instruction inst = _code[ i ];
+
+		switch ( inst.op )
+		{
+		case OpCode::Literal:
+			{
+				_literals[ uLiterals ] = _literals[ inst.operand ];
+				_code[ uCode++ ] = { OpCode::Literal, uint32_t( uLiterals++ ) };
+				stkConstant[ depth++ ] = true;
+			}
+			break;
+
+		case OpCode::Symbol:
+			{
+				_code[ uCode++ ] = inst;
+				stkConstant[ depth++ ] = false;
+			}
+			break;
+
+		case OpCode::Unit:
+			{
+				if ( stkConstant[ depth - 1 ] )
+				{
+					// pre-multiply the unit into the literal
+					Solution& mem = _literals[ uLiterals - 1 ];
+
+					mem.value = mem.value * _units[ inst.operand ].value;
+					mem.exact = math::Multiply( mem.exact, _units[ inst.operand ].exact );
+					mem.units = _units[ inst.operand ].unit;
+				}
+				else
+				{
+					_code[ uCode++ ] = inst;
+				}
+			}
+			break;
+
+		case OpCode::UnaryPlus:
+			break;
+
+		case OpCode::UnaryMinus:
+			{
+				if ( stkConstant[ depth - 1 ] )
+				{
+					_literals[ uLiterals - 1 ].value = -_literals[ uLiterals - 1 ].value;
+					_literals[ uLiterals - 1 ].exact = math::Negate( _literals[ uLiterals - 1 ].exact );
+				}
+				else
+				{
+					_code[ uCode++ ] = inst;
+				}
+			}
+			break;
+
+		case OpCode::Round:
+		case OpCode::Sqrt:
+			{
+				if ( stkConstant[ depth - 1 ] )
+				{
+					SolveUnary( inst.op, _literals[ uLiterals - 1 ] );
+				}
+				else
+				{
+					_code[ uCode++ ] = inst;
+				}
+			}
+			break;
+
+		case OpCode::Percent:
+			{
+				// reads the previous solution, so is never constant
+				_code[ uCode++ ] = inst;
+				stkConstant[ depth - 1 ] = false;
+			}
+			break;
+
+		default:
+			{
+				const bool bConstant = stkConstant[ depth - 1 ] && stkConstant[ depth - 2 ];
+
+				if ( bConstant )
+				{
+					--uCode;
+					--uLiterals;
+
+					_literals[ uLiterals - 1 ] = SolveBinary( inst.op, _literals[ uLiterals - 1 ], _literals[ uLiterals ], _desiredUnitType );
+				}
+				else
+				{
+					_code[ uCode++ ] = inst;
+				}
+
+				--depth;
+				stkConstant[ depth - 1 ] = bConstant;
+			}
+			break;
+		}
+
+		_maxDepth = std::max( _maxDepth, depth );
+	}
+
+	_code.resize( uCode );
+	_literals.resize( uLiterals );
+}
+
+void Numeric::CompiledExpression::SolveUnary( OpCode op, Solution& mem )
+{
+	// Round and Sqrt, on the value in its own units: round( 2.6in ) is 3in
+	const double value = mem.value / mem.units.scale;
+
+	if ( op == OpCode::Round )
+	{
+		mem.value = std::round( value ) * mem.units.scale;
+
+		if ( mem.exact.Exact() )
+		{
+			const math::Rational scale = Compiler::ExactScale( mem.units.scale );
+			mem.exact = math::Multiply( math::RoundRational( math::Divide( mem.exact, scale ) ), scale );
+		}
+	}
+	else // OpCode::Sqrt
+	{
+		mem.value = std::sqrt( value ) * mem.units.scale;
+		mem.exact = {};
+	}
+}
+
+Numeric::Solution Numeric::CompiledExpression::Eval( const Solution* pPrevSolution, const Solution* pSymbolValues ) const
+{
+	auto result = TryEval( pPrevSolution, pSymbolValues );
+
+	if ( result.error )
+	{
+		throw CompilerError( result.error );
+	}
+
+	return result.value;
+}
+
+inline void Numeric::CompiledExpression::Step( const Instruction& inst, Solution* stkSolve, size_t& depth, bool& bExplicitUnits, const Solution* pPrevSolution, const Solution* pSymbolValues, UnitType desiredUnitType ) const
+{
+	switch ( inst.op )
+	{
+	case OpCode::Literal:
+		{
+			stkSolve[ depth++ ] = _literals[ inst.operand ];
+		}
+		break;
+
+	case OpCode::Symbol:
+		{
+			const Solution& value = pSymbolValues[ inst.operand ];
+
+			bExplicitUnits |= value.units.type != UnitType::Generic;
+			stkSolve[ depth++ ] = value;
+		}
+		break;
+
+	case OpCode::Unit:
+		{
+			Solution& mem = stkSolve[ depth - 1 ];
+
+			mem.value = mem.value * _units[ inst.operand ].value;
+			mem.exact = math::Multiply( mem.exact, _units[ inst.operand ].exact );
+			mem.units = _units[ inst.operand ].unit;
+		}
+		break;
+
+	case OpCode::UnaryPlus:
+		break;
+
+	case OpCode::UnaryMinus:
+		{
+			Solution& mem = stkSolve[ depth - 1 ];
+
+			mem.value = -mem.value;
+			mem.exact = math::Negate( mem.exact );
+		}
+		break;
+
+	case OpCode::Round:
+	case OpCode::Sqrt:
+		{
+			SolveUnary( inst.op, stkSolve[ depth - 1 ] );
+		}
+		break;
+
+	case OpCode::Percent:
+		{
+			Solution& mem = stkSolve[ depth - 1 ];
+
+			mem.value = ( mem.value / mem.units.scale ) / 100.0 * pPrevSolution->value;
+
+			if ( mem.exact.Exact() )
+			{
+				const math::Rational percent = math::Divide( mem.exact, Compiler::ExactScale( mem.units.scale ) );
+				mem.exact = math::Multiply( math::Divide( percent, { 100, 1 } ), pPrevSolution->exact );
+			}
+
+			mem.units = pPrevSolution->units;
+		}
+		break;
+
+	default:
+		{
+			// binary: the top of the stack is the right hand side.
+			stkSolve[ depth - 2 ] = SolveBinary( inst.op, stkSolve[ depth - 2 ], stkSolve[ depth - 1 ], desiredUnitType );
+			--depth;
+		}
+		break;
+	}
+}
+
+Numeric::Result<Numeric::Solution> Numeric::CompiledExpression::TryEval( const Solution* pPrevSolution, const Solution* pSymbolValues ) const
+{
+	if ( _symbolSlots > 0 && pSymbolValues == nullptr )
+	{
+		return { {}, { ErrorCode::NoSymbolValues } };
+	}
+
+	if ( _readsPrevious && pPrevSolution == nullptr )
+	{
+		return { {}, { ErrorCode::NoPreviousValue } };
+	}
+
+	// Units are explicit if the expression gave any, or any symbol it read carries them.
+	bool bExplicitUnits = _explicitUnits;
+
+	// Solver (Almost identical to video 1), on a stack of values that grows upward.
+	Solution aLocalStack[ _localStackSize ];
+	std::vector<Solution> vLargeStack;
+
+	Solution* stkSolve = aLocalStack;
+	if ( _maxDepth > _localStackSize )
+	{
+		vLargeStack.resize( _maxDepth );
+		stkSolve = vLargeStack.data();
+	}
+
+	size_t depth = 0;
+
+	for ( const auto& inst : _code )
+	{
+		Step( inst, stkSolve, depth, bExplicitUnits, pPrevSolution, pSymbolValues, _desiredUnitType );
+	}
+
+	Solution result = stkSolve[ 0 ];
+
+	Finish( result, bExplicitUnits, pPrevSolution, _desiredUnitType );
+
+	return { result };
+}
+
+void Numeric::CompiledExpression::EvalBatch( const Solution* pPrevSolution, const SymbolColumn* pColumns, size_t uRows, Solution* pOutput ) const
+{
+	if ( _symbolSlots > 0 && pColumns == nullptr )
+	{
+		throw CompilerError( { ErrorCode::NoSymbolValues } );
+	}
+
+	if ( _readsPrevious && pPrevSolution == nullptr )
+	{
+		throw CompilerError( { ErrorCode::NoPreviousValue } );
+	}
+
+	// The same solver as Eval, but each stack entry is a block of row values. Units never
+	// depend on the values, so each entry has one set of units for the whole block.
+	std::vector<double> vValues( _maxDepth * _batchBlockSize );
+	std::vector<Unit> vUnits( _maxDepth );
+
+	for ( size_t uFirst = 0; uFirst < uRows; uFirst += _batchBlockSize )
+	{
+		const size_t n = std::min( _batchBlockSize, uRows - uFirst );
+
+		bool bExplicitUnits = _explicitUnits;
+		size_t depth = 0;
+
+		for ( const auto& inst : _code )
+		{
+			// values of stack entry e are at vValues[ e * _batchBlockSize ]
+			double* pNew = vValues.data() + depth * _batchBlockSize;
+			double* pTop = pNew - ( depth > 0 ? _batchBlockSize : 0 );
+
+			switch ( inst.op )
+			{
+			case OpCode::Literal:
+				{
+					const Solution& literal = _literals[ inst.operand ];
+
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pNew[ i ] = literal.value;
+					}
+
+					vUnits[ depth++ ] = literal.units;
+				}
+				break;
+
+			case OpCode::Symbol:
+				{
+					const SymbolColumn& column = pColumns[ inst.operand ];
+					const double* pValues = column.pValues + uFirst;
+
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pNew[ i ] = pValues[ i ];
+					}
+
+					bExplicitUnits |= column.units.type != UnitType::Generic;
+					vUnits[ depth++ ] = column.units;
+				}
+				break;
+
+			case OpCode::Unit:
+				{
+					const double value = _units[ inst.operand ].value;
+
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pTop[ i ] = pTop[ i ] * value;
+					}
+
+					vUnits[ depth - 1 ] = _units[ inst.operand ].unit;
+				}
+				break;
+
+			case OpCode::UnaryPlus:
+				break;
+
+			case OpCode::UnaryMinus:
+				{
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pTop[ i ] = -pTop[ i ];
+					}
+				}
+				break;
+
+			case OpCode::Round:
+				{
+					// as SolveUnary, in the entry's own units
+					const double scale = vUnits[ depth - 1 ].scale;
+
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pTop[ i ] = std::round( pTop[ i ] / scale ) * scale;
+					}
+				}
+				break;
+
+			case OpCode::Sqrt:
+				{
+					const double scale = vUnits[ depth - 1 ].scale;
+
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pTop[ i ] = std::sqrt( pTop[ i ] / scale ) * scale;
+					}
+				}
+				break;
+
+			case OpCode::Percent:
+				{
+					const double scale = vUnits[ depth - 1 ].scale;
+					const double previous = pPrevSolution->value;
+
+					for ( size_t i = 0; i < n; ++i )
+					{
+						pTop[ i ] = ( pTop[ i ] / scale ) / 100.0 * previous;
+					}
+
+					vUnits[ depth - 1 ] = pPrevSolution->units;
+				}
+				break;
+
+			default:
+				{
+					// binary: p0 and u0 are the right hand side, p1 and u1 the left (and the result).
+					const double* p0 = pTop;
+					double* p1 = pTop - _batchBlockSize;
+					const Unit u0 = vUnits[ depth - 1 ];
+					const Unit u1 = vUnits[ depth - 2 ];
+					const double s0 = u0.scale;
+					const double s1 = u1.scale;
+
+					Unit units = { 1.0, UnitType::Generic };
+
+					if ( inst.op == OpCode::Divide )
+					{
+						for ( size_t i = 0; i < n; ++i )
+						{
+							p1[ i ] = ( p1[ i ] / s1 ) / ( p0[ i ] / s0 );
+						}
+
+						if ( u0.type != UnitType::Generic )
+						{
+							units = u0;
+
+							for ( size_t i = 0; i < n; ++i )
+							{
+								p1[ i ] *= s0;
+							}
+						}
+						else
+						{
+							units = { 1.0, _desiredUnitType };
+						}
+					}
+					else if ( inst.op == OpCode::Multiply )
+					{
+						for ( size_t i = 0; i < n; ++i )
+						{
+							p1[ i ] = p1[ i ] * p0[ i ];
+						}
+
+						units = { 1.0, _desiredUnitType };
+					}
+					else if ( inst.op == OpCode::Power )
+					{
+						for ( size_t i = 0; i < n; ++i )
+						{
+							p1[ i ] = std::pow( p1[ i ] / s1, p0[ i ] / s0 ) * s1;
+						}
+
+						units = u1;
+					}
+					else if ( inst.op == OpCode::Min || inst.op == OpCode::Max )
+					{
+						// as SolveBinary: the units are chosen from the sides', never the values
+						const bool bMin = ( inst.op == OpCode::Min );
+
+						if ( u0.type == UnitType::Generic )
+						{
+							units = u1;
+						}
+						else if ( u1.type == UnitType::Generic )
+						{
+							units = u0;
+						}
+						else
+						{
+							units = ( s0 < s1 ) ? u0 : u1;
+						}
+
+						const bool bConvert0 = ( u0.type == UnitType::Generic );
+						const bool bConvert1 = !bConvert0 && ( u1.type == UnitType::Generic );
+						const double scale = units.scale;
+
+						for ( size_t i = 0; i < n; ++i )
+						{
+							const double a = bConvert1 ? ( p1[ i ] / s1 ) * scale : p1[ i ];
+							const double b = bConvert0 ? ( p0[ i ] / s0 ) * scale : p0[ i ];
+
+							if ( bMin )
+							{
+								p1[ i ] = ( b < a ) ? b : a;
+							}
+							else
+							{
+								p1[ i ] = ( a < b ) ? b : a;
+							}
+						}
+					}
+					else if ( u0.type == UnitType::Generic || u1.type == UnitType::Generic )
+					{
+						// Add or Subtract, with the units of the side that has them
+						units = ( u0.type == UnitType::Generic ) ? u1 : u0;
+						const double scale = units.scale;
+
+						if ( inst.op == OpCode::Add )
+						{
+							for ( size_t i = 0; i < n; ++i )
+							{
+								p1[ i ] = ( p1[ i ] / s1 + p0[ i ] / s0 ) * scale;
+							}
+						}
+						else
+						{
+							for ( size_t i = 0; i < n; ++i )
+							{
+								p1[ i ] = ( p1[ i ] / s1 - p0[ i ] / s0 ) * scale;
+							}
+						}
+					}
+					else
+					{
+						// Add or Subtract with both sides in units: summed, as Eval does
+						for ( size_t i = 0; i < n; ++i )
+						{
+							p1[ i ] = p1[ i ] + p0[ i ];
+						}
+					}
+
+					vUnits[ depth - 2 ] = units;
+					--depth;
+				}
+				break;
+			}
+		}
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			Solution& result = pOutput[ uFirst + i ];
+			result = { vValues[ i ], vUnits[ 0 ] };
+
+			Finish( result, bExplicitUnits, pPrevSolution, _desiredUnitType );
+		}
+	}
+}
+
+//==============================================================================
+
+void Numeric::CompiledChain::Append( const CompiledExpression& expr )
+{
+	// the link's operands follow the literals and units of the links before it
+	const uint32_t uLiteralBase = uint32_t( _program._literals.size() );
+	const uint32_t uUnitBase = uint32_t( _program._units.size() );
+
+	for ( auto inst : expr._code )
+	{
+		if ( inst.op == OpCode::Literal )
+		{
+			inst.operand += uLiteralBase;
+		}
+		else if ( inst.op == OpCode::Unit )
+		{
+			inst.operand += uUnitBase;
+		}
+
+		_program._code.push_back( inst );
+	}
+
+	_program._code.push_back( { OpCode::Finish, uint32_t( _links.size() ) } );
+	_program._literals.insert( _program._literals.end(), expr._literals.begin(), expr._literals.end() );
+	_program._units.insert( _program._units.end(), expr._units.begin(), expr._units.end() );
+
+	_program._maxDepth = std::max( _program._maxDepth, expr._maxDepth );
+	_program._symbolSlots = std::max( _program._symbolSlots, expr._symbolSlots );
+
+	// only the first link can lack a previous solution
+	if ( _links.empty() )
+	{
+		_program._readsPrevious = expr._readsPrevious;
+	}
+
+	_links.push_back( { expr._explicitUnits, expr._desiredUnitType } );
+}
+
+void Numeric::CompiledChain::Clear()
+{
+	_program = {};
+	_links.clear();
+}
+
+void Numeric::CompiledChain::Eval( const Solution* pPrevSolution, const Solution* pSymbolValues, Solution* pOutput ) const
+{
+	if ( const Error error = TryEval( pPrevSolution, pSymbolValues, pOutput ) )
+	{
+		throw CompilerError( error );
+	}
+}
+
+Numeric::Error Numeric::CompiledChain::TryEval( const Solution* pPrevSolution, const Solution* pSymbolValues, Solution* pOutput ) const
+{
+	if ( _links.empty() )
+	{
+		return {};
+	}
+
+	if ( _program._symbolSlots > 0 && pSymbolValues == nullptr )
+	{
+		return { ErrorCode::NoSymbolValues };
+	}
+
+	if ( _program._readsPrevious && pPrevSolution == nullptr )
+	{
+		return { ErrorCode::NoPreviousValue };
+	}
+
+	// The solver of CompiledExpression::TryEval, on one stack for all the links. At the end
+	// of each, its solution is written out and is the previous solution from then on.
+	Solution aLocalStack[ CompiledExpression::_localStackSize ];
+	std::vector<Solution> vLargeStack;
+
+	Solution* stkSolve = aLocalStack;
+	if ( _program._maxDepth > CompiledExpression::_localStackSize )
+	{
+		vLargeStack.resize( _program._maxDepth );
+		stkSolve = vLargeStack.data();
+	}
+
+	size_t depth = 0;
+	const Link* pLink = _links.data();
+	bool bExplicitUnits = pLink->explicitUnits;
+
+	for ( const auto& inst : _program._code )
+	{
+		if ( inst.op == OpCode::Finish )
+		{
+			Solution& result = pOutput[ inst.operand ];
+
+			result = stkSolve[ 0 ];
+			CompiledExpression::Finish( result, bExplicitUnits, pPrevSolution, pLink->desiredUnitType );
+
+			pPrevSolution = &result;
+			depth = 0;
+
+			if ( ++pLink != _links.data() + _links.size() )
+			{
+				bExplicitUnits = pLink->explicitUnits;
+			}
+		}
+		else
+		{
+			_program.Step( inst, stkSolve, depth, bExplicitUnits, pPrevSolution, pSymbolValues, pLink->desiredUnitType );
+		}
+	}
+
+	return {};
+}
+
+//==============================================================================
+
+#if JIT_X64
+
+namespace
+{
+	// x86-64 code for JitExpression: scalar SSE2 in xmm0 to xmm2, with the value stack in
+	// memory at rbx, the symbol values at r12 and the previous solution at r13 (all kept
+	// across calls on both ABIs). rax holds constants and call targets.
+	struct X64Emitter
+	{
+		std::vector<uint8_t> code;
+
+		void Bytes( std::initializer_list<uint8_t> bytes )
+		{
+			code.insert( code.end(), bytes );
+		}
+
+		void Imm32( uint32_t value )
+		{
+			for ( int i = 0; i < 4; ++i )
+			{
+				code.push_back( uint8_t( value >> ( i * 8 ) ) );
+			}
+		}
+
+		void Imm64( uint64_t value )
+		{
+			Imm32( uint32_t( value ) );
+			Imm32( uint32_t( value >> 32 ) );
+		}
+
+		void Prologue()
+		{
+			Bytes( { 0x53, 0x41, 0x54, 0x41, 0x55 } );				// push rbx; push r12; push r13
+			Bytes( { 0x48, 0x83, 0xEC, 0x20 } );					// sub rsp, 32 (the Win64 shadow space, and 16 byte aligned)
+#ifdef _WIN32
+			Bytes( { 0x49, 0x89, 0xCC, 0x49, 0x89, 0xD5, 0x4C, 0x89, 0xC3 } ); // mov r12, rcx; mov r13, rdx; mov rbx, r8
+#else
+			Bytes( { 0x49, 0x89, 0xFC, 0x49, 0x89, 0xF5, 0x48, 0x89, 0xD3 } ); // mov r12, rdi; mov r13, rsi; mov rbx, rdx
+#endif
+		}
+
+		void Epilogue()
+		{
+			Load( 0, 0 );											// the result, in xmm0
+			Bytes( { 0x48, 0x83, 0xC4, 0x20 } );					// add rsp, 32
+			Bytes( { 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 } );		// pop r13; pop r12; pop rbx; ret
+		}
+
+		// movsd xmm, [ rbx + 8 * slot ], and back
+		void Load( int xmm, size_t slot )
+		{
+			Bytes( { 0xF2, 0x0F, 0x10, uint8_t( 0x83 | xmm << 3 ) } );
+			Imm32( uint32_t( slot * sizeof( double ) ) );
+		}
+
+		void Store( size_t slot, int xmm )
+		{
+			Bytes( { 0xF2, 0x0F, 0x11, uint8_t( 0x83 | xmm << 3 ) } );
+			Imm32( uint32_t( slot * sizeof( double ) ) );
+		}
+
+		// movsd xmm, [ r12 + offset ] and [ r13 + offset ]
+		void LoadSymbol( int xmm, size_t offset )
+		{
+			Bytes( { 0xF2, 0x41, 0x0F, 0x10, uint8_t( 0x84 | xmm << 3 ), 0x24 } );
+			Imm32( uint32_t( offset ) );
+		}
+
+		void LoadPrevious( int xmm, size_t offset )
+		{
+			Bytes( { 0xF2, 0x41, 0x0F, 0x10, uint8_t( 0x85 | xmm << 3 ) } );
+			Imm32( uint32_t( offset ) );
+		}
+
+		// mov rax, bits; movq xmm, rax
+		void Constant( int xmm, double value )
 		{
-			// Push to holding stack, it acts as a stopper when we back track
-			stkHolding.push_front( token );
-			tokPrevious = stkHolding.front();
+			Bytes( { 0x48, 0xB8 } );
+			Imm64( std::bit_cast<uint64_t>( value ) );
+			Bytes( { 0x66, 0x48, 0x0F, 0x6E, uint8_t( 0xC0 | xmm << 3 ) } );
 		}
-		else if ( token.type == Token::Type::Parenthesis_Close )
+
+		// dst = dst op src, op one of the scalar double opcodes below
+		void Op( uint8_t op, int dst, int src )
 		{
-			// Check something is actually wrapped by parenthesis
-			if ( stkHolding.empty() )
-			{
-				throw CompilerError( CompilerError::Stage::Solver, "Unexpected close parenthesis" );
-			}
+			Bytes( { 0xF2, 0x0F, op, uint8_t( 0xC0 | dst << 3 | src ) } );
+		}
 
-			// Back-flush holding stack into output until open parenthesis
-			while ( !stkHolding.empty() && stkHolding.front().type != Token::Type::Parenthesis_Open )
-			{
-				stkOutput.push_back( stkHolding.front() );
-				stkHolding.pop_front();
-			}
+		static constexpr uint8_t _sqrt = 0x51, _add = 0x58, _mul = 0x59, _sub = 0x5C, _min = 0x5D, _div = 0x5E, _max = 0x5F;
 
-			// Check if open parenthesis was actually found
-			if ( stkHolding.empty() )
+		// by a unit's scale, which has no effect when it is 1
+		void DivideBy( int xmm, double scale )
+		{
+			if ( scale != 1.0 )
 			{
-				throw CompilerError( CompilerError::Stage::Solver, "No open parenthesis found" );
+				Constant( 2, scale );
+				Op( _div, xmm, 2 );
 			}
+		}
 
-			// Remove corresponding open parenthesis from holding stack
-			if ( !stkHolding.empty() && stkHolding.front().type == Token::Type::Parenthesis_Open )
+		void MultiplyBy( int xmm, double scale )
+		{
+			if ( scale != 1.0 )
 			{
-				stkHolding.pop_front();
+				Constant( 2, scale );
+				Op( _mul, xmm, 2 );
 			}
-
-			tokPrevious = { 0, Token::Type::Parenthesis_Close };
 		}
 
-		else if ( token.type == Token::Type::Unit )
+		// xorpd with the sign bit
+		void Negate( int xmm )
 		{
-			bExplicitUnits = true; // units were specified
-
-			// Push units straight to output, they are already in order
-			stkOutput.push_back( token );
-			tokPrevious = stkOutput.back();
+			Constant( 2, -0.0 );
+			Bytes( { 0x66, 0x0F, 0x57, uint8_t( 0xC0 | xmm << 3 | 2 ) } );
 		}
 
-		else if ( token.type == Token::Type::Operator )
+		// xmm0 = fn( xmm0, xmm1 ); mov rax, fn; call rax
+		void Call( double ( *fn )( double, double ) )
 		{
-			// Unit_or_Symbol is operator
-			std::string op_text = token.text;
+			Bytes( { 0x48, 0xB8 } );
+			Imm64( uint64_t( reinterpret_cast<uintptr_t>( fn ) ) );
+			Bytes( { 0xFF, 0xD0 } );
+		}
+	};
 
-			// Unary Operator check
-			if ( token.text == "-" || token.text == "+" )
-			{
-				if ( ( tokPrevious.type != Token::Type::Literal_Numeric
-					   && tokPrevious.type != Token::Type::Unit
-					   && tokPrevious.type != Token::Type::Parenthesis_Close ) || pass == 0 )
-				{
-					// "Upgrade" operator
-					op_text = "u" + token.text;
-				}
-			}
+	double JitPow( double base, double exponent )
+	{
+		return std::pow( base, exponent );
+	}
 
-			while ( !stkHolding.empty() && stkHolding.front().type != Token::Type::Parenthesis_Open )
-			{
-				// Ensure holding stack front is an operator (it might not be later...)
-				if ( stkHolding.front().type == Token::Type::Operator )
-				{
-					const auto& holding_stack_op = _mapOperators[ stkHolding.front().text ];
+	double JitRound( double value, double )
+	{
+		return std::round( value );
+	}
 
-					if ( holding_stack_op.precedence >= _mapOperators[ op_text ].precedence )
-					{
-						stkOutput.push_back( stkHolding.front() );
-						stkHolding.pop_front();
-					}
-					else
-					{
-						break;
-					}
-				}
-			}
+	// the code copied into pages of its own, then made executable (and no longer writable)
+	void* JitMap( const std::vector<uint8_t>& code )
+	{
+#ifdef _WIN32
+		void* pCode = VirtualAlloc( nullptr, code.size(), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+		if ( pCode == nullptr )
+		{
+			return nullptr;
+		}
 
-			// Push the new operator onto the holding stack
-			stkHolding.push_front( { 0, Token::Type::Operator, op_text } );
-			tokPrevious = stkHolding.front();
+		memcpy( pCode, code.data(), code.size() );
+
+		DWORD oldProtect = 0;
+		if ( !VirtualProtect( pCode, code.size(), PAGE_EXECUTE_READ, &oldProtect ) )
+		{
+			VirtualFree( pCode, 0, MEM_RELEASE );
+			return nullptr;
 		}
 
-		else
+		FlushInstructionCache( GetCurrentProcess(), pCode, code.size() );
+#else
+		void* pCode = mmap( nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( pCode == MAP_FAILED )
 		{
-			throw CompilerError( CompilerError::Stage::Solver, "Unsupported Token" );
+			return nullptr;
 		}
 
-		pass++;
+		memcpy( pCode, code.data(), code.size() );
+
+		if ( mprotect( pCode, code.size(), PROT_READ | PROT_EXEC ) != 0 )
+		{
+			munmap( pCode, code.size() );
+			return nullptr;
+		}
+#endif
+		return pCode;
 	}
 
-	// Drain the holding stack
-	while ( !stkHolding.empty() )
+	void JitUnmap( void* pCode, size_t uSize )
 	{
-		stkOutput.push_back( stkHolding.front() );
-		stkHolding.pop_front();
+#ifdef _WIN32
+		( void )uSize;
+		VirtualFree( pCode, 0, MEM_RELEASE );
+#else
+		munmap( pCode, uSize );
+#endif
 	}
+}
 
-#if DEBUG_OUTPUT_RPN
-	// debug reverse-polish notation
-	std::cout << "-------- RPN ------------\n";
-	for ( const auto& s : stkOutput )
+#endif // JIT_X64
+
+Numeric::JitExpression::JitExpression( const CompiledExpression& expr, const Solution* pPrevSolution, const Solution* pSymbolValues )
+	: _expr( expr )
+{
+	if ( !Translate( pPrevSolution, pSymbolValues ) )
 	{
-		std::cout << s.str() << "\n";
+		Release();
 	}
-	std::cout << "-------------------------\n\n";
-#endif // DEBUG_OUTPUT_RPN
+}
+
+Numeric::JitExpression::~JitExpression()
+{
+	Release();
+}
+
+Numeric::JitExpression::JitExpression( JitExpression&& other ) noexcept
+	: _expr( std::move( other._expr ) )
+	, _pCode( std::exchange( other._pCode, nullptr ) )
+	, _codeSize( std::exchange( other._codeSize, 0 ) )
+	, _symbolGuards( std::move( other._symbolGuards ) )
+	, _prevUnits( other._prevUnits )
+	, _resultUnits( other._resultUnits )
+	, _explicitUnits( other._explicitUnits )
+{
+}
 
-	// Solver (Almost identical to video 1)
-	std::deque<Solution> stkSolve;
+Numeric::JitExpression& Numeric::JitExpression::operator=( JitExpression&& other ) noexcept
+{
+	if ( this != &other )
+	{
+		Release();
+
+		_expr = std::move( other._expr );
+		_pCode = std::exchange( other._pCode, nullptr );
+		_codeSize = std::exchange( other._codeSize, 0 );
+		_symbolGuards = std::move( other._symbolGuards );
+		_prevUnits = other._prevUnits;
+		_resultUnits = other._resultUnits;
+		_explicitUnits = other._explicitUnits;
+	}
+
+	return *this;
+}
 
-	for ( const auto& inst : stkOutput )
+void Numeric::JitExpression::Release()
+{
+#if JIT_X64
+	if ( _pCode != nullptr )
 	{
-		switch ( inst.type )
+		JitUnmap( _pCode, _codeSize );
+	}
+#endif // JIT_X64
+
+	_pCode = nullptr;
+	_codeSize = 0;
+	_symbolGuards.clear();
+}
+
+bool Numeric::JitExpression::Translate( const Solution* pPrevSolution, const Solution* pSymbolValues )
+{
+#if JIT_X64
+	// Without example values there are no units to translate for, and the native stack is
+	// the solver's local one. Exact values need the solver.
+	if ( ( _expr._symbolSlots > 0 && pSymbolValues == nullptr ) || ( _expr._readsPrevious && pPrevSolution == nullptr ) )
+	{
+		return false;
+	}
+
+	if ( _expr._maxDepth > CompiledExpression::_localStackSize )
+	{
+		return false;
+	}
+
+	for ( const auto& literal : _expr._literals )
+	{
+		if ( literal.exact.Exact() )
 		{
-		case Token::Type::Literal_Numeric:
+			return false;
+		}
+	}
+
+	for ( const auto& unit : _expr._units )
+	{
+		if ( unit.exact.Exact() )
+		{
+			return false;
+		}
+	}
+
+	// Run the code as Step would, but with only the units on the stack; each instruction
+	// emits its arithmetic on the values, from the slots of its operands back to the slot of
+	// its result. Binary operations take the left hand side in xmm0 and the right in xmm1.
+	X64Emitter emit;
+	emit.Prologue();
+
+	Unit aUnits[ CompiledExpression::_localStackSize ];
+	size_t depth = 0;
+
+	_explicitUnits = _expr._explicitUnits;
+
+	for ( const auto& inst : _expr._code )
+	{
+		switch ( inst.op )
+		{
+		case OpCode::Literal:
 			{
-				stkSolve.push_front( { inst.value, 1.0 } );
+				const Solution& literal = _expr._literals[ inst.operand ];
+
+				emit.Constant( 0, literal.value );
+				emit.Store( depth, 0 );
+				aUnits[ depth++ ] = literal.units;
 			}
 			break;
 
-		case Token::Type::Unit:
+		case OpCode::Symbol:
 			{
-				Solution mem;
+				const Solution& value = pSymbolValues[ inst.operand ];
 
-				if ( stkSolve.empty() )
-				{
-					throw CompilerError( CompilerError::Stage::Solver, "Expression is malformed" );
-				}
-				else
+				if ( value.exact.Exact() )
 				{
-					mem = stkSolve[ 0 ];
-					stkSolve.pop_front();
+					return false;
 				}
 
-				Solution result;
-				result.value = mem.value * inst.value;
-				result.units = _mapUnits[ inst.text ];
+				emit.LoadSymbol( 0, inst.operand * sizeof( Solution ) + offsetof( Solution, value ) );
+				emit.Store( depth, 0 );
+				aUnits[ depth++ ] = value.units;
 
-				stkSolve.push_front( result );
+				_explicitUnits |= value.units.type != UnitType::Generic;
+				_symbolGuards.push_back( { inst.operand, value.units } );
 			}
 			break;
 
-		case Token::Type::Operator:
+		case OpCode::Unit:
+			{
+				emit.Load( 0, depth - 1 );
+				emit.MultiplyBy( 0, _expr._units[ inst.operand ].value );
+				emit.Store( depth - 1, 0 );
+				aUnits[ depth - 1 ] = _expr._units[ inst.operand ].unit;
+			}
+			break;
+
+		case OpCode::UnaryPlus:
+			break;
+
+		case OpCode::UnaryMinus:
+			{
+				emit.Load( 0, depth - 1 );
+				emit.Negate( 0 );
+				emit.Store( depth - 1, 0 );
+			}
+			break;
+
+		case OpCode::Round:
+		case OpCode::Sqrt:
 			{
-				const auto& op = _mapOperators[ inst.text ];
+				// as SolveUnary, in the entry's own units
+				const double scale = aUnits[ depth - 1 ].scale;
 
-				std::vector<Solution> mem( op.arguments );
+				emit.Load( 0, depth - 1 );
+				emit.DivideBy( 0, scale );
 
-				for ( uint8_t a = 0; a < op.arguments; a++ )
+				if ( inst.op == OpCode::Round )
 				{
-					if ( stkSolve.empty() )
-					{
-						throw CompilerError( CompilerError::Stage::Solver, "Expression is malformed" );
-					}
-					else
-					{
-						mem[ a ] = stkSolve[ 0 ];
-						stkSolve.pop_front();
-					}
+					emit.Call( JitRound );
+				}
+				else
+				{
+					emit.Op( X64Emitter::_sqrt, 0, 0 );
 				}
 
-				Solution result = { 0.0, { 1.0, UnitType::Generic } };
+				emit.MultiplyBy( 0, scale );
+				emit.Store( depth - 1, 0 );
+			}
+			break;
+
+		case OpCode::Percent:
+			{
+				emit.Load( 0, depth - 1 );
+				emit.DivideBy( 0, aUnits[ depth - 1 ].scale );
+				emit.Constant( 2, 100.0 );
+				emit.Op( X64Emitter::_div, 0, 2 );
+				emit.LoadPrevious( 1, offsetof( Solution, value ) );
+				emit.Op( X64Emitter::_mul, 0, 1 );
+				emit.Store( depth - 1, 0 );
+
+				aUnits[ depth - 1 ] = pPrevSolution->units;
+				_prevUnits = pPrevSolution->units;
+			}
+			break;
+
+		case OpCode::Finish:
+			return false;
 
-				if ( op.arguments == 2 )
+		default:
+			{
+				// as SolveBinary: u0 and s0 are the right hand side's, u1 and s1 the left's
+				const Unit u0 = aUnits[ depth - 1 ];
+				const Unit u1 = aUnits[ depth - 2 ];
+				const double s0 = u0.scale;
+				const double s1 = u1.scale;
+
+				Unit units = { 1.0, UnitType::Generic };
+				int result = 0;
+
+				emit.Load( 0, depth - 2 );
+				emit.Load( 1, depth - 1 );
+
+				switch ( inst.op )
 				{
-					if ( inst.text == "/" )
+				case OpCode::Divide:
 					{
-						double v0, v1;
-						v0 = mem[ 0 ].value / mem[ 0 ].units.scale;
-						v1 = mem[ 1 ].value / mem[ 1 ].units.scale;
-
-						result.value = v1 / v0;
+						emit.DivideBy( 1, s0 );
+						emit.DivideBy( 0, s1 );
+						emit.Op( X64Emitter::_div, 0, 1 );
 
-						if ( mem[ 0 ].units.type != UnitType::Generic )
+						if ( u0.type != UnitType::Generic )
 						{
-							result.units = mem[ 0 ].units;
-							result.value *= mem[ 0 ].units.scale;
+							units = u0;
+							emit.MultiplyBy( 0, s0 );
 						}
 						else
 						{
-							result.units = { 1.0, _desiredUnitType };
+							units = { 1.0, _expr._desiredUnitType };
 						}
 					}
-					else if ( inst.text == "*" )
+					break;
+
+				case OpCode::Multiply:
 					{
-						result.value = mem[ 1 ].value * mem[ 0 ].value;
-						result.units = { 1.0, _desiredUnitType };
+						emit.Op( X64Emitter::_mul, 0, 1 );
+						units = { 1.0, _expr._desiredUnitType };
 					}
-					else if ( inst.text == "+" )
+					break;
+
+				case OpCode::Add:
+				case OpCode::Subtract:
 					{
-						double v0, v1;
-						v0 = mem[ 0 ].value / mem[ 0 ].units.scale;
-						v1 = mem[ 1 ].value / mem[ 1 ].units.scale;
+						const uint8_t op = ( inst.op == OpCode::Add ) ? X64Emitter::_add : X64Emitter::_sub;
 
-						if ( mem[ 0 ].units.type == UnitType::Generic )
-						{
-							result.units = mem[ 1 ].units;
-							result.value = ( v1 + v0 ) * mem[ 1 ].units.scale;
-						}
-						else if ( mem[ 1 ].units.type == UnitType::Generic )
+						if ( u0.type == UnitType::Generic || u1.type == UnitType::Generic )
 						{
-							result.units = mem[ 0 ].units;
-							result.value = ( v1 + v0 ) * mem[ 0 ].units.scale;
+							units = ( u0.type == UnitType::Generic ) ? u1 : u0;
+
+							emit.DivideBy( 1, s0 );
+							emit.DivideBy( 0, s1 );
+							emit.Op( op, 0, 1 );
+							emit.MultiplyBy( 0, units.scale );
 						}
 						else
 						{
-							result.value = mem[ 1 ].value + mem[ 0 ].value;
+							emit.Op( X64Emitter::_add, 0, 1 ); // summed, as SolveBinary does
 						}
 					}
-					else if ( inst.text == "-" )
+					break;
+
+				case OpCode::Power:
 					{
-						double v0, v1;
-						v0 = mem[ 0 ].value / mem[ 0 ].units.scale;
-						v1 = mem[ 1 ].value / mem[ 1 ].units.scale;
+						emit.DivideBy( 1, s0 );
+						emit.DivideBy( 0, s1 );
+						emit.Call( JitPow );
+						emit.MultiplyBy( 0, s1 );
+						units = u1;
+					}
+					break;
 
-						if ( mem[ 0 ].units.type == UnitType::Generic )
+				case OpCode::Min:
+				case OpCode::Max:
+					{
+						// minsd and maxsd of ( b, a ) give just what ( b < a ) ? b : a and
+						// ( a < b ) ? b : a do, for NaNs and signed zeroes too
+						if ( u0.type == UnitType::Generic )
 						{
-							result.units = mem[ 1 ].units;
-							result.value = ( v1 - v0 ) * mem[ 1 ].units.scale;
+							units = u1;
+							emit.DivideBy( 1, s0 );
+							emit.MultiplyBy( 1, s1 );
 						}
-						else if ( mem[ 1 ].units.type == UnitType::Generic )
+						else if ( u1.type == UnitType::Generic )
 						{
-							result.units = mem[ 0 ].units;
-							result.value = ( v1 - v0 ) * mem[ 0 ].units.scale;
+							units = u0;
+							emit.DivideBy( 0, s1 );
+							emit.MultiplyBy( 0, s0 );
 						}
 						else
 						{
-							result.value = mem[ 1 ].value + mem[ 0 ].value;
+							units = ( s0 < s1 ) ? u0 : u1;
 						}
-					}
-				}
 
-				if ( op.arguments == 1 )
-				{
-					if ( inst.text == "u+" )
-					{
-						result = mem[ 0 ];
-						result.units = mem[ 0 ].units;
-					}
-					else if ( inst.text == "u-" )
-					{
-						result.value = -mem[ 0 ].value;
-						result.units = mem[ 0 ].units;
+						emit.Op( ( inst.op == OpCode::Min ) ? X64Emitter::_min : X64Emitter::_max, 1, 0 );
+						result = 1;
 					}
+					break;
+
+				default:
+					return false;
 				}
 
-				stkSolve.push_front( result );
+				--depth;
+				emit.Store( depth - 1, result );
+				aUnits[ depth - 1 ] = units;
 			}
 			break;
-
-		default:
-			throw CompilerError( CompilerError::Stage::Solver, "Unexpected Token" );
 		}
 	}
 
-	if ( stkSolve.size() != 1 )
-	{
-
-#if DEBUG_OUTPUT_ERROR
-		std::cout << "Solution  := \n";
-		for ( const auto& s : stkSolve )
-		{
-			std::cout << std::to_string( s.value ) << " (x" << std::to_string( s.units.scale ) << ")" << "\n";
-		}
-		std::cout << "\n";
-#endif // DEBUG_OUTPUT_ERROR
-
-		throw CompilerError( CompilerError::Stage::Solver, "Indeterminate Expression" );
-	}
-	else
-	{
-		Solution result = stkSolve.front();
+	emit.Epilogue();
 
-		// No units were explicitly specified?
-		if ( bExplicitUnits == false )
-		{
-			if ( pPrevSolution == nullptr || pPrevSolution->units.type == UnitType::Generic )
-			{
-				// fall back to desired units
-				result.units = { 1.0, _desiredUnitType };
-				result.value *= result.units.scale;
-			}
-			else
-			{
-				// recycle the previous solution's units
-				result.value *= pPrevSolution->units.scale;
-				result.units = pPrevSolution->units;
-			}
-		}
+	_resultUnits = aUnits[ 0 ];
+	_codeSize = emit.code.size();
+	_pCode = JitMap( emit.code );
 
-		// Convert?
-		if ( result.units.type != _desiredUnitType )
-		{
-			result.units = { 1.0, _desiredUnitType };
-		}
+	return _pCode != nullptr;
+#else // JIT_X64
+	( void )pPrevSolution;
+	( void )pSymbolValues;
+	return false;
+#endif // JIT_X64
+}
 
-		// Try to normalise the result into friendly values.
-		if ( _desiredUnitType == UnitType::Imperial )
-		{
-			NormaliseImperial( result );
-		}
-		else if ( _desiredUnitType == UnitType::Metric )
-		{
-			NormaliseMetric( result );
-		}
+Numeric::Solution Numeric::JitExpression::Eval( const Solution* pPrevSolution, const Solution* pSymbolValues ) const
+{
+	auto result = TryEval( pPrevSolution, pSymbolValues );
 
-		return result;
+	if ( result.error )
+	{
+		throw CompilerError( result.error );
 	}
+
+	return result.value;
 }
 
-const std::string Numeric::Compiler::UnitName( const Unit& unit ) const
+Numeric::Result<Numeric::Solution> Numeric::JitExpression::TryEval( const Solution* pPrevSolution, const Solution* pSymbolValues ) const
 {
-	if ( unit.type == UnitType::Generic )
+	if ( _expr._symbolSlots > 0 && pSymbolValues == nullptr )
 	{
-		return std::string( "" );
+		return { {}, { ErrorCode::NoSymbolValues } };
 	}
 
-	const auto find = _mapUnitLookup.find( unit.scale );
-	if ( find == _mapUnitLookup.end() )
+	if ( _expr._readsPrevious && pPrevSolution == nullptr )
 	{
-		return std::string( "<error>" );
+		return { {}, { ErrorCode::NoPreviousValue } };
 	}
 
-	return ( *find ).second;
-}
+	// the native code only holds for the units it was translated for
+	bool bNative = ( _pCode != nullptr );
 
-void Numeric::Compiler::NormaliseImperial( Solution& result )
-{
-	// .. zero?
-	if ( result.value == 0 )
+	for ( const auto& guard : _symbolGuards )
 	{
-		result.units = DefaultUnit();
-		return;
+		const Solution& value = pSymbolValues[ guard.slot ];
+		bNative = bNative && value.units.scale == guard.units.scale && value.units.type == guard.units.type && !value.exact.Exact();
 	}
 
-	for ( ; ; )
+	if ( bNative && _expr._readsPrevious )
 	{
-		double normalised = std::fabs( result.value / result.units.scale );
-
-		// ... convert from in to ft, if it doesn't create a fraction.
-		if ( ( normalised >= _impScaleInch/*1*/ ) && ( result.units.scale == _impScaleThou ) )
-		{
-			result.units.scale = _impScaleInch;
-		}
-		// ... convert from in to ft, don't care about fractions if the value is (>6ft)
-		else if ( ( normalised > 72 ) && ( result.units.scale == _impScaleInch ) )
-		{
-			result.units.scale = _impScaleFoot;
-		}
-		// ... convert from in to ft, if it doesn't create a fraction.
-		else if ( ( normalised >= 12 ) && ( result.units.scale == _impScaleInch ) && ( IsEpsilonInteger( result.value / _impScaleFoot ) ) )
-		{
-			result.units.scale = _impScaleFoot;
-		}
-#if OUTPUT_TO_YARDS
-		// ... convert from ft to yd, if it doesn't create a fraction.
-		else if ( ( normalised >= 12 ) && ( result.units.scale == _impScaleFoot ) && ( IsEpsilonInteger( result.value / _impScaleYard ) ) )
-		{
-			result.units.scale = _impScaleYard;
-		}
-#else // OUTPUT_TO_YARDS
-		// ... convert from yd to feet
-		else if ( result.units.scale == _impScaleYard )
-		{
-			result.units.scale = _impScaleFoot;
-		}
-#endif // OUTPUT_TO_YARDS
-		// ... convert from ft to mi, if it doesn't create a fraction.
-		else if ( ( normalised >= 5280 ) && ( result.units.scale == _impScaleFoot ) && ( IsEpsilonInteger( result.value / _impScaleMile ) ) )
-		{
-			result.units.scale = _impScaleMile;
-		}
-		// ... convert from yd to mi, if it doesn't create a fraction.
-		else if ( ( normalised >= 1760 ) && ( result.units.scale == _impScaleYard ) && ( IsEpsilonInteger( result.value / _impScaleMile ) ) )
-		{
-			result.units.scale = _impScaleMile;
-		}
-		else
-		{
-			break; // nothing more we can do.
-		}
+		bNative = pPrevSolution->units.scale == _prevUnits.scale && pPrevSolution->units.type == _prevUnits.type;
 	}
-}
 
-void Numeric::Compiler::NormaliseMetric( Solution& result )
-{
-	// .. zero?
-	if ( result.value == 0 )
+	if ( !bNative )
 	{
-		result.units = DefaultUnit();
-		return;
+		return _expr.TryEval( pPrevSolution, pSymbolValues );
 	}
 
-	for ( ; ; )
-	{
-		double normalised = std::fabs( result.value / result.units.scale );
+	double aStack[ CompiledExpression::_localStackSize ];
 
-		// ... convert from km to Mm
-		if ( ( normalised >= 1000 ) && ( result.units.scale == 1000 ) )
-		{
-			result.units.scale = 1000000;
-		}
-		// ... convert from m to km
-		else if ( ( normalised >= 1000 ) && ( result.units.scale == 1 ) )
-		{
-			result.units.scale = 1000.0;
-		}
-		// ... convert from mm to m
-		else if ( ( normalised >= 1000 ) && ( result.units.scale == 0.001 ) )
-		{
-			result.units.scale = 1;
-		}
-#if OUTPUT_TO_CM
-		// ... convert from mm to cm
-		else if ( ( normalised >= 100 ) && ( result.units.scale == 0.001 ) )
-		{
-			result.units.scale = 0.01;
-		}
-		// ... convert from cm to m
-		else if ( ( normalised >= 100 ) && ( result.units.scale == 0.01 ) )
-		{
-			result.units.scale = 1;
-		}
-#else // OUTPUT_TO_CM
-		// ... convert from cm to m
-		else if ( result.units.scale == 0.01 )
-		{
-			result.units.scale = 1;
-		}
-		// ... convert from mm to m
-		else if ( ( normalised >= 1000 ) && ( result.units.scale == 0.001 ) )
-		{
-			result.units.scale = 1;
-		}
-#endif // OUTPUT_TO_CM
-		// ... convert from Mm to km
-		else if ( ( normalised < 1 ) && ( result.units.scale == 1000000 ) )
-		{
-			result.units.scale = 1000;
-		}
-		// ... convert from km to m
-		else if ( ( normalised < 1 ) && ( result.units.scale == 1000 ) )
-		{
-			result.units.scale = 1;
-		}
-#if OUTPUT_TO_CM
-		// ... convert from m to cm
-		else if ( ( normalised < 1 ) && ( result.units.scale == 1 ) )
-		{
-			result.units.scale = 0.01;
-		}
-		// ... convert from cm to mm
-		else if ( ( normalised < 1 ) && ( result.units.scale == 0.01 ) )
-		{
-			result.units.scale = 0.001;
-		}
-#else // OUTPUT_TO_CM
-		// ... convert from m to mm
-		else if ( ( normalised < 1 ) && ( result.units.scale == 1 ) )
-		{
-			result.units.scale = 0.001;
-		}
-#endif // OUTPUT_TO_CM
-		else
-		{
-			break; // nothing more we can do.
-		}
-	}
-}
+	Solution result = { reinterpret_cast<Function>( _pCode )( pSymbolValues, pPrevSolution, aStack ), _resultUnits };
 
-void Numeric::Compiler::SetupInput( const std::string& input )
-{
-	_inputStream = input.begin();
-	_inputStreamEnd = input.end();
-	_inputPos = 0;
+	CompiledExpression::Finish( result, _explicitUnits, pPrevSolution, _expr._desiredUnitType );
+
+	return { result };
 }
 
-char Numeric::Compiler::PeekInput()
+std::string_view Numeric::Compiler::UnitName( const Unit& unit ) const
 {
-	char charNow;
-
-	if ( _inputStream == _inputStreamEnd )
+	if ( unit.type == UnitType::Generic )
 	{
-		charNow = 0;
+		return {};
 	}
-	else
+
+	for ( const auto& label : _pConfig->_pUnitSystem->labels )
 	{
-		charNow = *_inputStream;
+		if ( label.scale == unit.scale )
+		{
+			return label.name;
+		}
 	}
 
-	return charNow;
+	return "<error>";
 }
+
+
@@ -61,6 +61,18 @@
 #include <unordered_map>
 #include <string_view>
 #include <array>
+#include <vector>
+#include <memory>
+#include <span>
+#include <cmath>
+#include <type_traits>
+#include <bit>
+#include <cstring>
+#include <cstdint>
+
+// Normalisation of results (see Compiler::NormaliseMetric and NormaliseImperial)
+#define OUTPUT_TO_CM						0
+#define OUTPUT_TO_YARDS						0
 
 namespace Numeric
 {
@@ -76,6 +88,240 @@ namespace Numeric
 
 			return lut;
 		}
+
+		// Character classes of the tokeniser
+		inline constexpr auto gWhitespaceDigits = MakeLUT( " \t\n\r\v\f" );
+		inline constexpr auto gFirstNumericDigits = MakeLUT( "0123456789" );
+		inline constexpr auto gAdditionalNumericDigits = MakeLUT( ".,0123456789" );
+		inline constexpr auto gOperatorDigits = MakeLUT( "*+-/^%" );
+		inline constexpr auto gUnitDigits = MakeLUT( "mMkKcfootfeetinchesyardsmiles'\"" );
+		inline constexpr auto gFirstSymbolDigits = MakeLUT( "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_" );
+		inline constexpr auto gAdditionalSymbolDigits = MakeLUT( "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789" );
+		inline constexpr auto gAllowedHexDigits = MakeLUT( "0123456789abcdefABCDEF" );
+		inline constexpr auto gAllowedBinaryDigits = MakeLUT( "01" );
+
+		// Value of each hex (and so binary) digit
+		inline constexpr auto gDigitValues = []()
+		{
+			std::array<uint8_t, 256> values{};
+			for ( int c = 0; c < 10; ++c ) values[ '0' + c ] = uint8_t( c );
+			for ( int c = 0; c < 6; ++c ) values[ 'a' + c ] = values[ 'A' + c ] = uint8_t( 10 + c );
+			return values;
+		}();
+	}
+
+	namespace math
+	{
+		// std::fabs and std::round, for constant expressions too
+		constexpr double Abs( double d )
+		{
+			if ( std::is_constant_evaluated() )
+			{
+				return ( d < 0 ) ? -d : d;
+			}
+
+			return std::fabs( d );
+		}
+
+		constexpr double Round( double d )
+		{
+			if ( std::is_constant_evaluated() )
+			{
+				// halves away from zero; from 2^52 up every double is whole already
+				if ( !( Abs( d ) < 4503599627370496.0 ) )
+				{
+					return d;
+				}
+
+				const double whole = double( int64_t( d ) );
+				const double frac = d - whole;
+
+				return ( frac >= 0.5 ) ? whole + 1 : ( frac <= -0.5 ) ? whole - 1 : whole;
+			}
+
+			return std::round( d );
+		}
+
+		constexpr bool IsEpsilonInteger( double d )
+		{
+			const double delta = d - Round( d );
+			return Abs( delta ) <= 1e-14;
+		}
+
+		// An exact value, num / den in lowest terms with den > 0, for Compiler::SetExactImperial.
+		// A den of 0 means the value isn't exact; an operation on such a value gives one too, as
+		// does one whose terms would overflow, so the double beside it is all there is.
+		struct Rational
+		{
+			int64_t num = 0;
+			int64_t den = 0;
+
+			constexpr bool Exact() const { return den != 0; }
+		};
+
+		constexpr int64_t Gcd( int64_t a, int64_t b )
+		{
+			a = ( a < 0 ) ? -a : a;
+			b = ( b < 0 ) ? -b : b;
+
+			while ( b != 0 )
+			{
+				const int64_t t = a % b;
+				a = b;
+				b = t;
+			}
+
+			return a;
+		}
+
+		// terms are held within +-INT64_MAX, so negating one never overflows
+		constexpr bool CheckedMultiply( int64_t a, int64_t b, int64_t& out )
+		{
+			const uint64_t ua = ( a < 0 ) ? uint64_t( 0 ) - uint64_t( a ) : uint64_t( a );
+			const uint64_t ub = ( b < 0 ) ? uint64_t( 0 ) - uint64_t( b ) : uint64_t( b );
+
+			if ( ua != 0 && ub > uint64_t( INT64_MAX ) / ua )
+			{
+				return false;
+			}
+
+			out = a * b;
+			return true;
+		}
+
+		constexpr bool CheckedAdd( int64_t a, int64_t b, int64_t& out )
+		{
+			if ( ( b > 0 && a > INT64_MAX - b ) || ( b < 0 && a < -INT64_MAX - b ) )
+			{
+				return false;
+			}
+
+			out = a + b;
+			return true;
+		}
+
+		constexpr Rational MakeRational( int64_t num, int64_t den )
+		{
+			if ( den == 0 || num == INT64_MIN || den == INT64_MIN )
+			{
+				return {};
+			}
+
+			if ( den < 0 )
+			{
+				num = -num;
+				den = -den;
+			}
+
+			const int64_t g = Gcd( num, den );
+			return { num / g, den / g };
+		}
+
+		constexpr Rational Negate( Rational a )
+		{
+			return { -a.num, a.den };
+		}
+
+		constexpr Rational Add( Rational a, Rational b )
+		{
+			if ( !a.Exact() || !b.Exact() )
+			{
+				return {};
+			}
+
+			// over the least common denominator, so the terms grow no more than they must
+			const int64_t g = Gcd( a.den, b.den );
+			int64_t lhs = 0, rhs = 0, num = 0, den = 0;
+
+			if ( !CheckedMultiply( a.num, b.den / g, lhs ) || !CheckedMultiply( b.num, a.den / g, rhs )
+				 || !CheckedAdd( lhs, rhs, num ) || !CheckedMultiply( a.den / g, b.den, den ) )
+			{
+				return {};
+			}
+
+			return MakeRational( num, den );
+		}
+
+		constexpr Rational Subtract( Rational a, Rational b )
+		{
+			return Add( a, Negate( b ) );
+		}
+
+		constexpr Rational Multiply( Rational a, Rational b )
+		{
+			if ( !a.Exact() || !b.Exact() )
+			{
+				return {};
+			}
+
+			// cross cancelled first, as the terms are already in lowest terms
+			if ( a.num == 0 || b.num == 0 )
+			{
+				return { 0, 1 };
+			}
+
+			const int64_t g1 = Gcd( a.num, b.den );
+			const int64_t g2 = Gcd( b.num, a.den );
+			int64_t num = 0, den = 0;
+
+			if ( !CheckedMultiply( a.num / g1, b.num / g2, num ) || !CheckedMultiply( a.den / g2, b.den / g1, den ) )
+			{
+				return {};
+			}
+
+			return { num, den };
+		}
+
+		constexpr Rational Divide( Rational a, Rational b )
+		{
+			if ( !b.Exact() || b.num == 0 )
+			{
+				return {}; // the double gives inf or nan
+			}
+
+			return Multiply( a, ( b.num < 0 ) ? Rational{ -b.den, -b.num } : Rational{ b.den, b.num } );
+		}
+
+		// halves away from zero, as Round
+		constexpr Rational RoundRational( Rational a )
+		{
+			if ( !a.Exact() )
+			{
+				return {};
+			}
+
+			const int64_t rem = ( a.num % a.den < 0 ) ? -( a.num % a.den ) : a.num % a.den;
+			int64_t whole = a.num / a.den;
+
+			if ( rem >= a.den - rem )
+			{
+				whole += ( a.num < 0 ) ? -1 : 1;
+			}
+
+			return { whole, 1 };
+		}
+
+		// a whole exponent only; any other has no exact result to give
+		constexpr Rational Power( Rational base, Rational exponent )
+		{
+			if ( !base.Exact() || !exponent.Exact() || exponent.den != 1 || exponent.num > 64 || exponent.num < -64 )
+			{
+				return {};
+			}
+
+			Rational result = { 1, 1 };
+			for ( int64_t i = 0; i < ( ( exponent.num < 0 ) ? -exponent.num : exponent.num ); ++i )
+			{
+				result = Multiply( result, base );
+			}
+
+			return ( exponent.num < 0 ) ? Divide( { 1, 1 }, result ) : result;
+		}
+
+		constexpr double ToDouble( Rational a )
+		{
+			return double( a.num ) / double( a.den );
+		}
 	}
 
 	enum class UnitType
@@ -85,142 +331,1772 @@ namespace Numeric
 		Imperial,
 	};
 
+	// What a value is a quantity of, as far as can be told from the expression alone (see
+	// Compiler::SetDimensionChecking). A symbol's is Unknown unless it was defined with
+	// one, and so is a percentage, which is in the previous solution's units.
+	enum class Dimension : uint8_t
+	{
+		Unknown,
+		Unitless,
+		Length,
+		Area,
+	};
+
+	enum class UnitId : uint8_t
+	{
+		None,
+		Millimetre,
+		Centimetre,
+		Metre,
+		Kilometre,
+		Megametre,
+		Thou,
+		Inch,
+		Foot,
+		Yard,
+		Mile,
+		Count,
+	};
+
 	struct Unit
 	{
 		double scale = 1.0;
 		UnitType type = UnitType::Generic;
 	};
 
+	struct UnitLabel
+	{
+		double scale;
+		std::string_view name;
+	};
+
+	// The units of one system, built at compile time and selected by SetUnitOut.
+	struct UnitSystem
+	{
+		std::array<Unit, size_t( UnitId::Count )> units; // by UnitId; a scale of 0 means the system lacks the unit
+		std::array<UnitLabel, 10> labels; // names Format uses, by scale (unused entries have scale 0)
+	};
+
+	struct UnitAlias
+	{
+		std::string_view text;
+		UnitId id;
+	};
+
+	// The spellings of each unit
+	inline constexpr UnitAlias gUnitAliases[] =
+	{
+		{ "mm", UnitId::Millimetre },
+		{ "cm", UnitId::Centimetre },
+		{ "m", UnitId::Metre },
+		{ "Km", UnitId::Kilometre }, { "km", UnitId::Kilometre },
+		{ "Mm", UnitId::Megametre },
+		{ "th", UnitId::Thou }, { "thou", UnitId::Thou }, { "mil", UnitId::Thou },
+		{ "in", UnitId::Inch }, { "inch", UnitId::Inch }, { "inches", UnitId::Inch }, { "\"", UnitId::Inch },
+		{ "ft", UnitId::Foot }, { "foot", UnitId::Foot }, { "feet", UnitId::Foot }, { "'", UnitId::Foot },
+		{ "yd", UnitId::Yard }, { "yard", UnitId::Yard }, { "yds", UnitId::Yard }, { "yards", UnitId::Yard },
+		{ "mi", UnitId::Mile }, { "mile", UnitId::Mile }, { "miles", UnitId::Mile },
+	};
+
 	struct Solution
 	{
 		double value;
 		Unit units;
+		math::Rational exact; // value, exactly, when it can be carried so (see SetExactImperial)
 	};
 
-	struct Token
+	// One step of normalising a result into friendlier units: from one scale to another,
+	// when the value in the first passes a test, and (if whole is set) only if it is a
+	// whole number in that scale.
+	enum class NormaliseTest : uint8_t
 	{
-		enum class Type
-		{
-			Unknown,
-			Literal_Numeric,
-			Operator,
-			Parenthesis_Open,
-			Parenthesis_Close,
-			Symbol,
-			Unit,
-		};
-
-		size_t pos = 0;
-		Type type = Type::Unknown;
-		std::string text = "";
-		double value = 0.0;
-
-	public:
-		std::string str() const;
+		Always,
+		AtLeast,	// value >= bound
+		Above,		// value > bound
+		Below,		// value < bound
 	};
 
-	struct Operator
+	struct NormaliseRule
 	{
-		int precedence = 0;
-		int arguments = 0;
+		double from;
+		double to;
+		NormaliseTest test = NormaliseTest::Always;
+		double bound = 0.0;
+		double whole = 0.0;
 	};
 
-	class CompilerError : public std::exception
+	// Normalising applies the first rule that fits until none does. Every test is on the
+	// magnitude of the value in base units, so it comes down to which of a few bounds that
+	// reaches: the table runs the rules at compile time for each start scale, count of
+	// bounds reached and set of whole-number tests passed, and keeps where they end.
+	// Normalising a result is then one lookup.
+	template < size_t uRules >
+	class NormaliseTable
 	{
 	public:
+		constexpr NormaliseTable( const NormaliseRule ( &rules )[ uRules ] );
 
-		enum class Stage
+		constexpr void Apply( Solution& result ) const;
+
+	private:
+		static constexpr size_t _maxScales = 2 * uRules;
+		static constexpr size_t _maxWholes = 3;
+		static constexpr size_t _buckets = uRules + 2; // bounds reached, 0 to uRules; and NaN, which reaches none
+
+		std::array<double, _maxScales> _scales = {};
+		std::array<double, uRules> _bounds = {}; // least magnitude passing each test, ascending
+		std::array<double, _maxWholes> _wholes = {};
+		size_t _scaleCount = 0;
+		size_t _boundCount = 0;
+		size_t _wholeCount = 0;
+
+		// index of the final scale, by start scale, bucket and whole-number tests passed
+		std::array<uint8_t, _maxScales * _buckets << _maxWholes> _decisions = {};
+	};
+
+	template < size_t uRules >
+	constexpr NormaliseTable<uRules>::NormaliseTable( const NormaliseRule ( &rules )[ uRules ] )
+	{
+		auto indexOf = []( auto& values, size_t& uCount, double value )
 		{
-			Parser,
-			Solver
+			for ( size_t i = 0; i < uCount; ++i )
+			{
+				if ( values[ i ] == value )
+				{
+					return i;
+				}
+			}
+
+			values[ uCount ] = value;
+			return uCount++;
 		};
 
-		CompilerError( Stage stage, const std::string& sMsg );
+		// The least magnitude that passes a rule's test (or for Below, fails it), found from
+		// the same division the test does, so it never disagrees with it.
+		std::array<double, uRules> ruleBounds = {};
 
-	public:
-		const char* what() const override
+		for ( size_t r = 0; r < uRules; ++r )
 		{
-			return _message.c_str();
-		}
+			const NormaliseRule& rule = rules[ r ];
 
-	private:
-		std::string _message;
-	};
+			indexOf( _scales, _scaleCount, rule.from );
+			indexOf( _scales, _scaleCount, rule.to );
 
-	class Compiler
-	{
+			if ( rule.whole != 0.0 )
+			{
+				indexOf( _wholes, _wholeCount, rule.whole );
+			}
 
-	public:
-		Compiler();
-		virtual ~Compiler() {}
+			if ( rule.test == NormaliseTest::Always )
+			{
+				continue;
+			}
 
-	public: // configuration
-		void SetUnitOut( const UnitType type );
-		void SetImperialFractions( bool enable ) { _imperialFractions = enable; }
+			auto passes = [ & ]( double magnitude )
+			{
+				const double value = magnitude / rule.from;
+				return ( rule.test == NormaliseTest::Above ) ? ( value > rule.bound ) : ( value >= rule.bound );
+			};
 
-	public: // general use
-		Solution Eval( const std::string& sInput, const Solution* pPrevSolution );
-		const std::string Format( const Solution& result ) const;
+			auto step = []( double magnitude, int64_t delta )
+			{
+				return std::bit_cast<double>( std::bit_cast<int64_t>( magnitude ) + delta );
+			};
 
-	public: // low level access
-		const Unit DefaultUnit() const;
-		std::vector<Token> Parse( const std::string& sInput );
-		Solution Solve( const std::vector<Token>& vTokens, const Solution* pPrevSolution );
+			double magnitude = rule.bound * rule.from;
 
-	private:
+			while ( !passes( magnitude ) )
+			{
+				magnitude = step( magnitude, 1 );
+			}
 
-		static bool IsEpsilonInteger( double d )
+			while ( passes( step( magnitude, -1 ) ) )
+			{
+				magnitude = step( magnitude, -1 );
+			}
+
+			ruleBounds[ r ] = magnitude;
+
+			// kept sorted, each once
+			size_t i = 0;
+			while ( i < _boundCount && _bounds[ i ] < magnitude )
+			{
+				++i;
+			}
+
+			if ( i == _boundCount || _bounds[ i ] != magnitude )
+			{
+				for ( size_t j = _boundCount++; j > i; --j )
+				{
+					_bounds[ j ] = _bounds[ j - 1 ];
+				}
+
+				_bounds[ i ] = magnitude;
+			}
+		}
+
+		auto fits = [ & ]( size_t r, size_t uBucket, size_t uWhole )
+		{
+			const NormaliseRule& rule = rules[ r ];
+
+			if ( rule.whole != 0.0 && !( uWhole & ( size_t( 1 ) << indexOf( _wholes, _wholeCount, rule.whole ) ) ) )
+			{
+				return false;
+			}
+
+			if ( rule.test == NormaliseTest::Always )
+			{
+				return true;
+			}
+
+			if ( uBucket == _boundCount + 1 )
+			{
+				return false; // NaN fails every comparison
+			}
+
+			const bool bReached = uBucket > indexOf( _bounds, _boundCount, ruleBounds[ r ] );
+			return ( rule.test == NormaliseTest::Below ) ? !bReached : bReached;
+		};
+
+		// (rules that never settle would loop here, and stop the build)
+		for ( size_t uFrom = 0; uFrom < _scaleCount; ++uFrom )
 		{
-			const double delta = d - round( d );
-			return fabs( delta ) <= 1e-14;
+			for ( size_t uBucket = 0; uBucket <= _boundCount + 1; ++uBucket )
+			{
+				for ( size_t uWhole = 0; uWhole < ( size_t( 1 ) << _wholeCount ); ++uWhole )
+				{
+					size_t uScale = uFrom;
+
+					for ( size_t r = 0; r < uRules; )
+					{
+						if ( rules[ r ].from == _scales[ uScale ] && fits( r, uBucket, uWhole ) )
+						{
+							uScale = indexOf( _scales, _scaleCount, rules[ r ].to );
+							r = 0;
+						}
+						else
+						{
+							++r;
+						}
+					}
+
+					_decisions[ ( uFrom * _buckets + uBucket ) << _maxWholes | uWhole ] = uint8_t( uScale );
+				}
+			}
 		}
+	}
 
-		const std::string UnitName( const Unit& unit ) const;
-		void NormaliseImperial( Solution& result );
-		void NormaliseMetric( Solution& result );
+	template < size_t uRules >
+	constexpr void NormaliseTable<uRules>::Apply( Solution& result ) const
+	{
+		size_t uFrom = 0;
+		while ( uFrom < _scaleCount && _scales[ uFrom ] != result.units.scale )
+		{
+			++uFrom;
+		}
 
-	private:
+		if ( uFrom == _scaleCount )
+		{
+			return; // no rule starts from these units
+		}
 
-		void SetupInput( const std::string& input );
-		char PeekInput();
+		const double magnitude = math::Abs( result.value );
 
-		inline void NextInput()
+		size_t uBucket = ( magnitude == magnitude ) ? 0 : _boundCount + 1;
+		for ( size_t i = 0; i < _boundCount; ++i )
 		{
-			++_inputStream;
-			++_inputPos;
+			uBucket += size_t( magnitude >= _bounds[ i ] );
 		}
 
-		std::string::const_iterator _inputStream;
-		std::string::const_iterator _inputStreamEnd;
-		size_t _inputPos = 0;
+		size_t uWhole = 0;
+		for ( size_t i = 0; i < _wholeCount; ++i )
+		{
+			uWhole |= size_t( math::IsEpsilonInteger( result.value / _wholes[ i ] ) ) << i;
+		}
 
-	private:
+		result.units.scale = _scales[ _decisions[ ( uFrom * _buckets + uBucket ) << _maxWholes | uWhole ] ];
+	}
 
-		static constexpr double _metricScaleInch = 0.0254;
-		static constexpr double _metricScaleFoot = 0.3048;
-		static constexpr double _metricScaleYard = 0.9144;
-		static constexpr double _metricScaleMile = 1609.344;
+	enum class OperatorType : uint8_t
+	{
+		None,
+		Multiply,
+		Divide,
+		Add,
+		Subtract,
+		UnaryPlus,
+		UnaryMinus,
+		Power,
+		Percent,
+		Min,
+		Max,
+		Round,
+		Sqrt,
+		Count,
+	};
 
-		static constexpr double _impScaleThou = 1;
-		static constexpr double _impScaleInch = 1000;
-		static constexpr double _impScaleFoot = 12 * _impScaleInch;
-		static constexpr double _impScaleYard = 3 * _impScaleFoot;
-		static constexpr double _impScaleMile = 5280 * _impScaleFoot;
+	// A vector of trivially copyable T that keeps its first N elements in place, so a short
+	// one doesn't allocate; past that they move to the heap, as in a std::vector.
+	template <typename T, size_t N>
+	class SmallVector
+	{
+		static_assert( std::is_trivially_copyable_v<T> );
 
-	private:
+	public:
+		SmallVector() = default;
 
-		char _localeDecimalPoint = '.';
+		SmallVector( const SmallVector& other )
+		{
+			*this = other;
+		}
 
-		bool _imperialFractions = true;
-		
-		std::unordered_map<std::string, Operator> _mapOperators;
+		SmallVector( SmallVector&& other ) noexcept
+		{
+			*this = std::move( other );
+		}
 
-		// units tables
-		UnitType _desiredUnitType = UnitType::Metric;
-		std::unordered_map<std::string, Unit> _mapUnits;
-		std::unordered_map<double, std::string> _mapUnitLookup;
+		SmallVector& operator=( const SmallVector& other )
+		{
+			if ( this != &other )
+			{
+				reserve( other._size );
+				std::memcpy( _pData, other._pData, other._size * sizeof( T ) );
+				_size = other._size;
+			}
+			return *this;
+		}
 
-	}; // class Compiler
+		SmallVector& operator=( SmallVector&& other ) noexcept
+		{
+			if ( this == &other )
+			{
+				return *this;
+			}
+
+			if ( other._pHeap )
+			{
+				// take the heap buffer over
+				_pHeap = std::move( other._pHeap );
+				_pData = _pHeap.get();
+				_size = other._size;
+				_capacity = other._capacity;
+
+				other._pData = other._inline;
+				other._capacity = N;
+			}
+			else
+			{
+				*this = static_cast<const SmallVector&>( other );
+			}
+
+			other._size = 0;
+			return *this;
+		}
+
+		size_t size() const { return _size; }
+		size_t capacity() const { return _capacity; }
+		bool empty() const { return _size == 0; }
+
+		T* data() { return _pData; }
+		const T* data() const { return _pData; }
+		T* begin() { return _pData; }
+		T* end() { return _pData + _size; }
+		const T* begin() const { return _pData; }
+		const T* end() const { return _pData + _size; }
+
+		T& operator[]( size_t i ) { return _pData[ i ]; }
+		const T& operator[]( size_t i ) const { return _pData[ i ]; }
+		T& back() { return _pData[ _size - 1 ]; }
+		const T& back() const { return _pData[ _size - 1 ]; }
+
+		void push_back( const T& value )
+		{
+			if ( _size == _capacity )
+			{
+				const T copy = value; // value may be one of ours
+				reserve( _capacity * 2 );
+				_pData[ _size++ ] = copy;
+			}
+			else
+			{
+				_pData[ _size++ ] = value;
+			}
+		}
+
+		void pop_back() { --_size; }
+		void clear() { _size = 0; }
+
+		// shrinking keeps the capacity, growing adds default elements
+		void resize( size_t uSize )
+		{
+			reserve( uSize );
+			for ( size_t i = _size; i < uSize; ++i )
+			{
+				_pData[ i ] = T{};
+			}
+			_size = uSize;
+		}
+
+		void reserve( size_t uCapacity )
+		{
+			if ( uCapacity <= _capacity )
+			{
+				return;
+			}
+
+			std::unique_ptr<T[]> pHeap( new T[ uCapacity ] );
+			std::memcpy( pHeap.get(), _pData, _size * sizeof( T ) );
+			_pHeap = std::move( pHeap );
+			_pData = _pHeap.get();
+			_capacity = uCapacity;
+		}
+
+	private:
+		T* _pData = _inline;
+		size_t _size = 0;
+		size_t _capacity = N;
+		std::unique_ptr<T[]> _pHeap;
+		T _inline[ N ];
+	};
+
+	// 16 bytes: a token names its text by where it is in the parsed input, which the
+	// TokenList it is in holds, and keeps its operator or unit in one byte.
+	struct Token
+	{
+		enum class Type : uint8_t
+		{
+			Unknown,
+			Literal_Numeric,
+			Operator,
+			Parenthesis_Open,
+			Parenthesis_Close,
+			Symbol,
+			Unit,
+			Function,
+			Separator,
+		};
+
+		double value = 0.0;
+		uint32_t pos = 0; // offset of the token's text in the parsed input
+		uint16_t length = 0; // of its text
+		Type type = Type::Unknown;
+		uint8_t id = 0; // the UnitId of a Unit, else the OperatorType (see Op and UnitID)
+
+	public:
+		// of an Operator or Function, or of the call a Parenthesis_Open opens
+		OperatorType Op() const { return ( type == Type::Unit ) ? OperatorType::None : OperatorType( id ); }
+		UnitId UnitID() const { return ( type == Type::Unit ) ? UnitId( id ) : UnitId::None; }
+		void SetOp( OperatorType op ) { id = uint8_t( op ); }
+		void SetUnitID( UnitId unit ) { id = uint8_t( unit ); }
+
+		std::string_view Text( std::string_view svInput ) const { return svInput.substr( pos, length ); }
+		std::string str( std::string_view svInput ) const;
+	};
+
+	static_assert( sizeof( Token ) == 16 );
+
+	// The tokens of a parsed input, and the input their text is in (which must outlive the
+	// list). Most expressions fit in place, without an allocation.
+	struct TokenList : SmallVector<Token, 32>
+	{
+		std::string_view input;
+
+		std::string_view Text( const Token& token ) const { return token.Text( input ); }
+	};
+
+	struct Operator
+	{
+		int precedence = 0;
+		int arguments = 0;
+	};
+
+	// Lets maps keyed by std::string be searched with a std::string_view, without a copy.
+	struct StringHash
+	{
+		using is_transparent = void;
+
+		size_t operator()( std::string_view sv ) const
+		{
+			return std::hash<std::string_view>{}( sv );
+		}
+	};
+
+	enum class ErrorCode : uint8_t
+	{
+		None,
+
+		// Parser
+		NoInput,
+		UnknownCharacter,
+		BadNumericConstruction,
+		InvalidPrefixedLiteral,
+		UnknownOperator,
+		UnbalancedParenthesis,
+
+		// Solver
+		UnexpectedCloseParenthesis,
+		NoOpenParenthesis,
+		UnknownSymbol,
+		UnsupportedToken,
+		MalformedExpression,
+		UnexpectedToken,
+		IndeterminateExpression,
+		NoSymbolValues,
+		BadArguments,
+		NoPreviousValue,
+		DimensionMismatch,
+	};
+
+	// What went wrong and where: pos is the offset in the input, and text the part of it
+	// at fault (a view into the input, so only good for as long as that is).
+	struct Error
+	{
+		ErrorCode code = ErrorCode::None;
+		size_t pos = 0;
+		std::string_view text;
+
+		constexpr explicit operator bool() const { return code != ErrorCode::None; }
+	};
+
+	// A value, or the Error that prevented it; returned by the Try functions, which don't throw.
+	template <typename T>
+	struct Result
+	{
+		T value{};
+		Error error;
+
+		constexpr bool ok() const { return !error; }
+	};
+
+	// The text CompilerError::what() gives for an error, e.g. "[PARSE] Unknown operator: *+"
+	std::string ErrorMessage( const Error& error );
+
+	class CompilerError : public std::exception
+	{
+	public:
+
+		enum class Stage
+		{
+			Parser,
+			Solver
+		};
+
+		CompilerError( Stage stage, const std::string& sMsg );
+		CompilerError( const Error& error );
+
+		ErrorCode code() const { return _code; }
+		size_t pos() const { return _pos; }
+
+	public:
+		const char* what() const override
+		{
+			return _message.c_str();
+		}
+
+	private:
+		std::string _message;
+		ErrorCode _code = ErrorCode::None;
+		size_t _pos = 0;
+	};
+
+	// An expression compiled once by Compiler::Compile, to be evaluated any number of times:
+	// reverse-polish bytecode, with its literals and units as constants. Eval is a plain
+	// loop over the code with a fixed stack; the expression was checked when compiled, so
+	// it only fails if it uses symbols and no values are given. Symbols read the slot they
+	// were bound to in pSymbolValues. The units setup of the Compiler is fixed at the time
+	// of Compile.
+	// One input column for CompiledExpression::EvalBatch: a symbol's value for every row,
+	// stored like Solution::value, with the same units for all rows.
+	struct SymbolColumn
+	{
+		const double* pValues = nullptr;
+		Unit units;
+	};
+
+	class CompiledExpression
+	{
+
+	public:
+		Solution Eval( const Solution* pPrevSolution, const Solution* pSymbolValues = nullptr ) const;
+		Result<Solution> TryEval( const Solution* pPrevSolution, const Solution* pSymbolValues = nullptr ) const;
+
+		// Eval for uRows rows at once, reading symbol slot n from pColumns[ n ] and writing
+		// one Solution per row to pOutput. Each opcode runs across a block of rows in turn.
+		void EvalBatch( const Solution* pPrevSolution, const SymbolColumn* pColumns, size_t uRows, Solution* pOutput ) const;
+
+		// number of entries pSymbolValues (or pColumns) must hold: the highest slot used, plus one.
+		size_t SymbolSlots() const { return _symbolSlots; }
+
+		// what the result is a quantity of, when compiled with dimension checking; Unknown if not.
+		Dimension ResultDimension() const { return _dimension; }
+
+	private:
+		friend class Compiler;
+		friend class CompiledChain;
+		friend class JitExpression;
+		friend class LiteralEvaluator;
+
+		enum class OpCode : uint8_t
+		{
+			Literal,		// push _literals[ operand ]
+			Symbol,			// push pSymbolValues[ operand ]
+			Unit,			// apply _units[ operand ] to the top value
+			Add,
+			Subtract,
+			Multiply,
+			Divide,
+			UnaryPlus,
+			UnaryMinus,
+			Power,
+			Min,
+			Max,
+			Round,
+			Sqrt,
+			Percent,		// the top value, as a percentage of the previous solution
+			Finish,			// end of link operand of a CompiledChain (only there)
+		};
+
+		struct Instruction
+		{
+			OpCode op;
+			uint32_t operand = 0;
+		};
+
+		struct UnitConstant
+		{
+			double value = 1.0; // multiplier carried by the unit token
+			Unit unit;
+			math::Rational exact; // value, exactly, in exact imperial
+		};
+
+		std::vector<Instruction> _code;
+		std::vector<Solution> _literals; // with units, once folded
+		std::vector<UnitConstant> _units;
+
+		size_t _maxDepth = 0; // of the value stack
+		size_t _symbolSlots = 0;
+		bool _explicitUnits = false;
+		bool _readsPrevious = false; // by %, so Eval needs a previous solution
+		UnitType _desiredUnitType = UnitType::Metric;
+		Dimension _dimension = Dimension::Unknown;
+
+		static constexpr size_t _localStackSize = 32;
+		static constexpr size_t _batchBlockSize = 256; // rows per pass of EvalBatch
+
+		void Fold();
+
+		static constexpr void Finish( Solution& result, bool bExplicitUnits, const Solution* pPrevSolution, UnitType desiredUnitType );
+		static constexpr Solution SolveBinary( OpCode op, const Solution& lhs, const Solution& rhs, UnitType desiredUnitType );
+		static constexpr math::Rational SolveBinaryExact( OpCode op, const Solution& lhs, const Solution& rhs );
+		static void SolveUnary( OpCode op, Solution& mem );
+
+		// one instruction of the solver, on the stack stkSolve of depth values
+		void Step( const Instruction& inst, Solution* stkSolve, size_t& depth, bool& bExplicitUnits, const Solution* pPrevSolution, const Solution* pSymbolValues, UnitType desiredUnitType ) const;
+	};
+
+	// Compiled expressions for a run of fields, each taking the solution of the one before
+	// as its previous solution (the first, the one given to Eval). The links' code is joined
+	// into one program, so the whole chain is solved in a single pass.
+	class CompiledChain
+	{
+
+	public:
+		// adds expr as the last link; its symbols share the one set of values.
+		void Append( const CompiledExpression& expr );
+		void Clear();
+
+		size_t Links() const { return _links.size(); }
+		size_t SymbolSlots() const { return _program._symbolSlots; }
+
+		// writes each link's solution, in order, to pOutput, which holds Links() entries.
+		void Eval( const Solution* pPrevSolution, const Solution* pSymbolValues, Solution* pOutput ) const;
+		Error TryEval( const Solution* pPrevSolution, const Solution* pSymbolValues, Solution* pOutput ) const;
+
+	private:
+		using OpCode = CompiledExpression::OpCode;
+
+		struct Link
+		{
+			bool explicitUnits;
+			UnitType desiredUnitType;
+		};
+
+		CompiledExpression _program; // each link's code then a Finish, over the literals and units of all
+		std::vector<Link> _links;
+	};
+
+	// A CompiledExpression translated to native code, for an inner loop that evaluates it far
+	// more often than it changes. The units of every step are settled when it is made, from
+	// the symbol values (and previous solution) given as an example, so only the arithmetic
+	// on the values is left to run, with the solver's own operations in its order. Eval
+	// checks that the symbols and previous solution come in those units; if they don't, or
+	// the expression couldn't be translated, it runs the solver instead, to the same result.
+	// x86-64 only: elsewhere, and for expressions with exact values (SetExactImperial) or
+	// deeper than the solver's local stack, Native() is false and Eval always falls back.
+	class JitExpression
+	{
+
+	public:
+		explicit JitExpression( const CompiledExpression& expr, const Solution* pPrevSolution = nullptr, const Solution* pSymbolValues = nullptr );
+		~JitExpression();
+
+		JitExpression( JitExpression&& other ) noexcept;
+		JitExpression& operator=( JitExpression&& other ) noexcept;
+		JitExpression( const JitExpression& ) = delete;
+		JitExpression& operator=( const JitExpression& ) = delete;
+
+		Solution Eval( const Solution* pPrevSolution, const Solution* pSymbolValues = nullptr ) const;
+		Result<Solution> TryEval( const Solution* pPrevSolution, const Solution* pSymbolValues = nullptr ) const;
+
+		bool Native() const { return _pCode != nullptr; }
+
+	private:
+		using OpCode = CompiledExpression::OpCode;
+		using Function = double ( * )( const Solution* pSymbolValues, const Solution* pPrevSolution, double* pStack );
+
+		bool Translate( const Solution* pPrevSolution, const Solution* pSymbolValues );
+		void Release();
+
+		struct SymbolGuard
+		{
+			uint32_t slot;
+			Unit units;
+		};
+
+		CompiledExpression _expr;
+
+		void* _pCode = nullptr; // executable pages of _codeSize bytes, holding a Function
+		size_t _codeSize = 0;
+
+		std::vector<SymbolGuard> _symbolGuards; // the units each symbol read was translated for
+		Unit _prevUnits; // and those of the previous solution, for %
+		Unit _resultUnits;
+		bool _explicitUnits = false;
+	};
+
+	// The solutions of Compiler::EvalBulk, an entry per input in each array: the value and
+	// units of its solution, or 0 in generic units and the reason when it has none.
+	struct BulkResult
+	{
+		std::vector<double> values;
+		std::vector<Unit> units;
+		std::vector<ErrorCode> errors; // ErrorCode::None for those that were solved
+		size_t failed = 0;
+	};
+
+	// A Compiler keeps scratch buffers between calls, so each thread needs its own; the
+	// configuration can be shared, though. Set up a Config, then hand the same
+	// std::shared_ptr<const Config> to a Compiler per thread: nothing changes a Config once
+	// shared, so reading it needs no locks.
+	class Compiler
+	{
+
+	public:
+		// Output units, fraction formatting and the symbol table.
+		class Config
+		{
+
+		public:
+			Config( const UnitType unitOut = UnitType::Generic );
+
+			void SetUnitOut( const UnitType type );
+			void SetImperialFractions( bool enable ) { _imperialFractions = enable; }
+			void SetExactImperial( bool enable ) { _exactImperial = enable; }
+			void SetDimensionChecking( bool enable ) { _dimensionChecking = enable; }
+			void DefineSymbol( const std::string& sName, uint32_t uSlot, Dimension dimension = Dimension::Unknown ) { _mapSymbols[ sName ] = { uSlot, dimension }; }
+			void ClearSymbols() { _mapSymbols.clear(); }
+
+		private:
+			friend class Compiler;
+
+			char _localeDecimalPoint = '.';
+			bool _imperialFractions = true;
+			bool _exactImperial = false;
+			bool _dimensionChecking = false;
+
+			// units tables
+			UnitType _desiredUnitType = UnitType::Metric;
+			const UnitSystem* _pUnitSystem = nullptr;
+
+			// symbol table, name to slot in the values given to CompiledExpression::Eval
+			struct Symbol
+			{
+				uint32_t slot;
+				Dimension dimension;
+			};
+
+			std::unordered_map<std::string, Symbol, StringHash, std::equal_to<>> _mapSymbols;
+		};
+
+	public:
+		Compiler();
+		explicit Compiler( std::shared_ptr<const Config> pConfig );
+		virtual ~Compiler() {}
+
+	public: // configuration; a shared Config is copied before the first change
+		void SetUnitOut( const UnitType type );
+		void SetImperialFractions( bool enable ) { EditConfig().SetImperialFractions( enable ); }
+
+		// Imperial output only: carry each value as an exact fraction (of 64-bit terms) beside
+		// its double, so 1/3in + 1/3in + 1/3in is 1in and Format reduces the fraction instead of
+		// searching for it. Decimals and metric units stay exact (1mm is 5000/127 thou); sqrt, a
+		// power that isn't whole, a symbol value that isn't exact or a term too large to hold leave a value inexact,
+		// and it is formatted from its double as before. Off by default.
+		void SetExactImperial( bool enable ) { EditConfig().SetExactImperial( enable ); ClearCache(); }
+
+		// Give each value a Dimension as the expression is compiled (a literal is Unitless,
+		// one with units a Length, and the product of two Lengths an Area), and fail with
+		// DimensionMismatch where they don't go together: 3m + 2, 2in * 3in + 1in, sqrt( 2m ),
+		// or a unit on what already has one. A symbol defined with a dimension is held to it;
+		// one without, or a percentage, goes with anything. Nothing is checked as the
+		// expression is run. Off by default, when a plain number is taken in the other
+		// side's units.
+		void SetDimensionChecking( bool enable ) { EditConfig().SetDimensionChecking( enable ); ClearCache(); }
+		void DefineSymbol( const std::string& sName, uint32_t uSlot, Dimension dimension = Dimension::Unknown ) { EditConfig().DefineSymbol( sName, uSlot, dimension ); ClearCache(); }
+		void ClearSymbols() { EditConfig().ClearSymbols(); ClearCache(); }
+
+		// Keep up to uEntries compiled expressions, by input text and output units, so that Eval
+		// of an input seen before skips tokenising and compiling. 0 (the default) turns it off.
+		void SetCacheSize( size_t uEntries );
+		void ClearCache();
+		size_t CacheHits() const { return _cacheHits; }
+		size_t CacheMisses() const { return _cacheMisses; }
+
+	public: // general use
+		Solution Eval( const std::string& sInput, const Solution* pPrevSolution );
+		CompiledExpression Compile( const std::string& sInput );
+		const std::string Format( const Solution& result ) const;
+
+		// Format without allocating: into sOut, reusing its capacity, or into a caller's
+		// buffer. FormatTo works like snprintf: it returns the full length of the text and
+		// writes as much as fits in uSize, always null terminated when uSize > 0.
+		void Format( const Solution& result, std::string& sOut ) const;
+		size_t FormatTo( const Solution& result, char* pBuffer, size_t uSize ) const;
+
+		// Eval and Compile, reporting errors in the result instead of throwing.
+		Result<Solution> TryEval( const std::string& sInput, const Solution* pPrevSolution );
+		Result<CompiledExpression> TryCompile( const std::string& sInput );
+
+		// TryEval of many inputs at once, such as the cells of a pasted column, each with the
+		// same previous solution. On uThreads threads (0 for one per core, the calling thread
+		// one of them), each taking chunks of the inputs in turn with a Compiler of its own
+		// over this one's Config (and a cache of the same size). The inputs aren't kept.
+		BulkResult EvalBulk( std::span<const std::string_view> vInputs, const Solution* pPrevSolution, unsigned uThreads = 0 ) const;
+
+		// Eval for a live preview, as the input is edited: only the input from the first
+		// changed character on is tokenised again. Returns false, with the reason in
+		// PreviewError, rather than throwing when the input isn't valid (yet).
+		bool Preview( const std::string& sInput, const Solution* pPrevSolution, Solution& result );
+		const std::string& PreviewError() const { return _previewError; }
+
+	public: // low level access
+		const Unit DefaultUnit() const;
+		TokenList Parse( const std::string& sInput );
+		Solution Solve( const TokenList& vTokens, const Solution* pPrevSolution );
+		CompiledExpression Compile( const TokenList& vTokens );
+
+	private:
+		friend class CompiledExpression;
+		friend class LiteralEvaluator;
+
+		Error ParseInto( const std::string& sInput, TokenList& vecOutputTokens, size_t uKeepTokens = 0 );
+		Error CompileInto( const TokenList& vTokens, CompiledExpression& expr );
+		Result<Solution> TrySolve( const TokenList& vTokens, const Solution* pPrevSolution );
+		Result<Solution> TryEvalCached( const std::string& sInput, const Solution* pPrevSolution );
+
+		static constexpr Unit DefaultUnit( const UnitType type );
+		static constexpr math::Rational ExactScale( double scale );
+		std::string_view UnitName( const Unit& unit ) const;
+		size_t FormatChars( const Solution& result, char* pText ) const;
+		static constexpr void NormaliseImperial( Solution& result );
+		static constexpr void NormaliseMetric( Solution& result );
+
+		Config& EditConfig();
+
+	private:
+
+		static constexpr double _metricScaleInch = 0.0254;
+		static constexpr double _metricScaleFoot = 0.3048;
+		static constexpr double _metricScaleYard = 0.9144;
+		static constexpr double _metricScaleMile = 1609.344;
+
+		static constexpr double _impScaleThou = 1;
+		static constexpr double _impScaleInch = 1000;
+		static constexpr double _impScaleFoot = 12 * _impScaleInch;
+		static constexpr double _impScaleYard = 3 * _impScaleFoot;
+		static constexpr double _impScaleMile = 5280 * _impScaleFoot;
+
+		static constexpr UnitSystem _imperialSystem =
+		{
+			{ {
+				{ 0.0, UnitType::Generic },								// None
+				{ 1.0 / _metricScaleInch, UnitType::Metric },			// Millimetre
+				{ 10.0 / _metricScaleInch, UnitType::Metric },			// Centimetre
+				{ 1000.0 / _metricScaleInch, UnitType::Metric },		// Metre
+				{ 1000000.0 / _metricScaleInch, UnitType::Metric },		// Kilometre
+				{ 1000000000.0 / _metricScaleInch, UnitType::Metric },	// Megametre
+				{ _impScaleThou, UnitType::Imperial },					// Thou
+				{ _impScaleInch, UnitType::Imperial },					// Inch
+				{ _impScaleFoot, UnitType::Imperial },					// Foot
+				{ _impScaleYard, UnitType::Imperial },					// Yard
+				{ _impScaleMile, UnitType::Imperial },					// Mile
+			} },
+			{ {
+				{ 0.001 / _metricScaleFoot, "mm" },
+				{ 0.01 / _metricScaleFoot, "cm" },
+				{ 1 / _metricScaleFoot, "m" },
+				{ 1000 / _metricScaleFoot, "Km" },
+				{ 1000000 / _metricScaleFoot, "Mm" },
+				{ _impScaleThou, "th" },
+				{ _impScaleInch, "in" },
+				{ _impScaleFoot, "ft" },
+				{ _impScaleYard, "yd" },
+				{ _impScaleMile, "mi" },
+			} },
+		};
+
+		// The scales of _imperialSystem, exactly, by UnitId: an inch is 25.4mm, so 1mm is
+		// 1000 / 25.4 = 5000 / 127 thou.
+		static constexpr std::array<math::Rational, size_t( UnitId::Count )> _imperialExactScales =
+		{ {
+			{ 0, 0 },					// None
+			{ 5000, 127 },				// Millimetre
+			{ 50000, 127 },				// Centimetre
+			{ 5000000, 127 },			// Metre
+			{ 5000000000, 127 },		// Kilometre
+			{ 5000000000000, 127 },		// Megametre
+			{ 1, 1 },					// Thou
+			{ 1000, 1 },				// Inch
+			{ 12000, 1 },				// Foot
+			{ 36000, 1 },				// Yard
+			{ 63360000, 1 },			// Mile
+		} };
+
+		static constexpr UnitSystem _metricSystem =
+		{
+			{ {
+				{ 0.0, UnitType::Generic },								// None
+				{ 0.001, UnitType::Metric },							// Millimetre
+				{ 0.01, UnitType::Metric },								// Centimetre
+				{ 1, UnitType::Metric },								// Metre
+				{ 1000, UnitType::Metric },								// Kilometre
+				{ 1000000, UnitType::Metric },							// Megametre
+				{ 0.0, UnitType::Generic },								// Thou (imperial system only)
+				{ _metricScaleInch, UnitType::Imperial },				// Inch
+				{ _metricScaleFoot, UnitType::Imperial },				// Foot
+				{ _metricScaleYard, UnitType::Imperial },				// Yard
+				{ _metricScaleMile, UnitType::Imperial },				// Mile
+			} },
+			{ {
+				{ 0.001, "mm" },
+				{ 0.01, "cm" },
+				{ 1, "m" },
+				{ 1000, "Km" },
+				{ 1000000, "Mm" },
+				{ _metricScaleInch, "in" },
+				{ _metricScaleFoot, "ft" },
+				{ _metricScaleYard, "yd" },
+				{ _metricScaleMile, "mi" },
+				{ 0.0, "" },
+			} },
+		};
+
+		// Normalisation of results, tried in order (see NormaliseTable).
+		static constexpr auto _imperialNormalise = NormaliseTable(
+		{
+			{ _impScaleThou, _impScaleInch, NormaliseTest::AtLeast, 1000 },								// th to in, from 1in
+			{ _impScaleInch, _impScaleFoot, NormaliseTest::Above, 72 },									// in to ft, fractions or not, over 6ft
+			{ _impScaleInch, _impScaleFoot, NormaliseTest::AtLeast, 12, _impScaleFoot },				// in to ft, if it doesn't create a fraction
+#if OUTPUT_TO_YARDS
+			{ _impScaleFoot, _impScaleYard, NormaliseTest::AtLeast, 12, _impScaleYard },				// ft to yd, if it doesn't create a fraction
+#else // OUTPUT_TO_YARDS
+			{ _impScaleYard, _impScaleFoot },															// yd to ft
+#endif // OUTPUT_TO_YARDS
+			{ _impScaleFoot, _impScaleMile, NormaliseTest::AtLeast, 5280, _impScaleMile },				// ft to mi, if it doesn't create a fraction
+			{ _impScaleYard, _impScaleMile, NormaliseTest::AtLeast, 1760, _impScaleMile },				// yd to mi, if it doesn't create a fraction
+		} );
+
+		static constexpr auto _metricNormalise = NormaliseTable(
+		{
+			{ 1000, 1000000, NormaliseTest::AtLeast, 1000 },		// km to Mm
+			{ 1, 1000, NormaliseTest::AtLeast, 1000 },				// m to km
+			{ 0.001, 1, NormaliseTest::AtLeast, 1000 },				// mm to m
+#if OUTPUT_TO_CM
+			{ 0.001, 0.01, NormaliseTest::AtLeast, 100 },			// mm to cm
+			{ 0.01, 1, NormaliseTest::AtLeast, 100 },				// cm to m
+#else // OUTPUT_TO_CM
+			{ 0.01, 1 },											// cm to m
+#endif // OUTPUT_TO_CM
+			{ 1000000, 1000, NormaliseTest::Below, 1 },				// Mm to km
+			{ 1000, 1, NormaliseTest::Below, 1 },					// km to m
+#if OUTPUT_TO_CM
+			{ 1, 0.01, NormaliseTest::Below, 1 },					// m to cm
+			{ 0.01, 0.001, NormaliseTest::Below, 1 },				// cm to mm
+#else // OUTPUT_TO_CM
+			{ 1, 0.001, NormaliseTest::Below, 1 },					// m to mm
+#endif // OUTPUT_TO_CM
+		} );
+
+	private:
+
+		// Longest text FormatChars writes: a fixed point double is at most 309 integer digits
+		// plus sign and 6 decimals, and a unit name.
+		static constexpr size_t _formatTextSize = 384;
+
+		// inputs an EvalBulk thread takes at a time
+		static constexpr size_t _bulkChunkSize = 1024;
+
+		// shared, read only; _pOwnConfig is set too while the Config is this Compiler's alone
+		std::shared_ptr<const Config> _pConfig;
+		std::shared_ptr<Config> _pOwnConfig;
+
+		// scratch kept between calls, so Eval of a string reuses its capacity
+		TokenList _scratchTokens;
+		SmallVector<Token, 32> _stkHolding;
+		SmallVector<Dimension, 32> _stkDimensions; // beside the value stack, when checking them
+		CompiledExpression _scratchExpression;
+
+		// function calls open on the holding stack: the value stack depth at the call's
+		// parenthesis, and the arguments completed since
+		struct CallFrame
+		{
+			size_t depth;
+			uint32_t arguments;
+		};
+
+		std::vector<CallFrame> _stkCalls;
+
+		// Preview state: the last input and as many of its tokens as could be read
+		std::string _previewInput;
+		TokenList _previewTokens;
+		std::string _previewError;
+
+		// Eval cache: when full, a CLOCK hand passes over entries used since it last came by
+		// and replaces the first one that wasn't.
+		struct CacheEntry
+		{
+			std::string text;
+			size_t hash = 0;
+			UnitType unitType = UnitType::Generic;
+			bool referenced = false;
+			CompiledExpression expr;
+		};
+
+		std::vector<CacheEntry> _cacheEntries;
+		std::unordered_map<size_t, uint32_t> _mapCache; // hash of text and units to index in _cacheEntries
+		size_t _cacheSize = 0;
+		size_t _cacheHand = 0;
+		size_t _cacheHits = 0;
+		size_t _cacheMisses = 0;
+
+	}; // class Compiler
+
+	// Evaluates a literal expression, for Literal: the language of Compiler::Eval without
+	// symbols, read by recursive descent and solved with the solver's own arithmetic.
+	class LiteralEvaluator
+	{
+
+	public:
+		constexpr LiteralEvaluator( std::string_view sInput, UnitType unitOut )
+			: _input( sInput )
+			, _desiredUnitType( unitOut )
+			, _pUnitSystem( ( unitOut == UnitType::Imperial ) ? &Compiler::_imperialSystem : &Compiler::_metricSystem )
+		{
+		}
+
+		constexpr Result<Solution> Evaluate();
+
+	private:
+		using OpCode = CompiledExpression::OpCode;
+
+		constexpr Error Expression( Solution& result );	// term { ( + | - ) term }
+		constexpr Error Term( Solution& result );		// unary { ( * | / ) unary }
+		constexpr Error Unary( Solution& result );		// [ + | - ] postfix
+		constexpr Error Postfix( Solution& result );	// primary { unit }
+		constexpr Error Primary( Solution& result );	// number | ( expression )
+		constexpr Error Number( Solution& result );
+
+		// the next character after any white space, or 0 at the end
+		constexpr char Peek()
+		{
+			while ( _pos < _input.size() && lut::gWhitespaceDigits[ uint8_t( _input[ _pos ] ) ] )
+			{
+				++_pos;
+			}
+
+			return ( _pos < _input.size() ) ? _input[ _pos ] : 0;
+		}
+
+		static constexpr bool IsNameStart( char c )
+		{
+			return lut::gUnitDigits[ uint8_t( c ) ] || lut::gFirstSymbolDigits[ uint8_t( c ) ];
+		}
+
+		// a unit or symbol name, as the tokeniser reads them
+		constexpr std::string_view Name();
+		constexpr const Unit& FindUnit( std::string_view sName ) const;
+
+		std::string_view _input;
+		size_t _pos = 0;
+		UnitType _desiredUnitType;
+		const UnitSystem* _pUnitSystem;
+		bool _explicitUnits = false;
+	};
+
+	// Eval of a literal expression, such as "1ft + 6in", that can be done at compile time:
+	//     constexpr Numeric::Solution gDefaultHeight = Numeric::Literal( "1ft + 6in", Numeric::UnitType::Imperial );
+	// gives what Compiler::Eval would with the same output units and no previous solution.
+	// Literal fails the build on an error; TryEvalLiteral reports it, at run time as well.
+	// Decimals take '.' or ',' as the point, and must be exact to read exactly: at most 53
+	// bits of digits and 22 decimals.
+	constexpr Result<Solution> TryEvalLiteral( std::string_view sExpression, UnitType unitOut = UnitType::Generic )
+	{
+		return LiteralEvaluator( sExpression, unitOut ).Evaluate();
+	}
+
+	consteval Solution Literal( std::string_view sExpression, UnitType unitOut = UnitType::Generic )
+	{
+		const auto result = TryEvalLiteral( sExpression, unitOut );
+
+		if ( result.error )
+		{
+			throw CompilerError( result.error ); // not a constant: the build stops here
+		}
+
+		return result.value;
+	}
+
+	//==============================================================================
+	// The solver's arithmetic, constexpr for Literal
+
+	constexpr Unit Compiler::DefaultUnit( const UnitType type )
+	{
+		if ( type == UnitType::Generic || type == UnitType::Metric )
+		{
+			return { 1.0, type };
+		}
+		else
+		{
+			return { _impScaleFoot, type };
+		}
+	}
+
+	constexpr math::Rational Compiler::ExactScale( const double scale )
+	{
+		// units without a type have a scale of 1 too
+		if ( scale == 1.0 )
+		{
+			return { 1, 1 };
+		}
+
+		for ( size_t i = 1; i < _imperialExactScales.size(); ++i )
+		{
+			if ( _imperialSystem.units[ i ].scale == scale )
+			{
+				return _imperialExactScales[ i ];
+			}
+		}
+
+		return {};
+	}
+
+	constexpr void Compiler::NormaliseImperial( Solution& result )
+	{
+		// .. zero?
+		if ( result.value == 0 )
+		{
+			result.units = DefaultUnit( UnitType::Imperial );
+			return;
+		}
+
+		_imperialNormalise.Apply( result );
+	}
+
+	constexpr void Compiler::NormaliseMetric( Solution& result )
+	{
+		// .. zero?
+		if ( result.value == 0 )
+		{
+			result.units = DefaultUnit( UnitType::Metric );
+			return;
+		}
+
+		_metricNormalise.Apply( result );
+	}
+
+	constexpr Solution CompiledExpression::SolveBinary( OpCode op, const Solution& lhs, const Solution& rhs, UnitType desiredUnitType )
+	{
+		// mem[ 0 ] is the right hand side, mem[ 1 ] the left.
+		const Solution* mem[ 2 ] = { &rhs, &lhs };
+
+		Solution result = { 0.0, { 1.0, UnitType::Generic } };
+
+		switch ( op )
+		{
+		case OpCode::Divide:
+			{
+				double v0, v1;
+				v0 = mem[ 0 ]->value / mem[ 0 ]->units.scale;
+				v1 = mem[ 1 ]->value / mem[ 1 ]->units.scale;
+
+				result.value = v1 / v0;
+
+				if ( mem[ 0 ]->units.type != UnitType::Generic )
+				{
+					result.units = mem[ 0 ]->units;
+					result.value *= mem[ 0 ]->units.scale;
+				}
+				else
+				{
+					result.units = { 1.0, desiredUnitType };
+				}
+			}
+			break;
+
+		case OpCode::Multiply:
+			{
+				result.value = mem[ 1 ]->value * mem[ 0 ]->value;
+				result.units = { 1.0, desiredUnitType };
+			}
+			break;
+
+		case OpCode::Add:
+			{
+				double v0, v1;
+				v0 = mem[ 0 ]->value / mem[ 0 ]->units.scale;
+				v1 = mem[ 1 ]->value / mem[ 1 ]->units.scale;
+
+				if ( mem[ 0 ]->units.type == UnitType::Generic )
+				{
+					result.units = mem[ 1 ]->units;
+					result.value = ( v1 + v0 ) * mem[ 1 ]->units.scale;
+				}
+				else if ( mem[ 1 ]->units.type == UnitType::Generic )
+				{
+					result.units = mem[ 0 ]->units;
+					result.value = ( v1 + v0 ) * mem[ 0 ]->units.scale;
+				}
+				else
+				{
+					result.value = mem[ 1 ]->value + mem[ 0 ]->value;
+				}
+			}
+			break;
+
+		case OpCode::Subtract:
+			{
+				double v0, v1;
+				v0 = mem[ 0 ]->value / mem[ 0 ]->units.scale;
+				v1 = mem[ 1 ]->value / mem[ 1 ]->units.scale;
+
+				if ( mem[ 0 ]->units.type == UnitType::Generic )
+				{
+					result.units = mem[ 1 ]->units;
+					result.value = ( v1 - v0 ) * mem[ 1 ]->units.scale;
+				}
+				else if ( mem[ 1 ]->units.type == UnitType::Generic )
+				{
+					result.units = mem[ 0 ]->units;
+					result.value = ( v1 - v0 ) * mem[ 0 ]->units.scale;
+				}
+				else
+				{
+					result.value = mem[ 1 ]->value + mem[ 0 ]->value;
+				}
+			}
+			break;
+
+		case OpCode::Power:
+			{
+				// the exponent is a plain number, and the result is in the units of the base
+				double v0, v1;
+				v0 = mem[ 0 ]->value / mem[ 0 ]->units.scale;
+				v1 = mem[ 1 ]->value / mem[ 1 ]->units.scale;
+
+				result.units = mem[ 1 ]->units;
+				result.value = std::pow( v1, v0 ) * mem[ 1 ]->units.scale;
+			}
+			break;
+
+		case OpCode::Min:
+		case OpCode::Max:
+			{
+				// A side without units is taken in the other's, as for Add. With units on both,
+				// the finer of them is kept, which doesn't depend on the values (see EvalBatch).
+				double a = mem[ 1 ]->value;
+				double b = mem[ 0 ]->value;
+
+				if ( mem[ 0 ]->units.type == UnitType::Generic )
+				{
+					result.units = mem[ 1 ]->units;
+					b = ( b / mem[ 0 ]->units.scale ) * result.units.scale;
+				}
+				else if ( mem[ 1 ]->units.type == UnitType::Generic )
+				{
+					result.units = mem[ 0 ]->units;
+					a = ( a / mem[ 1 ]->units.scale ) * result.units.scale;
+				}
+				else
+				{
+					result.units = ( mem[ 0 ]->units.scale < mem[ 1 ]->units.scale ) ? mem[ 0 ]->units : mem[ 1 ]->units;
+				}
+
+				if ( op == OpCode::Min )
+				{
+					result.value = ( b < a ) ? b : a;
+				}
+				else
+				{
+					result.value = ( a < b ) ? b : a;
+				}
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if ( lhs.exact.Exact() && rhs.exact.Exact() )
+		{
+			result.exact = SolveBinaryExact( op, lhs, rhs );
+		}
+
+		return result;
+	}
+
+	// SolveBinary on the exact values, case for case (see Compiler::SetExactImperial)
+	constexpr math::Rational CompiledExpression::SolveBinaryExact( OpCode op, const Solution& lhs, const Solution& rhs )
+	{
+		const math::Rational s0 = Compiler::ExactScale( rhs.units.scale );
+		const math::Rational s1 = Compiler::ExactScale( lhs.units.scale );
+		const math::Rational v0 = math::Divide( rhs.exact, s0 );
+		const math::Rational v1 = math::Divide( lhs.exact, s1 );
+
+		switch ( op )
+		{
+		case OpCode::Divide:
+			return ( rhs.units.type != UnitType::Generic ) ? math::Multiply( math::Divide( v1, v0 ), s0 ) : math::Divide( v1, v0 );
+
+		case OpCode::Multiply:
+			return math::Multiply( lhs.exact, rhs.exact );
+
+		case OpCode::Add:
+		case OpCode::Subtract:
+			{
+				const math::Rational sum = ( op == OpCode::Add ) ? math::Add( v1, v0 ) : math::Subtract( v1, v0 );
+
+				if ( rhs.units.type == UnitType::Generic )
+				{
+					return math::Multiply( sum, s1 );
+				}
+				else if ( lhs.units.type == UnitType::Generic )
+				{
+					return math::Multiply( sum, s0 );
+				}
+
+				return math::Add( lhs.exact, rhs.exact ); // summed, as SolveBinary does
+			}
+
+		case OpCode::Power:
+			return math::Multiply( math::Power( v1, v0 ), s1 );
+
+		case OpCode::Min:
+		case OpCode::Max:
+			{
+				math::Rational a = lhs.exact;
+				math::Rational b = rhs.exact;
+
+				if ( rhs.units.type == UnitType::Generic )
+				{
+					b = math::Multiply( v0, s1 );
+				}
+				else if ( lhs.units.type == UnitType::Generic )
+				{
+					a = math::Multiply( v1, s0 );
+				}
+
+				const math::Rational difference = math::Subtract( b, a );
+
+				if ( !difference.Exact() )
+				{
+					return {};
+				}
+
+				return ( op == OpCode::Min ) ? ( ( difference.num < 0 ) ? b : a ) : ( ( difference.num > 0 ) ? b : a );
+			}
+
+		default:
+			return {};
+		}
+	}
+
+	constexpr void CompiledExpression::Finish( Solution& result, bool bExplicitUnits, const Solution* pPrevSolution, UnitType desiredUnitType )
+	{
+		// No units were explicitly specified?
+		if ( bExplicitUnits == false )
+		{
+			if ( pPrevSolution == nullptr || pPrevSolution->units.type == UnitType::Generic )
+			{
+				// fall back to desired units
+				result.units = { 1.0, desiredUnitType };
+				result.value *= result.units.scale;
+			}
+			else
+			{
+				// recycle the previous solution's units
+				result.value *= pPrevSolution->units.scale;
+
+				if ( result.exact.Exact() )
+				{
+					result.exact = math::Multiply( result.exact, Compiler::ExactScale( pPrevSolution->units.scale ) );
+				}
+
+				result.units = pPrevSolution->units;
+			}
+		}
+
+		// an exact result is given the double nearest to it
+		if ( result.exact.Exact() )
+		{
+			result.value = math::ToDouble( result.exact );
+		}
+
+		// Convert?
+		if ( result.units.type != desiredUnitType )
+		{
+			result.units = { 1.0, desiredUnitType };
+		}
+
+		// Try to normalise the result into friendly values.
+		if ( desiredUnitType == UnitType::Imperial )
+		{
+			Compiler::NormaliseImperial( result );
+		}
+		else if ( desiredUnitType == UnitType::Metric )
+		{
+			Compiler::NormaliseMetric( result );
+		}
+	}
+
+	//==============================================================================
+
+	constexpr Numeric::Result<Numeric::Solution> LiteralEvaluator::Evaluate()
+	{
+		if ( _input.empty() )
+		{
+			return { {}, { ErrorCode::NoInput } };
+		}
+
+		Solution result = { 0.0, { 1.0, UnitType::Generic } };
+
+		if ( const Error error = Expression( result ) )
+		{
+			return { {}, error };
+		}
+
+		// anything left over has no operator before it, or no open parenthesis
+		if ( const char charNow = Peek(); charNow == ')' )
+		{
+			return { {}, { ErrorCode::UnbalancedParenthesis, _pos, _input.substr( _pos, 1 ) } };
+		}
+		else if ( charNow == '(' || lut::gFirstNumericDigits[ uint8_t( charNow ) ] || IsNameStart( charNow ) )
+		{
+			return { {}, { ErrorCode::IndeterminateExpression } };
+		}
+		else if ( lut::gOperatorDigits[ uint8_t( charNow ) ] || charNow == ';' )
+		{
+			// ^ and %, and the arguments of functions, which literals don't take
+			return { {}, { ErrorCode::UnsupportedToken, _pos, _input.substr( _pos, 1 ) } };
+		}
+		else if ( charNow != 0 )
+		{
+			return { {}, { ErrorCode::UnknownCharacter, _pos, _input.substr( _pos, 1 ) } };
+		}
+
+		CompiledExpression::Finish( result, _explicitUnits, nullptr, _desiredUnitType );
+
+		return { result };
+	}
+
+	constexpr Numeric::Error LiteralEvaluator::Expression( Solution& result )
+	{
+		if ( const Error error = Term( result ) )
+		{
+			return error;
+		}
+
+		for ( char charNow = Peek(); charNow == '+' || charNow == '-'; charNow = Peek() )
+		{
+			++_pos;
+
+			Solution rhs = {};
+			if ( const Error error = Term( rhs ) )
+			{
+				return error;
+			}
+
+			result = CompiledExpression::SolveBinary( ( charNow == '+' ) ? OpCode::Add : OpCode::Subtract, result, rhs, _desiredUnitType );
+		}
+
+		return {};
+	}
+
+	constexpr Numeric::Error LiteralEvaluator::Term( Solution& result )
+	{
+		if ( const Error error = Unary( result ) )
+		{
+			return error;
+		}
+
+		for ( char charNow = Peek(); charNow == '*' || charNow == '/'; charNow = Peek() )
+		{
+			++_pos;
+
+			Solution rhs = {};
+			if ( const Error error = Unary( rhs ) )
+			{
+				return error;
+			}
+
+			result = CompiledExpression::SolveBinary( ( charNow == '*' ) ? OpCode::Multiply : OpCode::Divide, result, rhs, _desiredUnitType );
+		}
+
+		return {};
+	}
+
+	constexpr Numeric::Error LiteralEvaluator::Unary( Solution& result )
+	{
+		// one sign only: the solver finds "--1" malformed too
+		const char charNow = Peek();
+
+		if ( charNow == '+' || charNow == '-' )
+		{
+			++_pos;
+
+			if ( const Error error = Postfix( result ) )
+			{
+				return error;
+			}
+
+			if ( charNow == '-' )
+			{
+				result.value = -result.value;
+			}
+
+			return {};
+		}
+
+		return Postfix( result );
+	}
+
+	constexpr Numeric::Error LiteralEvaluator::Postfix( Solution& result )
+	{
+		if ( const Error error = Primary( result ) )
+		{
+			return error;
+		}
+
+		// units apply to the value before them
+		while ( IsNameStart( Peek() ) )
+		{
+			const size_t uStart = _pos;
+			const std::string_view sName = Name();
+			const Unit& unit = FindUnit( sName );
+
+			if ( unit.scale == 0.0 )
+			{
+				return { ErrorCode::UnknownSymbol, uStart, sName };
+			}
+
+			_explicitUnits = true;
+			result.value = result.value * unit.scale;
+			result.units = unit;
+		}
+
+		return {};
+	}
+
+	constexpr Numeric::Error LiteralEvaluator::Primary( Solution& result )
+	{
+		const char charNow = Peek();
+
+		if ( charNow == '(' )
+		{
+			const size_t uOpen = _pos++;
+
+			if ( const Error error = Expression( result ) )
+			{
+				return error;
+			}
+
+			if ( Peek() != ')' )
+			{
+				return { ErrorCode::UnbalancedParenthesis, uOpen, _input.substr( uOpen, 1 ) };
+			}
+
+			++_pos;
+			return {};
+		}
+		else if ( lut::gFirstNumericDigits[ uint8_t( charNow ) ] )
+		{
+			return Number( result );
+		}
+		else if ( IsNameStart( charNow ) )
+		{
+			// a unit with no value, or a symbol, which a literal can't have
+			const size_t uStart = _pos;
+			const std::string_view sName = Name();
+
+			if ( FindUnit( sName ).scale == 0.0 )
+			{
+				return { ErrorCode::UnknownSymbol, uStart, sName };
+			}
+
+			return { ErrorCode::MalformedExpression, uStart, sName };
+		}
+		else if ( charNow == 0 || charNow == ')' || lut::gOperatorDigits[ uint8_t( charNow ) ] )
+		{
+			return { ErrorCode::MalformedExpression, _pos, _input.substr( _pos, ( charNow != 0 ) ? 1 : 0 ) };
+		}
+
+		return { ErrorCode::UnknownCharacter, _pos, _input.substr( _pos, 1 ) };
+	}
+
+	constexpr Numeric::Error LiteralEvaluator::Number( Solution& result )
+	{
+		const size_t uStart = _pos;
+		auto currentToken = [ & ]( size_t uExtra = 0 )
+		{
+			return _input.substr( uStart, _pos - uStart + uExtra );
+		};
+
+		// Hex (0x) or binary (0b), read into an integer as the tokeniser does
+		if ( _input[ _pos ] == '0' && _pos + 1 < _input.size() && ( _input[ _pos + 1 ] == 'x' || _input[ _pos + 1 ] == 'X' || _input[ _pos + 1 ] == 'b' || _input[ _pos + 1 ] == 'B' ) )
+		{
+			const bool bHex = ( _input[ _pos + 1 ] == 'x' || _input[ _pos + 1 ] == 'X' );
+			const auto& allowed = bHex ? lut::gAllowedHexDigits : lut::gAllowedBinaryDigits;
+			const int bits = bHex ? 4 : 1;
+			uint64_t uValue = 0;
+
+			for ( _pos += 2; _pos < _input.size() && allowed[ uint8_t( _input[ _pos ] ) ]; ++_pos )
+			{
+				if ( uValue >> ( 64 - bits ) )
+				{
+					return { ErrorCode::InvalidPrefixedLiteral, uStart, currentToken( 1 ) };
+				}
+
+				uValue = ( uValue << bits ) | lut::gDigitValues[ uint8_t( _input[ _pos ] ) ];
+			}
+
+			if ( currentToken().size() == 2 ) // only the prefix
+			{
+				return { ErrorCode::InvalidPrefixedLiteral, uStart, currentToken() };
+			}
+
+			result = { double( uValue ), { 1.0, UnitType::Generic } };
+			return {};
+		}
+
+		// Base 10: the digits as an integer of up to 53 bits, over a power of ten up to 1e22,
+		// are both exact, so the one division rounds correctly, as from_chars does. Zeros at
+		// the end of the decimals are left out, so they don't count against the limits.
+		constexpr uint64_t uMaxExact = uint64_t( 1 ) << 53;
+		uint64_t uDigits = 0;
+		size_t uDecimals = 0;
+		size_t uPendingZeros = 0;
+		bool bDecimalPointFound = false;
+
+		for ( ; _pos < _input.size() && lut::gAdditionalNumericDigits[ uint8_t( _input[ _pos ] ) ]; ++_pos )
+		{
+			const char charNow = _input[ _pos ];
+
+			if ( lut::gFirstNumericDigits[ uint8_t( charNow ) ] == false ) // a delimiter
+			{
+				if ( bDecimalPointFound )
+				{
+					return { ErrorCode::BadNumericConstruction, uStart, currentToken( 1 ) };
+				}
+
+				bDecimalPointFound = true;
+				continue;
+			}
+
+			const uint64_t uDigit = uint64_t( charNow - '0' );
+
+			if ( bDecimalPointFound && uDigit == 0 )
+			{
+				++uPendingZeros;
+				continue;
+			}
+
+			for ( ; uPendingZeros > 0; --uPendingZeros, ++uDecimals )
+			{
+				if ( uDigits > uMaxExact / 10 )
+				{
+					return { ErrorCode::BadNumericConstruction, uStart, currentToken( 1 ) };
+				}
+
+				uDigits *= 10;
+			}
+
+			if ( uDigits > ( uMaxExact - uDigit ) / 10 )
+			{
+				return { ErrorCode::BadNumericConstruction, uStart, currentToken( 1 ) };
+			}
+
+			uDigits = uDigits * 10 + uDigit;
+			uDecimals += bDecimalPointFound ? 1 : 0;
+		}
+
+		if ( uDecimals > 22 )
+		{
+			return { ErrorCode::BadNumericConstruction, uStart, currentToken() };
+		}
+
+		double scale = 1.0;
+		for ( size_t i = 0; i < uDecimals; ++i )
+		{
+			scale *= 10.0;
+		}
+
+		result = { double( uDigits ) / scale, { 1.0, UnitType::Generic } };
+		return {};
+	}
+
+	constexpr std::string_view LiteralEvaluator::Name()
+	{
+		// symbol names may continue with digits, units (like ' and ") may not.
+		const size_t uStart = _pos;
+		const bool bSymbolName = lut::gFirstSymbolDigits[ uint8_t( _input[ _pos ] ) ];
+
+		for ( ++_pos; _pos < _input.size(); ++_pos )
+		{
+			const uint8_t c = uint8_t( _input[ _pos ] );
+
+			if ( !( lut::gUnitDigits[ c ] || ( bSymbolName && lut::gAdditionalSymbolDigits[ c ] ) ) )
+			{
+				break;
+			}
+		}
+
+		return _input.substr( uStart, _pos - uStart );
+	}
+
+	constexpr const Numeric::Unit& LiteralEvaluator::FindUnit( std::string_view sName ) const
+	{
+		// a scale of 0 if there's no such unit in the system
+		UnitId id = UnitId::None;
+
+		for ( const auto& alias : gUnitAliases )
+		{
+			if ( alias.text == sName )
+			{
+				id = alias.id;
+			}
+		}
+
+		return _pUnitSystem->units[ size_t( id ) ];
+	}
 
 }; // namespace Numeric
 
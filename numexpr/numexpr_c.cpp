@@ -0,0 +1,356 @@
+/*
+	A C interface to numexpr, by David Walters, 2026.
+	Released under the OLC-3 license, as numexpr.h is. See there.
+
+	Built with numexpr.cpp into a shared library (numexpr_c.vcxproj), with NUMEXPR_C_BUILD
+	defined so that the functions of numexpr_c.h are exported.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "numexpr.h"
+#include "numexpr_c.h"
+
+//==============================================================================
+
+static_assert( NUMEXPR_UNITS_METRIC == int32_t( Numeric::UnitType::Metric ) );
+static_assert( NUMEXPR_UNITS_IMPERIAL == int32_t( Numeric::UnitType::Imperial ) );
+static_assert( NUMEXPR_NO_INPUT == int32_t( Numeric::ErrorCode::NoInput ) );
+static_assert( NUMEXPR_UNBALANCED_PARENTHESIS == int32_t( Numeric::ErrorCode::UnbalancedParenthesis ) );
+static_assert( NUMEXPR_UNEXPECTED_CLOSE_PARENTHESIS == int32_t( Numeric::ErrorCode::UnexpectedCloseParenthesis ) );
+static_assert( NUMEXPR_NO_PREVIOUS_VALUE == int32_t( Numeric::ErrorCode::NoPreviousValue ) );
+static_assert( NUMEXPR_DIMENSION_MISMATCH == int32_t( Numeric::ErrorCode::DimensionMismatch ) );
+static_assert( NUMEXPR_DIMENSION_AREA == int32_t( Numeric::Dimension::Area ) );
+static_assert( sizeof( numexpr_solution ) == 40 );
+
+struct numexpr_compiler
+{
+	Numeric::Compiler compiler;
+	std::string sInput; // scratch, so the input's capacity is kept from call to call
+};
+
+struct numexpr_expr
+{
+	Numeric::CompiledExpression expr;
+};
+
+namespace
+{
+	// symbols in place, for an expression of up to this many slots; more are allocated
+	constexpr size_t kLocalSymbols = 32;
+
+	Numeric::UnitType ToUnitType( int32_t units )
+	{
+		switch ( units )
+		{
+		case NUMEXPR_UNITS_METRIC:		return Numeric::UnitType::Metric;
+		case NUMEXPR_UNITS_IMPERIAL:	return Numeric::UnitType::Imperial;
+		default:						return Numeric::UnitType::Generic;
+		}
+	}
+
+	Numeric::Solution FromC( const numexpr_solution& in )
+	{
+		Numeric::Solution out;
+		out.value = in.value;
+		out.units.scale = in.scale;
+		out.units.type = ToUnitType( in.units );
+		out.exact = { in.exact_num, in.exact_den };
+		return out;
+	}
+
+	void ToC( const Numeric::Solution& in, numexpr_solution& out )
+	{
+		out.value = in.value;
+		out.scale = in.units.scale;
+		out.units = int32_t( in.units.type );
+		out.reserved = 0;
+		out.exact_num = in.exact.num;
+		out.exact_den = in.exact.den;
+	}
+
+	void SetError( numexpr_error* pError, int32_t code, size_t pos = 0, size_t length = 0 )
+	{
+		if ( pError )
+		{
+			pError->code = code;
+			pError->pos = uint32_t( pos );
+			pError->length = uint32_t( length );
+		}
+	}
+
+	void SetError( numexpr_error* pError, const Numeric::Error& error )
+	{
+		SetError( pError, int32_t( error.code ), error.pos, error.text.size() );
+	}
+
+	// as snprintf
+	size_t CopyOut( const std::string& sText, char* pBuffer, size_t uSize )
+	{
+		if ( pBuffer && uSize > 0 )
+		{
+			const size_t uCopy = std::min( sText.size(), uSize - 1 );
+			std::memcpy( pBuffer, sText.data(), uCopy );
+			pBuffer[ uCopy ] = '\0';
+		}
+
+		return sText.size();
+	}
+}
+
+//==============================================================================
+
+int32_t numexpr_version( void )
+{
+	return NUMEXPR_C_VERSION;
+}
+
+numexpr_compiler* numexpr_compiler_create( int32_t units )
+{
+	try
+	{
+		numexpr_compiler* pCompiler = new numexpr_compiler;
+		pCompiler->compiler.SetUnitOut( ToUnitType( units ) );
+		return pCompiler;
+	}
+	catch ( ... )
+	{
+		return nullptr;
+	}
+}
+
+void numexpr_compiler_destroy( numexpr_compiler* compiler )
+{
+	delete compiler;
+}
+
+void numexpr_set_units( numexpr_compiler* compiler, int32_t units )
+{
+	try
+	{
+		compiler->compiler.SetUnitOut( ToUnitType( units ) );
+	}
+	catch ( ... )
+	{
+	}
+}
+
+void numexpr_set_imperial_fractions( numexpr_compiler* compiler, int32_t enable )
+{
+	try
+	{
+		compiler->compiler.SetImperialFractions( enable != 0 );
+	}
+	catch ( ... )
+	{
+	}
+}
+
+void numexpr_set_exact_imperial( numexpr_compiler* compiler, int32_t enable )
+{
+	try
+	{
+		compiler->compiler.SetExactImperial( enable != 0 );
+	}
+	catch ( ... )
+	{
+	}
+}
+
+void numexpr_set_dimension_checking( numexpr_compiler* compiler, int32_t enable )
+{
+	try
+	{
+		compiler->compiler.SetDimensionChecking( enable != 0 );
+	}
+	catch ( ... )
+	{
+	}
+}
+
+void numexpr_set_cache_size( numexpr_compiler* compiler, size_t entries )
+{
+	try
+	{
+		compiler->compiler.SetCacheSize( entries );
+	}
+	catch ( ... )
+	{
+		compiler->compiler.SetCacheSize( 0 );
+	}
+}
+
+int32_t numexpr_define_symbol( numexpr_compiler* compiler, const char* name, uint32_t slot )
+{
+	return numexpr_define_symbol_dimension( compiler, name, slot, NUMEXPR_DIMENSION_UNKNOWN );
+}
+
+int32_t numexpr_define_symbol_dimension( numexpr_compiler* compiler, const char* name, uint32_t slot, int32_t dimension )
+{
+	try
+	{
+		const bool bKnown = dimension >= NUMEXPR_DIMENSION_UNITLESS && dimension <= NUMEXPR_DIMENSION_AREA;
+
+		compiler->compiler.DefineSymbol( name, slot, bKnown ? Numeric::Dimension( dimension ) : Numeric::Dimension::Unknown );
+		return NUMEXPR_OK;
+	}
+	catch ( ... )
+	{
+		return NUMEXPR_OUT_OF_MEMORY;
+	}
+}
+
+void numexpr_clear_symbols( numexpr_compiler* compiler )
+{
+	try
+	{
+		compiler->compiler.ClearSymbols();
+	}
+	catch ( ... )
+	{
+	}
+}
+
+void numexpr_default_solution( const numexpr_compiler* compiler, numexpr_solution* solution )
+{
+	ToC( { 0.0, compiler->compiler.DefaultUnit(), {} }, *solution );
+}
+
+numexpr_expr* numexpr_compile( numexpr_compiler* compiler, const char* input, size_t length, numexpr_error* error )
+{
+	try
+	{
+		compiler->sInput.assign( input, length );
+
+		Numeric::Result<Numeric::CompiledExpression> result = compiler->compiler.TryCompile( compiler->sInput );
+		if ( !result.ok() )
+		{
+			SetError( error, result.error );
+			return nullptr;
+		}
+
+		numexpr_expr* pExpr = new numexpr_expr{ std::move( result.value ) };
+		SetError( error, NUMEXPR_OK );
+		return pExpr;
+	}
+	catch ( ... )
+	{
+		SetError( error, NUMEXPR_OUT_OF_MEMORY );
+		return nullptr;
+	}
+}
+
+void numexpr_expr_destroy( numexpr_expr* expr )
+{
+	delete expr;
+}
+
+uint32_t numexpr_expr_symbol_slots( const numexpr_expr* expr )
+{
+	return uint32_t( expr->expr.SymbolSlots() );
+}
+
+int32_t numexpr_expr_dimension( const numexpr_expr* expr )
+{
+	return int32_t( expr->expr.ResultDimension() );
+}
+
+int32_t numexpr_eval( const numexpr_expr* expr, const numexpr_solution* previous, const numexpr_solution* symbols, numexpr_solution* result )
+{
+	try
+	{
+		Numeric::Solution prev;
+		if ( previous )
+		{
+			prev = FromC( *previous );
+		}
+
+		// the symbols as Solutions, in place unless there are a lot of them
+		const size_t uSlots = symbols ? expr->expr.SymbolSlots() : 0;
+
+		Numeric::SmallVector<Numeric::Solution, kLocalSymbols> vSymbols;
+		vSymbols.resize( uSlots );
+		for ( size_t i = 0; i < uSlots; ++i )
+		{
+			vSymbols[ i ] = FromC( symbols[ i ] );
+		}
+
+		const Numeric::Result<Numeric::Solution> solution = expr->expr.TryEval( previous ? &prev : nullptr, symbols ? vSymbols.data() : nullptr );
+		if ( !solution.ok() )
+		{
+			return int32_t( solution.error.code );
+		}
+
+		ToC( solution.value, *result );
+		return NUMEXPR_OK;
+	}
+	catch ( ... )
+	{
+		return NUMEXPR_OUT_OF_MEMORY;
+	}
+}
+
+int32_t numexpr_eval_text( numexpr_compiler* compiler, const char* input, size_t length, const numexpr_solution* previous, numexpr_solution* result, numexpr_error* error )
+{
+	try
+	{
+		compiler->sInput.assign( input, length );
+
+		Numeric::Solution prev;
+		if ( previous )
+		{
+			prev = FromC( *previous );
+		}
+
+		const Numeric::Result<Numeric::Solution> solution = compiler->compiler.TryEval( compiler->sInput, previous ? &prev : nullptr );
+		if ( !solution.ok() )
+		{
+			SetError( error, solution.error );
+			return int32_t( solution.error.code );
+		}
+
+		ToC( solution.value, *result );
+		SetError( error, NUMEXPR_OK );
+		return NUMEXPR_OK;
+	}
+	catch ( ... )
+	{
+		SetError( error, NUMEXPR_OUT_OF_MEMORY );
+		return NUMEXPR_OUT_OF_MEMORY;
+	}
+}
+
+size_t numexpr_format_to( const numexpr_compiler* compiler, const numexpr_solution* solution, char* buffer, size_t size )
+{
+	return compiler->compiler.FormatTo( FromC( *solution ), buffer, buffer ? size : 0 );
+}
+
+size_t numexpr_error_message( const numexpr_error* error, const char* input, size_t length, char* buffer, size_t size )
+{
+	if ( error->code == NUMEXPR_OUT_OF_MEMORY )
+	{
+		return CopyOut( "Out of memory", buffer, size );
+	}
+
+	try
+	{
+		// the part of the input at fault, which some of the messages quote
+		const size_t uPos = std::min<size_t>( error->pos, input ? length : 0 );
+		const size_t uLength = std::min<size_t>( error->length, ( input ? length : 0 ) - uPos );
+
+		Numeric::Error e;
+		e.code = Numeric::ErrorCode( error->code );
+		e.pos = error->pos;
+		e.text = input ? std::string_view( input + uPos, uLength ) : std::string_view();
+
+		return CopyOut( Numeric::ErrorMessage( e ), buffer, size );
+	}
+	catch ( ... )
+	{
+		return CopyOut( "Out of memory", buffer, size );
+	}
+}
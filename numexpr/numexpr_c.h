@@ -0,0 +1,155 @@
+/*
+	A C interface to numexpr, by David Walters, 2026.
+	Released under the OLC-3 license, as numexpr.h is. See there.
+
+	For hosts that can't call C++ (C#, Python's ctypes, Lua's FFI and the like): plain
+	functions over opaque handles, and structs of fixed layout. Every buffer is the
+	caller's, so a call makes no allocations to pass its arguments or results across, and
+	no exception leaves the library; each call reports failure in its return value.
+
+	A numexpr_compiler is a Numeric::Compiler, with its settings, scratch buffers and
+	cache: use each from one thread at a time. A numexpr_expr is a CompiledExpression,
+	never changed once compiled, so any number of threads may evaluate it at once.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined( _WIN32 )
+#if defined( NUMEXPR_C_BUILD )
+#define NUMEXPR_API __declspec( dllexport )
+#else
+#define NUMEXPR_API __declspec( dllimport )
+#endif
+#else
+#define NUMEXPR_API __attribute__( ( visibility( "default" ) ) )
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The version of this interface; a change to any struct or signature changes it.
+#define NUMEXPR_C_VERSION 1
+
+typedef struct numexpr_compiler numexpr_compiler;
+typedef struct numexpr_expr numexpr_expr;
+
+// Numeric::UnitType
+enum
+{
+	NUMEXPR_UNITS_GENERIC = 0,
+	NUMEXPR_UNITS_METRIC = 1,
+	NUMEXPR_UNITS_IMPERIAL = 2,
+};
+
+// Numeric::Dimension
+enum
+{
+	NUMEXPR_DIMENSION_UNKNOWN = 0,
+	NUMEXPR_DIMENSION_UNITLESS = 1,
+	NUMEXPR_DIMENSION_LENGTH = 2,
+	NUMEXPR_DIMENSION_AREA = 3,
+};
+
+// Numeric::ErrorCode, and one of this interface's own.
+enum
+{
+	NUMEXPR_OK = 0,
+
+	NUMEXPR_NO_INPUT,
+	NUMEXPR_UNKNOWN_CHARACTER,
+	NUMEXPR_BAD_NUMERIC_CONSTRUCTION,
+	NUMEXPR_INVALID_PREFIXED_LITERAL,
+	NUMEXPR_UNKNOWN_OPERATOR,
+	NUMEXPR_UNBALANCED_PARENTHESIS,
+
+	NUMEXPR_UNEXPECTED_CLOSE_PARENTHESIS,
+	NUMEXPR_NO_OPEN_PARENTHESIS,
+	NUMEXPR_UNKNOWN_SYMBOL,
+	NUMEXPR_UNSUPPORTED_TOKEN,
+	NUMEXPR_MALFORMED_EXPRESSION,
+	NUMEXPR_UNEXPECTED_TOKEN,
+	NUMEXPR_INDETERMINATE_EXPRESSION,
+	NUMEXPR_NO_SYMBOL_VALUES,
+	NUMEXPR_BAD_ARGUMENTS,
+	NUMEXPR_NO_PREVIOUS_VALUE,
+	NUMEXPR_DIMENSION_MISMATCH,
+
+	NUMEXPR_OUT_OF_MEMORY = 255,
+};
+
+// A Numeric::Solution, field for field: the value in the base units of the system (thou
+// in imperial, metres in metric), the scale and type of its units, and the value as an
+// exact fraction when exact_den isn't 0 (see numexpr_set_exact_imperial). A value made
+// by the host is { value, 1.0, NUMEXPR_UNITS_GENERIC, 0, 0, 0 }, or carries units.
+typedef struct numexpr_solution
+{
+	double value;
+	double scale;
+	int32_t units;
+	int32_t reserved;
+	int64_t exact_num;
+	int64_t exact_den;
+} numexpr_solution;
+
+// What went wrong, and where: the offset and length of the part of the input at fault.
+typedef struct numexpr_error
+{
+	int32_t code;
+	uint32_t pos;
+	uint32_t length;
+} numexpr_error;
+
+// NUMEXPR_C_VERSION of the library that is loaded, to check against the header's.
+NUMEXPR_API int32_t numexpr_version( void );
+
+// A compiler for output in units (NUMEXPR_UNITS_*), or NULL if there is no memory.
+NUMEXPR_API numexpr_compiler* numexpr_compiler_create( int32_t units );
+NUMEXPR_API void numexpr_compiler_destroy( numexpr_compiler* compiler );
+
+// Settings, as the Compiler's of the same names. They apply to what is compiled after.
+NUMEXPR_API void numexpr_set_units( numexpr_compiler* compiler, int32_t units );
+NUMEXPR_API void numexpr_set_imperial_fractions( numexpr_compiler* compiler, int32_t enable );
+NUMEXPR_API void numexpr_set_exact_imperial( numexpr_compiler* compiler, int32_t enable );
+NUMEXPR_API void numexpr_set_dimension_checking( numexpr_compiler* compiler, int32_t enable );
+NUMEXPR_API void numexpr_set_cache_size( numexpr_compiler* compiler, size_t entries );
+NUMEXPR_API int32_t numexpr_define_symbol( numexpr_compiler* compiler, const char* name, uint32_t slot );
+NUMEXPR_API int32_t numexpr_define_symbol_dimension( numexpr_compiler* compiler, const char* name, uint32_t slot, int32_t dimension );
+NUMEXPR_API void numexpr_clear_symbols( numexpr_compiler* compiler );
+
+// The units a value without any is given: a previous solution to start from.
+NUMEXPR_API void numexpr_default_solution( const numexpr_compiler* compiler, numexpr_solution* solution );
+
+// Compiles length bytes of input (UTF-8, not null terminated), or returns NULL and the
+// reason in error, which may be NULL.
+NUMEXPR_API numexpr_expr* numexpr_compile( numexpr_compiler* compiler, const char* input, size_t length, numexpr_error* error );
+NUMEXPR_API void numexpr_expr_destroy( numexpr_expr* expr );
+
+// How many entries the symbols given to numexpr_eval must hold.
+NUMEXPR_API uint32_t numexpr_expr_symbol_slots( const numexpr_expr* expr );
+
+// What the result is a quantity of (NUMEXPR_DIMENSION_*), when compiled with dimension checking.
+NUMEXPR_API int32_t numexpr_expr_dimension( const numexpr_expr* expr );
+
+// Evaluates expr into result, reading symbol slot n from symbols[ n ]. previous is the
+// previous solution (for % and units), and either may be NULL if expr doesn't need it.
+// Returns NUMEXPR_OK or the reason there is no result.
+NUMEXPR_API int32_t numexpr_eval( const numexpr_expr* expr, const numexpr_solution* previous, const numexpr_solution* symbols, numexpr_solution* result );
+
+// numexpr_compile and numexpr_eval in one, for input evaluated once; the compiler's cache
+// (numexpr_set_cache_size) keeps those that come again.
+NUMEXPR_API int32_t numexpr_eval_text( numexpr_compiler* compiler, const char* input, size_t length, const numexpr_solution* previous, numexpr_solution* result, numexpr_error* error );
+
+// The text of a solution, as Compiler::FormatTo: like snprintf, writes as much of it as
+// fits in size bytes, always null terminated when size > 0, and returns its full length.
+NUMEXPR_API size_t numexpr_format_to( const numexpr_compiler* compiler, const numexpr_solution* solution, char* buffer, size_t size );
+
+// The message for an error from input, as Numeric::ErrorMessage, in the same way.
+NUMEXPR_API size_t numexpr_error_message( const numexpr_error* error, const char* input, size_t length, char* buffer, size_t size );
+
+#ifdef __cplusplus
+}
+#endif
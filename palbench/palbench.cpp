@@ -0,0 +1,1358 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palbench.cpp
+//
+// Runs the -bench of each tool over the image sets of a corpus file, a few times each,
+// and keeps every timing, the rate, the output hash and the peak memory of each run as
+// JSON. Given the JSON of an earlier run as a baseline, it says which cases got slower or
+// faster by more than the noise, and which outputs changed.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h> // GetProcessMemoryInfo
+#else
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#include "palfind.h" // the wildcards of a set, as the tools expand them
+
+//=============================================================================
+
+#ifdef _WIN32
+static const char* const kExeExtension = ".exe";
+#else
+static const char* const kExeExtension = "";
+#endif
+
+//
+// bench_case_t
+//
+// One line of a tool's -bench: its time on each run, in ms (ns/op for numexpr), the other
+// measures of the line by unit (Mpixel/s, dB, allocs ...) from the first run, and the
+// hash of its output.
+//
+struct bench_case_t
+{
+	std::string strName; // the section it is in, " / ", and its own name
+	std::string strUnit; // of aSamples: ms or ns/op
+	std::vector< double > aSamples;
+	std::vector< std::pair< std::string, double > > aMeasures;
+	std::string strHash;
+	bool bHashStable = true; // the same hash on every run
+
+	double Mean() const;
+	double StdDev() const;
+};
+
+//
+// bench_t
+//
+// A bench line of the corpus: the tool and its arguments, run on one image set.
+//
+struct bench_t
+{
+	std::string strKey; // "<tool> <set> <args>", to find it in a baseline
+	std::string strTool;
+	std::string strSet;
+	std::vector< std::string > aArgs; // the bench line's own, then the set's wildcards
+	size_t uFiles = 0;
+
+	std::vector< std::string > aSettings; // "Scan kernels: avx2" and the like, from the first run
+	std::vector< double > aWallMs;
+	uint64_t uPeakBytes = 0; // the most of any run
+	bool bFailed = false;
+
+	std::vector< bench_case_t > aCases;
+};
+
+struct options_t
+{
+	std::string strCorpusFile;
+	std::string strBinFolder; // where the tools are, or empty for beside palbench
+	std::string strOutFile = "palbench.json";
+	std::string strBaselineFile;
+	int iRuns = 3;
+	double fThreshold = 5.0; // percent
+	std::string strSelf; // argv[ 0 ]
+};
+
+//=============================================================================
+
+double bench_case_t::Mean() const
+{
+	double sum = 0.0;
+	for ( const double v : aSamples )
+	{
+		sum += v;
+	}
+	return aSamples.empty() ? 0.0 : sum / double( aSamples.size() );
+}
+
+double bench_case_t::StdDev() const
+{
+	if ( aSamples.size() < 2 )
+	{
+		return 0.0;
+	}
+
+	const double mean = Mean();
+	double sum = 0.0;
+	for ( const double v : aSamples )
+	{
+		sum += ( v - mean ) * ( v - mean );
+	}
+	return sqrt( sum / double( aSamples.size() - 1 ) );
+}
+
+//
+// print_hello
+//
+// Print hello text
+//
+static void print_hello()
+{
+	printf( "\n-----------------------------------------------------------------\n"
+			" Palette Benchmarks (c) David Walters. See LICENSE.txt for details\n"
+			"-----------------------------------------------------------------\n\n" );
+}
+
+//
+// print_help
+//
+// Print help text
+//
+static void print_help()
+{
+	// Usage
+	printf( " USAGE: palbench.exe [-?] [-runs=#] [-bin=<folder>] [-o <file>] [-baseline <file>] [-threshold=#] <corpus>\n\n" );
+
+	// Options
+	printf( "  -?                This help.\n" );
+	printf( "  -runs=#           Times each bench is run, for its spread. [Default=3]\n" );
+	printf( "  -bin=<folder>     Where the tools are. [Default=each tool's own build folder, beside palbench's]\n" );
+	printf( "  -o <file>         The results, as JSON. [Default=palbench.json]\n" );
+	printf( "  -baseline <file>  The results of an earlier run, to compare with. Any case slower, an output\n" );
+	printf( "                    changed or a case gone makes the exit code 1.\n" );
+	printf( "  -threshold=#      A time is only slower or faster when it has moved by this percent and by\n" );
+	printf( "                    more than the spread of both runs allows. [Default=5]\n" );
+	putchar( '\n' );
+	printf( "  <corpus>          One line each (# starts a comment):\n" );
+	putchar( '\n' );
+	printf( "    version <text>  The corpus's version, kept in the results. A baseline of another\n" );
+	printf( "                    version is not compared.\n" );
+	printf( "    set <name> <image>[...]\n" );
+	printf( "                    A set of images, by wildcards (** for every folder below).\n" );
+	printf( "    bench <tool> <set>|- [<option>...]\n" );
+	printf( "                    Run <tool> -bench with the options and the set's images.\n" );
+	putchar( '\n' );
+
+	putchar( '\n' );
+}
+
+//
+// split_line
+//
+// Split a corpus line at whitespace. Tokens may be quoted to keep spaces, and a '#'
+// outside quotes starts a comment.
+//
+static std::vector< std::string > split_line( const std::string& strLine )
+{
+	std::vector< std::string > aTokens;
+	std::string strToken;
+	bool bQuoted = false;
+	bool bHaveToken = false;
+
+	for ( const char c : strLine )
+	{
+		if ( c == '"' )
+		{
+			bQuoted = !bQuoted;
+			bHaveToken = true;
+		}
+		else if ( c == '#' && bQuoted == false )
+		{
+			break;
+		}
+		else if ( ( c == ' ' || c == '\t' || c == '\r' ) && bQuoted == false )
+		{
+			if ( bHaveToken )
+			{
+				aTokens.push_back( strToken );
+				strToken.clear();
+				bHaveToken = false;
+			}
+		}
+		else
+		{
+			strToken += c;
+			bHaveToken = true;
+		}
+	}
+
+	if ( bHaveToken )
+	{
+		aTokens.push_back( strToken );
+	}
+
+	return aTokens;
+}
+
+//=============================================================================
+
+//
+// run_tool
+//
+// Run a command line, wait for it, and keep what it wrote to stdout and stderr, and the
+// most memory it held (its peak working set, or max RSS). False if it could not be run
+// or did not exit with 0.
+//
+#ifdef _WIN32
+
+static bool run_tool( const std::string& strCommand, std::string& strOutput, uint64_t& uPeakBytes )
+{
+	SECURITY_ATTRIBUTES sa = { sizeof( sa ), nullptr, TRUE };
+	HANDLE hRead = nullptr;
+	HANDLE hWrite = nullptr;
+	if ( CreatePipe( &hRead, &hWrite, &sa, 0 ) == FALSE )
+	{
+		return false;
+	}
+	SetHandleInformation( hRead, HANDLE_FLAG_INHERIT, 0 );
+
+	STARTUPINFOA si = {};
+	si.cb = sizeof( si );
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = GetStdHandle( STD_INPUT_HANDLE );
+	si.hStdOutput = hWrite;
+	si.hStdError = hWrite;
+
+	PROCESS_INFORMATION pi = {};
+	std::string strCommandLine = strCommand; // CreateProcessA may write to it.
+	const BOOL bStarted = CreateProcessA( nullptr, &strCommandLine[ 0 ], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, &pi );
+	CloseHandle( hWrite );
+
+	if ( bStarted == FALSE )
+	{
+		CloseHandle( hRead );
+		return false;
+	}
+
+	char buffer[ 4096 ];
+	DWORD uRead = 0;
+	while ( ReadFile( hRead, buffer, sizeof( buffer ), &uRead, nullptr ) && uRead > 0 )
+	{
+		strOutput.append( buffer, uRead );
+	}
+	CloseHandle( hRead );
+
+	WaitForSingleObject( pi.hProcess, INFINITE );
+
+	PROCESS_MEMORY_COUNTERS pmc = {};
+	if ( GetProcessMemoryInfo( pi.hProcess, &pmc, sizeof( pmc ) ) )
+	{
+		uPeakBytes = pmc.PeakWorkingSetSize;
+	}
+
+	DWORD uExitCode = 1;
+	GetExitCodeProcess( pi.hProcess, &uExitCode );
+
+	CloseHandle( pi.hThread );
+	CloseHandle( pi.hProcess );
+
+	return uExitCode == 0;
+}
+
+#else
+
+static bool run_tool( const std::vector< std::string >& aCommand, std::string& strOutput, uint64_t& uPeakBytes )
+{
+	int aPipe[ 2 ];
+	if ( pipe( aPipe ) != 0 )
+	{
+		return false;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_adddup2( &actions, aPipe[ 1 ], STDOUT_FILENO );
+	posix_spawn_file_actions_adddup2( &actions, aPipe[ 1 ], STDERR_FILENO );
+	posix_spawn_file_actions_addclose( &actions, aPipe[ 0 ] );
+	posix_spawn_file_actions_addclose( &actions, aPipe[ 1 ] );
+
+	std::vector< char* > aArgv;
+	for ( const std::string& strArg : aCommand )
+	{
+		aArgv.push_back( const_cast< char* >( strArg.c_str() ) );
+	}
+	aArgv.push_back( nullptr );
+
+	pid_t pid = 0;
+	const int iSpawned = posix_spawn( &pid, aArgv[ 0 ], &actions, nullptr, aArgv.data(), environ );
+	posix_spawn_file_actions_destroy( &actions );
+	close( aPipe[ 1 ] );
+
+	if ( iSpawned != 0 )
+	{
+		close( aPipe[ 0 ] );
+		return false;
+	}
+
+	char buffer[ 4096 ];
+	ssize_t iRead;
+	while ( ( iRead = read( aPipe[ 0 ], buffer, sizeof( buffer ) ) ) > 0 )
+	{
+		strOutput.append( buffer, size_t( iRead ) );
+	}
+	close( aPipe[ 0 ] );
+
+	int iStatus = 0;
+	struct rusage usage = {};
+	if ( wait4( pid, &iStatus, 0, &usage ) != pid )
+	{
+		return false;
+	}
+
+	uPeakBytes = uint64_t( usage.ru_maxrss ) * 1024; // in KB on Linux
+
+	return WIFEXITED( iStatus ) && WEXITSTATUS( iStatus ) == 0;
+}
+
+#endif
+
+//
+// tool_path
+//
+// The tool's executable: in -bin, or else in the tool's own build folder of the same
+// configuration as palbench's (palbench\build\.obj\Release\ and imgsize\build\.obj\Release\),
+// or beside palbench.
+//
+static std::string tool_path( const options_t& options, const std::string& strTool )
+{
+	namespace fs = std::filesystem;
+
+	const std::string strExe = strTool + kExeExtension;
+
+	if ( options.strBinFolder.empty() == false )
+	{
+		return ( fs::path( options.strBinFolder ) / strExe ).string();
+	}
+
+	std::error_code ec;
+	const fs::path self = fs::absolute( options.strSelf, ec ).parent_path();
+	const fs::path build = self.parent_path().parent_path().parent_path().parent_path() / strTool / "build" / ".obj" / self.filename() / strExe;
+	if ( fs::exists( build, ec ) )
+	{
+		return build.string();
+	}
+
+	return ( self / strExe ).string();
+}
+
+//=============================================================================
+
+//
+// is_number
+//
+static bool is_number( const std::string& strToken )
+{
+	if ( strToken.empty() )
+	{
+		return false;
+	}
+
+	char* pEnd = nullptr;
+	strtod( strToken.c_str(), &pEnd );
+	return *pEnd == '\0';
+}
+
+//
+// is_hash
+//
+// 16 hex digits, as every tool's -bench prints its output hash.
+//
+static bool is_hash( const std::string& strToken )
+{
+	return strToken.size() == 16 && std::all_of( strToken.begin(), strToken.end(), []( char c ) { return isxdigit( static_cast< unsigned char >( c ) ) != 0; } );
+}
+
+//
+// split_words
+//
+// Split a line of tool output at spaces.
+//
+static std::vector< std::string > split_words( const std::string& strLine )
+{
+	std::vector< std::string > aWords;
+	std::istringstream stream( strLine );
+	std::string strWord;
+	while ( stream >> strWord )
+	{
+		aWords.push_back( strWord );
+	}
+	return aWords;
+}
+
+//
+// parse_bench_output
+//
+// The cases of a -bench run. A line that is not indented starts a section (its text, less a
+// last ':'), unless it is a setting of the run ("Scan kernels: avx2", a few words, ':' and
+// one word), which goes in aSettings so that the cases keep their names on any CPU. An indented line is a case when it has a time: its name is the words before
+// its first number, the time is the number before "ms" or "ns/op", each other number with a
+// word after it is a measure in that unit, and 16 hex digits at the end are the hash. A
+// table (fogpal's) has a header line starting "case" instead, whose columns name the
+// numbers of the rows below; its last "ms" column is the time.
+//
+static std::vector< bench_case_t > parse_bench_output( const std::string& strOutput, std::vector< std::string >& aSettings )
+{
+	std::vector< bench_case_t > aCases;
+	std::string strSection;
+	std::vector< std::string > aColumns; // of the table being read, or empty
+
+	std::istringstream stream( strOutput );
+	std::string strLine;
+	while ( std::getline( stream, strLine ) )
+	{
+		if ( strLine.empty() == false && strLine.back() == '\r' )
+		{
+			strLine.pop_back();
+		}
+
+		const std::vector< std::string > aWords = split_words( strLine );
+		if ( aWords.empty() )
+		{
+			aColumns.clear();
+			continue;
+		}
+
+		if ( strLine.find_first_not_of( "-=" ) == strLine.npos )
+		{
+			continue; // the tool's banner
+		}
+
+		if ( strLine[ 0 ] != ' ' && strLine[ 0 ] != '\t' )
+		{
+			const size_t colon = strLine.find( ": " );
+			if ( colon != strLine.npos && colon + 2 < strLine.size() && strLine.find_first_of( " \t", colon + 2 ) == strLine.npos &&
+				 strLine.find_first_of( "0123456789,", 0 ) >= colon )
+			{
+				aSettings.push_back( strLine );
+				continue;
+			}
+
+			strSection = strLine;
+			if ( strSection.back() == ':' )
+			{
+				strSection.pop_back();
+			}
+			aColumns.clear();
+			continue;
+		}
+
+		if ( aWords[ 0 ] == "case" )
+		{
+			// a part in brackets belongs to the column before it: "ms (build)".
+			aColumns.clear();
+			for ( const std::string& strWord : aWords )
+			{
+				if ( strWord[ 0 ] == '(' && aColumns.empty() == false )
+				{
+					aColumns.back() += " " + strWord;
+				}
+				else
+				{
+					aColumns.push_back( strWord );
+				}
+			}
+			continue;
+		}
+
+		bench_case_t item;
+
+		if ( aColumns.empty() == false )
+		{
+			if ( aWords.size() != aColumns.size() )
+			{
+				continue;
+			}
+
+			item.strName = aWords[ 0 ];
+			for ( size_t i = 1; i < aWords.size(); ++i )
+			{
+				if ( aColumns[ i ] == "hash" && is_hash( aWords[ i ] ) )
+				{
+					item.strHash = aWords[ i ];
+				}
+				else if ( is_number( aWords[ i ] ) )
+				{
+					if ( aColumns[ i ] == "ms" )
+					{
+						item.strUnit = "ms";
+						item.aSamples = { atof( aWords[ i ].c_str() ) };
+					}
+					else
+					{
+						item.aMeasures.push_back( { aColumns[ i ], atof( aWords[ i ].c_str() ) } );
+					}
+				}
+			}
+		}
+		else
+		{
+			size_t i = 0;
+			for ( ; i < aWords.size() && is_number( aWords[ i ] ) == false; ++i )
+			{
+				item.strName += ( i > 0 ? " " : "" ) + aWords[ i ];
+			}
+
+			for ( ; i < aWords.size(); ++i )
+			{
+				if ( i + 1 == aWords.size() && is_hash( aWords[ i ] ) )
+				{
+					item.strHash = aWords[ i ];
+				}
+				else if ( i + 1 < aWords.size() && is_number( aWords[ i ] ) )
+				{
+					const std::string& strUnit = aWords[ i + 1 ];
+					if ( item.strUnit.empty() && ( strUnit == "ms" || strUnit == "ns/op" ) )
+					{
+						item.strUnit = strUnit;
+						item.aSamples = { atof( aWords[ i ].c_str() ) };
+					}
+					else if ( is_number( strUnit ) == false && is_hash( strUnit ) == false )
+					{
+						item.aMeasures.push_back( { strUnit, atof( aWords[ i ].c_str() ) } );
+					}
+					++i;
+				}
+			}
+		}
+
+		if ( item.strUnit.empty() || item.strName.empty() )
+		{
+			continue;
+		}
+
+		if ( strSection.empty() == false )
+		{
+			item.strName = strSection + " / " + item.strName;
+		}
+
+		aCases.push_back( std::move( item ) );
+	}
+
+	return aCases;
+}
+
+//=============================================================================
+
+//
+// json_t
+//
+// Just enough JSON to read back the results palbench writes, for -baseline.
+//
+struct json_t
+{
+	enum type_t
+	{
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT,
+	};
+
+	type_t type = JSON_NULL;
+	double fNumber = 0.0;
+	std::string strText;
+	std::vector< json_t > aItems;
+	std::vector< std::pair< std::string, json_t > > aMembers;
+
+	const json_t* Find( const char* szKey ) const
+	{
+		for ( const std::pair< std::string, json_t >& member : aMembers )
+		{
+			if ( member.first == szKey )
+			{
+				return &member.second;
+			}
+		}
+		return nullptr;
+	}
+
+	double Number( const char* szKey ) const
+	{
+		const json_t* p = Find( szKey );
+		return ( p && p->type == JSON_NUMBER ) ? p->fNumber : 0.0;
+	}
+
+	std::string Text( const char* szKey ) const
+	{
+		const json_t* p = Find( szKey );
+		return ( p && p->type == JSON_STRING ) ? p->strText : std::string();
+	}
+};
+
+static void json_skip_space( const char*& p )
+{
+	while ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' )
+	{
+		++p;
+	}
+}
+
+static bool json_parse_string( const char*& p, std::string& strOut )
+{
+	if ( *p != '"' )
+	{
+		return false;
+	}
+
+	for ( ++p; *p != '"'; ++p )
+	{
+		if ( *p == '\0' )
+		{
+			return false;
+		}
+
+		if ( *p == '\\' )
+		{
+			++p;
+			switch ( *p )
+			{
+			case 'n': strOut += '\n'; break;
+			case 't': strOut += '\t'; break;
+			case 'r': strOut += '\r'; break;
+			case '\0': return false;
+			default: strOut += *p; break; // \" \\ \/ (palbench writes no \u)
+			}
+		}
+		else
+		{
+			strOut += *p;
+		}
+	}
+
+	++p;
+	return true;
+}
+
+static bool json_parse( const char*& p, json_t& value )
+{
+	json_skip_space( p );
+
+	if ( *p == '{' )
+	{
+		value.type = json_t::JSON_OBJECT;
+		++p;
+		json_skip_space( p );
+		if ( *p == '}' )
+		{
+			++p;
+			return true;
+		}
+
+		for ( ; ; )
+		{
+			json_skip_space( p );
+			std::pair< std::string, json_t > member;
+			if ( json_parse_string( p, member.first ) == false )
+			{
+				return false;
+			}
+
+			json_skip_space( p );
+			if ( *p++ != ':' || json_parse( p, member.second ) == false )
+			{
+				return false;
+			}
+			value.aMembers.push_back( std::move( member ) );
+
+			json_skip_space( p );
+			if ( *p == ',' )
+			{
+				++p;
+			}
+			else
+			{
+				return *p++ == '}';
+			}
+		}
+	}
+
+	if ( *p == '[' )
+	{
+		value.type = json_t::JSON_ARRAY;
+		++p;
+		json_skip_space( p );
+		if ( *p == ']' )
+		{
+			++p;
+			return true;
+		}
+
+		for ( ; ; )
+		{
+			json_t item;
+			if ( json_parse( p, item ) == false )
+			{
+				return false;
+			}
+			value.aItems.push_back( std::move( item ) );
+
+			json_skip_space( p );
+			if ( *p == ',' )
+			{
+				++p;
+			}
+			else
+			{
+				return *p++ == ']';
+			}
+		}
+	}
+
+	if ( *p == '"' )
+	{
+		value.type = json_t::JSON_STRING;
+		return json_parse_string( p, value.strText );
+	}
+
+	if ( strncmp( p, "true", 4 ) == 0 || strncmp( p, "false", 5 ) == 0 )
+	{
+		value.type = json_t::JSON_BOOL;
+		value.fNumber = ( *p == 't' ) ? 1.0 : 0.0;
+		p += ( *p == 't' ) ? 4 : 5;
+		return true;
+	}
+
+	if ( strncmp( p, "null", 4 ) == 0 )
+	{
+		p += 4;
+		return true;
+	}
+
+	char* pEnd = nullptr;
+	value.type = json_t::JSON_NUMBER;
+	value.fNumber = strtod( p, &pEnd );
+	if ( pEnd == p )
+	{
+		return false;
+	}
+	p = pEnd;
+	return true;
+}
+
+//
+// json_escape
+//
+static std::string json_escape( const std::string& strText )
+{
+	std::string strOut;
+	for ( const char c : strText )
+	{
+		if ( c == '"' || c == '\\' )
+		{
+			strOut += '\\';
+			strOut += c;
+		}
+		else if ( c == '\t' )
+		{
+			strOut += "\\t";
+		}
+		else if ( static_cast< unsigned char >( c ) >= 0x20 )
+		{
+			strOut += c;
+		}
+	}
+	return strOut;
+}
+
+//
+// write_results
+//
+// The corpus version and every bench, with each case's samples, as JSON.
+//
+static bool write_results( const options_t& options, const std::string& strVersion, const std::vector< bench_t >& aBenches )
+{
+	FILE* fp = fopen( options.strOutFile.c_str(), "w" );
+	if ( fp == nullptr )
+	{
+		printf( "Error - failed to write \"%s\".\n", options.strOutFile.c_str() );
+		return false;
+	}
+
+	fprintf( fp, "{\n  \"corpus\": \"%s\",\n  \"version\": \"%s\",\n  \"runs\": %d,\n  \"benches\": [\n", json_escape( options.strCorpusFile ).c_str(),
+			 json_escape( strVersion ).c_str(), options.iRuns );
+
+	for ( size_t b = 0; b < aBenches.size(); ++b )
+	{
+		const bench_t& bench = aBenches[ b ];
+
+		fprintf( fp, "    {\n      \"key\": \"%s\",\n      \"tool\": \"%s\",\n      \"set\": \"%s\",\n      \"files\": %llu,\n      \"failed\": %s,\n",
+				 json_escape( bench.strKey ).c_str(), json_escape( bench.strTool ).c_str(), json_escape( bench.strSet ).c_str(), (unsigned long long)bench.uFiles,
+				 bench.bFailed ? "true" : "false" );
+		fprintf( fp, "      \"settings\": [" );
+		for ( size_t i = 0; i < bench.aSettings.size(); ++i )
+		{
+			fprintf( fp, "%s\"%s\"", i ? ", " : "", json_escape( bench.aSettings[ i ] ).c_str() );
+		}
+		fprintf( fp, "],\n      \"peak_bytes\": %llu,\n      \"wall_ms\": [", (unsigned long long)bench.uPeakBytes );
+		for ( size_t i = 0; i < bench.aWallMs.size(); ++i )
+		{
+			fprintf( fp, "%s%.3f", i ? ", " : "", bench.aWallMs[ i ] );
+		}
+		fprintf( fp, "],\n      \"cases\": [\n" );
+
+		for ( size_t c = 0; c < bench.aCases.size(); ++c )
+		{
+			const bench_case_t& item = bench.aCases[ c ];
+
+			fprintf( fp, "        { \"name\": \"%s\", \"unit\": \"%s\", \"mean\": %.6g, \"stddev\": %.6g, \"samples\": [", json_escape( item.strName ).c_str(),
+					 item.strUnit.c_str(), item.Mean(), item.StdDev() );
+			for ( size_t i = 0; i < item.aSamples.size(); ++i )
+			{
+				fprintf( fp, "%s%.6g", i ? ", " : "", item.aSamples[ i ] );
+			}
+			fprintf( fp, "]" );
+
+			for ( const std::pair< std::string, double >& measure : item.aMeasures )
+			{
+				fprintf( fp, ", \"%s\": %.6g", json_escape( measure.first ).c_str(), measure.second );
+			}
+
+			if ( item.strHash.empty() == false )
+			{
+				fprintf( fp, ", \"hash\": \"%s\"", item.bHashStable ? item.strHash.c_str() : "unstable" );
+			}
+
+			fprintf( fp, " }%s\n", ( c + 1 < bench.aCases.size() ) ? "," : "" );
+		}
+
+		fprintf( fp, "      ]\n    }%s\n", ( b + 1 < aBenches.size() ) ? "," : "" );
+	}
+
+	fprintf( fp, "  ]\n}\n" );
+	fclose( fp );
+
+	printf( "Results written to \"%s\".\n", options.strOutFile.c_str() );
+	return true;
+}
+
+//=============================================================================
+
+//
+// compare_baseline
+//
+// Compare each case with the one of the same bench and name in the baseline. A time is
+// slower (or faster) when its mean has moved by more than the threshold and Welch's t of
+// the two sets of samples is past 3, so one noisy run does not count; with only one
+// sample each side the threshold alone decides. Peak memory is held to the threshold too.
+// True if nothing was slower, changed or gone.
+//
+static bool compare_baseline( const options_t& options, const std::string& strVersion, const std::vector< bench_t >& aBenches )
+{
+	std::ifstream file( options.strBaselineFile, std::ios::binary );
+	if ( file.is_open() == false )
+	{
+		printf( "Error - failed to open baseline \"%s\".\n", options.strBaselineFile.c_str() );
+		return false;
+	}
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	const std::string strJson = buffer.str();
+
+	json_t baseline;
+	const char* p = strJson.c_str();
+	if ( json_parse( p, baseline ) == false || baseline.type != json_t::JSON_OBJECT )
+	{
+		printf( "Error - baseline \"%s\" is not palbench results.\n", options.strBaselineFile.c_str() );
+		return false;
+	}
+
+	if ( baseline.Text( "version" ) != strVersion )
+	{
+		printf( "Error - the baseline is of corpus version \"%s\", not \"%s\"; not compared.\n", baseline.Text( "version" ).c_str(), strVersion.c_str() );
+		return false;
+	}
+
+	const double fThreshold = options.fThreshold / 100.0;
+	size_t uSlower = 0;
+	size_t uFaster = 0;
+	size_t uChanged = 0;
+	size_t uGone = 0;
+	size_t uSame = 0;
+
+	printf( "\nAgainst \"%s\":\n", options.strBaselineFile.c_str() );
+
+	const json_t* pBenches = baseline.Find( "benches" );
+	if ( pBenches == nullptr )
+	{
+		return false;
+	}
+
+	for ( const json_t& base_bench : pBenches->aItems )
+	{
+		const std::string strKey = base_bench.Text( "key" );
+		const auto it = std::find_if( aBenches.begin(), aBenches.end(), [&]( const bench_t& bench ) { return bench.strKey == strKey; } );
+		if ( it == aBenches.end() )
+		{
+			printf( "  GONE     %s\n", strKey.c_str() );
+			++uGone;
+			continue;
+		}
+
+		const bench_t& bench = *it;
+
+		// other kernels (another CPU, or -cpu=) are still compared, but say so.
+		std::vector< std::string > aBaseSettings;
+		if ( const json_t* pSettings = base_bench.Find( "settings" ) )
+		{
+			for ( const json_t& setting : pSettings->aItems )
+			{
+				aBaseSettings.push_back( setting.strText );
+			}
+		}
+		if ( aBaseSettings != bench.aSettings )
+		{
+			for ( const std::string& strSetting : bench.aSettings )
+			{
+				if ( std::find( aBaseSettings.begin(), aBaseSettings.end(), strSetting ) == aBaseSettings.end() )
+				{
+					printf( "  NOTE     %s: %s, not as in the baseline\n", strKey.c_str(), strSetting.c_str() );
+				}
+			}
+		}
+
+		const double fBasePeak = base_bench.Number( "peak_bytes" );
+		if ( fBasePeak > 0.0 && double( bench.uPeakBytes ) > fBasePeak * ( 1.0 + fThreshold ) )
+		{
+			printf( "  MEMORY   %s: peak %.1f MB, was %.1f MB\n", strKey.c_str(), double( bench.uPeakBytes ) / ( 1024.0 * 1024.0 ), fBasePeak / ( 1024.0 * 1024.0 ) );
+			++uSlower;
+		}
+
+		const json_t* pCases = base_bench.Find( "cases" );
+		if ( pCases == nullptr )
+		{
+			continue;
+		}
+
+		for ( const json_t& base_case : pCases->aItems )
+		{
+			const std::string strName = base_case.Text( "name" );
+			const auto found = std::find_if( bench.aCases.begin(), bench.aCases.end(), [&]( const bench_case_t& item ) { return item.strName == strName; } );
+			if ( found == bench.aCases.end() )
+			{
+				printf( "  GONE     %s: %s\n", bench.strTool.c_str(), strName.c_str() );
+				++uGone;
+				continue;
+			}
+
+			const bench_case_t& item = *found;
+
+			const std::string strBaseHash = base_case.Text( "hash" );
+			if ( strBaseHash != ( item.bHashStable ? item.strHash : std::string( "unstable" ) ) )
+			{
+				printf( "  CHANGED  %s: %s, hash %s, was %s\n", bench.strTool.c_str(), strName.c_str(), item.bHashStable ? item.strHash.c_str() : "unstable",
+						strBaseHash.c_str() );
+				++uChanged;
+			}
+
+			std::vector< double > aBase;
+			if ( const json_t* pSamples = base_case.Find( "samples" ) )
+			{
+				for ( const json_t& sample : pSamples->aItems )
+				{
+					aBase.push_back( sample.fNumber );
+				}
+			}
+
+			const double fBaseMean = base_case.Number( "mean" );
+			const double fBaseDev = base_case.Number( "stddev" );
+			const double fMean = item.Mean();
+			const double fDev = item.StdDev();
+			if ( fBaseMean <= 0.0 || aBase.empty() )
+			{
+				continue;
+			}
+
+			const double fDelta = ( fMean - fBaseMean ) / fBaseMean;
+			const double fError = sqrt( fDev * fDev / double( item.aSamples.size() ) + fBaseDev * fBaseDev / double( aBase.size() ) );
+			const bool bSignificant = ( item.aSamples.size() < 2 || aBase.size() < 2 ) || ( fError == 0.0 ) || ( fabs( fMean - fBaseMean ) / fError > 3.0 );
+
+			if ( bSignificant && fDelta > fThreshold )
+			{
+				printf( "  SLOWER   %s: %s, %.4g %s, was %.4g (%+.1f%%)\n", bench.strTool.c_str(), strName.c_str(), fMean, item.strUnit.c_str(), fBaseMean, fDelta * 100.0 );
+				++uSlower;
+			}
+			else if ( bSignificant && fDelta < -fThreshold )
+			{
+				printf( "  FASTER   %s: %s, %.4g %s, was %.4g (%+.1f%%)\n", bench.strTool.c_str(), strName.c_str(), fMean, item.strUnit.c_str(), fBaseMean, fDelta * 100.0 );
+				++uFaster;
+			}
+			else
+			{
+				++uSame;
+			}
+		}
+	}
+
+	printf( "\n%llu slower, %llu faster, %llu the same, %llu changed output, %llu gone.\n", (unsigned long long)uSlower, (unsigned long long)uFaster,
+			(unsigned long long)uSame, (unsigned long long)uChanged, (unsigned long long)uGone );
+
+	return uSlower == 0 && uChanged == 0 && uGone == 0;
+}
+
+//=============================================================================
+
+//
+// process_args
+//
+// Parse the command line into options. False for help or an error.
+//
+static bool process_args( int argc, char** argv, options_t& options )
+{
+	options.strSelf = argv[ 0 ];
+
+	for ( int iArg = 1; iArg < argc; ++iArg )
+	{
+		const char* szArg = argv[ iArg ];
+
+		if ( strcmp( szArg, "-?" ) == 0 || _stricmp( szArg, "-help" ) == 0 )
+		{
+			return false;
+		}
+		else if ( strncmp( szArg, "-runs=", 6 ) == 0 )
+		{
+			options.iRuns = atoi( szArg + 6 );
+
+			if ( options.iRuns <= 0 )
+			{
+				printf( "Error - invalid number of runs (%d).\n", options.iRuns );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-bin=", 5 ) == 0 )
+		{
+			options.strBinFolder = szArg + 5;
+		}
+		else if ( strcmp( szArg, "-o" ) == 0 && iArg + 1 < argc )
+		{
+			options.strOutFile = argv[ ++iArg ];
+		}
+		else if ( strcmp( szArg, "-baseline" ) == 0 && iArg + 1 < argc )
+		{
+			options.strBaselineFile = argv[ ++iArg ];
+		}
+		else if ( strncmp( szArg, "-threshold=", 11 ) == 0 )
+		{
+			options.fThreshold = atof( szArg + 11 );
+
+			if ( options.fThreshold < 0.0 )
+			{
+				printf( "Error - invalid threshold (%s).\n", szArg + 11 );
+				return false;
+			}
+		}
+		else if ( options.strCorpusFile.empty() && ( szArg[ 0 ] != '-' ) )
+		{
+			options.strCorpusFile = szArg;
+		}
+		else
+		{
+			printf( "Error - unknown option \"%s\"\n", szArg );
+			return false;
+		}
+	}
+
+	if ( options.strCorpusFile.empty() )
+	{
+		printf( "Error - no corpus file specified.\n" );
+		return false;
+	}
+
+	return true;
+}
+
+//
+// read_corpus
+//
+// The version and benches of a corpus file, each bench with its set's wildcards and the
+// number of files they find. False on an error, with its line.
+//
+static bool read_corpus( const options_t& options, std::string& strVersion, std::vector< bench_t >& aBenches )
+{
+	std::ifstream file( options.strCorpusFile );
+	if ( file.is_open() == false )
+	{
+		printf( "Error - failed to open corpus \"%s\".\n", options.strCorpusFile.c_str() );
+		return false;
+	}
+
+	std::map< std::string, std::vector< std::string > > mapSets;
+
+	int iLine = 0;
+	std::string strLine;
+	while ( std::getline( file, strLine ) )
+	{
+		++iLine;
+
+		const std::vector< std::string > aTokens = split_line( strLine );
+		if ( aTokens.empty() )
+		{
+			continue;
+		}
+
+		if ( aTokens[ 0 ] == "version" && aTokens.size() == 2 )
+		{
+			strVersion = aTokens[ 1 ];
+		}
+		else if ( aTokens[ 0 ] == "set" && aTokens.size() >= 3 )
+		{
+			mapSets[ aTokens[ 1 ] ].assign( aTokens.begin() + 2, aTokens.end() );
+		}
+		else if ( aTokens[ 0 ] == "bench" && aTokens.size() >= 3 )
+		{
+			bench_t bench;
+			bench.strTool = aTokens[ 1 ];
+			bench.strSet = aTokens[ 2 ];
+			bench.aArgs.push_back( "-bench" );
+			bench.aArgs.insert( bench.aArgs.end(), aTokens.begin() + 3, aTokens.end() );
+
+			bench.strKey = bench.strTool + " " + bench.strSet;
+			for ( size_t i = 3; i < aTokens.size(); ++i )
+			{
+				bench.strKey += " " + aTokens[ i ];
+			}
+
+			if ( bench.strSet != "-" )
+			{
+				const auto it = mapSets.find( bench.strSet );
+				if ( it == mapSets.end() )
+				{
+					printf( "Error - %s(%d): no set \"%s\" above.\n", options.strCorpusFile.c_str(), iLine, bench.strSet.c_str() );
+					return false;
+				}
+
+				// the tools expand the wildcards themselves, so a set of any size fits on their command line.
+				std::vector< std::string > aFiles;
+				for ( const std::string& strWildCard : it->second )
+				{
+					find_files( strWildCard.c_str(), aFiles );
+				}
+				sort_files( aFiles );
+
+				bench.uFiles = aFiles.size();
+				bench.aArgs.insert( bench.aArgs.end(), it->second.begin(), it->second.end() );
+			}
+
+			aBenches.push_back( std::move( bench ) );
+		}
+		else
+		{
+			printf( "Error - %s(%d): unknown line \"%s\".\n", options.strCorpusFile.c_str(), iLine, aTokens[ 0 ].c_str() );
+			return false;
+		}
+	}
+
+	if ( aBenches.empty() )
+	{
+		printf( "Error - corpus \"%s\" has no benches.\n", options.strCorpusFile.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+//
+// run_bench
+//
+// Run one bench options.iRuns times, keeping every run's time of each case. A case is
+// the line of the same name in each run.
+//
+static void run_bench( const options_t& options, bench_t& bench )
+{
+	const std::string strExe = tool_path( options, bench.strTool );
+
+	printf( "%s %s (%llu files) ", bench.strTool.c_str(), bench.strSet.c_str(), (unsigned long long)bench.uFiles );
+	fflush( stdout );
+
+	if ( bench.strSet != "-" && bench.uFiles == 0 )
+	{
+		printf( "... no files, skipped\n" );
+		return;
+	}
+
+	for ( int iRun = 0; iRun < options.iRuns; ++iRun )
+	{
+		std::string strOutput;
+		uint64_t uPeakBytes = 0;
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+#ifdef _WIN32
+		std::string strCommand = "\"" + strExe + "\"";
+		for ( const std::string& strArg : bench.aArgs )
+		{
+			strCommand += ( strArg.find_first_of( " \t" ) != strArg.npos ) ? " \"" + strArg + "\"" : " " + strArg;
+		}
+		const bool bOK = run_tool( strCommand, strOutput, uPeakBytes );
+#else
+		std::vector< std::string > aCommand = { strExe };
+		aCommand.insert( aCommand.end(), bench.aArgs.begin(), bench.aArgs.end() );
+		const bool bOK = run_tool( aCommand, strOutput, uPeakBytes );
+#endif
+
+		bench.aWallMs.push_back( std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() );
+		bench.uPeakBytes = std::max( bench.uPeakBytes, uPeakBytes );
+
+		if ( bOK == false )
+		{
+			printf( "... FAILED to run \"%s\"\n", strExe.c_str() );
+			bench.bFailed = true;
+			return;
+		}
+
+		std::vector< std::string > aSettings;
+		std::vector< bench_case_t > aRun = parse_bench_output( strOutput, aSettings );
+
+		if ( iRun == 0 )
+		{
+			bench.aSettings = std::move( aSettings );
+			bench.aCases = std::move( aRun );
+		}
+		else
+		{
+			for ( bench_case_t& item : bench.aCases )
+			{
+				const auto it = std::find_if( aRun.begin(), aRun.end(), [&]( const bench_case_t& other ) { return other.strName == item.strName; } );
+				if ( it != aRun.end() )
+				{
+					item.aSamples.insert( item.aSamples.end(), it->aSamples.begin(), it->aSamples.end() );
+					item.bHashStable &= ( it->strHash == item.strHash );
+				}
+			}
+		}
+
+		putchar( '.' );
+		fflush( stdout );
+	}
+
+	printf( " %llu cases, peak %.1f MB\n", (unsigned long long)bench.aCases.size(), double( bench.uPeakBytes ) / ( 1024.0 * 1024.0 ) );
+}
+
+//
+// do_work
+//
+// Run every bench of the corpus, write the results, and compare them with the baseline.
+// False if a bench failed or the baseline comparison found a regression.
+//
+static bool do_work( const options_t& options )
+{
+	print_hello();
+
+	std::string strVersion;
+	std::vector< bench_t > aBenches;
+	if ( read_corpus( options, strVersion, aBenches ) == false )
+	{
+		return false;
+	}
+
+	printf( "Corpus \"%s\", version %s, %d runs each:\n\n", options.strCorpusFile.c_str(), strVersion.empty() ? "(none)" : strVersion.c_str(), options.iRuns );
+
+	bool bOK = true;
+	for ( bench_t& bench : aBenches )
+	{
+		run_bench( options, bench );
+		bOK &= ( bench.bFailed == false );
+	}
+
+	putchar( '\n' );
+
+	if ( write_results( options, strVersion, aBenches ) == false )
+	{
+		return false;
+	}
+
+	if ( options.strBaselineFile.empty() == false )
+	{
+		bOK &= compare_baseline( options, strVersion, aBenches );
+	}
+
+	return bOK;
+}
+
+//
+// main
+//
+// Program entry point. The exit code is 1 if a bench failed or the baseline comparison
+// found a case slower, changed or gone, so a build can reject the change.
+//
+int main( int argc, char** argv )
+{
+	// Options
+	options_t options;
+
+	if ( process_args( argc, argv, options ) )
+	{
+		return do_work( options ) ? 0 : 1;
+	}
+
+	// Failure. Offer the user some help.
+	print_hello();
+	print_help();
+
+	return 0;
+}
+
+//=============================================================================
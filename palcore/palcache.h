@@ -0,0 +1,372 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palcache.h
+//
+// The folder of artefacts that the tools keep between runs, for incremental asset builds:
+// imgsize's -cache outputs and applypal's -lutcache cubes. Each entry is named by a 64-bit
+// key, a hash (cache_hash_t) of the contents of its inputs and of every option that shapes
+// it, so an entry is never stale, only unused. The folder is held to a size, the entries
+// used longest ago going first. Any number of runs may share it at once: an entry is
+// written to a temporary name and renamed into place, so it is whole or not there, and an
+// entry removed while it is being fetched is only a miss. Header only; uses
+// std::filesystem (C++17).
+//
+
+#pragma once
+
+#include "paltrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h> // _getpid
+#else
+#include <unistd.h>
+#endif
+
+//=============================================================================
+
+inline int cache_process_id()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return int( getpid() );
+#endif
+}
+
+//
+// cache_hash_t
+//
+// 64-bit FNV-1a, of the options as 32-bit values and of whole inputs a word at a time.
+//
+struct cache_hash_t
+{
+	uint64_t uHash = 0xcbf29ce484222325ULL;
+
+	void Add( uint32_t value )
+	{
+		for ( int i = 0; i < 4; ++i )
+		{
+			uHash = ( uHash ^ ( ( value >> ( i * 8 ) ) & 0xFF ) ) * 0x100000001b3ULL;
+		}
+	}
+
+	void Add( uint64_t value )
+	{
+		Add( uint32_t( value ) );
+		Add( uint32_t( value >> 32 ) );
+	}
+
+	void Add( const std::string& str )
+	{
+		Add( uint32_t( str.size() ) );
+		for ( char c : str )
+		{
+			uHash = ( uHash ^ uint8_t( c ) ) * 0x100000001b3ULL;
+		}
+	}
+
+	// an input file's contents, with its size.
+	void AddData( const uint8_t* pData, size_t size )
+	{
+		size_t i = 0;
+		for ( ; i + 8 <= size; i += 8 )
+		{
+			uint64_t word;
+			memcpy( &word, pData + i, 8 );
+			uHash = ( uHash ^ word ) * 0xFF51AFD7ED558CCDULL;
+			uHash ^= uHash >> 32;
+		}
+		for ( ; i < size; ++i )
+		{
+			uHash = ( uHash ^ pData[ i ] ) * 0x100000001b3ULL;
+		}
+
+		Add( uint64_t( size ) );
+	}
+};
+
+//
+// cache_size_limit
+//
+// The most a cache folder holds: FRAGMENTS_CACHE_MB megabytes, or 4GB.
+//
+inline uint64_t cache_size_limit()
+{
+	const char* szLimit = getenv( "FRAGMENTS_CACHE_MB" );
+	const long long iLimit = szLimit ? atoll( szLimit ) : 0;
+
+	return uint64_t( ( iLimit > 0 ) ? iLimit : 4096 ) << 20;
+}
+
+//
+// artefact_cache_t
+//
+// The entries are <folder>/<first byte of the key>/<key>_<name>, 256 folders so that none
+// grows too long to list. A fetched entry has its time set to now, so that the time of each
+// is when it was last used. Trim, at the end of a run that stored anything, takes the
+// folder back under its limit; one run at a time trims, the one holding trim.lock.
+//
+struct artefact_cache_t
+{
+
+public:
+
+	static constexpr const char* kLockName = "trim.lock";
+	static constexpr auto kStaleLock = std::chrono::minutes( 10 ); // a lock this old was left by a run that stopped.
+	static constexpr auto kStaleTemp = std::chrono::hours( 1 ); // likewise a temporary file.
+
+	std::filesystem::path _folder;
+	uint64_t _uMaxBytes = 0;
+	std::atomic< bool > _bStored{ false };
+	std::atomic< uint32_t > _uTemp{ 0 };
+
+public:
+
+	bool IsOpen() const
+	{
+		return _folder.empty() == false;
+	}
+
+	// Use (and make) the folder, held to uMaxBytes. False if it can't be made.
+	bool Open( const std::string& strFolder, uint64_t uMaxBytes = cache_size_limit() )
+	{
+		std::error_code ec;
+		std::filesystem::create_directories( strFolder, ec );
+		if ( std::filesystem::is_directory( strFolder, ec ) == false )
+		{
+			return false;
+		}
+
+		_folder = strFolder;
+		_uMaxBytes = uMaxBytes;
+		return true;
+	}
+
+	// Where the entry is, or would be, kept.
+	std::string Path( uint64_t key, const char* szName ) const
+	{
+		char szShard[ 4 ];
+		char szFile[ 24 ];
+		snprintf( szShard, sizeof( szShard ), "%02x", unsigned( key >> 56 ) );
+		snprintf( szFile, sizeof( szFile ), "%016llx_", (unsigned long long)key );
+
+		return ( _folder / szShard / ( std::string( szFile ) + szName ) ).string();
+	}
+
+	// Is the entry kept? Marks it used if it is.
+	bool Touch( uint64_t key, const char* szName ) const
+	{
+		std::error_code ec;
+		std::filesystem::last_write_time( Path( key, szName ), std::filesystem::file_time_type::clock::now(), ec );
+		return !ec;
+	}
+
+	// Put the entry at strFile, as a hard link where the file system has them and a copy
+	// where it doesn't. False if it isn't kept, or went before it could be fetched.
+	bool Fetch( uint64_t key, const char* szName, const std::string& strFile ) const
+	{
+		if ( Touch( key, szName ) == false )
+		{
+			return false;
+		}
+
+		const std::string strEntry = Path( key, szName );
+
+		std::error_code ec;
+		std::filesystem::remove( strFile, ec );
+		std::filesystem::create_hard_link( strEntry, strFile, ec );
+		if ( ec )
+		{
+			ec.clear();
+			std::filesystem::copy_file( strEntry, strFile, std::filesystem::copy_options::overwrite_existing, ec );
+		}
+
+		return !ec;
+	}
+
+	// Keep an entry, written by fnWrite( strTemp ) (true if it wrote the whole of it) to a
+	// name of this run's own and then renamed into place. An entry another run kept first is
+	// as good, being of the same inputs. False if the entry isn't kept.
+	template < typename FN >
+	bool Store( uint64_t key, const char* szName, FN&& fnWrite )
+	{
+		const std::string strEntry = Path( key, szName );
+		const std::string strTemp = strEntry + "." + std::to_string( cache_process_id() ) + "." + std::to_string( _uTemp++ ) + ".tmp";
+
+		std::error_code ec;
+		std::filesystem::create_directories( std::filesystem::path( strEntry ).parent_path(), ec );
+
+		bool bStored = fnWrite( strTemp );
+		if ( bStored )
+		{
+			std::filesystem::rename( strTemp, strEntry, ec );
+			bStored = !ec || std::filesystem::is_regular_file( strEntry, ec );
+		}
+
+		std::filesystem::remove( strTemp, ec );
+
+		if ( bStored )
+		{
+			_bStored = true;
+		}
+
+		return bStored;
+	}
+
+	// Keep a copy of a file as the entry.
+	bool StoreFile( uint64_t key, const char* szName, const std::string& strFile )
+	{
+		return Store( key, szName, [&]( const std::string& strTemp )
+		{
+			std::error_code ec;
+			std::filesystem::copy_file( strFile, strTemp, std::filesystem::copy_options::overwrite_existing, ec );
+			return !ec;
+		} );
+	}
+
+	// If this run stored anything, remove the entries used longest ago until the folder is
+	// back to 90% of its limit, and any temporary files left by runs that stopped. Entries
+	// that are open elsewhere and can't be removed are passed over.
+	void Trim()
+	{
+		TRACE_ZONE( "cache_trim" );
+
+		if ( IsOpen() == false || _bStored == false )
+		{
+			return;
+		}
+
+		const std::filesystem::path lock = _folder / kLockName;
+		if ( Lock( lock ) == false )
+		{
+			return; // another run is trimming.
+		}
+
+		struct entry_t
+		{
+			std::filesystem::file_time_type time;
+			uint64_t size;
+			std::filesystem::path path;
+		};
+
+		std::vector< entry_t > aEntries;
+		uint64_t uTotal = 0;
+
+		const auto now = std::filesystem::file_time_type::clock::now();
+
+		std::error_code ec;
+		for ( std::filesystem::recursive_directory_iterator it( _folder, ec ); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment( ec ) )
+		{
+			std::error_code ec_entry;
+			if ( it->is_regular_file( ec_entry ) == false || it->path() == lock )
+			{
+				continue;
+			}
+
+			entry_t entry = { it->last_write_time( ec_entry ), it->file_size( ec_entry ), it->path() };
+			if ( ec_entry )
+			{
+				continue;
+			}
+
+			if ( entry.path.extension() == ".tmp" )
+			{
+				if ( now - entry.time > kStaleTemp )
+				{
+					std::filesystem::remove( entry.path, ec_entry );
+				}
+				continue;
+			}
+
+			uTotal += entry.size;
+			aEntries.push_back( std::move( entry ) );
+		}
+
+		if ( uTotal > _uMaxBytes )
+		{
+			std::sort( aEntries.begin(), aEntries.end(), []( const entry_t& a, const entry_t& b )
+			{
+				return a.time < b.time;
+			} );
+
+			const uint64_t uTarget = _uMaxBytes / 10 * 9;
+			for ( size_t i = 0; i < aEntries.size() && uTotal > uTarget; ++i )
+			{
+				std::error_code ec_entry;
+				if ( std::filesystem::remove( aEntries[ i ].path, ec_entry ) )
+				{
+					uTotal -= aEntries[ i ].size;
+				}
+			}
+		}
+
+		std::filesystem::remove( lock, ec );
+	}
+
+private:
+
+	// Make the lock file, which only one run can do, taking over one left by a run that stopped.
+	static bool Lock( const std::filesystem::path& lock )
+	{
+		for ( int attempt = 0; attempt < 2; ++attempt )
+		{
+			FILE* fp = nullptr;
+			if ( fopen_s( &fp, lock.string().c_str(), "wx" ) == 0 && fp != nullptr )
+			{
+				fclose( fp );
+				return true;
+			}
+
+			std::error_code ec;
+			const auto time = std::filesystem::last_write_time( lock, ec );
+			if ( ec || std::filesystem::file_time_type::clock::now() - time < kStaleLock )
+			{
+				return false;
+			}
+
+			std::filesystem::remove( lock, ec );
+		}
+
+		return false;
+	}
+};
+
+//=============================================================================
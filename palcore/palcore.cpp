@@ -0,0 +1,628 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+
+#include "palcore.h"
+
+#include <cfloat>
+#include <climits>
+#include <cstring>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+//=============================================================================
+
+//
+// srgb_linear_table
+//
+// Built on first use.
+//
+const float* srgb_linear_table()
+{
+	static const std::vector< float > aTable = []()
+	{
+		std::vector< float > aLinear( 256 );
+		for ( int i = 0; i < 256; ++i )
+		{
+			const double v = i / 255.0;
+			aLinear[ i ] = float( ( v <= 0.04045 ) ? ( v / 12.92 ) : std::pow( ( v + 0.055 ) / 1.055, 2.4 ) );
+		}
+		return aLinear;
+	}();
+
+	return aTable.data();
+}
+
+//
+// srgb_linear12_table
+//
+// Built on first use.
+//
+const uint16_t* srgb_linear12_table()
+{
+	static const std::vector< uint16_t > aTable = []()
+	{
+		const float* aLinear = srgb_linear_table();
+
+		std::vector< uint16_t > aLinear12( 256 );
+		for ( int i = 0; i < 256; ++i )
+		{
+			aLinear12[ i ] = uint16_t( std::lround( aLinear[ i ] * ( kLinearLevels - 1 ) ) );
+		}
+		return aLinear12;
+	}();
+
+	return aTable.data();
+}
+
+//
+// linear12_srgb_table
+//
+// Built on first use.
+//
+const uint8_t* linear12_srgb_table()
+{
+	static const std::vector< uint8_t > aTable = []()
+	{
+		std::vector< uint8_t > aSRGB( kLinearLevels );
+		for ( int i = 0; i < kLinearLevels; ++i )
+		{
+			const double v = i / double( kLinearLevels - 1 );
+			const double s = ( v <= 0.0031308 ) ? ( v * 12.92 ) : ( 1.055 * std::pow( v, 1.0 / 2.4 ) - 0.055 );
+			aSRGB[ i ] = uint8_t( std::clamp( std::lround( s * 255.0 ), 0L, 255L ) );
+		}
+		return aSRGB;
+	}();
+
+	return aTable.data();
+}
+
+//
+// oklab_bounds
+//
+// See palcore.h.
+//
+void oklab_bounds( const int lo[ 3 ], const int hi[ 3 ], double lab_lo[ 3 ], double lab_hi[ 3 ] )
+{
+	const float* aLinear = srgb_linear_table();
+
+	double lms_lo[ 3 ];
+	double lms_hi[ 3 ];
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		lms_lo[ i ] = std::cbrt( kOklabM1[ i ][ 0 ] * aLinear[ lo[ 0 ] ] + kOklabM1[ i ][ 1 ] * aLinear[ lo[ 1 ] ] + kOklabM1[ i ][ 2 ] * aLinear[ lo[ 2 ] ] );
+		lms_hi[ i ] = std::cbrt( kOklabM1[ i ][ 0 ] * aLinear[ hi[ 0 ] ] + kOklabM1[ i ][ 1 ] * aLinear[ hi[ 1 ] ] + kOklabM1[ i ][ 2 ] * aLinear[ hi[ 2 ] ] );
+	}
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		lab_lo[ j ] = lab_hi[ j ] = 0.0;
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			const double w = kOklabM2[ j ][ i ];
+			lab_lo[ j ] += w * ( ( w < 0 ) ? lms_hi[ i ] : lms_lo[ i ] );
+			lab_hi[ j ] += w * ( ( w < 0 ) ? lms_lo[ i ] : lms_hi[ i ] );
+		}
+	}
+}
+
+//
+// find_nearest_palette_index
+//
+// See palcore.h.
+//
+uint8_t find_nearest_palette_index( const color_t& colour1, const std::vector< color_t >& aPalette, size_t palStart )
+{
+	size_t best_index = palStart;
+	int best_score = rgb_color_distance_squared( colour1, aPalette[ palStart ] );
+
+	for ( size_t i = palStart + 1; i < aPalette.size(); ++i )
+	{
+		int score = rgb_color_distance_squared( colour1, aPalette[ i ] );
+
+		if ( score <= best_score )
+		{
+			best_score = score;
+			best_index = i;
+		}
+	}
+
+	return (uint8_t)best_index;
+}
+
+//=============================================================================
+
+//
+// mapped_file_t::Open
+//
+// Map the whole of a file in, read only. False if it is missing or empty.
+//
+bool mapped_file_t::Open( const std::string& file_name )
+{
+	Close();
+
+	HANDLE hFile = CreateFileA( file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	_hFile = hFile;
+
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx( _hFile, &size ) || size.QuadPart <= 0 )
+	{
+		Close(); // empty files can't be mapped.
+		return false;
+	}
+
+	_hMapping = CreateFileMappingA( _hFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( _hMapping == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	_pData = reinterpret_cast<const uint8_t*>( MapViewOfFile( _hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+	if ( _pData == nullptr )
+	{
+		Close();
+		return false;
+	}
+
+	_uSize = static_cast<size_t>( size.QuadPart );
+	return true;
+}
+
+//
+// mapped_file_t::Close
+//
+// Unmap the file, if one is open.
+//
+void mapped_file_t::Close()
+{
+	if ( _pData != nullptr )
+	{
+		UnmapViewOfFile( _pData );
+		_pData = nullptr;
+	}
+
+	if ( _hMapping != nullptr )
+	{
+		CloseHandle( _hMapping );
+		_hMapping = nullptr;
+	}
+
+	if ( _hFile != nullptr )
+	{
+		CloseHandle( _hFile );
+		_hFile = nullptr;
+	}
+
+	_uSize = 0;
+}
+
+//=============================================================================
+
+//
+// palette_lookup_t::Create
+//
+// Start an empty cube for aPalette, searched from palStart and matched by match.
+//
+void palette_lookup_t::Create( const std::vector< color_t >& aPalette, size_t palStart, match_t match )
+{
+	Start( aPalette, palStart, match );
+
+	if ( match == MATCH_OKLAB )
+	{
+		for ( const color_t& colour : aPalette )
+		{
+			_aLab.push_back( rgb_to_oklab( colour ) );
+		}
+	}
+}
+
+void palette_lookup_t::Create( const palette_t& palette, size_t palStart, match_t match )
+{
+	Start( palette.aColours, palStart, match );
+
+	if ( match == MATCH_OKLAB )
+	{
+		_aLab = palette.aOklab;
+	}
+}
+
+//
+// palette_lookup_t::Start
+//
+// Forget any cube of the last palette, before the Oklab of this one is filled in.
+//
+void palette_lookup_t::Start( const std::vector< color_t >& aPalette, size_t palStart, match_t match )
+{
+	_pPalette = &aPalette;
+	_palStart = palStart;
+	_match = match;
+
+	_aLab.clear();
+	_aCells.clear();
+	_aCells.resize( kCells );
+	_aFilled.assign( kCells, false );
+
+	_cache.Close();
+	_pOffsets = nullptr;
+	_pCandidates = nullptr;
+}
+
+//
+// palette_lookup_t::FillAll
+//
+// See palcore.h.
+//
+void palette_lookup_t::FillAll()
+{
+	if ( _pOffsets != nullptr )
+	{
+		return;
+	}
+
+	for ( uint32_t cell = 0; cell < _aCells.size(); ++cell )
+	{
+		if ( _aFilled[ cell ] == false )
+		{
+			FillCell( cell );
+		}
+	}
+}
+
+//
+// palette_lookup_t::Load
+//
+// Checks the header, the palette and every offset and candidate before using any of it.
+//
+bool palette_lookup_t::Load( const std::string& strFile )
+{
+	const std::vector< color_t >& aPalette = *_pPalette;
+
+	if ( _cache.Open( strFile ) == false )
+	{
+		return false;
+	}
+
+	const size_t uPaletteBytes = aPalette.size() * sizeof( uint32_t );
+	const size_t uOffsetBytes = ( kCells + 1 ) * sizeof( uint32_t );
+
+	cache_header_t header;
+	bool bValid = _cache._uSize >= sizeof( header ) + uPaletteBytes + uOffsetBytes;
+
+	if ( bValid )
+	{
+		memcpy( &header, _cache._pData, sizeof( header ) );
+
+		bValid = memcmp( header.magic, kCacheMagic, sizeof( kCacheMagic ) ) == 0
+			  && header.uCellBits == kCellBits
+			  && header.uPalStart == _palStart
+			  && header.uMatch == uint32_t( _match )
+			  && header.uPaletteSize == aPalette.size()
+			  && _cache._uSize == sizeof( header ) + uPaletteBytes + uOffsetBytes + header.uCandidates;
+	}
+
+	// the palette itself, in case of a hash collision.
+	for ( size_t i = 0; bValid && i < aPalette.size(); ++i )
+	{
+		uint32_t value;
+		memcpy( &value, _cache._pData + sizeof( header ) + i * sizeof( uint32_t ), sizeof( value ) );
+		bValid = ( value == aPalette[ i ].value_abgr );
+	}
+
+	const uint32_t* pOffsets = reinterpret_cast< const uint32_t* >( _cache._pData + sizeof( header ) + uPaletteBytes );
+	const uint8_t* pCandidates = _cache._pData + sizeof( header ) + uPaletteBytes + uOffsetBytes;
+
+	// every cell has a candidate, and they're all in the palette.
+	for ( size_t cell = 0; bValid && cell < kCells; ++cell )
+	{
+		bValid = pOffsets[ cell ] < pOffsets[ cell + 1 ] && pOffsets[ cell + 1 ] <= header.uCandidates;
+	}
+
+	for ( size_t i = 0; bValid && i < header.uCandidates; ++i )
+	{
+		bValid = pCandidates[ i ] >= _palStart && pCandidates[ i ] < aPalette.size();
+	}
+
+	if ( bValid == false )
+	{
+		_cache.Close();
+		return false;
+	}
+
+	_pOffsets = pOffsets;
+	_pCandidates = pCandidates;
+
+	// the cells are no longer needed.
+	_aCells = {};
+	_aFilled = {};
+	return true;
+}
+
+//
+// palette_lookup_t::Save
+//
+// The file is header, the palette, kCells + 1 offsets, then the candidates.
+//
+bool palette_lookup_t::Save( const std::string& strFile )
+{
+	const std::vector< color_t >& aPalette = *_pPalette;
+
+	FillAll();
+
+	std::vector< uint32_t > aOffsets( kCells + 1, 0 );
+	for ( size_t cell = 0; cell < kCells; ++cell )
+	{
+		aOffsets[ cell + 1 ] = aOffsets[ cell ] + uint32_t( _aCells[ cell ].size() );
+	}
+
+	cache_header_t header;
+	memcpy( header.magic, kCacheMagic, sizeof( kCacheMagic ) );
+	header.uCellBits = kCellBits;
+	header.uPalStart = uint32_t( _palStart );
+	header.uMatch = uint32_t( _match );
+	header.uPaletteSize = uint32_t( aPalette.size() );
+	header.uCandidates = aOffsets[ kCells ];
+
+	const std::string strTemp = strFile + "." + std::to_string( GetCurrentProcessId() ) + ".tmp";
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, strTemp.c_str(), "wb" );
+	if ( e != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	bool bOK = fwrite( &header, sizeof( header ), 1, fp ) == 1;
+
+	for ( const color_t& colour : aPalette )
+	{
+		bOK = bOK && fwrite( &colour.value_abgr, sizeof( uint32_t ), 1, fp ) == 1;
+	}
+
+	bOK = bOK && fwrite( aOffsets.data(), sizeof( uint32_t ), aOffsets.size(), fp ) == aOffsets.size();
+
+	for ( const std::vector< uint8_t >& aCandidates : _aCells )
+	{
+		bOK = bOK && fwrite( aCandidates.data(), 1, aCandidates.size(), fp ) == aCandidates.size();
+	}
+
+	bOK = ( fclose( fp ) == 0 ) && bOK;
+
+	if ( bOK == false || MoveFileExA( strTemp.c_str(), strFile.c_str(), MOVEFILE_REPLACE_EXISTING ) == FALSE )
+	{
+		remove( strTemp.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+//
+// palette_lookup_t::FillCellOklab
+//
+// The candidates of a cell by oklab_distance_squared, lo being its lowest corner.
+//
+void palette_lookup_t::FillCellOklab( uint32_t cell, const int lo[ 3 ] )
+{
+	int hi[ 3 ];
+	for ( int c = 0; c < 3; ++c )
+	{
+		hi[ c ] = lo[ c ] + kCellSize - 1;
+	}
+
+	double lab_lo[ 3 ];
+	double lab_hi[ 3 ];
+	oklab_bounds( lo, hi, lab_lo, lab_hi );
+
+	std::vector< double > aMinDist( _aLab.size(), 0.0 );
+	double best_max_dist = DBL_MAX;
+
+	for ( size_t i = _palStart; i < _aLab.size(); ++i )
+	{
+		const double v[ 3 ] = { _aLab[ i ].L, _aLab[ i ].a, _aLab[ i ].b };
+		double min_dist = 0.0;
+		double max_dist = 0.0;
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			const double near_d = ( v[ c ] < lab_lo[ c ] ) ? ( lab_lo[ c ] - v[ c ] ) : ( v[ c ] > lab_hi[ c ] ) ? ( v[ c ] - lab_hi[ c ] ) : 0.0;
+			const double far_d = std::max( std::abs( v[ c ] - lab_lo[ c ] ), std::abs( v[ c ] - lab_hi[ c ] ) );
+
+			min_dist += near_d * near_d;
+			max_dist += far_d * far_d;
+		}
+
+		aMinDist[ i ] = min_dist;
+		best_max_dist = std::min( best_max_dist, max_dist );
+	}
+
+	// float rounding in rgb_to_oklab is far inside this.
+	const double limit = best_max_dist * ( 1.0 + 1e-4 ) + 1e-6;
+
+	std::vector< uint8_t >& aCandidates = _aCells[ cell ];
+
+	for ( size_t i = _palStart; i < _aLab.size(); ++i )
+	{
+		if ( aMinDist[ i ] <= limit )
+		{
+			aCandidates.push_back( uint8_t( i ) );
+		}
+	}
+
+	_aFilled[ cell ] = true;
+}
+
+//
+// palette_lookup_t::FillCell
+//
+// The candidates of a cell: every entry whose closest point is no further than the
+// best entry's furthest point.
+//
+void palette_lookup_t::FillCell( uint32_t cell )
+{
+	const std::vector< color_t >& aPalette = *_pPalette;
+
+	int lo[ 3 ];
+	lo[ 0 ] = int( ( cell >> ( kCellBits * 2 ) ) & ( ( 1 << kCellBits ) - 1 ) ) * kCellSize;
+	lo[ 1 ] = int( ( cell >> kCellBits ) & ( ( 1 << kCellBits ) - 1 ) ) * kCellSize;
+	lo[ 2 ] = int( cell & ( ( 1 << kCellBits ) - 1 ) ) * kCellSize;
+
+	if ( _match == MATCH_OKLAB )
+	{
+		FillCellOklab( cell, lo );
+		return;
+	}
+
+	std::vector< int > aMinDist( aPalette.size(), 0 );
+	int best_max_dist = INT_MAX;
+
+	for ( size_t i = _palStart; i < aPalette.size(); ++i )
+	{
+		int min_dist = 0;
+		int max_dist = 0;
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			const int v = aPalette[ i ].chan[ c ];
+			const int hi = lo[ c ] + kCellSize - 1;
+
+			// distance to the nearest and furthest edge of the cell on this axis.
+			const int near_d = ( v < lo[ c ] ) ? ( lo[ c ] - v ) : ( v > hi ) ? ( v - hi ) : 0;
+			const int far_d = std::max( std::abs( v - lo[ c ] ), std::abs( v - hi ) );
+
+			min_dist += near_d * near_d;
+			max_dist += far_d * far_d;
+		}
+
+		aMinDist[ i ] = min_dist;
+		best_max_dist = std::min( best_max_dist, max_dist );
+	}
+
+	std::vector< uint8_t >& aCandidates = _aCells[ cell ];
+
+	for ( size_t i = _palStart; i < aPalette.size(); ++i )
+	{
+		if ( aMinDist[ i ] <= best_max_dist )
+		{
+			aCandidates.push_back( uint8_t( i ) );
+		}
+	}
+
+	_aFilled[ cell ] = true;
+}
+
+//
+// palette_t::Load
+//
+// The whole file is read first, so a palette is never half of one.
+//
+bool palette_t::Load( const char* szFileName )
+{
+	FILE* fp = nullptr;
+	if ( fopen_s( &fp, szFileName, "rb" ) != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	std::vector< char > aText;
+	char aBlock[ 4096 ];
+	for ( size_t read; ( read = fread( aBlock, 1, sizeof( aBlock ), fp ) ) > 0; )
+	{
+		aText.insert( aText.end(), aBlock, aBlock + read );
+	}
+
+	const bool bRead = ( ferror( fp ) == 0 );
+	fclose( fp );
+
+	if ( bRead == false )
+	{
+		return false;
+	}
+
+	std::vector< uint32_t > aRGB;
+	palette_parse_hex( aText.data(), aText.size(), aRGB );
+
+	std::vector< color_t > aEntries( aRGB.size() );
+	for ( size_t i = 0; i < aRGB.size(); ++i )
+	{
+		aEntries[ i ].chan[ 0 ] = ( aRGB[ i ] >> 16 ) & 0xFF; // RED
+		aEntries[ i ].chan[ 1 ] = ( aRGB[ i ] >> 8 ) & 0xFF; // GREEN
+		aEntries[ i ].chan[ 2 ] = aRGB[ i ] & 0xFF; // BLUE
+	}
+
+	Set( aEntries );
+	return true;
+}
+
+//
+// palette_t::Set
+//
+// See palcore.h.
+//
+void palette_t::Set( const std::vector< color_t >& aEntries )
+{
+	aColours = aEntries;
+	for ( int c = 0; c < 3; ++c )
+	{
+		aChan[ c ].resize( aColours.size() );
+	}
+	aOklab.resize( aColours.size() );
+
+	palette_hash_t hash;
+
+	for ( size_t i = 0; i < aColours.size(); ++i )
+	{
+		color_t& colour = aColours[ i ];
+		colour.chan[ 3 ] = 0xFF;
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			aChan[ c ][ i ] = colour.chan[ c ];
+		}
+
+		aOklab[ i ] = rgb_to_oklab( colour );
+		hash.Add( ( uint32_t( colour.chan[ 0 ] ) << 16 ) | ( uint32_t( colour.chan[ 1 ] ) << 8 ) | colour.chan[ 2 ] );
+	}
+
+	uHash = hash.uHash;
+
+	for ( auto& aLookup : _apLookup )
+	{
+		aLookup[ 0 ].reset();
+		aLookup[ 1 ].reset();
+	}
+}
+
+//=============================================================================
@@ -0,0 +1,896 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palcore.h
+//
+// The palettising core shared by applypal and imgsize: pooled image storage, colour,
+// dither and index buffers, colour distances, palettes and the nearest palette index search. Built as the
+// palcore static library, see build/palcore.vcxproj.
+//
+
+#pragma once
+
+#include "palmem.h"
+#include "palpalette.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <malloc.h> // _aligned_malloc
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//=============================================================================
+
+//
+// buffer_pool_t
+//
+// Pixel buffers handed back for reuse by the next image, or the next size of this one,
+// instead of going back to the heap. A batch of images of the same few sizes keeps
+// using the same blocks, already paged in, rather than fragmenting the heap with fresh
+// ones. Blocks are aligned to a cache line. A request takes the smallest free block
+// that holds it, up to twice its size; free blocks over kMaxFreeBytes go back to the
+// heap, oldest first. With FRAGMENTS_HUGE_PAGES (palmem.h) the blocks of 2MB and more are
+// mapped in large pages instead, and handed out untouched when new.
+//
+struct buffer_pool_t
+{
+	static constexpr size_t kAlign = 64;
+	static constexpr size_t kMaxFreeBytes = size_t( 256 ) << 20;
+
+	struct block_t
+	{
+		void* pData;
+		size_t uBytes;
+	};
+
+	std::mutex _mutex;
+	std::deque< block_t > _aFree; // oldest first.
+	size_t _uFreeBytes = 0;
+
+	~buffer_pool_t()
+	{
+		for ( const block_t& block : _aFree )
+		{
+			Free( block );
+		}
+	}
+
+	// is a block of this (rounded) size mapped from the OS rather than the heap?
+	static bool Mapped( size_t uBytes )
+	{
+		return uBytes >= kHugePageBytes && mem_huge_pages();
+	}
+
+	static void Free( const block_t& block )
+	{
+		if ( Mapped( block.uBytes ) )
+		{
+			mem_page_free( block.pData, block.uBytes );
+		}
+		else
+		{
+			_aligned_free( block.pData );
+		}
+	}
+
+	// a block of at least uRequest bytes, and its size in *pBytes; the first uRequest zeroed
+	// if bZero.
+	void* Acquire( size_t uRequest, size_t* pBytes, bool bZero )
+	{
+		size_t uBytes = std::max< size_t >( ( uRequest + kAlign - 1 ) & ~( kAlign - 1 ), kAlign );
+		if ( Mapped( uBytes ) )
+		{
+			uBytes = mem_page_bytes( uBytes );
+		}
+
+		{
+			std::lock_guard< std::mutex > lock( _mutex );
+
+			auto best = _aFree.end();
+			for ( auto it = _aFree.begin(); it != _aFree.end(); ++it )
+			{
+				if ( it->uBytes >= uBytes && it->uBytes / 2 <= uBytes && ( best == _aFree.end() || it->uBytes < best->uBytes ) )
+				{
+					best = it;
+				}
+			}
+
+			if ( best != _aFree.end() )
+			{
+				const block_t block = *best;
+				_aFree.erase( best );
+				_uFreeBytes -= block.uBytes;
+
+				if ( bZero )
+				{
+					memset( block.pData, 0, uRequest );
+				}
+
+				*pBytes = block.uBytes;
+				return block.pData;
+			}
+		}
+
+		void* pData = nullptr;
+		if ( Mapped( uBytes ) )
+		{
+			// already zero, and left for the threads that fill it to page in.
+			pData = mem_page_alloc( uBytes );
+		}
+		else
+		{
+			pData = _aligned_malloc( uBytes, kAlign );
+			if ( pData != nullptr && bZero )
+			{
+				memset( pData, 0, uRequest );
+			}
+		}
+
+		if ( pData == nullptr )
+		{
+			throw std::bad_alloc();
+		}
+
+		*pBytes = uBytes;
+		return pData;
+	}
+
+	void Release( void* pData, size_t uBytes )
+	{
+		if ( pData == nullptr )
+		{
+			return;
+		}
+
+		std::lock_guard< std::mutex > lock( _mutex );
+
+		_aFree.push_back( { pData, uBytes } );
+		_uFreeBytes += uBytes;
+
+		while ( _uFreeBytes > kMaxFreeBytes )
+		{
+			_uFreeBytes -= _aFree.front().uBytes;
+			Free( _aFree.front() );
+			_aFree.pop_front();
+		}
+	}
+};
+
+// the pool every image_buffer_t draws from.
+inline buffer_pool_t& image_pool()
+{
+	static buffer_pool_t pool;
+	return pool;
+}
+
+//
+// image_buffer_t
+//
+// The storage of an image or a ring of its rows: a block from image_pool(), aligned to
+// buffer_pool_t::kAlign, that goes back to the pool when the buffer is reset, moved over
+// or destroyed. The image types keep one of these and point their _data_ptr into it, so
+// nothing is freed by hand; a view of another image's pixels leaves it empty.
+//
+struct image_buffer_t
+{
+
+public:
+
+	image_buffer_t() = default;
+	image_buffer_t( const image_buffer_t& ) = delete;
+	image_buffer_t& operator=( const image_buffer_t& ) = delete;
+
+	image_buffer_t( image_buffer_t&& other ) noexcept : _pData( other._pData ), _uBytes( other._uBytes )
+	{
+		other._pData = nullptr;
+		other._uBytes = 0;
+	}
+
+	image_buffer_t& operator=( image_buffer_t&& other ) noexcept
+	{
+		if ( this != &other )
+		{
+			Reset();
+			std::swap( _pData, other._pData );
+			std::swap( _uBytes, other._uBytes );
+		}
+		return *this;
+	}
+
+	~image_buffer_t()
+	{
+		Reset();
+	}
+
+	// uBytes of storage, in place of any held before. The contents are left as the pool
+	// had them unless bZero.
+	void* Allocate( size_t uBytes, bool bZero = false )
+	{
+		Reset();
+		_pData = image_pool().Acquire( uBytes, &_uBytes, bZero );
+		return _pData;
+	}
+
+	// storage for count default-initialised T, as new T[ count ] would give.
+	template < typename T >
+	T* Allocate( size_t count )
+	{
+		static_assert( std::is_trivially_destructible< T >::value, "image buffers are not destroyed element by element" );
+		T* pData = static_cast< T* >( Allocate( count * sizeof( T ) ) );
+		std::uninitialized_default_construct_n( pData, count );
+		return pData;
+	}
+
+	void Reset()
+	{
+		image_pool().Release( _pData, _uBytes );
+		_pData = nullptr;
+		_uBytes = 0;
+	}
+
+	void* Data() const
+	{
+		return _pData;
+	}
+
+private:
+
+	void* _pData = nullptr;
+	size_t _uBytes = 0;
+};
+
+struct dither_t
+{
+	uint8_t index;
+
+	float err_r;
+	float err_g;
+	float err_b;
+
+	bool is_opaque;
+};
+
+// integer version of dither_t, for -fixed.
+struct dither_fixed_t
+{
+	int16_t value[ 3 ]; // R, G, B level plus diffused error, in 1/kDivisor of a level for the kernel.
+
+	uint8_t index;
+	bool is_opaque;
+};
+
+// dither_fixed_t in 12-bit linear light, for -linear. That times a kernel's divisor
+// needs more than 16 bits.
+struct dither_linear_t
+{
+	int32_t value[ 3 ]; // R, G, B linear level plus diffused error, in 1/kDivisor of a level.
+
+	uint8_t index;
+	bool is_opaque;
+};
+
+// Error diffusion workspace for a w x h image, holding only a ring of rows. Row y
+// lives in slot y % rows, so a row's slot is reused once it is rows lines behind.
+template < typename T >
+struct dithermap_t
+{
+
+public:
+
+	T* _data_ptr = nullptr;
+	size_t _width = 0;
+	size_t _height = 0;
+	size_t _rows = 0;
+	image_buffer_t _buffer;
+
+public:
+
+	void Create( size_t w, size_t h, size_t rows )
+	{
+		_width = w;
+		_height = h;
+		_rows = std::min( rows, h );
+		_data_ptr = _buffer.Allocate< T >( w * _rows + 1 ); // +1 !
+	}
+
+	// x and y are signed, as the kernels reach back from them, but always inside the image.
+	T& Element( ptrdiff_t x, ptrdiff_t y )
+	{
+		return _data_ptr[ size_t( x ) + ( size_t( y ) % _rows ) * _width ];
+	}
+
+	const T& Element( ptrdiff_t x, ptrdiff_t y ) const
+	{
+		return _data_ptr[ size_t( x ) + ( size_t( y ) % _rows ) * _width ];
+	}
+};
+
+
+struct color_t
+{
+	union
+	{
+		uint32_t value_abgr;
+		uint8_t chan[ 4 ]; // R, G, B, A
+	};
+
+public:
+
+	inline void make_lum()
+	{
+		// https://en.wikipedia.org/wiki/Relative_luminance
+		const float lum = ( chan[ 0 ] * 0.299f ) + ( chan[ 1 ] * 0.587f ) + ( chan[ 2 ] * 0.114f );
+		const uint8_t g = uint8_t( std::clamp( int( round( lum ) ), 0, 255 ) );
+		chan[ 0 ] = chan[ 1 ] = chan[ 2 ] = g;
+	}
+
+	uint32_t BGR() const { return value_abgr & 0xFFFFFF; }
+
+	void FromDither( dither_t& dither )
+	{
+		chan[ 0 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_r * 255.0f ) ), 0, 255 ) );
+		chan[ 1 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_g * 255.0f ) ), 0, 255 ) );
+		chan[ 2 ] = static_cast<uint8_t>( std::clamp( static_cast<int>( std::floorf( dither.err_b * 255.0f ) ), 0, 255 ) );
+		chan[ 3 ] = dither.is_opaque ? 0xFF : 0x00;
+	}
+
+};
+
+// color_t::make_lum on an interleaved R, G, B pixel, in place.
+inline void make_lum_rgb( uint8_t* rgb )
+{
+	color_t colour;
+	colour.chan[ 0 ] = rgb[ 0 ];
+	colour.chan[ 1 ] = rgb[ 1 ];
+	colour.chan[ 2 ] = rgb[ 2 ];
+	colour.make_lum();
+	rgb[ 0 ] = rgb[ 1 ] = rgb[ 2 ] = colour.chan[ 0 ];
+}
+
+//
+// pack_row
+//
+// Pack a row of 8-bit indices into BPP-bit pixels, the first pixel in the top bits of
+// each byte as PNG stores them. The bits past the last pixel are zero.
+//
+template < uint32_t BPP >
+inline void pack_row( uint8_t* pDest, const uint8_t* pIndices, size_t width )
+{
+	constexpr size_t kPerByte = 8 / BPP;
+	constexpr uint32_t kMask = ( 1u << BPP ) - 1;
+
+	size_t x = 0;
+	for ( ; x + kPerByte <= width; x += kPerByte )
+	{
+		uint32_t byte = 0;
+		for ( size_t i = 0; i < kPerByte; ++i )
+		{
+			byte = ( byte << BPP ) | ( pIndices[ x + i ] & kMask );
+		}
+		*pDest++ = uint8_t( byte );
+	}
+
+	// partial last byte.
+	if ( x < width )
+	{
+		uint32_t byte = 0;
+		for ( size_t i = 0; i < kPerByte; ++i )
+		{
+			byte = ( byte << BPP ) | ( ( x + i < width ) ? ( pIndices[ x + i ] & kMask ) : 0 );
+		}
+		*pDest = uint8_t( byte );
+	}
+}
+
+struct indexmap_t
+{
+
+public:
+
+	uint8_t* _data_ptr = nullptr;
+	size_t _width = 0;
+	size_t _height = 0;
+	size_t _uStride = 0; // bytes
+	uint32_t _uBPP = 0;
+	uint32_t _uPixelsPerByte = 0;
+	size_t _rows = 0; // a ring of rows, row y in slot y % _rows, until they are written.
+
+	// hands each finished row to the PNG writer, in order.
+	std::function< void( const uint8_t* pRow ) > _fnWriteRow;
+	size_t _uFlushed = 0;
+
+	image_buffer_t _buffer;
+
+public:
+
+	void Create( size_t w, size_t h, uint32_t bpp, size_t rows )
+	{
+		_width = w;
+		_height = h;
+		_uBPP = bpp;
+		_rows = std::clamp< size_t >( rows, 1, h );
+
+		_uPixelsPerByte = 8 / _uBPP;
+		_uStride = ( ( w + ( _uPixelsPerByte - 1 ) ) / _uPixelsPerByte );
+		const size_t payload = _uStride * _rows;
+		_data_ptr = static_cast< uint8_t* >( _buffer.Allocate( payload, true ) ); // zeroed, so the row padding bits are repeatable.
+		_uFlushed = 0;
+	}
+
+	uint8_t* Row( size_t y )
+	{
+		return _data_ptr + ( y % _rows ) * _uStride;
+	}
+
+	// Pack a row of 8-bit indices into row y.
+	void StoreRow( size_t y, const uint8_t* pIndices )
+	{
+		uint8_t* row_ptr = Row( y );
+
+		switch ( _uBPP )
+		{
+		case 1:		pack_row< 1 >( row_ptr, pIndices, _width ); break;
+		case 2:		pack_row< 2 >( row_ptr, pIndices, _width ); break;
+		case 4:		pack_row< 4 >( row_ptr, pIndices, _width ); break;
+		default:	std::copy( pIndices, pIndices + _width, row_ptr ); break;
+		}
+	}
+
+	// Write out the stored rows before y_end. Rows must be flushed in order, and before
+	// their slot is reused.
+	void Flush( size_t y_end )
+	{
+		for ( ; _uFlushed < y_end; ++_uFlushed )
+		{
+			if ( _fnWriteRow )
+			{
+				_fnWriteRow( Row( _uFlushed ) );
+			}
+		}
+	}
+
+};
+
+//=============================================================================
+
+inline int rgb_color_distance_squared( color_t colour1, color_t colour2 )
+{
+	int x;
+	int delta;
+
+	x = static_cast<int>( colour1.chan[ 0 ] ) - static_cast<int>( colour2.chan[ 0 ] );
+	delta = x * x;
+
+	x = static_cast<int>( colour1.chan[ 1 ] ) - static_cast<int>( colour2.chan[ 1 ] );
+	delta += x * x;
+
+	x = static_cast<int>( colour1.chan[ 2 ] ) - static_cast<int>( colour2.chan[ 2 ] );
+	delta += x * x;
+
+	return delta;
+}
+
+//
+// oklab_t
+//
+// A colour in Oklab (Bjorn Ottosson), where Euclidean distance follows perceived
+// difference far better than it does in RGB.
+//
+typedef enum
+{
+	MATCH_RGB,		// Euclidean RGB
+	MATCH_OKLAB,	// Euclidean Oklab
+
+} match_t;
+
+struct oklab_t
+{
+	float L, a, b;
+};
+
+// sRGB channel to linear light, for each of the 256 values.
+const float* srgb_linear_table();
+
+// The same in integers: each sRGB channel value as 12-bit linear light (0..4095), and
+// for each 12-bit linear level the nearest sRGB value.
+inline constexpr int kLinearLevels = 4096;
+const uint16_t* srgb_linear12_table();
+const uint8_t* linear12_srgb_table();
+
+// Oklab's cone response (LMS) from linear RGB. Every weight is positive, so each is
+// increasing in R, G and B.
+inline constexpr double kOklabM1[ 3 ][ 3 ] =
+{
+	{ 0.4122214708, 0.5363325363, 0.0514459929 },
+	{ 0.2119034982, 0.6806995451, 0.1073969566 },
+	{ 0.0883024619, 0.2817188376, 0.6299787005 },
+};
+
+// Lab from the cube roots of LMS.
+inline constexpr double kOklabM2[ 3 ][ 3 ] =
+{
+	{ 0.2104542553, 0.7936177850, -0.0040720468 },
+	{ 1.9779984951, -2.4285922050, 0.4505937099 },
+	{ 0.0259040371, 0.7827717662, -0.8086757660 },
+};
+
+inline oklab_t rgb_to_oklab( const color_t& colour )
+{
+	const float* aLinear = srgb_linear_table();
+	const float r = aLinear[ colour.chan[ 0 ] ];
+	const float g = aLinear[ colour.chan[ 1 ] ];
+	const float b = aLinear[ colour.chan[ 2 ] ];
+
+	float lms[ 3 ];
+	for ( int i = 0; i < 3; ++i )
+	{
+		lms[ i ] = std::cbrt( float( kOklabM1[ i ][ 0 ] ) * r + float( kOklabM1[ i ][ 1 ] ) * g + float( kOklabM1[ i ][ 2 ] ) * b );
+	}
+
+	oklab_t lab;
+	lab.L = float( kOklabM2[ 0 ][ 0 ] ) * lms[ 0 ] + float( kOklabM2[ 0 ][ 1 ] ) * lms[ 1 ] + float( kOklabM2[ 0 ][ 2 ] ) * lms[ 2 ];
+	lab.a = float( kOklabM2[ 1 ][ 0 ] ) * lms[ 0 ] + float( kOklabM2[ 1 ][ 1 ] ) * lms[ 1 ] + float( kOklabM2[ 1 ][ 2 ] ) * lms[ 2 ];
+	lab.b = float( kOklabM2[ 2 ][ 0 ] ) * lms[ 0 ] + float( kOklabM2[ 2 ][ 1 ] ) * lms[ 1 ] + float( kOklabM2[ 2 ][ 2 ] ) * lms[ 2 ];
+	return lab;
+}
+
+inline float oklab_distance_squared( const oklab_t& lab1, const oklab_t& lab2 )
+{
+	const float dL = lab1.L - lab2.L;
+	const float da = lab1.a - lab2.a;
+	const float db = lab1.b - lab2.b;
+
+	return dL * dL + da * da + db * db;
+}
+
+//
+// oklab_bounds
+//
+// A box in Oklab holding every colour of the RGB box lo..hi. LMS and its cube roots
+// are increasing in every channel, so their ranges come from the two corners; Lab is
+// linear in those, so each axis takes the low or high end by the sign of its weight.
+//
+void oklab_bounds( const int lo[ 3 ], const int hi[ 3 ], double lab_lo[ 3 ], double lab_hi[ 3 ] );
+
+//
+// find_nearest_palette_index
+//
+// Full scan of the palette from palStart. Ties go to the last index.
+//
+uint8_t find_nearest_palette_index( const color_t& colour1, const std::vector< color_t >& aPalette, size_t palStart );
+
+//
+// mapped_file_t
+//
+// Read only view of a whole file, memory mapped.
+//
+struct mapped_file_t
+{
+	void* _hFile = nullptr; // HANDLE, so that this header needs no windows.h.
+	void* _hMapping = nullptr;
+
+	const uint8_t* _pData = nullptr;
+	size_t _uSize = 0;
+
+public:
+
+	mapped_file_t() = default;
+	mapped_file_t( const mapped_file_t& ) = delete;
+	mapped_file_t& operator=( const mapped_file_t& ) = delete;
+
+	~mapped_file_t()
+	{
+		Close();
+	}
+
+	bool Open( const std::string& file_name );
+
+	void Close();
+};
+
+//
+// palette_lookup_t
+//
+// Nearest palette index, via a 32x32x32 cube over RGB. Each cell holds the palette
+// entries that can be nearest to some colour inside it (any entry whose closest point
+// is no further than the best entry's furthest point), so a lookup only scans those.
+// Cells are filled on first use. Results match a full scan of the palette, including
+// ties going to the last index.
+// With MATCH_OKLAB, nearest is by oklab_distance_squared: the palette is converted once,
+// and each cell is bounded by oklab_bounds. A little slack in the test keeps rounding
+// from dropping an entry that can be nearest.
+// Save writes the whole cube to a file that Load maps back in, for applypal -lutcache. A loaded
+// cube is complete and read only.
+//
+struct palette_t;
+
+struct palette_lookup_t
+{
+
+public:
+
+	static constexpr int kCellBits = 5;
+	static constexpr int kCellSize = 1 << ( 8 - kCellBits );
+	static constexpr size_t kCells = size_t( 1 ) << ( kCellBits * 3 );
+
+	const std::vector< color_t >* _pPalette = nullptr;
+	size_t _palStart = 0;
+	match_t _match = MATCH_RGB;
+	std::vector< oklab_t > _aLab; // MATCH_OKLAB: the palette in Oklab.
+
+	std::vector< std::vector< uint8_t > > _aCells;
+	std::vector< bool > _aFilled;
+
+	// Load: the candidates of each cell, [ _pOffsets[ cell ], _pOffsets[ cell + 1 ] ) in _pCandidates.
+	mapped_file_t _cache;
+	const uint32_t* _pOffsets = nullptr;
+	const uint8_t* _pCandidates = nullptr;
+
+	// cache file layout: header, the palette, kCells + 1 offsets, then the candidates.
+	struct cache_header_t
+	{
+		char magic[ 8 ];
+		uint32_t uCellBits;
+		uint32_t uPalStart;
+		uint32_t uMatch;
+		uint32_t uPaletteSize;
+		uint32_t uCandidates;
+	};
+
+	static constexpr char kCacheMagic[ 8 ] = { 'A', 'P', 'L', 'U', 'T', '0', '0', '2' };
+
+public:
+
+	void Create( const std::vector< color_t >& aPalette, size_t palStart, match_t match );
+
+	// The same, with the Oklab of the entries that palette already holds.
+	void Create( const palette_t& palette, size_t palStart, match_t match );
+
+	// Fill every cell now, after which Find only reads and may be shared between threads.
+	void FillAll();
+
+	inline uint8_t Find( const color_t& colour )
+	{
+		const uint32_t cell = ( uint32_t( colour.chan[ 0 ] >> ( 8 - kCellBits ) ) << ( kCellBits * 2 ) )
+							| ( uint32_t( colour.chan[ 1 ] >> ( 8 - kCellBits ) ) << kCellBits )
+							| ( uint32_t( colour.chan[ 2 ] >> ( 8 - kCellBits ) ) );
+
+		const uint8_t* pFirst;
+		const uint8_t* pLast;
+
+		if ( _pOffsets != nullptr )
+		{
+			pFirst = _pCandidates + _pOffsets[ cell ];
+			pLast = _pCandidates + _pOffsets[ cell + 1 ];
+		}
+		else
+		{
+			if ( _aFilled[ cell ] == false )
+			{
+				FillCell( cell );
+			}
+
+			pFirst = _aCells[ cell ].data();
+			pLast = pFirst + _aCells[ cell ].size();
+		}
+
+		if ( _match == MATCH_OKLAB )
+		{
+			return FindOklab( colour, pFirst, pLast );
+		}
+
+		const std::vector< color_t >& aPalette = *_pPalette;
+
+		uint8_t best_index = pFirst[ 0 ];
+		int best_score = rgb_color_distance_squared( colour, aPalette[ best_index ] );
+
+		for ( const uint8_t* p = pFirst + 1; p < pLast; ++p )
+		{
+			int score = rgb_color_distance_squared( colour, aPalette[ *p ] );
+
+			if ( score <= best_score )
+			{
+				best_score = score;
+				best_index = *p;
+			}
+		}
+
+		return best_index;
+	}
+
+	// Map in a cube saved for this palette and palStart. False if there isn't one, or it doesn't match.
+	bool Load( const std::string& strFile );
+
+	// Fill every cell and write the cube out for Load. Written to a temporary file first,
+	// so that another run never sees half of one.
+	bool Save( const std::string& strFile );
+
+private:
+
+	uint8_t FindOklab( const color_t& colour, const uint8_t* pFirst, const uint8_t* pLast ) const
+	{
+		// no need to convert the colour when the cell has only one entry it can be.
+		if ( pLast - pFirst == 1 )
+		{
+			return pFirst[ 0 ];
+		}
+
+		const oklab_t lab = rgb_to_oklab( colour );
+
+		uint8_t best_index = pFirst[ 0 ];
+		float best_score = oklab_distance_squared( lab, _aLab[ best_index ] );
+
+		for ( const uint8_t* p = pFirst + 1; p < pLast; ++p )
+		{
+			float score = oklab_distance_squared( lab, _aLab[ *p ] );
+
+			if ( score <= best_score )
+			{
+				best_score = score;
+				best_index = *p;
+			}
+		}
+
+		return best_index;
+	}
+
+	void Start( const std::vector< color_t >& aPalette, size_t palStart, match_t match );
+
+	void FillCellOklab( uint32_t cell, const int lo[ 3 ] );
+
+	void FillCell( uint32_t cell );
+};
+
+//
+// palette_t
+//
+// A palette as the tools load it, with what their searches need of it worked out once: the
+// entries as color_t and as one array a channel, their Oklab, and palette_hash of them for
+// the caches made from it. The cube for each palStart and match is made on its first
+// Lookup, so make the ones that threads share before they start. A copy or move takes the
+// entries, and makes cubes of its own.
+//
+struct palette_t
+{
+
+public:
+
+	std::vector< color_t > aColours; // opaque
+	std::vector< uint8_t > aChan[ 3 ]; // R, G and B, each in order of entry, for the vector searches.
+	std::vector< oklab_t > aOklab;
+	uint64_t uHash = palette_hash_t().uHash;
+
+private:
+
+	std::unique_ptr< palette_lookup_t > _apLookup[ 2 ][ 2 ]; // [ palStart ][ match ]
+
+public:
+
+	palette_t() = default;
+
+	palette_t( const palette_t& other )
+	{
+		*this = other;
+	}
+
+	palette_t& operator=( const palette_t& other )
+	{
+		if ( this != &other )
+		{
+			Set( other.aColours );
+		}
+		return *this;
+	}
+
+	palette_t( palette_t&& other ) noexcept
+	{
+		*this = std::move( other );
+	}
+
+	palette_t& operator=( palette_t&& other ) noexcept
+	{
+		aColours = std::move( other.aColours );
+		for ( int c = 0; c < 3; ++c )
+		{
+			aChan[ c ] = std::move( other.aChan[ c ] );
+		}
+		aOklab = std::move( other.aOklab );
+		uHash = other.uHash;
+
+		// the cubes come too, pointed at the entries where they now are.
+		for ( int start = 0; start < 2; ++start )
+		{
+			for ( int match = 0; match < 2; ++match )
+			{
+				_apLookup[ start ][ match ] = std::move( other._apLookup[ start ][ match ] );
+				if ( _apLookup[ start ][ match ] )
+				{
+					_apLookup[ start ][ match ]->_pPalette = &aColours;
+				}
+			}
+		}
+		other.Set( {} );
+		return *this;
+	}
+
+	// Load a .hex file (palette_parse_hex). False if it could not be read; the caller checks
+	// the entry count.
+	bool Load( const char* szFileName );
+
+	// Take these entries (alpha is made opaque), and drop any cubes of the last ones.
+	void Set( const std::vector< color_t >& aEntries );
+
+	size_t size() const
+	{
+		return aColours.size();
+	}
+
+	bool empty() const
+	{
+		return aColours.empty();
+	}
+
+	const color_t& operator[]( size_t index ) const
+	{
+		return aColours[ index ];
+	}
+
+	std::vector< color_t >::const_iterator begin() const
+	{
+		return aColours.begin();
+	}
+
+	std::vector< color_t >::const_iterator end() const
+	{
+		return aColours.end();
+	}
+
+	// The cube searching from palStart (0 or 1) by match, made on first use.
+	palette_lookup_t& Lookup( size_t palStart, match_t match )
+	{
+		std::unique_ptr< palette_lookup_t >& pLookup = _apLookup[ palStart ][ match ];
+		if ( pLookup == nullptr )
+		{
+			pLookup = std::make_unique< palette_lookup_t >();
+			pLookup->Create( *this, palStart, match );
+		}
+		return *pLookup;
+	}
+};
+
+//=============================================================================
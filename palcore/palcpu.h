@@ -0,0 +1,210 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palcpu.h
+//
+// Which SIMD kernels a tool runs, chosen once at run time from what the CPU has, so one
+// binary uses AVX2 where it can and still runs on any x64 (or ARM64) machine. Each tool
+// keeps a table of function pointers for a kernel family and fills it from cpu_level()
+// the first time it is used; -cpu= (cpu_select) picks a lower level, to time the kernels
+// against each other or to reproduce an issue seen on another machine. Header only and
+// C++14, like paltask.h.
+//
+// A kernel for a level above the build's own is marked with CPU_TARGET_*, so GCC and
+// Clang compile its intrinsics; MSVC takes them anywhere.
+//
+
+#pragma once
+
+#include <cstring>
+
+// x64 only (as the tools are built), where SSE2 is always there.
+#if defined( _M_X64 ) || defined( __x86_64__ )
+#define CPU_X86				1
+#if defined( _MSC_VER )
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#else
+#define CPU_X86				0
+#endif
+
+#if defined( _M_ARM64 ) || defined( __aarch64__ )
+#define CPU_ARM64			1
+#else
+#define CPU_ARM64			0
+#endif
+
+#if CPU_X86 && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define CPU_TARGET_SSE41	__attribute__( ( target( "sse4.1" ) ) )
+#define CPU_TARGET_AVX2		__attribute__( ( target( "avx2" ) ) )
+#define CPU_TARGET_AVX512	__attribute__( ( target( "avx512f,avx512bw" ) ) )
+#else
+#define CPU_TARGET_SSE41
+#define CPU_TARGET_AVX2
+#define CPU_TARGET_AVX512
+#endif
+
+//=============================================================================
+
+// each x86 level has all of those before it.
+enum cpu_level_t
+{
+	CPU_SCALAR = 0,
+	CPU_SSE2,
+	CPU_SSE41,
+	CPU_AVX2,
+	CPU_AVX512, // F and BW
+	CPU_NEON,
+};
+
+inline const char* cpu_level_name( cpu_level_t level )
+{
+	switch ( level )
+	{
+	case CPU_SSE2:		return "sse2";
+	case CPU_SSE41:		return "sse4.1";
+	case CPU_AVX2:		return "avx2";
+	case CPU_AVX512:	return "avx512";
+	case CPU_NEON:		return "neon";
+	default:			return "scalar";
+	}
+}
+
+//
+// cpu_detect
+//
+// The highest level this CPU, and the OS (which has to save the wider registers), has.
+//
+inline cpu_level_t cpu_detect()
+{
+#if CPU_X86
+	unsigned regs1[ 4 ] = { 0, 0, 0, 0 }; // eax, ebx, ecx, edx
+	unsigned regs7[ 4 ] = { 0, 0, 0, 0 };
+	unsigned long long xcr0 = 0;
+
+#if defined( _MSC_VER )
+	int aInfo[ 4 ];
+	__cpuid( aInfo, 0 );
+	const int max_leaf = aInfo[ 0 ];
+	__cpuid( aInfo, 1 );
+	memcpy( regs1, aInfo, sizeof( regs1 ) );
+	if ( max_leaf >= 7 )
+	{
+		__cpuidex( aInfo, 7, 0 );
+		memcpy( regs7, aInfo, sizeof( regs7 ) );
+	}
+	if ( regs1[ 2 ] & ( 1u << 27 ) ) // OSXSAVE
+	{
+		xcr0 = _xgetbv( 0 );
+	}
+#else
+	const unsigned max_leaf = __get_cpuid_max( 0, nullptr );
+	__get_cpuid( 1, &regs1[ 0 ], &regs1[ 1 ], &regs1[ 2 ], &regs1[ 3 ] );
+	if ( max_leaf >= 7 )
+	{
+		__cpuid_count( 7, 0, regs7[ 0 ], regs7[ 1 ], regs7[ 2 ], regs7[ 3 ] );
+	}
+	if ( regs1[ 2 ] & ( 1u << 27 ) ) // OSXSAVE
+	{
+		unsigned lo, hi;
+		__asm__ volatile( "xgetbv" : "=a"( lo ), "=d"( hi ) : "c"( 0 ) );
+		xcr0 = ( ( unsigned long long )hi << 32 ) | lo;
+	}
+#endif
+
+	const bool bSSE2 = ( regs1[ 3 ] & ( 1u << 26 ) ) != 0;
+	const bool bSSE41 = ( regs1[ 2 ] & ( 1u << 19 ) ) != 0;
+	const bool bAVX = ( regs1[ 2 ] & ( 1u << 28 ) ) != 0 && ( xcr0 & 0x6 ) == 0x6; // XMM and YMM saved
+	const bool bAVX2 = bAVX && ( regs7[ 1 ] & ( 1u << 5 ) ) != 0;
+	const bool bAVX512 = bAVX2 && ( xcr0 & 0xE6 ) == 0xE6 && ( regs7[ 1 ] & ( 1u << 16 ) ) != 0 && ( regs7[ 1 ] & ( 1u << 30 ) ) != 0;
+
+	if ( bAVX512 )	return CPU_AVX512;
+	if ( bAVX2 )	return CPU_AVX2;
+	if ( bSSE41 )	return CPU_SSE41;
+	if ( bSSE2 )	return CPU_SSE2;
+	return CPU_SCALAR;
+#elif CPU_ARM64
+	return CPU_NEON; // always there on ARM64.
+#else
+	return CPU_SCALAR;
+#endif
+}
+
+// the level in use: cpu_detect()'s, unless cpu_select has lowered it.
+inline cpu_level_t& cpu_level_slot()
+{
+	static cpu_level_t level = cpu_detect();
+	return level;
+}
+
+inline cpu_level_t cpu_level()
+{
+	return cpu_level_slot();
+}
+
+//
+// cpu_select
+//
+// Use the kernels of the level named (scalar, sse2, sse4.1, avx2, avx512, neon or native),
+// for -cpu=. False if the name is unknown or this CPU doesn't have it. Call it before the
+// first kernel runs, as each table is filled only once.
+//
+inline bool cpu_select( const char* szName )
+{
+	const cpu_level_t detected = cpu_detect();
+
+	if ( _stricmp( szName, "native" ) == 0 )
+	{
+		cpu_level_slot() = detected;
+		return true;
+	}
+
+	for ( int i = CPU_SCALAR; i <= CPU_NEON; ++i )
+	{
+		const cpu_level_t level = cpu_level_t( i );
+		if ( _stricmp( szName, cpu_level_name( level ) ) == 0 )
+		{
+			// NEON isn't above or below the x86 levels, only scalar is below it.
+			const bool bHave = ( level == CPU_SCALAR ) || ( detected == CPU_NEON ? level == CPU_NEON : ( level != CPU_NEON && level <= detected ) );
+			if ( bHave == false )
+			{
+				return false;
+			}
+
+			cpu_level_slot() = level;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//=============================================================================
@@ -0,0 +1,202 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// paldeflate.h
+//
+// Which deflate compresses the IDAT of the indexed PNGs the tools write. zlib, through
+// libpng a row at a time, is always there. Built with FRAGMENTS_LIBDEFLATE (and
+// libdeflate's include folder and libdeflate.lib added to the project) libdeflate is too,
+// and is the default: it compresses a whole buffer at once, faster than zlib at the same
+// level, so a writer keeps the rows and hands them over in Close.
+// -deflate= (deflate_select) picks one. Header only; needs libpng and zlib on the include
+// path, as applypal, imgsize and palpipe have.
+//
+
+#pragma once
+
+#include "png.h"
+#include "zlib.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef FRAGMENTS_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+//=============================================================================
+
+enum deflate_backend_t
+{
+	DEFLATE_ZLIB = 0,
+	DEFLATE_LIBDEFLATE,
+};
+
+inline const char* deflate_backend_name( deflate_backend_t backend )
+{
+	return ( backend == DEFLATE_LIBDEFLATE ) ? "libdeflate" : "zlib";
+}
+
+// the backend in use: libdeflate when it is built in, unless deflate_select says otherwise.
+inline deflate_backend_t& deflate_backend_slot()
+{
+#ifdef FRAGMENTS_LIBDEFLATE
+	static deflate_backend_t backend = DEFLATE_LIBDEFLATE;
+#else
+	static deflate_backend_t backend = DEFLATE_ZLIB;
+#endif
+	return backend;
+}
+
+inline deflate_backend_t deflate_backend()
+{
+	return deflate_backend_slot();
+}
+
+//
+// deflate_select
+//
+// Use the backend named (zlib or libdeflate), for -deflate=. False if the name is unknown,
+// or is libdeflate in a build without it.
+//
+inline bool deflate_select( const char* szName )
+{
+	if ( _stricmp( szName, "zlib" ) == 0 )
+	{
+		deflate_backend_slot() = DEFLATE_ZLIB;
+		return true;
+	}
+
+#ifdef FRAGMENTS_LIBDEFLATE
+	if ( _stricmp( szName, "libdeflate" ) == 0 )
+	{
+		deflate_backend_slot() = DEFLATE_LIBDEFLATE;
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+//
+// zlib_compress
+//
+// Compress size bytes into aOut as one zlib stream (header, deflate data and Adler-32), at
+// a zlib level (Z_DEFAULT_COMPRESSION or 1 to 9), with the backend in use. libdeflate also
+// takes 10 to 12, slower and smaller than zlib can go. False if it could not be done.
+//
+inline bool zlib_compress( const uint8_t* pData, size_t size, int level, std::vector< uint8_t >& aOut )
+{
+#ifdef FRAGMENTS_LIBDEFLATE
+	if ( deflate_backend() == DEFLATE_LIBDEFLATE )
+	{
+		// a compressor is costly to make (level 12 takes several MB), so each thread keeps one of each level it uses.
+		struct compressors_t
+		{
+			libdeflate_compressor* aLevel[ 13 ] = {};
+
+			~compressors_t()
+			{
+				for ( libdeflate_compressor* p : aLevel )
+				{
+					libdeflate_free_compressor( p );
+				}
+			}
+		};
+
+		thread_local compressors_t compressors;
+
+		const int lvl = ( level < 1 || level > 12 ) ? 6 : level;
+		libdeflate_compressor*& pCompressor = compressors.aLevel[ lvl ];
+		if ( pCompressor == nullptr && ( pCompressor = libdeflate_alloc_compressor( lvl ) ) == nullptr )
+		{
+			return false;
+		}
+
+		aOut.resize( libdeflate_zlib_compress_bound( pCompressor, size ) );
+		aOut.resize( libdeflate_zlib_compress( pCompressor, pData, size, aOut.data(), aOut.size() ) );
+		return aOut.empty() == false;
+	}
+#endif
+
+	if ( size > UINT_MAX || level > Z_BEST_COMPRESSION )
+	{
+		return false;
+	}
+
+	z_stream strm = {};
+	if ( deflateInit2( &strm, level, Z_DEFLATED, MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+	{
+		return false;
+	}
+
+	aOut.resize( deflateBound( &strm, uLong( size ) ) );
+
+	strm.next_in = const_cast< Bytef* >( pData );
+	strm.avail_in = uInt( size );
+	strm.next_out = aOut.data();
+	strm.avail_out = uInt( aOut.size() );
+
+	const bool bOK = ( deflate( &strm, Z_FINISH ) == Z_STREAM_END );
+	aOut.resize( strm.total_out );
+	deflateEnd( &strm );
+
+	return bOK;
+}
+
+//
+// png_write_compressed
+//
+// In place of png_write_rows and png_write_end, after png_write_info: the filtered rows
+// (each a filter type byte, then the row), compressed whole with zlib_compress, as IDAT
+// chunks of up to kPngIdatChunk bytes, and then IEND. Errors in writing longjmp, as
+// libpng's own do, so the compressed stream goes in the caller's aStream, which a longjmp
+// past this frame would not free. False if the rows could not be compressed.
+//
+static constexpr size_t kPngIdatChunk = 1024 * 1024;
+
+inline bool png_write_compressed( png_structp png_ptr, const uint8_t* pFiltered, size_t size, int level, std::vector< uint8_t >& aStream )
+{
+	if ( zlib_compress( pFiltered, size, level, aStream ) == false )
+	{
+		return false;
+	}
+
+	for ( size_t pos = 0; pos < aStream.size(); pos += kPngIdatChunk )
+	{
+		png_write_chunk( png_ptr, reinterpret_cast< png_const_bytep >( "IDAT" ), aStream.data() + pos, std::min( kPngIdatChunk, aStream.size() - pos ) );
+	}
+
+	png_write_chunk( png_ptr, reinterpret_cast< png_const_bytep >( "IEND" ), nullptr, 0 );
+	return true;
+}
+
+//=============================================================================
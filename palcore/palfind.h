@@ -0,0 +1,369 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palfind.h
+//
+// The input file wildcards of palgen, applypal, imgsize and palpipe. * and ? match within
+// one name, in any part of the path (art/*/walk_??.png), and a part that is ** matches any
+// number of folders, none included (art/**/*.png is every .png under art). Folders are
+// read a level at a time, each level's folders across the threads, and a folder is only
+// read when the rest of the wildcard can match below it. Matching ignores case on Windows,
+// as its file system does. Header only; uses std::filesystem (C++17) and paltask.h.
+//
+
+#pragma once
+
+#include "paltask.h"
+#include "paltrace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+//=============================================================================
+
+#ifdef _WIN32
+static constexpr char kFindSeparator = '\\';
+#else
+static constexpr char kFindSeparator = '/';
+#endif
+
+//
+// find_match
+//
+// Does the name match a wildcard part, of * (any run of characters) and ? (any one)?
+//
+inline bool find_match( const char* szPattern, const char* szName )
+{
+	const char* pStar = nullptr; // the last * seen, and where in the name it has taken up to.
+	const char* pStarName = nullptr;
+
+	for ( ; ; )
+	{
+		if ( *szPattern == '*' )
+		{
+			pStar = szPattern++;
+			pStarName = szName;
+			continue;
+		}
+
+		if ( *szName == '\0' )
+		{
+			break;
+		}
+
+#ifdef _WIN32
+		const bool bSame = ( tolower( static_cast< unsigned char >( *szPattern ) ) == tolower( static_cast< unsigned char >( *szName ) ) );
+#else
+		const bool bSame = ( *szPattern == *szName );
+#endif
+
+		if ( *szPattern != '\0' && ( *szPattern == '?' || bSame ) )
+		{
+			++szPattern;
+			++szName;
+		}
+		else if ( pStar != nullptr )
+		{
+			// let the last * take one more character, and try again from after it.
+			szPattern = pStar + 1;
+			szName = ++pStarName;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while ( *szPattern == '*' )
+	{
+		++szPattern;
+	}
+
+	return *szPattern == '\0';
+}
+
+//
+// find_split
+//
+// Split a wildcard into the folder its files are all under, as written (ending in a
+// separator, or empty for the current folder), and the parts after it to match.
+//
+inline void find_split( const char* szWildCard, std::string& strBase, std::vector< std::string >& aParts )
+{
+	// the parts up to the first with a wildcard are as written.
+	const std::string strWildCard = szWildCard;
+	strBase.clear();
+	aParts.clear();
+	bool bFixed = true;
+
+	for ( size_t pos = 0; pos <= strWildCard.size(); )
+	{
+		size_t end = strWildCard.find_first_of( "/\\", pos );
+		if ( end == strWildCard.npos )
+		{
+			end = strWildCard.size();
+		}
+
+		const std::string strPart = strWildCard.substr( pos, end - pos );
+		const bool bLast = ( end == strWildCard.size() );
+
+		if ( bFixed && bLast == false && strPart.find_first_of( "*?" ) == strPart.npos )
+		{
+			strBase.append( strWildCard, pos, end - pos + 1 ); // with its separator
+		}
+		else if ( strPart.empty() == false || bLast )
+		{
+			bFixed = false;
+			aParts.push_back( strPart );
+		}
+
+		pos = end + 1;
+	}
+}
+
+//
+// find_match_path
+//
+// Is a path, as find_files gives them, one that the wildcard matches? For the files that
+// a watch (palwatch.h) sees written, without reading the folders again.
+//
+inline bool find_match_path( const char* szWildCard, const std::string& strPath )
+{
+	std::string strBase;
+	std::vector< std::string > aParts;
+	find_split( szWildCard, strBase, aParts );
+
+	if ( strPath.compare( 0, strBase.size(), strBase ) != 0 )
+	{
+		return false;
+	}
+
+	std::vector< std::string > aNames;
+	for ( size_t pos = strBase.size(); pos <= strPath.size(); )
+	{
+		size_t end = strPath.find_first_of( "/\\", pos );
+		if ( end == strPath.npos )
+		{
+			end = strPath.size();
+		}
+
+		if ( end > pos )
+		{
+			aNames.push_back( strPath.substr( pos, end - pos ) );
+		}
+
+		pos = end + 1;
+	}
+
+	// as find_files: ** takes any number of folders, and when it is the last part every
+	// file below them too, its name included.
+	std::function< bool( size_t, size_t ) > match_fn = [&]( size_t part, size_t name ) -> bool
+	{
+		if ( part == aParts.size() )
+		{
+			return name == aNames.size();
+		}
+
+		if ( aParts[ part ] == "**" )
+		{
+			if ( part + 1 == aParts.size() )
+			{
+				return name < aNames.size();
+			}
+
+			return match_fn( part + 1, name ) || ( name + 1 < aNames.size() && match_fn( part, name + 1 ) );
+		}
+
+		return name < aNames.size() && find_match( aParts[ part ].c_str(), aNames[ name ].c_str() ) && match_fn( part + 1, name + 1 );
+	};
+
+	return match_fn( 0, 0 );
+}
+
+//
+// find_files
+//
+// Add the files that match a wildcard to aFiles, each as the wildcard's folder was written
+// followed by the rest of its path. Without wildcards it is the file itself, if it is
+// there. The order is that of the folders' reading; sort_files puts the list in order.
+//
+inline void find_files( const char* szWildCard, std::vector< std::string >& aFiles, int threads = int( task_thread_cap() ) )
+{
+	TRACE_ZONE( "find_files" );
+
+	std::string strBase;
+	std::vector< std::string > aParts;
+	find_split( szWildCard, strBase, aParts );
+
+	struct folder_t
+	{
+		std::string strPath; // as it is to be written, ending in a separator (or empty, for the current folder)
+		size_t part; // the first part left to match in it
+	};
+
+	struct found_t
+	{
+		std::vector< folder_t > aFolders;
+		std::vector< std::string > aFiles;
+	};
+
+	// each folder is matched against its first part, and the parts ** lets it skip to.
+	auto read_folder = [&]( const folder_t& folder, found_t& found )
+	{
+		size_t aPart[ 16 ];
+		size_t count = 0;
+		bool bWild = false;
+
+		for ( size_t part = folder.part; part < aParts.size() && count < 16; ++part )
+		{
+			aPart[ count++ ] = part;
+			bWild |= ( aParts[ part ].find_first_of( "*?" ) != std::string::npos );
+			if ( aParts[ part ] != "**" )
+			{
+				break;
+			}
+		}
+
+		std::error_code ec;
+
+		// a part without wildcards is looked up, not searched for.
+		if ( bWild == false )
+		{
+			const size_t part = aPart[ 0 ];
+			const std::string strPath = folder.strPath + aParts[ part ];
+			const std::filesystem::file_status status = std::filesystem::status( strPath.empty() ? "." : strPath, ec );
+			if ( ec )
+			{
+				return;
+			}
+
+			if ( part + 1 == aParts.size() )
+			{
+				if ( std::filesystem::exists( status ) && std::filesystem::is_directory( status ) == false )
+				{
+					found.aFiles.push_back( strPath );
+				}
+			}
+			else if ( std::filesystem::is_directory( status ) )
+			{
+				found.aFolders.push_back( { strPath + kFindSeparator, part + 1 } );
+			}
+			return;
+		}
+
+		std::filesystem::directory_iterator it( folder.strPath.empty() ? std::filesystem::path( "." ) : std::filesystem::path( folder.strPath ), ec );
+
+		for ( ; !ec && it != std::filesystem::directory_iterator(); it.increment( ec ) )
+		{
+			std::string strName;
+			try
+			{
+				strName = it->path().filename().string();
+			}
+			catch ( const std::exception& )
+			{
+				continue; // not a name this code page can hold.
+			}
+
+			std::error_code ec_entry;
+			const bool bFolder = it->is_directory( ec_entry );
+			const bool bLink = it->is_symlink( ec_entry );
+
+			for ( size_t i = 0; i < count; ++i )
+			{
+				const size_t part = aPart[ i ];
+
+				if ( aParts[ part ] == "**" )
+				{
+					// ** goes down into every folder, but not through links, which may loop.
+					if ( bFolder && bLink == false )
+					{
+						found.aFolders.push_back( { folder.strPath + strName + kFindSeparator, part } );
+					}
+					else if ( bFolder == false && part + 1 == aParts.size() )
+					{
+						found.aFiles.push_back( folder.strPath + strName );
+					}
+				}
+				else if ( find_match( aParts[ part ].c_str(), strName.c_str() ) )
+				{
+					if ( part + 1 == aParts.size() )
+					{
+						if ( bFolder == false )
+						{
+							found.aFiles.push_back( folder.strPath + strName );
+						}
+					}
+					else if ( bFolder )
+					{
+						found.aFolders.push_back( { folder.strPath + strName + kFindSeparator, part + 1 } );
+					}
+				}
+			}
+		}
+	};
+
+	std::vector< folder_t > aLevel = { { strBase, 0 } };
+
+	while ( aLevel.empty() == false )
+	{
+		std::vector< found_t > aFound( aLevel.size() );
+
+		parallel_for( 0, aLevel.size(), threads, [&]( size_t i )
+		{
+			read_folder( aLevel[ i ], aFound[ i ] );
+		} );
+
+		std::vector< folder_t > aNext;
+		for ( found_t& found : aFound )
+		{
+			aFiles.insert( aFiles.end(), std::make_move_iterator( found.aFiles.begin() ), std::make_move_iterator( found.aFiles.end() ) );
+			aNext.insert( aNext.end(), std::make_move_iterator( found.aFolders.begin() ), std::make_move_iterator( found.aFolders.end() ) );
+		}
+
+		aLevel = std::move( aNext );
+	}
+}
+
+//
+// sort_files
+//
+// Put a list of files in order, once it has all been found, and drop any found twice.
+//
+inline void sort_files( std::vector< std::string >& aFiles )
+{
+	std::sort( aFiles.begin(), aFiles.end() );
+	aFiles.erase( std::unique( aFiles.begin(), aFiles.end() ), aFiles.end() );
+}
+
+//=============================================================================
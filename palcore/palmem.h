@@ -0,0 +1,293 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palmem.h
+//
+// Memory and thread placement for large machines, both off unless asked for:
+//
+//  FRAGMENTS_HUGE_PAGES=1   the image pool's blocks of 2MB and more are mapped from the OS
+//                           in 2MB pages (MEM_LARGE_PAGES, which needs the "Lock pages in
+//                           memory" right; MAP_HUGETLB, or transparent huge pages, on Linux),
+//                           so a full frame takes a few TLB entries instead of thousands.
+//                           Without large pages to hand they are mapped in normal pages.
+//  FRAGMENTS_NUMA=1         each batch worker is held to the cores of one NUMA node, the
+//                           workers dealt out over the nodes in turn, and the row bands a
+//                           worker splits its image into stay on its node. Mapped blocks
+//                           are left untouched until the first write, so each page lands
+//                           on the node of the thread that fills it.
+//
+// Header only and C++14, like paltask.h.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#endif
+
+//=============================================================================
+
+static constexpr size_t kHugePageBytes = size_t( 2 ) << 20;
+
+// is FRAGMENTS_HUGE_PAGES set?
+inline bool mem_huge_pages()
+{
+	static const bool bHuge = []()
+	{
+		const char* szHuge = getenv( "FRAGMENTS_HUGE_PAGES" );
+		return szHuge != nullptr && atoi( szHuge ) > 0;
+	}();
+
+	return bHuge;
+}
+
+//
+// mem_page_bytes
+//
+// The size mem_page_alloc gives for uBytes: a whole number of large pages.
+//
+inline size_t mem_page_bytes( size_t uBytes )
+{
+#ifdef _WIN32
+	static const size_t uPage = []()
+	{
+		// large pages need SeLockMemoryPrivilege, held by the account but off until asked for.
+		HANDLE hToken = nullptr;
+		if ( OpenProcessToken( GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken ) )
+		{
+			TOKEN_PRIVILEGES privileges = {};
+			privileges.PrivilegeCount = 1;
+			privileges.Privileges[ 0 ].Attributes = SE_PRIVILEGE_ENABLED;
+			if ( LookupPrivilegeValueA( nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[ 0 ].Luid ) )
+			{
+				AdjustTokenPrivileges( hToken, FALSE, &privileges, 0, nullptr, nullptr );
+			}
+			CloseHandle( hToken );
+		}
+
+		const size_t uLarge = GetLargePageMinimum();
+		return ( uLarge > kHugePageBytes ) ? uLarge : kHugePageBytes;
+	}();
+#else
+	const size_t uPage = kHugePageBytes;
+#endif
+
+	return ( uBytes + uPage - 1 ) / uPage * uPage;
+}
+
+//
+// mem_page_alloc
+//
+// uBytes (from mem_page_bytes) mapped straight from the OS, in large pages if it has them.
+// The memory is zero, and is not paged in until it is first written. nullptr if it fails.
+//
+inline void* mem_page_alloc( size_t uBytes )
+{
+#ifdef _WIN32
+	void* pData = VirtualAlloc( nullptr, uBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+	if ( pData == nullptr )
+	{
+		pData = VirtualAlloc( nullptr, uBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+	}
+	return pData;
+#else
+	void* pData = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	pData = mmap( nullptr, uBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+#endif
+	if ( pData == MAP_FAILED )
+	{
+		// no huge pages reserved: normal pages, which the kernel may still gather into huge ones.
+		pData = mmap( nullptr, uBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( pData == MAP_FAILED )
+		{
+			return nullptr;
+		}
+#ifdef MADV_HUGEPAGE
+		madvise( pData, uBytes, MADV_HUGEPAGE );
+#endif
+	}
+	return pData;
+#endif
+}
+
+inline void mem_page_free( void* pData, size_t uBytes )
+{
+#ifdef _WIN32
+	( void )uBytes;
+	VirtualFree( pData, 0, MEM_RELEASE );
+#else
+	munmap( pData, uBytes );
+#endif
+}
+
+//=============================================================================
+
+#ifdef _WIN32
+using mem_node_t = GROUP_AFFINITY;
+#else
+using mem_node_t = std::vector< int >; // the node's CPUs
+#endif
+
+//
+// mem_numa_nodes
+//
+// The CPUs of each NUMA node that has any, when FRAGMENTS_NUMA is set and there are two or
+// more; empty otherwise, and threads are left where the OS puts them.
+//
+inline const std::vector< mem_node_t >& mem_numa_nodes()
+{
+	static const std::vector< mem_node_t > aNodes = []()
+	{
+		std::vector< mem_node_t > aFound;
+
+		const char* szNuma = getenv( "FRAGMENTS_NUMA" );
+		if ( szNuma == nullptr || atoi( szNuma ) <= 0 )
+		{
+			return aFound;
+		}
+
+#ifdef _WIN32
+		ULONG highest = 0;
+		if ( GetNumaHighestNodeNumber( &highest ) )
+		{
+			for ( ULONG node = 0; node <= highest; ++node )
+			{
+				GROUP_AFFINITY affinity = {};
+				if ( GetNumaNodeProcessorMaskEx( USHORT( node ), &affinity ) && affinity.Mask != 0 )
+				{
+					aFound.push_back( affinity );
+				}
+			}
+		}
+#elif defined( __linux__ )
+		// each node's cpulist is ranges, as "0-15,32-47".
+		for ( int node = 0; ; ++node )
+		{
+			char szPath[ 64 ];
+			snprintf( szPath, sizeof( szPath ), "/sys/devices/system/node/node%d/cpulist", node );
+
+			FILE* fp = fopen( szPath, "r" );
+			if ( fp == nullptr )
+			{
+				break;
+			}
+
+			std::vector< int > aCPUs;
+			int first = 0;
+			while ( fscanf( fp, "%d", &first ) == 1 )
+			{
+				int last = first;
+				const int c = fgetc( fp );
+				if ( c == '-' && fscanf( fp, "%d", &last ) == 1 )
+				{
+					fgetc( fp );
+				}
+
+				for ( int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu )
+				{
+					aCPUs.push_back( cpu );
+				}
+			}
+			fclose( fp );
+
+			if ( aCPUs.empty() == false )
+			{
+				aFound.push_back( aCPUs );
+			}
+		}
+#endif
+
+		if ( aFound.size() < 2 )
+		{
+			aFound.clear();
+		}
+
+		return aFound;
+	}();
+
+	return aNodes;
+}
+
+// the node the calling thread was held to by mem_numa_pin, or -1.
+inline int& mem_numa_thread_node()
+{
+	static thread_local int node = -1;
+	return node;
+}
+
+//
+// mem_numa_pin
+//
+// Hold the calling thread to the cores of node ( index % nodes ), for worker index of a
+// batch. Does nothing without FRAGMENTS_NUMA.
+//
+inline void mem_numa_pin( size_t index )
+{
+	const std::vector< mem_node_t >& aNodes = mem_numa_nodes();
+	if ( aNodes.empty() )
+	{
+		return;
+	}
+
+	const int node = int( index % aNodes.size() );
+
+#ifdef _WIN32
+	SetThreadGroupAffinity( GetCurrentThread(), &aNodes[ node ], nullptr );
+#elif defined( __linux__ )
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	for ( const int cpu : aNodes[ node ] )
+	{
+		CPU_SET( cpu, &set );
+	}
+	pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#endif
+
+	mem_numa_thread_node() = node;
+}
+
+//=============================================================================
@@ -0,0 +1,147 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palpalette.h
+//
+// The .hex palettes every tool reads (as aseprite saves them: a line of 6 ASCII hex digits
+// for each entry), and the hash of a palette's entries that keys the caches built from it.
+// palcore.h's palette_t loads them for applypal and imgsize; fogpal, which keeps its
+// entries as 0xRRGGBB, uses these directly. Header only and C++14, like paltask.h.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//=============================================================================
+
+//
+// palette_hex_digit
+//
+// The value of an ASCII hex digit, or -1.
+//
+inline int palette_hex_digit( char c )
+{
+	struct table_t
+	{
+		int8_t aValue[ 256 ];
+
+		table_t()
+		{
+			for ( int i = 0; i < 256; ++i )
+			{
+				aValue[ i ] = ( i >= '0' && i <= '9' ) ? int8_t( i - '0' ) :
+							  ( i >= 'a' && i <= 'f' ) ? int8_t( i - 'a' + 10 ) :
+							  ( i >= 'A' && i <= 'F' ) ? int8_t( i - 'A' + 10 ) : -1;
+			}
+		}
+	};
+
+	static const table_t table;
+	return table.aValue[ uint8_t( c ) ];
+}
+
+//
+// palette_parse_hex
+//
+// Add the entries of a .hex file's text to aPalette, as 0xRRGGBB. Lines end in \n or \r\n,
+// and the palette ends at the first line that isn't 6 hex digits.
+//
+inline void palette_parse_hex( const char* pData, size_t size, std::vector< uint32_t >& aPalette )
+{
+	aPalette.reserve( aPalette.size() + size / 7 );
+
+	size_t pos = 0;
+	while ( pos < size )
+	{
+		size_t end = pos;
+		while ( end < size && pData[ end ] != '\n' )
+		{
+			++end;
+		}
+
+		size_t len = end - pos;
+		if ( len > 0 && pData[ end - 1 ] == '\r' )
+		{
+			--len;
+		}
+
+		if ( len != 6 )
+		{
+			break;
+		}
+
+		uint32_t colour = 0;
+		for ( size_t k = 0; k < 6; ++k )
+		{
+			const int digit = palette_hex_digit( pData[ pos + k ] );
+			if ( digit < 0 )
+			{
+				return;
+			}
+			colour = ( colour << 4 ) | uint32_t( digit );
+		}
+
+		aPalette.push_back( colour );
+
+		pos = end + 1;
+	}
+}
+
+//
+// palette_hash
+//
+// 64-bit FNV-1a of a palette's entries, each 0xRRGGBB as 3 bytes, red first. Equal palettes
+// hash the same in every tool, whatever each keeps its entries as.
+//
+struct palette_hash_t
+{
+	uint64_t uHash = 0xcbf29ce484222325ULL;
+
+	void Add( uint32_t rgb )
+	{
+		for ( int shift = 16; shift >= 0; shift -= 8 )
+		{
+			uHash = ( uHash ^ ( ( rgb >> shift ) & 0xFF ) ) * 0x100000001b3ULL;
+		}
+	}
+};
+
+inline uint64_t palette_hash( const std::vector< uint32_t >& aPalette )
+{
+	palette_hash_t hash;
+	for ( uint32_t rgb : aPalette )
+	{
+		hash.Add( rgb );
+	}
+	return hash.uHash;
+}
+
+//=============================================================================
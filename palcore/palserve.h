@@ -0,0 +1,608 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palserve.h
+//
+// -serve, the long running form of applypal, imgsize, palgen and fogpal, for build systems
+// that would otherwise start a process for every image. A job is a line of the options of
+// a normal run, which the tool runs as it would from its command line, keeping what it can
+// between jobs (palettes, colour cubes and fog searches, image buffers, kernel tables).
+// After each job comes its log, if the tool gathers one, and then
+//
+//  #<job> OK <ms>ms      or      #<job> FAILED <ms>ms
+//
+// <job> counting the lines of its connection from 1, and <ms> the time the job took. Blank
+// lines and lines starting with # are counted but not run or answered; -stop ends the
+// server once the jobs under way are done.
+//
+//  -serve            the jobs are read from stdin and answered on stdout, side by side
+//                    as they come, so the answers may be out of order.
+//  -serve=<name>     any number of clients connect to a named pipe (\\.\pipe\<name>) on
+//                    Windows, a Unix domain socket at the path <name> elsewhere. Each
+//                    client's jobs are run one after another, and each answered before the
+//                    next is read; the jobs of all clients share the tool's job threads.
+//
+// Header only and C++14, like paltask.h.
+//
+
+#pragma once
+
+#include "paltask.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================
+
+//
+// serve_split_args
+//
+// Splits a job line into arguments at spaces and tabs. Double quotes group an argument
+// that holds spaces.
+//
+inline std::vector< std::string > serve_split_args( const std::string& strLine )
+{
+	std::vector< std::string > aArgs;
+	std::string strArg;
+	bool bQuoted = false;
+	bool bHaveArg = false;
+
+	for ( const char c : strLine )
+	{
+		if ( c == '"' )
+		{
+			bQuoted = !bQuoted;
+			bHaveArg = true;
+		}
+		else if ( ( c == ' ' || c == '\t' || c == '\r' ) && bQuoted == false )
+		{
+			if ( bHaveArg )
+			{
+				aArgs.push_back( strArg );
+				strArg.clear();
+				bHaveArg = false;
+			}
+		}
+		else
+		{
+			strArg += c;
+			bHaveArg = true;
+		}
+	}
+
+	if ( bHaveArg )
+	{
+		aArgs.push_back( strArg );
+	}
+
+	return aArgs;
+}
+
+//
+// serve_argv
+//
+// A job's arguments as the argv of a run of szTool, for its process_args. The pointers are
+// into aArgs.
+//
+inline std::vector< char* > serve_argv( const char* szTool, std::vector< std::string >& aArgs )
+{
+	std::vector< char* > argv = { const_cast< char* >( szTool ) };
+	for ( std::string& strArg : aArgs )
+	{
+		argv.push_back( &strArg[ 0 ] );
+	}
+	return argv;
+}
+
+//
+// serve_stream_t
+//
+// One client's lines in, and answers out.
+//
+struct serve_stream_t
+{
+	std::string _strBuffer; // read, not yet taken as lines.
+
+	virtual ~serve_stream_t()
+	{
+	}
+
+	// false at the end of the input.
+	virtual bool ReadLine( std::string& strLine )
+	{
+		for ( ;; )
+		{
+			const size_t end = _strBuffer.find( '\n' );
+			if ( end != std::string::npos )
+			{
+				strLine.assign( _strBuffer, 0, end );
+				_strBuffer.erase( 0, end + 1 );
+				return true;
+			}
+
+			char aBlock[ 4096 ];
+			const size_t read = Read( aBlock, sizeof( aBlock ) );
+			if ( read == 0 )
+			{
+				// a last line without its \n.
+				strLine.swap( _strBuffer );
+				_strBuffer.clear();
+				return strLine.empty() == false;
+			}
+
+			_strBuffer.append( aBlock, read );
+		}
+	}
+
+	virtual void Write( const std::string& strText ) = 0;
+
+	// End a ReadLine waiting on another thread, as the server stops.
+	virtual void Cancel()
+	{
+	}
+
+protected:
+
+	virtual size_t Read( char* pBuffer, size_t size )
+	{
+		( void )pBuffer;
+		( void )size;
+		return 0;
+	}
+};
+
+struct serve_stdio_t : serve_stream_t
+{
+	bool ReadLine( std::string& strLine ) override
+	{
+		return !!std::getline( std::cin, strLine );
+	}
+
+	void Write( const std::string& strText ) override
+	{
+		std::cout << strText << std::flush;
+	}
+};
+
+#ifdef _WIN32
+
+struct serve_pipe_t : serve_stream_t
+{
+	HANDLE _hPipe;
+
+	explicit serve_pipe_t( HANDLE hPipe ) : _hPipe( hPipe )
+	{
+	}
+
+	~serve_pipe_t() override
+	{
+		FlushFileBuffers( _hPipe );
+		DisconnectNamedPipe( _hPipe );
+		CloseHandle( _hPipe );
+	}
+
+	void Write( const std::string& strText ) override
+	{
+		for ( size_t pos = 0; pos < strText.size(); )
+		{
+			DWORD written = 0;
+			if ( WriteFile( _hPipe, strText.data() + pos, DWORD( std::min< size_t >( strText.size() - pos, 1 << 20 ) ), &written, nullptr ) == FALSE || written == 0 )
+			{
+				return; // the client has gone.
+			}
+			pos += written;
+		}
+	}
+
+	void Cancel() override
+	{
+		CancelIoEx( _hPipe, nullptr );
+	}
+
+protected:
+
+	size_t Read( char* pBuffer, size_t size ) override
+	{
+		DWORD read = 0;
+		return ( ReadFile( _hPipe, pBuffer, DWORD( size ), &read, nullptr ) != FALSE ) ? size_t( read ) : 0;
+	}
+};
+
+#else
+
+struct serve_socket_t : serve_stream_t
+{
+	int _fd;
+
+	explicit serve_socket_t( int fd ) : _fd( fd )
+	{
+	}
+
+	~serve_socket_t() override
+	{
+		close( _fd );
+	}
+
+	void Write( const std::string& strText ) override
+	{
+		for ( size_t pos = 0; pos < strText.size(); )
+		{
+			const ssize_t sent = send( _fd, strText.data() + pos, strText.size() - pos, MSG_NOSIGNAL );
+			if ( sent <= 0 )
+			{
+				return; // the client has gone.
+			}
+			pos += size_t( sent );
+		}
+	}
+
+	void Cancel() override
+	{
+		shutdown( _fd, SHUT_RDWR );
+	}
+
+protected:
+
+	size_t Read( char* pBuffer, size_t size ) override
+	{
+		const ssize_t read = recv( _fd, pBuffer, size, 0 );
+		return ( read > 0 ) ? size_t( read ) : 0;
+	}
+};
+
+#endif
+
+//
+// serve_listener_t
+//
+// Where the clients of -serve=<name> connect. Accept returns the next, or null once the
+// listener is closed; Wake makes a waiting Accept return.
+//
+struct serve_listener_t
+{
+#ifdef _WIN32
+	std::string _strPipe;
+	HANDLE _hNext = INVALID_HANDLE_VALUE; // the instance the next client connects to.
+#else
+	std::string _strPath;
+	int _fd = -1;
+#endif
+
+	~serve_listener_t()
+	{
+#ifdef _WIN32
+		if ( _hNext != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle( _hNext );
+		}
+#else
+		if ( _fd >= 0 )
+		{
+			close( _fd );
+			unlink( _strPath.c_str() );
+		}
+#endif
+	}
+
+	// False, with why, if the name can't be listened on (or another server has it).
+	bool Open( const std::string& strName, std::string& strError )
+	{
+#ifdef _WIN32
+		_strPipe = "\\\\.\\pipe\\" + strName;
+		_hNext = Instance( FILE_FLAG_FIRST_PIPE_INSTANCE );
+		if ( _hNext == INVALID_HANDLE_VALUE )
+		{
+			strError = "could not make the pipe \"" + _strPipe + "\" (is another server using it?)";
+			return false;
+		}
+#else
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if ( strName.size() >= sizeof( address.sun_path ) )
+		{
+			strError = "the socket path \"" + strName + "\" is too long";
+			return false;
+		}
+		strName.copy( address.sun_path, strName.size() );
+
+		_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if ( _fd < 0 )
+		{
+			strError = "could not make a socket";
+			return false;
+		}
+
+		// a socket left by a server that stopped is taken over.
+		unlink( strName.c_str() );
+		if ( bind( _fd, reinterpret_cast< const sockaddr* >( &address ), sizeof( address ) ) != 0 || listen( _fd, SOMAXCONN ) != 0 )
+		{
+			close( _fd );
+			_fd = -1;
+			strError = "could not listen on the socket \"" + strName + "\"";
+			return false;
+		}
+
+		_strPath = strName;
+#endif
+		return true;
+	}
+
+	std::unique_ptr< serve_stream_t > Accept()
+	{
+#ifdef _WIN32
+		if ( _hNext == INVALID_HANDLE_VALUE )
+		{
+			return nullptr;
+		}
+
+		HANDLE hPipe = _hNext;
+		const bool bConnected = ConnectNamedPipe( hPipe, nullptr ) != FALSE || GetLastError() == ERROR_PIPE_CONNECTED;
+
+		_hNext = Instance( 0 );
+
+		if ( bConnected == false )
+		{
+			CloseHandle( hPipe );
+			return nullptr;
+		}
+
+		return std::unique_ptr< serve_stream_t >( new serve_pipe_t( hPipe ) );
+#else
+		const int fd = accept( _fd, nullptr, nullptr );
+		if ( fd < 0 )
+		{
+			return nullptr;
+		}
+
+		return std::unique_ptr< serve_stream_t >( new serve_socket_t( fd ) );
+#endif
+	}
+
+	void Wake()
+	{
+#ifdef _WIN32
+		HANDLE hClient = CreateFileA( _strPipe.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr );
+		if ( hClient != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle( hClient );
+		}
+#else
+		const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if ( fd >= 0 )
+		{
+			sockaddr_un address = {};
+			address.sun_family = AF_UNIX;
+			_strPath.copy( address.sun_path, _strPath.size() );
+			connect( fd, reinterpret_cast< const sockaddr* >( &address ), sizeof( address ) );
+			close( fd );
+		}
+#endif
+	}
+
+#ifdef _WIN32
+private:
+
+	HANDLE Instance( DWORD dwFlags ) const
+	{
+		return CreateNamedPipeA( _strPipe.c_str(), PIPE_ACCESS_DUPLEX | dwFlags, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+								 PIPE_UNLIMITED_INSTANCES, 64 * 1024, 64 * 1024, 0, nullptr );
+	}
+#endif
+};
+
+//
+// serve_jobs
+//
+// Run the jobs of -serve (strEndpoint empty) or -serve=<endpoint> on up to threads threads
+// at once, until the input ends or a -stop. Each job is fnJob( aArgs, strLog ): the
+// arguments of the line, and a log to add to; it returns false if the job failed. False if
+// the endpoint can't be listened on.
+//
+inline bool serve_jobs( const std::string& strEndpoint, unsigned threads, const std::function< bool( std::vector< std::string >&, std::string& ) >& fnJob )
+{
+	threads = std::max( 1u, threads );
+
+	auto run_fn = [&]( size_t uJob, std::vector< std::string >& aArgs )
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::string strLog;
+		const bool bOK = fnJob( aArgs, strLog );
+
+		const double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+
+		char szResult[ 64 ];
+		snprintf( szResult, sizeof( szResult ), "#%llu %s %.3fms\n", (unsigned long long)uJob, bOK ? "OK" : "FAILED", ms );
+		return strLog + szResult;
+	};
+
+	// the job threads, taking jobs from every client.
+	bounded_queue_t< std::function< void() > > queue( threads );
+	std::vector< std::thread > aWorkers;
+	for ( unsigned t = 0; t < threads; ++t )
+	{
+		aWorkers.emplace_back( [&]()
+		{
+			std::function< void() > job;
+			while ( queue.Pop( job ) )
+			{
+				job();
+			}
+		} );
+	}
+
+	auto finish_fn = [&]()
+	{
+		queue.Close();
+		for ( std::thread& worker : aWorkers )
+		{
+			worker.join();
+		}
+	};
+
+	// is the line a job, or the end? Blank and # lines are neither.
+	auto parse_fn = []( const std::string& strLine, std::vector< std::string >& aArgs, bool& bStop )
+	{
+		aArgs = serve_split_args( strLine );
+		bStop = ( aArgs.size() == 1 && aArgs[ 0 ] == "-stop" );
+		return aArgs.empty() == false && aArgs[ 0 ][ 0 ] != '#' && bStop == false;
+	};
+
+	if ( strEndpoint.empty() )
+	{
+		serve_stdio_t stdio;
+		std::mutex mutexOut;
+
+		std::string strLine;
+		for ( size_t uJob = 1; stdio.ReadLine( strLine ); ++uJob )
+		{
+			auto pArgs = std::make_shared< std::vector< std::string > >();
+			bool bStop;
+			if ( parse_fn( strLine, *pArgs, bStop ) )
+			{
+				queue.Push( [ &, uJob, pArgs ]()
+				{
+					const std::string strAnswer = run_fn( uJob, *pArgs );
+
+					std::lock_guard< std::mutex > lock( mutexOut );
+					stdio.Write( strAnswer );
+				} );
+			}
+			else if ( bStop )
+			{
+				break;
+			}
+		}
+
+		finish_fn();
+		return true;
+	}
+
+	serve_listener_t listener;
+	std::string strError;
+	if ( listener.Open( strEndpoint, strError ) == false )
+	{
+		std::cout << "Error - " << strError << ".\n";
+		finish_fn();
+		return false;
+	}
+
+	std::cout << "Serving jobs on \"" << strEndpoint << "\".\n" << std::flush;
+
+	std::atomic< bool > bStopping( false );
+	std::mutex mutexClients;
+	std::condition_variable cvClients;
+	std::vector< serve_stream_t* > aClients; // connected, to Cancel as the server stops.
+
+	auto client_fn = [&]( std::shared_ptr< serve_stream_t > pStream )
+	{
+		std::string strLine;
+		for ( size_t uJob = 1; bStopping == false && pStream->ReadLine( strLine ); ++uJob )
+		{
+			std::vector< std::string > aArgs;
+			bool bStop;
+			if ( parse_fn( strLine, aArgs, bStop ) )
+			{
+				std::promise< std::string > answer;
+				std::future< std::string > future = answer.get_future();
+
+				queue.Push( [ &, uJob ]()
+				{
+					answer.set_value( run_fn( uJob, aArgs ) );
+				} );
+
+				pStream->Write( future.get() );
+			}
+			else if ( bStop )
+			{
+				bStopping = true;
+				listener.Wake();
+				break;
+			}
+		}
+
+		std::lock_guard< std::mutex > lock( mutexClients );
+		aClients.erase( std::find( aClients.begin(), aClients.end(), pStream.get() ) );
+		cvClients.notify_all();
+	};
+
+	while ( bStopping == false )
+	{
+		std::shared_ptr< serve_stream_t > pStream( listener.Accept() );
+		if ( pStream == nullptr || bStopping )
+		{
+			break;
+		}
+
+		// a thread for each client, as long as it stays connected.
+		std::lock_guard< std::mutex > lock( mutexClients );
+		aClients.push_back( pStream.get() );
+		std::thread( client_fn, pStream ).detach();
+	}
+
+	// the clients still connected are waiting for their next line, which will not be run.
+	{
+		std::unique_lock< std::mutex > lock( mutexClients );
+		for ( serve_stream_t* pClient : aClients )
+		{
+			pClient->Cancel();
+		}
+
+		cvClients.wait( lock, [&]() { return aClients.empty(); } );
+	}
+
+	finish_fn();
+	return true;
+}
+
+//=============================================================================
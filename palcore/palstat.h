@@ -0,0 +1,473 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palstat.h
+//
+// The progress of a long batch, off unless asked for:
+//
+//  FRAGMENTS_PROGRESS=<s>    every <s> seconds a status line on stderr: files done of those
+//                            found (and failed), MB/s read and written, Mpixel/s, the items
+//                            waiting in each pipeline queue, how many worker threads are
+//                            busy, and the time left at the rate so far.
+//  FRAGMENTS_METRICS=<file>  the same counters, as often (every 5 seconds without
+//                            FRAGMENTS_PROGRESS), in the Prometheus text format for a node
+//                            exporter's textfile collector or any script to read. It is
+//                            written to <file>.tmp and renamed, so it is always whole.
+//
+// The counters are kept by the shared scheduler. parallel_for_state counts its threads as
+// workers, busy for as long as they run; a tool's own long-lived workers count themselves
+// with stat_worker_t, and busy with stat_busy_t only while they have an item in hand, so
+// time spent waiting on a queue shows as idle. bounded_queue_t given a name counts the items
+// in it. The tools add the files they find with stat_files and count each one with
+// stat_file_done. Header only and C++14, like paltask.h.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+//=============================================================================
+
+static constexpr size_t kStatQueues = 8;
+
+// is FRAGMENTS_PROGRESS or FRAGMENTS_METRICS set?
+inline bool stat_enabled()
+{
+	static const bool bEnabled = []()
+	{
+		const char* szProgress = getenv( "FRAGMENTS_PROGRESS" );
+		const char* szMetrics = getenv( "FRAGMENTS_METRICS" );
+		return ( szProgress != nullptr && atof( szProgress ) > 0 ) || ( szMetrics != nullptr && szMetrics[ 0 ] != '\0' );
+	}();
+
+	return bEnabled;
+}
+
+//
+// stat_queue_t
+//
+// The items waiting in every queue of one name, and the most they may hold between them.
+//
+struct stat_queue_t
+{
+	const char* szName = nullptr;
+	std::atomic< int64_t > iDepth{ 0 };
+	std::atomic< int64_t > iCapacity{ 0 };
+};
+
+//
+// stat_batch_t
+//
+// The counters of the run, and the thread that reports them.
+//
+struct stat_batch_t
+{
+	std::atomic< uint64_t > uFiles{ 0 };
+	std::atomic< uint64_t > uDone{ 0 };
+	std::atomic< uint64_t > uFailed{ 0 };
+	std::atomic< uint64_t > uBytesIn{ 0 };
+	std::atomic< uint64_t > uBytesOut{ 0 };
+	std::atomic< uint64_t > uPixels{ 0 };
+	std::atomic< int64_t > iWorkers{ 0 };
+	std::atomic< int64_t > iBusy{ 0 };
+
+	std::mutex mutexQueues;
+	std::atomic< size_t > uQueueCount{ 0 };
+	stat_queue_t aQueues[ kStatQueues ];
+
+	stat_batch_t()
+	{
+		const char* szProgress = getenv( "FRAGMENTS_PROGRESS" );
+		const char* szMetrics = getenv( "FRAGMENTS_METRICS" );
+
+		fPeriod = ( szProgress != nullptr ) ? atof( szProgress ) : 0.0;
+		bProgress = ( fPeriod > 0 );
+		if ( bProgress == false )
+		{
+			fPeriod = 5.0;
+		}
+		strMetrics = ( szMetrics != nullptr ) ? szMetrics : "";
+
+		start = tClock::now();
+		thread = std::thread( [ this ]() { Run(); } );
+	}
+
+	~stat_batch_t()
+	{
+		{
+			std::lock_guard< std::mutex > lock( mutexStop );
+			bStop = true;
+		}
+		cvStop.notify_all();
+		thread.join();
+	}
+
+	// the queue of this name, made the first time it is asked for; nullptr once there are kStatQueues.
+	stat_queue_t* Queue( const char* szName )
+	{
+		std::lock_guard< std::mutex > lock( mutexQueues );
+
+		const size_t count = uQueueCount;
+		for ( size_t i = 0; i < count; ++i )
+		{
+			if ( strcmp( aQueues[ i ].szName, szName ) == 0 )
+			{
+				return &aQueues[ i ];
+			}
+		}
+
+		if ( count == kStatQueues )
+		{
+			return nullptr;
+		}
+
+		aQueues[ count ].szName = szName;
+		uQueueCount = count + 1;
+		return &aQueues[ count ];
+	}
+
+private:
+
+	using tClock = std::chrono::steady_clock;
+
+	struct sample_t
+	{
+		double fSeconds = 0;
+		uint64_t uDone = 0;
+		uint64_t uBytesIn = 0;
+		uint64_t uBytesOut = 0;
+		uint64_t uPixels = 0;
+	};
+
+	double fPeriod = 0;
+	bool bProgress = false;
+	std::string strMetrics;
+
+	tClock::time_point start;
+	std::thread thread;
+	std::mutex mutexStop;
+	std::condition_variable cvStop;
+	bool bStop = false;
+
+	// the workers and busy threads are gauges, so they are sampled every 100ms and averaged.
+	void Run()
+	{
+		sample_t last;
+		double fWorkers = 0, fBusy = 0;
+		size_t samples = 0;
+		double fNext = fPeriod;
+
+		std::unique_lock< std::mutex > lock( mutexStop );
+
+		for ( ; ; )
+		{
+			const bool bStopping = cvStop.wait_for( lock, std::chrono::milliseconds( 100 ), [ this ]() { return bStop; } );
+
+			fWorkers += double( iWorkers );
+			fBusy += double( iBusy );
+			++samples;
+
+			const double fSeconds = std::chrono::duration< double >( tClock::now() - start ).count();
+			if ( fSeconds < fNext && bStopping == false )
+			{
+				continue;
+			}
+
+			// the last report, as the tool exits, is of the whole run.
+			const sample_t now = { fSeconds, uDone, uBytesIn, uBytesOut, uPixels };
+			Report( bStopping ? sample_t() : last, now, fWorkers / double( samples ), fBusy / double( samples ), bStopping );
+
+			last = now;
+			fWorkers = fBusy = 0;
+			samples = 0;
+			fNext = fSeconds + fPeriod;
+
+			if ( bStopping )
+			{
+				return;
+			}
+		}
+	}
+
+	void Report( const sample_t& last, const sample_t& now, double fWorkers, double fBusy, bool bFinal )
+	{
+		const double fSpan = std::max( now.fSeconds - last.fSeconds, 1e-3 );
+		const double fInMBs = double( now.uBytesIn - last.uBytesIn ) / fSpan / 1048576.0;
+		const double fOutMBs = double( now.uBytesOut - last.uBytesOut ) / fSpan / 1048576.0;
+		const double fMPixels = double( now.uPixels - last.uPixels ) / fSpan / 1e6;
+
+		const uint64_t uTotal = uFiles;
+		const uint64_t uLeft = ( uTotal > now.uDone ) ? ( uTotal - now.uDone ) : 0;
+		const double fEta = ( now.uDone > 0 ) ? now.fSeconds * double( uLeft ) / double( now.uDone ) : -1.0;
+
+		const size_t uQueues = uQueueCount;
+
+		if ( bProgress && ( bFinal == false || uTotal > 0 ) )
+		{
+			char szLine[ 512 ];
+			int length = snprintf( szLine, sizeof( szLine ), "[%s] %llu/%llu files", clock_text( now.fSeconds ).c_str(),
+								   (unsigned long long)now.uDone, (unsigned long long)uTotal );
+			if ( uFailed > 0 )
+			{
+				length += snprintf( szLine + length, sizeof( szLine ) - length, " (%llu failed)", (unsigned long long)uFailed );
+			}
+
+			length += snprintf( szLine + length, sizeof( szLine ) - length, ", in %.1f MB/s, out %.1f MB/s, %.1f Mpixel/s", fInMBs, fOutMBs, fMPixels );
+
+			// a queue of no capacity is held to something other than a count, and shows its depth alone.
+			for ( size_t i = 0; i < uQueues && length < int( sizeof( szLine ) ) - 64; ++i )
+			{
+				const long long depth = aQueues[ i ].iDepth;
+				const long long capacity = aQueues[ i ].iCapacity;
+				if ( capacity > 0 )
+					length += snprintf( szLine + length, sizeof( szLine ) - length, ", %s %lld/%lld", aQueues[ i ].szName, depth, capacity );
+				else
+					length += snprintf( szLine + length, sizeof( szLine ) - length, ", %s %lld", aQueues[ i ].szName, depth );
+			}
+
+			length += snprintf( szLine + length, sizeof( szLine ) - length, ", busy %.1f/%.1f threads", fBusy, fWorkers );
+
+			if ( bFinal == false && fEta >= 0 && uLeft > 0 )
+			{
+				snprintf( szLine + length, sizeof( szLine ) - length, ", ETA %s", clock_text( fEta ).c_str() );
+			}
+
+			fprintf( stderr, "%s\n", szLine );
+		}
+
+		if ( strMetrics.empty() == false )
+		{
+			const std::string strTemp = strMetrics + ".tmp";
+
+			FILE* fp = fopen( strTemp.c_str(), "w" );
+			if ( fp == nullptr )
+			{
+				return;
+			}
+
+			fprintf( fp, "# TYPE fragments_files gauge\nfragments_files %llu\n", (unsigned long long)uTotal );
+			fprintf( fp, "# TYPE fragments_files_done counter\nfragments_files_done %llu\n", (unsigned long long)now.uDone );
+			fprintf( fp, "# TYPE fragments_files_failed counter\nfragments_files_failed %llu\n", (unsigned long long)uFailed );
+			fprintf( fp, "# TYPE fragments_bytes_in counter\nfragments_bytes_in %llu\n", (unsigned long long)now.uBytesIn );
+			fprintf( fp, "# TYPE fragments_bytes_out counter\nfragments_bytes_out %llu\n", (unsigned long long)now.uBytesOut );
+			fprintf( fp, "# TYPE fragments_pixels counter\nfragments_pixels %llu\n", (unsigned long long)now.uPixels );
+			fprintf( fp, "# TYPE fragments_bytes_in_per_second gauge\nfragments_bytes_in_per_second %.0f\n", fInMBs * 1048576.0 );
+			fprintf( fp, "# TYPE fragments_bytes_out_per_second gauge\nfragments_bytes_out_per_second %.0f\n", fOutMBs * 1048576.0 );
+			fprintf( fp, "# TYPE fragments_pixels_per_second gauge\nfragments_pixels_per_second %.0f\n", fMPixels * 1e6 );
+			fprintf( fp, "# TYPE fragments_workers gauge\nfragments_workers %.2f\n", fWorkers );
+			fprintf( fp, "# TYPE fragments_workers_busy gauge\nfragments_workers_busy %.2f\n", fBusy );
+
+			fprintf( fp, "# TYPE fragments_queue_depth gauge\n" );
+			for ( size_t i = 0; i < uQueues; ++i )
+			{
+				fprintf( fp, "fragments_queue_depth{queue=\"%s\"} %lld\n", aQueues[ i ].szName, (long long)aQueues[ i ].iDepth );
+			}
+			fprintf( fp, "# TYPE fragments_queue_capacity gauge\n" );
+			for ( size_t i = 0; i < uQueues; ++i )
+			{
+				fprintf( fp, "fragments_queue_capacity{queue=\"%s\"} %lld\n", aQueues[ i ].szName, (long long)aQueues[ i ].iCapacity );
+			}
+
+			fprintf( fp, "# TYPE fragments_elapsed_seconds gauge\nfragments_elapsed_seconds %.1f\n", now.fSeconds );
+			fprintf( fp, "# TYPE fragments_eta_seconds gauge\nfragments_eta_seconds %.1f\n", ( uLeft == 0 ) ? 0.0 : fEta );
+
+			fclose( fp );
+
+#ifdef _WIN32
+			MoveFileExA( strTemp.c_str(), strMetrics.c_str(), MOVEFILE_REPLACE_EXISTING );
+#else
+			rename( strTemp.c_str(), strMetrics.c_str() );
+#endif
+		}
+	}
+
+	// seconds as 1h02m03s, 2m03s or 3s.
+	static std::string clock_text( double fSeconds )
+	{
+		const unsigned long long s = (unsigned long long)( fSeconds + 0.5 );
+
+		char szText[ 32 ];
+		if ( s >= 3600 )
+			snprintf( szText, sizeof( szText ), "%lluh%02llum%02llus", s / 3600, s / 60 % 60, s % 60 );
+		else if ( s >= 60 )
+			snprintf( szText, sizeof( szText ), "%llum%02llus", s / 60, s % 60 );
+		else
+			snprintf( szText, sizeof( szText ), "%llus", s );
+		return szText;
+	}
+};
+
+// the run's counters, and the reporting thread, started the first time they are used.
+inline stat_batch_t& stat_batch()
+{
+	static stat_batch_t batch;
+	return batch;
+}
+
+//
+// stat_files, stat_file_done
+//
+// A tool adds the files it has found to the batch, and counts each one when it is done,
+// with the bytes it read and wrote and the source pixels.
+//
+inline void stat_files( size_t count )
+{
+	if ( stat_enabled() )
+	{
+		stat_batch().uFiles += count;
+	}
+}
+
+inline void stat_file_done( bool bOK, uint64_t uBytesIn, uint64_t uBytesOut, uint64_t uPixels )
+{
+	if ( stat_enabled() )
+	{
+		stat_batch_t& batch = stat_batch();
+		batch.uBytesIn += uBytesIn;
+		batch.uBytesOut += uBytesOut;
+		batch.uPixels += uPixels;
+		batch.uFailed += bOK ? 0 : 1;
+		++batch.uDone;
+	}
+}
+
+//
+// stat_worker_t, stat_busy_t
+//
+// A thread counted as a worker, or as a busy one, for the scope. Scopes on a thread that is
+// counted already (parallel_for's calling thread, inside a worker's item) are not counted again.
+//
+template < int KIND >
+struct stat_scope_t
+{
+	stat_scope_t()
+	{
+		if ( stat_enabled() && Depth()++ == 0 )
+		{
+			++Gauge();
+		}
+	}
+
+	~stat_scope_t()
+	{
+		if ( stat_enabled() && --Depth() == 0 )
+		{
+			--Gauge();
+		}
+	}
+
+	stat_scope_t( const stat_scope_t& ) = delete;
+	stat_scope_t& operator=( const stat_scope_t& ) = delete;
+
+private:
+
+	static int& Depth()
+	{
+		static thread_local int depth = 0;
+		return depth;
+	}
+
+	static std::atomic< int64_t >& Gauge()
+	{
+		return ( KIND == 0 ) ? stat_batch().iWorkers : stat_batch().iBusy;
+	}
+};
+
+using stat_worker_t = stat_scope_t< 0 >;
+using stat_busy_t = stat_scope_t< 1 >;
+
+//
+// stat_depth_t
+//
+// A pipeline queue's share of its stage's depth and capacity. Does nothing unnamed, or without
+// FRAGMENTS_PROGRESS or FRAGMENTS_METRICS.
+//
+struct stat_depth_t
+{
+	stat_depth_t( const char* szName, size_t capacity )
+	{
+		if ( szName != nullptr && stat_enabled() )
+		{
+			pQueue = stat_batch().Queue( szName );
+			iCapacity = int64_t( capacity );
+			if ( pQueue != nullptr )
+			{
+				pQueue->iCapacity += iCapacity;
+			}
+		}
+	}
+
+	~stat_depth_t()
+	{
+		if ( pQueue != nullptr )
+		{
+			pQueue->iCapacity -= iCapacity;
+			pQueue->iDepth -= iDepth;
+		}
+	}
+
+	stat_depth_t( const stat_depth_t& ) = delete;
+	stat_depth_t& operator=( const stat_depth_t& ) = delete;
+
+	void Add( int64_t count )
+	{
+		if ( pQueue != nullptr )
+		{
+			pQueue->iDepth += count;
+			iDepth += count;
+		}
+	}
+
+private:
+
+	stat_queue_t* pQueue = nullptr;
+	int64_t iCapacity = 0;
+	int64_t iDepth = 0; // this queue's own, taken back out when it goes.
+};
+
+//=============================================================================
@@ -0,0 +1,217 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// paltask.h
+//
+// The thread cap and task helpers shared by every tool (palgen, fogpal, applypal, imgsize
+// and palpipe). Header only and C++14, so fogpal can use it too; add this folder to the
+// include path.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "palmem.h"
+#include "palstat.h"
+#include "paltrace.h"
+
+//=============================================================================
+
+//
+// task_thread_cap
+//
+// The most threads a tool uses at once: the cores, or FRAGMENTS_THREADS when that is set
+// lower, so that tools run side by side on one machine can share its cores out. Every
+// default thread count, and every -j, is held to it.
+//
+inline unsigned task_thread_cap()
+{
+	static const unsigned cap = []()
+	{
+		const unsigned cores = std::max( 1u, std::thread::hardware_concurrency() );
+
+		const char* szCap = getenv( "FRAGMENTS_THREADS" );
+		const int iCap = szCap ? atoi( szCap ) : 0;
+
+		return ( iCap > 0 ) ? std::min( cores, unsigned( iCap ) ) : cores;
+	}();
+
+	return cap;
+}
+
+//
+// parallel_for_state
+//
+// Call fn( i, state ) for each i in [ first, last ), on up to threads threads (the calling
+// thread is one of them), each taking the next i not yet started so uneven work evens out.
+// Each thread has a STATE of its own, made before its first i, for scratch memory or caches.
+// With 1 thread it all runs on the calling thread. Under FRAGMENTS_NUMA (palmem.h) the
+// threads are held to the calling thread's node, or spread over the nodes if it has none.
+// Each thread counts as a busy worker for palstat.h while it runs.
+//
+template < typename STATE, typename FN >
+inline void parallel_for_state( size_t first, size_t last, int threads, FN&& fn )
+{
+	std::atomic< size_t > next( first );
+	const int node = mem_numa_thread_node();
+
+	auto thread_fn = [&]( int t )
+	{
+		TRACE_ZONE( "parallel_for" );
+
+		stat_worker_t worker;
+		stat_busy_t busy;
+
+		if ( t > 0 )
+		{
+			mem_numa_pin( size_t( ( node >= 0 ) ? node : t ) );
+		}
+
+		STATE state;
+
+		for ( size_t i = next++; i < last; i = next++ )
+		{
+			fn( i, state );
+		}
+	};
+
+	const size_t count = ( last > first ) ? ( last - first ) : 0;
+	const int thread_count = int( std::max< size_t >( 1, std::min< size_t >( size_t( std::max( threads, 1 ) ), count ) ) );
+
+	std::vector< std::thread > aThreads;
+	for ( int t = 1; t < thread_count; ++t )
+	{
+		aThreads.emplace_back( thread_fn, t );
+	}
+
+	thread_fn( 0 );
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+}
+
+//
+// parallel_for
+//
+// parallel_for_state without the state: fn( i ).
+//
+template < typename FN >
+inline void parallel_for( size_t first, size_t last, int threads, FN&& fn )
+{
+	struct no_state_t
+	{
+	};
+
+	parallel_for_state< no_state_t >( first, last, threads, [&]( size_t i, no_state_t& ) { fn( i ); } );
+}
+
+//
+// fork_join
+//
+// Run a on a thread of its own and b on the calling thread, and return when both are done.
+//
+template < typename FA, typename FB >
+inline void fork_join( FA&& a, FB&& b )
+{
+	std::thread thread( a );
+	b();
+	thread.join();
+}
+
+//
+// bounded_queue_t
+//
+// Hands items from one pipeline stage to the next. Push waits while uCapacity items are
+// waiting, so a fast stage cannot run ahead of a slow one by more than that; Pop waits for
+// an item, and returns false once the queue is closed and empty. A queue with a name (a
+// string literal) reports its depth to palstat.h as that stage's.
+//
+template < typename T >
+struct bounded_queue_t
+{
+	explicit bounded_queue_t( size_t capacity, const char* szName = nullptr ) : uCapacity( std::max< size_t >( 1, capacity ) ), depth( szName, uCapacity )
+	{
+	}
+
+	void Push( T item )
+	{
+		std::unique_lock< std::mutex > lock( mutex );
+		cvSpace.wait( lock, [&]() { return aItems.size() < uCapacity; } );
+		aItems.push_back( std::move( item ) );
+		depth.Add( 1 );
+		cvItems.notify_one();
+	}
+
+	bool Pop( T& item )
+	{
+		std::unique_lock< std::mutex > lock( mutex );
+		cvItems.wait( lock, [&]() { return aItems.empty() == false || bClosed; } );
+
+		if ( aItems.empty() )
+		{
+			return false;
+		}
+
+		item = std::move( aItems.front() );
+		aItems.pop_front();
+		depth.Add( -1 );
+		cvSpace.notify_one();
+		return true;
+	}
+
+	// no more will be pushed; every waiting Pop returns.
+	void Close()
+	{
+		std::lock_guard< std::mutex > lock( mutex );
+		bClosed = true;
+		cvItems.notify_all();
+	}
+
+private:
+
+	const size_t uCapacity;
+	std::mutex mutex;
+	std::condition_variable cvSpace;
+	std::condition_variable cvItems;
+	std::deque< T > aItems;
+	bool bClosed = false;
+	stat_depth_t depth;
+};
+
+//=============================================================================
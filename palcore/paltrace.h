@@ -0,0 +1,184 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// paltrace.h
+//
+// TRACE_ZONE( "name" ) times the rest of the scope it is in, on the thread it runs on, to
+// see where a slow batch spends its time. It is compiled out unless a tool is built with
+// one of:
+//
+//  FRAGMENTS_TRACE   each thread keeps its zones, and at exit they are written as Chrome
+//                    trace JSON (chrome://tracing or ui.perfetto.dev), one track a thread,
+//                    to the file named by the FRAGMENTS_TRACE_FILE environment variable,
+//                    or fragments_trace.json.
+//  TRACY_ENABLE      the zones go to the Tracy profiler as it runs (add Tracy's public
+//                    folder to the include path and TracyClient.cpp to the project).
+//
+// Zone names are string literals, kept by pointer. Header only and C++14, like paltask.h.
+//
+
+#pragma once
+
+#if defined( TRACY_ENABLE )
+
+#include "tracy/Tracy.hpp"
+
+#define TRACE_ZONE( name )		ZoneScopedN( name )
+
+#elif defined( FRAGMENTS_TRACE )
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+//=============================================================================
+
+struct trace_event_t
+{
+	const char* szName;
+	uint32_t uThread;
+	int64_t iStartUs; // from the first zone of the run
+	int64_t iDurationUs;
+};
+
+//
+// trace_log_t
+//
+// The zones of every thread, handed in by trace_thread_t as its buffer fills or the thread
+// ends, and written out when the tool exits.
+//
+struct trace_log_t
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::atomic< uint32_t > uThreads{ 0 };
+	std::mutex mutex;
+	std::vector< trace_event_t > aEvents;
+
+	static trace_log_t& Get()
+	{
+		static trace_log_t log;
+		return log;
+	}
+
+	void Add( const std::vector< trace_event_t >& aThreadEvents )
+	{
+		std::lock_guard< std::mutex > lock( mutex );
+		aEvents.insert( aEvents.end(), aThreadEvents.begin(), aThreadEvents.end() );
+	}
+
+	~trace_log_t()
+	{
+		const char* szFile = getenv( "FRAGMENTS_TRACE_FILE" );
+		FILE* fp = fopen( ( szFile && szFile[ 0 ] ) ? szFile : "fragments_trace.json", "w" );
+		if ( fp == nullptr )
+		{
+			return;
+		}
+
+		fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+		for ( size_t i = 0; i < aEvents.size(); ++i )
+		{
+			const trace_event_t& event = aEvents[ i ];
+			fprintf( fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld}\n", ( i > 0 ) ? "," : "", event.szName,
+					 event.uThread, static_cast< long long >( event.iStartUs ), static_cast< long long >( event.iDurationUs ) );
+		}
+
+		fprintf( fp, "]}\n" );
+		fclose( fp );
+	}
+};
+
+//
+// trace_thread_t
+//
+// One thread's zones, numbered from 0 (the first thread to finish a zone) as its track.
+//
+struct trace_thread_t
+{
+	static constexpr size_t kFlush = 4096;
+
+	trace_log_t& log = trace_log_t::Get(); // first, so the log outlives every thread's buffer.
+	const uint32_t uThread = log.uThreads++;
+	std::vector< trace_event_t > aEvents;
+
+	static trace_thread_t& Get()
+	{
+		static thread_local trace_thread_t thread;
+		return thread;
+	}
+
+	void Add( const char* szName, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end )
+	{
+		using us_t = std::chrono::microseconds;
+		aEvents.push_back( { szName, uThread, std::chrono::duration_cast< us_t >( begin - log.start ).count(), std::chrono::duration_cast< us_t >( end - begin ).count() } );
+
+		if ( aEvents.size() >= kFlush )
+		{
+			log.Add( aEvents );
+			aEvents.clear();
+		}
+	}
+
+	~trace_thread_t()
+	{
+		log.Add( aEvents );
+	}
+};
+
+struct trace_zone_t
+{
+	const char* _szName;
+	const std::chrono::steady_clock::time_point _begin;
+
+	// the log, and with it the clock, starts at the first zone.
+	explicit trace_zone_t( const char* szName ) : _szName( szName ), _begin( ( trace_log_t::Get(), std::chrono::steady_clock::now() ) )
+	{
+	}
+
+	~trace_zone_t()
+	{
+		trace_thread_t::Get().Add( _szName, _begin, std::chrono::steady_clock::now() );
+	}
+};
+
+#define TRACE_JOIN2( a, b )		a##b
+#define TRACE_JOIN( a, b )		TRACE_JOIN2( a, b )
+#define TRACE_ZONE( name )		const trace_zone_t TRACE_JOIN( trace_zone_, __LINE__ )( name )
+
+#else
+
+#define TRACE_ZONE( name )		( void )0
+
+#endif
+
+//=============================================================================
@@ -0,0 +1,251 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palverify.h
+//
+// -verify (-verify=<file> or -verify <file>, as each tool takes its options): a hash of
+// every result as it is before it is encoded (a palette's entries, an image's indices with
+// its palette, or its RGBA), kept in a manifest, to show that a change of thread count, -cpu level or anything else that should not change the
+// outputs has not. Only the pixels and entries are hashed, so the PNG compression (or
+// -deflate) can be changed too.
+//
+// A run without the manifest there writes it. A run with it compares each result and
+// notes those that differ, or that it does not hold, and fails if any differ; delete the
+// file to record it again. Each line is "<hash> <kind> <output>", the hash 16 hex digits,
+// in order of the outputs. The hash is the same on every (little-endian) build.
+//
+// Header only and C++14, like paltask.h.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+//=============================================================================
+
+//
+// verify_hash_t
+//
+// 64-bit FNV-1a, of sizes and entries as 32-bit values and of rows a word at a time.
+//
+struct verify_hash_t
+{
+	uint64_t uHash = 0xcbf29ce484222325ULL;
+
+	void Add( uint32_t value )
+	{
+		for ( int i = 0; i < 4; ++i )
+		{
+			uHash = ( uHash ^ ( ( value >> ( i * 8 ) ) & 0xFF ) ) * 0x100000001b3ULL;
+		}
+	}
+
+	// a row of pixels or indices, or any buffer, with its size.
+	void AddData( const void* pData, size_t size )
+	{
+		const uint8_t* pBytes = static_cast< const uint8_t* >( pData );
+
+		size_t i = 0;
+		for ( ; i + 8 <= size; i += 8 )
+		{
+			uint64_t word;
+			memcpy( &word, pBytes + i, 8 );
+			uHash = ( uHash ^ word ) * 0xFF51AFD7ED558CCDULL;
+			uHash ^= uHash >> 32;
+		}
+		for ( ; i < size; ++i )
+		{
+			uHash = ( uHash ^ pBytes[ i ] ) * 0x100000001b3ULL;
+		}
+
+		Add( uint32_t( size ) );
+	}
+};
+
+//
+// verify_manifest_t
+//
+// The -verify manifest of a run. Record may be called from any thread.
+//
+struct verify_manifest_t
+{
+	struct entry_t
+	{
+		uint64_t uHash = 0;
+		std::string strKind;
+		bool bSeen = false;
+	};
+
+	// read the manifest if it is there, to compare with; false if it cannot be read.
+	bool Open( const std::string& strFile )
+	{
+		strFileName = strFile;
+		bCompare = false;
+		mapEntries.clear();
+
+		FILE* fp = fopen( strFile.c_str(), "r" );
+		if ( fp == nullptr )
+		{
+			return true; // to be written.
+		}
+
+		bCompare = true;
+
+		char szLine[ 4096 ];
+		while ( fgets( szLine, sizeof( szLine ), fp ) )
+		{
+			size_t length = strlen( szLine );
+			while ( length > 0 && ( szLine[ length - 1 ] == '\n' || szLine[ length - 1 ] == '\r' ) )
+			{
+				szLine[ --length ] = '\0';
+			}
+
+			unsigned long long hash = 0;
+			char szKind[ 32 ];
+			int consumed = 0;
+			if ( length == 0 )
+			{
+				continue;
+			}
+			if ( sscanf( szLine, "%16llx %31s %n", &hash, szKind, &consumed ) != 2 || szLine[ consumed ] == '\0' )
+			{
+				fclose( fp );
+				return false;
+			}
+
+			entry_t& entry = mapEntries[ szLine + consumed ];
+			entry.uHash = uint64_t( hash );
+			entry.strKind = szKind;
+		}
+
+		fclose( fp );
+		return true;
+	}
+
+	bool IsOpen() const
+	{
+		return strFileName.empty() == false;
+	}
+
+	// the hash of an output: kept, or compared with the manifest. Returns the line for the log.
+	std::string Record( const std::string& strOutput, const char* szKind, const verify_hash_t& hash )
+	{
+		char szHash[ 20 ];
+		snprintf( szHash, sizeof( szHash ), "%016" PRIx64, hash.uHash );
+
+		std::lock_guard< std::mutex > lock( mutex );
+
+		if ( bCompare == false )
+		{
+			entry_t& entry = mapEntries[ strOutput ];
+			entry.uHash = hash.uHash;
+			entry.strKind = szKind;
+			return "Verify: \"" + strOutput + "\" ... " + szHash + "\n";
+		}
+
+		const auto it = mapEntries.find( strOutput );
+		if ( it == mapEntries.end() )
+		{
+			++uNew;
+			return "Verify: \"" + strOutput + "\" ... NEW (" + szHash + ")\n";
+		}
+
+		it->second.bSeen = true;
+
+		if ( it->second.uHash != hash.uHash || it->second.strKind != szKind )
+		{
+			char szWas[ 20 ];
+			snprintf( szWas, sizeof( szWas ), "%016" PRIx64, it->second.uHash );
+
+			++uDiffer;
+			return "Verify: \"" + strOutput + "\" ... DIFFERS (" + szHash + ", was " + szWas + ")\n";
+		}
+
+		++uMatch;
+		return "Verify: \"" + strOutput + "\" ... OK\n";
+	}
+
+	// write the manifest, or sum up the comparison, into strLog. False if any output differed.
+	bool Close( std::string& strLog )
+	{
+		std::lock_guard< std::mutex > lock( mutex );
+
+		if ( bCompare == false )
+		{
+			const std::string strTemp = strFileName + ".tmp";
+
+			FILE* fp = fopen( strTemp.c_str(), "w" );
+			bool bOK = ( fp != nullptr );
+
+			for ( const auto& it : mapEntries )
+			{
+				bOK = bOK && fprintf( fp, "%016" PRIx64 " %s %s\n", it.second.uHash, it.second.strKind.c_str(), it.first.c_str() ) > 0;
+			}
+
+			bOK = ( fp != nullptr ) && ( fclose( fp ) == 0 ) && bOK;
+
+			remove( strFileName.c_str() );
+			bOK = bOK && ( rename( strTemp.c_str(), strFileName.c_str() ) == 0 );
+
+			strLog += "Writing verify manifest \"" + strFileName + "\" (" + std::to_string( mapEntries.size() ) + " outputs) ... " + ( bOK ? "OK\n" : "FAILED\n" );
+			return bOK;
+		}
+
+		size_t uMissing = 0;
+		for ( const auto& it : mapEntries )
+		{
+			uMissing += it.second.bSeen ? 0 : 1;
+		}
+
+		strLog += "Verified against \"" + strFileName + "\": " + std::to_string( uMatch ) + " identical, " + std::to_string( uDiffer ) + " different, "
+				+ std::to_string( uNew ) + " not in it, " + std::to_string( uMissing ) + " not made this run ... " + ( uDiffer == 0 ? "OK\n" : "FAILED\n" );
+
+		return uDiffer == 0;
+	}
+
+private:
+
+	std::string strFileName;
+	bool bCompare = false;
+	std::map< std::string, entry_t > mapEntries;
+	std::mutex mutex;
+
+	size_t uMatch = 0;
+	size_t uDiffer = 0;
+	size_t uNew = 0;
+};
+
+//=============================================================================
@@ -0,0 +1,405 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palwatch.h
+//
+// -watch, applypal staying running to remap its inputs again as they are saved. A
+// watch_folders_t watches folders, and the folders below them if asked, for files written,
+// made or renamed into them: ReadDirectoryChangesW on Windows, inotify on Linux, so
+// nothing is polled and an idle watch costs nothing. Wait returns the paths seen once the
+// changes have settled, as each folder was given followed by the rest of the path, the
+// form find_files (palfind.h) gives them in.
+//
+// The events say only that a file may have changed: an editor's save can be several, and
+// a copy its own. watch_stamp_t, the time and size of a file, is what tells whether it
+// needs remapping again.
+//
+// Header only; uses std::filesystem (C++17), like palfind.h.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <map>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================
+
+//
+// watch_stamp_t
+//
+// When a file was last written, and its size; uSize is ~0 if it isn't there.
+//
+struct watch_stamp_t
+{
+	int64_t iTime = 0;
+	uint64_t uSize = ~0ULL;
+
+	bool operator==( const watch_stamp_t& other ) const
+	{
+		return iTime == other.iTime && uSize == other.uSize;
+	}
+
+	bool operator!=( const watch_stamp_t& other ) const
+	{
+		return !( *this == other );
+	}
+};
+
+inline watch_stamp_t watch_stamp( const std::string& strFile )
+{
+	watch_stamp_t stamp;
+
+	std::error_code ec;
+	const std::filesystem::file_time_type time = std::filesystem::last_write_time( strFile, ec );
+	if ( ec )
+	{
+		return stamp;
+	}
+
+	const uintmax_t size = std::filesystem::file_size( strFile, ec );
+	if ( ec )
+	{
+		return stamp;
+	}
+
+	stamp.iTime = int64_t( time.time_since_epoch().count() );
+	stamp.uSize = uint64_t( size );
+	return stamp;
+}
+
+//
+// watch_folders_t
+//
+// The folders of a watch. Add them, then call Wait from one thread.
+//
+struct watch_folders_t
+{
+	watch_folders_t() = default;
+	watch_folders_t( const watch_folders_t& ) = delete;
+	watch_folders_t& operator=( const watch_folders_t& ) = delete;
+
+	~watch_folders_t()
+	{
+#ifdef _WIN32
+		for ( std::unique_ptr< folder_t >& folder : _aFolders )
+		{
+			CancelIoEx( folder->hFolder, &folder->overlapped );
+			DWORD dwBytes;
+			GetOverlappedResult( folder->hFolder, &folder->overlapped, &dwBytes, TRUE );
+			CloseHandle( folder->hFolder );
+			CloseHandle( folder->overlapped.hEvent );
+		}
+#else
+		if ( _fd >= 0 )
+		{
+			close( _fd );
+		}
+#endif
+	}
+
+	// watch strFolder (ending in a separator, or empty for the current folder), and the
+	// folders below it with bSubtree. False if it can't be watched.
+	bool Add( const std::string& strFolder, bool bSubtree )
+	{
+#ifdef _WIN32
+		if ( _aFolders.size() >= MAXIMUM_WAIT_OBJECTS )
+		{
+			return false;
+		}
+
+		std::unique_ptr< folder_t > folder( new folder_t );
+		folder->strPath = strFolder;
+		folder->bSubtree = bSubtree;
+		folder->hFolder = CreateFileA( strFolder.empty() ? "." : strFolder.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+									   nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr );
+		if ( folder->hFolder == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		folder->overlapped.hEvent = CreateEventA( nullptr, TRUE, FALSE, nullptr );
+		folder->aBuffer.resize( kBufferBytes / sizeof( DWORD ) );
+
+		if ( folder->overlapped.hEvent == nullptr || Read( *folder ) == false )
+		{
+			if ( folder->overlapped.hEvent != nullptr )
+			{
+				CloseHandle( folder->overlapped.hEvent );
+			}
+			CloseHandle( folder->hFolder );
+			return false;
+		}
+
+		_aFolders.push_back( std::move( folder ) );
+		return true;
+#else
+		if ( _fd < 0 )
+		{
+			_fd = inotify_init1( IN_CLOEXEC );
+			if ( _fd < 0 )
+			{
+				return false;
+			}
+		}
+
+		std::vector< std::string > aFound; // there already, so not changed
+		return AddFolder( strFolder, bSubtree, aFound );
+#endif
+	}
+
+	// wait for a change, then for uSettleMs without one, and add the paths seen to aChanged
+	// (some perhaps more than once). bLost is set if the OS dropped changes, when any of the
+	// files may have changed. False if the folders can no longer be watched.
+	bool Wait( unsigned uSettleMs, std::vector< std::string >& aChanged, bool& bLost )
+	{
+		bLost = false;
+		bool bSeen = false;
+
+#ifdef _WIN32
+		if ( _aFolders.empty() )
+		{
+			return false;
+		}
+
+		std::vector< HANDLE > aEvents;
+		for ( const std::unique_ptr< folder_t >& folder : _aFolders )
+		{
+			aEvents.push_back( folder->overlapped.hEvent );
+		}
+
+		for ( ; ; )
+		{
+			const DWORD dwWait = WaitForMultipleObjects( DWORD( aEvents.size() ), aEvents.data(), FALSE, bSeen ? DWORD( uSettleMs ) : INFINITE );
+			if ( dwWait == WAIT_TIMEOUT )
+			{
+				return true;
+			}
+
+			if ( dwWait >= WAIT_OBJECT_0 + aEvents.size() )
+			{
+				return false;
+			}
+
+			folder_t& folder = *_aFolders[ dwWait - WAIT_OBJECT_0 ];
+
+			DWORD dwBytes = 0;
+			if ( GetOverlappedResult( folder.hFolder, &folder.overlapped, &dwBytes, FALSE ) == FALSE )
+			{
+				return false;
+			}
+
+			// nothing read is a buffer that overflowed.
+			bLost |= ( dwBytes == 0 );
+
+			const uint8_t* pNext = reinterpret_cast< const uint8_t* >( folder.aBuffer.data() );
+			for ( DWORD dwOffset = ( dwBytes > 0 ) ? 1 : 0; dwOffset != 0; pNext += dwOffset )
+			{
+				const FILE_NOTIFY_INFORMATION* pInfo = reinterpret_cast< const FILE_NOTIFY_INFORMATION* >( pNext );
+				dwOffset = pInfo->NextEntryOffset;
+
+				if ( pInfo->Action == FILE_ACTION_ADDED || pInfo->Action == FILE_ACTION_MODIFIED || pInfo->Action == FILE_ACTION_RENAMED_NEW_NAME )
+				{
+					const int length = int( pInfo->FileNameLength / sizeof( WCHAR ) );
+					const int bytes = WideCharToMultiByte( CP_ACP, 0, pInfo->FileName, length, nullptr, 0, nullptr, nullptr );
+
+					std::string strName( size_t( std::max( bytes, 0 ) ), '\0' );
+					WideCharToMultiByte( CP_ACP, 0, pInfo->FileName, length, &strName[ 0 ], bytes, nullptr, nullptr );
+
+					aChanged.push_back( folder.strPath + strName );
+				}
+			}
+
+			bSeen = true;
+
+			ResetEvent( folder.overlapped.hEvent );
+			if ( Read( folder ) == false )
+			{
+				return false;
+			}
+		}
+#else
+		if ( _fd < 0 )
+		{
+			return false;
+		}
+
+		alignas( inotify_event ) char aBuffer[ kBufferBytes ];
+
+		for ( ; ; )
+		{
+			pollfd poll_fd = { _fd, POLLIN, 0 };
+			const int ready = poll( &poll_fd, 1, bSeen ? int( uSettleMs ) : -1 );
+			if ( ready == 0 )
+			{
+				return true;
+			}
+
+			const ssize_t bytes = ( ready > 0 ) ? read( _fd, aBuffer, sizeof( aBuffer ) ) : -1;
+			if ( bytes <= 0 )
+			{
+				return false;
+			}
+
+			for ( ssize_t offset = 0; offset < bytes; )
+			{
+				const inotify_event* pEvent = reinterpret_cast< const inotify_event* >( aBuffer + offset );
+				offset += sizeof( inotify_event ) + pEvent->len;
+
+				if ( pEvent->mask & IN_Q_OVERFLOW )
+				{
+					bLost = true;
+					continue;
+				}
+
+				const auto it = _mapFolders.find( pEvent->wd );
+				if ( it == _mapFolders.end() )
+				{
+					continue;
+				}
+
+				if ( pEvent->mask & IN_IGNORED )
+				{
+					_mapFolders.erase( it );
+					continue;
+				}
+
+				const std::string strPath = it->second.strPath + pEvent->name;
+
+				if ( pEvent->mask & IN_ISDIR )
+				{
+					// a new folder, of files that may have been written before it was watched.
+					if ( it->second.bSubtree && ( pEvent->mask & ( IN_CREATE | IN_MOVED_TO ) ) )
+					{
+						AddFolder( strPath + '/', true, aChanged );
+					}
+				}
+				else if ( pEvent->mask & ( IN_CLOSE_WRITE | IN_MOVED_TO ) )
+				{
+					aChanged.push_back( strPath );
+				}
+			}
+
+			bSeen = true;
+		}
+#endif
+	}
+
+private:
+
+	static constexpr size_t kBufferBytes = 64 * 1024;
+
+#ifdef _WIN32
+	struct folder_t
+	{
+		std::string strPath;
+		bool bSubtree = false;
+		HANDLE hFolder = INVALID_HANDLE_VALUE;
+		OVERLAPPED overlapped = {};
+		std::vector< DWORD > aBuffer; // DWORD aligned, as ReadDirectoryChangesW wants.
+	};
+
+	std::vector< std::unique_ptr< folder_t > > _aFolders;
+
+	static bool Read( folder_t& folder )
+	{
+		return ReadDirectoryChangesW( folder.hFolder, folder.aBuffer.data(), DWORD( folder.aBuffer.size() * sizeof( DWORD ) ), folder.bSubtree ? TRUE : FALSE,
+									  FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE, nullptr, &folder.overlapped,
+									  nullptr ) != FALSE;
+	}
+#else
+	struct folder_t
+	{
+		std::string strPath;
+		bool bSubtree = false;
+	};
+
+	int _fd = -1;
+	std::map< int, folder_t > _mapFolders; // by inotify watch
+
+	// inotify watches one folder, so a subtree is a watch for each folder in it. The files
+	// already in the folders below a new one are added to aFound.
+	bool AddFolder( const std::string& strFolder, bool bSubtree, std::vector< std::string >& aFound )
+	{
+		const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | ( bSubtree ? IN_CREATE : 0u );
+
+		const int wd = inotify_add_watch( _fd, strFolder.empty() ? "." : strFolder.c_str(), mask );
+		if ( wd < 0 )
+		{
+			return false;
+		}
+
+		_mapFolders[ wd ] = { strFolder, bSubtree };
+
+		if ( bSubtree )
+		{
+			std::error_code ec;
+			std::filesystem::directory_iterator it( strFolder.empty() ? std::filesystem::path( "." ) : std::filesystem::path( strFolder ), ec );
+
+			for ( ; !ec && it != std::filesystem::directory_iterator(); it.increment( ec ) )
+			{
+				std::error_code ec_entry;
+				const std::string strPath = strFolder + it->path().filename().string();
+
+				// not through links, which may loop, as find_files doesn't.
+				if ( it->is_directory( ec_entry ) && it->is_symlink( ec_entry ) == false )
+				{
+					AddFolder( strPath + '/', true, aFound );
+				}
+				else
+				{
+					aFound.push_back( strPath );
+				}
+			}
+		}
+
+		return true;
+	}
+#endif
+};
+
+//=============================================================================
@@ -0,0 +1,139 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palfind_test.cpp
+//
+// find_match_path against find_files: a small tree is made in the temp folder, and for
+// each wildcard every file under its folder must be matched by find_match_path exactly
+// when find_files lists it, as -watch relies on. Exits with 1 if any disagree.
+//
+
+#include "palfind.h"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+//=============================================================================
+
+int main()
+{
+	namespace fs = std::filesystem;
+
+	std::error_code ec;
+	const fs::path root = fs::temp_directory_path( ec ) / "palfind_test";
+	fs::remove_all( root, ec );
+
+	const char* const aTree[] =
+	{
+		"tree/top.png",
+		"tree/a/x.png",
+		"tree/a/y.txt",
+		"tree/a/b/z.png",
+		"tree/a/b/c/w.png",
+		"tree/a/b/c/v.PNG",
+		"tree/d/u.png",
+	};
+
+	for ( const char* szFile : aTree )
+	{
+		const fs::path file = root / szFile;
+		fs::create_directories( file.parent_path(), ec );
+		std::ofstream( file ) << szFile;
+	}
+
+	fs::current_path( root, ec );
+	if ( ec )
+	{
+		printf( "Could not make the tree in \"%s\".\n", root.string().c_str() );
+		return 1;
+	}
+
+	const char* const aWildCards[] =
+	{
+		"tree/a/**",
+		"tree/**",
+		"tree/**/*.png",
+		"tree/**/b/**",
+		"tree/a/**/c/*",
+		"tree/*/*.png",
+		"tree/?/*.txt",
+		"tree/*.png",
+		"tree/top.png",
+		"tree/a/b/c/*.PNG",
+	};
+
+	bool bOK = true;
+
+	for ( const char* szWildCard : aWildCards )
+	{
+		std::vector< std::string > aFound;
+		find_files( szWildCard, aFound, 1 );
+		const std::set< std::string > setFound( aFound.begin(), aFound.end() );
+
+		std::string strBase;
+		std::vector< std::string > aParts;
+		find_split( szWildCard, strBase, aParts );
+
+		// every file under the wildcard's folder, in the form find_files writes them.
+		size_t uMatched = 0;
+		size_t uWrong = 0;
+
+		for ( fs::recursive_directory_iterator it( strBase.empty() ? fs::path( "." ) : fs::path( strBase ), ec ), end; !ec && it != end; it.increment( ec ) )
+		{
+			if ( it->is_directory( ec ) )
+			{
+				continue;
+			}
+
+			std::string strPath = strBase;
+			for ( const fs::path& name : fs::relative( it->path(), strBase.empty() ? fs::path( "." ) : fs::path( strBase ), ec ) )
+			{
+				strPath += ( strPath.size() > strBase.size() ? std::string( 1, kFindSeparator ) : std::string() ) + name.string();
+			}
+
+			const bool bMatched = find_match_path( szWildCard, strPath );
+			uMatched += bMatched ? 1 : 0;
+
+			if ( bMatched != ( setFound.count( strPath ) != 0 ) )
+			{
+				printf( "  \"%s\": find_files %s, find_match_path %s\n", strPath.c_str(), setFound.count( strPath ) ? "lists it" : "does not",
+						bMatched ? "matches it" : "does not" );
+				++uWrong;
+			}
+		}
+
+		printf( "%-20s %zu found, %zu matched ... %s\n", szWildCard, setFound.size(), uMatched, uWrong == 0 && uMatched == setFound.size() ? "OK" : "FAILED" );
+		bOK = bOK && uWrong == 0 && uMatched == setFound.size();
+	}
+
+	fs::current_path( root.parent_path(), ec );
+	fs::remove_all( root, ec );
+
+	return bOK ? 0 : 1;
+}
@@ -0,0 +1,4 @@
+@echo off
+@setlocal enableextensions
+
+python.exe -BES %~dp0.\pngexifinfo.py %*
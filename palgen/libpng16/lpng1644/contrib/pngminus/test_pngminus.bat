@@ -0,0 +1,4 @@
+make
+call png2pnm.bat
+call pnm2png.bat
+
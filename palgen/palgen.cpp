@@ -28,46 +28,78 @@ SOFTWARE.
 //=============================================================================
 
 #include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
 #include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
 #include <set>
 #include <vector>
 #include <iostream>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
+#include <fcntl.h>
 #include <io.h>
 
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+#include "palgen.h"
+#include "palcpu.h" // run time choice of SIMD kernels, from palcore
+#include "paltrace.h" // TRACE_ZONE, compiled out unless FRAGMENTS_TRACE or TRACY_ENABLE
+#include "palfind.h" // input wildcards, with ** for every folder below
+#include "palserve.h" // -serve, jobs from stdin or a pipe
+#include "palverify.h" // -verify, hashes of the palettes made
+
+#include "png.h" // libpng
+
 #define STBI_WINDOWS_UTF8
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #define KEY_TRANSPARENT		0x00ff00ff
 
-//=============================================================================
+static constexpr size_t kConvertBlock = 256;
 
-struct color_t
-{
-	union
-	{
-		uint32_t value_abgr;
-		uint8_t chan[ 4 ]; // R, G, B, A
-	};
+// -edges=#: a pixel of the most contrast counts up to 1 + # times.
+static constexpr uint32_t kDefaultEdgeWeight = 16;
+static constexpr uint32_t kMaxEdgeWeight = 64; // the kernels take it as 16 bits.
 
-public:
-	inline uint32_t sum_rgb()
-	{
-		return (int)chan[ 0 ] + (int)chan[ 1 ] + (int)chan[ 2 ];
-	}
+// SIMD kernels. SSE2 is always present on x64; the SSSE3 and wider kernels are chosen at
+// run time by palcpu.h.
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define USE_SIMD_SSE2		1
+#include <emmintrin.h>
+#else
+#define USE_SIMD_SSE2		0
+#endif
 
-	inline void make_lum()
-	{
-		// https://en.wikipedia.org/wiki/Relative_luminance
-		const float lum = ( chan[ 0 ] * 0.299f ) + ( chan[ 1 ] * 0.587f ) + ( chan[ 2 ] * 0.114f );
-		const uint8_t g = uint8_t( std::clamp( int( round( lum ) ), 0, 255 ) );
-		chan[ 0 ] = chan[ 1 ] = chan[ 2 ] = g;
-	}
-};
+#if ( defined( _M_ARM64 ) || defined( __aarch64__ ) ) && !USE_SIMD_SSE2
+#define USE_SIMD_NEON		1
+#include <arm_neon.h>
+#else
+#define USE_SIMD_NEON		0
+#endif
+
+//=============================================================================
 
 struct sColorTotal
 {
@@ -76,6 +108,8 @@ struct sColorTotal
 	size_t _uScaledRGBA[ 4 ]; // R, G, B, A
 	size_t _uTotal;
 
+	float _fLab[ 3 ] = { 0, 0, 0 }; // L, a, b - only filled in for COLOR_SPACE_OKLAB.
+
 public:
 
 	sColorTotal( uint32_t key, size_t total )
@@ -87,757 +121,7046 @@ public:
 	{
 		_colAverage.value_abgr = key;
 
-		_uScaledRGBA[ 0 ] = _colAverage.chan[ 0 ] * total;
-		_uScaledRGBA[ 1 ] = _colAverage.chan[ 1 ] * total;
-		_uScaledRGBA[ 2 ] = _colAverage.chan[ 2 ] * total;
-		_uScaledRGBA[ 3 ] = _colAverage.chan[ 3 ] * total;
+		// R, G, B are premultiplied by alpha, so translucent colors count for less in the
+		// average. For opaque colors this is the same as a plain weighted average.
+		const size_t alpha_total = _colAverage.chan[ 3 ] * total;
+
+		_uScaledRGBA[ 0 ] = _colAverage.chan[ 0 ] * alpha_total;
+		_uScaledRGBA[ 1 ] = _colAverage.chan[ 1 ] * alpha_total;
+		_uScaledRGBA[ 2 ] = _colAverage.chan[ 2 ] * alpha_total;
+		_uScaledRGBA[ 3 ] = alpha_total;
 
 		_uTotal = total;
 	}
 
 	void GenerateAverage()
 	{
-		for ( int i = 0; i < 4; ++i )
+		for ( int i = 0; i < 3; ++i )
 		{
-			_colAverage.chan[ i ] = static_cast<uint8_t>( std::clamp< size_t >( _uScaledRGBA[ i ] / _uTotal, 0, 255 ) );
+			_colAverage.chan[ i ] = ( _uScaledRGBA[ 3 ] == 0 ) ? 0 : static_cast<uint8_t>( std::clamp< size_t >( _uScaledRGBA[ i ] / _uScaledRGBA[ 3 ], 0, 255 ) );
 		}
+
+		_colAverage.chan[ 3 ] = static_cast<uint8_t>( std::clamp< size_t >( _uScaledRGBA[ 3 ] / _uTotal, 0, 255 ) );
 	}
 };
 
-struct options_t
+// one palette of a -manifest, made from its own set of images.
+struct palette_group_t
 {
-	std::set< std::string > aInputFiles;
-
 	std::string strOutFile;
+	std::vector< std::string > aInputFiles;
+};
 
-	uint32_t uPaletteSizeReal = 256;
-	uint32_t uPaletteSizePow2 = 256;
+struct options_t : public palgen_settings_t
+{
+	std::vector< std::string > aInputFiles; // with -manifest, the union of every group's images.
 
-	bool bLuminance = false;
-	bool bForceTransp = false;
-	bool bForceOpaque = false;
+	std::string strOutFile;
+	std::string strCacheFile;
+	std::string strManifestFile;
+	std::string strPartialFile; // -partial=<file>, write the counts rather than a palette.
+
+	std::vector< palette_group_t > aGroups; // -manifest=<file>
+
+	uint32_t uInFlightMB = 256;
+	uint32_t uHistogramMB = 1024; // -histmem=#, for the workers' tables.
+
+	// -raw=<width>x<height>[,rgba]: frames of packed pixels from stdin, rather than image files.
+	int iRawWidth = 0;
+	int iRawHeight = 0;
+	int iRawChannels = 0; // 0 without -raw.
+	uint32_t uFrameSkip = 1; // -skip=#, count 1 in # frames.
+
+	// -tiles=#: that many sub-palettes of uTileColors, one per uTileSize square tile.
+	uint32_t uSubPalettes = 0; // 0 without -tiles.
+	uint32_t uTileColors = 16;
+	uint32_t uTileSize = 8;
+
+	bool bStream = true;
+	bool bGpu = false;
+	bool bMerge = false; // -merge, the inputs are -partial files.
+	bool bBenchmark = false;
+	bool bStats = false;
+	bool bServe = false; // -serve
+	std::string strServe; // -serve=<name>: the pipe or socket, or stdin if empty.
+
+	std::string strStatsFile; // -stats=<file>, JSON
+
+	std::string strVerifyFile; // -verify=<file>
+	verify_manifest_t* pVerify = nullptr; // open while the run's palettes are written.
 };
 
 typedef std::unordered_map< uint32_t, size_t > tUniqueColorMap;
 
-typedef std::vector< sColorTotal* > tColorBucket;
+typedef std::vector< std::pair< uint32_t, uint64_t > > tColorCountList; // color key, pixel count
 
-//=============================================================================
+typedef std::chrono::steady_clock tClock;
 
-static uint32_t blend_rgb( color_t a, color_t b )
+static inline double elapsed_ms( tClock::time_point start, tClock::time_point end = tClock::now() )
 {
-	color_t out;
+	return std::chrono::duration< double, std::milli >( end - start ).count();
+}
 
-	int mix;
+//
+// stats_t
+//
+// Per phase timings and counters for -stats. Decode and count times are summed over
+// the workers, so they can exceed the analysis wall time.
+//
+struct stats_t
+{
+	double fAnalyseMs = 0; // wall time, including the cache
+	double fDecodeMs = 0;
+	double fCountMs = 0;
+	double fCompactMs = 0;
+	double fReduceMs = 0;
+	double fCrushMs = 0;
+	double fRefineMs = 0;
+	double fWriteMs = 0;
+	double fTotalMs = 0;
+
+	uint64_t uFiles = 0;
+	uint64_t uPixels = 0;
+	uint64_t uUniqueColors = 0;
+	uint64_t uPeakHistogramBytes = 0;
+	uint64_t uAllocCount = 0;
+	uint64_t uAllocBytes = 0;
 
-	out.chan[ 3 ] = 0xFF;
+public:
 
-	for ( int i = 0; i < 3; ++i )
+	void Add( const stats_t& other )
 	{
-		mix = ( ( (int)a.chan[ i ] ) + ( (int)b.chan[ i ] ) ) >> 1;
-		out.chan[ i ] = static_cast<uint8_t>( mix );
+		fDecodeMs += other.fDecodeMs;
+		fCountMs += other.fCountMs;
+		uFiles += other.uFiles;
+		uPixels += other.uPixels;
 	}
-
-	return out.value_abgr;
-}
+};
 
 //
-// rgb_color_distance_squared
+// color_range_t
 //
-// Compute a 'distance' between too colors. Smaller values are closer.
+// A median cut bucket. A [begin,end) range of one contiguous sColorTotal array.
 //
-static int rgb_color_distance_squared( color_t colour1, color_t colour2 )
+struct color_range_t
 {
-	int x;
-	int delta;
+	size_t _uBegin = 0;
+	size_t _uEnd = 0;
 
-	x = static_cast<int>( colour1.chan[ 0 ] ) - static_cast<int>( colour2.chan[ 0 ] );
-	delta = x * x;
+public:
 
-	x = static_cast<int>( colour1.chan[ 1 ] ) - static_cast<int>( colour2.chan[ 1 ] );
-	delta += x * x;
+	size_t Size() const
+	{
+		return _uEnd - _uBegin;
+	}
+};
 
-	x = static_cast<int>( colour1.chan[ 2 ] ) - static_cast<int>( colour2.chan[ 2 ] );
-	delta += x * x;
+//
+// color_histogram_t
+//
+// Counts opaque pixel colors. The dense modes use a flat array of counters indexed
+// by the (optionally quantised) RGB value, so the counting pass is a shift, an or
+// and an increment per pixel. The histogram is only compacted into a list of
+// sColorTotal once all images have been counted.
+//
+// HISTOGRAM_TWO_LEVEL is a 5-5-5 cube of cells, each with its pixel count, a bit for
+// each of the 512 colors inside it that has been seen, and the exact counts of those
+// colors while there are no more than kCellColors. A busier cell keeps only its bits,
+// and compacts to every color seen with an even share of the cell's pixels: the
+// quantizer splits on the same colors as -hist=24, only their weights inside a busy
+// cell are approximate. Whether a cell overflows depends only on the set of colors in
+// it, not the order they came in, so merging the workers' histograms is deterministic.
+// It takes a fixed few MB, however many colors the images have.
+//
+// For -order=adjacent it also counts pairs of different horizontal neighbours, by
+// their exact colors (or kPairMasked for a transparent neighbour). Only pairs whose
+// hash is below a threshold are kept, and the threshold halves whenever more than
+// kPairCapacity are, so what is kept depends only on the set of pairs seen, and
+// merging workers gives the same sample in any order. Every pair kept is counted
+// exactly.
+//
+// A histogram created with bTrack lists the entries (or cells) it has counted into, so
+// that Extract, for a histogram that only ever holds one image, costs what the image
+// touched rather than a sweep and a clear of the whole table.
+//
+struct color_histogram_t
+{
 
-	return delta;
-}
+public:
 
-static void crush_palette( std::vector< color_t >& aPalette, size_t targetSize )
-{
-	while ( aPalette.size() > targetSize )
+	static constexpr uint32_t kCellBits = 5;
+	static constexpr uint32_t kCellColors = 8;
+	static constexpr uint8_t kCellOverflow = 0xFF;
+
+	static constexpr size_t kPairCapacity = 1 << 16;
+	static constexpr uint32_t kPairMasked = 1u << 24; // above every RGB key.
+
+	struct cell_t
 	{
-		struct measure_t
-		{
-			size_t index0;
-			size_t index1;
-			int best_dist;
-		};
+		size_t uTotal = 0;
+		uint64_t aSeen[ 8 ] = {}; // by the low 3 bits of R, G and B.
+		size_t aCounts[ kCellColors ] = {};
+		uint32_t aKeys[ kCellColors ] = {};
+		uint8_t uColors = 0; // or kCellOverflow.
 
-		measure_t m{ UINT32_MAX, UINT32_MAX, INT32_MAX };
+	public:
 
-		for ( size_t i = 0; i < aPalette.size(); ++i )
+		// Add count pixels of an opaque key to the exact colors, if they still fit.
+		inline void AddColor( uint32_t key, size_t count )
 		{
-			const color_t& col_i = aPalette[ i ];
+			if ( uColors == kCellOverflow )
+				return;
 
-			for ( size_t j = 0; j < aPalette.size(); ++j )
+			for ( uint32_t i = 0; i < uColors; ++i )
 			{
-				if ( i == j )
-					continue;
-
-				const color_t& col_j = aPalette[ j ];
-
-				int dist = rgb_color_distance_squared( col_i, col_j );
-				if ( dist <= m.best_dist )
+				if ( aKeys[ i ] == key )
 				{
-					m.index0 = i;
-					m.index1 = j;
-					m.best_dist = dist;
+					aCounts[ i ] += count;
+					return;
 				}
 			}
-		}
 
-		std::vector< color_t > aNewPal;
-
-		for ( size_t i = 0; i < aPalette.size(); ++i )
-		{
-			if ( i == m.index0 || i == m.index1 )
-				continue;
+			if ( uColors == kCellColors )
+			{
+				uColors = kCellOverflow;
+				return;
+			}
 
-			aNewPal.push_back( aPalette[ i ] );
+			aKeys[ uColors ] = key;
+			aCounts[ uColors ] = count;
+			++uColors;
 		}
+	};
 
-		aNewPal.push_back( color_t( blend_rgb( aPalette[ m.index0 ], aPalette[ m.index1 ] ) ) );
-
-		std::swap( aPalette, aNewPal );
-	}
-}
-
-//
-// next_power_two
-//
-// Returns the closest power-of-two number greater or equal
-// to n for the given (unsigned) integer n.
-// Will return 0 when n = 0, 1 when n = 1.
-//
-static constexpr uint32_t next_power_two( uint32_t n )
-{
-	--n;
-	n |= n >> 16;
-	n |= n >> 8;
-	n |= n >> 4;
-	n |= n >> 2;
-	n |= n >> 1;
-	++n;
-	return n;
-}
-
-//
-// print_hello
-//
-// Print hello text
-//
-static void print_hello()
-{
-	printf( "\n------------------------------------------------------------------\n"
-			" Palette Generator (c) David Walters. See LICENSE.txt for details\n"
-			"------------------------------------------------------------------\n\n" );
-}
-
-//
-// print_help
-//
-// Print help text
-//
-static void print_help()
-{
-	// Usage
-	printf( " USAGE: palgen.exe [-?] [-count=#] [-lum] [-transp] [-opaque] <image>[...] -o <palette>\n" );
-	putchar( '\n' );
+	std::vector< size_t > _aCounts;
+	tUniqueColorMap _mapCounts;
+	std::vector< cell_t > _aCells; // HISTOGRAM_TWO_LEVEL
+	std::unordered_map< uint64_t, uint64_t > _mapPairs; // -order=adjacent
+	uint64_t _uPairThreshold = UINT64_MAX;
+	std::vector< uint32_t > _aTouched; // bTrack: indices into _aCounts or _aCells, in the order first counted.
 
-	// Options
-	printf( "  -?                This help.\n" );
-	printf( "  -count=#          Set the palette size. [Default=256]\n" );
-	printf( "  -lum              Apply rgb-to-luminance pre-filter to all inputs.\n" );
-	printf( "  -transp           Always make index 0 transparent.\n" );
-	printf( "  -opaque           Ignore transparent pixels.\n" );
-	putchar( '\n' );
-	printf( "  <image>           Source image(s), wildcards supported.\n" );
-	putchar( '\n' );
-	printf( "  -o <palette>      Filename of output palette.\n" );
-	putchar( '\n' );
+	histogram_t _mode = HISTOGRAM_MAP;
+	bool _bDense = false;
+	bool _bCells = false;
+	bool _bAlpha = false; // keep translucent pixels, keyed by RGBA. Always a map.
+	bool _bPairs = false;
+	bool _bTrack = false;
 
-	putchar( '\n' );
-}
+	uint32_t _uBits[ 3 ] = { 8, 8, 8 }; // R, G, B
+	uint32_t _uShiftR = 16;
+	uint32_t _uShiftG = 8;
 
-//
-// add_files_wildcard
-//
-// Add a file to an array. Supports wildcards like *.png, so multiple files may be added.
-//
-static void add_files_wildcard( const char* szWildCard, std::set< std::string >& aFiles )
-{
-	// printf( "scan input %s\n", szWildCard );
+public:
 
-	// split argument into path and file.
-	std::string path = szWildCard;
-	size_t slash_find = path.find_last_of( "/\\", path.npos ); // either kind of path separators
-	if ( slash_find == path.npos )
+	//
+	// TableBytes
+	//
+	// The fixed size of the table a histogram of this mode allocates, or 0 for a map,
+	// which only grows with the colors counted.
+	//
+	static size_t TableBytes( histogram_t mode, bool bAlpha )
 	{
-		path.clear();
+		if ( bAlpha )
+			return 0;
+
+		switch ( mode )
+		{
+			case HISTOGRAM_RGB24: return sizeof( size_t ) << 24;
+			case HISTOGRAM_RGB18: return sizeof( size_t ) << 18;
+			case HISTOGRAM_RGB16: return sizeof( size_t ) << 16;
+			case HISTOGRAM_RGB15: return sizeof( size_t ) << 15;
+			case HISTOGRAM_TWO_LEVEL: return sizeof( cell_t ) << ( kCellBits * 3 );
+			default: return 0;
+		}
 	}
-	else
+
+	void Create( histogram_t mode, bool bAlpha = false, bool bPairs = false, bool bTrack = false )
 	{
-		path = path.substr( 0, slash_find + 1 );
-		// printf( "from path %s\n", path.c_str() );
-	}
+		if ( bAlpha )
+		{
+			mode = HISTOGRAM_MAP; // the dense tables have no alpha.
+		}
 
-	struct _finddata_t fileinfo;
+		_mode = mode;
+		_bDense = ( mode != HISTOGRAM_MAP && mode != HISTOGRAM_TWO_LEVEL );
+		_bCells = ( mode == HISTOGRAM_TWO_LEVEL );
+		_bAlpha = bAlpha;
 
-	// Start the search
-	intptr_t handle = _findfirst( szWildCard, &fileinfo );
-	if ( handle != -1L )
-	{
-		do
+		switch ( mode )
 		{
-			// A file, not a sub-directory?
-			if ( !( fileinfo.attrib & _A_SUBDIR ) )
-			{
-				std::string filepath;
-				filepath = path + fileinfo.name;
 
-				// printf( "found %s\n", filepath.c_str() );
+		default:
+		case HISTOGRAM_MAP:
+		case HISTOGRAM_RGB24:
+			_uBits[ 0 ] = 8; _uBits[ 1 ] = 8; _uBits[ 2 ] = 8;
+			break;
 
-				aFiles.insert( filepath );
-			}
-		}
-		while ( _findnext( handle, &fileinfo ) == 0 ); // Get the next one
+		case HISTOGRAM_RGB18:
+			_uBits[ 0 ] = 6; _uBits[ 1 ] = 6; _uBits[ 2 ] = 6;
+			break;
 
-		_findclose( handle );
-	}
-}
+		case HISTOGRAM_RGB16:
+			_uBits[ 0 ] = 5; _uBits[ 1 ] = 6; _uBits[ 2 ] = 5;
+			break;
 
-//
-// process_args
-//
-// Process command line arguments
-//
-static bool process_args( int argc, char** argv, options_t& options )
-{
-	// Command Line State
-	bool bNextArgIsOutput = false;
+		case HISTOGRAM_RGB15:
+			_uBits[ 0 ] = 5; _uBits[ 1 ] = 5; _uBits[ 2 ] = 5;
+			break;
 
-	// Parse Command Line
-	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
-	{
-		const char* szArg = argv[ iarg ];
+		}; // switch ( mode )
 
-		if ( bNextArgIsOutput )
+		_uShiftG = _uBits[ 2 ];
+		_uShiftR = _uBits[ 1 ] + _uBits[ 2 ];
+
+		_mapCounts.clear();
+		_aCounts.clear();
+		_aCells.clear();
+		_mapPairs.clear();
+		_uPairThreshold = UINT64_MAX;
+		_aTouched.clear();
+		_bPairs = bPairs;
+		_bTrack = bTrack;
+
+		if ( _bDense )
 		{
-			bNextArgIsOutput = false;
-			options.strOutFile = szArg;
+			_aCounts.resize( size_t( 1 ) << ( _uBits[ 0 ] + _uBits[ 1 ] + _uBits[ 2 ] ), 0 );
 		}
-		else if ( strncmp( szArg, "-count=", 7 ) == 0 )
+		else if ( _bCells )
 		{
-			int iSize = atoi( szArg + 7 );
+			_aCells.resize( size_t( 1 ) << ( kCellBits * 3 ) );
+		}
+	}
 
-			if ( iSize <= 2 )
+	inline void Add( color_t col )
+	{
+		if ( _bDense )
+		{
+			const uint32_t index = ( uint32_t( col.chan[ 0 ] >> ( 8 - _uBits[ 0 ] ) ) << _uShiftR )
+								 | ( uint32_t( col.chan[ 1 ] >> ( 8 - _uBits[ 1 ] ) ) << _uShiftG )
+								 | ( uint32_t( col.chan[ 2 ] >> ( 8 - _uBits[ 2 ] ) ) );
+
+			if ( _bTrack && _aCounts[ index ] == 0 )
 			{
-				printf( "Error - invalid palette size (%d).\n", iSize );
-				return false;
+				_aTouched.push_back( index );
 			}
 
-			options.uPaletteSizeReal = iSize;
-			options.uPaletteSizePow2 = next_power_two( iSize );
+			_aCounts[ index ]++;
 		}
-		else if ( _stricmp( szArg, "-?" ) == 0 )
-		{
-			return false;
-		}
-		else if ( _stricmp( szArg, "-o" ) == 0 )
+		else if ( _bCells )
 		{
-			bNextArgIsOutput = true;
+			AddCell( col, 1 );
 		}
-		else if ( _stricmp( szArg, "-lum" ) == 0 )
+		else
 		{
-			options.bLuminance = true;
+			_mapCounts[ col.value_abgr ]++;
 		}
-		else if ( _stricmp( szArg, "-transp" ) == 0 )
+	}
+
+	inline void Add( color_t col, size_t count )
+	{
+		if ( _bDense )
 		{
-			options.bForceTransp = true;
+			const uint32_t index = ( uint32_t( col.chan[ 0 ] >> ( 8 - _uBits[ 0 ] ) ) << _uShiftR )
+								 | ( uint32_t( col.chan[ 1 ] >> ( 8 - _uBits[ 1 ] ) ) << _uShiftG )
+								 | ( uint32_t( col.chan[ 2 ] >> ( 8 - _uBits[ 2 ] ) ) );
+
+			if ( _bTrack && _aCounts[ index ] == 0 && count != 0 )
+			{
+				_aTouched.push_back( index );
+			}
+
+			_aCounts[ index ] += count;
 		}
-		else if ( _stricmp( szArg, "-opaque" ) == 0 )
+		else if ( _bCells )
 		{
-			options.bForceOpaque = true;
+			AddCell( col, count );
 		}
 		else
 		{
-			add_files_wildcard( szArg, options.aInputFiles );
+			_mapCounts[ col.value_abgr ] += count;
 		}
-
-	}; // for each command line argument
-
-	if ( options.aInputFiles.empty() )
-	{
-		printf( "Error - no input file(s) specified.\n" );
-		return false;
 	}
 
-	if ( options.strOutFile.empty() )
+	inline void AddCell( color_t col, size_t count )
 	{
-		printf( "Error - no output file specified.\n" );
-		return false;
-	}
+		const uint32_t index = ( uint32_t( col.chan[ 0 ] >> ( 8 - kCellBits ) ) << ( kCellBits * 2 ) )
+							 | ( uint32_t( col.chan[ 1 ] >> ( 8 - kCellBits ) ) << kCellBits )
+							 | ( uint32_t( col.chan[ 2 ] >> ( 8 - kCellBits ) ) );
 
-	return true;
-}
+		const uint32_t sub = ( uint32_t( col.chan[ 0 ] & 7 ) << 6 ) | ( uint32_t( col.chan[ 1 ] & 7 ) << 3 ) | uint32_t( col.chan[ 2 ] & 7 );
 
-//
-// write_hexfile
-//
-// Dump the whole palette to disk in .hex format.
-//
-static void write_hexfile( std::vector< color_t >& aPalette, const std::string& strFileName )
-{
-	char buf[ 64 ];
+		cell_t& cell = _aCells[ index ];
 
-	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+		if ( _bTrack && cell.uTotal == 0 && count != 0 )
+		{
+			_aTouched.push_back( index );
+		}
 
-	std::ofstream file( strFileName );
-	if ( file.is_open() )
+		cell.uTotal += count;
+		cell.aSeen[ sub >> 6 ] |= uint64_t( 1 ) << ( sub & 63 );
+		cell.AddColor( col.value_abgr | 0xFF000000, count );
+	}
+
+	//
+	// AddPair
+	//
+	// Count two neighbouring pixels, by RGB key or kPairMasked, if the pair is sampled.
+	//
+	inline void AddPair( uint32_t key1, uint32_t key2 )
 	{
-		for ( uint32_t i = 0; i < aPalette.size(); ++i )
-		{
-			// read BGRA palette entry and convert to RGB
+		if ( key1 == key2 )
+			return;
 
-			const color_t& pal = aPalette[ i ];
-			uint32_t cout;
-			cout = pal.chan[ 0 ] << 16;
-			cout |= pal.chan[ 1 ] << 8;
-			cout |= pal.chan[ 2 ];
+		const uint64_t pair = ( key1 < key2 ) ? ( ( uint64_t( key1 ) << 25 ) | key2 ) : ( ( uint64_t( key2 ) << 25 ) | key1 );
 
-			// .hex palette file format
-			sprintf_s( buf, sizeof( buf ), "%06x\n", cout );
+		if ( PairHash( pair ) >= _uPairThreshold )
+			return;
 
-			file << buf;
-		}
+		++_mapPairs[ pair ];
 
-		file.close();
-		printf( "OK\n\n" );
+		if ( _mapPairs.size() > kPairCapacity )
+		{
+			ShrinkPairs();
+		}
 	}
-	else
+
+	static inline uint64_t PairHash( uint64_t x )
 	{
-		printf( "FAILED\n\n" );
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
 	}
-}
-
 
-static void count_unique_image_lum_3ch( uint8_t* data, int width, int height, tUniqueColorMap& col_counts )
-{
-	for ( int y = 0; y < height; ++y )
+	// Halve the threshold until the sampled pairs fit again.
+	void ShrinkPairs()
 	{
-		for ( int x = 0; x < width; ++x )
+		while ( _mapPairs.size() > kPairCapacity )
 		{
-			color_t col;
-			col.chan[ 0 ] = data[ 0 ];
-			col.chan[ 1 ] = data[ 1 ];
-			col.chan[ 2 ] = data[ 2 ];
-			col.chan[ 3 ] = 0xFF;
+			_uPairThreshold >>= 1;
 
-			col.make_lum();
+			for ( auto it = _mapPairs.begin(); it != _mapPairs.end(); )
+			{
+				if ( PairHash( it->first ) >= _uPairThreshold )
+					it = _mapPairs.erase( it );
+				else
+					++it;
+			}
+		}
+	}
 
-			data += 3;
+	//
+	// Merge
+	//
+	// Add the counts of another histogram (of the same mode) into this one.
+	//
+	void Merge( const color_histogram_t& other )
+	{
+		if ( _bPairs && other._bPairs )
+		{
+			MergePairs( other );
+		}
 
-			// Add to the map
-			col_counts[ col.value_abgr ]++;
+		if ( _bDense )
+		{
+			for ( size_t i = 0; i < _aCounts.size(); ++i )
+			{
+				_aCounts[ i ] += other._aCounts[ i ];
+			}
 		}
-	}
-}
+		else if ( _bCells )
+		{
+			for ( size_t i = 0; i < _aCells.size(); ++i )
+			{
+				MergeCell( _aCells[ i ], other._aCells[ i ] );
+			}
+		}
+		else
+		{
+			for ( const auto& [key, value] : other._mapCounts )
+			{
+				_mapCounts[ key ] += value;
+			}
+		}
+	}
+
+	//
+	// Drain
+	//
+	// Add the counts of a bTrack histogram (of the same mode) into this one, and leave
+	// it empty, at the cost of the entries it counted rather than the size of the table.
+	//
+	void Drain( color_histogram_t& other )
+	{
+		if ( _bPairs && other._bPairs )
+		{
+			MergePairs( other );
+
+			// pairs above this threshold would be dropped here anyway.
+			other._mapPairs.clear();
+			other._uPairThreshold = _uPairThreshold;
+		}
+
+		if ( _bDense )
+		{
+			for ( uint32_t index : other._aTouched )
+			{
+				_aCounts[ index ] += other._aCounts[ index ];
+				other._aCounts[ index ] = 0;
+			}
+		}
+		else if ( _bCells )
+		{
+			for ( uint32_t index : other._aTouched )
+			{
+				MergeCell( _aCells[ index ], other._aCells[ index ] );
+				other._aCells[ index ] = cell_t();
+			}
+		}
+		else
+		{
+			for ( const auto& [key, value] : other._mapCounts )
+			{
+				_mapCounts[ key ] += value;
+			}
+			other._mapCounts.clear();
+		}
+
+		other._aTouched.clear();
+	}
+
+	//
+	// Clear
+	//
+	// Drop every count, for a bTrack histogram at the cost of the entries it counted.
+	//
+	void Clear()
+	{
+		if ( _bTrack )
+		{
+			for ( uint32_t index : _aTouched )
+			{
+				if ( _bDense )
+					_aCounts[ index ] = 0;
+				else
+					_aCells[ index ] = cell_t();
+			}
+		}
+		else
+		{
+			std::fill( _aCounts.begin(), _aCounts.end(), 0 );
+			std::fill( _aCells.begin(), _aCells.end(), cell_t() );
+		}
+
+		_aTouched.clear();
+		_mapCounts.clear();
+		_mapPairs.clear();
+		_uPairThreshold = UINT64_MAX;
+	}
+
+	//
+	// Compact
+	//
+	// Transfer every non-empty entry into a flat list of color totals.
+	// Quantised entries are expanded back to 8-bit channels by bit replication.
+	//
+	void Compact( std::vector< sColorTotal >& aColors ) const
+	{
+		aColors.clear();
+
+		if ( _bCells )
+		{
+			for ( size_t index = 0; index < _aCells.size(); ++index )
+			{
+				if ( _aCells[ index ].uTotal != 0 )
+				{
+					CompactCell( index, aColors );
+				}
+			}
+			return;
+		}
+
+		if ( _bDense == false )
+		{
+			aColors.reserve( _mapCounts.size() );
+			for ( const auto& [key, value] : _mapCounts )
+			{
+				aColors.emplace_back( key, value );
+			}
+
+			// hash order depends on insertion history. Sort, to be reproducible.
+			std::sort( aColors.begin(), aColors.end(), []( const sColorTotal& t1, const sColorTotal& t2 )
+					   {
+						   return t1._colAverage.value_abgr < t2._colAverage.value_abgr;
+					   } );
+			return;
+		}
+
+		for ( size_t index = 0; index < _aCounts.size(); ++index )
+		{
+			const size_t total = _aCounts[ index ];
+
+			if ( total == 0 )
+				continue;
+
+			aColors.emplace_back( DenseKey( uint32_t( index ) ), total );
+		}
+	}
+
+	//
+	// CompactCell
+	//
+	// Append the colors of one non-empty cell, in key order.
+	//
+	void CompactCell( size_t index, std::vector< sColorTotal >& aColors ) const
+	{
+		const cell_t& cell = _aCells[ index ];
+
+		if ( cell.uColors != kCellOverflow )
+		{
+			const size_t uFirst = aColors.size();
+
+			for ( uint32_t c = 0; c < cell.uColors; ++c )
+			{
+				aColors.emplace_back( cell.aKeys[ c ], cell.aCounts[ c ] );
+			}
+
+			std::sort( aColors.begin() + uFirst, aColors.end(), []( const sColorTotal& t1, const sColorTotal& t2 )
+					   {
+						   return t1._colAverage.value_abgr < t2._colAverage.value_abgr;
+					   } );
+			return;
+		}
+
+		// every color seen, in key order, sharing out the cell's pixels.
+		size_t uSeen = 0;
+		for ( int w = 0; w < 8; ++w )
+		{
+			uSeen += std::bitset< 64 >( cell.aSeen[ w ] ).count();
+		}
+
+		const size_t uShare = cell.uTotal / uSeen;
+		size_t uExtra = cell.uTotal % uSeen;
+
+		const uint32_t r0 = uint32_t( index >> ( kCellBits * 2 ) ) << 3;
+		const uint32_t g0 = uint32_t( ( index >> kCellBits ) & ( ( 1u << kCellBits ) - 1 ) ) << 3;
+		const uint32_t b0 = uint32_t( index & ( ( 1u << kCellBits ) - 1 ) ) << 3;
+
+		for ( uint32_t b = 0; b < 8; ++b )
+		{
+			for ( uint32_t g = 0; g < 8; ++g )
+			{
+				for ( uint32_t r = 0; r < 8; ++r )
+				{
+					const uint32_t sub = ( r << 6 ) | ( g << 3 ) | b;
+					if ( ( cell.aSeen[ sub >> 6 ] >> ( sub & 63 ) ) & 1 )
+					{
+						color_t col;
+						col.chan[ 0 ] = uint8_t( r0 + r );
+						col.chan[ 1 ] = uint8_t( g0 + g );
+						col.chan[ 2 ] = uint8_t( b0 + b );
+						col.chan[ 3 ] = 0xFF;
+
+						aColors.emplace_back( col.value_abgr, uShare + ( uExtra > 0 ? 1 : 0 ) );
+						uExtra -= ( uExtra > 0 ) ? 1 : 0;
+					}
+				}
+			}
+		}
+	}
+
+	//
+	// MergeCounts
+	//
+	// Add an array of 32-bit counters, in the same layout as _aCounts, to a dense histogram.
+	//
+	void MergeCounts( const uint32_t* pCounts, size_t uCount )
+	{
+		uCount = std::min( uCount, _aCounts.size() );
+
+		for ( size_t i = 0; i < uCount; ++i )
+		{
+			_aCounts[ i ] += pCounts[ i ];
+		}
+	}
+
+	//
+	// MemoryBytes
+	//
+	// Approximate memory held by the counters.
+	//
+	size_t MemoryBytes() const
+	{
+		const size_t uPairs = _mapPairs.bucket_count() * sizeof( void* ) + _mapPairs.size() * ( sizeof( std::pair< const uint64_t, uint64_t > ) + sizeof( void* ) );
+
+		if ( _bDense )
+		{
+			return uPairs + _aCounts.capacity() * sizeof( size_t );
+		}
+
+		if ( _bCells )
+		{
+			return uPairs + _aCells.capacity() * sizeof( cell_t );
+		}
+
+		// buckets, plus one node (key, value and next pointer) per entry.
+		return uPairs + _mapCounts.bucket_count() * sizeof( void* ) + _mapCounts.size() * ( sizeof( tUniqueColorMap::value_type ) + sizeof( void* ) );
+	}
+
+	//
+	// Extract
+	//
+	// Move every non-empty entry into a list of color keys and counts, leaving
+	// the histogram empty (ready to count the next image). Keys are the same expanded
+	// colors that Compact produces, so Add( key, count ) restores the same entries.
+	// (Not for HISTOGRAM_TWO_LEVEL, where a busy cell has lost its counts.)
+	//
+	void Extract( tColorCountList& aCounts )
+	{
+		aCounts.clear();
+
+		if ( _bCells )
+		{
+			std::vector< sColorTotal > aColors;
+
+			if ( _bTrack )
+			{
+				for ( uint32_t index : _aTouched )
+				{
+					CompactCell( index, aColors );
+					_aCells[ index ] = cell_t();
+				}
+				_aTouched.clear();
+			}
+			else
+			{
+				Compact( aColors );
+				std::fill( _aCells.begin(), _aCells.end(), cell_t() );
+			}
+
+			for ( const sColorTotal& total : aColors )
+			{
+				aCounts.emplace_back( total._colAverage.value_abgr, total._uTotal );
+			}
+
+			std::sort( aCounts.begin(), aCounts.end() );
+			return;
+		}
+
+		if ( _bDense == false )
+		{
+			aCounts.assign( _mapCounts.begin(), _mapCounts.end() );
+			_mapCounts.clear();
+
+			std::sort( aCounts.begin(), aCounts.end() );
+			return;
+		}
+
+		if ( _bTrack )
+		{
+			// in index order, as Compact gives them.
+			std::sort( _aTouched.begin(), _aTouched.end() );
+
+			aCounts.reserve( _aTouched.size() );
+			for ( uint32_t index : _aTouched )
+			{
+				aCounts.emplace_back( DenseKey( index ), _aCounts[ index ] );
+				_aCounts[ index ] = 0;
+			}
+
+			_aTouched.clear();
+			return;
+		}
+
+		std::vector< sColorTotal > aColors;
+		Compact( aColors );
+
+		aCounts.reserve( aColors.size() );
+		for ( const sColorTotal& total : aColors )
+		{
+			aCounts.emplace_back( total._colAverage.value_abgr, total._uTotal );
+		}
+
+		std::fill( _aCounts.begin(), _aCounts.end(), 0 );
+	}
+
+private:
+
+	void MergePairs( const color_histogram_t& other )
+	{
+		_uPairThreshold = std::min( _uPairThreshold, other._uPairThreshold );
+
+		for ( const auto& [pair, count] : other._mapPairs )
+		{
+			if ( PairHash( pair ) < _uPairThreshold )
+			{
+				_mapPairs[ pair ] += count;
+			}
+		}
+
+		for ( auto it = _mapPairs.begin(); it != _mapPairs.end(); )
+		{
+			if ( PairHash( it->first ) >= _uPairThreshold )
+				it = _mapPairs.erase( it );
+			else
+				++it;
+		}
+
+		ShrinkPairs();
+	}
+
+	static void MergeCell( cell_t& cell, const cell_t& from )
+	{
+		cell.uTotal += from.uTotal;
+
+		for ( int w = 0; w < 8; ++w )
+		{
+			cell.aSeen[ w ] |= from.aSeen[ w ];
+		}
+
+		if ( from.uColors == kCellOverflow )
+		{
+			cell.uColors = kCellOverflow;
+			return;
+		}
+
+		for ( uint32_t c = 0; c < from.uColors; ++c )
+		{
+			cell.AddColor( from.aKeys[ c ], from.aCounts[ c ] );
+		}
+	}
+
+	// The expanded, opaque color key of a dense index.
+	uint32_t DenseKey( uint32_t index ) const
+	{
+		const uint32_t maskR = ( 1u << _uBits[ 0 ] ) - 1;
+		const uint32_t maskG = ( 1u << _uBits[ 1 ] ) - 1;
+		const uint32_t maskB = ( 1u << _uBits[ 2 ] ) - 1;
+
+		color_t col;
+		col.chan[ 0 ] = expand_bits( ( index >> _uShiftR ) & maskR, _uBits[ 0 ] );
+		col.chan[ 1 ] = expand_bits( ( index >> _uShiftG ) & maskG, _uBits[ 1 ] );
+		col.chan[ 2 ] = expand_bits( index & maskB, _uBits[ 2 ] );
+		col.chan[ 3 ] = 0xFF;
+
+		return col.value_abgr;
+	}
+
+	static uint8_t expand_bits( uint32_t value, uint32_t bits )
+	{
+		if ( bits >= 8 )
+			return uint8_t( value );
+
+		// replicate the top bits into the vacated low bits, so 0 -> 0x00 and max -> 0xFF.
+		uint32_t out = value << ( 8 - bits );
+		out |= out >> bits;
+		return uint8_t( out );
+	}
+};
+
+//=============================================================================
+
+struct png_memory_t
+{
+	const uint8_t* pData;
+	size_t uSize;
+	size_t uOffset;
+};
+
+static void png_read_data_fn( png_structp png_ptr, png_bytep p_data, png_size_t size )
+{
+	// Get our memory source, and copy data from it.
+	png_memory_t* p_mem = reinterpret_cast<png_memory_t*>( png_get_io_ptr( png_ptr ) );
+	if ( size > p_mem->uSize - p_mem->uOffset )
+	{
+		png_error( png_ptr, "unexpected end of file" );
+	}
+
+	memcpy( p_data, p_mem->pData + p_mem->uOffset, size );
+	p_mem->uOffset += size;
+}
+
+// The error pointer is the file's log, as the workers decode at the same time.
+static void png_error_fn( png_structp png_ptr, png_const_charp error_message )
+{
+	std::string& strLog = *static_cast<std::string*>( png_get_error_ptr( png_ptr ) );
+	strLog += "png error: " + std::string( error_message ) + " ... ";
+	png_longjmp( png_ptr, -1 );
+}
+
+static void png_warn_fn( png_structp png_ptr, png_const_charp error_message )
+{
+	std::string& strLog = *static_cast<std::string*>( png_get_error_ptr( png_ptr ) );
+	strLog += "png warning: " + std::string( error_message ) + " ... ";
+}
+
+//=============================================================================
+
+//
+// srgb_to_linear_table
+//
+// sRGB channel value to linear light, for all 256 values. Built once.
+//
+static const float* srgb_to_linear_table()
+{
+	static const std::vector< float > table = []()
+	{
+		std::vector< float > t( 256 );
+		for ( int i = 0; i < 256; ++i )
+		{
+			const double c = i / 255.0;
+			t[ i ] = static_cast<float>( ( c <= 0.04045 ) ? ( c / 12.92 ) : std::pow( ( c + 0.055 ) / 1.055, 2.4 ) );
+		}
+		return t;
+	}();
+
+	return table.data();
+}
+
+//
+// rgb_to_oklab_block
+//
+// Convert a block of colors to Oklab (https://bottosson.github.io/posts/oklab/).
+// The gamma step is a table lookup, and the two matrix steps run over whole arrays
+// so the compiler can vectorise them; only the cube root is done per channel.
+//
+static void rgb_to_oklab_block( const color_t* pColors, float ( *pLab )[ 3 ], size_t count )
+{
+	const float* lut = srgb_to_linear_table();
+
+	float r[ kConvertBlock ], g[ kConvertBlock ], b[ kConvertBlock ];
+	float l[ kConvertBlock ], m[ kConvertBlock ], s[ kConvertBlock ];
+
+	while ( count > 0 )
+	{
+		const size_t n = std::min( count, kConvertBlock );
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			r[ i ] = lut[ pColors[ i ].chan[ 0 ] ];
+			g[ i ] = lut[ pColors[ i ].chan[ 1 ] ];
+			b[ i ] = lut[ pColors[ i ].chan[ 2 ] ];
+		}
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			l[ i ] = 0.4122214708f * r[ i ] + 0.5363325363f * g[ i ] + 0.0514459929f * b[ i ];
+			m[ i ] = 0.2119034982f * r[ i ] + 0.6806995451f * g[ i ] + 0.1073969566f * b[ i ];
+			s[ i ] = 0.0883024619f * r[ i ] + 0.2817188376f * g[ i ] + 0.6299787005f * b[ i ];
+		}
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			l[ i ] = std::cbrt( l[ i ] );
+			m[ i ] = std::cbrt( m[ i ] );
+			s[ i ] = std::cbrt( s[ i ] );
+		}
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			pLab[ i ][ 0 ] = 0.2104542553f * l[ i ] + 0.7936177850f * m[ i ] - 0.0040720468f * s[ i ];
+			pLab[ i ][ 1 ] = 1.9779984951f * l[ i ] - 2.4285922050f * m[ i ] + 0.4505937099f * s[ i ];
+			pLab[ i ][ 2 ] = 0.0259040371f * l[ i ] + 0.7827717662f * m[ i ] - 0.8086757660f * s[ i ];
+		}
+
+		pColors += n;
+		pLab += n;
+		count -= n;
+	}
+}
+
+//
+// convert_colors_oklab
+//
+// Fill in _fLab for every color in the list.
+//
+static void convert_colors_oklab( std::vector< sColorTotal >& aColors )
+{
+	color_t block[ kConvertBlock ];
+	float lab[ kConvertBlock ][ 3 ];
+
+	for ( size_t first = 0; first < aColors.size(); first += kConvertBlock )
+	{
+		const size_t n = std::min( aColors.size() - first, kConvertBlock );
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			block[ i ] = aColors[ first + i ]._colAverage;
+		}
+
+		rgb_to_oklab_block( block, lab, n );
+
+		for ( size_t i = 0; i < n; ++i )
+		{
+			memcpy( aColors[ first + i ]._fLab, lab[ i ], sizeof( lab[ i ] ) );
+		}
+	}
+}
+
+//
+// rgb_color_distance_squared
+//
+// Compute a 'distance' between too colors. Smaller values are closer.
+// Alpha is included, and is zero for opaque colors.
+//
+static int rgb_color_distance_squared( color_t colour1, color_t colour2 )
+{
+	int x;
+	int delta;
+
+	x = static_cast<int>( colour1.chan[ 0 ] ) - static_cast<int>( colour2.chan[ 0 ] );
+	delta = x * x;
+
+	x = static_cast<int>( colour1.chan[ 1 ] ) - static_cast<int>( colour2.chan[ 1 ] );
+	delta += x * x;
+
+	x = static_cast<int>( colour1.chan[ 2 ] ) - static_cast<int>( colour2.chan[ 2 ] );
+	delta += x * x;
+
+	x = static_cast<int>( colour1.chan[ 3 ] ) - static_cast<int>( colour2.chan[ 3 ] );
+	delta += x * x;
+
+	return delta;
+}
+
+//
+// color_distance
+//
+// Squared distance between two colors in the given space.
+// For Oklab both colors must have _fLab filled in.
+//
+static float color_distance( const sColorTotal& t1, const sColorTotal& t2, color_space_t space )
+{
+	if ( space == COLOR_SPACE_OKLAB )
+	{
+		const float dl = t1._fLab[ 0 ] - t2._fLab[ 0 ];
+		const float da = t1._fLab[ 1 ] - t2._fLab[ 1 ];
+		const float db = t1._fLab[ 2 ] - t2._fLab[ 2 ];
+		return dl * dl + da * da + db * db;
+	}
+
+	return static_cast<float>( rgb_color_distance_squared( t1._colAverage, t2._colAverage ) );
+}
+
+//
+// crush_palette
+//
+// Merge the closest pair of colors until the palette fits the target size.
+// Pair distances live in a min-heap; entries invalidated by a merge are skipped
+// lazily when popped, so each merge only pushes the pairs of the merged color.
+// Merged colors are weighted by their pixel counts.
+//
+static void crush_palette( std::vector< sColorTotal >& aTotals, size_t targetSize, color_space_t space = COLOR_SPACE_RGB )
+{
+	TRACE_ZONE( "crush_palette" );
+
+	const size_t count = aTotals.size();
+
+	if ( count <= targetSize )
+	{
+		return;
+	}
+
+	struct pair_t
+	{
+		float dist;
+		uint32_t index0;
+		uint32_t index1;
+		uint32_t version0;
+		uint32_t version1;
+	};
+
+	auto compare = []( const pair_t& p1, const pair_t& p2 )
+				   {
+					   // smallest distance on top.
+					   return p1.dist > p2.dist;
+				   };
+
+	std::priority_queue< pair_t, std::vector< pair_t >, decltype( compare ) > heap( compare );
+
+	std::vector< uint32_t > aVersion( count, 0 );
+	std::vector< bool > aAlive( count, true );
+
+	if ( space == COLOR_SPACE_OKLAB )
+	{
+		convert_colors_oklab( aTotals );
+	}
+
+	for ( uint32_t i = 0; i < count; ++i )
+	{
+		for ( uint32_t j = i + 1; j < count; ++j )
+		{
+			const float dist = color_distance( aTotals[ i ], aTotals[ j ], space );
+			heap.push( { dist, i, j, 0, 0 } );
+		}
+	}
+
+	size_t alive = count;
+
+	while ( alive > targetSize && !heap.empty() )
+	{
+		const pair_t m = heap.top();
+		heap.pop();
+
+		// stale?
+		if ( !aAlive[ m.index0 ] || !aAlive[ m.index1 ] ||
+			 aVersion[ m.index0 ] != m.version0 || aVersion[ m.index1 ] != m.version1 )
+		{
+			continue;
+		}
+
+		// merge index1 into index0
+		sColorTotal& keep = aTotals[ m.index0 ];
+		const sColorTotal& drop = aTotals[ m.index1 ];
+
+		if ( keep._uTotal + drop._uTotal > 0 )
+		{
+			keep._uTotal += drop._uTotal;
+
+			for ( int c = 0; c < 4; ++c )
+			{
+				keep._uScaledRGBA[ c ] += drop._uScaledRGBA[ c ];
+			}
+
+			keep.GenerateAverage();
+
+			if ( space == COLOR_SPACE_OKLAB )
+			{
+				float lab[ 1 ][ 3 ];
+				rgb_to_oklab_block( &keep._colAverage, lab, 1 );
+				memcpy( keep._fLab, lab[ 0 ], sizeof( keep._fLab ) );
+			}
+		}
+
+		aAlive[ m.index1 ] = false;
+		++aVersion[ m.index0 ];
+		--alive;
+
+		// re-measure the merged color against the survivors.
+		for ( uint32_t k = 0; k < count; ++k )
+		{
+			if ( k == m.index0 || !aAlive[ k ] )
+				continue;
+
+			const float dist = color_distance( keep, aTotals[ k ], space );
+
+			if ( k < m.index0 )
+				heap.push( { dist, k, m.index0, aVersion[ k ], aVersion[ m.index0 ] } );
+			else
+				heap.push( { dist, m.index0, k, aVersion[ m.index0 ], aVersion[ k ] } );
+		}
+	}
+
+	std::vector< sColorTotal > aNewTotals;
+	aNewTotals.reserve( alive );
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		if ( aAlive[ i ] )
+		{
+			aNewTotals.push_back( aTotals[ i ] );
+		}
+	}
+
+	std::swap( aTotals, aNewTotals );
+}
+
+//
+// next_power_two
+//
+// Returns the closest power-of-two number greater or equal
+// to n for the given (unsigned) integer n.
+// Will return 0 when n = 0, 1 when n = 1.
+//
+static constexpr uint32_t next_power_two( uint32_t n )
+{
+	--n;
+	n |= n >> 16;
+	n |= n >> 8;
+	n |= n >> 4;
+	n |= n >> 2;
+	n |= n >> 1;
+	++n;
+	return n;
+}
+
+//
+// print_hello
+//
+// Print hello text
+//
+static void print_hello()
+{
+	printf( "\n------------------------------------------------------------------\n"
+			" Palette Generator (c) David Walters. See LICENSE.txt for details\n"
+			"------------------------------------------------------------------\n\n" );
+}
+
+//
+// print_help
+//
+// Print help text
+//
+static void print_help()
+{
+	// Usage
+	printf( " USAGE: palgen.exe [-?] [-count=#] [-hist=#] [-sample=#] [-edges[=#]] [-threads=#] [-inflight=#] [-histmem=#] [-cache=<file>] [-method=#] [-space=#] [-adaptive] [-kmeans=#] [-kmeanslimit=#] [-nostream] [-gpu] [-cpu=#] [-lum] [-transp] [-opaque] [-alpha] [-stats[=<file>]] [-verify=<file>] <image>[...] -o <palette>\n" );
+	printf( "        palgen.exe [options] -raw=<width>x<height>[,rgba] [-skip=#] -o <palette> < <frames>\n" );
+	printf( "        palgen.exe [options] <image>[...] -partial=<file>\n" );
+	printf( "        palgen.exe [options] -merge <partial>[...] -o <palette>\n" );
+	printf( "        palgen.exe [options] -tiles=# [-tilecolors=#] [-tilesize=#] <image>[...] -o <palette>\n" );
+	printf( "        palgen.exe [options] -manifest=<file>\n" );
+	printf( "        palgen.exe -serve[=<name>]\n" );
+	printf( "        palgen.exe -bench [-hist=#] [-cpu=#] [<image>...]\n" );
+	putchar( '\n' );
+
+	// Options
+	printf( "  -?                This help.\n" );
+	printf( "  -count=#          Set the palette size. [Default=256]\n" );
+	printf( "  -hist=#           Histogram: 24, 18 (6-6-6), 16 (5-6-5), 15 (5-5-5), map or 2level. [Default=24]\n" );
+	printf( "  -sample=#         Only count 1 in # pixels, for quick-look palettes. [Default=1]\n" );
+	printf( "  -edges[=#]        Count pixels that differ from their neighbours up to # more times (0 to %u),\n", kMaxEdgeWeight );
+	printf( "                    so that detail is not outweighed by flat areas. [Default=0, or %u]\n", kDefaultEdgeWeight );
+	printf( "  -threads=#        Threads to analyze images and split the palette with. [Default=CPU count, or FRAGMENTS_THREADS]\n" );
+	printf( "  -inflight=#       Limit on the MB of mapped input files (or -raw frames) waiting to be counted. [Default=256]\n" );
+	printf( "  -histmem=#        Limit on the MB of the counting workers' histograms, fewer count at once if needed. [Default=1024]\n" );
+	printf( "  -cache=<file>     Keep per-image color counts in <file>, only changed images are decoded again.\n" );
+	printf( "  -method=#         Quantizer: median (median cut), octree or wu. [Default=median]\n" );
+	printf( "  -space=#          Median cut color space: rgb or oklab (perceptual). [Default=rgb]\n" );
+	printf( "  -adaptive         Median cut: split the highest variance bucket until the palette is full.\n" );
+	printf( "  -kmeans=#         Refine the palette with up to # k-means iterations. [Default=0]\n" );
+	printf( "  -kmeanslimit=#    Stop refining once no color moves further than #. [Default=0.5]\n" );
+	printf( "  -order=#          Palette order: sum (R+G+B) or adjacent (neighbour colors get close indices). [Default=sum]\n" );
+	printf( "  -nostream         Decode whole PNG files instead of streaming them row by row.\n" );
+	printf( "  -gpu              Count pixels with a Direct3D 11 compute shader, or the CPU if unavailable.\n" );
+	printf( "  -cpu=#            SIMD kernels: scalar, sse2, sse4.1, avx2, avx512, neon or native. [Default=native]\n" );
+	printf( "  -lum              Apply rgb-to-luminance pre-filter to all inputs.\n" );
+	printf( "  -transp           Always make index 0 transparent.\n" );
+	printf( "  -opaque           Ignore transparent pixels.\n" );
+	printf( "  -alpha            Quantise translucent pixels as RGBA, written as RRGGBBAA. Median cut only, no -kmeans.\n" );
+	printf( "  -stats[=<file>]   Print timings and counters for each phase, and write them to <file> as JSON.\n" );
+	printf( "  -verify=<file>    Write a hash of each palette's entries to <file>, or compare them with it if it\n" );
+	printf( "                    is there and fail if any differ.\n" );
+	putchar( '\n' );
+	printf( "  <image>           Source image(s), wildcards supported, with ** for every\n" );
+	printf( "                    folder below (art\\**\\*.png).\n" );
+	putchar( '\n' );
+	printf( "  -o <palette>      Filename of output palette.\n" );
+	putchar( '\n' );
+	printf( "  -manifest=<file>  Make several palettes in one pass, one per \"<palette> = <image>[...]\" line.\n" );
+	putchar( '\n' );
+	printf( "  -raw=<w>x<h>[,rgba] Count frames of packed RGB24 (or RGBA32) pixels read from stdin,\n" );
+	printf( "                    e.g. from ffmpeg -f rawvideo -pix_fmt rgb24 -. Nothing is read from disk.\n" );
+	printf( "  -skip=#           With -raw, only count 1 in # frames. [Default=1]\n" );
+	putchar( '\n' );
+	printf( "  -partial=<file>   Write the color counts of the inputs to <file>, rather than a palette.\n" );
+	printf( "  -merge            The inputs are -partial files, counted with the same options: add them up.\n" );
+	putchar( '\n' );
+	printf( "  -tiles=#          Make # sub-palettes, each tile of the images using only one of them.\n" );
+	printf( "  -tilecolors=#     Colors in each sub-palette, with the transparent index 0 if any. [Default=16]\n" );
+	printf( "  -tilesize=#       Width and height of a tile, in pixels. [Default=8]\n" );
+	putchar( '\n' );
+	printf( "  -serve[=<name>]   Read jobs from stdin, or from clients of the named pipe (a Unix socket off\n" );
+	printf( "                    Windows) <name>, one line of the options above each (not -raw), run in turn.\n" );
+	printf( "                    Each job's log is followed by \"#<line> OK <ms>ms\" or \"#<line> FAILED <ms>ms\".\n" );
+	printf( "                    A line of -stop ends the server.\n" );
+	printf( "  -bench            Time each phase on synthetic images (and any <image>s), no output.\n" );
+	putchar( '\n' );
+
+	putchar( '\n' );
+}
+
+//
+// split_manifest_line
+//
+// Split a manifest line at whitespace. Tokens may be quoted to keep spaces, and a '#'
+// outside quotes starts a comment.
+//
+static void split_manifest_line( const std::string& line, std::vector< std::string >& aTokens )
+{
+	std::string token;
+	bool bInToken = false;
+	bool bQuoted = false;
+
+	for ( char c : line )
+	{
+		if ( bQuoted )
+		{
+			if ( c == '"' )
+				bQuoted = false;
+			else
+				token += c;
+		}
+		else if ( c == '"' )
+		{
+			bQuoted = true;
+			bInToken = true;
+		}
+		else if ( c == '#' )
+		{
+			break;
+		}
+		else if ( c == ' ' || c == '\t' || c == '\r' || c == '\n' )
+		{
+			if ( bInToken )
+			{
+				aTokens.push_back( token );
+				token.clear();
+				bInToken = false;
+			}
+		}
+		else
+		{
+			token += c;
+			bInToken = true;
+		}
+	}
+
+	if ( bInToken )
+	{
+		aTokens.push_back( token );
+	}
+}
+
+//
+// read_manifest
+//
+// Read the palette groups of a -manifest file, one "<palette> = <image>[...]" per line.
+// '=' separates the palette from its images, as ':' may be part of a path.
+//
+static bool read_manifest( const std::string& strFileName, options_t& options )
+{
+	std::ifstream file( strFileName );
+	if ( !file.is_open() )
+	{
+		printf( "Error - could not open manifest \"%s\".\n", strFileName.c_str() );
+		return false;
+	}
+
+	std::set< std::string > aOutFiles;
+	std::string line;
+	int iLine = 0;
+
+	while ( std::getline( file, line ) )
+	{
+		++iLine;
+
+		std::vector< std::string > aTokens;
+		split_manifest_line( line, aTokens );
+
+		if ( aTokens.empty() )
+		{
+			continue; // blank or comment
+		}
+
+		if ( aTokens.size() < 3 || aTokens[ 1 ] != "=" )
+		{
+			printf( "Error - %s(%d): expected \"<palette> = <image>[...]\".\n", strFileName.c_str(), iLine );
+			return false;
+		}
+
+		palette_group_t group;
+		group.strOutFile = aTokens[ 0 ];
+
+		if ( !aOutFiles.insert( group.strOutFile ).second )
+		{
+			printf( "Error - %s(%d): palette \"%s\" is listed twice.\n", strFileName.c_str(), iLine, group.strOutFile.c_str() );
+			return false;
+		}
+
+		for ( size_t i = 2; i < aTokens.size(); ++i )
+		{
+			find_files( aTokens[ i ].c_str(), group.aInputFiles );
+		}
+		sort_files( group.aInputFiles );
+
+		if ( group.aInputFiles.empty() )
+		{
+			printf( "Error - %s(%d): no input file(s) found for \"%s\".\n", strFileName.c_str(), iLine, group.strOutFile.c_str() );
+			return false;
+		}
+
+		options.aInputFiles.insert( options.aInputFiles.end(), group.aInputFiles.begin(), group.aInputFiles.end() );
+		options.aGroups.push_back( std::move( group ) );
+	}
+
+	sort_files( options.aInputFiles );
+
+	if ( options.aGroups.empty() )
+	{
+		printf( "Error - manifest \"%s\" has no palettes.\n", strFileName.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+//
+// process_args
+//
+// Process command line arguments
+//
+static bool process_args( int argc, char** argv, options_t& options )
+{
+	// Command Line State
+	bool bNextArgIsOutput = false;
+
+	// Parse Command Line
+	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
+	{
+		const char* szArg = argv[ iarg ];
+
+		if ( bNextArgIsOutput )
+		{
+			bNextArgIsOutput = false;
+			options.strOutFile = szArg;
+		}
+		else if ( strncmp( szArg, "-count=", 7 ) == 0 )
+		{
+			int iSize = atoi( szArg + 7 );
+
+			if ( iSize <= 2 )
+			{
+				printf( "Error - invalid palette size (%d).\n", iSize );
+				return false;
+			}
+
+			options.uPaletteSizeReal = iSize;
+		}
+		else if ( strncmp( szArg, "-threads=", 9 ) == 0 )
+		{
+			int iThreads = atoi( szArg + 9 );
+
+			if ( iThreads <= 0 )
+			{
+				printf( "Error - invalid thread count (%d).\n", iThreads );
+				return false;
+			}
+
+			options.uThreadCount = std::min( unsigned( iThreads ), task_thread_cap() );
+		}
+		else if ( strncmp( szArg, "-cpu=", 5 ) == 0 )
+		{
+			if ( cpu_select( szArg + 5 ) == false )
+			{
+				printf( "Error - unknown or unsupported SIMD level \"%s\" (this CPU has %s).\n", szArg + 5, cpu_level_name( cpu_detect() ) );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-sample=", 8 ) == 0 )
+		{
+			int iRate = atoi( szArg + 8 );
+
+			if ( iRate <= 0 )
+			{
+				printf( "Error - invalid sample rate (%d).\n", iRate );
+				return false;
+			}
+
+			options.uSampleRate = iRate;
+		}
+		else if ( _stricmp( szArg, "-edges" ) == 0 )
+		{
+			options.uEdgeWeight = kDefaultEdgeWeight;
+		}
+		else if ( strncmp( szArg, "-edges=", 7 ) == 0 )
+		{
+			int iWeight = atoi( szArg + 7 );
+
+			if ( iWeight < 0 || iWeight > int( kMaxEdgeWeight ) )
+			{
+				printf( "Error - invalid edge weight (%d), 0 to %u.\n", iWeight, kMaxEdgeWeight );
+				return false;
+			}
+
+			options.uEdgeWeight = iWeight;
+		}
+		else if ( strncmp( szArg, "-kmeans=", 8 ) == 0 )
+		{
+			int iIterations = atoi( szArg + 8 );
+
+			if ( iIterations < 0 )
+			{
+				printf( "Error - invalid k-means iteration count (%d).\n", iIterations );
+				return false;
+			}
+
+			options.uKMeansIterations = iIterations;
+		}
+		else if ( strncmp( szArg, "-kmeanslimit=", 13 ) == 0 )
+		{
+			float fLimit = static_cast<float>( atof( szArg + 13 ) );
+
+			if ( !( fLimit >= 0 ) )
+			{
+				printf( "Error - invalid k-means limit (%s).\n", szArg + 13 );
+				return false;
+			}
+
+			options.fKMeansLimit = fLimit;
+		}
+		else if ( strncmp( szArg, "-method=", 8 ) == 0 )
+		{
+			const char* szMethod = szArg + 8;
+
+			if ( _stricmp( szMethod, "median" ) == 0 )
+				options.method = METHOD_MEDIAN_CUT;
+			else if ( _stricmp( szMethod, "octree" ) == 0 )
+				options.method = METHOD_OCTREE;
+			else if ( _stricmp( szMethod, "wu" ) == 0 )
+				options.method = METHOD_WU;
+			else
+			{
+				printf( "Error - invalid method (%s).\n", szMethod );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-inflight=", 10 ) == 0 )
+		{
+			int iMB = atoi( szArg + 10 );
+
+			if ( iMB <= 0 )
+			{
+				printf( "Error - invalid in-flight limit (%d).\n", iMB );
+				return false;
+			}
+
+			options.uInFlightMB = iMB;
+		}
+		else if ( strncmp( szArg, "-histmem=", 9 ) == 0 )
+		{
+			int iMB = atoi( szArg + 9 );
+
+			if ( iMB <= 0 )
+			{
+				printf( "Error - invalid histogram memory limit (%d).\n", iMB );
+				return false;
+			}
+
+			options.uHistogramMB = iMB;
+		}
+		else if ( strncmp( szArg, "-space=", 7 ) == 0 )
+		{
+			const char* szSpace = szArg + 7;
+
+			if ( _stricmp( szSpace, "rgb" ) == 0 )
+				options.colorSpace = COLOR_SPACE_RGB;
+			else if ( _stricmp( szSpace, "oklab" ) == 0 )
+				options.colorSpace = COLOR_SPACE_OKLAB;
+			else
+			{
+				printf( "Error - invalid color space (%s).\n", szSpace );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-hist=", 6 ) == 0 )
+		{
+			const char* szMode = szArg + 6;
+
+			if ( _stricmp( szMode, "map" ) == 0 )
+				options.histogram = HISTOGRAM_MAP;
+			else if ( strcmp( szMode, "24" ) == 0 )
+				options.histogram = HISTOGRAM_RGB24;
+			else if ( strcmp( szMode, "18" ) == 0 )
+				options.histogram = HISTOGRAM_RGB18;
+			else if ( strcmp( szMode, "16" ) == 0 )
+				options.histogram = HISTOGRAM_RGB16;
+			else if ( strcmp( szMode, "15" ) == 0 )
+				options.histogram = HISTOGRAM_RGB15;
+			else if ( _stricmp( szMode, "2level" ) == 0 )
+				options.histogram = HISTOGRAM_TWO_LEVEL;
+			else
+			{
+				printf( "Error - invalid histogram mode (%s).\n", szMode );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-order=", 7 ) == 0 )
+		{
+			const char* szOrder = szArg + 7;
+
+			if ( _stricmp( szOrder, "sum" ) == 0 )
+				options.order = ORDER_SUM;
+			else if ( _stricmp( szOrder, "adjacent" ) == 0 )
+				options.order = ORDER_ADJACENT;
+			else
+			{
+				printf( "Error - invalid palette order (%s).\n", szOrder );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-cache=", 7 ) == 0 )
+		{
+			options.strCacheFile = szArg + 7;
+
+			if ( options.strCacheFile.empty() )
+			{
+				printf( "Error - no cache file specified.\n" );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-raw=", 5 ) == 0 )
+		{
+			int iWidth = 0;
+			int iHeight = 0;
+			int iUsed = 0;
+
+			if ( sscanf( szArg + 5, "%dx%d%n", &iWidth, &iHeight, &iUsed ) != 2 || iWidth <= 0 || iHeight <= 0 )
+			{
+				printf( "Error - invalid raw frame size (%s).\n", szArg + 5 );
+				return false;
+			}
+
+			const char* szFormat = szArg + 5 + iUsed;
+
+			if ( *szFormat == 0 || _stricmp( szFormat, ",rgb" ) == 0 )
+				options.iRawChannels = 3;
+			else if ( _stricmp( szFormat, ",rgba" ) == 0 )
+				options.iRawChannels = 4;
+			else
+			{
+				printf( "Error - invalid raw pixel format (%s), use rgb or rgba.\n", szFormat );
+				return false;
+			}
+
+			options.iRawWidth = iWidth;
+			options.iRawHeight = iHeight;
+		}
+		else if ( strncmp( szArg, "-skip=", 6 ) == 0 )
+		{
+			int iSkip = atoi( szArg + 6 );
+
+			if ( iSkip <= 0 )
+			{
+				printf( "Error - invalid frame skip (%d).\n", iSkip );
+				return false;
+			}
+
+			options.uFrameSkip = iSkip;
+		}
+		else if ( strncmp( szArg, "-partial=", 9 ) == 0 )
+		{
+			options.strPartialFile = szArg + 9;
+
+			if ( options.strPartialFile.empty() )
+			{
+				printf( "Error - no partial file specified.\n" );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-merge" ) == 0 )
+		{
+			options.bMerge = true;
+		}
+		else if ( strncmp( szArg, "-tiles=", 7 ) == 0 )
+		{
+			int iCount = atoi( szArg + 7 );
+
+			if ( iCount <= 0 || iCount > 256 )
+			{
+				printf( "Error - invalid sub-palette count (%d).\n", iCount );
+				return false;
+			}
+
+			options.uSubPalettes = iCount;
+		}
+		else if ( strncmp( szArg, "-tilecolors=", 12 ) == 0 )
+		{
+			int iColors = atoi( szArg + 12 );
+
+			if ( iColors <= 2 || iColors > 256 )
+			{
+				printf( "Error - invalid sub-palette size (%d).\n", iColors );
+				return false;
+			}
+
+			options.uTileColors = iColors;
+		}
+		else if ( strncmp( szArg, "-tilesize=", 10 ) == 0 )
+		{
+			int iSize = atoi( szArg + 10 );
+
+			if ( iSize <= 0 || iSize > 256 )
+			{
+				printf( "Error - invalid tile size (%d).\n", iSize );
+				return false;
+			}
+
+			options.uTileSize = iSize;
+		}
+		else if ( strncmp( szArg, "-manifest=", 10 ) == 0 )
+		{
+			options.strManifestFile = szArg + 10;
+
+			if ( options.strManifestFile.empty() )
+			{
+				printf( "Error - no manifest file specified.\n" );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-?" ) == 0 )
+		{
+			return false;
+		}
+		else if ( _stricmp( szArg, "-o" ) == 0 )
+		{
+			bNextArgIsOutput = true;
+		}
+		else if ( _stricmp( szArg, "-adaptive" ) == 0 )
+		{
+			options.bAdaptive = true;
+		}
+		else if ( _stricmp( szArg, "-nostream" ) == 0 )
+		{
+			options.bStream = false;
+		}
+		else if ( _stricmp( szArg, "-gpu" ) == 0 )
+		{
+			options.bGpu = true;
+		}
+		else if ( _stricmp( szArg, "-lum" ) == 0 )
+		{
+			options.bLuminance = true;
+		}
+		else if ( _stricmp( szArg, "-transp" ) == 0 )
+		{
+			options.bForceTransp = true;
+		}
+		else if ( _stricmp( szArg, "-opaque" ) == 0 )
+		{
+			options.bForceOpaque = true;
+		}
+		else if ( _stricmp( szArg, "-alpha" ) == 0 )
+		{
+			options.bAlpha = true;
+		}
+		else if ( _stricmp( szArg, "-bench" ) == 0 )
+		{
+			options.bBenchmark = true;
+		}
+		else if ( _stricmp( szArg, "-stats" ) == 0 )
+		{
+			options.bStats = true;
+		}
+		else if ( strncmp( szArg, "-stats=", 7 ) == 0 )
+		{
+			options.bStats = true;
+			options.strStatsFile = szArg + 7;
+		}
+		else if ( strncmp( szArg, "-verify=", 8 ) == 0 )
+		{
+			options.strVerifyFile = szArg + 8;
+
+			if ( options.strVerifyFile.empty() )
+			{
+				printf( "Error - no verify file specified.\n" );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-serve" ) == 0 )
+		{
+			options.bServe = true;
+		}
+		else if ( strncmp( szArg, "-serve=", 7 ) == 0 && szArg[ 7 ] != '\0' )
+		{
+			options.bServe = true;
+			options.strServe = szArg + 7;
+		}
+		else
+		{
+			find_files( szArg, options.aInputFiles );
+		}
+
+	}; // for each command line argument
+
+	sort_files( options.aInputFiles );
+
+	if ( options.bAlpha && options.method != METHOD_MEDIAN_CUT )
+	{
+		printf( "Error - -alpha is only supported by the median cut method.\n" );
+		return false;
+	}
+
+	if ( options.bAlpha && options.uKMeansIterations > 0 )
+	{
+		printf( "Error - -kmeans only refines RGB, it can't be used with -alpha.\n" );
+		return false;
+	}
+
+	if ( options.bBenchmark )
+	{
+		return true; // input files are optional, and nothing is written.
+	}
+
+	if ( options.bServe )
+	{
+		return true; // the jobs bring their own images.
+	}
+
+	if ( options.iRawChannels != 0 )
+	{
+		if ( !options.aInputFiles.empty() || !options.strManifestFile.empty() || !options.strCacheFile.empty() )
+		{
+			printf( "Error - -raw reads its frames from stdin, do not also give <image>, -manifest or -cache.\n" );
+			return false;
+		}
+	}
+	else if ( options.uFrameSkip > 1 )
+	{
+		printf( "Error - -skip needs -raw.\n" );
+		return false;
+	}
+
+	if ( options.histogram == HISTOGRAM_TWO_LEVEL && !options.bAlpha
+		 && ( !options.strCacheFile.empty() || !options.strManifestFile.empty() || !options.strPartialFile.empty() || options.bMerge ) )
+	{
+		printf( "Error - -hist=2level shares out the counts of busy cells, it can't be saved for -cache, -manifest, -partial or -merge.\n" );
+		return false;
+	}
+
+	if ( options.order == ORDER_ADJACENT
+		 && ( !options.strCacheFile.empty() || !options.strManifestFile.empty() || !options.strPartialFile.empty() || options.bMerge || options.uSubPalettes != 0 ) )
+	{
+		printf( "Error - -order=adjacent counts neighbours while decoding, it does not work with -cache, -manifest, -partial, -merge or -tiles.\n" );
+		return false;
+	}
+
+	if ( options.bMerge && ( options.iRawChannels != 0 || !options.strCacheFile.empty() ) )
+	{
+		printf( "Error - -merge reads counts, not images, do not also give -raw or -cache.\n" );
+		return false;
+	}
+
+	if ( ( options.bMerge || !options.strPartialFile.empty() ) && !options.strManifestFile.empty() )
+	{
+		printf( "Error - -partial and -merge do not work with -manifest.\n" );
+		return false;
+	}
+
+	if ( options.uSubPalettes != 0 )
+	{
+		if ( options.iRawChannels != 0 || options.bMerge || !options.strPartialFile.empty() || !options.strManifestFile.empty() || !options.strCacheFile.empty() )
+		{
+			printf( "Error - -tiles needs <image> files, do not also give -raw, -merge, -partial, -manifest or -cache.\n" );
+			return false;
+		}
+
+		if ( options.bAlpha || options.uSampleRate > 1 || options.uEdgeWeight > 0 )
+		{
+			printf( "Error - -tiles counts every opaque pixel once, -alpha, -sample and -edges are not supported.\n" );
+			return false;
+		}
+	}
+
+	if ( !options.strPartialFile.empty() )
+	{
+		if ( !options.strOutFile.empty() )
+		{
+			printf( "Error - -partial writes counts, not a palette, do not also give -o.\n" );
+			return false;
+		}
+
+		if ( options.aInputFiles.empty() && options.iRawChannels == 0 )
+		{
+			printf( "Error - no input file(s) specified.\n" );
+			return false;
+		}
+
+		return true;
+	}
+
+	if ( !options.strManifestFile.empty() )
+	{
+		if ( !options.aInputFiles.empty() || !options.strOutFile.empty() )
+		{
+			printf( "Error - -manifest lists the images and palettes, do not also give <image> or -o.\n" );
+			return false;
+		}
+
+		return read_manifest( options.strManifestFile, options );
+	}
+
+	if ( options.aInputFiles.empty() && options.iRawChannels == 0 )
+	{
+		printf( "Error - no input file(s) specified.\n" );
+		return false;
+	}
+
+	if ( options.strOutFile.empty() )
+	{
+		printf( "Error - no output file specified.\n" );
+		return false;
+	}
+
+	return true;
+}
+
+//
+// write_hexfile
+//
+// Dump the whole palette to disk in .hex format. With -verify, the entries as written (the
+// alpha only with -alpha) are hashed into the manifest.
+//
+static void write_hexfile( std::vector< color_t >& aPalette, const std::string& strFileName, bool bAlpha, verify_manifest_t* pVerify = nullptr )
+{
+	TRACE_ZONE( "write_hexfile" );
+
+	char buf[ 64 ];
+
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+
+	std::ofstream file( strFileName );
+	if ( file.is_open() )
+	{
+		for ( uint32_t i = 0; i < aPalette.size(); ++i )
+		{
+			// read BGRA palette entry and convert to RGB
+
+			const color_t& pal = aPalette[ i ];
+			uint32_t cout;
+			cout = pal.chan[ 0 ] << 16;
+			cout |= pal.chan[ 1 ] << 8;
+			cout |= pal.chan[ 2 ];
+
+			// .hex palette file format, with alpha appended as RRGGBBAA.
+			if ( bAlpha )
+				sprintf_s( buf, sizeof( buf ), "%06x%02x\n", cout, pal.chan[ 3 ] );
+			else
+				sprintf_s( buf, sizeof( buf ), "%06x\n", cout );
+
+			file << buf;
+		}
+
+		file.close();
+		printf( "OK\n\n" );
+
+		if ( pVerify )
+		{
+			verify_hash_t hash;
+			hash.Add( uint32_t( aPalette.size() ) );
+			for ( const color_t& pal : aPalette )
+			{
+				hash.Add( bAlpha ? pal.value_abgr : ( pal.value_abgr | 0xFF000000 ) );
+			}
+
+			fputs( pVerify->Record( strFileName, "palette", hash ).c_str(), stdout );
+		}
+	}
+	else
+	{
+		printf( "FAILED\n\n" );
+	}
+}
+
+
+//==============================================================================
+
+//
+// Pixel kernels
+//
+// Convert blocks of packed pixels to color_t keys. Each kernel has a SIMD body and a
+// scalar tail; the scalar code (color_t::make_lum etc.) is the reference, and the
+// SIMD versions produce identical results.
+//
+
+static constexpr size_t kPixelBlock = 256;
+
+//
+// unpack_pixels_3ch
+//
+// Expand packed RGB into opaque color_t values.
+//
+static void unpack_pixels_3ch_scalar( const uint8_t* src, color_t* out, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		out[ i ].chan[ 0 ] = src[ i * 3 + 0 ];
+		out[ i ].chan[ 1 ] = src[ i * 3 + 1 ];
+		out[ i ].chan[ 2 ] = src[ i * 3 + 2 ];
+		out[ i ].chan[ 3 ] = 0xFF;
+	}
+}
+
+#if CPU_X86
+// SSSE3's byte shuffle, which every SSE4.1 CPU has.
+CPU_TARGET_SSE41 static void unpack_pixels_3ch_ssse3( const uint8_t* src, color_t* out, size_t count )
+{
+	size_t i = 0;
+
+	const __m128i shuffle = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+	const __m128i alpha = _mm_set1_epi32( int( 0xFF000000 ) );
+
+	// each load reads 16 bytes but only consumes 12, so stop 2 pixels early.
+	for ( ; i + 6 <= count; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i * 3 ) );
+		v = _mm_or_si128( _mm_shuffle_epi8( v, shuffle ), alpha );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), v );
+	}
+
+	unpack_pixels_3ch_scalar( src + i * 3, out + i, count - i );
+}
+#endif
+
+#if USE_SIMD_NEON
+static void unpack_pixels_3ch_neon( const uint8_t* src, color_t* out, size_t count )
+{
+	size_t i = 0;
+
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		const uint8x8x3_t rgb = vld3_u8( src + i * 3 );
+
+		uint8x8x4_t rgba;
+		rgba.val[ 0 ] = rgb.val[ 0 ];
+		rgba.val[ 1 ] = rgb.val[ 1 ];
+		rgba.val[ 2 ] = rgb.val[ 2 ];
+		rgba.val[ 3 ] = vdup_n_u8( 0xFF );
+
+		vst4_u8( reinterpret_cast<uint8_t*>( out + i ), rgba );
+	}
+
+	unpack_pixels_3ch_scalar( src + i * 3, out + i, count - i );
+}
+#endif
+
+//
+// make_lum_pixels
+//
+// Apply color_t::make_lum to a block of pixels, preserving alpha.
+// The float expression is evaluated in the same order, and rounding is half away
+// from zero like round(), so the output matches the scalar path exactly.
+//
+static void make_lum_pixels_scalar( color_t* pixels, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		pixels[ i ].make_lum();
+	}
+}
+
+#if USE_SIMD_SSE2
+static void make_lum_pixels_sse2( color_t* pixels, size_t count )
+{
+	size_t i = 0;
+
+	const __m128i mask8 = _mm_set1_epi32( 0xFF );
+	const __m128i mask_alpha = _mm_set1_epi32( int( 0xFF000000 ) );
+	const __m128i max_lum = _mm_set1_epi32( 255 );
+	const __m128 kr = _mm_set1_ps( 0.299f );
+	const __m128 kg = _mm_set1_ps( 0.587f );
+	const __m128 kb = _mm_set1_ps( 0.114f );
+	const __m128 half = _mm_set1_ps( 0.5f );
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pixels + i ) );
+
+		const __m128 r = _mm_cvtepi32_ps( _mm_and_si128( v, mask8 ) );
+		const __m128 g = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( v, 8 ), mask8 ) );
+		const __m128 b = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( v, 16 ), mask8 ) );
+
+		const __m128 lum = _mm_add_ps( _mm_add_ps( _mm_mul_ps( r, kr ), _mm_mul_ps( g, kg ) ), _mm_mul_ps( b, kb ) );
+
+		// round half away from zero (lum is never negative)
+		__m128i t = _mm_cvttps_epi32( lum );
+		const __m128 frac = _mm_sub_ps( lum, _mm_cvtepi32_ps( t ) );
+		t = _mm_sub_epi32( t, _mm_castps_si128( _mm_cmpge_ps( frac, half ) ) );
+
+		// clamp (values fit in 16 bits, so the 16-bit min is safe on 32-bit lanes)
+		t = _mm_min_epi16( t, max_lum );
+
+		const __m128i gray = _mm_or_si128( _mm_or_si128( t, _mm_slli_epi32( t, 8 ) ), _mm_slli_epi32( t, 16 ) );
+		v = _mm_or_si128( _mm_and_si128( v, mask_alpha ), gray );
+
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pixels + i ), v );
+	}
+
+	make_lum_pixels_scalar( pixels + i, count - i );
+}
+#endif
+
+#if USE_SIMD_NEON
+static void make_lum_pixels_neon( color_t* pixels, size_t count )
+{
+	size_t i = 0;
+
+	const uint32x4_t mask8 = vdupq_n_u32( 0xFF );
+	const uint32x4_t mask_alpha = vdupq_n_u32( 0xFF000000 );
+	const uint32x4_t max_lum = vdupq_n_u32( 255 );
+	const float32x4_t half = vdupq_n_f32( 0.5f );
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		uint32x4_t v = vld1q_u32( reinterpret_cast<const uint32_t*>( pixels + i ) );
+
+		const float32x4_t r = vcvtq_f32_u32( vandq_u32( v, mask8 ) );
+		const float32x4_t g = vcvtq_f32_u32( vandq_u32( vshrq_n_u32( v, 8 ), mask8 ) );
+		const float32x4_t b = vcvtq_f32_u32( vandq_u32( vshrq_n_u32( v, 16 ), mask8 ) );
+
+		// separate multiply and add (no fused multiply-add), to match the scalar path.
+		const float32x4_t lum = vaddq_f32( vaddq_f32( vmulq_n_f32( r, 0.299f ), vmulq_n_f32( g, 0.587f ) ), vmulq_n_f32( b, 0.114f ) );
+
+		uint32x4_t t = vcvtq_u32_f32( lum );
+		const float32x4_t frac = vsubq_f32( lum, vcvtq_f32_u32( t ) );
+		t = vsubq_u32( t, vcgeq_f32( frac, half ) );
+		t = vminq_u32( t, max_lum );
+
+		const uint32x4_t gray = vorrq_u32( vorrq_u32( t, vshlq_n_u32( t, 8 ) ), vshlq_n_u32( t, 16 ) );
+		v = vorrq_u32( vandq_u32( v, mask_alpha ), gray );
+
+		vst1q_u32( reinterpret_cast<uint32_t*>( pixels + i ), v );
+	}
+
+	make_lum_pixels_scalar( pixels + i, count - i );
+}
+#endif
+
+//
+// all_pixels_opaque
+//
+// True if every pixel in the block has an alpha of 0xFF.
+//
+static bool all_pixels_opaque_scalar( const color_t* pixels, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		if ( pixels[ i ].chan[ 3 ] != 0xFF )
+			return false;
+	}
+
+	return true;
+}
+
+#if USE_SIMD_SSE2
+static bool all_pixels_opaque_sse2( const color_t* pixels, size_t count )
+{
+	size_t i = 0;
+
+	const __m128i mask_alpha = _mm_set1_epi32( int( 0xFF000000 ) );
+	__m128i all = _mm_set1_epi32( -1 );
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pixels + i ) );
+		all = _mm_and_si128( all, _mm_cmpeq_epi32( _mm_and_si128( v, mask_alpha ), mask_alpha ) );
+	}
+
+	if ( _mm_movemask_epi8( all ) != 0xFFFF )
+	{
+		return false;
+	}
+
+	return all_pixels_opaque_scalar( pixels + i, count - i );
+}
+#endif
+
+#if USE_SIMD_NEON
+static bool all_pixels_opaque_neon( const color_t* pixels, size_t count )
+{
+	size_t i = 0;
+
+	uint32x4_t all = vdupq_n_u32( 0xFFFFFFFF );
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const uint32x4_t v = vld1q_u32( reinterpret_cast<const uint32_t*>( pixels + i ) );
+		all = vandq_u32( all, vcgeq_u32( v, vdupq_n_u32( 0xFF000000 ) ) );
+	}
+
+	if ( vminvq_u32( all ) == 0 )
+	{
+		return false;
+	}
+
+	return all_pixels_opaque_scalar( pixels + i, count - i );
+}
+#endif
+
+//
+// edge_weights
+//
+// For -edges, the weight of each of count pixels row[ i + 1 ] from its local contrast: the
+// difference in luma (R + 2G + B) of its left and right neighbours, row[ i ] and row[ i + 2 ],
+// plus the difference of it and up[ i ], the pixel above. The weight is 1 plus that contrast
+// (0 to 2040) times strength, over 2048. All integer, so each kernel gives the same weights.
+//
+static inline uint32_t edge_luma( color_t col )
+{
+	return uint32_t( col.chan[ 0 ] ) + 2 * uint32_t( col.chan[ 1 ] ) + uint32_t( col.chan[ 2 ] );
+}
+
+static void edge_weights_scalar( const color_t* row, const color_t* up, size_t count, uint32_t strength, uint32_t* weights )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const uint32_t left = edge_luma( row[ i ] );
+		const uint32_t right = edge_luma( row[ i + 2 ] );
+		const uint32_t centre = edge_luma( row[ i + 1 ] );
+		const uint32_t above = edge_luma( up[ i ] );
+
+		const uint32_t contrast = ( ( left > right ) ? left - right : right - left ) + ( ( centre > above ) ? centre - above : above - centre );
+
+		weights[ i ] = 1 + ( ( contrast * strength ) >> 11 );
+	}
+}
+
+#if USE_SIMD_SSE2
+static inline __m128i edge_luma_sse2( const color_t* pixels )
+{
+	const __m128i mask8 = _mm_set1_epi32( 0xFF );
+	const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pixels ) );
+
+	const __m128i g = _mm_and_si128( _mm_srli_epi32( v, 8 ), mask8 );
+	return _mm_add_epi32( _mm_add_epi32( _mm_and_si128( v, mask8 ), _mm_add_epi32( g, g ) ), _mm_and_si128( _mm_srli_epi32( v, 16 ), mask8 ) );
+}
+
+static inline __m128i abs_diff_sse2( __m128i a, __m128i b )
+{
+	// the difference fits in 16 bits, so the 16-bit max of a - b and b - a is its size.
+	return _mm_max_epi16( _mm_sub_epi32( a, b ), _mm_sub_epi32( b, a ) );
+}
+
+static void edge_weights_sse2( const color_t* row, const color_t* up, size_t count, uint32_t strength, uint32_t* weights )
+{
+	size_t i = 0;
+
+	const __m128i one = _mm_set1_epi32( 1 );
+	const __m128i scale = _mm_set1_epi32( int( strength ) ); // as 16-bit pairs of ( strength, 0 )
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const __m128i gx = abs_diff_sse2( edge_luma_sse2( row + i ), edge_luma_sse2( row + i + 2 ) );
+		const __m128i gy = abs_diff_sse2( edge_luma_sse2( row + i + 1 ), edge_luma_sse2( up + i ) );
+
+		// the contrast (at most 2040) and strength (at most 64) are 16 bits, with a zero above each
+		const __m128i weighted = _mm_madd_epi16( _mm_add_epi32( gx, gy ), scale );
+
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( weights + i ), _mm_add_epi32( one, _mm_srli_epi32( weighted, 11 ) ) );
+	}
+
+	edge_weights_scalar( row + i, up + i, count - i, strength, weights + i );
+}
+#endif
+
+#if USE_SIMD_NEON
+static inline uint32x4_t edge_luma_neon( const color_t* pixels )
+{
+	const uint32x4_t mask8 = vdupq_n_u32( 0xFF );
+	const uint32x4_t v = vld1q_u32( reinterpret_cast<const uint32_t*>( pixels ) );
+
+	const uint32x4_t g = vandq_u32( vshrq_n_u32( v, 8 ), mask8 );
+	return vaddq_u32( vaddq_u32( vandq_u32( v, mask8 ), vaddq_u32( g, g ) ), vandq_u32( vshrq_n_u32( v, 16 ), mask8 ) );
+}
+
+static void edge_weights_neon( const color_t* row, const color_t* up, size_t count, uint32_t strength, uint32_t* weights )
+{
+	size_t i = 0;
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const uint32x4_t gx = vabdq_u32( edge_luma_neon( row + i ), edge_luma_neon( row + i + 2 ) );
+		const uint32x4_t gy = vabdq_u32( edge_luma_neon( row + i + 1 ), edge_luma_neon( up + i ) );
+
+		const uint32x4_t weighted = vmulq_n_u32( vaddq_u32( gx, gy ), strength );
+
+		vst1q_u32( weights + i, vaddq_u32( vdupq_n_u32( 1 ), vshrq_n_u32( weighted, 11 ) ) );
+	}
+
+	edge_weights_scalar( row + i, up + i, count - i, strength, weights + i );
+}
+#endif
+
+//
+// pixel_kernels_t
+//
+// The pixel kernels for cpu_level(), chosen the first time they are used.
+//
+struct pixel_kernels_t
+{
+	void ( *pfnUnpack3ch )( const uint8_t* src, color_t* out, size_t count ) = unpack_pixels_3ch_scalar;
+	void ( *pfnMakeLum )( color_t* pixels, size_t count ) = make_lum_pixels_scalar;
+	bool ( *pfnAllOpaque )( const color_t* pixels, size_t count ) = all_pixels_opaque_scalar;
+	void ( *pfnEdgeWeights )( const color_t* row, const color_t* up, size_t count, uint32_t strength, uint32_t* weights ) = edge_weights_scalar;
+
+	static const pixel_kernels_t& Get()
+	{
+		static const pixel_kernels_t kernels = Bind( cpu_level() );
+		return kernels;
+	}
+
+private:
+
+	static pixel_kernels_t Bind( cpu_level_t level )
+	{
+		pixel_kernels_t kernels;
+
+#if USE_SIMD_SSE2
+		if ( level >= CPU_SSE2 && level != CPU_NEON )
+		{
+			kernels.pfnMakeLum = make_lum_pixels_sse2;
+			kernels.pfnAllOpaque = all_pixels_opaque_sse2;
+			kernels.pfnEdgeWeights = edge_weights_sse2;
+		}
+#endif
+#if CPU_X86
+		if ( level >= CPU_SSE41 && level != CPU_NEON )
+		{
+			kernels.pfnUnpack3ch = unpack_pixels_3ch_ssse3;
+		}
+#endif
+#if USE_SIMD_NEON
+		if ( level == CPU_NEON )
+		{
+			kernels.pfnUnpack3ch = unpack_pixels_3ch_neon;
+			kernels.pfnMakeLum = make_lum_pixels_neon;
+			kernels.pfnAllOpaque = all_pixels_opaque_neon;
+			kernels.pfnEdgeWeights = edge_weights_neon;
+		}
+#endif
+
+		( void )level;
+		return kernels;
+	}
+};
+
+static void unpack_pixels_3ch( const uint8_t* src, color_t* out, size_t count )
+{
+	pixel_kernels_t::Get().pfnUnpack3ch( src, out, count );
+}
+
+static void make_lum_pixels( color_t* pixels, size_t count )
+{
+	pixel_kernels_t::Get().pfnMakeLum( pixels, count );
+}
+
+static bool all_pixels_opaque( const color_t* pixels, size_t count )
+{
+	return pixel_kernels_t::Get().pfnAllOpaque( pixels, count );
+}
+
+static void edge_weights( const color_t* row, const color_t* up, size_t count, uint32_t strength, uint32_t* weights )
+{
+	pixel_kernels_t::Get().pfnEdgeWeights( row, up, count, strength, weights );
+}
+
+//
+// count_pixels_masked
+//
+// Add a block of pixels to the histogram, skipping any that are not opaque.
+// An alpha histogram only skips fully transparent pixels.
+//
+static void count_pixels_masked( const color_t* pixels, size_t count, color_histogram_t& col_counts, bool& bMaskDetected )
+{
+	if ( all_pixels_opaque( pixels, count ) )
+	{
+		for ( size_t i = 0; i < count; ++i )
+		{
+			col_counts.Add( pixels[ i ] );
+		}
+		return;
+	}
+
+	const uint8_t skip_below = col_counts._bAlpha ? 1 : 0xFF;
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		// masked pixel?
+		if ( pixels[ i ].chan[ 3 ] < skip_below )
+		{
+			bMaskDetected = true;
+			continue;
+		}
+
+		// Add to the histogram
+		col_counts.Add( pixels[ i ] );
+	}
+}
+
+//==============================================================================
+
+static void count_unique_image_lum_3ch( const uint8_t* data, int width, int height, color_histogram_t& col_counts )
+{
+	color_t block[ kPixelBlock ];
+
+	size_t remaining = size_t( width ) * size_t( height );
+
+	while ( remaining > 0 )
+	{
+		const size_t count = std::min( remaining, kPixelBlock );
+
+		unpack_pixels_3ch( data, block, count );
+		make_lum_pixels( block, count );
+
+		// Add to the histogram
+		for ( size_t i = 0; i < count; ++i )
+		{
+			col_counts.Add( block[ i ] );
+		}
+
+		data += count * 3;
+		remaining -= count;
+	}
+}
+
+static void count_unique_image_lum_4ch( const uint8_t* data, int width, int height, color_histogram_t& col_counts, bool& bMaskDetected )
+{
+	color_t block[ kPixelBlock ];
+
+	size_t remaining = size_t( width ) * size_t( height );
+
+	while ( remaining > 0 )
+	{
+		const size_t count = std::min( remaining, kPixelBlock );
+
+		memcpy( block, data, count * 4 );
+		make_lum_pixels( block, count );
+
+		count_pixels_masked( block, count, col_counts, bMaskDetected );
+
+		data += count * 4;
+		remaining -= count;
+	}
+}
+
+static void count_unique_image_cols_3ch( const uint8_t* data, int width, int height, color_histogram_t& col_counts )
+{
+	color_t block[ kPixelBlock ];
+
+	size_t remaining = size_t( width ) * size_t( height );
+
+	while ( remaining > 0 )
+	{
+		const size_t count = std::min( remaining, kPixelBlock );
+
+		unpack_pixels_3ch( data, block, count );
+
+		// Add to the histogram
+		for ( size_t i = 0; i < count; ++i )
+		{
+			col_counts.Add( block[ i ] );
+		}
+
+		data += count * 3;
+		remaining -= count;
+	}
+}
+
+static void count_unique_image_cols_4ch( const uint8_t* data, int width, int height, color_histogram_t& col_counts, bool& bMaskDetected )
+{
+	color_t block[ kPixelBlock ];
+
+	size_t remaining = size_t( width ) * size_t( height );
+
+	while ( remaining > 0 )
+	{
+		const size_t count = std::min( remaining, kPixelBlock );
+
+		memcpy( block, data, count * 4 );
+
+		count_pixels_masked( block, count, col_counts, bMaskDetected );
+
+		data += count * 4;
+		remaining -= count;
+	}
+}
+
+//
+// dispatch_image_pixels
+//
+// Pass a block of packed pixels to the counter for the channel count and -lum mode.
+//
+static void dispatch_image_pixels( const palgen_settings_t& options,
+								   const uint8_t* data, int width, int height, int chan_count,
+								   color_histogram_t& unique_colors,
+								   bool& bMaskDetected )
+{
+	if ( options.bLuminance )
+	{
+		switch ( chan_count )
+		{
+
+		case 3:
+			count_unique_image_lum_3ch( data, width, height, unique_colors );
+			break;
+
+		case 4:
+			count_unique_image_lum_4ch( data, width, height, unique_colors, bMaskDetected );
+			break;
+
+		}
+	}
+	else
+	{
+		switch ( chan_count )
+		{
+
+		case 3:
+			count_unique_image_cols_3ch( data, width, height, unique_colors );
+			break;
+
+		case 4:
+			count_unique_image_cols_4ch( data, width, height, unique_colors, bMaskDetected );
+			break;
+
+		}
+	}
+}
+
+//
+// sample_hash
+//
+// Cheap integer hash, used to jitter the sample position in each stratum.
+//
+static inline uint32_t sample_hash( uint32_t x )
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+//
+// count_neighbour_pairs
+//
+// Count the horizontal neighbours of a block of packed pixels for -order=adjacent,
+// after the same -lum filter as the colors. With -sample=N only the pixel sampled in
+// each stratum and the one to its right are paired.
+//
+static void count_neighbour_pairs( const palgen_settings_t& options,
+								   const uint8_t* data, int width, int height, int row_index, int chan_count,
+								   color_histogram_t& unique_colors )
+{
+	const uint32_t rate = options.uSampleRate;
+	const uint8_t skip_below = unique_colors._bAlpha ? 1 : 0xFF; // as count_pixels_masked
+
+	color_t block[ kPixelBlock + 1 ];
+
+	for ( int y = 0; y < height; ++y )
+	{
+		const uint8_t* row = data + size_t( y ) * size_t( width ) * chan_count;
+		const uint32_t row_seed = sample_hash( uint32_t( row_index + y ) );
+
+		for ( int x0 = 0; x0 + 1 < width; )
+		{
+			int first = x0;
+			int count = std::min( int( kPixelBlock ) + 1, width - x0 );
+
+			if ( rate > 1 )
+			{
+				const uint32_t stratum = std::min< uint32_t >( rate, uint32_t( width - x0 ) );
+				first = x0 + int( sample_hash( row_seed ^ uint32_t( x0 ) ) % stratum );
+				count = std::min( 2, width - first );
+				x0 += int( rate );
+			}
+			else
+			{
+				x0 += count - 1;
+			}
+
+			if ( count < 2 )
+				continue;
+
+			if ( chan_count == 3 )
+			{
+				unpack_pixels_3ch( row + size_t( first ) * 3, block, size_t( count ) );
+			}
+			else
+			{
+				memcpy( block, row + size_t( first ) * 4, size_t( count ) * 4 );
+			}
+
+			if ( options.bLuminance )
+			{
+				make_lum_pixels( block, size_t( count ) );
+			}
+
+			for ( int i = 0; i + 1 < count; ++i )
+			{
+				const uint8_t alpha1 = block[ i ].chan[ 3 ];
+				const uint8_t alpha2 = block[ i + 1 ].chan[ 3 ];
+
+				// translucent colors of an -alpha histogram are not ordered.
+				if ( ( alpha1 != 0xFF && alpha1 >= skip_below ) || ( alpha2 != 0xFF && alpha2 >= skip_below ) )
+					continue;
+
+				const uint32_t key1 = ( alpha1 == 0xFF ) ? ( block[ i ].value_abgr & 0xFFFFFF ) : color_histogram_t::kPairMasked;
+				const uint32_t key2 = ( alpha2 == 0xFF ) ? ( block[ i + 1 ].value_abgr & 0xFFFFFF ) : color_histogram_t::kPairMasked;
+
+				unique_colors.AddPair( key1, key2 );
+			}
+		}
+	}
+}
+
+//
+// load_pixel_span
+//
+// Unpack pixels first to first + count - 1 of a packed row, those past either end of it
+// repeating the pixel at that end.
+//
+static void load_pixel_span( const uint8_t* row, int width, int chan_count, int first, int count, color_t* out )
+{
+	const int lo = std::max( first, 0 );
+	const int hi = std::min( first + count, width );
+
+	if ( chan_count == 3 )
+	{
+		unpack_pixels_3ch( row + size_t( lo ) * 3, out + ( lo - first ), size_t( hi - lo ) );
+	}
+	else
+	{
+		memcpy( out + ( lo - first ), row + size_t( lo ) * 4, size_t( hi - lo ) * 4 );
+	}
+
+	for ( int i = 0; i < lo - first; ++i )
+	{
+		out[ i ] = out[ lo - first ];
+	}
+	for ( int i = hi - first; i < count; ++i )
+	{
+		out[ i ] = out[ hi - first - 1 ];
+	}
+}
+
+//
+// count_weighted_pixels
+//
+// count_image_pixels for -edges: each pixel is counted edge_weights times rather than once,
+// so the colors of detail outweigh those of the flat areas around it. above is the packed
+// row before data's first (nullptr for an image's top row), so that a streamed image is
+// counted with the same weights as a loaded one. The weights are of the pixels as they are,
+// before -lum.
+//
+static void count_weighted_pixels( const palgen_settings_t& options,
+								   const uint8_t* data, int width, int height, int row_index, int chan_count, const uint8_t* above,
+								   color_histogram_t& unique_colors,
+								   bool& bMaskDetected )
+{
+	const uint32_t rate = options.uSampleRate;
+	const uint32_t strength = std::min( options.uEdgeWeight, kMaxEdgeWeight ); // a library caller's too
+	const size_t stride = size_t( width ) * size_t( chan_count );
+	const uint8_t skip_below = unique_colors._bAlpha ? 1 : 0xFF; // as count_pixels_masked
+
+	color_t row[ kPixelBlock + 2 ]; // with the neighbours to the left and right
+	color_t up[ kPixelBlock ];
+	uint32_t weights[ kPixelBlock ];
+
+	for ( int y = 0; y < height; ++y )
+	{
+		const uint8_t* src = data + size_t( y ) * stride;
+		const uint8_t* src_up = ( y > 0 ) ? src - stride : above;
+		const uint32_t row_seed = sample_hash( uint32_t( row_index + y ) );
+
+		for ( int x0 = 0; x0 < width; )
+		{
+			int first = x0;
+			int count = std::min( int( kPixelBlock ), width - x0 );
+
+			// with -sample=N, the same pixel of each stratum as count_image_pixels takes
+			if ( rate > 1 )
+			{
+				const uint32_t stratum = std::min< uint32_t >( rate, uint32_t( width - x0 ) );
+				first = x0 + int( sample_hash( row_seed ^ uint32_t( x0 ) ) % stratum );
+				count = 1;
+				x0 += int( rate );
+			}
+			else
+			{
+				x0 += count;
+			}
+
+			load_pixel_span( src, width, chan_count, first - 1, count + 2, row );
+
+			if ( src_up != nullptr )
+			{
+				load_pixel_span( src_up, width, chan_count, first, count, up );
+			}
+			else
+			{
+				memcpy( up, row + 1, size_t( count ) * sizeof( color_t ) ); // nothing above.
+			}
+
+			edge_weights( row, up, size_t( count ), strength, weights );
+
+			if ( options.bLuminance )
+			{
+				make_lum_pixels( row + 1, size_t( count ) );
+			}
+
+			for ( int i = 0; i < count; ++i )
+			{
+				// masked pixel?
+				if ( row[ i + 1 ].chan[ 3 ] < skip_below )
+				{
+					bMaskDetected = true;
+					continue;
+				}
+
+				unique_colors.Add( row[ i + 1 ], weights[ i ] );
+			}
+		}
+	}
+}
+
+//
+// count_image_pixels
+//
+// Count a block of packed pixels (a whole image, or a single row starting at row_index).
+// above is the packed row before it, or nullptr at the top of the image; only -edges reads it.
+//
+// With -sample=N each row is split into strata of N pixels and one pixel at a hashed
+// position is taken from each, so only 1 in N pixels is visited while the weighting
+// of the colors stays roughly the same. The positions depend only on the pixel
+// coordinates, so results are repeatable and the same for streamed or loaded images.
+//
+static void count_image_pixels( const palgen_settings_t& options,
+								const uint8_t* data, int width, int height, int row_index, int chan_count, const uint8_t* above,
+								color_histogram_t& unique_colors,
+								bool& bMaskDetected )
+{
+	const uint32_t rate = options.uSampleRate;
+
+	if ( unique_colors._bPairs )
+	{
+		count_neighbour_pairs( options, data, width, height, row_index, chan_count, unique_colors );
+	}
+
+	if ( options.uEdgeWeight > 0 )
+	{
+		count_weighted_pixels( options, data, width, height, row_index, chan_count, above, unique_colors, bMaskDetected );
+		return;
+	}
+
+	if ( rate <= 1 )
+	{
+		dispatch_image_pixels( options, data, width, height, chan_count, unique_colors, bMaskDetected );
+		return;
+	}
+
+	uint8_t block[ kPixelBlock * 4 ];
+	int count = 0;
+
+	for ( int y = 0; y < height; ++y )
+	{
+		const uint8_t* row = data + size_t( y ) * size_t( width ) * chan_count;
+		const uint32_t row_seed = sample_hash( uint32_t( row_index + y ) );
+
+		for ( int x0 = 0; x0 < width; x0 += int( rate ) )
+		{
+			const uint32_t stratum = std::min< uint32_t >( rate, uint32_t( width - x0 ) );
+			const int x = x0 + int( sample_hash( row_seed ^ uint32_t( x0 ) ) % stratum );
+
+			memcpy( block + count * chan_count, row + size_t( x ) * chan_count, chan_count );
+
+			if ( ++count == int( kPixelBlock ) )
+			{
+				dispatch_image_pixels( options, block, count, 1, chan_count, unique_colors, bMaskDetected );
+				count = 0;
+			}
+		}
+	}
+
+	if ( count > 0 )
+	{
+		dispatch_image_pixels( options, block, count, 1, chan_count, unique_colors, bMaskDetected );
+	}
+}
+
+//
+// analyse_png_stream
+//
+// Count a (mapped) PNG file one row at a time with libpng, so the decoded image is
+// never held in full. Returns false if the file should be decoded by stb instead
+// (not a PNG, or interlaced). Channels are as stb gives them, so a grey PNG is
+// INVALID-CHANNELS either way. If it fails part way, the rows before have been
+// counted, so bSuccess is false and the caller drops the image's counts.
+//
+static bool analyse_png_stream( const options_t& options,
+								const uint8_t* pData,
+								size_t uSize,
+								color_histogram_t& unique_colors,
+								bool& bMaskDetected,
+								bool& bSuccess,
+								stats_t& stats,
+								std::string& strLog )
+{
+	TRACE_ZONE( "decode_png_stream" );
+
+	const size_t kHeaderSize = 8;
+
+	if ( uSize < kHeaderSize || png_sig_cmp( pData, 0, kHeaderSize ) != 0 )
+	{
+		return false;
+	}
+
+	png_memory_t mem = { pData, uSize, kHeaderSize };
+
+	// Initialise the PNG.
+	png_structp png_ptr;
+	png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, &strLog, png_error_fn, png_warn_fn );
+	if ( png_ptr == nullptr )
+	{
+		return false;
+	}
+
+	// up to what PNG itself allows, past libpng's default of a million pixels a side.
+	png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+	// Initialise the information structure.
+	png_infop info_ptr;
+	info_ptr = png_create_info_struct( png_ptr );
+	if ( info_ptr == nullptr )
+	{
+		png_destroy_read_struct( &png_ptr, nullptr, nullptr );
+		return false;
+	}
+
+	volatile bool bHandled = true; // set after the setjmp, read after a longjmp.
+	std::vector< png_byte > row;
+	std::vector< png_byte > prev_row; // for -edges
+
+	jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
+
+	if ( setjmp( *p_jmp_buf ) != -1 )
+	{
+		// Setup the reader
+		png_set_read_fn( png_ptr, &mem, png_read_data_fn );
+		png_set_sig_bytes( png_ptr, int( kHeaderSize ) );
+
+		png_read_info( png_ptr, info_ptr );
+
+		if ( png_get_interlace_type( png_ptr, info_ptr ) != PNG_INTERLACE_NONE )
+		{
+			// every pass is needed to rebuild a row. Fall back to a full decode.
+			bHandled = false;
+		}
+		else
+		{
+			// ... always unpack to 8 bits, and palettes to RGB or RGBA, matching stb_image.
+			png_set_expand( png_ptr );
+			png_set_strip_16( png_ptr );
+			png_read_update_info( png_ptr, info_ptr );
+
+			const int w = static_cast<int>( png_get_image_width( png_ptr, info_ptr ) );
+			const int h = static_cast<int>( png_get_image_height( png_ptr, info_ptr ) );
+			const int chan_count = png_get_channels( png_ptr, info_ptr );
+
+			if ( chan_count != 3 && chan_count != 4 )
+			{
+				strLog += "INVALID-CHANNELS (" + std::to_string( chan_count ) + ")\n";
+			}
+			else
+			{
+				strLog += "STREAMING (" + std::to_string( w ) + " x " + std::to_string( h ) + ") ... ";
+
+				row.resize( png_get_rowbytes( png_ptr, info_ptr ) );
+				prev_row.resize( ( options.uEdgeWeight > 0 ) ? row.size() : 0 );
+
+				for ( int y = 0; y < h; ++y )
+				{
+					const tClock::time_point t0 = tClock::now();
+
+					png_read_row( png_ptr, row.data(), nullptr );
+
+					const tClock::time_point t1 = tClock::now();
+
+					count_image_pixels( options, row.data(), w, 1, y, chan_count, ( y > 0 && !prev_row.empty() ) ? prev_row.data() : nullptr, unique_colors, bMaskDetected );
+
+					if ( !prev_row.empty() )
+					{
+						row.swap( prev_row ); // this row is the next one's above.
+					}
+
+					stats.fDecodeMs += elapsed_ms( t0, t1 );
+					stats.fCountMs += elapsed_ms( t1 );
+				}
+
+				stats.uFiles++;
+				stats.uPixels += uint64_t( w ) * uint64_t( h );
+
+				png_read_end( png_ptr, nullptr );
+
+				strLog += "OK\n";
+				bSuccess = true;
+			}
+		}
+	}
+	else
+	{
+		strLog += "FAILED\n";
+	}
+
+	// Destroy the main reader and info structures
+	png_destroy_read_struct( &png_ptr, &info_ptr, nullptr );
+
+	return bHandled;
+}
+
+namespace // palcore.h has one of its own, which a library build may be linked with.
+{
+
+//
+// mapped_file_t
+//
+// Read only view of a whole file, memory mapped.
+//
+struct mapped_file_t
+{
+	HANDLE _hFile = INVALID_HANDLE_VALUE;
+	HANDLE _hMapping = nullptr;
+
+	const uint8_t* _pData = nullptr;
+	size_t _uSize = 0;
+
+public:
+
+	mapped_file_t() = default;
+	mapped_file_t( const mapped_file_t& ) = delete;
+	mapped_file_t& operator=( const mapped_file_t& ) = delete;
+
+	~mapped_file_t()
+	{
+		Close();
+	}
+
+	bool Open( const std::string& file_name )
+	{
+		Close();
+
+		_hFile = CreateFileA( file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+		if ( _hFile == INVALID_HANDLE_VALUE )
+			return false;
+
+		LARGE_INTEGER size;
+		if ( !GetFileSizeEx( _hFile, &size ) || size.QuadPart <= 0 )
+		{
+			Close(); // empty files can't be mapped (or decoded).
+			return false;
+		}
+
+		_hMapping = CreateFileMappingA( _hFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( _hMapping == nullptr )
+		{
+			Close();
+			return false;
+		}
+
+		_pData = reinterpret_cast<const uint8_t*>( MapViewOfFile( _hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+		if ( _pData == nullptr )
+		{
+			Close();
+			return false;
+		}
+
+		_uSize = static_cast<size_t>( size.QuadPart );
+		return true;
+	}
+
+	void Close()
+	{
+		if ( _pData != nullptr )
+		{
+			UnmapViewOfFile( _pData );
+			_pData = nullptr;
+		}
+
+		if ( _hMapping != nullptr )
+		{
+			CloseHandle( _hMapping );
+			_hMapping = nullptr;
+		}
+
+		if ( _hFile != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle( _hFile );
+			_hFile = INVALID_HANDLE_VALUE;
+		}
+
+		_uSize = 0;
+	}
+};
+
+} // namespace
+
+//==============================================================================
+
+// One thread per pixel: unpack it from the raw pixel buffer (3 or 4 channels), skip
+// it if it isn't opaque, and bump its counter in the dense histogram.
+static const char g_szCountShader[] =
+	"ByteAddressBuffer pixels : register( t0 );\n"
+	"RWByteAddressBuffer counts : register( u0 );\n"
+	"RWByteAddressBuffer flags : register( u1 );\n"
+	"cbuffer params : register( b0 )\n"
+	"{\n"
+	"	uint pixel_count;\n"
+	"	uint chan_count;\n"
+	"	uint shift_r;\n"
+	"	uint shift_g;\n"
+	"	uint3 drop;\n"
+	"};\n"
+	"[numthreads( 256, 1, 1 )]\n"
+	"void main( uint3 id : SV_DispatchThreadID )\n"
+	"{\n"
+	"	if ( id.x >= pixel_count ) return;\n"
+	"	uint offset = id.x * chan_count;\n"
+	"	uint shift = ( offset & 3u ) * 8u;\n"
+	"	uint v = pixels.Load( offset & ~3u ) >> shift;\n"
+	"	if ( shift != 0 ) v |= pixels.Load( ( offset & ~3u ) + 4 ) << ( 32u - shift );\n"
+	"	if ( chan_count == 3 ) v |= 0xFF000000u;\n"
+	"	if ( ( v >> 24 ) != 0xFFu ) { flags.Store( 0, 1u ); return; }\n"
+	"	uint r = ( v & 0xFFu ) >> drop.x;\n"
+	"	uint g = ( ( v >> 8 ) & 0xFFu ) >> drop.y;\n"
+	"	uint b = ( ( v >> 16 ) & 0xFFu ) >> drop.z;\n"
+	"	counts.InterlockedAdd( ( ( r << shift_r ) | ( g << shift_g ) | b ) * 4, 1u );\n"
+	"}\n";
+
+//
+// gpu_counter_t
+//
+// Counts whole decoded images into a dense histogram with a Direct3D 11 compute shader.
+// d3d11.dll and d3dcompiler_47.dll are loaded at run time, so a machine without them
+// (or without a feature level 11 GPU) just counts on the CPU. Images are uploaded in
+// chunks, and the 32-bit GPU counters are read back into the target histogram before
+// they could overflow, and once more by Finish.
+//
+// Safe to call from several decode workers, uploads are serialised.
+//
+struct gpu_counter_t
+{
+	static constexpr uint32_t kChunkPixels = 1u << 23; // 32768 groups of 256, within the dispatch limit.
+	static constexpr uint32_t kGroupSize = 256;
+
+	// matches the cbuffer in g_szCountShader.
+	struct params_t
+	{
+		uint32_t uPixelCount;
+		uint32_t uChanCount;
+		uint32_t uShiftR;
+		uint32_t uShiftG;
+		uint32_t uDrop[ 3 ];
+		uint32_t uPad;
+	};
+
+	std::mutex _mutex;
+
+	HMODULE _hD3D = nullptr;
+	HMODULE _hCompiler = nullptr;
+
+	ID3D11Device* _pDevice = nullptr;
+	ID3D11DeviceContext* _pContext = nullptr;
+	ID3D11ComputeShader* _pShader = nullptr;
+
+	ID3D11Buffer* _pPixels = nullptr;	// raw, one chunk of packed pixels.
+	ID3D11Buffer* _pCounts = nullptr;	// raw, uint32 per histogram entry.
+	ID3D11Buffer* _pFlags = nullptr;	// raw, [0] = a masked pixel was seen.
+	ID3D11Buffer* _pParams = nullptr;
+	ID3D11Buffer* _pReadCounts = nullptr;	// staging copies of the above, for read back.
+	ID3D11Buffer* _pReadFlags = nullptr;
+
+	ID3D11ShaderResourceView* _pPixelsView = nullptr;
+	ID3D11UnorderedAccessView* _pCountsView = nullptr;
+	ID3D11UnorderedAccessView* _pFlagsView = nullptr;
+
+	color_histogram_t* _pTarget = nullptr;
+	params_t _params = {};
+
+	uint64_t _uPending = 0; // pixels counted since the last read back.
+	bool _bMaskDetected = false;
+	bool _bFailed = false;
+
+	~gpu_counter_t()
+	{
+		release( _pFlagsView );
+		release( _pCountsView );
+		release( _pPixelsView );
+		release( _pReadFlags );
+		release( _pReadCounts );
+		release( _pParams );
+		release( _pFlags );
+		release( _pCounts );
+		release( _pPixels );
+		release( _pShader );
+		release( _pContext );
+		release( _pDevice );
+
+		if ( _hCompiler )
+			FreeLibrary( _hCompiler );
+		if ( _hD3D )
+			FreeLibrary( _hD3D );
+	}
+
+	template < typename T >
+	static void release( T*& pObject )
+	{
+		if ( pObject )
+		{
+			pObject->Release();
+			pObject = nullptr;
+		}
+	}
+
+	//
+	// Init
+	//
+	// Create the device, shader and buffers for a dense target histogram. On failure
+	// strReason says why, and the CPU should be used instead.
+	//
+	bool Init( color_histogram_t& target, std::string& strReason )
+	{
+		_hD3D = LoadLibraryA( "d3d11.dll" );
+		_hCompiler = LoadLibraryA( "d3dcompiler_47.dll" );
+
+		if ( _hD3D == nullptr || _hCompiler == nullptr )
+		{
+			strReason = "Direct3D 11 is not installed";
+			return false;
+		}
+
+		auto pfnCreateDevice = reinterpret_cast< PFN_D3D11_CREATE_DEVICE >( GetProcAddress( _hD3D, "D3D11CreateDevice" ) );
+		auto pfnCompile = reinterpret_cast< pD3DCompile >( GetProcAddress( _hCompiler, "D3DCompile" ) );
+
+		if ( pfnCreateDevice == nullptr || pfnCompile == nullptr )
+		{
+			strReason = "Direct3D 11 is not installed";
+			return false;
+		}
+
+		const D3D_FEATURE_LEVEL level = D3D_FEATURE_LEVEL_11_0;
+
+		if ( FAILED( pfnCreateDevice( nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, &level, 1, D3D11_SDK_VERSION, &_pDevice, nullptr, &_pContext ) ) )
+		{
+			strReason = "no feature level 11 GPU";
+			return false;
+		}
+
+		ID3DBlob* pCode = nullptr;
+		ID3DBlob* pErrors = nullptr;
+
+		HRESULT hr = pfnCompile( g_szCountShader, sizeof( g_szCountShader ) - 1, "palgen_count", nullptr, nullptr,
+								 "main", "cs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &pCode, &pErrors );
+		release( pErrors );
+
+		if ( SUCCEEDED( hr ) )
+		{
+			hr = _pDevice->CreateComputeShader( pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, &_pShader );
+		}
+
+		release( pCode );
+
+		if ( FAILED( hr ) )
+		{
+			strReason = "the compute shader failed to build";
+			return false;
+		}
+
+		const uint32_t uEntries = 1u << ( target._uBits[ 0 ] + target._uBits[ 1 ] + target._uBits[ 2 ] );
+
+		if ( !create_raw_buffer( kChunkPixels * 4 + 4, D3D11_BIND_SHADER_RESOURCE, &_pPixels )
+			 || !create_raw_buffer( uEntries * 4, D3D11_BIND_UNORDERED_ACCESS, &_pCounts )
+			 || !create_raw_buffer( 16, D3D11_BIND_UNORDERED_ACCESS, &_pFlags )
+			 || !create_staging_buffer( uEntries * 4, &_pReadCounts )
+			 || !create_staging_buffer( 16, &_pReadFlags ) )
+		{
+			strReason = "out of GPU memory";
+			return false;
+		}
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof( params_t );
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srv = {};
+		srv.Format = DXGI_FORMAT_R32_TYPELESS;
+		srv.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+		srv.BufferEx.NumElements = kChunkPixels + 1;
+		srv.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uav = {};
+		uav.Format = DXGI_FORMAT_R32_TYPELESS;
+		uav.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uav.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+		hr = _pDevice->CreateBuffer( &desc, nullptr, &_pParams );
+
+		if ( SUCCEEDED( hr ) )
+			hr = _pDevice->CreateShaderResourceView( _pPixels, &srv, &_pPixelsView );
+
+		if ( SUCCEEDED( hr ) )
+		{
+			uav.Buffer.NumElements = uEntries;
+			hr = _pDevice->CreateUnorderedAccessView( _pCounts, &uav, &_pCountsView );
+		}
+
+		if ( SUCCEEDED( hr ) )
+		{
+			uav.Buffer.NumElements = 4;
+			hr = _pDevice->CreateUnorderedAccessView( _pFlags, &uav, &_pFlagsView );
+		}
+
+		if ( FAILED( hr ) )
+		{
+			strReason = "out of GPU memory";
+			return false;
+		}
+
+		_pTarget = &target;
+
+		_params.uShiftR = target._uShiftR;
+		_params.uShiftG = target._uShiftG;
+		for ( int i = 0; i < 3; ++i )
+		{
+			_params.uDrop[ i ] = 8 - target._uBits[ i ];
+		}
+
+		const UINT zeros[ 4 ] = { 0, 0, 0, 0 };
+		_pContext->ClearUnorderedAccessViewUint( _pCountsView, zeros );
+		_pContext->ClearUnorderedAccessViewUint( _pFlagsView, zeros );
+
+		ID3D11UnorderedAccessView* aViews[ 2 ] = { _pCountsView, _pFlagsView };
+
+		_pContext->CSSetShader( _pShader, nullptr, 0 );
+		_pContext->CSSetShaderResources( 0, 1, &_pPixelsView );
+		_pContext->CSSetUnorderedAccessViews( 0, 2, aViews, nullptr );
+		_pContext->CSSetConstantBuffers( 0, 1, &_pParams );
+
+		return true;
+	}
+
+	bool create_raw_buffer( uint32_t uBytes, UINT uBind, ID3D11Buffer** ppBuffer )
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = uBytes;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = uBind;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+
+		return SUCCEEDED( _pDevice->CreateBuffer( &desc, nullptr, ppBuffer ) );
+	}
+
+	bool create_staging_buffer( uint32_t uBytes, ID3D11Buffer** ppBuffer )
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = uBytes;
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+		return SUCCEEDED( _pDevice->CreateBuffer( &desc, nullptr, ppBuffer ) );
+	}
+
+	//
+	// Count
+	//
+	// Add a decoded image to the GPU histogram. Returns false if the GPU has failed,
+	// and the image should be counted on the CPU.
+	//
+	bool Count( const uint8_t* data, int width, int height, int chan_count )
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+
+		if ( _bFailed )
+		{
+			return false;
+		}
+
+		size_t remaining = size_t( width ) * size_t( height );
+
+		while ( remaining > 0 )
+		{
+			const uint32_t count = uint32_t( std::min< size_t >( remaining, kChunkPixels ) );
+
+			// no counter can pass 2^32 - 1 if the pixels since the last read back don't.
+			if ( _uPending + count > UINT32_MAX && !read_back() )
+			{
+				return false;
+			}
+
+			D3D11_BOX box = {};
+			box.right = count * chan_count;
+			box.bottom = 1;
+			box.back = 1;
+
+			_params.uPixelCount = count;
+			_params.uChanCount = chan_count;
+
+			_pContext->UpdateSubresource( _pPixels, 0, &box, data, 0, 0 );
+			_pContext->UpdateSubresource( _pParams, 0, nullptr, &_params, 0, 0 );
+			_pContext->Dispatch( ( count + kGroupSize - 1 ) / kGroupSize, 1, 1 );
+
+			_uPending += count;
+			data += size_t( count ) * chan_count;
+			remaining -= count;
+		}
+
+		return true;
+	}
+
+	//
+	// Finish
+	//
+	// Read the remaining counts back into the target histogram.
+	//
+	bool Finish( bool& bMaskDetected )
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+
+		if ( _bFailed || !read_back() )
+		{
+			return false;
+		}
+
+		bMaskDetected |= _bMaskDetected;
+		return true;
+	}
+
+	bool read_back()
+	{
+		_pContext->CopyResource( _pReadCounts, _pCounts );
+		_pContext->CopyResource( _pReadFlags, _pFlags );
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+
+		if ( FAILED( _pContext->Map( _pReadCounts, 0, D3D11_MAP_READ, 0, &mapped ) ) )
+		{
+			_bFailed = true;
+			return false;
+		}
+
+		_pTarget->MergeCounts( static_cast< const uint32_t* >( mapped.pData ), _pTarget->_aCounts.size() );
+		_pContext->Unmap( _pReadCounts, 0 );
+
+		if ( FAILED( _pContext->Map( _pReadFlags, 0, D3D11_MAP_READ, 0, &mapped ) ) )
+		{
+			_bFailed = true;
+			return false;
+		}
+
+		_bMaskDetected |= ( *static_cast< const uint32_t* >( mapped.pData ) != 0 );
+		_pContext->Unmap( _pReadFlags, 0 );
+
+		const UINT zeros[ 4 ] = { 0, 0, 0, 0 };
+		_pContext->ClearUnorderedAccessViewUint( _pCountsView, zeros );
+
+		_uPending = 0;
+		return true;
+	}
+};
+
+//
+// analyse_image_memory
+//
+// Decode and count a single (mapped) image file into the given histogram.
+// Progress text is returned in strLog so that parallel workers don't interleave.
+// Returns true if the whole image was counted; if not, some of it may have been.
+//
+static bool analyse_image_memory( const options_t& options,
+								  const uint8_t* pData,
+								  size_t uSize,
+								  color_histogram_t& unique_colors,
+								  bool& bMaskDetected,
+								  stats_t& stats,
+								  std::string& strLog,
+								  gpu_counter_t* pGpu = nullptr )
+{
+	TRACE_ZONE( "decode_image" );
+
+	int w, h, chan_count;
+	unsigned char* data;
+
+	bool bSuccess = false;
+
+	// the GPU takes whole images, so PNGs aren't streamed.
+	if ( options.bStream && pGpu == nullptr && analyse_png_stream( options, pData, uSize, unique_colors, bMaskDetected, bSuccess, stats, strLog ) )
+	{
+		return bSuccess;
+	}
+
+	if ( uSize > size_t( INT_MAX ) )
+	{
+		strLog += "FAILED\n";
+		return false;
+	}
+
+	const tClock::time_point t0 = tClock::now();
+
+	data = stbi_load_from_memory( pData, static_cast<int>( uSize ), &w, &h, &chan_count, 0 );
+
+	stats.fDecodeMs += elapsed_ms( t0 );
+
+	if ( data == nullptr )
+	{
+		strLog += "FAILED\n";
+		return false;
+	}
+	else if ( chan_count != 3 && chan_count != 4 )
+	{
+		strLog += "INVALID-CHANNELS (" + std::to_string( chan_count ) + ")\n";
+		stbi_image_free( data );
+		return false;
+	}
+
+	strLog += "LOADED (" + std::to_string( w ) + " x " + std::to_string( h ) + ") ... ";
+
+	const tClock::time_point t1 = tClock::now();
+
+	if ( pGpu == nullptr || !pGpu->Count( data, w, h, chan_count ) )
+	{
+		count_image_pixels( options, data, w, h, 0, chan_count, nullptr, unique_colors, bMaskDetected );
+	}
+
+	stats.fCountMs += elapsed_ms( t1 );
+	stats.uFiles++;
+	stats.uPixels += uint64_t( w ) * uint64_t( h );
+
+	stbi_image_free( data );
+
+	strLog += "OK\n";
+	return true;
+}
+
+//
+// decode_queue_t
+//
+// Bounded queue of mapped files, between the reader thread and the decode workers.
+// Push blocks while the mapped bytes in flight (queued, or still being decoded)
+// would go over the limit; a single file larger than the limit is still let through
+// on its own. Its depth is the "decode" stage's for palstat.h.
+//
+struct decode_queue_t
+{
+	struct job_t
+	{
+		size_t index;
+		std::unique_ptr< mapped_file_t > file; // nullptr if the file couldn't be mapped.
+	};
+
+	std::mutex _mutex;
+	std::condition_variable _cvSpace;
+	std::condition_variable _cvJobs;
+	std::deque< job_t > _aJobs;
+
+	size_t _uBytesInFlight = 0;
+	size_t _uByteLimit = 0;
+	bool _bClosed = false;
+
+	stat_depth_t _depth{ "decode", 0 }; // held to bytes, not a count of files.
+
+public:
+
+	void Push( job_t job )
+	{
+		const size_t bytes = job.file ? job.file->_uSize : 0;
+
+		std::unique_lock< std::mutex > lock( _mutex );
+		_cvSpace.wait( lock, [&]() { return _uBytesInFlight == 0 || _uBytesInFlight + bytes <= _uByteLimit; } );
+
+		_uBytesInFlight += bytes;
+		_aJobs.push_back( std::move( job ) );
+		_depth.Add( 1 );
+		_cvJobs.notify_one();
+	}
+
+	bool Pop( job_t& job )
+	{
+		std::unique_lock< std::mutex > lock( _mutex );
+		_cvJobs.wait( lock, [&]() { return !_aJobs.empty() || _bClosed; } );
+
+		if ( _aJobs.empty() )
+			return false;
+
+		job = std::move( _aJobs.front() );
+		_aJobs.pop_front();
+		_depth.Add( -1 );
+		return true;
+	}
+
+	// Unmap a finished job and release its bytes.
+	void Release( job_t& job )
+	{
+		const size_t bytes = job.file ? job.file->_uSize : 0;
+		job.file.reset();
+
+		std::lock_guard< std::mutex > lock( _mutex );
+		_uBytesInFlight -= bytes;
+		_cvSpace.notify_all();
+	}
+
+	void Close()
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+		_bClosed = true;
+		_cvJobs.notify_all();
+	}
+};
+
+//==============================================================================
+
+//
+// Histogram cache
+//
+// A binary sidecar holding the color counts of each analysed file, keyed by path,
+// modification time and size. Unchanged files are merged straight from the cache,
+// so only new or changed files need to be decoded.
+//
+// Layout (native byte order):
+//   uint32 magic, uint32 version, uint32 histogram mode, uint32 flags (1 = -lum, 2 = -alpha), uint32 sample rate,
+//   uint32 file count
+//   per file: uint32 path length, path, int64 mtime, uint64 size, uint8 mask detected,
+//             uint64 entry count, { uint32 color key, uint64 pixel count } * entry count
+//
+
+static constexpr uint32_t kCacheMagic = 0x43484750; // "PGHC"
+static constexpr uint32_t kCacheVersion = 3;
+
+struct cache_entry_t
+{
+	int64_t mtime = 0;
+	uint64_t size = 0;
+	bool bMaskDetected = false;
+
+	tColorCountList aCounts;
+};
+
+typedef std::map< std::string, cache_entry_t > tHistogramCache;
+
+// receives the color counts of each file, instead of merging them into one histogram.
+typedef std::function< void( const std::string& file_name, const cache_entry_t& entry ) > tFileSink;
+
+template< typename T >
+static bool cache_read( FILE* fp, T& value )
+{
+	return fread( &value, sizeof( T ), 1, fp ) == 1;
+}
+
+template< typename T >
+static void cache_write( FILE* fp, const T& value )
+{
+	fwrite( &value, sizeof( T ), 1, fp );
+}
+
+static uint32_t cache_flags( const options_t& options )
+{
+	return ( options.bLuminance ? 1 : 0 ) | ( options.bAlpha ? 2 : 0 ) | ( options.uEdgeWeight << 8 );
+}
+
+//
+// get_file_stamp
+//
+// Fetch the modification time and size used to validate a cache entry.
+//
+static bool get_file_stamp( const std::string& file_name, cache_entry_t& entry )
+{
+	std::error_code ec;
+
+	const auto mtime = std::filesystem::last_write_time( file_name, ec );
+	if ( ec )
+		return false;
+
+	const auto size = std::filesystem::file_size( file_name, ec );
+	if ( ec )
+		return false;
+
+	entry.mtime = static_cast<int64_t>( mtime.time_since_epoch().count() );
+	entry.size = static_cast<uint64_t>( size );
+	return true;
+}
+
+//
+// read_histogram_cache
+//
+// Load the cache file. A missing, damaged or mismatched (-hist, -lum, -alpha, -sample) cache
+// is discarded as a whole, and every file is decoded again.
+//
+static void read_histogram_cache( const options_t& options, tHistogramCache& cache )
+{
+	cache.clear();
+
+	printf( "Reading cache \"%s\" ... ", options.strCacheFile.c_str() );
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, options.strCacheFile.c_str(), "rb" );
+
+	if ( e != 0 || fp == nullptr )
+	{
+		printf( "NONE\n" );
+		return;
+	}
+
+	uint32_t magic = 0, version = 0, mode = 0, flags = 0, rate = 0, file_count = 0;
+
+	bool bValid = cache_read( fp, magic ) && cache_read( fp, version ) && magic == kCacheMagic && version == kCacheVersion
+			   && cache_read( fp, mode ) && cache_read( fp, flags ) && cache_read( fp, rate ) && cache_read( fp, file_count );
+
+	if ( bValid && ( mode != uint32_t( options.histogram ) || flags != cache_flags( options ) || rate != options.uSampleRate ) )
+	{
+		fclose( fp );
+		printf( "MISMATCH (rebuilding)\n" );
+		return;
+	}
+
+	// the bytes after the header, to bound each entry's count: a key and a pixel count
+	// each, however many keys the mode and -alpha allow.
+	constexpr uint64_t kCountBytes = sizeof( uint32_t ) + sizeof( uint64_t );
+
+	std::error_code ec;
+	const uint64_t uFileBytes = std::filesystem::file_size( options.strCacheFile, ec );
+	uint64_t uLeft = ( ec || uFileBytes < 6 * sizeof( uint32_t ) ) ? 0 : uFileBytes - 6 * sizeof( uint32_t );
+
+	for ( uint32_t i = 0; bValid && i < file_count; ++i )
+	{
+		uint32_t path_length = 0;
+		uint8_t mask = 0;
+		uint64_t entry_count = 0;
+		cache_entry_t entry;
+
+		bValid = cache_read( fp, path_length ) && path_length < 0x10000;
+		if ( !bValid )
+			break;
+
+		std::string file_name( path_length, '\0' );
+
+		const uint64_t uHeadBytes = sizeof( path_length ) + path_length + sizeof( entry.mtime ) + sizeof( entry.size ) + sizeof( mask ) + sizeof( entry_count );
+
+		bValid = ( fread( file_name.data(), 1, path_length, fp ) == path_length )
+			  && cache_read( fp, entry.mtime ) && cache_read( fp, entry.size )
+			  && cache_read( fp, mask ) && cache_read( fp, entry_count )
+			  && uHeadBytes <= uLeft && entry_count <= ( uLeft - uHeadBytes ) / kCountBytes;
+
+		if ( bValid )
+		{
+			uLeft -= uHeadBytes + entry_count * kCountBytes;
+		}
+
+		entry.bMaskDetected = ( mask != 0 );
+		entry.aCounts.resize( bValid ? size_t( entry_count ) : 0 );
+
+		for ( auto& [key, count] : entry.aCounts )
+		{
+			if ( !cache_read( fp, key ) || !cache_read( fp, count ) )
+			{
+				bValid = false;
+				break;
+			}
+		}
+
+		if ( bValid )
+		{
+			cache[ file_name ] = std::move( entry );
+		}
+	}
+
+	fclose( fp );
+
+	if ( bValid == false )
+	{
+		cache.clear();
+		printf( "INVALID (rebuilding)\n" );
+		return;
+	}
+
+	printf( "OK (%zu files)\n", cache.size() );
+}
+
+//
+// write_histogram_cache
+//
+// Save the per file color counts for the next run.
+//
+static void write_histogram_cache( const options_t& options, const tHistogramCache& cache )
+{
+	printf( "Writing cache \"%s\" ... ", options.strCacheFile.c_str() );
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, options.strCacheFile.c_str(), "wb" );
+
+	if ( e != 0 || fp == nullptr )
+	{
+		printf( "FAILED\n" );
+		return;
+	}
+
+	cache_write( fp, kCacheMagic );
+	cache_write( fp, kCacheVersion );
+	cache_write( fp, uint32_t( options.histogram ) );
+	cache_write( fp, cache_flags( options ) );
+	cache_write( fp, options.uSampleRate );
+	cache_write( fp, uint32_t( cache.size() ) );
+
+	for ( const auto& [file_name, entry] : cache )
+	{
+		cache_write( fp, uint32_t( file_name.size() ) );
+		fwrite( file_name.data(), 1, file_name.size(), fp );
+		cache_write( fp, entry.mtime );
+		cache_write( fp, entry.size );
+		cache_write( fp, uint8_t( entry.bMaskDetected ? 1 : 0 ) );
+		cache_write( fp, uint64_t( entry.aCounts.size() ) );
+
+		for ( const auto& [key, count] : entry.aCounts )
+		{
+			cache_write( fp, key );
+			cache_write( fp, count );
+		}
+	}
+
+	const bool bOK = ( ferror( fp ) == 0 );
+
+	fclose( fp );
+
+	printf( bOK ? "OK\n" : "FAILED\n" );
+}
+
+//
+// merge_cache_entry
+//
+// Add the color counts of one cached file into the histogram.
+//
+static void merge_cache_entry( const cache_entry_t& entry, color_histogram_t& unique_colors, bool& bMaskDetected )
+{
+	color_t col;
+
+	for ( const auto& [key, count] : entry.aCounts )
+	{
+		col.value_abgr = key;
+		unique_colors.Add( col, size_t( count ) );
+	}
+
+	bMaskDetected |= entry.bMaskDetected;
+}
+
+//==============================================================================
+
+//
+// Partial histograms
+//
+// -partial=<file> writes the summed color counts of its inputs, so counting can be
+// split across machines, each with a shard of the images. -merge then adds up any
+// number of partials and makes the palette. Counts are integers and keys are sorted, so
+// the merged histogram, and the palette, are the same in any order or sharding, and
+// the same as counting every image in one run. A -merge can also write a -partial,
+// to reduce in stages.
+//
+// Layout (native byte order):
+//   uint32 magic, uint32 version, uint32 histogram mode, uint32 flags (as the cache), uint32 sample rate,
+//   uint8 mask detected, uint64 file count, uint64 pixel count, uint64 entry count,
+//   uint32 color key * entry count, then uint64 pixel count * entry count
+//
+
+static constexpr uint32_t kPartialMagic = 0x50484750; // "PGHP"
+static constexpr uint32_t kPartialVersion = 1;
+
+//
+// write_partial_histogram
+//
+// Save the counts, which leaves unique_colors empty.
+//
+static bool write_partial_histogram( const options_t& options, color_histogram_t& unique_colors, bool bMaskDetected, const stats_t& stats )
+{
+	printf( "Writing partial \"%s\" ... ", options.strPartialFile.c_str() );
+
+	tColorCountList aCounts;
+	unique_colors.Extract( aCounts );
+
+	std::vector< uint32_t > aKeys( aCounts.size() );
+	std::vector< uint64_t > aTotals( aCounts.size() );
+
+	for ( size_t i = 0; i < aCounts.size(); ++i )
+	{
+		aKeys[ i ] = aCounts[ i ].first;
+		aTotals[ i ] = aCounts[ i ].second;
+	}
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, options.strPartialFile.c_str(), "wb" );
+
+	if ( e != 0 || fp == nullptr )
+	{
+		printf( "FAILED\n" );
+		return false;
+	}
+
+	cache_write( fp, kPartialMagic );
+	cache_write( fp, kPartialVersion );
+	cache_write( fp, uint32_t( options.histogram ) );
+	cache_write( fp, cache_flags( options ) );
+	cache_write( fp, options.uSampleRate );
+	cache_write( fp, uint8_t( bMaskDetected ? 1 : 0 ) );
+	cache_write( fp, stats.uFiles );
+	cache_write( fp, stats.uPixels );
+	cache_write( fp, uint64_t( aKeys.size() ) );
+
+	fwrite( aKeys.data(), sizeof( uint32_t ), aKeys.size(), fp );
+	fwrite( aTotals.data(), sizeof( uint64_t ), aTotals.size(), fp );
+
+	const bool bOK = ( ferror( fp ) == 0 );
+
+	fclose( fp );
+
+	printf( bOK ? "OK (%zu colors)\n" : "FAILED\n", aKeys.size() );
+	return bOK;
+}
+
+//
+// merge_partial_histograms
+//
+// -merge: add the counts of every input partial into unique_colors. Returns false if
+// one can't be read, or was counted with other -hist, -lum, -alpha or -sample options,
+// since a palette of only some of the counts would be quietly wrong.
+//
+static bool merge_partial_histograms( const options_t& options, color_histogram_t& unique_colors, bool& bMaskDetected, stats_t& stats )
+{
+	std::vector< uint32_t > aKeys;
+	std::vector< uint64_t > aTotals;
+
+	for ( const std::string& file_name : options.aInputFiles )
+	{
+		printf( "Merge: \"%s\" ... ", file_name.c_str() );
+
+		FILE* fp = nullptr;
+		int e = fopen_s( &fp, file_name.c_str(), "rb" );
+
+		if ( e != 0 || fp == nullptr )
+		{
+			printf( "FAILED\n" );
+			return false;
+		}
+
+		uint32_t magic = 0, version = 0, mode = 0, flags = 0, rate = 0;
+		uint8_t mask = 0;
+		uint64_t files = 0, pixels = 0, entry_count = 0;
+
+		bool bValid = cache_read( fp, magic ) && cache_read( fp, version ) && magic == kPartialMagic && version == kPartialVersion
+				   && cache_read( fp, mode ) && cache_read( fp, flags ) && cache_read( fp, rate ) && cache_read( fp, mask )
+				   && cache_read( fp, files ) && cache_read( fp, pixels ) && cache_read( fp, entry_count )
+				   && entry_count <= ( uint64_t( 1 ) << 32 );
+
+		if ( bValid && ( mode != uint32_t( options.histogram ) || flags != cache_flags( options ) || rate != options.uSampleRate ) )
+		{
+			fclose( fp );
+			printf( "MISMATCH (counted with other -hist, -lum, -alpha or -sample options)\n" );
+			return false;
+		}
+
+		if ( bValid )
+		{
+			aKeys.resize( size_t( entry_count ) );
+			aTotals.resize( size_t( entry_count ) );
+
+			bValid = fread( aKeys.data(), sizeof( uint32_t ), aKeys.size(), fp ) == aKeys.size()
+				  && fread( aTotals.data(), sizeof( uint64_t ), aTotals.size(), fp ) == aTotals.size();
+		}
+
+		fclose( fp );
+
+		if ( bValid == false )
+		{
+			printf( "INVALID\n" );
+			return false;
+		}
+
+		color_t col;
+
+		for ( size_t i = 0; i < aKeys.size(); ++i )
+		{
+			col.value_abgr = aKeys[ i ];
+			unique_colors.Add( col, size_t( aTotals[ i ] ) );
+		}
+
+		bMaskDetected |= ( mask != 0 );
+		stats.uFiles += files;
+		stats.uPixels += pixels;
+
+		printf( "OK (%llu files, %zu colors)\n", static_cast<unsigned long long>( files ), aKeys.size() );
+	}
+
+	return true;
+}
+
+//
+// histogram_workers
+//
+// How many workers may count at once, each with its own histogram table, within
+// -histmem. At least one, whatever the limit; the dense 24-bit table alone is 128 MB.
+//
+static size_t histogram_workers( const options_t& options, size_t uWorkers )
+{
+	const size_t uTableBytes = color_histogram_t::TableBytes( options.histogram, options.bAlpha );
+
+	if ( uTableBytes == 0 )
+	{
+		return uWorkers;
+	}
+
+	const size_t uFit = std::max< size_t >( 1, ( size_t( options.uHistogramMB ) << 20 ) / uTableBytes );
+
+	if ( uFit < uWorkers )
+	{
+		std::cout << "Counting on " << uFit << " of " << uWorkers << " threads, a histogram each is " << ( uTableBytes >> 20 ) << " MB (-histmem=" << options.uHistogramMB << ").\n";
+		return uFit;
+	}
+
+	return uWorkers;
+}
+
+//
+// analyse_images
+//
+// Load and run count_unique_image_cols on all image files to build a color histogram.
+// A reader thread maps the files onto a bounded queue, and a pool of workers decodes
+// and counts them, each into a private histogram, which is merged into unique_colors
+// once the image is done; an image that fails part way is dropped. Counting is order
+// independent, so the result matches a serial run.
+//
+// With a cache file, unchanged files are taken from the cache, and each decoded file
+// is extracted from its worker's histogram so that it can be written back. With a
+// sink, the counts of each file are passed to it rather than merged into unique_colors.
+//
+static void analyse_images( const options_t& options,
+							color_histogram_t& unique_colors,
+							bool& bMaskDetected,
+							stats_t& stats,
+							const tFileSink* pSink = nullptr )
+{
+	TRACE_ZONE( "analyse_images" );
+
+	const bool bUseCache = !options.strCacheFile.empty();
+	const bool bPerFile = bUseCache || ( pSink != nullptr );
+
+	tHistogramCache cacheOld;
+	tHistogramCache cacheNew;
+
+	if ( bUseCache )
+	{
+		read_histogram_cache( options, cacheOld );
+	}
+
+	std::vector< std::string > file_names;
+	std::vector< cache_entry_t > aEntries;
+	std::vector< bool > aStamped;
+
+	for ( const std::string& file_name : options.aInputFiles )
+	{
+		cache_entry_t stamp;
+		bool bStamped = false;
+
+		if ( bUseCache )
+		{
+			bStamped = get_file_stamp( file_name, stamp );
+
+			auto it = cacheOld.find( file_name );
+			if ( bStamped && it != cacheOld.end() && it->second.mtime == stamp.mtime && it->second.size == stamp.size )
+			{
+				std::cout << "Analyze: \"" << file_name << "\" ... CACHED\n";
+
+				if ( pSink )
+					( *pSink )( file_name, it->second );
+				else
+					merge_cache_entry( it->second, unique_colors, bMaskDetected );
+
+				cacheNew[ file_name ] = std::move( it->second );
+				continue;
+			}
+		}
+
+		if ( bPerFile )
+		{
+			aEntries.push_back( stamp );
+			aStamped.push_back( bStamped );
+		}
+
+		file_names.push_back( file_name );
+	}
+
+	// Count on the GPU where it can give the same histogram as the CPU.
+	std::unique_ptr< gpu_counter_t > pGpu;
+
+	if ( options.bGpu && !file_names.empty() )
+	{
+		std::string strReason;
+
+		if ( bPerFile )
+			strReason = "-cache and -manifest need counts per file";
+		else if ( !unique_colors._bDense )
+			strReason = "-hist=map, -hist=2level and -alpha are not supported";
+		else if ( options.bLuminance )
+			strReason = "-lum is not supported";
+		else if ( options.uSampleRate > 1 )
+			strReason = "-sample is not supported";
+		else if ( options.uEdgeWeight > 0 )
+			strReason = "-edges is not supported";
+		else if ( options.order == ORDER_ADJACENT )
+			strReason = "-order=adjacent is not supported";
+		else
+		{
+			pGpu = std::make_unique< gpu_counter_t >();
+			if ( !pGpu->Init( unique_colors, strReason ) )
+			{
+				pGpu.reset();
+			}
+		}
+
+		if ( pGpu )
+			std::cout << "Counting on the GPU.\n";
+		else
+			std::cout << "Counting on the CPU, " << strReason << ".\n";
+	}
+
+	struct worker_t
+	{
+		color_histogram_t histogram; // the image being counted.
+		bool bMaskDetected = false;
+		stats_t stats;
+	};
+
+	const size_t uThreadCount = histogram_workers( options, std::max< size_t >( 1, std::min< size_t >( options.uThreadCount, file_names.size() ) ) );
+
+	std::vector< worker_t > aWorkers( uThreadCount );
+	std::vector< uint8_t > aSuccess( file_names.size(), 0 ); // not vector< bool >, workers write concurrently.
+	std::mutex mutexLog;
+	std::mutex mutexColors; // unique_colors
+
+	stat_files( file_names.size() );
+
+	decode_queue_t queue;
+	queue._uByteLimit = size_t( options.uInFlightMB ) << 20;
+
+	// Reader - map the files in order, as fast as the queue allows.
+	std::thread reader( [&]()
+						{
+							for ( size_t index = 0; index < file_names.size(); ++index )
+							{
+								auto file = std::make_unique< mapped_file_t >();
+								if ( !file->Open( file_names[ index ] ) )
+								{
+									file.reset();
+								}
+
+								queue.Push( { index, std::move( file ) } );
+							}
+
+							queue.Close();
+						} );
+
+	auto worker_fn = [&]( worker_t& worker )
+	{
+		stat_worker_t stat_worker;
+
+		// each image is counted on its own, so that one which fails part way can be dropped.
+		worker.histogram.Create( options.histogram, options.bAlpha, options.order == ORDER_ADJACENT, true );
+
+		decode_queue_t::job_t job;
+
+		while ( queue.Pop( job ) )
+		{
+			stat_busy_t busy;
+
+			const size_t index = job.index;
+			const uint64_t uPixels = worker.stats.uPixels;
+			const uint64_t uBytes = job.file ? job.file->_uSize : 0;
+			bool bOK = false;
+
+			std::string strLog = "Analyze: \"" + file_names[ index ] + "\" ... ";
+
+			if ( job.file == nullptr )
+			{
+				strLog += "FAILED\n";
+			}
+			else if ( bPerFile )
+			{
+				cache_entry_t& entry = aEntries[ index ];
+				aSuccess[ index ] = bOK = analyse_image_memory( options, job.file->_pData, job.file->_uSize, worker.histogram, entry.bMaskDetected, worker.stats, strLog );
+				worker.histogram.Extract( entry.aCounts );
+
+				if ( !bOK )
+				{
+					entry.aCounts.clear();
+					entry.bMaskDetected = false;
+				}
+			}
+			else
+			{
+				bool bMask = false;
+				bOK = analyse_image_memory( options, job.file->_pData, job.file->_uSize, worker.histogram, bMask, worker.stats, strLog, pGpu.get() );
+
+				if ( bOK )
+				{
+					std::lock_guard< std::mutex > lock( mutexColors );
+					unique_colors.Drain( worker.histogram );
+					worker.bMaskDetected |= bMask;
+				}
+				else
+				{
+					worker.histogram.Clear();
+				}
+			}
+
+			queue.Release( job );
+			stat_file_done( bOK, uBytes, 0, worker.stats.uPixels - uPixels );
+
+			std::lock_guard< std::mutex > lock( mutexLog );
+			std::cout << strLog;
+		}
+	};
+
+	if ( uThreadCount == 1 )
+	{
+		worker_fn( aWorkers[ 0 ] );
+	}
+	else
+	{
+		std::vector< std::thread > aThreads;
+
+		for ( worker_t& worker : aWorkers )
+		{
+			aThreads.emplace_back( worker_fn, std::ref( worker ) );
+		}
+
+		for ( std::thread& thread : aThreads )
+		{
+			thread.join();
+		}
+	}
+
+	reader.join();
+
+	if ( pGpu && !pGpu->Finish( bMaskDetected ) )
+	{
+		std::cout << "Error - the GPU failed, its counts are incomplete.\n";
+	}
+
+	// every worker histogram is alive at once, alongside the output.
+	stats.uPeakHistogramBytes = unique_colors.MemoryBytes();
+	for ( worker_t& worker : aWorkers )
+	{
+		stats.uPeakHistogramBytes += worker.histogram.MemoryBytes();
+		stats.Add( worker.stats );
+	}
+
+	// Reduction
+	if ( bPerFile )
+	{
+		for ( size_t i = 0; i < file_names.size(); ++i )
+		{
+			if ( pSink )
+				( *pSink )( file_names[ i ], aEntries[ i ] );
+			else
+				merge_cache_entry( aEntries[ i ], unique_colors, bMaskDetected );
+
+			// only cache files that were read in full.
+			if ( bUseCache && aStamped[ i ] && aSuccess[ i ] )
+			{
+				cacheNew[ file_names[ i ] ] = std::move( aEntries[ i ] );
+			}
+		}
+
+		// skip the write if every file came from the cache and none were dropped.
+		if ( bUseCache && ( !file_names.empty() || cacheNew.size() != cacheOld.size() ) )
+		{
+			write_histogram_cache( options, cacheNew );
+		}
+	}
+	else
+	{
+		for ( worker_t& worker : aWorkers )
+		{
+			bMaskDetected |= worker.bMaskDetected;
+		}
+	}
+}
+
+//
+// frame_queue_t
+//
+// A fixed pool of -raw frame buffers, between the stdin reader and the counting workers.
+// Acquire blocks until a buffer is free, Pop until one has been filled (or the queue is
+// closed), so the frames in flight are capped by the size of the pool.
+//
+struct frame_queue_t
+{
+	std::vector< std::vector< uint8_t > > _aBuffers;
+
+	std::mutex _mutex;
+	std::condition_variable _cvFree;
+	std::condition_variable _cvFull;
+	std::vector< uint8_t* > _aFree;
+	std::deque< uint8_t* > _aFull;
+
+	bool _bClosed = false;
+
+public:
+
+	void Create( size_t uCount, size_t uBytes )
+	{
+		_aBuffers.resize( uCount );
+
+		for ( std::vector< uint8_t >& buffer : _aBuffers )
+		{
+			buffer.resize( uBytes );
+			_aFree.push_back( buffer.data() );
+		}
+	}
+
+	uint8_t* Acquire()
+	{
+		std::unique_lock< std::mutex > lock( _mutex );
+		_cvFree.wait( lock, [&]() { return !_aFree.empty(); } );
+
+		uint8_t* pFrame = _aFree.back();
+		_aFree.pop_back();
+		return pFrame;
+	}
+
+	void Push( uint8_t* pFrame )
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+		_aFull.push_back( pFrame );
+		_cvFull.notify_one();
+	}
+
+	bool Pop( uint8_t*& pFrame )
+	{
+		std::unique_lock< std::mutex > lock( _mutex );
+		_cvFull.wait( lock, [&]() { return !_aFull.empty() || _bClosed; } );
+
+		if ( _aFull.empty() )
+			return false;
+
+		pFrame = _aFull.front();
+		_aFull.pop_front();
+		return true;
+	}
+
+	// Hand a counted frame back to the reader.
+	void Release( uint8_t* pFrame )
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+		_aFree.push_back( pFrame );
+		_cvFree.notify_one();
+	}
+
+	void Close()
+	{
+		std::lock_guard< std::mutex > lock( _mutex );
+		_bClosed = true;
+		_cvFull.notify_all();
+	}
+};
+
+//
+// analyse_raw_frames
+//
+// -raw: count frames of packed pixels read from stdin until it ends, such as a video
+// piped from ffmpeg, without anything going through disk. A reader thread fills frames
+// from a pool sized by -inflight, and a pool of workers counts them, each into a private
+// histogram, which are then merged. With -skip=N only frames 0, N, 2N ... are counted;
+// the rest are read over into the same buffer.
+//
+static void analyse_raw_frames( const options_t& options,
+								color_histogram_t& unique_colors,
+								bool& bMaskDetected,
+								stats_t& stats )
+{
+	TRACE_ZONE( "analyse_raw_frames" );
+
+	const int w = options.iRawWidth;
+	const int h = options.iRawHeight;
+	const int chan_count = options.iRawChannels;
+	const size_t uFrameBytes = size_t( w ) * size_t( h ) * size_t( chan_count );
+
+	if ( options.bGpu )
+	{
+		std::cout << "Counting on the CPU, -raw is not supported.\n";
+	}
+
+	std::cout << "Analyze: frames of (" << w << " x " << h << ") " << ( chan_count == 4 ? "RGBA" : "RGB" ) << " from stdin ...\n";
+
+	// stdin is text by default, which would turn \r\n into \n inside a frame.
+	_setmode( _fileno( stdin ), _O_BINARY );
+
+	struct worker_t
+	{
+		color_histogram_t histogram;
+		bool bMaskDetected = false;
+		stats_t stats;
+	};
+
+	const size_t uThreadCount = histogram_workers( options, std::max< size_t >( 1, options.uThreadCount ) );
+	const size_t uFrames = std::clamp< size_t >( ( size_t( options.uInFlightMB ) << 20 ) / uFrameBytes, 2, uThreadCount * 2 );
+
+	std::vector< worker_t > aWorkers( uThreadCount );
+
+	frame_queue_t queue;
+	queue.Create( uFrames, uFrameBytes );
+
+	uint64_t uFramesRead = 0;
+	size_t uShortBytes = 0; // of a last frame that was cut off.
+	double fReadMs = 0;
+
+	// Reader - fill frames in order, as fast as the workers free them.
+	std::thread reader( [&]()
+						{
+							uint8_t* pFrame = nullptr;
+
+							for ( ;; )
+							{
+								if ( pFrame == nullptr )
+								{
+									pFrame = queue.Acquire();
+								}
+
+								const tClock::time_point t0 = tClock::now();
+								const size_t uRead = fread( pFrame, 1, uFrameBytes, stdin );
+								fReadMs += elapsed_ms( t0 );
+
+								if ( uRead != uFrameBytes )
+								{
+									uShortBytes = uRead;
+									break;
+								}
+
+								if ( uFramesRead++ % options.uFrameSkip == 0 )
+								{
+									queue.Push( pFrame );
+									pFrame = nullptr;
+								}
+							}
+
+							queue.Close();
+						} );
+
+	auto worker_fn = [&]( worker_t& worker )
+	{
+		worker.histogram.Create( options.histogram, options.bAlpha, options.order == ORDER_ADJACENT );
+
+		uint8_t* pFrame;
+
+		while ( queue.Pop( pFrame ) )
+		{
+			const tClock::time_point t0 = tClock::now();
+
+			count_image_pixels( options, pFrame, w, h, 0, chan_count, nullptr, worker.histogram, worker.bMaskDetected );
+
+			worker.stats.fCountMs += elapsed_ms( t0 );
+			worker.stats.uFiles++;
+			worker.stats.uPixels += uint64_t( w ) * uint64_t( h );
+
+			queue.Release( pFrame );
+		}
+	};
+
+	if ( uThreadCount == 1 )
+	{
+		worker_fn( aWorkers[ 0 ] );
+	}
+	else
+	{
+		std::vector< std::thread > aThreads;
+
+		for ( worker_t& worker : aWorkers )
+		{
+			aThreads.emplace_back( worker_fn, std::ref( worker ) );
+		}
+
+		for ( std::thread& thread : aThreads )
+		{
+			thread.join();
+		}
+	}
+
+	reader.join();
+
+	stats.fDecodeMs += fReadMs;
+	stats.uPeakHistogramBytes = unique_colors.MemoryBytes();
+
+	for ( worker_t& worker : aWorkers )
+	{
+		stats.uPeakHistogramBytes += worker.histogram.MemoryBytes();
+		stats.Add( worker.stats );
+
+		unique_colors.Merge( worker.histogram );
+		bMaskDetected |= worker.bMaskDetected;
+	}
+
+	std::cout << "Analyze: " << uFramesRead << " frame(s) read, " << stats.uFiles << " counted.\n";
+
+	if ( uShortBytes != 0 )
+	{
+		std::cout << "Warning - the input ended " << uShortBytes << " bytes into a frame, which was not counted.\n";
+	}
+}
+
+//==============================================================================
+
+static int median_find_axis( const sColorTotal* pFirst, const sColorTotal* pLast, color_space_t space )
+{
+	int big_axis = 1;
+
+	if ( space == COLOR_SPACE_OKLAB )
+	{
+		float lo[ 3 ] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float hi[ 3 ] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		for ( const sColorTotal* pTotal = pFirst; pTotal < pLast; ++pTotal )
+		{
+			for ( int i = 0; i < 3; ++i )
+			{
+				lo[ i ] = std::min( lo[ i ], pTotal->_fLab[ i ] );
+				hi[ i ] = std::max( hi[ i ], pTotal->_fLab[ i ] );
+			}
+		}
+
+		float best = -1;
+		for ( int i = 0; i < 3; ++i )
+		{
+			if ( hi[ i ] - lo[ i ] > best )
+			{
+				best = hi[ i ] - lo[ i ];
+				big_axis = i; // L, a or b
+			}
+		}
+
+		return big_axis;
+	}
+
+	int r_min = 0xFF, g_min = 0xFF, b_min = 0xFF, a_min = 0xFF;
+	int r_max = 0, g_max = 0, b_max = 0, a_max = 0;
+
+	for ( const sColorTotal* pTotal = pFirst; pTotal < pLast; ++pTotal )
+	{
+		const color_t& color = pTotal->_colAverage;
+
+		r_min = std::min< int >( r_min, color.chan[ 0 ] );
+		g_min = std::min< int >( g_min, color.chan[ 1 ] );
+		b_min = std::min< int >( b_min, color.chan[ 2 ] );
+		a_min = std::min< int >( a_min, color.chan[ 3 ] );
+
+		r_max = std::max< int >( r_max, color.chan[ 0 ] );
+		g_max = std::max< int >( g_max, color.chan[ 1 ] );
+		b_max = std::max< int >( b_max, color.chan[ 2 ] );
+		a_max = std::max< int >( a_max, color.chan[ 3 ] );
+	}
+
+	int r_range, g_range, b_range, a_range;
+
+	r_range = r_max - r_min;
+	g_range = g_max - g_min;
+	b_range = b_max - b_min;
+	a_range = a_max - a_min; // only non-zero for an alpha histogram.
+
+	if ( g_range >= r_range && g_range >= b_range )
+		big_axis = 1; // G
+	else if ( b_range >= r_range && b_range >= g_range )
+		big_axis = 2; // B
+	else if ( r_range >= g_range && r_range >= b_range )
+		big_axis = 0; // R
+
+	if ( a_range > r_range && a_range > g_range && a_range > b_range )
+		big_axis = 3; // A
+
+	return big_axis;
+}
+
+//
+// median_partition_bucket
+//
+// Partially order the bucket along the given channel axis, so that every entry before
+// pMedian is less than or equal to every entry after it. Cheaper than a full sort.
+//
+// An RGB(A) key is one 8-bit channel, so the median's value is found from a histogram of
+// the key, and the bucket is then partitioned around it: below it, equal to it, above
+// it. Each is a linear pass, with no comparisons between entries. L, a and b are floats,
+// and use nth_element.
+//
+static void median_partition_bucket( sColorTotal* pFirst, sColorTotal* pMedian, sColorTotal* pLast, int channel_axis, color_space_t space )
+{
+	if ( pLast - pFirst < 2 )
+	{
+		return;
+	}
+
+	if ( space == COLOR_SPACE_OKLAB )
+	{
+		std::nth_element( pFirst, pMedian, pLast, [channel_axis]( const sColorTotal& t1, const sColorTotal& t2 )
+						  {
+							  return t1._fLab[ channel_axis ] < t2._fLab[ channel_axis ];
+						  } );
+		return;
+	}
+
+	const int shift = channel_axis * 8;
+
+	auto key = [shift]( const sColorTotal& total ) { return ( total._colAverage.value_abgr >> shift ) & 0xFF; };
+
+	size_t aCount[ 256 ] = {};
+
+	for ( const sColorTotal* pTotal = pFirst; pTotal < pLast; ++pTotal )
+	{
+		++aCount[ key( *pTotal ) ];
+	}
+
+	// the key of the entry that belongs at pMedian.
+	const size_t median = size_t( pMedian - pFirst );
+	uint32_t median_key = 0;
+
+	for ( size_t below = 0; below + aCount[ median_key ] <= median; ++median_key )
+	{
+		below += aCount[ median_key ];
+	}
+
+	sColorTotal* pEqual = std::partition( pFirst, pLast, [&]( const sColorTotal& total ) { return key( total ) < median_key; } );
+	std::partition( pEqual, pLast, [&]( const sColorTotal& total ) { return key( total ) == median_key; } );
+}
+
+static sColorTotal find_median_bucket_final_color( const std::vector< sColorTotal >& aColors, const color_range_t& bucket )
+{
+	sColorTotal mega( 0, 0 );
+
+	if ( bucket.Size() == 0 )
+	{
+		return mega;
+	}
+
+	for ( size_t i = bucket._uBegin; i < bucket._uEnd; ++i )
+	{
+		const sColorTotal& color = aColors[ i ];
+
+		mega._uTotal += color._uTotal;
+
+		mega._uScaledRGBA[ 0 ] += color._uScaledRGBA[ 0 ];
+		mega._uScaledRGBA[ 1 ] += color._uScaledRGBA[ 1 ];
+		mega._uScaledRGBA[ 2 ] += color._uScaledRGBA[ 2 ];
+		mega._uScaledRGBA[ 3 ] += color._uScaledRGBA[ 3 ];
+	}
+
+	mega.GenerateAverage();
+
+	return mega;
+}
+
+//
+// median_cut_inner
+//
+// Split the bucket source at its median, along its widest axis, into pOut[ 0 ] and pOut[ 1 ].
+//
+static void median_cut_inner( std::vector< sColorTotal >& aColors, const color_range_t& source, color_space_t space, color_range_t* pOut )
+{
+	sColorTotal* pFirst = aColors.data() + source._uBegin;
+	sColorTotal* pLast = aColors.data() + source._uEnd;
+
+	const size_t median_index = source._uBegin + ( ( source.Size() + 1 ) / 2 );
+
+	int axis = median_find_axis( pFirst, pLast, space );
+
+	median_partition_bucket( pFirst, aColors.data() + median_index, pLast, axis, space );
+
+	pOut[ 0 ] = { source._uBegin, median_index };
+	pOut[ 1 ] = { median_index, source._uEnd };
+}
+
+//
+// median_cut
+//
+// Works in place on the compacted color list. Buckets are ranges of that list.
+// For COLOR_SPACE_OKLAB, buckets are split along L, a or b (_fLab must be filled in).
+//
+// The buckets of a level are disjoint ranges, so they are split on up to thread_count
+// threads, each taking a run of them. Bucket i's halves always go to 2i and 2i + 1, and
+// a bucket's split depends only on its own colors, so the palette is the same for any
+// thread count.
+//
+static constexpr size_t kMedianColorsPerThread = 1 << 16;
+
+void median_cut( std::vector< sColorTotal >& aColors, const uint32_t max_colors, color_space_t space, std::vector< sColorTotal >& aPalette, size_t thread_count )
+{
+	TRACE_ZONE( "median_cut" );
+
+	std::vector< color_range_t > aBuckets( 2 );
+	std::vector< color_range_t > aNewBuckets;
+
+	aBuckets.reserve( max_colors );
+	aNewBuckets.reserve( max_colors );
+
+	// initial split of full color list.
+	median_cut_inner( aColors, { 0, aColors.size() }, space, aBuckets.data() );
+
+	const size_t uMaxThreads = std::clamp< size_t >( thread_count, 1, ( aColors.size() + kMedianColorsPerThread - 1 ) / kMedianColorsPerThread );
+
+	// can we subdivide further?
+	while ( aBuckets.size() * 2 <= max_colors )
+	{
+		const size_t uBuckets = aBuckets.size();
+		const size_t uThreadCount = std::min( uMaxThreads, uBuckets );
+
+		aNewBuckets.resize( uBuckets * 2 );
+
+		auto split = [&]( size_t thread_index )
+		{
+			const size_t first = uBuckets * thread_index / uThreadCount;
+			const size_t last = uBuckets * ( thread_index + 1 ) / uThreadCount;
+
+			for ( size_t i = first; i < last; ++i )
+			{
+				median_cut_inner( aColors, aBuckets[ i ], space, &aNewBuckets[ i * 2 ] );
+			}
+		};
+
+		if ( uThreadCount == 1 )
+		{
+			split( 0 );
+		}
+		else
+		{
+			std::vector< std::thread > aThreads;
+			for ( size_t t = 0; t < uThreadCount; ++t )
+			{
+				aThreads.emplace_back( split, t );
+			}
+
+			for ( std::thread& thread : aThreads )
+			{
+				thread.join();
+			}
+		}
+
+		std::swap( aBuckets, aNewBuckets );
+	}
+
+	// transfer color averages (and their weights) into the final palette.
+	for ( const color_range_t& bucket : aBuckets )
+	{
+		aPalette.push_back( find_median_bucket_final_color( aColors, bucket ) );
+	}
+}
+
+//
+// median_measure_bucket
+//
+// Weighted variance of each channel (or L, a, b) in a bucket. Returns the sum (the
+// bucket's total squared error) and the axis with the largest variance.
+//
+static double median_measure_bucket( const sColorTotal* pFirst, const sColorTotal* pLast, color_space_t space, int& big_axis )
+{
+	double sum_w = 0;
+	double sum[ 4 ] = { 0, 0, 0, 0 };
+	double sum_sq[ 4 ] = { 0, 0, 0, 0 };
+
+	// alpha is a fourth axis in RGB space. It has no variance unless the histogram has alpha.
+	const int axis_count = ( space == COLOR_SPACE_OKLAB ) ? 3 : 4;
+
+	for ( const sColorTotal* pTotal = pFirst; pTotal < pLast; ++pTotal )
+	{
+		const double w = static_cast<double>( pTotal->_uTotal );
+
+		sum_w += w;
+
+		for ( int i = 0; i < axis_count; ++i )
+		{
+			const double c = ( space == COLOR_SPACE_OKLAB ) ? pTotal->_fLab[ i ] : pTotal->_colAverage.chan[ i ];
+			sum[ i ] += w * c;
+			sum_sq[ i ] += w * c * c;
+		}
+	}
+
+	big_axis = 1;
+
+	if ( sum_w <= 0 )
+	{
+		return 0;
+	}
+
+	double score = 0;
+	double best_var = -1;
+
+	for ( int i = 0; i < axis_count; ++i )
+	{
+		const double var = sum_sq[ i ] - ( sum[ i ] * sum[ i ] ) / sum_w;
+
+		score += var;
+
+		if ( var > best_var )
+		{
+			best_var = var;
+			big_axis = i;
+		}
+	}
+
+	return score;
+}
+
+//
+// median_cut_adaptive
+//
+// Repeatedly split the bucket with the largest weighted variance, at the weighted
+// median of its widest axis, until exactly max_colors buckets exist (or no bucket
+// can be split). Does not need a following crush_palette pass.
+//
+void median_cut_adaptive( std::vector< sColorTotal >& aColors, const uint32_t max_colors, color_space_t space, std::vector< sColorTotal >& aPalette )
+{
+	TRACE_ZONE( "median_cut_adaptive" );
+
+	struct entry_t
+	{
+		double score;
+		int axis;
+		color_range_t range;
+	};
+
+	auto compare = []( const entry_t& e1, const entry_t& e2 )
+				   {
+					   // largest score on top.
+					   return e1.score < e2.score;
+				   };
+
+	std::priority_queue< entry_t, std::vector< entry_t >, decltype( compare ) > heap( compare );
+	std::vector< color_range_t > aFinished;
+
+	auto push_bucket = [&]( const color_range_t& range )
+					   {
+						   if ( range.Size() < 2 )
+						   {
+							   aFinished.push_back( range );
+							   return;
+						   }
+
+						   entry_t e;
+						   e.range = range;
+						   e.score = median_measure_bucket( aColors.data() + range._uBegin, aColors.data() + range._uEnd, space, e.axis );
+						   heap.push( e );
+					   };
+
+	if ( aColors.empty() )
+	{
+		return;
+	}
+
+	push_bucket( { 0, aColors.size() } );
+
+	while ( !heap.empty() && ( heap.size() + aFinished.size() ) < max_colors )
+	{
+		const entry_t e = heap.top();
+		heap.pop();
+
+		sColorTotal* pFirst = aColors.data() + e.range._uBegin;
+		sColorTotal* pLast = aColors.data() + e.range._uEnd;
+
+		const int shift = e.axis * 8;
+
+		if ( space == COLOR_SPACE_OKLAB )
+		{
+			const int axis = e.axis;
+			std::sort( pFirst, pLast, [axis]( const sColorTotal& t1, const sColorTotal& t2 )
+					   {
+						   return t1._fLab[ axis ] < t2._fLab[ axis ];
+					   } );
+		}
+		else
+		{
+			std::sort( pFirst, pLast, [shift]( const sColorTotal& t1, const sColorTotal& t2 )
+					   {
+						   const uint32_t col1 = ( t1._colAverage.value_abgr >> shift ) & 0xFF;
+						   const uint32_t col2 = ( t2._colAverage.value_abgr >> shift ) & 0xFF;
+						   return col1 < col2;
+					   } );
+		}
+
+		// find the weighted median, keeping at least one entry on each side.
+		size_t total = 0;
+		for ( const sColorTotal* pTotal = pFirst; pTotal < pLast; ++pTotal )
+		{
+			total += pTotal->_uTotal;
+		}
+
+		size_t median_index = e.range._uBegin + 1;
+		size_t running = pFirst->_uTotal;
+		while ( median_index < e.range._uEnd - 1 && running * 2 < total )
+		{
+			running += aColors[ median_index ]._uTotal;
+			++median_index;
+		}
+
+		push_bucket( { e.range._uBegin, median_index } );
+		push_bucket( { median_index, e.range._uEnd } );
+	}
+
+	while ( !heap.empty() )
+	{
+		aFinished.push_back( heap.top().range );
+		heap.pop();
+	}
+
+	for ( const color_range_t& bucket : aFinished )
+	{
+		aPalette.push_back( find_median_bucket_final_color( aColors, bucket ) );
+	}
+}
+
+//==============================================================================
+
+//
+// octree_quantizer_t
+//
+// Octree color quantizer. Histogram colors are inserted down to the leaves, every
+// node keeping the pixel weighted sums of its subtree. The deepest levels are then
+// folded, lightest nodes first, as long as that leaves at least max_colors leaves.
+// Folding a whole node can overshoot, so the last few colors are merged pairwise
+// with crush_palette.
+//
+// Nodes come from a flat pool that keeps its capacity between calls, so a quantizer
+// that is reused doesn't allocate again once it has grown. reduce_colors keeps one
+// for each thread; Trim lets go of a pool grown past kKeepNodes.
+//
+struct octree_quantizer_t
+{
+	static constexpr int kDepth = 8;
+	static constexpr size_t kKeepNodes = size_t( 1 ) << 20;
+
+	struct node_t
+	{
+		uint64_t sum[ 3 ]; // R, G, B
+		uint64_t weight;
+		uint32_t child[ 8 ]; // 0 = none (the root is never a child)
+		uint32_t child_count;
+		uint32_t parent;
+		uint32_t leaves; // leaves in this subtree
+	};
+
+	std::vector< node_t > _aNodes;
+	std::vector< uint32_t > _aLevels[ kDepth ]; // interior nodes by depth
+
+public:
+
+	// Free the pool if one big histogram grew it past kKeepNodes, rather than hold it.
+	void Trim()
+	{
+		if ( _aNodes.capacity() > kKeepNodes )
+		{
+			std::vector< node_t >().swap( _aNodes );
+		}
+	}
+
+	void Quantize( const std::vector< sColorTotal >& aColors, const uint32_t max_colors, std::vector< sColorTotal >& aPalette )
+	{
+		_aNodes.clear();
+		for ( auto& level : _aLevels )
+		{
+			level.clear();
+		}
+
+		if ( aColors.empty() || max_colors == 0 )
+		{
+			return;
+		}
+
+		_aNodes.push_back( node_t{} );
+
+		for ( const sColorTotal& total : aColors )
+		{
+			const color_t col = total._colAverage;
+			const uint64_t w = total._uTotal;
+
+			uint32_t index = 0;
+
+			for ( int depth = 0; ; ++depth )
+			{
+				node_t& node = _aNodes[ index ];
+				node.sum[ 0 ] += w * col.chan[ 0 ];
+				node.sum[ 1 ] += w * col.chan[ 1 ];
+				node.sum[ 2 ] += w * col.chan[ 2 ];
+				node.weight += w;
+
+				if ( depth == kDepth )
+					break;
+
+				const int shift = 7 - depth;
+				const uint32_t octant = ( ( ( col.chan[ 0 ] >> shift ) & 1 ) << 2 )
+									  | ( ( ( col.chan[ 1 ] >> shift ) & 1 ) << 1 )
+									  | ( ( col.chan[ 2 ] >> shift ) & 1 );
+
+				uint32_t next = node.child[ octant ];
+				if ( next == 0 )
+				{
+					if ( node.child_count == 0 )
+					{
+						_aLevels[ depth ].push_back( index );
+					}
+
+					next = uint32_t( _aNodes.size() );
+					node.child[ octant ] = next;
+					node.child_count++;
+
+					node_t child = {};
+					child.parent = index;
+					_aNodes.push_back( child ); // invalidates node
+				}
+
+				index = next;
+			}
+
+			// count the new leaf on the whole path.
+			if ( _aNodes[ index ].leaves == 0 )
+			{
+				for ( uint32_t n = index; ; n = _aNodes[ n ].parent )
+				{
+					_aNodes[ n ].leaves++;
+					if ( n == 0 )
+						break;
+				}
+			}
+		}
+
+		size_t leaf_count = _aNodes[ 0 ].leaves;
+
+		// Fold the deepest level first, so every folded node only has leaf children.
+		for ( int depth = kDepth - 1; depth >= 0 && leaf_count > max_colors; --depth )
+		{
+			std::vector< uint32_t >& level = _aLevels[ depth ];
+
+			std::sort( level.begin(), level.end(), [&]( uint32_t n1, uint32_t n2 )
+					   {
+						   if ( _aNodes[ n1 ].weight != _aNodes[ n2 ].weight )
+							   return _aNodes[ n1 ].weight < _aNodes[ n2 ].weight;
+						   return n1 < n2;
+					   } );
+
+			for ( uint32_t index : level )
+			{
+				if ( leaf_count <= max_colors )
+					break;
+
+				const uint32_t removed = _aNodes[ index ].leaves - 1;
+				if ( leaf_count - removed < max_colors )
+					continue;
+
+				node_t& node = _aNodes[ index ];
+				std::fill( std::begin( node.child ), std::end( node.child ), 0 );
+				node.child_count = 0;
+
+				for ( uint32_t n = index; ; n = _aNodes[ n ].parent )
+				{
+					_aNodes[ n ].leaves -= removed;
+					if ( n == 0 )
+						break;
+				}
+
+				leaf_count -= removed;
+			}
+		}
+
+		CollectLeaves( 0, aPalette );
+
+		crush_palette( aPalette, max_colors );
+	}
+
+private:
+
+	void CollectLeaves( uint32_t index, std::vector< sColorTotal >& aPalette ) const
+	{
+		const node_t& node = _aNodes[ index ];
+
+		if ( node.child_count == 0 )
+		{
+			sColorTotal total( 0xFF000000, node.weight );
+			total._uScaledRGBA[ 0 ] = size_t( node.sum[ 0 ] ) * 0xFF; // premultiplied, opaque
+			total._uScaledRGBA[ 1 ] = size_t( node.sum[ 1 ] ) * 0xFF;
+			total._uScaledRGBA[ 2 ] = size_t( node.sum[ 2 ] ) * 0xFF;
+			total.GenerateAverage();
+
+			aPalette.push_back( total );
+			return;
+		}
+
+		for ( uint32_t child : node.child )
+		{
+			if ( child != 0 )
+			{
+				CollectLeaves( child, aPalette );
+			}
+		}
+	}
+};
+
+//==============================================================================
+
+//
+// wu_quantizer_t
+//
+// Xiaolin Wu's greedy orthogonal bipartition quantizer. The histogram is binned into
+// a 33^3 table (5 bits per channel, plus a zero border) of pixel weighted moments,
+// and the table is made cumulative, so the moments of any box take 8 lookups. Boxes
+// are then split, largest variance first, at the cut that maximises the between
+// box variance. Once the table is built, the cost doesn't depend on the number of
+// unique colors.
+//
+struct wu_quantizer_t
+{
+	static constexpr int kBits = 5;
+	static constexpr int kSide = ( 1 << kBits ) + 1;
+
+	struct box_t
+	{
+		int r0, r1; // (r0, r1]
+		int g0, g1;
+		int b0, b1;
+		int volume;
+	};
+
+	std::vector< int64_t > _aWeight;
+	std::vector< int64_t > _aMomentR;
+	std::vector< int64_t > _aMomentG;
+	std::vector< int64_t > _aMomentB;
+	std::vector< double > _aMoment2;
+
+public:
+
+	void Quantize( const std::vector< sColorTotal >& aColors, const uint32_t max_colors, std::vector< sColorTotal >& aPalette )
+	{
+		if ( aColors.empty() || max_colors == 0 )
+		{
+			return;
+		}
+
+		BuildMoments( aColors );
+
+		std::vector< box_t > aBoxes( max_colors );
+		std::vector< double > aVariance( max_colors, 0 );
+
+		aBoxes[ 0 ] = { 0, kSide - 1, 0, kSide - 1, 0, kSide - 1, 0 };
+
+		uint32_t box_count = 1;
+		uint32_t next = 0;
+
+		while ( box_count < max_colors )
+		{
+			if ( Cut( aBoxes[ next ], aBoxes[ box_count ] ) )
+			{
+				aVariance[ next ] = ( aBoxes[ next ].volume > 1 ) ? Variance( aBoxes[ next ] ) : 0;
+				aVariance[ box_count ] = ( aBoxes[ box_count ].volume > 1 ) ? Variance( aBoxes[ box_count ] ) : 0;
+				++box_count;
+			}
+			else
+			{
+				aVariance[ next ] = 0; // don't try to split this one again.
+			}
+
+			next = 0;
+			for ( uint32_t k = 1; k < box_count; ++k )
+			{
+				if ( aVariance[ k ] > aVariance[ next ] )
+				{
+					next = k;
+				}
+			}
+
+			if ( aVariance[ next ] <= 0 )
+				break;
+		}
+
+		for ( uint32_t k = 0; k < box_count; ++k )
+		{
+			const int64_t weight = Volume( aBoxes[ k ], _aWeight );
+			if ( weight <= 0 )
+				continue;
+
+			sColorTotal total( 0xFF000000, size_t( weight ) );
+			total._uScaledRGBA[ 0 ] = size_t( Volume( aBoxes[ k ], _aMomentR ) ) * 0xFF; // premultiplied, opaque
+			total._uScaledRGBA[ 1 ] = size_t( Volume( aBoxes[ k ], _aMomentG ) ) * 0xFF;
+			total._uScaledRGBA[ 2 ] = size_t( Volume( aBoxes[ k ], _aMomentB ) ) * 0xFF;
+			total.GenerateAverage();
+
+			aPalette.push_back( total );
+		}
+	}
+
+private:
+
+	static inline size_t Index( int r, int g, int b )
+	{
+		return ( size_t( r ) * kSide + g ) * kSide + b;
+	}
+
+	void BuildMoments( const std::vector< sColorTotal >& aColors )
+	{
+		const size_t size = size_t( kSide ) * kSide * kSide;
+
+		_aWeight.assign( size, 0 );
+		_aMomentR.assign( size, 0 );
+		_aMomentG.assign( size, 0 );
+		_aMomentB.assign( size, 0 );
+		_aMoment2.assign( size, 0 );
+
+		for ( const sColorTotal& total : aColors )
+		{
+			const color_t col = total._colAverage;
+			const int64_t w = int64_t( total._uTotal );
+
+			const size_t index = Index( ( col.chan[ 0 ] >> ( 8 - kBits ) ) + 1,
+										( col.chan[ 1 ] >> ( 8 - kBits ) ) + 1,
+										( col.chan[ 2 ] >> ( 8 - kBits ) ) + 1 );
+
+			_aWeight[ index ] += w;
+			_aMomentR[ index ] += w * col.chan[ 0 ];
+			_aMomentG[ index ] += w * col.chan[ 1 ];
+			_aMomentB[ index ] += w * col.chan[ 2 ];
+			_aMoment2[ index ] += double( w ) * ( col.chan[ 0 ] * col.chan[ 0 ] + col.chan[ 1 ] * col.chan[ 1 ] + col.chan[ 2 ] * col.chan[ 2 ] );
+		}
+
+		// make the tables cumulative, so [r][g][b] holds the sum over (0,r] x (0,g] x (0,b].
+		for ( int r = 1; r < kSide; ++r )
+		{
+			int64_t area_w[ kSide ] = {}, area_r[ kSide ] = {}, area_g[ kSide ] = {}, area_b[ kSide ] = {};
+			double area_2[ kSide ] = {};
+
+			for ( int g = 1; g < kSide; ++g )
+			{
+				int64_t line_w = 0, line_r = 0, line_g = 0, line_b = 0;
+				double line_2 = 0;
+
+				for ( int b = 1; b < kSide; ++b )
+				{
+					const size_t index = Index( r, g, b );
+					const size_t below = Index( r - 1, g, b );
+
+					line_w += _aWeight[ index ];
+					line_r += _aMomentR[ index ];
+					line_g += _aMomentG[ index ];
+					line_b += _aMomentB[ index ];
+					line_2 += _aMoment2[ index ];
+
+					area_w[ b ] += line_w;
+					area_r[ b ] += line_r;
+					area_g[ b ] += line_g;
+					area_b[ b ] += line_b;
+					area_2[ b ] += line_2;
+
+					_aWeight[ index ] = _aWeight[ below ] + area_w[ b ];
+					_aMomentR[ index ] = _aMomentR[ below ] + area_r[ b ];
+					_aMomentG[ index ] = _aMomentG[ below ] + area_g[ b ];
+					_aMomentB[ index ] = _aMomentB[ below ] + area_b[ b ];
+					_aMoment2[ index ] = _aMoment2[ below ] + area_2[ b ];
+				}
+			}
+		}
+	}
+
+	template< typename T >
+	static T Volume( const box_t& box, const std::vector< T >& m )
+	{
+		return m[ Index( box.r1, box.g1, box.b1 ) ]
+			 - m[ Index( box.r1, box.g1, box.b0 ) ]
+			 - m[ Index( box.r1, box.g0, box.b1 ) ]
+			 + m[ Index( box.r1, box.g0, box.b0 ) ]
+			 - m[ Index( box.r0, box.g1, box.b1 ) ]
+			 + m[ Index( box.r0, box.g1, box.b0 ) ]
+			 + m[ Index( box.r0, box.g0, box.b1 ) ]
+			 - m[ Index( box.r0, box.g0, box.b0 ) ];
+	}
+
+	// Part of Volume that doesn't depend on the cut position along axis.
+	static int64_t Bottom( const box_t& box, int axis, const std::vector< int64_t >& m )
+	{
+		switch ( axis )
+		{
+		case 0:
+			return -m[ Index( box.r0, box.g1, box.b1 ) ] + m[ Index( box.r0, box.g1, box.b0 ) ]
+				   + m[ Index( box.r0, box.g0, box.b1 ) ] - m[ Index( box.r0, box.g0, box.b0 ) ];
+		case 1:
+			return -m[ Index( box.r1, box.g0, box.b1 ) ] + m[ Index( box.r1, box.g0, box.b0 ) ]
+				   + m[ Index( box.r0, box.g0, box.b1 ) ] - m[ Index( box.r0, box.g0, box.b0 ) ];
+		default:
+			return -m[ Index( box.r1, box.g1, box.b0 ) ] + m[ Index( box.r1, box.g0, box.b0 ) ]
+				   + m[ Index( box.r0, box.g1, box.b0 ) ] - m[ Index( box.r0, box.g0, box.b0 ) ];
+		}
+	}
+
+	// Rest of Volume, with the box cut at pos along axis.
+	static int64_t Top( const box_t& box, int axis, int pos, const std::vector< int64_t >& m )
+	{
+		switch ( axis )
+		{
+		case 0:
+			return m[ Index( pos, box.g1, box.b1 ) ] - m[ Index( pos, box.g1, box.b0 ) ]
+				   - m[ Index( pos, box.g0, box.b1 ) ] + m[ Index( pos, box.g0, box.b0 ) ];
+		case 1:
+			return m[ Index( box.r1, pos, box.b1 ) ] - m[ Index( box.r1, pos, box.b0 ) ]
+				   - m[ Index( box.r0, pos, box.b1 ) ] + m[ Index( box.r0, pos, box.b0 ) ];
+		default:
+			return m[ Index( box.r1, box.g1, pos ) ] - m[ Index( box.r1, box.g0, pos ) ]
+				   - m[ Index( box.r0, box.g1, pos ) ] + m[ Index( box.r0, box.g0, pos ) ];
+		}
+	}
+
+	double Variance( const box_t& box ) const
+	{
+		const double dr = double( Volume( box, _aMomentR ) );
+		const double dg = double( Volume( box, _aMomentG ) );
+		const double db = double( Volume( box, _aMomentB ) );
+		const double w = double( Volume( box, _aWeight ) );
+
+		if ( w <= 0 )
+			return 0;
+
+		return Volume( box, _aMoment2 ) - ( dr * dr + dg * dg + db * db ) / w;
+	}
+
+	//
+	// Maximize
+	//
+	// Find the cut along axis (in [first,last)) that maximises the sum of the squared
+	// moments over weight of the two halves. Returns the score, cut is -1 if none.
+	//
+	double Maximize( const box_t& box, int axis, int first, int last, int& cut,
+					 int64_t whole_r, int64_t whole_g, int64_t whole_b, int64_t whole_w ) const
+	{
+		const int64_t base_r = Bottom( box, axis, _aMomentR );
+		const int64_t base_g = Bottom( box, axis, _aMomentG );
+		const int64_t base_b = Bottom( box, axis, _aMomentB );
+		const int64_t base_w = Bottom( box, axis, _aWeight );
+
+		double best = 0;
+		cut = -1;
+
+		for ( int i = first; i < last; ++i )
+		{
+			const int64_t half_r = base_r + Top( box, axis, i, _aMomentR );
+			const int64_t half_g = base_g + Top( box, axis, i, _aMomentG );
+			const int64_t half_b = base_b + Top( box, axis, i, _aMomentB );
+			const int64_t half_w = base_w + Top( box, axis, i, _aWeight );
+
+			if ( half_w == 0 || half_w == whole_w )
+				continue; // one side would be empty.
+
+			double score = ( double( half_r ) * half_r + double( half_g ) * half_g + double( half_b ) * half_b ) / double( half_w );
+
+			const int64_t rest_r = whole_r - half_r;
+			const int64_t rest_g = whole_g - half_g;
+			const int64_t rest_b = whole_b - half_b;
+			const int64_t rest_w = whole_w - half_w;
+
+			score += ( double( rest_r ) * rest_r + double( rest_g ) * rest_g + double( rest_b ) * rest_b ) / double( rest_w );
+
+			if ( score > best )
+			{
+				best = score;
+				cut = i;
+			}
+		}
+
+		return best;
+	}
+
+	bool Cut( box_t& box1, box_t& box2 ) const
+	{
+		const int64_t whole_r = Volume( box1, _aMomentR );
+		const int64_t whole_g = Volume( box1, _aMomentG );
+		const int64_t whole_b = Volume( box1, _aMomentB );
+		const int64_t whole_w = Volume( box1, _aWeight );
+
+		int cut_r, cut_g, cut_b;
+		const double max_r = Maximize( box1, 0, box1.r0 + 1, box1.r1, cut_r, whole_r, whole_g, whole_b, whole_w );
+		const double max_g = Maximize( box1, 1, box1.g0 + 1, box1.g1, cut_g, whole_r, whole_g, whole_b, whole_w );
+		const double max_b = Maximize( box1, 2, box1.b0 + 1, box1.b1, cut_b, whole_r, whole_g, whole_b, whole_w );
+
+		box2 = box1;
+
+		if ( max_r >= max_g && max_r >= max_b )
+		{
+			if ( cut_r < 0 )
+				return false; // can't split
+			box2.r0 = box1.r1 = cut_r;
+		}
+		else if ( max_g >= max_r && max_g >= max_b )
+		{
+			box2.g0 = box1.g1 = cut_g;
+		}
+		else
+		{
+			box2.b0 = box1.b1 = cut_b;
+		}
+
+		box1.volume = ( box1.r1 - box1.r0 ) * ( box1.g1 - box1.g0 ) * ( box1.b1 - box1.b0 );
+		box2.volume = ( box2.r1 - box2.r0 ) * ( box2.g1 - box2.g0 ) * ( box2.b1 - box2.b0 );
+
+		return true;
+	}
+};
+
+//==============================================================================
+
+//
+// kmeans_refine
+//
+// Weighted k-means (Lloyd iterations) over the color histogram, seeded with the
+// palette from median cut. Colors are assigned to centroids in parallel, and the
+// pixel weighted sums are kept as integers so the result doesn't depend on the
+// thread count. Stops after max_iterations, or once no centroid moves further
+// than limit. Returns the number of iterations run.
+//
+// The nearest centroid search starts from the centroid the color was assigned to
+// last time, then checks the other centroids in order of their distance from that
+// one, stopping once the triangle inequality rules out the rest.
+//
+static uint32_t kmeans_refine( const std::vector< sColorTotal >& aColors,
+							   std::vector< sColorTotal >& aPalette,
+							   const uint32_t max_iterations,
+							   const float limit,
+							   const uint32_t thread_count )
+{
+	TRACE_ZONE( "kmeans_refine" );
+
+	const size_t k = aPalette.size();
+
+	if ( k < 2 || aColors.empty() || max_iterations == 0 )
+	{
+		return 0;
+	}
+
+	struct centroid_t
+	{
+		float c[ 3 ]; // R, G, B
+	};
+
+	struct accum_t
+	{
+		uint64_t sum[ 3 ];
+		uint64_t weight;
+	};
+
+	auto distance = []( const centroid_t& a, const float* b )
+					{
+						const float dr = a.c[ 0 ] - b[ 0 ];
+						const float dg = a.c[ 1 ] - b[ 1 ];
+						const float db = a.c[ 2 ] - b[ 2 ];
+						return std::sqrt( dr * dr + dg * dg + db * db );
+					};
+
+	std::vector< centroid_t > aCentroids( k );
+	for ( size_t j = 0; j < k; ++j )
+	{
+		for ( int i = 0; i < 3; ++i )
+		{
+			aCentroids[ j ].c[ i ] = aPalette[ j ]._colAverage.chan[ i ];
+		}
+	}
+
+	std::vector< uint32_t > aAssigned( aColors.size(), 0 );
+
+	// neighbours of each centroid, nearest first. [ j * k + n ]
+	std::vector< uint32_t > aNeighbours( k * k );
+	std::vector< float > aNeighbourDist( k * k );
+
+	const size_t uThreadCount = std::clamp< size_t >( thread_count, 1, ( aColors.size() + 4095 ) / 4096 );
+	std::vector< std::vector< accum_t > > aAccum( uThreadCount, std::vector< accum_t >( k ) );
+
+	const float limit_sq = limit * limit;
+	uint32_t iteration = 0;
+
+	while ( iteration < max_iterations )
+	{
+		++iteration;
+
+		for ( size_t j = 0; j < k; ++j )
+		{
+			uint32_t* pNeighbours = aNeighbours.data() + j * k;
+			for ( size_t n = 0; n < k; ++n )
+			{
+				pNeighbours[ n ] = uint32_t( n );
+			}
+
+			std::sort( pNeighbours, pNeighbours + k, [&]( uint32_t n1, uint32_t n2 )
+					   {
+						   return distance( aCentroids[ j ], aCentroids[ n1 ].c ) < distance( aCentroids[ j ], aCentroids[ n2 ].c );
+					   } );
+
+			for ( size_t n = 0; n < k; ++n )
+			{
+				aNeighbourDist[ j * k + n ] = distance( aCentroids[ j ], aCentroids[ pNeighbours[ n ] ].c );
+			}
+		}
+
+		// Assignment
+		auto assign = [&]( size_t thread_index )
+					  {
+						  std::vector< accum_t >& aSums = aAccum[ thread_index ];
+						  std::fill( aSums.begin(), aSums.end(), accum_t{ { 0, 0, 0 }, 0 } );
+
+						  const size_t first = aColors.size() * thread_index / uThreadCount;
+						  const size_t last = aColors.size() * ( thread_index + 1 ) / uThreadCount;
+
+						  for ( size_t index = first; index < last; ++index )
+						  {
+							  const color_t col = aColors[ index ]._colAverage;
+							  const float x[ 3 ] = { float( col.chan[ 0 ] ), float( col.chan[ 1 ] ), float( col.chan[ 2 ] ) };
+
+							  const uint32_t start = aAssigned[ index ];
+							  const float start_dist = distance( aCentroids[ start ], x );
+
+							  uint32_t best = start;
+							  float best_dist = start_dist;
+
+							  const uint32_t* pNeighbours = aNeighbours.data() + size_t( start ) * k;
+							  const float* pNeighbourDist = aNeighbourDist.data() + size_t( start ) * k;
+
+							  for ( size_t n = 1; n < k; ++n )
+							  {
+								  // d(x,j) >= d(start,j) - d(x,start), so nothing further out can beat best.
+								  if ( pNeighbourDist[ n ] >= start_dist + best_dist )
+									  break;
+
+								  const float d = distance( aCentroids[ pNeighbours[ n ] ], x );
+								  if ( d < best_dist )
+								  {
+									  best_dist = d;
+									  best = pNeighbours[ n ];
+								  }
+							  }
+
+							  aAssigned[ index ] = best;
+
+							  const uint64_t w = aColors[ index ]._uTotal;
+							  accum_t& acc = aSums[ best ];
+							  acc.sum[ 0 ] += w * col.chan[ 0 ];
+							  acc.sum[ 1 ] += w * col.chan[ 1 ];
+							  acc.sum[ 2 ] += w * col.chan[ 2 ];
+							  acc.weight += w;
+						  }
+					  };
+
+		if ( uThreadCount == 1 )
+		{
+			assign( 0 );
+		}
+		else
+		{
+			std::vector< std::thread > aThreads;
+			for ( size_t t = 0; t < uThreadCount; ++t )
+			{
+				aThreads.emplace_back( assign, t );
+			}
+
+			for ( std::thread& thread : aThreads )
+			{
+				thread.join();
+			}
+		}
+
+		// Update
+		float max_move_sq = 0;
+
+		for ( size_t j = 0; j < k; ++j )
+		{
+			accum_t total = { { 0, 0, 0 }, 0 };
+			for ( const auto& aSums : aAccum )
+			{
+				for ( int i = 0; i < 3; ++i )
+				{
+					total.sum[ i ] += aSums[ j ].sum[ i ];
+				}
+				total.weight += aSums[ j ].weight;
+			}
+
+			if ( total.weight == 0 )
+				continue; // empty cluster, keep the old centroid.
+
+			float move_sq = 0;
+			for ( int i = 0; i < 3; ++i )
+			{
+				const float c = float( double( total.sum[ i ] ) / double( total.weight ) );
+				move_sq += ( c - aCentroids[ j ].c[ i ] ) * ( c - aCentroids[ j ].c[ i ] );
+				aCentroids[ j ].c[ i ] = c;
+			}
+
+			max_move_sq = std::max( max_move_sq, move_sq );
+		}
+
+		if ( max_move_sq <= limit_sq )
+			break;
+	}
+
+	for ( size_t j = 0; j < k; ++j )
+	{
+		for ( int i = 0; i < 3; ++i )
+		{
+			aPalette[ j ]._colAverage.chan[ i ] = static_cast<uint8_t>( std::clamp( std::lround( aCentroids[ j ].c[ i ] ), 0l, 255l ) );
+		}
+	}
+
+	return iteration;
+}
+
+//==============================================================================
+
+static void sort_palette_rgb( std::vector< color_t >& aPalette )
+{
+	if ( aPalette.size() < 2 )
+		return;
+
+	std::sort( aPalette.begin(), aPalette.end(), [&]( color_t t1, color_t t2 )
+			   {
+				   // move larger values to the end of the array.
+				   return ( t1.sum_rgb() ) < ( t2.sum_rgb() );
+			   } );
+}
+
+//
+// order_palette_adjacent
+//
+// Reorder a palette sorted by sort_palette_rgb so that colors that are often
+// horizontal neighbours in the images get close indices, which is what the PNG row
+// filters (Sub, Up, Paeth) turn into small, repeating residuals.
+//
+// Each sampled pair of colors adds its count to the weight between their nearest
+// palette colors. With bTransparent the index 0 that finish_palette inserts is one
+// more color, weighted by the pairs with a masked pixel.
+//
+// The chain starts at index 0 (the transparent index, or else the darkest color) and
+// always takes the unplaced color with the most weight to the last one, or the
+// nearest color when there is none. Swapping neighbours in the chain then lowers the
+// sum of weight times distance in indices, until no swap helps.
+//
+static void order_palette_adjacent( std::vector< color_t >& aPalette, const color_histogram_t& histogram, bool bTransparent )
+{
+	const size_t n = aPalette.size();
+
+	if ( n < 3 || histogram._mapPairs.empty() )
+		return;
+
+	// nodes are the palette colors, then the transparent index.
+	const size_t m = bTransparent ? n + 1 : n;
+
+	std::unordered_map< uint32_t, uint32_t > mapNearest;
+
+	auto node_of = [&]( uint32_t key ) -> uint32_t
+	{
+		if ( key == color_histogram_t::kPairMasked )
+			return uint32_t( n ); // only used with bTransparent.
+
+		auto it = mapNearest.find( key );
+		if ( it != mapNearest.end() )
+			return it->second;
+
+		color_t col;
+		col.value_abgr = key | 0xFF000000;
+
+		uint32_t index = 0;
+		int best = INT_MAX;
+		for ( size_t i = 0; i < n; ++i )
+		{
+			const int dist = rgb_color_distance_squared( col, aPalette[ i ] );
+			if ( dist < best )
+			{
+				best = dist;
+				index = uint32_t( i );
+			}
+		}
+
+		mapNearest.emplace( key, index );
+		return index;
+	};
+
+	// symmetric pair weights between nodes.
+	std::vector< uint64_t > aWeights( m * m, 0 );
+	for ( const auto& [pair, count] : histogram._mapPairs )
+	{
+		const uint32_t key1 = uint32_t( pair >> 25 );
+		const uint32_t key2 = uint32_t( pair & ( ( 1u << 25 ) - 1 ) );
+
+		if ( !bTransparent && key2 == color_histogram_t::kPairMasked )
+			continue;
+
+		const uint32_t p1 = node_of( key1 );
+		const uint32_t p2 = node_of( key2 );
+
+		if ( p1 != p2 )
+		{
+			aWeights[ size_t( p1 ) * m + p2 ] += count;
+			aWeights[ size_t( p2 ) * m + p1 ] += count;
+		}
+	}
+
+	// the transparent index is nearest to the darkest color, when it has no weights.
+	auto node_color = [&]( size_t node ) -> color_t
+	{
+		return ( node < n ) ? aPalette[ node ] : aPalette[ 0 ];
+	};
+
+	// greedy chain from index 0.
+	std::vector< uint32_t > aOrder( 1, uint32_t( bTransparent ? n : 0 ) );
+	std::vector< bool > aPlaced( m, false );
+	aPlaced[ aOrder[ 0 ] ] = true;
+
+	while ( aOrder.size() < m )
+	{
+		const size_t last = aOrder.back();
+
+		size_t next = m;
+		uint64_t best_weight = 0;
+		int best_dist = INT_MAX;
+
+		for ( size_t i = 0; i < m; ++i )
+		{
+			if ( aPlaced[ i ] )
+				continue;
+
+			const uint64_t weight = aWeights[ last * m + i ];
+			const int dist = rgb_color_distance_squared( node_color( last ), node_color( i ) );
+
+			if ( weight > best_weight || ( weight == best_weight && dist < best_dist ) )
+			{
+				next = i;
+				best_weight = weight;
+				best_dist = dist;
+			}
+		}
+
+		aPlaced[ next ] = true;
+		aOrder.push_back( uint32_t( next ) );
+	}
+
+	// swap neighbours in the chain while it helps, index 0 stays put.
+	std::vector< int64_t > aPos( m );
+	for ( size_t k = 0; k < m; ++k )
+	{
+		aPos[ aOrder[ k ] ] = int64_t( k );
+	}
+
+	for ( int pass = 0; pass < 64; ++pass )
+	{
+		bool bSwapped = false;
+
+		for ( size_t k = 1; k + 1 < m; ++k )
+		{
+			const size_t u = aOrder[ k ];
+			const size_t v = aOrder[ k + 1 ];
+
+			// u moves one later and v one earlier, the u-v pair itself stays 1 apart.
+			int64_t delta = 0;
+			for ( size_t w = 0; w < m; ++w )
+			{
+				if ( w == u || w == v )
+					continue;
+
+				const int64_t pw = aPos[ w ];
+				const int64_t near_u = std::abs( int64_t( k + 1 ) - pw ) - std::abs( int64_t( k ) - pw );
+
+				delta += ( int64_t( aWeights[ u * m + w ] ) - int64_t( aWeights[ v * m + w ] ) ) * near_u;
+			}
+
+			if ( delta < 0 )
+			{
+				std::swap( aOrder[ k ], aOrder[ k + 1 ] );
+				aPos[ u ] = int64_t( k + 1 );
+				aPos[ v ] = int64_t( k );
+				bSwapped = true;
+			}
+		}
+
+		if ( !bSwapped )
+			break;
+	}
+
+	std::vector< color_t > aOrdered;
+	aOrdered.reserve( n );
+	for ( uint32_t node : aOrder )
+	{
+		if ( node < n )
+		{
+			aOrdered.push_back( aPalette[ node ] );
+		}
+	}
+
+	aPalette.swap( aOrdered );
+}
+
+//==============================================================================
+
+//
+// palette_target_size
+//
+// Number of colors to generate, leaving room for the transparent index 0 if needed.
+//
+static uint32_t palette_target_size( const palgen_settings_t& settings, bool bMaskDetected )
+{
+	uint32_t targetSize = settings.uPaletteSizeReal;
+	if ( ( bMaskDetected && !settings.bForceOpaque ) || settings.bForceTransp )
+	{
+		--targetSize;
+	}
+
+	return targetSize;
+}
+
+//
+// reduce_colors
+//
+// Run the selected quantizer over the compacted histogram.
+// The perceptual color space only applies to median cut.
+//
+static void reduce_colors( const palgen_settings_t& settings,
+						   std::vector< sColorTotal >& aColors,
+						   const uint32_t targetSize,
+						   std::vector< sColorTotal >& aTotals,
+						   stats_t* pStats = nullptr )
+{
+	TRACE_ZONE( "reduce_colors" );
+
+	const tClock::time_point t0 = tClock::now();
+
+	if ( settings.colorSpace == COLOR_SPACE_OKLAB && settings.method == METHOD_MEDIAN_CUT )
+	{
+		convert_colors_oklab( aColors );
+	}
+
+	if ( settings.method == METHOD_OCTREE )
+	{
+		// one for each thread, so the group workers and repeated library calls reuse its nodes.
+		static thread_local octree_quantizer_t octree;
+		octree.Quantize( aColors, targetSize, aTotals );
+		octree.Trim();
+	}
+	else if ( settings.method == METHOD_WU )
+	{
+		wu_quantizer_t wu;
+		wu.Quantize( aColors, targetSize, aTotals );
+	}
+	else if ( settings.bAdaptive )
+	{
+		median_cut_adaptive( aColors, targetSize, settings.colorSpace, aTotals );
+	}
+	else
+	{
+		median_cut( aColors, next_power_two( settings.uPaletteSizeReal ), settings.colorSpace, aTotals, settings.uThreadCount );
+
+		const tClock::time_point t1 = tClock::now();
+
+		crush_palette( aTotals, targetSize, settings.colorSpace );
+
+		if ( pStats )
+		{
+			pStats->fCrushMs = elapsed_ms( t1 );
+			pStats->fReduceMs = elapsed_ms( t0, t1 );
+		}
+		return;
+	}
+
+	if ( pStats )
+	{
+		pStats->fReduceMs = elapsed_ms( t0 );
+	}
+}
+
+//
+// finish_palette
+//
+// Convert the reduced colors to a sorted palette, with the transparent index 0.
+// -order=adjacent then reorders it by the neighbour pairs counted in pHistogram.
+//
+static void finish_palette( const palgen_settings_t& settings,
+							const std::vector< sColorTotal >& aTotals,
+							bool bMaskDetected,
+							std::vector< color_t >& aPalette,
+							const color_histogram_t* pHistogram = nullptr )
+{
+	TRACE_ZONE( "finish_palette" );
+
+	aPalette.clear();
+
+	for ( const sColorTotal& total : aTotals )
+	{
+		aPalette.push_back( total._colAverage );
+	}
+
+	sort_palette_rgb( aPalette ); // move black to index 0
+
+	const bool bTransparent = ( bMaskDetected && !settings.bForceOpaque ) || settings.bForceTransp;
+
+	if ( settings.order == ORDER_ADJACENT && pHistogram != nullptr )
+	{
+		order_palette_adjacent( aPalette, *pHistogram, bTransparent );
+	}
+
+	if ( !aPalette.empty() && bTransparent )
+	{
+		aPalette.insert( aPalette.begin(), color_t( KEY_TRANSPARENT ) );
+	}
+}
+
+//
+// palgen_generate
+//
+// Library entry point, see palgen.h
+//
+bool palgen_generate( const palgen_settings_t& settings,
+					  const palgen_image_t* pImages,
+					  size_t uImageCount,
+					  std::vector< color_t >& aPalette )
+{
+	aPalette.clear();
+
+	if ( settings.uPaletteSizeReal <= 2 )
+	{
+		return false;
+	}
+
+	if ( settings.bAlpha && settings.uKMeansIterations > 0 )
+	{
+		return false; // k-means would move RGBA entries by their RGB alone.
+	}
+
+	color_histogram_t unique_colors;
+	unique_colors.Create( settings.histogram, settings.bAlpha, settings.order == ORDER_ADJACENT );
+
+	bool bMaskDetected = false;
+
+	for ( size_t i = 0; i < uImageCount; ++i )
+	{
+		const palgen_image_t& image = pImages[ i ];
+
+		if ( image.pPixels == nullptr || image.iWidth <= 0 || image.iHeight <= 0 || ( image.iChannels != 3 && image.iChannels != 4 ) )
+		{
+			return false;
+		}
+
+		count_image_pixels( settings, image.pPixels, image.iWidth, image.iHeight, 0, image.iChannels, nullptr, unique_colors, bMaskDetected );
+	}
+
+	std::vector< sColorTotal > aColors;
+	unique_colors.Compact( aColors );
+
+	std::vector< sColorTotal > aTotals;
+	reduce_colors( settings, aColors, palette_target_size( settings, bMaskDetected ), aTotals );
+
+	if ( settings.uKMeansIterations > 0 )
+	{
+		kmeans_refine( aColors, aTotals, settings.uKMeansIterations, settings.fKMeansLimit, settings.uThreadCount );
+	}
+
+	finish_palette( settings, aTotals, bMaskDetected, aPalette, &unique_colors );
+
+	return !aPalette.empty();
+}
+
+//==============================================================================
+
+#if !defined( PALGEN_LIBRARY )
+
+//
+// Allocation counters
+//
+// The command line build counts calls to the global operator new, so the benchmark
+// can report allocations per phase.
+//
+
+static std::atomic< uint64_t > g_uAllocCount = 0;
+static std::atomic< uint64_t > g_uAllocBytes = 0;
+
+void* operator new( size_t size )
+{
+	g_uAllocCount.fetch_add( 1, std::memory_order_relaxed );
+	g_uAllocBytes.fetch_add( size, std::memory_order_relaxed );
+
+	void* p = malloc( size ? size : 1 );
+	if ( p == nullptr )
+	{
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+// The unsized, sized and array deletes all come here, as every new comes from the one
+// above. It isn't inlined: GCC would then see free given a pointer from a call to
+// operator new, and warn of a mismatch (-Wmismatched-new-delete).
+#if defined( __GNUC__ )
+__attribute__(( noinline ))
+#endif
+void operator delete( void* p ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+	operator delete( p );
+}
+
+void operator delete[]( void* p ) noexcept
+{
+	operator delete( p );
+}
+
+void operator delete[]( void* p, size_t ) noexcept
+{
+	operator delete( p );
+}
+
+//
+// phase_timer_t
+//
+// Wall time and allocations since Start().
+//
+struct phase_timer_t
+{
+	std::chrono::steady_clock::time_point _start;
+	uint64_t _uAllocCount = 0;
+	uint64_t _uAllocBytes = 0;
+
+public:
+
+	void Start()
+	{
+		_uAllocCount = g_uAllocCount.load();
+		_uAllocBytes = g_uAllocBytes.load();
+		_start = std::chrono::steady_clock::now();
+	}
+
+	double Milliseconds() const
+	{
+		return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - _start ).count();
+	}
+
+	uint64_t Allocs() const
+	{
+		return g_uAllocCount.load() - _uAllocCount;
+	}
+
+	uint64_t AllocBytes() const
+	{
+		return g_uAllocBytes.load() - _uAllocBytes;
+	}
+};
+
+//
+// bench_phase
+//
+// Time one phase of the benchmark and print a result line.
+//
+template< typename FN >
+static void bench_phase( const char* szName, FN fn )
+{
+	phase_timer_t timer;
+	timer.Start();
+
+	fn();
+
+	const double ms = timer.Milliseconds();
+	printf( "  %-12s %10.3f ms %10llu allocs %12llu bytes\n", szName, ms,
+			static_cast<unsigned long long>( timer.Allocs() ),
+			static_cast<unsigned long long>( timer.AllocBytes() ) );
+}
+
+//
+// bench_dataset
+//
+// Run the analysis, median cut, crush and sort phases on one RGBA image buffer.
+//
+static void bench_dataset( const options_t& options, const char* szName, const std::vector< uint8_t >& aPixels, uint32_t uPaletteSize )
+{
+	const size_t uPixelCount = aPixels.size() / 4;
+
+	color_histogram_t histogram;
+	std::vector< sColorTotal > aColors;
+	std::vector< sColorTotal > aTotals;
+	std::vector< color_t > aPalette;
+	bool bMaskDetected = false;
+
+	printf( "%s, %zu pixels, palette %u:\n", szName, uPixelCount, uPaletteSize );
+
+	bench_phase( "histogram", [&]() { histogram.Create( options.histogram, options.bAlpha ); } );
+	bench_phase( "count", [&]() { count_unique_image_cols_4ch( aPixels.data(), int( uPixelCount ), 1, histogram, bMaskDetected ); } );
+
+	// -edges, into a histogram of its own so that the phases below are as before
+	{
+		palgen_settings_t edges = options;
+		edges.uEdgeWeight = kDefaultEdgeWeight;
+
+		color_histogram_t weighted;
+		weighted.Create( options.histogram, options.bAlpha );
+
+		bench_phase( "count_edges", [&]() { count_weighted_pixels( edges, aPixels.data(), int( uPixelCount ), 1, 0, 4, nullptr, weighted, bMaskDetected ); } );
+	}
+	bench_phase( "compact", [&]() { histogram.Compact( aColors ); } );
+	bench_phase( "median_cut", [&]() { median_cut( aColors, next_power_two( uPaletteSize ), COLOR_SPACE_RGB, aTotals, options.uThreadCount ); } );
+	bench_phase( "crush", [&]() { crush_palette( aTotals, uPaletteSize ); } );
+	bench_phase( "sort", [&]()
+				 {
+					 for ( const sColorTotal& total : aTotals )
+					 {
+						 aPalette.push_back( total._colAverage );
+					 }
+					 sort_palette_rgb( aPalette );
+				 } );
+
+	printf( "  %zu unique colors -> %zu.\n\n", aColors.size(), aPalette.size() );
+}
+
+//
+// do_benchmark
+//
+// Time each phase over synthetic images with a range of unique color counts and
+// palette sizes, then over the input files (if any).
+//
+static void do_benchmark( const options_t& options )
+{
+	print_hello();
+
+	printf( "Pixel kernels: %s\n\n", cpu_level_name( cpu_level() ) );
+
+	const size_t kSyntheticPixels = size_t( 1 ) << 22;
+	const uint32_t aUniqueCounts[] = { 1u << 10, 1u << 16, 1u << 20, 1u << 24 };
+	const uint32_t aPaletteSizes[] = { 16, 240 }; // 240 is not a power of two, so crush_palette has work to do.
+
+	// a bijection of the 24-bit colors, so that different indices are different colors.
+	auto scramble = []( uint32_t x )
+	{
+		x = ( x * 0x9e3779u ) & 0xFFFFFF;
+		x ^= x >> 12;
+		x = ( x * 0x5bd1e5u ) & 0xFFFFFF;
+		x ^= x >> 11;
+		return x;
+	};
+
+	std::vector< uint8_t > aPixels;
+
+	for ( uint32_t unique : aUniqueCounts )
+	{
+		// every one of the 'unique' colors once, then pseudo random picks from them, so
+		// the 1 << 24 set is a whole (shuffled) color cube of more pixels than the rest.
+		const size_t uPixels = std::max< size_t >( kSyntheticPixels, unique );
+		aPixels.resize( uPixels * 4 );
+
+		for ( size_t i = 0; i < uPixels; ++i )
+		{
+			const uint32_t index = ( i < unique ) ? uint32_t( i ) : ( sample_hash( uint32_t( i ) ) & ( unique - 1 ) );
+			color_t col;
+			col.value_abgr = scramble( index ) | 0xFF000000;
+			memcpy( &aPixels[ i * 4 ], &col, 4 );
+		}
+
+		for ( uint32_t palette_size : aPaletteSizes )
+		{
+			const std::string strName = "synthetic (" + std::to_string( unique ) + " colors)";
+			bench_dataset( options, strName.c_str(), aPixels, palette_size );
+		}
+	}
+
+	// real images, as one buffer.
+	aPixels.clear();
+
+	for ( const std::string& file_name : options.aInputFiles )
+	{
+		int w, h, chan_count;
+		unsigned char* data = stbi_load( file_name.c_str(), &w, &h, &chan_count, 4 );
+		if ( data == nullptr )
+		{
+			printf( "Error - failed to load \"%s\".\n", file_name.c_str() );
+			continue;
+		}
+
+		aPixels.insert( aPixels.end(), data, data + size_t( w ) * size_t( h ) * 4 );
+		stbi_image_free( data );
+	}
+
+	if ( !aPixels.empty() )
+	{
+		for ( uint32_t palette_size : aPaletteSizes )
+		{
+			const std::string strName = std::to_string( options.aInputFiles.size() ) + " input file(s)";
+			bench_dataset( options, strName.c_str(), aPixels, palette_size );
+		}
+	}
+}
+
+//
+// print_stats
+//
+// Print the -stats report.
+//
+static void print_stats( const stats_t& stats )
+{
+	const double fMegaPixelsPerSec = ( stats.fAnalyseMs > 0 ) ? ( double( stats.uPixels ) / ( stats.fAnalyseMs * 1000.0 ) ) : 0;
+
+	printf( "Stats:\n" );
+	printf( "  analyse         %10.3f ms (%llu files, %llu pixels, %.2f Mpixel/s)\n", stats.fAnalyseMs,
+			static_cast<unsigned long long>( stats.uFiles ), static_cast<unsigned long long>( stats.uPixels ), fMegaPixelsPerSec );
+	printf( "    decode        %10.3f ms (all workers)\n", stats.fDecodeMs );
+	printf( "    count         %10.3f ms (all workers)\n", stats.fCountMs );
+	printf( "  compact         %10.3f ms (%llu unique colors)\n", stats.fCompactMs, static_cast<unsigned long long>( stats.uUniqueColors ) );
+	printf( "  reduce          %10.3f ms\n", stats.fReduceMs );
+	printf( "  crush           %10.3f ms\n", stats.fCrushMs );
+	printf( "  refine          %10.3f ms\n", stats.fRefineMs );
+	printf( "  write           %10.3f ms\n", stats.fWriteMs );
+	printf( "  total           %10.3f ms\n", stats.fTotalMs );
+	printf( "  histogram peak  %10.1f MB\n", double( stats.uPeakHistogramBytes ) / ( 1024.0 * 1024.0 ) );
+	printf( "  allocations     %10llu (%.1f MB)\n", static_cast<unsigned long long>( stats.uAllocCount ), double( stats.uAllocBytes ) / ( 1024.0 * 1024.0 ) );
+	putchar( '\n' );
+}
+
+//
+// write_stats_json
+//
+// Dump the -stats report to disk as JSON.
+//
+static void write_stats_json( const stats_t& stats, const std::string& strFileName )
+{
+	printf( "Writing \"%s\" ... ", strFileName.c_str() );
+
+	FILE* fp = nullptr;
+	int e = fopen_s( &fp, strFileName.c_str(), "w" );
+
+	if ( e != 0 || fp == nullptr )
+	{
+		printf( "FAILED\n\n" );
+		return;
+	}
+
+	fprintf( fp, "{\n" );
+	fprintf( fp, "\t\"analyse_ms\": %.3f,\n", stats.fAnalyseMs );
+	fprintf( fp, "\t\"decode_ms\": %.3f,\n", stats.fDecodeMs );
+	fprintf( fp, "\t\"count_ms\": %.3f,\n", stats.fCountMs );
+	fprintf( fp, "\t\"compact_ms\": %.3f,\n", stats.fCompactMs );
+	fprintf( fp, "\t\"reduce_ms\": %.3f,\n", stats.fReduceMs );
+	fprintf( fp, "\t\"crush_ms\": %.3f,\n", stats.fCrushMs );
+	fprintf( fp, "\t\"refine_ms\": %.3f,\n", stats.fRefineMs );
+	fprintf( fp, "\t\"write_ms\": %.3f,\n", stats.fWriteMs );
+	fprintf( fp, "\t\"total_ms\": %.3f,\n", stats.fTotalMs );
+	fprintf( fp, "\t\"files\": %llu,\n", static_cast<unsigned long long>( stats.uFiles ) );
+	fprintf( fp, "\t\"pixels\": %llu,\n", static_cast<unsigned long long>( stats.uPixels ) );
+	fprintf( fp, "\t\"pixels_per_sec\": %.0f,\n", ( stats.fAnalyseMs > 0 ) ? ( double( stats.uPixels ) * 1000.0 / stats.fAnalyseMs ) : 0.0 );
+	fprintf( fp, "\t\"unique_colors\": %llu,\n", static_cast<unsigned long long>( stats.uUniqueColors ) );
+	fprintf( fp, "\t\"peak_histogram_bytes\": %llu,\n", static_cast<unsigned long long>( stats.uPeakHistogramBytes ) );
+	fprintf( fp, "\t\"alloc_count\": %llu,\n", static_cast<unsigned long long>( stats.uAllocCount ) );
+	fprintf( fp, "\t\"alloc_bytes\": %llu\n", static_cast<unsigned long long>( stats.uAllocBytes ) );
+	fprintf( fp, "}\n" );
+
+	fclose( fp );
+
+	printf( "OK\n\n" );
+}
+
+//
+// report_stats
+//
+// -stats: print the run's timings and counters, and write them to -stats=<file>.
+//
+static void report_stats( const options_t& options, stats_t& stats, const phase_timer_t& timerTotal )
+{
+	if ( options.bStats )
+	{
+		stats.fTotalMs = timerTotal.Milliseconds();
+		stats.uAllocCount = timerTotal.Allocs();
+		stats.uAllocBytes = timerTotal.AllocBytes();
+
+		print_stats( stats );
+
+		if ( !options.strStatsFile.empty() )
+		{
+			write_stats_json( stats, options.strStatsFile );
+		}
+	}
+}
+
+//
+// do_work
+//
+// Palette generator.
+//
+static void do_work( const options_t& options )
+{
+	std::vector< color_t > aPalette;
+	bool bMaskDetected = false;
+
+	stats_t stats;
+	phase_timer_t timerTotal;
+	timerTotal.Start();
+
+	print_hello();
+
+	if ( options.aInputFiles.size() > 1 )
+	{
+		std::cout << ( options.bMerge ? "Merging " : "Analyzing " ) << options.aInputFiles.size() << " files ...\n";
+	}
+
+	color_histogram_t unique_colors;
+	unique_colors.Create( options.histogram, options.bAlpha, options.order == ORDER_ADJACENT );
+
+	tClock::time_point t0 = tClock::now();
+
+	if ( options.bMerge )
+	{
+		if ( !merge_partial_histograms( options, unique_colors, bMaskDetected, stats ) )
+		{
+			std::cout << "\nError - no palette was generated.\n";
+			return;
+		}
+	}
+	else if ( options.iRawChannels != 0 )
+		analyse_raw_frames( options, unique_colors, bMaskDetected, stats );
+	else
+		analyse_images( options, unique_colors, bMaskDetected, stats );
+
+	stats.fAnalyseMs = elapsed_ms( t0 );
+	t0 = tClock::now();
+
+	if ( !options.strPartialFile.empty() )
+	{
+		write_partial_histogram( options, unique_colors, bMaskDetected, stats );
+
+		stats.fWriteMs = elapsed_ms( t0 );
+
+		report_stats( options, stats, timerTotal );
+		return;
+	}
+
+	std::vector< sColorTotal > aColors;
+	unique_colors.Compact( aColors );
+
+	stats.fCompactMs = elapsed_ms( t0 );
+	stats.uUniqueColors = aColors.size();
+
+	std::cout << "\nDetected " << aColors.size() << " unique colors.\n";
+
+	{
+		switch ( options.method )
+		{
+		case METHOD_OCTREE:	std::cout << "Applying 'octree' reduction... "; break;
+		case METHOD_WU:		std::cout << "Applying 'Wu' reduction... "; break;
+		default:			std::cout << "Applying 'median cut' reduction... "; break;
+		}
+
+		std::vector< sColorTotal > aTotals;
+		reduce_colors( options, aColors, palette_target_size( options, bMaskDetected ), aTotals, &stats );
+
+		std::cout << "DONE.\n";
+
+		if ( options.uKMeansIterations > 0 )
+		{
+			std::cout << "Refining with 'k-means'... ";
+
+			t0 = tClock::now();
+
+			const uint32_t iterations = kmeans_refine( aColors, aTotals, options.uKMeansIterations, options.fKMeansLimit, options.uThreadCount );
+
+			stats.fRefineMs = elapsed_ms( t0 );
+
+			std::cout << iterations << " iteration(s) DONE.\n";
+		}
+
+		finish_palette( options, aTotals, bMaskDetected, aPalette, &unique_colors );
+	}
+
+	if ( aPalette.empty() )
+	{
+		std::cout << "\nError - no palette was generated.\n";
+		return;
+	}
+
+	if ( ( bMaskDetected && !options.bForceOpaque ) || options.bForceTransp )
+	{
+		std::cout << "Reduced palette to " << aPalette.size() - 1 << ". Plus transparent index 0.\n\n";
+	}
+	else
+	{
+		std::cout << "Reduced palette to " << aPalette.size() << ".\n\n";
+	}
+
+	// Try and write the output.
+	t0 = tClock::now();
+
+	write_hexfile( aPalette, options.strOutFile, options.bAlpha, options.pVerify );
+
+	stats.fWriteMs = elapsed_ms( t0 );
+
+	report_stats( options, stats, timerTotal );
+}
+
+//
+// run_slices
+//
+// Call fn( first, last ) over [0, count) split into up to thread_count slices, each on its
+// own thread.
+//
+template< typename FN >
+static void run_slices( size_t count, size_t thread_count, FN fn )
+{
+	const size_t uThreadCount = std::clamp< size_t >( thread_count, 1, std::max< size_t >( count, 1 ) );
+
+	if ( uThreadCount == 1 )
+	{
+		fn( size_t( 0 ), count );
+		return;
+	}
+
+	std::vector< std::thread > aThreads;
+	for ( size_t t = 0; t < uThreadCount; ++t )
+	{
+		aThreads.emplace_back( fn, count * t / uThreadCount, count * ( t + 1 ) / uThreadCount );
+	}
+
+	for ( std::thread& thread : aThreads )
+	{
+		thread.join();
+	}
+}
+
+//
+// tile_t
+//
+// The opaque colors of one -tiles tile, a range of (key, pixel count) in the shared list,
+// sorted by key, and their pixel weighted average.
+//
+struct tile_t
+{
+	size_t uFirst = 0;
+	size_t uCount = 0;
+	size_t uPixels = 0;
+	color_t colAverage;
+};
+
+//
+// load_tiles
+//
+// Decode the images, on up to thread_count threads, and split each into tiles of
+// uTileSize pixels (smaller at the right and bottom edges). Tiles are listed image by
+// image, in the order of aInputFiles, whatever order they were decoded in.
+//
+static bool load_tiles( const options_t& options, std::vector< tile_t >& aTiles, tColorCountList& aTileColors, bool& bMaskDetected, stats_t& stats )
+{
+	const std::vector< std::string > file_names( options.aInputFiles.begin(), options.aInputFiles.end() );
+
+	struct image_tiles_t
+	{
+		std::vector< tile_t > aTiles;
+		tColorCountList aColors;
+		bool bMaskDetected = false;
+		bool bSuccess = false;
+		std::string strLog;
+	};
+
+	std::vector< image_tiles_t > aImages( file_names.size() );
+	std::atomic< size_t > next_image = 0;
+	std::mutex mutexLog;
+
+	const size_t uThreadCount = std::min< size_t >( options.uThreadCount, file_names.size() );
+
+	run_slices( uThreadCount, uThreadCount, [&]( size_t, size_t )
+	{
+		std::vector< uint32_t > aKeys;
+
+		for ( size_t index = next_image++; index < file_names.size(); index = next_image++ )
+		{
+			image_tiles_t& image = aImages[ index ];
+			image.strLog = "Analyze: \"" + file_names[ index ] + "\" ... ";
+
+			mapped_file_t file;
+			int w = 0, h = 0, chan_count = 0;
+			unsigned char* data = nullptr;
+
+			if ( file.Open( file_names[ index ] ) && file._uSize <= size_t( INT_MAX ) )
+			{
+				data = stbi_load_from_memory( file._pData, static_cast<int>( file._uSize ), &w, &h, &chan_count, 4 );
+			}
+
+			if ( data == nullptr )
+			{
+				image.strLog += "FAILED\n";
+			}
+			else
+			{
+				const int tile_size = int( options.uTileSize );
+				const color_t* pPixels = reinterpret_cast< const color_t* >( data );
+
+				for ( int ty = 0; ty < h; ty += tile_size )
+				{
+					for ( int tx = 0; tx < w; tx += tile_size )
+					{
+						aKeys.clear();
+
+						for ( int y = ty; y < std::min( ty + tile_size, h ); ++y )
+						{
+							for ( int x = tx; x < std::min( tx + tile_size, w ); ++x )
+							{
+								const color_t col = pPixels[ size_t( y ) * size_t( w ) + x ];
+
+								if ( col.chan[ 3 ] != 0xFF )
+								{
+									image.bMaskDetected = true;
+									continue;
+								}
+
+								aKeys.push_back( col.value_abgr );
+							}
+						}
+
+						std::sort( aKeys.begin(), aKeys.end() );
+
+						tile_t tile;
+						tile.uFirst = image.aColors.size();
+						tile.uPixels = aKeys.size();
+
+						size_t sum[ 3 ] = { 0, 0, 0 };
+
+						for ( size_t i = 0; i < aKeys.size(); ++i )
+						{
+							if ( i == 0 || aKeys[ i ] != aKeys[ i - 1 ] )
+								image.aColors.emplace_back( aKeys[ i ], 0 );
+
+							image.aColors.back().second++;
+
+							color_t col;
+							col.value_abgr = aKeys[ i ];
+							sum[ 0 ] += col.chan[ 0 ];
+							sum[ 1 ] += col.chan[ 1 ];
+							sum[ 2 ] += col.chan[ 2 ];
+						}
+
+						tile.uCount = image.aColors.size() - tile.uFirst;
+						tile.colAverage.value_abgr = 0xFF000000;
+
+						for ( int c = 0; c < 3 && tile.uPixels > 0; ++c )
+						{
+							tile.colAverage.chan[ c ] = static_cast<uint8_t>( sum[ c ] / tile.uPixels );
+						}
+
+						image.aTiles.push_back( tile );
+					}
+				}
+
+				image.strLog += "LOADED (" + std::to_string( w ) + " x " + std::to_string( h ) + ") ... OK\n";
+				image.bSuccess = true;
+
+				stbi_image_free( data );
+			}
+
+			std::lock_guard< std::mutex > lock( mutexLog );
+			std::cout << image.strLog;
+		}
+	} );
+
+	for ( image_tiles_t& image : aImages )
+	{
+		if ( !image.bSuccess )
+			continue;
+
+		const size_t uBase = aTileColors.size();
+
+		for ( tile_t& tile : image.aTiles )
+		{
+			tile.uFirst += uBase;
+			aTiles.push_back( tile );
+			stats.uPixels += tile.uPixels;
+		}
+
+		aTileColors.insert( aTileColors.end(), image.aColors.begin(), image.aColors.end() );
+		bMaskDetected |= image.bMaskDetected;
+		stats.uFiles++;
+	}
+
+	return !aTiles.empty();
+}
+
+//
+// tile_error
+//
+// The pixel weighted squared error of a tile drawn with the nearest colors of a sub-palette.
+// Stops once it reaches bound, returning what it had, which is then only a lower bound.
+//
+static uint64_t tile_error( const tile_t& tile, const tColorCountList& aTileColors, const std::vector< color_t >& aColors, uint64_t bound = UINT64_MAX )
+{
+	uint64_t error = 0;
+
+	for ( size_t i = tile.uFirst; i < tile.uFirst + tile.uCount && error < bound; ++i )
+	{
+		color_t col;
+		col.value_abgr = aTileColors[ i ].first;
+
+		int best = INT_MAX;
+		for ( const color_t& option : aColors )
+		{
+			best = std::min( best, rgb_color_distance_squared( col, option ) );
+		}
+
+		error += uint64_t( best ) * aTileColors[ i ].second;
+	}
+
+	return error;
+}
+
+//
+// do_tiles
+//
+// -tiles=N: N sub-palettes, each of -tilecolors, for targets where each tile of the image
+// picks one sub-palette. Much like k-means, over tiles rather than colors:
+//
+// - seed: median cut the tiles' average colors into N groups, each tile joining the
+//   group of the nearest average.
+// - each group's palette: the tiles' colors added up and run through the -method
+//   quantizer (with -kmeans if given), or taken as they are if there are few enough.
+// - each tile moves to the sub-palette that draws it with the least error.
+//
+// This runs until no tile moves, kTileStall iterations go by without a better one, or
+// kTileIterations, keeping the assignment with the least error seen, as a quantizer
+// doesn't always lower the error of its group. Only
+// groups whose tiles changed are quantized again, spread over the threads, and only
+// errors against palettes that changed are measured again, in slices of tiles on every
+// thread. A tile is measured against another group's palette only until it is worse
+// than the best so far; what was cut short is kept as a lower bound, and measured again
+// only once it could win. An emptied group takes the tile drawn worst by its own
+// palette. Ties go to the tile's current group, then the lowest, so the result doesn't
+// depend on the thread count.
+//
+// The output is the sub-palettes one after another, each -tilecolors long, padded with
+// black, and with the transparent index 0 in each if the images have transparency.
+//
+static constexpr uint32_t kTileIterations = 64;
+static constexpr uint32_t kTileStall = 8; // iterations without a new best, before giving up.
 
-static void count_unique_image_lum_4ch( uint8_t* data, int width, int height, tUniqueColorMap& col_counts, bool& bMaskDetected )
+static void do_tiles( const options_t& options )
 {
-	for ( int y = 0; y < height; ++y )
-	{
-		for ( int x = 0; x < width; ++x )
-		{
-			color_t col;
-			col.chan[ 0 ] = data[ 0 ];
-			col.chan[ 1 ] = data[ 1 ];
-			col.chan[ 2 ] = data[ 2 ];
-			col.chan[ 3 ] = data[ 3 ];
+	stats_t stats;
+	phase_timer_t timerTotal;
+	timerTotal.Start();
 
-			col.make_lum();
+	print_hello();
 
-			data += 4;
+	tClock::time_point t0 = tClock::now();
 
-			// not-opaque pixel?
-			if ( ( col.chan[ 3 ] ) != 0xFF )
-			{
-				bMaskDetected = true;
-				continue;
-			}
+	std::vector< tile_t > aTiles;
+	tColorCountList aTileColors;
+	bool bMaskDetected = false;
 
-			// Add to the map
-			col_counts[ col.value_abgr ]++;
-		}
+	if ( !load_tiles( options, aTiles, aTileColors, bMaskDetected, stats ) || aTileColors.empty() )
+	{
+		std::cout << "\nError - no tiles with opaque pixels were loaded.\n";
+		return;
 	}
-}
 
-static void count_unique_image_cols_3ch( uint8_t* data, int width, int height, tUniqueColorMap& col_counts )
-{
-	for ( int y = 0; y < height; ++y )
-	{
-		for ( int x = 0; x < width; ++x )
-		{
-			color_t col;
-			col.chan[ 0 ] = data[ 0 ];
-			col.chan[ 1 ] = data[ 1 ];
-			col.chan[ 2 ] = data[ 2 ];
-			col.chan[ 3 ] = 0xFF;
+	stats.fAnalyseMs = elapsed_ms( t0 );
+	t0 = tClock::now();
 
-			data += 3;
+	const size_t uGroups = options.uSubPalettes;
+	const size_t uTiles = aTiles.size();
 
-			// Add to the map
-			col_counts[ col.value_abgr ]++;
-		}
-	}
-}
+	std::cout << "\nDetected " << uTiles << " tiles.\n";
+	std::cout << "Clustering into " << uGroups << " sub-palettes of " << options.uTileColors << "... ";
 
-static void count_unique_image_cols_4ch( uint8_t* data, int width, int height, tUniqueColorMap& col_counts, bool& bMaskDetected )
-{
-	for ( int y = 0; y < height; ++y )
+	// each group is quantized on one thread, the groups in parallel.
+	palgen_settings_t groupSettings = options;
+	groupSettings.uPaletteSizeReal = options.uTileColors;
+	groupSettings.uThreadCount = 1;
+
+	const uint32_t uGroupColors = palette_target_size( groupSettings, bMaskDetected );
+
+	// seed, from the tile averages.
+	std::vector< uint32_t > aGroup( uTiles, 0 );
 	{
-		for ( int x = 0; x < width; ++x )
+		std::vector< sColorTotal > aAverages;
+		aAverages.reserve( uTiles );
+
+		for ( const tile_t& tile : aTiles )
 		{
-			color_t col;
-			col.chan[ 0 ] = data[ 0 ];
-			col.chan[ 1 ] = data[ 1 ];
-			col.chan[ 2 ] = data[ 2 ];
-			col.chan[ 3 ] = data[ 3 ];
+			aAverages.emplace_back( tile.colAverage.value_abgr, std::max< size_t >( tile.uPixels, 1 ) );
+		}
 
-			data += 4;
+		std::vector< sColorTotal > aSeeds;
+		median_cut( aAverages, next_power_two( uint32_t( std::max< size_t >( uGroups, 2 ) ) ), COLOR_SPACE_RGB, aSeeds, options.uThreadCount );
+		crush_palette( aSeeds, uGroups );
 
-			// not-opaque pixel?
-			if ( ( col.chan[ 3 ] ) != 0xFF )
+		run_slices( uTiles, options.uThreadCount, [&]( size_t first, size_t last )
+		{
+			for ( size_t t = first; t < last; ++t )
 			{
-				bMaskDetected = true;
-				continue;
-			}
+				int best = INT_MAX;
 
-			// Add to the map
-			col_counts[ col.value_abgr ]++;
-		}
+				for ( size_t g = 0; g < aSeeds.size(); ++g )
+				{
+					const int dist = rgb_color_distance_squared( aTiles[ t ].colAverage, aSeeds[ g ]._colAverage );
+					if ( dist < best )
+					{
+						best = dist;
+						aGroup[ t ] = uint32_t( g );
+					}
+				}
+			}
+		} );
 	}
-}
-
-//
-// analyse_images
-//
-// Load and run count_unique_image_cols on all image files to build a unique color map.
-//
-static void analyse_images( const options_t& options,
-							tUniqueColorMap& unique_colors,
-							bool& bMaskDetected )
-{
-	const std::set< std::string >& file_names = options.aInputFiles;
 
-	for ( const auto& file_name : file_names )
-	{
-		int w, h, chan_count;
-		unsigned char* data;
+	std::vector< std::vector< color_t > > aPalettes( uGroups );
+	std::vector< uint64_t > aError( uTiles * uGroups, UINT64_MAX ); // [ tile * uGroups + group ], UINT64_MAX for no palette.
+	std::vector< uint8_t > aExact( uTiles * uGroups, 1 ); // or only a lower bound, from a measure cut short.
+	std::vector< uint8_t > aDirty( uGroups, 1 ); // the group's tiles changed.
+	std::vector< uint8_t > aChanged( uGroups, 0 ); // the group's palette changed.
 
-		std::cout << "Analyze: \"" << file_name << "\" ... ";
+	// the best assignment yet, with the palettes it was measured against.
+	std::vector< uint32_t > aBestGroup;
+	std::vector< std::vector< color_t > > aBestPalettes;
+	uint64_t uBestError = UINT64_MAX;
+	uint32_t uBestIteration = 0;
 
-		data = stbi_load( file_name.c_str(), &w, &h, &chan_count, 0 );
+	uint32_t iterations = 0;
 
-		if ( data == nullptr )
+	for ( ; iterations < kTileIterations; ++iterations )
+	{
+		// the palettes of groups whose tiles changed.
+		std::vector< uint32_t > aRebuild;
+		for ( uint32_t g = 0; g < uGroups; ++g )
 		{
-			std::cout << "FAILED\n";
-			continue;
+			aChanged[ g ] = 0;
+			if ( aDirty[ g ] )
+				aRebuild.push_back( g );
 		}
-		else if ( chan_count != 3 && chan_count != 4 )
+
+		std::vector< std::vector< size_t > > aMembers( uGroups );
+		for ( size_t t = 0; t < uTiles; ++t )
 		{
-			std::cout << "INVALID-CHANNELS (" << chan_count << ")\n";
-			continue;
+			if ( aDirty[ aGroup[ t ] ] )
+				aMembers[ aGroup[ t ] ].push_back( t );
 		}
-		else
+
+		std::atomic< size_t > next_group = 0;
+
+		run_slices( std::min( aRebuild.size(), size_t( options.uThreadCount ) ), options.uThreadCount, [&]( size_t, size_t )
 		{
-			std::cout << "LOADED (" << w << " x " << h << ") ... ";
+			tColorCountList aCounts;
 
-			if ( options.bLuminance )
+			for ( size_t r = next_group++; r < aRebuild.size(); r = next_group++ )
 			{
-				switch ( chan_count )
+				const uint32_t g = aRebuild[ r ];
+
+				aCounts.clear();
+				for ( size_t t : aMembers[ g ] )
 				{
+					const tile_t& tile = aTiles[ t ];
+					aCounts.insert( aCounts.end(), aTileColors.begin() + tile.uFirst, aTileColors.begin() + tile.uFirst + tile.uCount );
+				}
 
-				case 3:
-					count_unique_image_lum_3ch( data, w, h, unique_colors );
-					break;
+				std::sort( aCounts.begin(), aCounts.end() );
 
-				case 4:
-					count_unique_image_lum_4ch( data, w, h, unique_colors, bMaskDetected );
-					break;
+				std::vector< sColorTotal > aColors;
+				for ( const auto& [key, count] : aCounts )
+				{
+					if ( !aColors.empty() && aColors.back()._colAverage.value_abgr == key )
+						aColors.back().Set( key, aColors.back()._uTotal + count );
+					else
+						aColors.emplace_back( key, size_t( count ) );
+				}
+
+				std::vector< color_t > aNew;
+
+				if ( aColors.size() <= uGroupColors )
+				{
+					for ( const sColorTotal& total : aColors )
+						aNew.push_back( total._colAverage );
+				}
+				else
+				{
+					std::vector< sColorTotal > aTotals;
+					reduce_colors( groupSettings, aColors, uGroupColors, aTotals );
+
+					if ( groupSettings.uKMeansIterations > 0 )
+					{
+						kmeans_refine( aColors, aTotals, groupSettings.uKMeansIterations, groupSettings.fKMeansLimit, 1 );
+					}
+
+					for ( const sColorTotal& total : aTotals )
+						aNew.push_back( total._colAverage );
+				}
+
+				sort_palette_rgb( aNew );
 
+				if ( !std::equal( aNew.begin(), aNew.end(), aPalettes[ g ].begin(), aPalettes[ g ].end(), []( color_t c1, color_t c2 ) { return c1.value_abgr == c2.value_abgr; } ) )
+				{
+					aPalettes[ g ] = std::move( aNew );
+					aChanged[ g ] = 1;
 				}
 			}
-			else
+		} );
+
+		// errors against the palettes that changed, then the tiles' best groups.
+		std::atomic< size_t > moves = 0;
+		std::atomic< uint64_t > error = 0;
+		std::vector< uint32_t > aNewGroup( aGroup );
+
+		run_slices( uTiles, options.uThreadCount, [&]( size_t first, size_t last )
+		{
+			size_t uMoves = 0;
+			uint64_t uError = 0;
+
+			for ( size_t t = first; t < last; ++t )
 			{
-				switch ( chan_count )
+				uint64_t* pError = &aError[ t * uGroups ];
+				uint8_t* pExact = &aExact[ t * uGroups ];
+
+				// a palette is measured against a tile only as far as it could beat the best so
+				// far; a lower bound left from before is measured again once it might.
+				auto measure = [&]( size_t g, uint64_t bound )
 				{
+					pError[ g ] = aPalettes[ g ].empty() ? UINT64_MAX : tile_error( aTiles[ t ], aTileColors, aPalettes[ g ], bound );
+					pExact[ g ] = ( pError[ g ] < bound ) || aPalettes[ g ].empty();
+				};
 
-				case 3:
-					count_unique_image_cols_3ch( data, w, h, unique_colors );
-					break;
+				uint32_t best = aGroup[ t ];
+				if ( aChanged[ best ] || !pExact[ best ] )
+				{
+					measure( best, UINT64_MAX );
+				}
 
-				case 4:
-					count_unique_image_cols_4ch( data, w, h, unique_colors, bMaskDetected );
-					break;
+				for ( uint32_t g = 0; g < uGroups; ++g )
+				{
+					if ( g == aGroup[ t ] )
+						continue;
+
+					if ( aChanged[ g ] || ( !pExact[ g ] && pError[ g ] < pError[ best ] ) )
+						measure( g, pError[ best ] );
+
+					if ( pExact[ g ] && pError[ g ] < pError[ best ] )
+						best = g;
+				}
 
+				if ( best != aGroup[ t ] )
+				{
+					aNewGroup[ t ] = best;
+					++uMoves;
 				}
+
+				uError += pError[ best ];
 			}
 
-			stbi_image_free( data );
+			moves += uMoves;
+			error += uError;
+		} );
 
-			std::cout << "OK\n";
+		if ( error < uBestError )
+		{
+			uBestError = error;
+			aBestGroup = aNewGroup;
+			aBestPalettes = aPalettes;
+			uBestIteration = iterations;
+		}
+		else if ( iterations >= uBestIteration + kTileStall )
+		{
+			++iterations;
+			break;
 		}
-	}
-}
 
-//==============================================================================
+		for ( uint32_t g = 0; g < uGroups; ++g )
+		{
+			aDirty[ g ] = 0;
+		}
 
-static int median_find_axis( const tColorBucket& aBucket )
-{
-	int big_axis = 1;
+		std::vector< size_t > aSize( uGroups, 0 );
+		for ( size_t t = 0; t < uTiles; ++t )
+		{
+			if ( aNewGroup[ t ] != aGroup[ t ] )
+			{
+				aDirty[ aGroup[ t ] ] = 1;
+				aDirty[ aNewGroup[ t ] ] = 1;
+			}
 
-	int r_min = 0xFF, g_min = 0xFF, b_min = 0xFF;
-	int r_max = 0, g_max = 0, b_max = 0;
+			++aSize[ aNewGroup[ t ] ];
+		}
 
-	for ( const sColorTotal* pTotal : aBucket )
-	{
-		const color_t& color = pTotal->_colAverage;
+		aGroup = std::move( aNewGroup );
 
-		if ( color.chan[ 3 ] != 0xFF )
-			continue;
+		// an empty group takes the tile worst drawn by its own group's palette.
+		for ( uint32_t g = 0; g < uGroups; ++g )
+		{
+			if ( aSize[ g ] != 0 )
+				continue;
 
-		r_min = std::min< int >( r_min, color.chan[ 0 ] );
-		g_min = std::min< int >( g_min, color.chan[ 1 ] );
-		b_min = std::min< int >( b_min, color.chan[ 2 ] );
+			size_t worst = SIZE_MAX;
+			for ( size_t t = 0; t < uTiles; ++t )
+			{
+				if ( aSize[ aGroup[ t ] ] > 1 && ( worst == SIZE_MAX || aError[ t * uGroups + aGroup[ t ] ] > aError[ worst * uGroups + aGroup[ worst ] ] ) )
+					worst = t;
+			}
 
-		r_max = std::max< int >( r_max, color.chan[ 0 ] );
-		g_max = std::max< int >( g_max, color.chan[ 1 ] );
-		b_max = std::max< int >( b_max, color.chan[ 2 ] );
+			if ( worst == SIZE_MAX )
+				break; // fewer tiles than groups.
+
+			--aSize[ aGroup[ worst ] ];
+			++aSize[ g ];
+			aDirty[ aGroup[ worst ] ] = 1;
+			aDirty[ g ] = 1;
+			aGroup[ worst ] = g;
+			++moves;
+		}
+
+		if ( moves == 0 )
+		{
+			++iterations;
+			break;
+		}
 	}
 
-	int r_range, g_range, b_range;
+	stats.fReduceMs = elapsed_ms( t0 );
 
-	r_range = r_max - r_min;
-	g_range = g_max - g_min;
-	b_range = b_max - b_min;
+	std::cout << iterations << " iteration(s) DONE.\n";
 
-	if ( g_range >= r_range && g_range >= b_range )
-		big_axis = 1; // G
-	else if ( b_range >= r_range && b_range >= g_range )
-		big_axis = 2; // B
-	else if ( r_range >= g_range && r_range >= b_range )
-		big_axis = 0; // R
+	aGroup = std::move( aBestGroup );
+	aPalettes = std::move( aBestPalettes );
 
-	return big_axis;
-}
+	std::vector< size_t > aSize( uGroups, 0 );
 
-static void median_sort_bucket( tColorBucket& aBucket, int channel_axis )
-{
-	if ( aBucket.size() < 2 )
+	for ( size_t t = 0; t < uTiles; ++t )
 	{
-		return;
+		++aSize[ aGroup[ t ] ];
 	}
 
-	uint32_t mask;
-	mask = 0xFF << ( channel_axis * 8 );
+	const bool bTransparent = ( bMaskDetected && !options.bForceOpaque ) || options.bForceTransp;
 
-	// sort along the given channel axis
-	std::sort( aBucket.begin(), aBucket.end(), [&]( sColorTotal* t1, sColorTotal* t2 )
-			   {
-				   const uint32_t col1 = t1->_colAverage.value_abgr;
-				   const uint32_t col2 = t2->_colAverage.value_abgr;
-
-				   // move larger values to the end of the array.
-				   return ( col1 & mask ) < ( col2 & mask );
-			   } );
-}
+	std::vector< color_t > aPalette;
 
-static uint32_t find_median_bucket_final_color( const tColorBucket& aBucket )
-{
-	if ( aBucket.empty() )
+	for ( size_t g = 0; g < uGroups; ++g )
 	{
-		return 0;
+		std::cout << "  sub-palette " << g << ": " << aSize[ g ] << " tiles, " << aPalettes[ g ].size() << " colors\n";
+
+		if ( bTransparent )
+		{
+			aPalette.push_back( color_t( KEY_TRANSPARENT ) );
+		}
+
+		aPalette.insert( aPalette.end(), aPalettes[ g ].begin(), aPalettes[ g ].end() );
+		aPalette.resize( ( g + 1 ) * options.uTileColors, color_t( 0xFF000000 ) );
 	}
 
-	sColorTotal mega( 0, 0 );
+	printf( "Mean squared error %.2f per pixel.\n\n", stats.uPixels ? double( uBestError ) / double( stats.uPixels ) : 0.0 );
 
-	for ( const sColorTotal* pColor : aBucket )
-	{
-		mega._uTotal += pColor->_uTotal;
+	t0 = tClock::now();
 
-		mega._uScaledRGBA[ 0 ] += pColor->_uScaledRGBA[ 0 ];
-		mega._uScaledRGBA[ 1 ] += pColor->_uScaledRGBA[ 1 ];
-		mega._uScaledRGBA[ 2 ] += pColor->_uScaledRGBA[ 2 ];
-		mega._uScaledRGBA[ 3 ] += pColor->_uScaledRGBA[ 3 ];
-	}
+	write_hexfile( aPalette, options.strOutFile, false, options.pVerify );
 
-	mega.GenerateAverage();
+	stats.fWriteMs = elapsed_ms( t0 );
 
-	return mega._colAverage.value_abgr;
+	report_stats( options, stats, timerTotal );
 }
 
-static void median_cut_inner( tColorBucket& aSourceBucket, std::vector< tColorBucket* >& aOutBuckets )
+//
+// do_manifest
+//
+// Generate every palette of a -manifest. The images are decoded once, each one being
+// merged into the histogram of every group that lists it, then the groups are reduced
+// in parallel.
+//
+static void do_manifest( const options_t& options )
 {
-	int axis = median_find_axis( aSourceBucket );
+	stats_t stats;
+	phase_timer_t timerTotal;
+	timerTotal.Start();
 
-	median_sort_bucket( aSourceBucket, axis );
+	print_hello();
 
-	const size_t median_index = ( ( aSourceBucket.size() + 1 ) / 2 );
+	std::cout << "Analyzing " << options.aInputFiles.size() << " files for " << options.aGroups.size() << " palettes ...\n";
 
-	tColorBucket* bucket_a, * bucket_b;
+	const size_t uGroups = options.aGroups.size();
 
-	bucket_a = new tColorBucket;
-	for ( size_t i = 0; i < median_index; ++i )
-	{
-		bucket_a->push_back( aSourceBucket[ i ] );
-	}
+	std::vector< color_histogram_t > aHistograms( uGroups );
+	std::vector< uint8_t > aMaskDetected( uGroups, 0 );
 
-	bucket_b = new tColorBucket;
-	for ( size_t i = median_index; i < aSourceBucket.size(); ++i )
+	for ( color_histogram_t& hist : aHistograms )
 	{
-		bucket_b->push_back( aSourceBucket[ i ] );
+		hist.Create( options.histogram, options.bAlpha );
 	}
 
-	aOutBuckets.push_back( bucket_a );
-	aOutBuckets.push_back( bucket_b );
-}
-
-void median_cut( tUniqueColorMap& unique_colors, const uint32_t max_colors, std::vector< color_t >& aPalette )
-{
-	// transfer the unique color map into a vector
-	tColorBucket* pOriginalBucket = new tColorBucket();
-	for ( const auto& [key, value] : unique_colors )
+	// which groups each image belongs to.
+	std::map< std::string, std::vector< size_t > > mapFileGroups;
+	for ( size_t g = 0; g < uGroups; ++g )
 	{
-		pOriginalBucket->push_back( new sColorTotal( key, value ) );
+		for ( const std::string& file_name : options.aGroups[ g ].aInputFiles )
+		{
+			mapFileGroups[ file_name ].push_back( g );
+		}
 	}
 
-	// initial split of full color list.
-	std::vector< tColorBucket* > aBuckets;
-	median_cut_inner( *pOriginalBucket, aBuckets );
-
-	// can we subdivide further?
-	while ( aBuckets.size() * 2 <= max_colors )
+	// called on this thread only, so the group histograms need no locking.
+	const tFileSink sink = [ & ]( const std::string& file_name, const cache_entry_t& entry )
 	{
-		std::vector< tColorBucket* > aNewBuckets;
+		auto it = mapFileGroups.find( file_name );
+		if ( it == mapFileGroups.end() )
+		{
+			return;
+		}
 
-		for ( tColorBucket* pBucket : aBuckets )
+		for ( size_t g : it->second )
 		{
-			median_cut_inner( *pBucket, aNewBuckets );
-			delete pBucket;
+			bool bMask = aMaskDetected[ g ] != 0;
+			merge_cache_entry( entry, aHistograms[ g ], bMask );
+			aMaskDetected[ g ] = bMask ? 1 : 0;
 		}
+	};
 
-		aBuckets.clear();
-		std::swap( aBuckets, aNewBuckets );
-	}
+	tClock::time_point t0 = tClock::now();
 
-	// transfer color averages into the final palette.
-	for ( const tColorBucket* pBucket : aBuckets )
+	color_histogram_t unused;
+	bool bUnusedMask = false;
+	analyse_images( options, unused, bUnusedMask, stats, &sink );
+
+	stats.fAnalyseMs = elapsed_ms( t0 );
+
+	for ( const color_histogram_t& hist : aHistograms )
 	{
-		color_t color;
-		color.value_abgr = find_median_bucket_final_color( *pBucket );
+		stats.uPeakHistogramBytes += hist.MemoryBytes();
+	}
+	t0 = tClock::now();
 
-		aPalette.push_back( color );
+	// Reduce each group on its own thread, k-means is single threaded within a group.
+	std::vector< std::vector< color_t > > aPalettes( uGroups );
+	std::vector< size_t > aUniqueColors( uGroups, 0 );
+	std::atomic< size_t > uNextGroup = 0;
 
-		// clean up the bucket
-		for ( sColorTotal* pTotal : *pBucket )
+	auto reduce_fn = [ & ]()
+	{
+		for ( size_t g = uNextGroup++; g < uGroups; g = uNextGroup++ )
 		{
-			delete pTotal;
-		}
+			const bool bMask = aMaskDetected[ g ] != 0;
 
-		delete pBucket;
-	}
+			std::vector< sColorTotal > aColors;
+			aHistograms[ g ].Compact( aColors );
+			aHistograms[ g ] = color_histogram_t(); // release the group's histogram early.
 
-	delete pOriginalBucket;
-}
+			aUniqueColors[ g ] = aColors.size();
 
-//==============================================================================
+			std::vector< sColorTotal > aTotals;
+			reduce_colors( options, aColors, palette_target_size( options, bMask ), aTotals );
 
-static void sort_palette_rgb( std::vector< color_t >& aPalette )
-{
-	if ( aPalette.size() < 2 )
-		return;
+			if ( options.uKMeansIterations > 0 )
+			{
+				kmeans_refine( aColors, aTotals, options.uKMeansIterations, options.fKMeansLimit, 1 );
+			}
 
-	std::sort( aPalette.begin(), aPalette.end(), [&]( color_t t1, color_t t2 )
-			   {
-				   // move larger values to the end of the array.
-				   return ( t1.sum_rgb() ) < ( t2.sum_rgb() );
-			   } );
-}
+			finish_palette( options, aTotals, bMask, aPalettes[ g ] );
+		}
+	};
 
-//==============================================================================
+	{
+		const size_t uThreads = std::min< size_t >( std::max< uint32_t >( options.uThreadCount, 1 ), uGroups );
 
-//
-// do_work
-//
-// Palette generator.
-//
-static void do_work( const options_t& options )
-{
-	std::vector< color_t > aPalette;
-	bool bMaskDetected = false;
+		std::vector< std::thread > aThreads;
+		for ( size_t i = 1; i < uThreads; ++i )
+		{
+			aThreads.emplace_back( reduce_fn );
+		}
 
-	print_hello();
+		reduce_fn();
 
-	if ( options.aInputFiles.size() > 1 )
-	{
-		std::cout << "Analyzing " << options.aInputFiles.size() << " files ...\n";
+		for ( std::thread& thread : aThreads )
+		{
+			thread.join();
+		}
 	}
 
-	tUniqueColorMap unique_colors;
+	stats.fReduceMs = elapsed_ms( t0 );
+	t0 = tClock::now();
 
-	analyse_images( options, unique_colors, bMaskDetected );
-
-	std::cout << "\nDetected " << unique_colors.size() << " unique colors.\n";
+	putchar( '\n' );
 
+	for ( size_t g = 0; g < uGroups; ++g )
 	{
-		std::cout << "Applying 'median cut' reduction... ";
+		const palette_group_t& group = options.aGroups[ g ];
+		std::vector< color_t >& aPalette = aPalettes[ g ];
 
-		median_cut( unique_colors, options.uPaletteSizePow2, aPalette );
+		stats.uUniqueColors += aUniqueColors[ g ];
 
-		uint32_t targetSize = options.uPaletteSizeReal;
-		if ( ( bMaskDetected && !options.bForceOpaque ) || options.bForceTransp )
+		if ( aPalette.empty() )
 		{
-			--targetSize;
+			std::cout << "Error - no palette was generated for \"" << group.strOutFile << "\".\n";
+			continue;
 		}
 
-		crush_palette( aPalette, targetSize );
+		std::cout << group.aInputFiles.size() << " file(s), " << aUniqueColors[ g ] << " unique colors, reduced to " << aPalette.size() << ". ";
 
-		sort_palette_rgb( aPalette ); // move black to index 0
+		write_hexfile( aPalette, group.strOutFile, options.bAlpha, options.pVerify );
 	}
 
-	if ( aPalette.empty() )
+	stats.fWriteMs = elapsed_ms( t0 );
+
+	if ( options.bStats )
 	{
-		std::cout << "\nError - no palette was generated.\n";
-		return;
-	}
+		stats.fTotalMs = timerTotal.Milliseconds();
+		stats.uAllocCount = timerTotal.Allocs();
+		stats.uAllocBytes = timerTotal.AllocBytes();
 
-	std::cout << "DONE.\n";
+		print_stats( stats );
 
-	if ( ( bMaskDetected && !options.bForceOpaque ) || options.bForceTransp )
-	{
-		std::cout << "Reduced palette to " << aPalette.size() << ". Plus transparent index 0.\n\n";
+		if ( !options.strStatsFile.empty() )
+		{
+			write_stats_json( stats, options.strStatsFile );
+		}
+	}
+}
 
-		aPalette.insert( aPalette.begin(), color_t( KEY_TRANSPARENT ) );
+//
+// do_job
+//
+// A run of palgen: one palette, -tiles or a -manifest, under -verify if it is given. False
+// if -verify found a palette that differs.
+//
+static bool do_job( options_t& options )
+{
+	verify_manifest_t verify;
+	if ( !options.strVerifyFile.empty() )
+	{
+		if ( verify.Open( options.strVerifyFile ) == false )
+		{
+			printf( "Error - could not read the verify manifest \"%s\".\n", options.strVerifyFile.c_str() );
+			return false;
+		}
+		options.pVerify = &verify;
 	}
+
+	if ( !options.aGroups.empty() )
+		do_manifest( options );
+	else if ( options.uSubPalettes != 0 )
+		do_tiles( options );
 	else
+		do_work( options );
+
+	if ( options.pVerify == nullptr )
 	{
-		std::cout << "Reduced palette to " << aPalette.size() << ".\n\n";
+		return true;
 	}
 
-	// Try and write the output.
-	write_hexfile( aPalette, options.strOutFile );
+	options.pVerify = nullptr;
+
+	std::string strLog;
+	const bool bOK = verify.Close( strLog );
+	fputs( strLog.c_str(), stdout );
+	return bOK;
+}
+
+//
+// run_server
+//
+// -serve: each job (see palserve.h) has the arguments of a normal run, and is run in turn
+// with its own -threads. palgen prints as it goes, so a job's log comes out on stdout ahead
+// of its answer; a client of the pipe gets just the answer. -raw jobs are refused, as
+// stdin is either the jobs themselves or not the client's.
+//
+static void run_server( const options_t& server )
+{
+	serve_jobs( server.strServe, 1, [&]( std::vector< std::string >& aArgs, std::string& )
+	{
+		std::vector< char* > argv = serve_argv( "palgen", aArgs );
+
+		options_t job;
+		if ( process_args( int( argv.size() ), argv.data(), job ) == false || job.bServe || job.bBenchmark || job.iRawChannels != 0 )
+		{
+			return false;
+		}
+
+		const bool bOK = do_job( job );
+
+		fflush( stdout );
+		return bOK;
+	} );
 }
 
 //
@@ -852,7 +7175,12 @@ int main( int argc, char** argv )
 
 	if ( process_args( argc, argv, options ) )
 	{
-		do_work( options );
+		if ( options.bServe )
+			run_server( options );
+		else if ( options.bBenchmark )
+			do_benchmark( options );
+		else if ( do_job( options ) == false )
+			return 1;
 	}
 	else
 	{
@@ -863,3 +7191,5 @@ int main( int argc, char** argv )
 
 	return 0;
 }
+
+#endif // !defined( PALGEN_LIBRARY )
@@ -0,0 +1,156 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2024-2025 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palgen.h
+//
+// Library interface. Build palgen.cpp with PALGEN_LIBRARY defined to leave out the
+// command line entry point, and call palgen_generate with images already in memory.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "paltask.h" // the shared thread cap, from palcore
+
+//=============================================================================
+
+struct color_t
+{
+	union
+	{
+		uint32_t value_abgr;
+		uint8_t chan[ 4 ]; // R, G, B, A
+	};
+
+public:
+	inline uint32_t sum_rgb()
+	{
+		return (int)chan[ 0 ] + (int)chan[ 1 ] + (int)chan[ 2 ];
+	}
+
+	inline void make_lum()
+	{
+		// https://en.wikipedia.org/wiki/Relative_luminance
+		const float lum = ( chan[ 0 ] * 0.299f ) + ( chan[ 1 ] * 0.587f ) + ( chan[ 2 ] * 0.114f );
+		const uint8_t g = uint8_t( std::clamp( int( round( lum ) ), 0, 255 ) );
+		chan[ 0 ] = chan[ 1 ] = chan[ 2 ] = g;
+	}
+};
+
+typedef enum
+{
+	HISTOGRAM_MAP,		// sparse hash map, exact colors.
+	HISTOGRAM_RGB24,	// dense 8-8-8 counters, exact colors.
+	HISTOGRAM_RGB18,	// dense 6-6-6 counters.
+	HISTOGRAM_RGB16,	// dense 5-6-5 counters.
+	HISTOGRAM_RGB15,	// dense 5-5-5 counters.
+	HISTOGRAM_TWO_LEVEL,	// 5-5-5 cells, the colors seen in each, exact counts in cells with few.
+}
+histogram_t;
+
+typedef enum
+{
+	METHOD_MEDIAN_CUT,	// median cut, then crush (or -adaptive).
+	METHOD_OCTREE,		// octree leaf reduction.
+	METHOD_WU,			// Wu's variance minimising box splits.
+}
+method_t;
+
+typedef enum
+{
+	COLOR_SPACE_RGB,	// split and merge on sRGB values.
+	COLOR_SPACE_OKLAB,	// split and merge on perceptual Oklab coordinates.
+}
+color_space_t;
+
+typedef enum
+{
+	ORDER_SUM,			// by R+G+B, black first.
+	ORDER_ADJACENT,		// colors that are often neighbours get close indices.
+}
+palette_order_t;
+
+//
+// palgen_settings_t
+//
+// Palette generation settings, shared by the command line tool and the library.
+//
+struct palgen_settings_t
+{
+	uint32_t uPaletteSizeReal = 256; // including the transparent index, if any. Must be > 2.
+
+	histogram_t histogram = HISTOGRAM_RGB24;
+	method_t method = METHOD_MEDIAN_CUT;
+	color_space_t colorSpace = COLOR_SPACE_RGB;
+	palette_order_t order = ORDER_SUM;
+
+	uint32_t uThreadCount = task_thread_cap();
+	uint32_t uSampleRate = 1;
+	uint32_t uEdgeWeight = 0; // 0 counts each pixel once, else one of the most local contrast up to 1 + this times (at most 64).
+
+	uint32_t uKMeansIterations = 0;
+	float fKMeansLimit = 0.5f;
+
+	bool bAdaptive = false;
+	bool bLuminance = false;
+	bool bAlpha = false; // quantise translucent pixels too (median cut only, no k-means), alpha is a split axis.
+	bool bForceTransp = false;
+	bool bForceOpaque = false;
+};
+
+//
+// palgen_image_t
+//
+// An image in memory. 3 (RGB) or 4 (RGBA) channels of 8 bits, rows tightly packed.
+//
+struct palgen_image_t
+{
+	const uint8_t* pPixels = nullptr;
+	int iWidth = 0;
+	int iHeight = 0;
+	int iChannels = 0;
+};
+
+//
+// palgen_generate
+//
+// Generate a palette from one or more images. Nothing is printed or written to disk.
+// If transparency is detected (or forced) the palette starts with a transparent
+// (magenta) index 0. Returns false if an image is invalid, bAlpha is set with k-means
+// iterations, or no palette was made.
+//
+bool palgen_generate( const palgen_settings_t& settings,
+					  const palgen_image_t* pImages,
+					  size_t uImageCount,
+					  std::vector< color_t >& aPalette );
@@ -0,0 +1,1156 @@
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//=============================================================================
+//
+// palpipe.cpp
+//
+// Runs the palgen, fogpal and applypal stages of an asset build in one process, from a
+// job file. Images are decoded once and kept, palettes and fog tables are passed on in
+// memory, and nothing is written but the outputs asked for.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "palgen.h" // palgen.cpp, built with PALGEN_LIBRARY
+#include "fogcore.h"
+#include "paltask.h"
+#include "palcpu.h"
+#include "paldeflate.h"
+#include "paltrace.h" // TRACE_ZONE, compiled out unless FRAGMENTS_TRACE or TRACY_ENABLE
+#include "palfind.h" // input wildcards, with ** for every folder below
+#include "palverify.h" // -verify, hashes of the outputs before they are encoded
+
+#include "png.h" // libpng
+
+#include "stb_image.h" // the implementation is in palgen.cpp
+
+//=============================================================================
+
+//
+// pipe_image_t
+//
+// A source image, decoded once to RGBA and shared by every stage that names its set.
+//
+struct pipe_image_t
+{
+	std::string strFile;
+	int iWidth = 0;
+	int iHeight = 0;
+	std::vector< uint8_t > aPixels; // RGBA, rows tightly packed.
+};
+
+//
+// pipe_palette_t
+//
+// A palette from a palette stage (one level), or a fog table from a fog stage (every level,
+// one after another). With bTransparent, entry 0 of each level is the transparent index.
+//
+struct pipe_palette_t
+{
+	std::vector< uint32_t > aColours; // 0xRRGGBB
+	size_t uEntries = 0; // per level
+	bool bTransparent = false;
+
+	size_t Levels() const
+	{
+		return uEntries ? aColours.size() / uEntries : 0;
+	}
+};
+
+struct pipeline_t
+{
+	int iThreads = int( task_thread_cap() );
+
+	std::map< std::string, std::vector< pipe_image_t > > mapImages;
+	std::map< std::string, pipe_palette_t > mapPalettes;
+
+	verify_manifest_t* pVerify = nullptr; // -verify
+	std::string strVerifyLog; // the stage's -verify lines, printed after it.
+};
+
+struct options_t
+{
+	std::string strJobFile;
+	int iThreads = 0; // -threads, 0 for every core.
+	std::string strVerifyFile; // -verify=<file>
+};
+
+//=============================================================================
+
+//
+// print_hello
+//
+// Print hello text
+//
+static void print_hello()
+{
+	printf( "\n---------------------------------------------------------------\n"
+			" Palette Pipeline (c) David Walters. See LICENSE.txt for details\n"
+			"---------------------------------------------------------------\n\n" );
+}
+
+//
+// print_help
+//
+// Print help text
+//
+static void print_help()
+{
+	// Usage
+	printf( " USAGE: palpipe.exe [-?] [-threads=#] [-cpu=#] [-deflate=#] [-verify=<file>] <jobfile>\n\n" );
+
+	// Options
+	printf( "  -?                This help.\n" );
+	printf( "  -threads=#        Threads for each stage. [Default=CPU count, or FRAGMENTS_THREADS]\n" );
+	printf( "  -cpu=#            SIMD kernels: scalar, sse2, sse4.1, avx2, avx512, neon or native. [Default=native]\n" );
+	printf( "  -deflate=#        PNG compression: zlib, or libdeflate (in builds with FRAGMENTS_LIBDEFLATE),\n" );
+	printf( "                    which compresses each image whole. [Default=libdeflate if built in]\n" );
+	printf( "  -verify=<file>    Write a hash of each output's indices and palette (or colours) to <file>,\n" );
+	printf( "                    or compare them with it if it is there and fail if any differ.\n" );
+	putchar( '\n' );
+	printf( "  <jobfile>         One stage per line, run in order (# starts a comment):\n" );
+	putchar( '\n' );
+	printf( "    images <name> <image>[...]\n" );
+	printf( "                    Decode the images (wildcards supported, ** for every folder below)\n" );
+	printf( "                    once, as a set.\n" );
+	printf( "    palette <name> <images> [-count=#] [-method=#] [-space=#] [-kmeans=#]\n" );
+	printf( "                    [-transp|-opaque]\n" );
+	printf( "                    A palette of a set, as palgen makes it.\n" );
+	printf( "    fog <name> <palette> [-col=RRGGBB] [-ramp=<mode>,RRGGBB[,<curve>]...] -steps=#\n" );
+	printf( "                    [-final] [-remap|-remap-lab|-remap-oklab]\n" );
+	printf( "                    A fog table of a palette, as fogpal makes it.\n" );
+	printf( "    apply <palette>[:<level>] <images> -outdir <folder> [-suffix=<text>]\n" );
+	printf( "                    [-match=rgb|lab|oklab]\n" );
+	printf( "                    Write each image of a set as an indexed .png, in a palette or\n" );
+	printf( "                    one level of a fog table. [Default level=0]\n" );
+	printf( "    save <palette> <file>\n" );
+	printf( "                    Write a palette or fog table as .hex, or .pal32 (binary).\n" );
+	putchar( '\n' );
+
+	putchar( '\n' );
+}
+
+//
+// split_line
+//
+// Split a job file line at whitespace. Tokens may be quoted to keep spaces, and a '#'
+// outside quotes starts a comment.
+//
+static std::vector< std::string > split_line( const std::string& strLine )
+{
+	std::vector< std::string > aTokens;
+	std::string strToken;
+	bool bQuoted = false;
+	bool bHaveToken = false;
+
+	for ( const char c : strLine )
+	{
+		if ( c == '"' )
+		{
+			bQuoted = !bQuoted;
+			bHaveToken = true;
+		}
+		else if ( c == '#' && bQuoted == false )
+		{
+			break;
+		}
+		else if ( ( c == ' ' || c == '\t' || c == '\r' ) && bQuoted == false )
+		{
+			if ( bHaveToken )
+			{
+				aTokens.push_back( strToken );
+				strToken.clear();
+				bHaveToken = false;
+			}
+		}
+		else
+		{
+			strToken += c;
+			bHaveToken = true;
+		}
+	}
+
+	if ( bHaveToken )
+	{
+		aTokens.push_back( strToken );
+	}
+
+	return aTokens;
+}
+
+//=============================================================================
+
+//
+// stage_images
+//
+// images <name> <image>[...]: decode each file once, on every thread.
+//
+static bool stage_images( pipeline_t& pipeline, const std::vector< std::string >& aArgs )
+{
+	TRACE_ZONE( "stage_images" );
+
+	if ( aArgs.size() < 3 )
+	{
+		printf( "Error - images needs a name and at least one image.\n" );
+		return false;
+	}
+
+	std::vector< std::string > aFiles;
+	for ( size_t i = 2; i < aArgs.size(); ++i )
+	{
+		find_files( aArgs[ i ].c_str(), aFiles, pipeline.iThreads );
+	}
+	sort_files( aFiles );
+
+	if ( aFiles.empty() )
+	{
+		printf( "Error - no images found for \"%s\".\n", aArgs[ 1 ].c_str() );
+		return false;
+	}
+
+	std::vector< pipe_image_t > aImages( aFiles.size() );
+	size_t i = 0;
+	for ( const std::string& strFile : aFiles )
+	{
+		aImages[ i++ ].strFile = strFile;
+	}
+
+	std::atomic< size_t > uFailed( 0 );
+
+	stat_files( aImages.size() );
+
+	parallel_for( 0, aImages.size(), pipeline.iThreads, [&]( size_t index )
+	{
+		pipe_image_t& image = aImages[ index ];
+
+		std::error_code ec;
+		const uint64_t uBytes = stat_enabled() ? uint64_t( std::filesystem::file_size( image.strFile, ec ) ) : 0;
+
+		int channels = 0;
+		uint8_t* pPixels = stbi_load( image.strFile.c_str(), &image.iWidth, &image.iHeight, &channels, 4 );
+		if ( pPixels == nullptr )
+		{
+			stat_file_done( false, ec ? 0 : uBytes, 0, 0 );
+			++uFailed;
+			return;
+		}
+
+		image.aPixels.assign( pPixels, pPixels + size_t( image.iWidth ) * image.iHeight * 4 );
+		stbi_image_free( pPixels );
+		stat_file_done( true, ec ? 0 : uBytes, 0, uint64_t( image.iWidth ) * uint64_t( image.iHeight ) );
+	} );
+
+	if ( uFailed > 0 )
+	{
+		for ( const pipe_image_t& image : aImages )
+		{
+			if ( image.aPixels.empty() )
+			{
+				printf( "Error - failed to load \"%s\".\n", image.strFile.c_str() );
+			}
+		}
+		return false;
+	}
+
+	size_t uPixels = 0;
+	for ( const pipe_image_t& image : aImages )
+	{
+		uPixels += size_t( image.iWidth ) * image.iHeight;
+	}
+
+	printf( "%llu images, %.2f Mpixels", (unsigned long long)aImages.size(), uPixels / 1000000.0 );
+
+	pipeline.mapImages[ aArgs[ 1 ] ] = std::move( aImages );
+	return true;
+}
+
+//
+// find_images, find_palette
+//
+// A set or palette made by an earlier line.
+//
+static const std::vector< pipe_image_t >* find_images( const pipeline_t& pipeline, const std::string& strName )
+{
+	const auto it = pipeline.mapImages.find( strName );
+	if ( it == pipeline.mapImages.end() )
+	{
+		printf( "Error - no images named \"%s\" before this line.\n", strName.c_str() );
+		return nullptr;
+	}
+
+	return &it->second;
+}
+
+static const pipe_palette_t* find_palette( const pipeline_t& pipeline, const std::string& strName )
+{
+	const auto it = pipeline.mapPalettes.find( strName );
+	if ( it == pipeline.mapPalettes.end() )
+	{
+		printf( "Error - no palette named \"%s\" before this line.\n", strName.c_str() );
+		return nullptr;
+	}
+
+	return &it->second;
+}
+
+//
+// stage_palette
+//
+// palette <name> <images> [options]: palgen_generate on the decoded set.
+//
+static bool stage_palette( pipeline_t& pipeline, const std::vector< std::string >& aArgs )
+{
+	TRACE_ZONE( "stage_palette" );
+
+	if ( aArgs.size() < 3 )
+	{
+		printf( "Error - palette needs a name and a set of images.\n" );
+		return false;
+	}
+
+	const std::vector< pipe_image_t >* pImages = find_images( pipeline, aArgs[ 2 ] );
+	if ( pImages == nullptr )
+	{
+		return false;
+	}
+
+	palgen_settings_t settings;
+	settings.uThreadCount = uint32_t( pipeline.iThreads );
+
+	for ( size_t i = 3; i < aArgs.size(); ++i )
+	{
+		const char* szArg = aArgs[ i ].c_str();
+
+		if ( strncmp( szArg, "-count=", 7 ) == 0 )
+		{
+			settings.uPaletteSizeReal = uint32_t( atoi( szArg + 7 ) );
+			if ( settings.uPaletteSizeReal <= 2 || settings.uPaletteSizeReal > 256 )
+			{
+				printf( "Error - invalid palette size (%s), it must be 3 to 256.\n", szArg + 7 );
+				return false;
+			}
+		}
+		else if ( _stricmp( szArg, "-method=median" ) == 0 )
+		{
+			settings.method = METHOD_MEDIAN_CUT;
+		}
+		else if ( _stricmp( szArg, "-method=octree" ) == 0 )
+		{
+			settings.method = METHOD_OCTREE;
+		}
+		else if ( _stricmp( szArg, "-method=wu" ) == 0 )
+		{
+			settings.method = METHOD_WU;
+		}
+		else if ( _stricmp( szArg, "-space=rgb" ) == 0 )
+		{
+			settings.colorSpace = COLOR_SPACE_RGB;
+		}
+		else if ( _stricmp( szArg, "-space=oklab" ) == 0 )
+		{
+			settings.colorSpace = COLOR_SPACE_OKLAB;
+		}
+		else if ( strncmp( szArg, "-kmeans=", 8 ) == 0 )
+		{
+			settings.uKMeansIterations = uint32_t( atoi( szArg + 8 ) );
+		}
+		else if ( _stricmp( szArg, "-transp" ) == 0 )
+		{
+			settings.bForceTransp = true;
+		}
+		else if ( _stricmp( szArg, "-opaque" ) == 0 )
+		{
+			settings.bForceOpaque = true;
+		}
+		else
+		{
+			printf( "Error - unknown palette option \"%s\".\n", szArg );
+			return false;
+		}
+	}
+
+	// palgen takes the pixels where they are.
+	std::vector< palgen_image_t > aInputs( pImages->size() );
+	bool bMasked = false;
+	for ( size_t i = 0; i < pImages->size(); ++i )
+	{
+		const pipe_image_t& image = ( *pImages )[ i ];
+		aInputs[ i ].pPixels = image.aPixels.data();
+		aInputs[ i ].iWidth = image.iWidth;
+		aInputs[ i ].iHeight = image.iHeight;
+		aInputs[ i ].iChannels = 4;
+
+		for ( size_t p = 3; p < image.aPixels.size() && bMasked == false; p += 4 )
+		{
+			bMasked = image.aPixels[ p ] != 0xFF;
+		}
+	}
+
+	std::vector< color_t > aPalette;
+	if ( palgen_generate( settings, aInputs.data(), aInputs.size(), aPalette ) == false )
+	{
+		printf( "Error - no palette was made.\n" );
+		return false;
+	}
+
+	pipe_palette_t palette;
+	palette.uEntries = aPalette.size();
+	palette.bTransparent = settings.bForceTransp || ( bMasked && settings.bForceOpaque == false );
+	for ( const color_t& colour : aPalette )
+	{
+		palette.aColours.push_back( ( uint32_t( colour.chan[ 0 ] ) << 16 ) | ( uint32_t( colour.chan[ 1 ] ) << 8 ) | colour.chan[ 2 ] );
+	}
+
+	printf( "%llu colours%s", (unsigned long long)palette.uEntries, palette.bTransparent ? ", index 0 transparent" : "" );
+
+	pipeline.mapPalettes[ aArgs[ 1 ] ] = std::move( palette );
+	return true;
+}
+
+//
+// parse_ramp
+//
+// -ramp=<mode>,RRGGBB[,<curve>], as fogpal takes it (a curve of linear or exp).
+//
+static bool parse_ramp( const char* szArg, ramp_t& ramp )
+{
+	char szMode[ 8 ] = {};
+	char szCurve[ 8 ] = {};
+	unsigned colour = 0;
+
+	const int fields = sscanf( szArg, "%7[a-z],%6x,%7s", szMode, &colour, szCurve );
+	if ( fields < 2 )
+	{
+		return false;
+	}
+
+	if ( _stricmp( szMode, "fog" ) == 0 )
+	{
+		ramp.mode = RAMP_FOG;
+	}
+	else if ( _stricmp( szMode, "light" ) == 0 )
+	{
+		ramp.mode = RAMP_LIGHT;
+	}
+	else
+	{
+		return false;
+	}
+
+	ramp.colour = colour;
+
+	if ( fields == 2 || _stricmp( szCurve, "linear" ) == 0 )
+	{
+		ramp.curve = CURVE_LINEAR;
+	}
+	else if ( _stricmp( szCurve, "exp" ) == 0 )
+	{
+		ramp.curve = CURVE_EXP;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+//
+// stage_fog
+//
+// fog <name> <palette> [options]: fog_generate on the palette. A transparent index 0 is
+// left out of the fogging and the remap, so no fogged colour can become transparent.
+//
+static bool stage_fog( pipeline_t& pipeline, const std::vector< std::string >& aArgs )
+{
+	TRACE_ZONE( "stage_fog" );
+
+	if ( aArgs.size() < 3 )
+	{
+		printf( "Error - fog needs a name and a palette.\n" );
+		return false;
+	}
+
+	const pipe_palette_t* pSource = find_palette( pipeline, aArgs[ 2 ] );
+	if ( pSource == nullptr )
+	{
+		return false;
+	}
+
+	if ( pSource->Levels() != 1 )
+	{
+		printf( "Error - \"%s\" is already a fog table.\n", aArgs[ 2 ].c_str() );
+		return false;
+	}
+
+	fog_settings_t settings;
+	ramp_t fog;
+	bool bFogColour = false;
+
+	for ( size_t i = 3; i < aArgs.size(); ++i )
+	{
+		const char* szArg = aArgs[ i ].c_str();
+
+		if ( strncmp( szArg, "-steps=", 7 ) == 0 )
+		{
+			settings.iSteps = atoi( szArg + 7 );
+			if ( settings.iSteps <= 1 )
+			{
+				printf( "Error - invalid number of steps (%d).\n", settings.iSteps );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-col=", 5 ) == 0 )
+		{
+			char* pEnd = nullptr;
+			fog.colour = strtoul( szArg + 5, &pEnd, 16 ) & 0xFFFFFF;
+			bFogColour = true;
+		}
+		else if ( strncmp( szArg, "-ramp=", 6 ) == 0 )
+		{
+			ramp_t ramp;
+			if ( parse_ramp( szArg + 6, ramp ) == false )
+			{
+				printf( "Error - invalid ramp \"%s\".\n", szArg + 6 );
+				return false;
+			}
+			settings.aRamps.push_back( ramp );
+		}
+		else if ( _stricmp( szArg, "-final" ) == 0 )
+		{
+			settings.bLastStepEqualsFog = true;
+		}
+		else if ( _stricmp( szArg, "-remap" ) == 0 )
+		{
+			settings.bRemap = true;
+			settings.remapMetric = REMAP_RGB;
+		}
+		else if ( _stricmp( szArg, "-remap-lab" ) == 0 )
+		{
+			settings.bRemap = true;
+			settings.remapMetric = REMAP_LAB;
+		}
+		else if ( _stricmp( szArg, "-remap-oklab" ) == 0 )
+		{
+			settings.bRemap = true;
+			settings.remapMetric = REMAP_OKLAB;
+		}
+		else
+		{
+			printf( "Error - unknown fog option \"%s\".\n", szArg );
+			return false;
+		}
+	}
+
+	// the -col fog comes first, and is the only ramp without any -ramp.
+	if ( bFogColour || settings.aRamps.empty() )
+	{
+		settings.aRamps.insert( settings.aRamps.begin(), fog );
+	}
+
+	const size_t uStart = pSource->bTransparent ? 1 : 0;
+	const size_t uCount = pSource->uEntries - uStart;
+	if ( uCount == 0 )
+	{
+		printf( "Error - \"%s\" has no colours to fog.\n", aArgs[ 2 ].c_str() );
+		return false;
+	}
+
+	fog_palette_t source;
+	source.Create( pSource->aColours.data() + uStart, uCount );
+	if ( settings.bRemap )
+	{
+		source.AddRemap( settings.remapMetric );
+	}
+
+	const size_t levels = fog_levels( settings );
+	std::vector< uint32_t > aFogged( uCount * levels );
+	fog_generate( source, settings, aFogged.data(), nullptr, pipeline.iThreads );
+
+	// each level with the transparent index back in front.
+	pipe_palette_t table;
+	table.uEntries = pSource->uEntries;
+	table.bTransparent = pSource->bTransparent;
+	table.aColours.reserve( table.uEntries * levels );
+	for ( size_t level = 0; level < levels; ++level )
+	{
+		if ( uStart )
+		{
+			table.aColours.push_back( pSource->aColours[ 0 ] );
+		}
+		table.aColours.insert( table.aColours.end(), aFogged.begin() + level * uCount, aFogged.begin() + ( level + 1 ) * uCount );
+	}
+
+	printf( "%llu levels of %llu colours", (unsigned long long)levels, (unsigned long long)table.uEntries );
+
+	pipeline.mapPalettes[ aArgs[ 1 ] ] = std::move( table );
+	return true;
+}
+
+static void png_error_fn( png_structp png_ptr, png_const_charp error_message )
+{
+	printf( "png error: %s\n", error_message );
+	png_longjmp( png_ptr, -1 );
+}
+
+static void png_warn_fn( png_structp png_ptr, png_const_charp error_message )
+{
+	printf( "png warning: %s\n", error_message );
+}
+
+//
+// write_indexed_png
+//
+// An 8-bit palette PNG of the indices, index 0 transparent with bTransparent.
+//
+static bool write_indexed_png( const std::string& strFileName, const std::vector< uint8_t >& aIndices, int width, int height, const uint32_t* pColours, size_t count, bool bTransparent )
+{
+	TRACE_ZONE( "write_indexed_png" );
+
+	FILE* fp = fopen( strFileName.c_str(), "wb" );
+	if ( fp == nullptr )
+	{
+		return false;
+	}
+
+	png_structp png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, nullptr, png_error_fn, png_warn_fn );
+	png_infop info_ptr = png_ptr ? png_create_info_struct( png_ptr ) : nullptr;
+	std::vector< uint8_t > aFiltered;
+	std::vector< uint8_t > aStream;
+	bool bOK = false;
+
+	if ( info_ptr != nullptr )
+	{
+		jmp_buf* p_jmp_buf = png_set_longjmp_fn( png_ptr, longjmp, sizeof( jmp_buf ) );
+
+		if ( setjmp( *p_jmp_buf ) != -1 )
+		{
+			png_init_io( png_ptr, fp );
+
+			// up to what PNG itself allows, past libpng's default of a million pixels a side.
+			png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+			png_set_IHDR( png_ptr, info_ptr, width, height,
+						  8 /*CHANNEL DEPTH*/, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+						  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+
+			png_color aPalette[ 256 ];
+			for ( size_t i = 0; i < count; ++i )
+			{
+				aPalette[ i ].red = png_byte( pColours[ i ] >> 16 );
+				aPalette[ i ].green = png_byte( pColours[ i ] >> 8 );
+				aPalette[ i ].blue = png_byte( pColours[ i ] );
+			}
+			png_set_PLTE( png_ptr, info_ptr, aPalette, int( count ) );
+
+			// Transparent index?
+			if ( bTransparent )
+			{
+				png_byte palette_trans_alpha[ 1 ] = { 0 }; // Invisible
+				png_set_tRNS( png_ptr, info_ptr, palette_trans_alpha, 1, nullptr );
+			}
+
+			png_write_info( png_ptr, info_ptr );
+
+			if ( deflate_backend() == DEFLATE_LIBDEFLATE )
+			{
+				// compressed at once, unfiltered as libpng leaves palette images.
+				aFiltered.reserve( ( size_t( width ) + 1 ) * height );
+				for ( int y = 0; y < height; ++y )
+				{
+					const uint8_t* pRow = aIndices.data() + size_t( width ) * y;
+					aFiltered.push_back( PNG_FILTER_VALUE_NONE );
+					aFiltered.insert( aFiltered.end(), pRow, pRow + width );
+				}
+
+				bOK = png_write_compressed( png_ptr, aFiltered.data(), aFiltered.size(), Z_DEFAULT_COMPRESSION, aStream );
+			}
+			else
+			{
+				for ( int y = 0; y < height; ++y )
+				{
+					png_bytep row = const_cast< png_bytep >( aIndices.data() + size_t( width ) * y );
+					png_write_rows( png_ptr, &row, 1 );
+				}
+
+				png_write_end( png_ptr, nullptr );
+				bOK = true;
+			}
+		}
+	}
+
+	png_destroy_write_struct( &png_ptr, ( info_ptr != nullptr ) ? &info_ptr : nullptr );
+	fclose( fp );
+
+	return bOK;
+}
+
+//
+// stage_apply
+//
+// apply <palette>[:<level>] <images> -outdir <folder> [options]: map every pixel of each
+// image to the level's nearest entry, as applypal does without dithering, and write it.
+// With a transparent index 0, pixels that are not opaque take it and no others do (a dark
+// fog level would otherwise send colours near magenta to it). The images share out the
+// threads.
+//
+static bool stage_apply( pipeline_t& pipeline, const std::vector< std::string >& aArgs )
+{
+	TRACE_ZONE( "stage_apply" );
+
+	if ( aArgs.size() < 3 )
+	{
+		printf( "Error - apply needs a palette and a set of images.\n" );
+		return false;
+	}
+
+	std::string strPalette = aArgs[ 1 ];
+	size_t level = 0;
+
+	const size_t colon = strPalette.find_last_of( ':' );
+	if ( colon != std::string::npos )
+	{
+		level = size_t( atoi( strPalette.c_str() + colon + 1 ) );
+		strPalette.resize( colon );
+	}
+
+	const pipe_palette_t* pPalette = find_palette( pipeline, strPalette );
+	const std::vector< pipe_image_t >* pImages = find_images( pipeline, aArgs[ 2 ] );
+	if ( pPalette == nullptr || pImages == nullptr )
+	{
+		return false;
+	}
+
+	if ( level >= pPalette->Levels() )
+	{
+		printf( "Error - \"%s\" has %llu levels.\n", strPalette.c_str(), (unsigned long long)pPalette->Levels() );
+		return false;
+	}
+
+	if ( pPalette->uEntries > 256 )
+	{
+		printf( "Error - a .png palette holds 256 colours at most.\n" );
+		return false;
+	}
+
+	std::string strOutDir;
+	std::string strSuffix;
+	remap_metric_t metric = REMAP_RGB;
+
+	bool bNextArgIsOutDir = false;
+	for ( size_t i = 3; i < aArgs.size(); ++i )
+	{
+		const char* szArg = aArgs[ i ].c_str();
+
+		if ( bNextArgIsOutDir )
+		{
+			bNextArgIsOutDir = false;
+			strOutDir = szArg;
+		}
+		else if ( _stricmp( szArg, "-outdir" ) == 0 )
+		{
+			bNextArgIsOutDir = true;
+		}
+		else if ( strncmp( szArg, "-suffix=", 8 ) == 0 )
+		{
+			strSuffix = szArg + 8;
+		}
+		else if ( _stricmp( szArg, "-match=rgb" ) == 0 )
+		{
+			metric = REMAP_RGB;
+		}
+		else if ( _stricmp( szArg, "-match=lab" ) == 0 )
+		{
+			metric = REMAP_LAB;
+		}
+		else if ( _stricmp( szArg, "-match=oklab" ) == 0 )
+		{
+			metric = REMAP_OKLAB;
+		}
+		else
+		{
+			printf( "Error - unknown apply option \"%s\".\n", szArg );
+			return false;
+		}
+	}
+
+	if ( strOutDir.empty() )
+	{
+		printf( "Error - apply needs an -outdir.\n" );
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories( strOutDir, error );
+
+	// the level's colours, searched without the transparent index.
+	const uint32_t* pColours = pPalette->aColours.data() + level * pPalette->uEntries;
+	const size_t uStart = pPalette->bTransparent ? 1 : 0;
+
+	nearest_search_t search;
+	search.Create( pColours + uStart, pPalette->uEntries - uStart, metric );
+
+	std::atomic< size_t > uFailed( 0 );
+	std::vector< std::string > aVerify( pipeline.pVerify ? pImages->size() : 0 ); // in image order.
+
+	parallel_for_state< nearest_memo_t >( 0, pImages->size(), pipeline.iThreads, [&]( size_t index, nearest_memo_t& memo )
+	{
+		const pipe_image_t& image = ( *pImages )[ index ];
+		const size_t pixels = size_t( image.iWidth ) * image.iHeight;
+
+		std::vector< uint8_t > aIndices( pixels );
+
+		const uint8_t* p = image.aPixels.data();
+		for ( size_t i = 0; i < pixels; ++i, p += 4 )
+		{
+			if ( uStart && p[ 3 ] != 0xFF )
+			{
+				aIndices[ i ] = 0;
+				continue;
+			}
+
+			const uint32_t colour = ( uint32_t( p[ 0 ] ) << 16 ) | ( uint32_t( p[ 1 ] ) << 8 ) | p[ 2 ];
+			aIndices[ i ] = uint8_t( uStart + memo.Find( search, colour ) );
+		}
+
+		std::filesystem::path output = std::filesystem::path( strOutDir ) / std::filesystem::path( image.strFile ).stem();
+		output += strSuffix + ".png";
+
+		if ( write_indexed_png( output.string(), aIndices, image.iWidth, image.iHeight, pColours, pPalette->uEntries, pPalette->bTransparent ) == false )
+		{
+			printf( "Error - failed to write \"%s\".\n", output.string().c_str() );
+			++uFailed;
+		}
+		else if ( pipeline.pVerify )
+		{
+			verify_hash_t hash;
+			hash.Add( uint32_t( image.iWidth ) );
+			hash.Add( uint32_t( image.iHeight ) );
+			hash.Add( uint32_t( pPalette->uEntries ) );
+			hash.AddData( pColours, pPalette->uEntries * sizeof( uint32_t ) );
+			hash.AddData( aIndices.data(), aIndices.size() );
+			aVerify[ index ] = pipeline.pVerify->Record( output.string(), "indexed", hash );
+		}
+	} );
+
+	for ( const std::string& strVerify : aVerify )
+	{
+		pipeline.strVerifyLog += strVerify;
+	}
+
+	if ( uFailed > 0 )
+	{
+		return false;
+	}
+
+	printf( "%llu images with %llu colours", (unsigned long long)pImages->size(), (unsigned long long)pPalette->uEntries );
+	return true;
+}
+
+//
+// stage_save
+//
+// save <palette> <file>: every level, as .hex text or .pal32 little endian 0x00RRGGBB.
+//
+static bool stage_save( pipeline_t& pipeline, const std::vector< std::string >& aArgs )
+{
+	TRACE_ZONE( "stage_save" );
+
+	if ( aArgs.size() != 3 )
+	{
+		printf( "Error - save needs a palette and a file.\n" );
+		return false;
+	}
+
+	const pipe_palette_t* pPalette = find_palette( pipeline, aArgs[ 1 ] );
+	if ( pPalette == nullptr )
+	{
+		return false;
+	}
+
+	const std::string& strFileName = aArgs[ 2 ];
+	const bool bBinary = strFileName.length() >= 6 && _stricmp( strFileName.c_str() + strFileName.length() - 6, ".pal32" ) == 0;
+
+	std::string data;
+	if ( bBinary )
+	{
+		data.assign( reinterpret_cast< const char* >( pPalette->aColours.data() ), pPalette->aColours.size() * sizeof( uint32_t ) );
+	}
+	else
+	{
+		for ( const uint32_t colour : pPalette->aColours )
+		{
+			char szLine[ 8 ];
+			snprintf( szLine, sizeof( szLine ), "%06x\n", colour );
+			data += szLine;
+		}
+	}
+
+	std::ofstream file( strFileName, bBinary ? std::ios::binary : std::ios::out );
+	if ( file.is_open() )
+	{
+		file.write( data.data(), data.size() );
+		file.close();
+	}
+
+	if ( file.fail() )
+	{
+		printf( "Error - failed to write \"%s\".\n", strFileName.c_str() );
+		return false;
+	}
+
+	if ( pipeline.pVerify )
+	{
+		verify_hash_t hash;
+		hash.Add( uint32_t( pPalette->uEntries ) );
+		hash.AddData( pPalette->aColours.data(), pPalette->aColours.size() * sizeof( uint32_t ) );
+		pipeline.strVerifyLog += pipeline.pVerify->Record( strFileName, "palette", hash );
+	}
+
+	printf( "%llu colours to \"%s\"", (unsigned long long)pPalette->aColours.size(), strFileName.c_str() );
+	return true;
+}
+
+//=============================================================================
+
+//
+// process_args
+//
+// Process command line arguments
+//
+static bool process_args( int argc, char** argv, options_t& options )
+{
+	for ( int iarg = 1; iarg < argc; ++iarg ) // skip element[0]
+	{
+		const char* szArg = argv[ iarg ];
+
+		if ( _stricmp( szArg, "-?" ) == 0 )
+		{
+			return false;
+		}
+		else if ( strncmp( szArg, "-threads=", 9 ) == 0 )
+		{
+			options.iThreads = atoi( szArg + 9 );
+
+			if ( options.iThreads <= 0 )
+			{
+				printf( "Error - invalid number of threads (%d).\n", options.iThreads );
+				return false;
+			}
+
+			options.iThreads = std::min( options.iThreads, int( task_thread_cap() ) );
+		}
+		else if ( strncmp( szArg, "-cpu=", 5 ) == 0 )
+		{
+			if ( cpu_select( szArg + 5 ) == false )
+			{
+				printf( "Error - unknown or unsupported SIMD level \"%s\" (this CPU has %s).\n", szArg + 5, cpu_level_name( cpu_detect() ) );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-deflate=", 9 ) == 0 )
+		{
+			if ( deflate_select( szArg + 9 ) == false )
+			{
+				printf( "Error - unknown deflate \"%s\" (zlib, or libdeflate in builds with FRAGMENTS_LIBDEFLATE).\n", szArg + 9 );
+				return false;
+			}
+		}
+		else if ( strncmp( szArg, "-verify=", 8 ) == 0 && szArg[ 8 ] != '\0' )
+		{
+			options.strVerifyFile = szArg + 8;
+		}
+		else if ( options.strJobFile.empty() && ( szArg[ 0 ] != '-' ) )
+		{
+			options.strJobFile = szArg;
+		}
+		else
+		{
+			printf( "Error - unknown option \"%s\"\n", szArg );
+			return false;
+		}
+	}
+
+	if ( options.strJobFile.empty() )
+	{
+		printf( "Error - no job file specified.\n" );
+		return false;
+	}
+
+	return true;
+}
+
+//
+// do_work
+//
+// Run each line of the job file in turn, stopping at the first that fails (the lines after
+// it may need what it would have made). False if a line failed, or -verify found an output
+// that differs.
+//
+static bool do_work( const options_t& options )
+{
+	print_hello();
+
+	std::ifstream fileJobs( options.strJobFile );
+	if ( fileJobs.is_open() == false )
+	{
+		printf( "Error - failed to open job file \"%s\".\n", options.strJobFile.c_str() );
+		return false;
+	}
+
+	pipeline_t pipeline;
+	if ( options.iThreads > 0 )
+	{
+		pipeline.iThreads = options.iThreads;
+	}
+
+	verify_manifest_t verify;
+	if ( options.strVerifyFile.empty() == false )
+	{
+		if ( verify.Open( options.strVerifyFile ) == false )
+		{
+			printf( "Error - could not read the verify manifest \"%s\".\n", options.strVerifyFile.c_str() );
+			return false;
+		}
+		pipeline.pVerify = &verify;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t uLine = 0;
+	size_t uStages = 0;
+	std::string strLine;
+	while ( std::getline( fileJobs, strLine ) )
+	{
+		++uLine;
+
+		const std::vector< std::string > aTokens = split_line( strLine );
+		if ( aTokens.empty() )
+		{
+			continue;
+		}
+
+		const std::string& strStage = aTokens[ 0 ];
+
+		printf( "Line %llu: %s ... ", (unsigned long long)uLine, strStage.c_str() );
+
+		const std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
+
+		bool bOK;
+		if ( strStage == "images" )
+		{
+			bOK = stage_images( pipeline, aTokens );
+		}
+		else if ( strStage == "palette" )
+		{
+			bOK = stage_palette( pipeline, aTokens );
+		}
+		else if ( strStage == "fog" )
+		{
+			bOK = stage_fog( pipeline, aTokens );
+		}
+		else if ( strStage == "apply" )
+		{
+			bOK = stage_apply( pipeline, aTokens );
+		}
+		else if ( strStage == "save" )
+		{
+			bOK = stage_save( pipeline, aTokens );
+		}
+		else
+		{
+			printf( "Error - unknown stage \"%s\".\n", strStage.c_str() );
+			bOK = false;
+		}
+
+		if ( bOK == false )
+		{
+			printf( "Line %llu: FAILED\n", (unsigned long long)uLine );
+			return false;
+		}
+
+		const double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - stage_start ).count();
+		printf( " (%.1f ms) OK\n", ms );
+		++uStages;
+
+		fputs( pipeline.strVerifyLog.c_str(), stdout );
+		pipeline.strVerifyLog.clear();
+	}
+
+	const double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+	printf( "\n%llu stages in %.1f ms.\n", (unsigned long long)uStages, ms );
+
+	if ( pipeline.pVerify == nullptr )
+	{
+		return true;
+	}
+
+	std::string strLog;
+	const bool bOK = verify.Close( strLog );
+	fputs( strLog.c_str(), stdout );
+	return bOK;
+}
+
+//
+// main
+//
+// Program entry point.
+//
+int main( int argc, char** argv )
+{
+	// Options
+	options_t options;
+
+	if ( process_args( argc, argv, options ) )
+	{
+		if ( do_work( options ) == false )
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		// Failure. Offer the user some help.
+		print_hello();
+		print_help();
+	}
+
+	return 0;
+}
+
+//=============================================================================
@@ -0,0 +1,1061 @@
+
+/*
+
+MIT License
+
+Copyright (c) 2026 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//=============================================================================
+//
+// palpy.cpp
+//
+// Python bindings for palette generation (palgen), palette application, resizing
+// (imgsize), fog tables (fogpal) and numeric expressions (numexpr), as the module palpy.
+// Images and palettes are read in place through the buffer protocol, so numpy arrays are
+// not copied, and the results are handed back the same way: as numpy arrays when numpy
+// can be imported, memoryviews otherwise, over memory the module owns. Every call lets go
+// of the GIL while it works, so Python threads run side by side.
+//
+//  images   ( height, width, 3 or 4 ) uint8, RGB or RGBA. Rows may be apart (a slice of a
+//           wider image), but each row's pixels are packed; palgen needs packed rows.
+//  palettes ( count ) uint32, 0xRRGGBB, as palpipe passes them between stages.
+//
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+// Python.h comes first. A debug build still links the release Python library.
+#if defined( _DEBUG )
+#undef _DEBUG
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define _DEBUG
+#else
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#endif
+
+#include "palgen.h" // palgen.cpp, built with PALGEN_LIBRARY
+#include "imgsize.h" // imgsize.cpp, built with IMGSIZE_LIBRARY
+#include "fogcore.h"
+#include "numexpr.h"
+#include "paltask.h"
+
+//=============================================================================
+
+//
+// array_object_t
+//
+// A result: a block of memory with the shape and type of its contents, exported through
+// the buffer protocol. Allocated with the GIL held and filled without it.
+//
+struct array_object_t
+{
+	PyObject_HEAD
+	uint8_t* pData;
+	Py_ssize_t uBytes;
+	Py_ssize_t itemsize;
+	const char* szFormat;
+	int ndim;
+	Py_ssize_t aShape[ 3 ];
+	Py_ssize_t aStrides[ 3 ];
+};
+
+static PyTypeObject s_array_type = { PyVarObject_HEAD_INIT( nullptr, 0 ) };
+
+static PyObject* s_pAsArray = nullptr; // numpy.asarray, or nullptr without numpy.
+
+static void array_dealloc( PyObject* pSelf )
+{
+	PyMem_RawFree( reinterpret_cast< array_object_t* >( pSelf )->pData );
+	Py_TYPE( pSelf )->tp_free( pSelf );
+}
+
+static int array_getbuffer( PyObject* pSelf, Py_buffer* pView, int flags )
+{
+	array_object_t* pArray = reinterpret_cast< array_object_t* >( pSelf );
+
+	pView->buf = pArray->pData;
+	pView->obj = pSelf;
+	pView->len = pArray->uBytes;
+	pView->readonly = 0;
+	pView->itemsize = pArray->itemsize;
+	pView->format = ( flags & PyBUF_FORMAT ) ? const_cast< char* >( pArray->szFormat ) : nullptr;
+	pView->ndim = pArray->ndim;
+	pView->shape = ( flags & PyBUF_ND ) ? pArray->aShape : nullptr;
+	pView->strides = ( ( flags & PyBUF_STRIDES ) == PyBUF_STRIDES ) ? pArray->aStrides : nullptr;
+	pView->suboffsets = nullptr;
+	pView->internal = nullptr;
+
+	Py_INCREF( pSelf );
+	return 0;
+}
+
+static PyBufferProcs s_array_buffer = { array_getbuffer, nullptr };
+
+//
+// new_array
+//
+// An uninitialised C ordered array of the shape given (up to 3 dimensions), of items
+// of format szFormat and itemsize bytes. nullptr, with MemoryError raised, if it fails.
+//
+static array_object_t* new_array( const char* szFormat, Py_ssize_t itemsize, std::initializer_list< Py_ssize_t > aShape )
+{
+	array_object_t* pArray = PyObject_New( array_object_t, &s_array_type );
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	pArray->itemsize = itemsize;
+	pArray->szFormat = szFormat;
+	pArray->ndim = int( aShape.size() );
+
+	Py_ssize_t uBytes = itemsize;
+	int axis = 0;
+	for ( const Py_ssize_t size : aShape )
+	{
+		pArray->aShape[ axis++ ] = size;
+		uBytes *= size;
+	}
+
+	for ( Py_ssize_t stride = itemsize; axis-- > 0; )
+	{
+		pArray->aStrides[ axis ] = stride;
+		stride *= pArray->aShape[ axis ];
+	}
+
+	pArray->uBytes = uBytes;
+	pArray->pData = static_cast< uint8_t* >( PyMem_RawMalloc( size_t( std::max< Py_ssize_t >( uBytes, 1 ) ) ) );
+	if ( pArray->pData == nullptr )
+	{
+		Py_DECREF( pArray );
+		PyErr_NoMemory();
+		return nullptr;
+	}
+
+	return pArray;
+}
+
+//
+// wrap_array
+//
+// What a function returns for an array: numpy.asarray of it, which shares its memory, or
+// a memoryview of it without numpy. Takes the reference to pArray.
+//
+static PyObject* wrap_array( array_object_t* pArray )
+{
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	PyObject* pResult = s_pAsArray ? PyObject_CallOneArg( s_pAsArray, reinterpret_cast< PyObject* >( pArray ) )
+								   : PyMemoryView_FromObject( reinterpret_cast< PyObject* >( pArray ) );
+	Py_DECREF( pArray );
+	return pResult;
+}
+
+//=============================================================================
+
+//
+// view_t
+//
+// A buffer held from an argument for the length of a call, and let go (with the GIL held)
+// when the call returns.
+//
+struct view_t
+{
+	Py_buffer buffer = {};
+	bool bHeld = false;
+
+	view_t() = default;
+	view_t( const view_t& ) = delete;
+	view_t& operator=( const view_t& ) = delete;
+
+	~view_t()
+	{
+		if ( bHeld )
+		{
+			PyBuffer_Release( &buffer );
+		}
+	}
+
+	bool Get( PyObject* pObject )
+	{
+		bHeld = ( PyObject_GetBuffer( pObject, &buffer, PyBUF_RECORDS_RO ) == 0 );
+		return bHeld;
+	}
+
+	// the struct format character of the items, past any byte order mark.
+	char Format() const
+	{
+		const char* szFormat = buffer.format ? buffer.format : "B";
+		while ( *szFormat == '@' || *szFormat == '=' || *szFormat == '<' || *szFormat == '>' || *szFormat == '!' || *szFormat == '|' )
+		{
+			++szFormat;
+		}
+		return *szFormat;
+	}
+};
+
+//
+// image_arg_t
+//
+// An image argument: ( height, width, 3 or 4 ) uint8, each row's pixels packed.
+//
+struct image_arg_t
+{
+	view_t view;
+	const uint8_t* pPixels = nullptr;
+	size_t uWidth = 0;
+	size_t uHeight = 0;
+	size_t uStride = 0; // bytes
+	int iChannels = 0;
+
+	bool Get( PyObject* pObject, const char* szName )
+	{
+		if ( view.Get( pObject ) == false )
+		{
+			return false;
+		}
+
+		const Py_buffer& buffer = view.buffer;
+		const bool bBytes = ( buffer.itemsize == 1 && ( view.Format() == 'B' || view.Format() == 'b' || view.Format() == 'c' ) );
+
+		if ( bBytes == false || buffer.ndim != 3 || ( buffer.shape[ 2 ] != 3 && buffer.shape[ 2 ] != 4 ) || buffer.shape[ 0 ] <= 0 || buffer.shape[ 1 ] <= 0 ||
+			 buffer.strides[ 2 ] != 1 || buffer.strides[ 1 ] != buffer.shape[ 2 ] || buffer.strides[ 0 ] < buffer.shape[ 1 ] * buffer.shape[ 2 ] )
+		{
+			PyErr_Format( PyExc_ValueError, "%s must be a (height, width, 3 or 4) array of uint8, with each row's pixels packed", szName );
+			return false;
+		}
+
+		pPixels = static_cast< const uint8_t* >( buffer.buf );
+		uHeight = size_t( buffer.shape[ 0 ] );
+		uWidth = size_t( buffer.shape[ 1 ] );
+		iChannels = int( buffer.shape[ 2 ] );
+		uStride = size_t( buffer.strides[ 0 ] );
+		return true;
+	}
+};
+
+//
+// palette_arg_t
+//
+// A palette argument: ( count ) uint32 of 0xRRGGBB, packed.
+//
+struct palette_arg_t
+{
+	view_t view;
+	const uint32_t* pColours = nullptr;
+	size_t uCount = 0;
+
+	bool Get( PyObject* pObject, const char* szName )
+	{
+		if ( view.Get( pObject ) == false )
+		{
+			return false;
+		}
+
+		const Py_buffer& buffer = view.buffer;
+		const char format = view.Format();
+		const bool bWords = ( buffer.itemsize == 4 && ( format == 'I' || format == 'L' || format == 'i' || format == 'l' ) );
+
+		if ( bWords == false || buffer.ndim != 1 || buffer.shape[ 0 ] <= 0 || buffer.strides[ 0 ] != 4 )
+		{
+			PyErr_Format( PyExc_ValueError, "%s must be a (count) array of uint32 0xRRGGBB", szName );
+			return false;
+		}
+
+		pColours = static_cast< const uint32_t* >( buffer.buf );
+		uCount = size_t( buffer.shape[ 0 ] );
+		return true;
+	}
+};
+
+// threads= of every function: 0 for the thread cap.
+static int call_threads( int threads )
+{
+	return ( threads > 0 ) ? std::min( threads, int( task_thread_cap() ) ) : int( task_thread_cap() );
+}
+
+//
+// pick
+//
+// The index of szName in a list of names, or -1 with ValueError raised.
+//
+static int pick( const char* szName, std::initializer_list< const char* > aNames, const char* szArg )
+{
+	int index = 0;
+	for ( const char* szOption : aNames )
+	{
+		if ( strcmp( szName, szOption ) == 0 )
+		{
+			return index;
+		}
+		++index;
+	}
+
+	PyErr_Format( PyExc_ValueError, "unknown %s \"%s\"", szArg, szName );
+	return -1;
+}
+
+//
+// run_released
+//
+// fn() with the GIL let go. A C++ exception from it is raised as RuntimeError (or
+// MemoryError) once the GIL is back; returns false if there was one.
+//
+template < typename FN >
+static bool run_released( FN&& fn )
+{
+	std::string strError;
+	bool bMemory = false;
+
+	Py_BEGIN_ALLOW_THREADS
+
+	try
+	{
+		fn();
+	}
+	catch ( const std::bad_alloc& )
+	{
+		bMemory = true;
+	}
+	catch ( const std::exception& e )
+	{
+		strError = e.what();
+		strError += " ";
+	}
+
+	Py_END_ALLOW_THREADS
+
+	if ( bMemory )
+	{
+		PyErr_NoMemory();
+		return false;
+	}
+
+	if ( strError.empty() == false )
+	{
+		strError.pop_back();
+		PyErr_SetString( PyExc_RuntimeError, strError.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+//=============================================================================
+
+//
+// palpy.palgen
+//
+static PyObject* py_palgen( PyObject*, PyObject* pArgs, PyObject* pKeywords )
+{
+	static const char* kKeywords[] = { "images", "colours", "method", "space", "order", "histogram", "kmeans", "sample", "edges", "alpha", "transparent", "opaque", "threads", nullptr };
+
+	PyObject* pImages = nullptr;
+	unsigned int uColours = 256;
+	const char* szMethod = "median";
+	const char* szSpace = "rgb";
+	const char* szOrder = "sum";
+	const char* szHistogram = "rgb24";
+	unsigned int uKMeans = 0;
+	unsigned int uSample = 1;
+	unsigned int uEdges = 0;
+	int bAlpha = 0;
+	int bTransparent = 0;
+	int bOpaque = 0;
+	int threads = 0;
+
+	if ( !PyArg_ParseTupleAndKeywords( pArgs, pKeywords, "O|$IssssIIIpppi", const_cast< char** >( kKeywords ), &pImages, &uColours, &szMethod, &szSpace, &szOrder,
+									   &szHistogram, &uKMeans, &uSample, &uEdges, &bAlpha, &bTransparent, &bOpaque, &threads ) )
+	{
+		return nullptr;
+	}
+
+	palgen_settings_t settings;
+	settings.uPaletteSizeReal = uColours;
+	settings.uKMeansIterations = uKMeans;
+	settings.uSampleRate = std::max( uSample, 1u );
+	settings.uEdgeWeight = std::min( uEdges, 64u );
+	settings.bAlpha = ( bAlpha != 0 );
+	settings.bForceTransp = ( bTransparent != 0 );
+	settings.bForceOpaque = ( bOpaque != 0 );
+	settings.uThreadCount = uint32_t( call_threads( threads ) );
+
+	const int method = pick( szMethod, { "median", "octree", "wu" }, "method" );
+	const int space = ( method < 0 ) ? -1 : pick( szSpace, { "rgb", "oklab" }, "space" );
+	const int order = ( space < 0 ) ? -1 : pick( szOrder, { "sum", "adjacent" }, "order" );
+	const int histogram = ( order < 0 ) ? -1 : pick( szHistogram, { "map", "rgb24", "rgb18", "rgb16", "rgb15", "two-level" }, "histogram" );
+	if ( histogram < 0 )
+	{
+		return nullptr;
+	}
+
+	settings.method = method_t( method );
+	settings.colorSpace = color_space_t( space );
+	settings.order = palette_order_t( order );
+	settings.histogram = histogram_t( histogram );
+
+	if ( uColours <= 2 )
+	{
+		PyErr_SetString( PyExc_ValueError, "colours must be more than 2" );
+		return nullptr;
+	}
+
+	if ( settings.bAlpha && ( settings.method != METHOD_MEDIAN_CUT || settings.uKMeansIterations > 0 ) )
+	{
+		PyErr_SetString( PyExc_ValueError, "alpha is only for the median method, without kmeans" );
+		return nullptr;
+	}
+
+	// one image, or a sequence of them.
+	PyObject* pList = nullptr;
+	if ( PyObject_CheckBuffer( pImages ) == 0 )
+	{
+		pList = PySequence_Fast( pImages, "images must be an image or a sequence of images" );
+		if ( pList == nullptr )
+		{
+			return nullptr;
+		}
+	}
+
+	std::vector< image_arg_t > aArgs( pList ? size_t( PySequence_Fast_GET_SIZE( pList ) ) : 1 );
+	for ( size_t i = 0; i < aArgs.size(); ++i )
+	{
+		if ( aArgs[ i ].Get( pList ? PySequence_Fast_GET_ITEM( pList, Py_ssize_t( i ) ) : pImages, "each image" ) == false )
+		{
+			Py_XDECREF( pList );
+			return nullptr;
+		}
+	}
+	Py_XDECREF( pList ); // the views hold the images.
+
+	std::vector< palgen_image_t > aImages( aArgs.size() );
+	for ( size_t i = 0; i < aArgs.size(); ++i )
+	{
+		const image_arg_t& arg = aArgs[ i ];
+		if ( arg.uStride != arg.uWidth * size_t( arg.iChannels ) || arg.uWidth > INT_MAX || arg.uHeight > INT_MAX )
+		{
+			PyErr_SetString( PyExc_ValueError, "palgen's images must have their rows packed (numpy.ascontiguousarray)" );
+			return nullptr;
+		}
+
+		aImages[ i ].pPixels = arg.pPixels;
+		aImages[ i ].iWidth = int( arg.uWidth );
+		aImages[ i ].iHeight = int( arg.uHeight );
+		aImages[ i ].iChannels = arg.iChannels;
+	}
+
+	std::vector< color_t > aPalette;
+	bool bOK = false;
+	if ( run_released( [&]() { bOK = palgen_generate( settings, aImages.data(), aImages.size(), aPalette ); } ) == false )
+	{
+		return nullptr;
+	}
+
+	if ( bOK == false )
+	{
+		PyErr_SetString( PyExc_RuntimeError, "no palette could be made from the images" );
+		return nullptr;
+	}
+
+	array_object_t* pArray = new_array( "I", 4, { Py_ssize_t( aPalette.size() ) } );
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	uint32_t* pOut = reinterpret_cast< uint32_t* >( pArray->pData );
+	for ( const color_t& colour : aPalette )
+	{
+		*pOut++ = ( uint32_t( colour.chan[ 0 ] ) << 16 ) | ( uint32_t( colour.chan[ 1 ] ) << 8 ) | colour.chan[ 2 ];
+	}
+
+	return wrap_array( pArray );
+}
+
+//
+// palpy.apply
+//
+static PyObject* py_apply( PyObject*, PyObject* pArgs, PyObject* pKeywords )
+{
+	static const char* kKeywords[] = { "image", "palette", "match", "transparent", "threads", nullptr };
+
+	PyObject* pImage = nullptr;
+	PyObject* pPalette = nullptr;
+	const char* szMatch = "rgb";
+	int bTransparent = 0;
+	int threads = 0;
+
+	if ( !PyArg_ParseTupleAndKeywords( pArgs, pKeywords, "OO|$spi", const_cast< char** >( kKeywords ), &pImage, &pPalette, &szMatch, &bTransparent, &threads ) )
+	{
+		return nullptr;
+	}
+
+	const int match = pick( szMatch, { "rgb", "lab", "oklab" }, "match" );
+	if ( match < 0 )
+	{
+		return nullptr;
+	}
+
+	image_arg_t image;
+	palette_arg_t palette;
+	if ( image.Get( pImage, "image" ) == false || palette.Get( pPalette, "palette" ) == false )
+	{
+		return nullptr;
+	}
+
+	const size_t uStart = bTransparent ? 1 : 0;
+	if ( palette.uCount > 256 || palette.uCount <= uStart )
+	{
+		PyErr_SetString( PyExc_ValueError, "palette must have 1 to 256 colours, past any transparent index" );
+		return nullptr;
+	}
+
+	array_object_t* pArray = new_array( "B", 1, { Py_ssize_t( image.uHeight ), Py_ssize_t( image.uWidth ) } );
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	const bool bOK = run_released( [&]()
+	{
+		// as palpipe's apply stage: with a transparent index 0, any pixel not opaque is 0.
+		nearest_search_t search;
+		search.Create( palette.pColours + uStart, palette.uCount - uStart, remap_metric_t( match ) );
+
+		parallel_for_state< nearest_memo_t >( 0, image.uHeight, call_threads( threads ), [&]( size_t y, nearest_memo_t& memo )
+		{
+			const uint8_t* p = image.pPixels + y * image.uStride;
+			uint8_t* pOut = pArray->pData + y * image.uWidth;
+
+			for ( size_t x = 0; x < image.uWidth; ++x, p += image.iChannels )
+			{
+				if ( uStart && image.iChannels == 4 && p[ 3 ] != 0xFF )
+				{
+					pOut[ x ] = 0;
+					continue;
+				}
+
+				const uint32_t colour = ( uint32_t( p[ 0 ] ) << 16 ) | ( uint32_t( p[ 1 ] ) << 8 ) | p[ 2 ];
+				pOut[ x ] = uint8_t( uStart + memo.Find( search, colour ) );
+			}
+		} );
+	} );
+
+	if ( bOK == false )
+	{
+		Py_DECREF( pArray );
+		return nullptr;
+	}
+
+	return wrap_array( pArray );
+}
+
+//
+// palpy.resize
+//
+static PyObject* py_resize( PyObject*, PyObject* pArgs, PyObject* pKeywords )
+{
+	static const char* kKeywords[] = { "image", "width", "height", "filter", "linear", "sharpen", "threads", nullptr };
+
+	PyObject* pImage = nullptr;
+	Py_ssize_t width = 0;
+	Py_ssize_t height = 0;
+	const char* szFilter = "lanczos";
+	int bLinear = 0;
+	double fSharpen = 0.0;
+	int threads = 0;
+
+	if ( !PyArg_ParseTupleAndKeywords( pArgs, pKeywords, "Onn|$spdi", const_cast< char** >( kKeywords ), &pImage, &width, &height, &szFilter, &bLinear, &fSharpen, &threads ) )
+	{
+		return nullptr;
+	}
+
+	const int filter = pick( szFilter, { "nearest", "bilinear", "area", "mitchell", "lanczos" }, "filter" );
+	if ( filter < 0 )
+	{
+		return nullptr;
+	}
+
+	if ( width <= 0 || height <= 0 )
+	{
+		PyErr_SetString( PyExc_ValueError, "width and height must be positive" );
+		return nullptr;
+	}
+
+	if ( fSharpen < 0.0 || fSharpen > 1.0 || ( fSharpen > 0.0 && filter == FILTER_NEAREST ) )
+	{
+		PyErr_SetString( PyExc_ValueError, "sharpen must be 0 to 1, and not with the nearest filter" );
+		return nullptr;
+	}
+
+	image_arg_t image;
+	if ( image.Get( pImage, "image" ) == false )
+	{
+		return nullptr;
+	}
+
+	imgsize_settings_t settings;
+	settings.filter = filter_t( filter );
+	settings.bLinear = ( bLinear != 0 );
+	settings.fSharpen = fSharpen;
+	settings.uThreadCount = uint32_t( call_threads( threads ) );
+
+	imgsize_image_t input;
+	input.pPixels = image.pPixels;
+	input.uWidth = image.uWidth;
+	input.uHeight = image.uHeight;
+	input.uStride = image.uStride;
+	input.iChannels = image.iChannels;
+
+	array_object_t* pArray = new_array( "B", 1, { height, width, 4 } );
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	bool bResized = false;
+	if ( run_released( [&]() { bResized = imgsize_resize( settings, input, pArray->pData, size_t( width ), size_t( height ) ); } ) == false || bResized == false )
+	{
+		if ( PyErr_Occurred() == nullptr )
+		{
+			PyErr_SetString( PyExc_ValueError, "the image could not be resized" );
+		}
+		Py_DECREF( pArray );
+		return nullptr;
+	}
+
+	return wrap_array( pArray );
+}
+
+//
+// parse_ramp
+//
+// A ramp of fog's ramps=: ( mode, 0xRRGGBB[, curve] ), the curve "linear", "exp", or a
+// sequence of amounts from 0 to 1 for the steps after the first.
+//
+static bool parse_ramp( PyObject* pItem, ramp_t& ramp )
+{
+	const char* szMode = nullptr;
+	unsigned long colour = 0;
+	PyObject* pCurve = nullptr;
+
+	if ( !PyArg_ParseTuple( pItem, "sk|O", &szMode, &colour, &pCurve ) )
+	{
+		return false;
+	}
+
+	const int mode = pick( szMode, { "fog", "light" }, "ramp mode" );
+	if ( mode < 0 )
+	{
+		return false;
+	}
+
+	ramp.mode = ramp_mode_t( mode );
+	ramp.colour = uint32_t( colour & 0xFFFFFF );
+
+	if ( pCurve == nullptr || pCurve == Py_None )
+	{
+		return true;
+	}
+
+	if ( PyUnicode_Check( pCurve ) )
+	{
+		const int curve = pick( PyUnicode_AsUTF8( pCurve ), { "linear", "exp" }, "curve" );
+		ramp.curve = curve_t( std::max( curve, 0 ) );
+		return curve >= 0;
+	}
+
+	PyObject* pList = PySequence_Fast( pCurve, "a curve must be \"linear\", \"exp\" or a sequence of amounts" );
+	if ( pList == nullptr )
+	{
+		return false;
+	}
+
+	ramp.curve = CURVE_LUT;
+	for ( Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE( pList ); ++i )
+	{
+		const double fAmount = PyFloat_AsDouble( PySequence_Fast_GET_ITEM( pList, i ) );
+		if ( fAmount == -1.0 && PyErr_Occurred() )
+		{
+			Py_DECREF( pList );
+			return false;
+		}
+		ramp.aAmounts.push_back( float( fAmount ) );
+	}
+
+	Py_DECREF( pList );
+	return true;
+}
+
+//
+// palpy.fog
+//
+static PyObject* py_fog( PyObject*, PyObject* pArgs, PyObject* pKeywords )
+{
+	static const char* kKeywords[] = { "palette", "colour", "steps", "ramps", "final", "remap", "threads", nullptr };
+
+	PyObject* pPalette = nullptr;
+	PyObject* pColour = Py_None;
+	int steps = 8;
+	PyObject* pRamps = Py_None;
+	int bFinal = 0;
+	const char* szRemap = nullptr;
+	int threads = 0;
+
+	if ( !PyArg_ParseTupleAndKeywords( pArgs, pKeywords, "O|$OiOpzi", const_cast< char** >( kKeywords ), &pPalette, &pColour, &steps, &pRamps, &bFinal, &szRemap, &threads ) )
+	{
+		return nullptr;
+	}
+
+	if ( steps <= 1 )
+	{
+		PyErr_SetString( PyExc_ValueError, "steps must be more than 1" );
+		return nullptr;
+	}
+
+	fog_settings_t settings;
+	settings.iSteps = steps;
+	settings.bLastStepEqualsFog = ( bFinal != 0 );
+
+	if ( szRemap )
+	{
+		const int metric = pick( szRemap, { "rgb", "lab", "oklab" }, "remap" );
+		if ( metric < 0 )
+		{
+			return nullptr;
+		}
+		settings.bRemap = true;
+		settings.remapMetric = remap_metric_t( metric );
+	}
+
+	if ( pRamps != Py_None )
+	{
+		PyObject* pList = PySequence_Fast( pRamps, "ramps must be a sequence of (mode, colour[, curve])" );
+		if ( pList == nullptr )
+		{
+			return nullptr;
+		}
+
+		for ( Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE( pList ); ++i )
+		{
+			ramp_t ramp;
+			if ( parse_ramp( PySequence_Fast_GET_ITEM( pList, i ), ramp ) == false )
+			{
+				Py_DECREF( pList );
+				return nullptr;
+			}
+			settings.aRamps.push_back( ramp );
+		}
+		Py_DECREF( pList );
+	}
+
+	// as fogpal: the colour= fog comes first, and is the only ramp without any ramps=.
+	if ( pColour != Py_None || settings.aRamps.empty() )
+	{
+		ramp_t fog;
+		if ( pColour != Py_None )
+		{
+			fog.colour = uint32_t( PyLong_AsUnsignedLong( pColour ) & 0xFFFFFF );
+			if ( PyErr_Occurred() )
+			{
+				return nullptr;
+			}
+		}
+		settings.aRamps.insert( settings.aRamps.begin(), fog );
+	}
+
+	palette_arg_t palette;
+	if ( palette.Get( pPalette, "palette" ) == false )
+	{
+		return nullptr;
+	}
+
+	const size_t levels = fog_levels( settings );
+	array_object_t* pArray = new_array( "I", 4, { Py_ssize_t( levels ), Py_ssize_t( palette.uCount ) } );
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	const bool bOK = run_released( [&]()
+	{
+		fog_palette_t source;
+		source.Create( palette.pColours, palette.uCount );
+		if ( settings.bRemap )
+		{
+			source.AddRemap( settings.remapMetric );
+		}
+
+		fog_generate( source, settings, reinterpret_cast< uint32_t* >( pArray->pData ), nullptr, call_threads( threads ) );
+	} );
+
+	if ( bOK == false )
+	{
+		Py_DECREF( pArray );
+		return nullptr;
+	}
+
+	return wrap_array( pArray );
+}
+
+// units= of the numexpr functions.
+static bool parse_units( const char* szUnits, Numeric::UnitType& type )
+{
+	const int units = pick( szUnits, { "generic", "metric", "imperial" }, "units" );
+	type = Numeric::UnitType( std::max( units, 0 ) );
+	return units >= 0;
+}
+
+//
+// palpy.numexpr
+//
+static PyObject* py_numexpr( PyObject*, PyObject* pArgs, PyObject* pKeywords )
+{
+	static const char* kKeywords[] = { "expression", "units", "previous", nullptr };
+
+	const char* szExpression = nullptr;
+	const char* szUnits = "generic";
+	PyObject* pPrevious = Py_None;
+
+	if ( !PyArg_ParseTupleAndKeywords( pArgs, pKeywords, "s|$sO", const_cast< char** >( kKeywords ), &szExpression, &szUnits, &pPrevious ) )
+	{
+		return nullptr;
+	}
+
+	Numeric::UnitType type;
+	if ( parse_units( szUnits, type ) == false )
+	{
+		return nullptr;
+	}
+
+	Numeric::Compiler compiler;
+	compiler.SetUnitOut( type );
+
+	// the previous solution, for %, is a number in the default units.
+	Numeric::Solution previous{ 0.0, compiler.DefaultUnit() };
+	if ( pPrevious != Py_None )
+	{
+		previous.value = PyFloat_AsDouble( pPrevious );
+		if ( previous.value == -1.0 && PyErr_Occurred() )
+		{
+			return nullptr;
+		}
+	}
+
+	Numeric::Result< Numeric::Solution > result;
+	std::string strText;
+	if ( run_released( [&]()
+	{
+		result = compiler.TryEval( szExpression, ( pPrevious != Py_None ) ? &previous : nullptr );
+		if ( result.ok() )
+		{
+			compiler.Format( result.value, strText );
+		}
+	} ) == false )
+	{
+		return nullptr;
+	}
+
+	if ( result.ok() == false )
+	{
+		PyErr_SetString( PyExc_ValueError, Numeric::ErrorMessage( result.error ).c_str() );
+		return nullptr;
+	}
+
+	return Py_BuildValue( "(ds)", result.value.value, strText.c_str() );
+}
+
+//
+// palpy.numexpr_batch
+//
+static PyObject* py_numexpr_batch( PyObject*, PyObject* pArgs, PyObject* pKeywords )
+{
+	static const char* kKeywords[] = { "expression", "symbols", "units", nullptr };
+
+	const char* szExpression = nullptr;
+	PyObject* pSymbols = nullptr;
+	const char* szUnits = "generic";
+
+	if ( !PyArg_ParseTupleAndKeywords( pArgs, pKeywords, "sO!|$s", const_cast< char** >( kKeywords ), &szExpression, &PyDict_Type, &pSymbols, &szUnits ) )
+	{
+		return nullptr;
+	}
+
+	Numeric::UnitType type;
+	if ( parse_units( szUnits, type ) == false )
+	{
+		return nullptr;
+	}
+
+	Numeric::Compiler compiler;
+	compiler.SetUnitOut( type );
+
+	// each symbol's column, a float64 value for every row, bound to a slot of its own.
+	const Py_ssize_t count = PyDict_Size( pSymbols );
+	std::vector< view_t > aViews( static_cast< size_t >( count ) );
+	std::vector< Numeric::SymbolColumn > aColumns( static_cast< size_t >( count ) );
+	Py_ssize_t rows = -1;
+
+	PyObject* pKey = nullptr;
+	PyObject* pValue = nullptr;
+	Py_ssize_t pos = 0;
+	for ( uint32_t slot = 0; PyDict_Next( pSymbols, &pos, &pKey, &pValue ); ++slot )
+	{
+		const char* szName = PyUnicode_Check( pKey ) ? PyUnicode_AsUTF8( pKey ) : nullptr;
+		if ( szName == nullptr )
+		{
+			PyErr_SetString( PyExc_TypeError, "symbols must be named by strings" );
+			return nullptr;
+		}
+
+		view_t& view = aViews[ slot ];
+		if ( view.Get( pValue ) == false )
+		{
+			return nullptr;
+		}
+
+		if ( view.buffer.itemsize != 8 || view.Format() != 'd' || view.buffer.ndim != 1 || view.buffer.strides[ 0 ] != 8 || ( rows >= 0 && view.buffer.shape[ 0 ] != rows ) )
+		{
+			PyErr_Format( PyExc_ValueError, "symbol \"%s\" must be a (rows) array of float64, as long as the others", szName );
+			return nullptr;
+		}
+
+		rows = view.buffer.shape[ 0 ];
+		aColumns[ slot ].pValues = static_cast< const double* >( view.buffer.buf );
+		aColumns[ slot ].units = compiler.DefaultUnit();
+		compiler.DefineSymbol( szName, slot );
+	}
+
+	rows = std::max< Py_ssize_t >( rows, 1 );
+
+	array_object_t* pArray = new_array( "d", 8, { rows } );
+	if ( pArray == nullptr )
+	{
+		return nullptr;
+	}
+
+	Numeric::Result< Numeric::CompiledExpression > compiled;
+	const bool bOK = run_released( [&]()
+	{
+		compiled = compiler.TryCompile( szExpression );
+		if ( compiled.ok() == false )
+		{
+			return;
+		}
+
+		std::vector< Numeric::Solution > aSolutions( static_cast< size_t >( rows ) );
+		compiled.value.EvalBatch( nullptr, aColumns.data(), aSolutions.size(), aSolutions.data() );
+
+		double* pOut = reinterpret_cast< double* >( pArray->pData );
+		for ( const Numeric::Solution& solution : aSolutions )
+		{
+			*pOut++ = solution.value;
+		}
+	} );
+
+	if ( bOK == false || compiled.ok() == false )
+	{
+		if ( PyErr_Occurred() == nullptr )
+		{
+			PyErr_SetString( PyExc_ValueError, Numeric::ErrorMessage( compiled.error ).c_str() );
+		}
+		Py_DECREF( pArray );
+		return nullptr;
+	}
+
+	return wrap_array( pArray );
+}
+
+//=============================================================================
+
+static PyMethodDef s_aMethods[] =
+{
+	{ "palgen", reinterpret_cast< PyCFunction >( reinterpret_cast< void* >( py_palgen ) ), METH_VARARGS | METH_KEYWORDS,
+	  "palgen(images, *, colours=256, method='median', space='rgb', order='sum', histogram='rgb24', kmeans=0, sample=1,\n"
+	  "       edges=0, alpha=False, transparent=False, opaque=False, threads=0)\n"
+	  "A palette for an image or a sequence of them, as uint32 0xRRGGBB; a transparent index comes first." },
+	{ "apply", reinterpret_cast< PyCFunction >( reinterpret_cast< void* >( py_apply ) ), METH_VARARGS | METH_KEYWORDS,
+	  "apply(image, palette, *, match='rgb', transparent=False, threads=0)\n"
+	  "The (height, width) uint8 index of the nearest palette colour to each pixel, by 'rgb', 'lab' or 'oklab'.\n"
+	  "With transparent, index 0 is left for pixels that are not opaque." },
+	{ "resize", reinterpret_cast< PyCFunction >( reinterpret_cast< void* >( py_resize ) ), METH_VARARGS | METH_KEYWORDS,
+	  "resize(image, width, height, *, filter='lanczos', linear=False, sharpen=0.0, threads=0)\n"
+	  "The image resampled to (height, width, 4) uint8 RGBA with imgsize's nearest, bilinear, area, mitchell or lanczos." },
+	{ "fog", reinterpret_cast< PyCFunction >( reinterpret_cast< void* >( py_fog ) ), METH_VARARGS | METH_KEYWORDS,
+	  "fog(palette, *, colour=None, steps=8, ramps=None, final=False, remap=None, threads=0)\n"
+	  "fogpal's table for a palette: (levels, count) uint32, level 0 the palette. ramps are (mode, colour[, curve]),\n"
+	  "mode 'fog' or 'light', curve 'linear', 'exp' or a sequence of amounts; remap is 'rgb', 'lab' or 'oklab'." },
+	{ "numexpr", reinterpret_cast< PyCFunction >( reinterpret_cast< void* >( py_numexpr ) ), METH_VARARGS | METH_KEYWORDS,
+	  "numexpr(expression, *, units='generic', previous=None)\n"
+	  "The value of an expression with units, and its formatted text, in 'generic', 'metric' or 'imperial' units." },
+	{ "numexpr_batch", reinterpret_cast< PyCFunction >( reinterpret_cast< void* >( py_numexpr_batch ) ), METH_VARARGS | METH_KEYWORDS,
+	  "numexpr_batch(expression, symbols, *, units='generic')\n"
+	  "The expression for every row of its symbols, a dict of name to (rows) float64 array: (rows) float64." },
+	{ nullptr, nullptr, 0, nullptr }
+};
+
+static PyModuleDef s_module =
+{
+	PyModuleDef_HEAD_INIT, "palpy",
+	"Palette generation, palette application, resizing, fog tables and numeric expressions, over numpy arrays.",
+	-1, s_aMethods
+};
+
+PyMODINIT_FUNC PyInit_palpy()
+{
+	s_array_type.tp_name = "palpy.array";
+	s_array_type.tp_doc = "A result's memory, shared with the numpy array or memoryview over it.";
+	s_array_type.tp_basicsize = sizeof( array_object_t );
+	s_array_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	s_array_type.tp_dealloc = array_dealloc;
+	s_array_type.tp_as_buffer = &s_array_buffer;
+
+	if ( PyType_Ready( &s_array_type ) < 0 )
+	{
+		return nullptr;
+	}
+
+	// results are numpy arrays when there is numpy to hand.
+	PyObject* pNumpy = PyImport_ImportModule( "numpy" );
+	if ( pNumpy )
+	{
+		s_pAsArray = PyObject_GetAttrString( pNumpy, "asarray" );
+		Py_DECREF( pNumpy );
+	}
+	PyErr_Clear();
+
+	return PyModule_Create( &s_module );
+}
+
+//=============================================================================